@@ -35,6 +35,7 @@
 #include "spindump_analyze_quic.h"
 #include "spindump_analyze_icmp.h"
 #include "spindump_analyze_aggregate.h"
+#include "spindump_table_eviction.h"
 #include "spindump_event.h"
 
 //
@@ -44,26 +45,39 @@
 static void
 spindump_analyze_process_null(struct spindump_analyze* state,
                               struct spindump_packet* packet,
-                              const struct timeval* timestamp,
+                              const spindump_time* timestamp,
                               struct spindump_connection** p_connection);
 static void
 spindump_analyze_process_ethernet(struct spindump_analyze* state,
                                   struct spindump_packet* packet,
-                                  const struct timeval* timestamp,
+                                  const spindump_time* timestamp,
                                   struct spindump_connection** p_connection);
 static void
 spindump_analyze_process_linux_sll(struct spindump_analyze* state,
                                    struct spindump_packet* packet,
-                                   const struct timeval* timestamp,
+                                   const spindump_time* timestamp,
                                    struct spindump_connection** p_connection);
 static void
 spindump_analyze_process_raw(struct spindump_analyze* state,
                              struct spindump_packet* packet,
-                             const struct timeval* timestamp,
+                             const spindump_time* timestamp,
                              struct spindump_connection** p_connection);
-static int
-spindump_analyze_connectionspecifichandlerstillinuse(struct spindump_analyze* state,
-                                                     spindump_handler_mask mask);
+static unsigned int
+spindump_analyze_eventindex(spindump_analyze_event event);
+static void
+spindump_analyze_rebuildhandlerlists(struct spindump_analyze* state);
+static void
+spindump_analyze_deletehandler(struct spindump_analyze* state,
+                               unsigned int i);
+static inline void
+spindump_analyze_process_handler(struct spindump_analyze* state,
+                                 unsigned int i,
+                                 spindump_analyze_event event,
+                                 const spindump_time* timestamp,
+                                 const int fromResponder,
+                                 const unsigned int ipPacketLength,
+                                 struct spindump_packet* packet,
+                                 struct spindump_connection* connection);
 
 //
 // Actual code --------------------------------------------------------------------------------
@@ -163,7 +177,79 @@ spindump_analyze_uninitialize(struct spindump_analyze* state) {
 }
 
 //
-// Register a handler for specific events
+// Find the position of an event in the per-event handler lists,
+// i.e., the position of its bit in spindump_analyze_event
+//
+
+static unsigned int
+spindump_analyze_eventindex(spindump_analyze_event event) {
+  spindump_assert(event != 0);
+  spindump_assert((event & (event - 1)) == 0);
+  unsigned int index = 0;
+  while ((event >>= 1) != 0) index++;
+  spindump_assert(index < spindump_analyze_nevents);
+  return(index);
+}
+
+//
+// Rebuild the per-event lists of handlers, after a handler has been
+// registered or deregistered. The lists keep the order of the
+// handler table.
+//
+
+static void
+spindump_analyze_rebuildhandlerlists(struct spindump_analyze* state) {
+  for (unsigned int e = 0; e < spindump_analyze_nevents; e++) {
+    spindump_analyze_event event = (spindump_analyze_event)1 << e;
+    struct spindump_analyze_handlerlist* global = &state->globalHandlers[e];
+    struct spindump_analyze_handlerlist* specific = &state->connectionHandlers[e];
+    global->nHandlers = 0;
+    specific->nHandlers = 0;
+    for (unsigned int i = 0; i < state->nHandlers; i++) {
+      const struct spindump_analyze_handler* handler = &state->handlers[i];
+      if ((handler->eventmask & event) == 0) continue;
+      if (handler->connectionSpecific) {
+        specific->handlers[specific->nHandlers++] = (uint8_t)i;
+      } else {
+        global->handlers[global->nHandlers++] = (uint8_t)i;
+      }
+    }
+  }
+}
+
+//
+// Remove a handler from the table of handlers
+//
+
+static void
+spindump_analyze_deletehandler(struct spindump_analyze* state,
+                               unsigned int i) {
+  
+  spindump_assert(i < state->nHandlers);
+  spindump_assert(state->handlerRefCounts[i] == 0);
+  struct spindump_analyze_handler* handlerPtr = &state->handlers[i];
+  handlerPtr->eventmask = 0;
+  handlerPtr->connectionSpecific = 0;
+  handlerPtr->function = 0;
+  handlerPtr->handlerData = 0;
+
+  //
+  // Also decrease nHandlers if this was the last item in the array
+  //
+  
+  while (state->nHandlers > 0 &&
+         state->handlers[state->nHandlers - 1].function == 0) {
+    state->nHandlers--;
+  }
+  
+  spindump_analyze_rebuildhandlerlists(state);
+}
+
+//
+// Register a handler for specific events. If connection is non-null,
+// the handler is called only for events on that connection; the same
+// connection-specific handler may be registered for any number of
+// connections.
 //
 
 void
@@ -182,19 +268,60 @@ spindump_analyze_registerhandler(struct spindump_analyze* state,
   spindump_assert(handler != 0);
 
   //
-  // Do we have space for this handler?
+  // Look for an earlier registration of the same connection-specific
+  // handler, and otherwise for a free slot for this handler
   //
 
-  if (state->nHandlers == spindump_analyze_max_handlers) {
-    spindump_errorf("cannot add any more handlers, supporting only max %u handlers", spindump_analyze_max_handlers);
-    return;
+  unsigned int i;
+  unsigned int freeSlot = state->nHandlers;
+  for (i = 0; i < state->nHandlers; i++) {
+    const struct spindump_analyze_handler* handlerPtr = &state->handlers[i];
+    if (connection != 0 &&
+        handlerPtr->connectionSpecific &&
+        handlerPtr->eventmask == eventmask &&
+        handlerPtr->function == handler &&
+        handlerPtr->handlerData == handlerData) {
+      break;
+    }
+    if (handlerPtr->function == 0 && freeSlot == state->nHandlers) freeSlot = i;
+  }
+  
+  if (i == state->nHandlers) {
+    
+    //
+    // Do we have space for this handler?
+    //
+    
+    if (freeSlot == spindump_analyze_max_handlers) {
+      spindump_errorf("cannot add any more handlers, supporting only max %u handlers", spindump_analyze_max_handlers);
+      return;
+    }
+    
+    i = freeSlot;
+    state->handlers[i].eventmask = eventmask;
+    state->handlers[i].connectionSpecific = (connection != 0);
+    state->handlers[i].function = handler;
+    state->handlers[i].handlerData = handlerData;
+    state->handlerRefCounts[i] = 0;
+    if (i == state->nHandlers) state->nHandlers++;
+    spindump_analyze_rebuildhandlerlists(state);
+    spindump_deepdeepdebugf("registered %uth handler %lx for %u", i, (unsigned long)handler, eventmask);
+    
   }
 
-  state->handlers[state->nHandlers].eventmask = eventmask;
-  state->handlers[state->nHandlers].function = handler;
-  state->handlers[state->nHandlers].handlerData = handlerData;
-  spindump_deepdeepdebugf("registered %uth handler %lx for %u", state->nHandlers, (unsigned long)handler, eventmask);
-  state->nHandlers++;
+  //
+  // For connection-specific handlers, mark the handler in the
+  // connection's bit mask, and count the connections using the
+  // handler
+  //
+
+  if (connection != 0) {
+    spindump_handler_mask mask = ((spindump_handler_mask)1 << i);
+    if ((connection->handlerMask & mask) == 0) {
+      connection->handlerMask |= mask;
+      state->handlerRefCounts[i]++;
+    }
+  }
 }
 
 //
@@ -237,7 +364,7 @@ spindump_analyze_unregisterhandler(struct spindump_analyze* state,
 
       if (connection != 0) {
         
-        spindump_handler_mask mask = (1 << i);
+        spindump_handler_mask mask = ((spindump_handler_mask)1 << i);
         
         //
         // Check that the mask was on
@@ -245,6 +372,7 @@ spindump_analyze_unregisterhandler(struct spindump_analyze* state,
         
         if ((connection->handlerMask & mask) == 0) {
           spindump_errorf("unregistering a handler for a connection for which it was not registered");
+          return;
         }
 
         //
@@ -260,7 +388,9 @@ spindump_analyze_unregisterhandler(struct spindump_analyze* state,
         // rather just the deletion from the bit mask is enough.
         //
         
-        if (spindump_analyze_connectionspecifichandlerstillinuse(state,mask)) {
+        spindump_assert(state->handlerRefCounts[i] > 0);
+        state->handlerRefCounts[i]--;
+        if (state->handlerRefCounts[i] > 0) {
           spindump_deepdebugf("connection-specific handler is still in use by some other connections");
           return;
         }
@@ -270,26 +400,7 @@ spindump_analyze_unregisterhandler(struct spindump_analyze* state,
       // Found the matching registration. Delete it.
       //
       
-      handlerPtr->eventmask = 0;
-      handlerPtr->connectionSpecific = 0;
-      handlerPtr->function = 0;
-      handlerPtr->handlerData = 0;
-
-      //
-      // Also decrease nHandlers if this was the last item in the array
-      //
-      
-      while (i == state->nHandlers - 1 &&
-             state->nHandlers > 0 &&
-             handlerPtr->eventmask == 0 &&
-             handlerPtr->function == 0 &&
-             handlerPtr->handlerData == 0) {
-        state->nHandlers--;
-        if  (state->nHandlers > 0) {
-          i = state->nHandlers - 1;
-          handlerPtr = &state->handlers[i];
-        }
-      }
+      spindump_analyze_deletehandler(state,i);
       
       //
       // Done. Return.
@@ -306,33 +417,61 @@ spindump_analyze_unregisterhandler(struct spindump_analyze* state,
   spindump_errorf("de-registering a non-registered handler");
 }
 
-static int
-spindump_analyze_connectionspecifichandlerstillinuse(struct spindump_analyze* state,
-                                                     spindump_handler_mask mask) {
-  for (unsigned int i = 0; i < state->table->nConnections; i++) {
-    
-    struct spindump_connection* connection = state->table->connections[i];
-    
-    if (connection != 0 &&
-        (connection->handlerMask & mask) != 0) {
-      
-      //
-      // Found. Return 1.
-      //
-      
-      return(1);
-      
-    }
-    
+//
+// De-register all connection-specific handlers of a connection that
+// is about to be deleted. Handlers that are no longer used by any
+// connection are removed.
+//
+
+void
+spindump_analyze_unregisterconnectionhandlers(struct spindump_analyze* state,
+                                              struct spindump_connection* connection) {
+  spindump_assert(state != 0);
+  spindump_assert(connection != 0);
+  for (unsigned int i = 0; connection->handlerMask != 0 && i < state->nHandlers; i++) {
+    spindump_handler_mask mask = ((spindump_handler_mask)1 << i);
+    if ((connection->handlerMask & mask) == 0) continue;
+    connection->handlerMask &= (~mask);
+    spindump_assert(state->handlers[i].connectionSpecific);
+    spindump_assert(state->handlerRefCounts[i] > 0);
+    state->handlerRefCounts[i]--;
+    if (state->handlerRefCounts[i] == 0) spindump_analyze_deletehandler(state,i);
   }
-  
-  //
-  // Not found
-  //
-  
-  return(0);
 }
-                                   
+
+//
+// Call one handler
+//
+
+static inline void
+spindump_analyze_process_handler(struct spindump_analyze* state,
+                                 unsigned int i,
+                                 spindump_analyze_event event,
+                                 const spindump_time* timestamp,
+                                 const int fromResponder,
+                                 const unsigned int ipPacketLength,
+                                 struct spindump_packet* packet,
+                                 struct spindump_connection* connection) {
+  struct spindump_analyze_handler* handler = &state->handlers[i];
+  spindump_assert(spindump_analyze_max_handlers == spindump_connection_max_handlers);
+  spindump_assert(i < spindump_connection_max_handlers);
+  spindump_assert((handler->eventmask & event) != 0);
+  state->stats->analyzerHandlerCalls++;
+  spindump_deepdebugf("calling %uth handler %x (%lx)",
+                      state->stats->analyzerHandlerCalls,
+                      handler->eventmask,
+                      (unsigned long)handler->function);
+  (*(handler->function))(state,
+                         handler->handlerData,
+                         &connection->handlerConnectionDatas[i],
+                         event,
+                         timestamp,
+                         fromResponder,
+                         ipPacketLength,
+                         packet,
+                         connection);
+}
+
 //
 // Run all the handlers for a specific event
 //
@@ -340,7 +479,7 @@ spindump_analyze_connectionspecifichandlerstillinuse(struct spindump_analyze* st
 void
 spindump_analyze_process_handlers(struct spindump_analyze* state,
                                   spindump_analyze_event event,
-                                  const struct timeval* timestamp,
+                                  const spindump_time* timestamp,
                                   const int fromResponder,
                                   const unsigned int ipPacketLength,
                                   struct spindump_packet* packet,
@@ -361,29 +500,26 @@ spindump_analyze_process_handlers(struct spindump_analyze* state,
   spindump_assert(packet == 0 || spindump_packet_isvalid(packet));
   
   //
-  // Scan through the registered handlers and execute them if they
-  // match this event
+  // Execute the handlers registered for this event, first the global
+  // ones, and then the connection-specific ones that have been
+  // registered for this connection
   //
   
-  for (unsigned int i = 0; i < state->nHandlers; i++) {
-    struct spindump_analyze_handler* handler = &state->handlers[i];
-    if ((handler->eventmask & event) != 0) {
-      spindump_assert(spindump_analyze_max_handlers == spindump_connection_max_handlers);
-      spindump_assert(i < spindump_connection_max_handlers);
-      state->stats->analyzerHandlerCalls++;
-      spindump_deepdebugf("calling %uth handler %x (%lx)",
-                          state->stats->analyzerHandlerCalls,
-                          handler->eventmask,
-                          (unsigned long)handler->function);
-      (*(handler->function))(state,
-                             handler->handlerData,
-                             &connection->handlerConnectionDatas[i],
-                             event,
-                             timestamp,
-                             fromResponder,
-                             ipPacketLength,
-                             packet,
-                             connection);
+  unsigned int index = spindump_analyze_eventindex(event);
+  const struct spindump_analyze_handlerlist* global = &state->globalHandlers[index];
+  for (unsigned int k = 0; k < global->nHandlers; k++) {
+    spindump_analyze_process_handler(state,global->handlers[k],
+                                     event,timestamp,fromResponder,ipPacketLength,packet,connection);
+  }
+  
+  if (connection->handlerMask != 0) {
+    const struct spindump_analyze_handlerlist* specific = &state->connectionHandlers[index];
+    for (unsigned int k = 0; k < specific->nHandlers; k++) {
+      unsigned int i = specific->handlers[k];
+      if ((connection->handlerMask & ((spindump_handler_mask)1 << i)) != 0) {
+        spindump_analyze_process_handler(state,i,
+                                         event,timestamp,fromResponder,ipPacketLength,packet,connection);
+      }
     }
   }
   
@@ -455,6 +591,127 @@ spindump_analyze_getdestination(struct spindump_packet* packet,
   }
 }
 
+//
+// Get the source and destination IP addresses of a packet, without
+// analyzing the packet otherwise. The datalink layer is parsed in the
+// same way as when the packet is processed. Return 1 if the packet
+// has an IPv4 or IPv6 header, and 0 otherwise.
+//
+
+int
+spindump_analyze_getaddresses(enum spindump_capture_linktype linktype,
+                              struct spindump_packet* packet,
+                              spindump_address* source,
+                              spindump_address* destination) {
+  spindump_assert(spindump_packet_isvalid(packet));
+  spindump_assert(source != 0);
+  spindump_assert(destination != 0);
+
+  //
+  // Find the IP header
+  //
+
+  unsigned int position;
+  uint8_t ipVersion;
+  switch (linktype) {
+
+  case spindump_capture_linktype_null:
+    {
+      if (packet->etherlen < spindump_null_header_size ||
+          packet->caplen < spindump_null_header_size) return(0);
+      uint32_t nullInt;
+      memcpy(&nullInt,packet->contents,sizeof(nullInt));
+      switch (nullInt) {
+      case 0x00000002:
+      case 0x02000000:
+        ipVersion = 4;
+        break;
+      case 0x00000016:
+      case 0x16000000:
+      case 0x0000001C:
+      case 0x1C000000:
+      case 0x0000001E:
+      case 0x1E000000:
+        ipVersion = 6;
+        break;
+      default:
+        return(0);
+      }
+      position = spindump_null_header_size;
+    }
+    break;
+
+  case spindump_capture_linktype_ethernet:
+    {
+      if (packet->etherlen < spindump_ethernet_header_size ||
+          packet->caplen < spindump_ethernet_header_size) return(0);
+      struct spindump_ethernet ethernet;
+      spindump_protocols_ethernet_header_decode(packet->contents,&ethernet);
+      switch (ethernet.ether_type) {
+      case spindump_ethertype_ip:
+        ipVersion = 4;
+        break;
+      case spindump_ethertype_ip6:
+        ipVersion = 6;
+        break;
+      default:
+        return(0);
+      }
+      position = spindump_ethernet_header_size;
+    }
+    break;
+
+  case spindump_capture_linktype_linux_sll:
+    {
+      if (packet->etherlen < spindump_linux_sll_header_size ||
+          packet->caplen < spindump_linux_sll_header_size) return(0);
+      uint16_t protoType;
+      memcpy(&protoType,packet->contents + 14,sizeof(protoType));
+      switch (protoType) {
+      case 0x0800:
+      case 0x0008:
+        ipVersion = 4;
+        break;
+      case 0x86DD:
+      case 0xDD86:
+        ipVersion = 6;
+        break;
+      default:
+        return(0);
+      }
+      position = spindump_linux_sll_header_size;
+    }
+    break;
+
+  case spindump_capture_linktype_raw:
+    if (packet->caplen < 1) return(0);
+    ipVersion = packet->contents[0] >> 4;
+    position = 0;
+    break;
+
+  default:
+    return(0);
+
+  }
+
+  //
+  // Check that the IP header is there, and get the addresses from it
+  //
+
+  if (ipVersion == 4) {
+    if (packet->caplen < position + sizeof(struct spindump_ip) ||
+        (packet->contents[position] >> 4) != 4) return(0);
+  } else if (ipVersion == 6) {
+    if (packet->caplen < position + sizeof(struct spindump_ip6) ||
+        (packet->contents[position] >> 4) != 6) return(0);
+  } else {
+    return(0);
+  }
+  spindump_analyze_getsource(packet,ipVersion,position,source);
+  spindump_analyze_getdestination(packet,ipVersion,position,destination);
+  return(1);
+}
+
 //
 // This is the main function to process an incoming packet, and decide
 // what category it falls under, and then process it
@@ -490,8 +747,7 @@ spindump_analyze_process(struct spindump_analyze* state,
   //
   
   if (state->firstEventTime == 0) {
-    state->firstEventTime = (((unsigned long long)(packet->timestamp.tv_sec)) * 1000 * 1000 +
-                             (unsigned long long)packet->timestamp.tv_usec);
+    spindump_time_to_timestamp(&packet->timestamp,&state->firstEventTime);
   }
   
   //
@@ -506,6 +762,7 @@ spindump_analyze_process(struct spindump_analyze* state,
   // Switch based on type of L2
   //
 
+  *p_connection = 0;
   switch (linktype) {
   case spindump_capture_linktype_null:
     spindump_analyze_process_null(state,packet,&packet->timestamp,p_connection);
@@ -522,6 +779,51 @@ spindump_analyze_process(struct spindump_analyze* state,
   default:
     spindump_errorf("unsupported linktype");
   }
+  
+  //
+  // The packet may have changed the timeout of the connection, and
+  // the connection is now the most recently active one
+  //
+  
+  if (*p_connection != 0) {
+    spindump_connectionstable_updatetimeout(state->table,*p_connection);
+    spindump_connectionstable_eviction_touch(state->table,*p_connection);
+  }
+}
+
+//
+// Process a batch of nPackets packets, as returned by
+// spindump_capture_nextbatch. This is equivalent to calling
+// spindump_analyze_process for each packet in turn, except that the
+// headers of the next packet are prefetched while the current packet
+// is being analyzed.
+//
+
+void
+spindump_analyze_process_batch(struct spindump_analyze* state,
+                               enum spindump_capture_linktype linktype,
+                               struct spindump_packet* packets,
+                               unsigned int nPackets) {
+
+  //
+  // Checks
+  //
+
+  spindump_assert(state != 0);
+  spindump_assert(packets != 0 || nPackets == 0);
+
+  //
+  // Process the packets
+  //
+  
+  for (unsigned int i = 0; i < nPackets; i++) {
+    struct spindump_connection* connection = 0;
+    if (i + 1 < nPackets) {
+      __builtin_prefetch(packets[i+1].contents);
+      __builtin_prefetch(packets[i+1].contents + 64);
+    }
+    spindump_analyze_process(state,linktype,&packets[i],&connection);
+  }
 }
 
 //
@@ -532,7 +834,7 @@ spindump_analyze_process(struct spindump_analyze* state,
 static void
 spindump_analyze_process_null(struct spindump_analyze* state,
                               struct spindump_packet* packet,
-                              const struct timeval* timestamp,
+                              const spindump_time* timestamp,
                               struct spindump_connection** p_connection) {
   //
   // Check there is enough of the null header. As pcap_datalink man page says:
@@ -618,7 +920,7 @@ spindump_analyze_process_null(struct spindump_analyze* state,
 void
 spindump_analyze_process_ethernet(struct spindump_analyze* state,
                                   struct spindump_packet* packet,
-                                  const struct timeval* timestamp,
+                                  const spindump_time* timestamp,
                                   struct spindump_connection** p_connection) {
   //
   // Check there is enough of the Ethernet header
@@ -694,7 +996,7 @@ spindump_analyze_process_ethernet(struct spindump_analyze* state,
 void
 spindump_analyze_process_linux_sll(struct spindump_analyze* state,
                                    struct spindump_packet* packet,
-                                   const struct timeval* timestamp,
+                                   const spindump_time* timestamp,
                                    struct spindump_connection** p_connection) {
   
   //
@@ -753,7 +1055,7 @@ spindump_analyze_process_linux_sll(struct spindump_analyze* state,
 void
 spindump_analyze_process_raw(struct spindump_analyze* state,
                                   struct spindump_packet* packet,
-                                  const struct timeval* timestamp,
+                                  const spindump_time* timestamp,
                                   struct spindump_connection** p_connection) {
   if (packet->caplen < 1) {
     spindump_warnf("empty packet");
@@ -794,7 +1096,7 @@ spindump_analyze_process_raw(struct spindump_analyze* state,
 void
 spindump_analyze_process_pakstats(struct spindump_analyze* state,
                                   struct spindump_connection* connection,
-                                  const struct timeval* timestamp,
+                                  const spindump_time* timestamp,
                                   const int fromResponder,
                                   struct spindump_packet* packet,
                                   unsigned int ipPacketLength,
@@ -813,6 +1115,24 @@ spindump_analyze_process_pakstats(struct spindump_analyze* state,
   spindump_deepdeepdebugf("pakstats got a packet of length %u for a connection of type %s",
                           ipPacketLength,
                           spindump_connection_type_to_string(connection->type));
+
+  //
+  // If aggregates are updated elsewhere, only pass the update on
+  //
+
+  if (state->table->aggregateUpdateHandler != 0 && spindump_connections_isaggregate(connection)) {
+    struct spindump_connectionstable_aggregateupdate update;
+    memset(&update,0,sizeof(update));
+    update.type = spindump_connectionstable_aggregateupdate_packet;
+    update.aggregate = connection;
+    update.timestamp = *timestamp;
+    update.fromResponder = fromResponder;
+    update.ipPacketLength = ipPacketLength;
+    update.ecnFlags = ecnFlags;
+    update.handled = (packet->analyzerHandlerCalls != state->stats->analyzerHandlerCalls);
+    (*state->table->aggregateUpdateHandler)(&update,state->table->aggregateUpdateHandlerData);
+    return;
+  }
   
   //
   // Update the statistics based on whether the packet was from side1
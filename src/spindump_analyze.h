@@ -64,6 +64,7 @@ typedef uint32_t spindump_analyze_event;
 #define spindump_analyze_event_periodic                        4194304
 
 #define spindump_analyze_event_alllegal                        8388607
+#define spindump_analyze_nevents                                    23 // number of different events
 
 struct spindump_analyze;
 struct spindump_event;
@@ -72,7 +73,7 @@ typedef void (*spindump_analyze_handler)(struct spindump_analyze* state,
                                          void* handlerData,
                                          void** handlerConnectionData,
                                          spindump_analyze_event event,
-                                         const struct timeval* timestamp,
+                                         const spindump_time* timestamp,
                                          const int fromResponder,
                                          const unsigned int ipPacketLength,
                                          struct spindump_packet* packet,
@@ -89,6 +90,11 @@ struct spindump_analyze_handler {
   char padding[2];                                 // unused
 };
 
+struct spindump_analyze_handlerlist {
+  unsigned int nHandlers;                          // the number of handlers in the list
+  uint8_t handlers[spindump_analyze_max_handlers]; // indexes of the handlers in the analyzer's table of handlers
+};
+
 struct spindump_analyze {
   int showRelativeTime;                            // Whether reports are in absolute or relative time
   unsigned long long firstEventTime;               // The time of the first event reported in this Spindump run
@@ -98,6 +104,12 @@ struct spindump_analyze {
   unsigned int padding;                            // unused
   struct spindump_analyze_handler
     handlers[spindump_analyze_max_handlers];       // the registered handlers
+  unsigned int
+    handlerRefCounts[spindump_analyze_max_handlers];// for connection-specific handlers, the number of connections using them
+  struct spindump_analyze_handlerlist
+    globalHandlers[spindump_analyze_nevents];      // global handlers matching each event, by event bit position
+  struct spindump_analyze_handlerlist
+    connectionHandlers[spindump_analyze_nevents];  // connection-specific handlers matching each event, by event bit position
 };
 
 //
@@ -125,6 +137,9 @@ spindump_analyze_unregisterhandler(struct spindump_analyze* state,
                                    struct spindump_connection* connection,
                                    spindump_analyze_handler handler,
                                    void* handlerData);
+void
+spindump_analyze_unregisterconnectionhandlers(struct spindump_analyze* state,
+                                              struct spindump_connection* connection);
 struct spindump_stats*
 spindump_analyze_getstats(struct spindump_analyze* state);
 void
@@ -133,6 +148,11 @@ spindump_analyze_process(struct spindump_analyze* state,
                          struct spindump_packet* packet,
                          struct spindump_connection** p_connection);
 void
+spindump_analyze_process_batch(struct spindump_analyze* state,
+                               enum spindump_capture_linktype linktype,
+                               struct spindump_packet* packets,
+                               unsigned int nPackets);
+void
 spindump_analyze_processevent(struct spindump_analyze* state,
                               const struct spindump_event* event,
                               struct spindump_connection** p_connection);
@@ -146,6 +166,11 @@ spindump_analyze_getdestination(struct spindump_packet* packet,
                                 uint8_t ipVersion,
                                 unsigned int ipHeaderPosition,
                                 spindump_address *address);
+int
+spindump_analyze_getaddresses(enum spindump_capture_linktype linktype,
+                              struct spindump_packet* packet,
+                              spindump_address* source,
+                              spindump_address* destination);
 const char*
 spindump_analyze_eventtostring(spindump_analyze_event event);
 
@@ -156,7 +181,7 @@ spindump_analyze_eventtostring(spindump_analyze_event event);
 void
 spindump_analyze_process_pakstats(struct spindump_analyze* state,
                                   struct spindump_connection* connection,
-                                  const struct timeval* timestamp,
+                                  const spindump_time* timestamp,
                                   const int fromResponder,
                                   struct spindump_packet* packet,
                                   unsigned int ipPacketLength,
@@ -164,7 +189,7 @@ spindump_analyze_process_pakstats(struct spindump_analyze* state,
 void
 spindump_analyze_process_handlers(struct spindump_analyze* state,
                                   spindump_analyze_event event,
-                                  const struct timeval* timestamp,
+                                  const spindump_time* timestamp,
                                   const int fromResponder,
                                   const unsigned int ipPacketLength,
                                   struct spindump_packet* packet,
@@ -51,7 +51,7 @@ spindump_analyze_process_aggregate(struct spindump_analyze* state,
                                    unsigned int ipHeaderSize,
                                    uint8_t ipVersion,
                                    uint8_t ecnFlags,
-                                   const struct timeval* timestamp,
+                                   const spindump_time* timestamp,
                                    const unsigned int ipPacketLength,
                                    struct spindump_stats* stats) {
   
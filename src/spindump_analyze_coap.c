@@ -37,7 +37,7 @@ static void
 spindump_analyze_process_coap_dtls(struct spindump_analyze* state,
                                    struct spindump_packet* packet,
                                    uint8_t ecnFlags,
-                                   const struct timeval* timestamp,
+                                   const spindump_time* timestamp,
                                    unsigned int ipPacketLength,
                                    unsigned int udpLength,
                                    unsigned int remainingCaplen,
@@ -51,7 +51,7 @@ static void
 spindump_analyze_process_coap_cleartext(struct spindump_analyze* state,
                                         struct spindump_packet* packet,
                                         uint8_t ecnFlags,
-                                        const struct timeval* timestamp,
+                                        const spindump_time* timestamp,
                                         unsigned int ipPacketLength,
                                         unsigned int udpLength,
                                         unsigned int remainingCaplen,
@@ -65,7 +65,7 @@ static void
 spindump_analyze_coap_markmidsent(struct spindump_connection* connection,
                                   const int fromResponder,
                                   const uint16_t mid,
-                                  const struct timeval* t);
+                                  const spindump_time* t);
 static int
 spindump_analyze_coap_markmidreceived(struct spindump_analyze* state,
                                       struct spindump_packet* packet,
@@ -73,14 +73,14 @@ spindump_analyze_coap_markmidreceived(struct spindump_analyze* state,
                                       const int fromResponder,
                                       const unsigned int ipPacketLength,
                                       const uint16_t mid,
-                                      const struct timeval* t);
+                                      const spindump_time* t);
 static void
 spindump_analyze_coap_markinitialresponsereceived(struct spindump_analyze* state,
                                                   struct spindump_packet* packet,
                                                   struct spindump_connection* connection,
                                                   const int fromResponder,
                                                   const unsigned int ipPacketLength,
-                                                  const struct timeval* t);
+                                                  const spindump_time* t);
 
 //
 // Actual code --------------------------------------------------------------------------------
@@ -151,17 +151,17 @@ static void
 spindump_analyze_coap_markmidsent(struct spindump_connection* connection,
                                   const int fromResponder,
                                   const uint16_t mid,
-                                  const struct timeval* t) {
+                                  const spindump_time* t) {
 
   spindump_assert(connection != 0);
   spindump_assert(fromResponder == 0 || fromResponder == 1);
   spindump_assert(t != 0);
 
   if (fromResponder) {
-    spindump_messageidtracker_add(&connection->u.coap.side2MIDs,t,mid);
+    spindump_messageidtracker_add(&connection->u.coap.trackers->side2MIDs,t,mid);
     spindump_deepdebugf("responder sent MID %u", mid);
   } else {
-    spindump_messageidtracker_add(&connection->u.coap.side1MIDs,t,mid);
+    spindump_messageidtracker_add(&connection->u.coap.trackers->side1MIDs,t,mid);
     spindump_deepdebugf("initiator sent MID %u", mid);
   }
 }
@@ -182,7 +182,7 @@ spindump_analyze_coap_markmidreceived(struct spindump_analyze* state,
                                       const int fromResponder,
                                       const unsigned int ipPacketLength,
                                       const uint16_t mid,
-                                      const struct timeval* t) {
+                                      const spindump_time* t) {
 
   //
   // Some sanity checks
@@ -201,11 +201,11 @@ spindump_analyze_coap_markmidreceived(struct spindump_analyze* state,
   // for a later match
   //
 
-  const struct timeval* ackto;
+  const spindump_time* ackto;
 
   if (fromResponder) {
 
-    ackto = spindump_messageidtracker_ackto(&connection->u.coap.side1MIDs,mid);
+    ackto = spindump_messageidtracker_ackto(&connection->u.coap.trackers->side1MIDs,t,mid);
 
     if (ackto != 0) {
 
@@ -222,18 +222,20 @@ spindump_analyze_coap_markmidreceived(struct spindump_analyze* state,
                                              ackto,
                                              t,
                                              "COAP response");
+      state->stats->matchedCoapResponse++;
       return(1);
 
     } else {
 
       spindump_deepdebugf("did not find the initiator COAP message that responder mid %u refers to", mid);
+      state->stats->unmatchedCoapResponse++;
       return(0);
 
     }
 
   } else {
 
-    ackto = spindump_messageidtracker_ackto(&connection->u.coap.side2MIDs,mid);
+    ackto = spindump_messageidtracker_ackto(&connection->u.coap.trackers->side2MIDs,t,mid);
 
     if (ackto != 0) {
 
@@ -250,11 +252,13 @@ spindump_analyze_coap_markmidreceived(struct spindump_analyze* state,
                                              ackto,
                                              t,
                                              "COAP response");
+      state->stats->matchedCoapResponse++;
       return(1);
 
     } else {
 
       spindump_deepdebugf("did not find the responder COAP message that initiator mid %u refers to", mid);
+      state->stats->unmatchedCoapResponse++;
       return(0);
 
     }
@@ -273,7 +277,7 @@ spindump_analyze_coap_markinitialresponsereceived(struct spindump_analyze* state
                                                   struct spindump_connection* connection,
                                                   const int fromResponder,
                                                   const unsigned int ipPacketLength,
-                                                  const struct timeval* t) {
+                                                  const spindump_time* t) {
 
   //
   // Some sanity checks
@@ -290,7 +294,7 @@ spindump_analyze_coap_markinitialresponsereceived(struct spindump_analyze* state
   // Calculate the time for the initial request-response
   //
 
-  const struct timeval* ackto = &connection->creationTime;
+  const spindump_time* ackto = &connection->creationTime;
   unsigned long long diff = spindump_timediffinusecs(t,ackto);
   spindump_deepdebugf("the responder COAP TLS initial response refers to initiator COAP message that came %llu ms earlier",
                       diff / 1000);
@@ -331,7 +335,7 @@ spindump_analyze_process_coap(struct spindump_analyze* state,
                               unsigned int ipHeaderSize,
                               uint8_t ipVersion,
                               uint8_t ecnFlags,
-                              const struct timeval* timestamp,
+                              const spindump_time* timestamp,
                               unsigned int ipPacketLength,
                               unsigned int udpHeaderPosition,
                               unsigned int udpLength,
@@ -419,7 +423,7 @@ static void
 spindump_analyze_process_coap_cleartext(struct spindump_analyze* state,
                                         struct spindump_packet* packet,
                                         uint8_t ecnFlags,
-                                        const struct timeval* timestamp,
+                                        const spindump_time* timestamp,
                                         unsigned int ipPacketLength,
                                         unsigned int udpLength,
                                         unsigned int remainingCaplen,
@@ -631,7 +635,7 @@ static void
 spindump_analyze_process_coap_dtls(struct spindump_analyze* state,
                                    struct spindump_packet* packet,
                                    uint8_t ecnFlags,
-                                   const struct timeval* timestamp,
+                                   const spindump_time* timestamp,
                                    unsigned int ipPacketLength,
                                    unsigned int udpLength,
                                    unsigned int remainingCaplen,
@@ -35,7 +35,7 @@ static void
 spindump_analyzer_dns_markmidsent(struct spindump_connection* connection,
                                   int fromResponder,
                                   const uint16_t mid,
-                                  const struct timeval* t);
+                                  const spindump_time* t);
 static int
 spindump_analyzer_dns_markmidreceived(struct spindump_analyze* state,
                                       struct spindump_packet* packet,
@@ -43,7 +43,7 @@ spindump_analyzer_dns_markmidreceived(struct spindump_analyze* state,
                                       int fromResponder,
                                       const unsigned int ipPacketLength,
                                       const uint16_t mid,
-                                      const struct timeval* t);
+                                      const spindump_time* t);
 static const char*
 spindump_analyzer_dns_parsename(const char* dnspayload,
                                 unsigned int dnspayloadsize);
@@ -100,13 +100,13 @@ spindump_analyze_dns_isprobablednspacket(const unsigned char* payload,
 // string need not be freed, but it will not survive the next call to
 // this same function.
 //
-// Note: This function is not thread safe.
+// Note: the returned buffer is per thread.
 //
 
 static const char*
 spindump_analyzer_dns_parsename(const char* dnspayload,
                                 unsigned int dnspayloadsize) {
-  static char buf[200];
+  static _Thread_local char buf[200];
   memset(buf,0,sizeof(buf));
   if (dnspayloadsize == 0) {
     spindump_deepdebugf("DNS payload size 0 is not allowed, failing");
@@ -145,17 +145,17 @@ static void
 spindump_analyzer_dns_markmidsent(struct spindump_connection* connection,
                                   int fromResponder,
                                   const uint16_t mid,
-                                  const struct timeval* t) {
+                                  const spindump_time* t) {
 
   spindump_assert(connection != 0);
   spindump_assert(fromResponder == 0 || fromResponder == 1);
   spindump_assert(t != 0);
 
   if (fromResponder) {
-    spindump_messageidtracker_add(&connection->u.dns.side2MIDs,t,mid);
+    spindump_messageidtracker_add(&connection->u.dns.trackers->side2MIDs,t,mid);
     spindump_deepdebugf("responder sent MID %u", mid);
   } else {
-    spindump_messageidtracker_add(&connection->u.dns.side1MIDs,t,mid);
+    spindump_messageidtracker_add(&connection->u.dns.trackers->side1MIDs,t,mid);
     spindump_deepdebugf("initiator sent MID %u", mid);
   }
 }
@@ -176,9 +176,9 @@ spindump_analyzer_dns_markmidreceived(struct spindump_analyze* state,
                                       int fromResponder,
                                       const unsigned int ipPacketLength,
                                       const uint16_t mid,
-                                      const struct timeval* t) {
+                                      const spindump_time* t) {
 
-  const struct timeval* ackto;
+  const spindump_time* ackto;
 
   spindump_assert(connection != 0);
   spindump_assert(spindump_packet_isvalid(packet));
@@ -187,7 +187,7 @@ spindump_analyzer_dns_markmidreceived(struct spindump_analyze* state,
 
   if (fromResponder) {
 
-    ackto = spindump_messageidtracker_ackto(&connection->u.dns.side1MIDs,mid);
+    ackto = spindump_messageidtracker_ackto(&connection->u.dns.trackers->side1MIDs,t,mid);
 
     if (ackto != 0) {
 
@@ -204,18 +204,20 @@ spindump_analyzer_dns_markmidreceived(struct spindump_analyze* state,
                                              ackto,
                                              t,
                                              "DNS response");
+      state->stats->matchedDnsResponse++;
       return(1);
 
     } else {
 
       spindump_deepdebugf("did not find the initiator DNS message that responder mid %u refers to", mid);
+      state->stats->unmatchedDnsResponse++;
       return(0);
 
     }
 
   } else {
 
-    ackto = spindump_messageidtracker_ackto(&connection->u.dns.side2MIDs,mid);
+    ackto = spindump_messageidtracker_ackto(&connection->u.dns.trackers->side2MIDs,t,mid);
 
     if (ackto != 0) {
 
@@ -232,11 +234,13 @@ spindump_analyzer_dns_markmidreceived(struct spindump_analyze* state,
                                              ackto,
                                              t,
                                              "DNS response");
+      state->stats->matchedDnsResponse++;
       return(1);
 
     } else {
 
       spindump_deepdebugf("did not find the responder DNS message that initiator mid %u refers to", mid);
+      state->stats->unmatchedDnsResponse++;
       return(0);
 
     }
@@ -268,7 +272,7 @@ spindump_analyze_process_dns(struct spindump_analyze* state,
                              unsigned int ipHeaderSize,
                              uint8_t ipVersion,
                              uint8_t ecnFlags,
-                             const struct timeval* timestamp,
+                             const spindump_time* timestamp,
                              unsigned int ipPacketLength,
                              unsigned int udpHeaderPosition,
                              unsigned int udpLength,
@@ -390,9 +394,9 @@ spindump_analyze_process_dns(struct spindump_analyze* state,
       dnspayloadsize > 0) {
     const char* queriedName = spindump_analyzer_dns_parsename(dnspayload,dnspayloadsize);
     if (queriedName != 0) {
-      memset(connection->u.dns.lastQueriedName,0,sizeof(connection->u.dns.lastQueriedName));
-      strncpy(connection->u.dns.lastQueriedName,queriedName,sizeof(connection->u.dns.lastQueriedName)-1);
-      spindump_deepdebugf("storing queried DNS name %s for interest", connection->u.dns.lastQueriedName);
+      memset(connection->u.dns.trackers->lastQueriedName,0,sizeof(connection->u.dns.trackers->lastQueriedName));
+      strncpy(connection->u.dns.trackers->lastQueriedName,queriedName,sizeof(connection->u.dns.trackers->lastQueriedName)-1);
+      spindump_deepdebugf("storing queried DNS name %s for interest", connection->u.dns.trackers->lastQueriedName);
     }
   }
 
@@ -36,6 +36,7 @@
 #include "spindump_analyze_quic.h"
 #include "spindump_analyze_icmp.h"
 #include "spindump_analyze_aggregate.h"
+#include "spindump_table_eviction.h"
 #include "spindump_event.h"
 
 //
@@ -90,6 +91,9 @@ static void
 spindump_analyze_processevent_packet(struct spindump_analyze* state,
                                      const struct spindump_event* event,
                                      struct spindump_connection** p_connection);
+static void
+spindump_analyze_processevent_capture(struct spindump_analyze* state,
+                                      const struct spindump_event* event);
 static int
 spindump_analyze_event_parseicmpsessionid(const struct spindump_event* event,
                                           uint16_t* p_peerId);
@@ -121,7 +125,7 @@ spindump_analyze_event_updateinfo_aggregate(struct spindump_analyze* state,
                                             spindump_counter_64bit fromSide2Diff,
                                             spindump_counter_64bit bytesFromSide1Diff,
                                             spindump_counter_64bit bytesFromSide2Diff,
-                                            struct timeval* when);
+                                            spindump_time* when);
 static int
 spindump_analyze_event_charbytetobyte(char ch1,
                                       char ch2,
@@ -200,10 +204,23 @@ spindump_analyze_processevent(struct spindump_analyze* state,
   case spindump_event_type_packet:
     spindump_analyze_processevent_packet(state,event,p_connection);
     break;
+  case spindump_event_type_capture:
+    spindump_analyze_processevent_capture(state,event);
+    break;
   default:
     spindump_errorf("invalid event type %u", event->eventType);
     return;
   }
+  
+  //
+  // The event may have changed the timeout of the connection, and
+  // the connection is now the most recently active one
+  //
+  
+  if (*p_connection != 0) {
+    spindump_connectionstable_updatetimeout(state->table,*p_connection);
+    spindump_connectionstable_eviction_touch(state->table,*p_connection);
+  }
 }
 
 //
@@ -491,9 +508,9 @@ static void
 spindump_analyze_processevent_new_connection(struct spindump_analyze* state,
                                              const struct spindump_event* event,
                                              struct spindump_connection** p_connection) {
-  struct timeval when;
+  spindump_time when;
   spindump_deepdeepdebugf("spindump_analyze_processevent_new_connection");
-  spindump_timestamp_to_timeval(event->timestamp,&when);
+  spindump_timestamp_to_time(event->timestamp,&when);
   spindump_port side1port;
   spindump_port side2port;
   struct spindump_quic_connectionid side1cid;
@@ -766,17 +783,14 @@ spindump_analyze_processevent_new_rtt_measurement(struct spindump_analyze* state
   // And update RTT statistics as well
   //
   
-  unsigned long long timestamp = event->timestamp;
-  unsigned long long timestampEarlier =
-    timestamp >= event->u.newRttMeasurement.rtt ?
-    timestamp - event->u.newRttMeasurement.rtt :
-    0;
-  struct timeval sent;
-  struct timeval rcvd;
-  spindump_deepdeepdebugf("spindump_analyze_processevent_new_rttmeasurement 1");
-  spindump_timestamp_to_timeval(timestampEarlier,&sent);
-  spindump_deepdeepdebugf("spindump_analyze_processevent_new_rttmeasurement 2");
-  spindump_timestamp_to_timeval(timestamp,&rcvd);
+  spindump_time rcvd;
+  spindump_timestamp_to_time(event->timestamp,&rcvd);
+  spindump_time rtt =
+    event->u.newRttMeasurement.rttNsec > 0 ?
+    event->u.newRttMeasurement.rttNsec :
+    event->u.newRttMeasurement.rtt * spindump_time_nsecsperusec;
+  spindump_time sent = rcvd >= rtt ? rcvd - rtt : 0;
+  spindump_deepdeepdebugf("spindump_analyze_processevent_new_rttmeasurement sent %llu rcvd %llu", sent, rcvd);
   int right = (event->u.newRttMeasurement.direction == spindump_direction_fromresponder);
   int unidirectional = (event->u.newRttMeasurement.measurement == spindump_measurement_type_unidirectional);
   spindump_connections_newrttmeasurement(state,
@@ -814,10 +828,10 @@ spindump_analyze_processevent_periodic(struct spindump_analyze* state,
     timestamp >= event->u.periodic.rttRight ?
     timestamp - event->u.periodic.rttRight :
     0;
-  struct timeval sent;
-  struct timeval rcvd;
-  spindump_timestamp_to_timeval(timestampEarlier,&sent);
-  spindump_timestamp_to_timeval(timestamp,&rcvd);
+  spindump_time sent;
+  spindump_time rcvd;
+  spindump_timestamp_to_time(timestampEarlier,&sent);
+  spindump_timestamp_to_time(timestamp,&rcvd);
   // TBD should perhaps update stats based on receiving this? ...
   spindump_connections_newrttmeasurement(state,
                                          0,
@@ -828,6 +842,38 @@ spindump_analyze_processevent_periodic(struct spindump_analyze* state,
                                          &sent,
                                          &rcvd,
                                          "remote update");
+
+  //
+  // Merge the RTT histogram of the period, if any, to the connection
+  // and the aggregates it belongs to
+  //
+
+  const struct spindump_event_histogram* histogram = &event->u.periodic.histRight;
+  if (histogram->nBins > 0) {
+    spindump_connections_newrtthistogram(*p_connection,
+                                         1,
+                                         0,
+                                         histogram->precision,
+                                         histogram->nBins,
+                                         histogram->indexes,
+                                         histogram->counts);
+  }
+
+  //
+  // Likewise for the quantile sketch
+  //
+
+  const struct spindump_event_sketch* sketch = &event->u.periodic.sketchRight;
+  if (sketch->nBins > 0 || sketch->zeroCount > 0) {
+    spindump_connections_newrttsketch(*p_connection,
+                                      1,
+                                      0,
+                                      sketch->offset,
+                                      sketch->zeroCount,
+                                      sketch->nBins,
+                                      sketch->indexes,
+                                      sketch->counts);
+  }
 }
 
 //
@@ -1049,7 +1095,7 @@ spindump_analyze_processevent_packet(struct spindump_analyze* state,
 
   struct spindump_packet dummypacket;
   memset(&dummypacket,0,sizeof(dummypacket));
-  spindump_timestamp_to_timeval(event->timestamp,&dummypacket.timestamp);
+  spindump_timestamp_to_time(event->timestamp,&dummypacket.timestamp);
   spindump_analyze_process_pakstats(state,
                                     *p_connection,
                                     &dummypacket.timestamp,
@@ -1059,6 +1105,32 @@ spindump_analyze_processevent_packet(struct spindump_analyze* state,
                                     0);
 }
 
+//
+// Process an event of type "capture" from another instance of
+// Spindump somewhere else. The event is not about any connection,
+// but tells how many packets the other instance failed to capture;
+// measurements from that instance during the period may be
+// missing. Update the statistics.
+//
+
+static void
+spindump_analyze_processevent_capture(struct spindump_analyze* state,
+                                      const struct spindump_event* event) {
+  state->stats->remoteCaptureReports++;
+  state->stats->remoteCaptureDrops += (event->u.capture.kernelDrops +
+                                        event->u.capture.interfaceDrops +
+                                        event->u.capture.ringOverflows);
+  if (event->u.capture.kernelDrops > 0 ||
+      event->u.capture.interfaceDrops > 0 ||
+      event->u.capture.ringOverflows > 0) {
+    spindump_debugf("remote capture dropped %llu + %llu + %llu packets during the period ending at %llu",
+                    event->u.capture.kernelDrops,
+                    event->u.capture.interfaceDrops,
+                    event->u.capture.ringOverflows,
+                    event->timestamp);
+  }
+}
+
 //
 // Find the already existing connection pointed to by the
 // event. Return that connection object, or 0 if not found. If the
@@ -1252,16 +1324,16 @@ spindump_analyze_event_updateinfo(struct spindump_analyze* state,
   // Update timestamps
   //
 
-  struct timeval* tv = 0;
+  spindump_time* tv = 0;
   if (connection->packetsFromSide1 < event->packetsFromSide1) {
     tv = &connection->latestPacketFromSide1;
     spindump_deepdeepdebugf("spindump_analyze_processevent_updateinfo 1");
-    spindump_timestamp_to_timeval(event->timestamp,tv);
+    spindump_timestamp_to_time(event->timestamp,tv);
   }
   if (connection->packetsFromSide2 < event->packetsFromSide2) {
     tv = &connection->latestPacketFromSide2;
     spindump_deepdeepdebugf("spindump_analyze_processevent_updateinfo 2");
-    spindump_timestamp_to_timeval(event->timestamp,tv);
+    spindump_timestamp_to_time(event->timestamp,tv);
   }
   
   //
@@ -1299,8 +1371,8 @@ spindump_analyze_event_updateinfo(struct spindump_analyze* state,
 
     struct spindump_connection* aggregate = spindump_connection_set_iterator_next(&iter);
     spindump_assert(aggregate != 0);
-    struct timeval when;
-    spindump_timestamp_to_timeval(event->timestamp,&when);
+    spindump_time when;
+    spindump_timestamp_to_time(event->timestamp,&when);
     spindump_analyze_event_updateinfo_aggregate(state,
                                                 aggregate,
                                                 fromSide1Diff,fromSide2Diff,
@@ -1326,7 +1398,7 @@ spindump_analyze_event_updateinfo_aggregate(struct spindump_analyze* state,
                                             spindump_counter_64bit fromSide2Diff,
                                             spindump_counter_64bit bytesFromSide1Diff,
                                             spindump_counter_64bit bytesFromSide2Diff,
-                                            struct timeval* when) {
+                                            spindump_time* when) {
   
   //
   // Sanity checks
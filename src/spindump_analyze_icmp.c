@@ -57,7 +57,7 @@ spindump_analyze_process_icmp(struct spindump_analyze* state,
                               unsigned int ipHeaderSize,
                               uint8_t ipVersion,
                               uint8_t ecnFlags,
-                              const struct timeval* timestamp,
+                              const spindump_time* timestamp,
                               unsigned int ipPacketLength,
                               unsigned int icmpHeaderPosition,
                               unsigned int icmpLength,
@@ -225,8 +225,8 @@ spindump_analyze_process_icmp(struct spindump_analyze* state,
 
       spindump_deepdeepdebugf("looking for ICMP SEQ match of %u",
                               peerSeq);
-      const struct timeval* ackto =
-        spindump_messageidtracker_ackto(&connection->u.icmp.side1Seqs,peerSeq);
+      const spindump_time* ackto =
+        spindump_messageidtracker_ackto(&connection->u.icmp.trackers->side1Seqs,&packet->timestamp,peerSeq);
       if (ackto != 0) {
         spindump_deepdeepdebugf("found ackto for sequence %u", peerSeq);
         spindump_connections_newrttmeasurement(state,
@@ -246,7 +246,7 @@ spindump_analyze_process_icmp(struct spindump_analyze* state,
 
     } else {
 
-      spindump_messageidtracker_add(&connection->u.icmp.side1Seqs,&packet->timestamp,peerSeq);
+      spindump_messageidtracker_add(&connection->u.icmp.trackers->side1Seqs,&packet->timestamp,peerSeq);
       fromResponder = 0;
 
     }
@@ -315,7 +315,7 @@ spindump_analyze_process_icmp6(struct spindump_analyze* state,
                                unsigned int ipHeaderSize,
                                uint8_t ipVersion,
                                uint8_t ecnFlags,
-                               const struct timeval* timestamp,
+                               const spindump_time* timestamp,
                                unsigned int ipPacketLength,
                                unsigned int icmpHeaderPosition,
                                unsigned int icmpLength,
@@ -472,8 +472,8 @@ spindump_analyze_process_icmp6(struct spindump_analyze* state,
       
       spindump_deepdeepdebugf("looking for ICMPv6 SEQ match of %u",
                               peerSeq);
-      const struct timeval* ackto =
-        spindump_messageidtracker_ackto(&connection->u.icmp.side1Seqs,peerSeq);
+      const spindump_time* ackto =
+        spindump_messageidtracker_ackto(&connection->u.icmp.trackers->side1Seqs,&packet->timestamp,peerSeq);
       
       if (ackto != 0) {
         spindump_deepdeepdebugf("found ackto for sequence %u", peerSeq);
@@ -494,7 +494,7 @@ spindump_analyze_process_icmp6(struct spindump_analyze* state,
 
     } else {
       
-      spindump_messageidtracker_add(&connection->u.icmp.side1Seqs,&packet->timestamp,peerSeq);
+      spindump_messageidtracker_add(&connection->u.icmp.trackers->side1Seqs,&packet->timestamp,peerSeq);
       fromResponder = 0;
       
     }
@@ -36,7 +36,7 @@ spindump_analyze_process_icmp(struct spindump_analyze* state,
                               unsigned int ipHeaderSize,
                               uint8_t ipVersion,
                               uint8_t ecnFlags,
-                              const struct timeval* timestamp,
+                              const spindump_time* timestamp,
                               unsigned int ipPacketLength,
                               unsigned int icmpHeaderPosition,
                               unsigned int icmpLength,
@@ -49,7 +49,7 @@ spindump_analyze_process_icmp6(struct spindump_analyze* state,
                                unsigned int ipHeaderSize,
                                uint8_t ipVersion,
                                uint8_t ecnFlags,
-                               const struct timeval* timestamp,
+                               const spindump_time* timestamp,
                                unsigned int ipPacketLength,
                                unsigned int icmpHeaderPosition,
                                unsigned int icmpLength,
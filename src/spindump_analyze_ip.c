@@ -28,6 +28,7 @@
 #include "spindump_connections.h"
 #include "spindump_connections_set.h"
 #include "spindump_connections_set_iterator.h"
+#include "spindump_table_aggregates.h"
 #include "spindump_analyze.h"
 #include "spindump_analyze_ip.h"
 #include "spindump_analyze_tcp.h"
@@ -55,7 +56,7 @@ spindump_analyze_ip_decodeippayload(struct spindump_analyze* state,
                                     unsigned int ipHeaderSize,
                                     uint8_t ipVersion,
                                     uint8_t ecnFlags,
-                                    const struct timeval* timestamp,
+                                    const spindump_time* timestamp,
                                     unsigned int ipPacketLength,
                                     unsigned char proto,
                                     unsigned int payloadPosition,
@@ -67,7 +68,7 @@ spindump_analyze_ip_otherippayload(struct spindump_analyze* state,
                                    unsigned int ipHeaderSize,
                                    uint8_t ipVersion,
                                    uint8_t ecnFlags,
-                                   const struct timeval* timestamp,
+                                   const spindump_time* timestamp,
                                    unsigned int ipPacketLength,
                                    struct spindump_connection** p_connection);
 
@@ -85,7 +86,7 @@ void
 spindump_analyze_ip_decodeiphdr(struct spindump_analyze* state,
                                 struct spindump_packet* packet,
                                 unsigned int position,
-                                const struct timeval* timestamp,
+                                const spindump_time* timestamp,
                                 struct spindump_connection** p_connection) {
 
   //
@@ -195,7 +196,7 @@ void
 spindump_analyze_ip_decodeip6hdr(struct spindump_analyze* state,
                                  struct spindump_packet* packet,
                                  unsigned int position,
-                                 const struct timeval* timestamp,
+                                 const spindump_time* timestamp,
                                  struct spindump_connection** p_connection) {
 
   //
@@ -308,7 +309,7 @@ spindump_analyze_ip_decodeippayload(struct spindump_analyze* state,
                                     unsigned int ipHeaderSize,
                                     uint8_t ipVersion,
                                     uint8_t ecnFlags,
-                                    const struct timeval* timestamp,
+                                    const spindump_time* timestamp,
                                     unsigned int ipPacketLength,
                                     unsigned char proto,
                                     unsigned int payloadPosition,
@@ -508,7 +509,7 @@ spindump_analyze_ip_otherippayload(struct spindump_analyze* state,
                                    unsigned int ipHeaderSize,
                                    uint8_t ipVersion,
                                    uint8_t ecnFlags,
-                                   const struct timeval* timestamp,
+                                   const spindump_time* timestamp,
                                    unsigned int ipPacketLength,
                                    struct spindump_connection** p_connection) {
   //
@@ -536,11 +537,15 @@ spindump_analyze_ip_otherippayload(struct spindump_analyze* state,
   spindump_analyze_getsource(packet,ipVersion,ipHeaderPosition,&source);
   spindump_analyze_getdestination(packet,ipVersion,ipHeaderPosition,&destination);
 
-  for (i = 0; i < state->table->nConnections; i++) {
+  struct spindump_connection** candidates;
+  unsigned int nCandidates = spindump_connectionstable_aggregates_find(state->table,
+                                                                       &source,
+                                                                       &destination,
+                                                                       &candidates);
+  for (i = 0; i < nCandidates; i++) {
 
-    struct spindump_connection* connection = state->table->connections[i];
-    if (connection != 0 &&
-        spindump_connections_isaggregate_simple(connection) &&
+    struct spindump_connection* connection = candidates[i];
+    if (spindump_connections_isaggregate_simple(connection) &&
         spindump_connections_matches_aggregate_srcdst(&source,&destination,connection)) {
 
       //
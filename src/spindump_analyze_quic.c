@@ -22,6 +22,7 @@
 
 #include "spindump_util.h"
 #include "spindump_connections.h"
+#include "spindump_table_index.h"
 #include "spindump_analyze.h"
 #include "spindump_analyze_quic.h"
 #include "spindump_analyze_quic_parser.h"
@@ -57,7 +58,7 @@ spindump_analyze_process_quic(struct spindump_analyze* state,
                               unsigned int ipHeaderSize,
                               uint8_t ipVersion,
                               uint8_t ecnFlags,
-                              const struct timeval* timestamp,
+                              const spindump_time* timestamp,
                               unsigned int ipPacketLength,
                               unsigned int udpHeaderPosition,
                               unsigned int udpLength,
@@ -278,6 +279,7 @@ spindump_analyze_process_quic(struct spindump_analyze* state,
       spindump_debugf("(initial destination connection id was %s)",
                       spindump_connection_quicconnectionid_tostring(&connection->u.quic.peer2ConnectionID,tempid,sizeof(tempid)));
       connection->u.quic.peer2ConnectionID = sourceCid;
+      spindump_connectionstable_cidindex_update(state->table,connection);
       spindump_deepdeepdebugf("calling spindump_connections_changeidentifiers");
       spindump_connections_changeidentifiers(state,packet,timestamp,connection);
     }
@@ -352,6 +354,7 @@ spindump_analyze_process_quic(struct spindump_analyze* state,
 
         char tempid[100];
         connection->u.quic.peer1ConnectionID = destinationCid;
+        spindump_connectionstable_cidindex_update(state->table,connection);
         spindump_deepdebugf("changed peer 1 connection id to %s",
                             spindump_connection_quicconnectionid_tostring(&connection->u.quic.peer1ConnectionID,tempid,sizeof(tempid)));
 
@@ -369,6 +372,7 @@ spindump_analyze_process_quic(struct spindump_analyze* state,
 
         char tempid[100];
         connection->u.quic.peer2ConnectionID = sourceCid;
+        spindump_connectionstable_cidindex_update(state->table,connection);
         spindump_deepdebugf("changed peer 2 connection id to %s",
                             spindump_connection_quicconnectionid_tostring(&connection->u.quic.peer2ConnectionID,tempid,sizeof(tempid)));
 
@@ -35,7 +35,7 @@ static void
 spindump_analyze_process_sctp_marktsnsent(struct spindump_connection* connection,
                                           int fromResponder,
                                           sctp_tsn tsn,
-                                          struct timeval* t);
+                                          spindump_time* t);
 static void
 spindump_analyze_process_sctp_markackreceived_data(struct spindump_analyze* state,
                                                    struct spindump_packet* packet,
@@ -43,12 +43,12 @@ spindump_analyze_process_sctp_markackreceived_data(struct spindump_analyze* stat
                                                    int fromResponder,
                                                    const unsigned int ipPacketLength,
                                                    sctp_tsn ackTsn,
-                                                   struct timeval* t);
+                                                   spindump_time* t);
 
 static void
 spindump_analyze_process_sctp_marksent_hb(struct spindump_connection* connection,
                                           int fromResponder,
-                                          struct timeval* t);
+                                          spindump_time* t);
 
 static void
 spindump_analyze_process_sctp_markackreceived_hb(struct spindump_analyze* state,
@@ -56,7 +56,7 @@ spindump_analyze_process_sctp_markackreceived_hb(struct spindump_analyze* state,
                                                  struct spindump_connection* connection,
                                                  int fromResponder,
                                                  const unsigned int ipPacketLength,
-                                                 struct timeval* t);
+                                                 spindump_time* t);
 static const char*
 spindump_analyze_sctp_chunk_type_to_string(enum spindump_sctp_chunk_type type);
 
@@ -103,16 +103,16 @@ static void
 spindump_analyze_process_sctp_marktsnsent(struct spindump_connection* connection,
                                           int fromResponder,
                                           sctp_tsn tsn,
-                                          struct timeval* t) {
+                                          spindump_time* t) {
 
   spindump_assert(connection != 0);
   spindump_assert(spindump_isbool(fromResponder));
   spindump_assert(t != 0);
   if (fromResponder) {
-    spindump_tsntracker_add(&connection->u.sctp.side2Seqs,t,tsn);
+    spindump_tsntracker_add(&connection->u.sctp.trackers->side2Seqs,t,tsn);
     spindump_deepdebugf("responder sent TSN %u", tsn);
   } else {
-    spindump_tsntracker_add(&connection->u.sctp.side1Seqs,t,tsn);
+    spindump_tsntracker_add(&connection->u.sctp.trackers->side1Seqs,t,tsn);
     spindump_deepdebugf("initiator sent TSN %u", tsn);
   }
 }
@@ -132,9 +132,9 @@ spindump_analyze_process_sctp_markackreceived_data(struct spindump_analyze* stat
                                                    int fromResponder,
                                                    const unsigned int ipPacketLength,
                                                    sctp_tsn ackTsn,
-                                                   struct timeval* t) {
+                                                   spindump_time* t) {
 
-  struct timeval* ackto;
+  spindump_time* ackto;
   sctp_tsn sentTsn;
   spindump_assert(state != 0);
   spindump_assert(connection != 0);
@@ -143,9 +143,9 @@ spindump_analyze_process_sctp_markackreceived_data(struct spindump_analyze* stat
   spindump_assert(t != 0);
 
   if (fromResponder) {
-    ackto = spindump_tsntracker_ackto(&connection->u.sctp.side1Seqs,ackTsn,&sentTsn);
+    ackto = spindump_tsntracker_ackto(&connection->u.sctp.trackers->side1Seqs,ackTsn,&sentTsn);
   } else {
-    ackto = spindump_tsntracker_ackto(&connection->u.sctp.side2Seqs,ackTsn,&sentTsn);
+    ackto = spindump_tsntracker_ackto(&connection->u.sctp.trackers->side2Seqs,ackTsn,&sentTsn);
   }
 
   spindump_deepdebugf("spindump_analyze_process_sctp_markackreceived_data, fromResponder: %d", fromResponder);
@@ -186,7 +186,7 @@ spindump_analyze_process_sctp_markackreceived_data(struct spindump_analyze* stat
 static void
 spindump_analyze_process_sctp_marksent_hb(struct spindump_connection* connection,
                                           int fromResponder,
-                                          struct timeval* t)
+                                          spindump_time* t)
 {
   // ignore if not in Established state
   if (connection->state == spindump_connection_state_established) {
@@ -196,17 +196,17 @@ spindump_analyze_process_sctp_marksent_hb(struct spindump_connection* connection
   // increment number of HBs inflight and remember timestamp
   if (fromResponder) {
 
-    connection->u.sctp.side2HbCnt += 1;
-    connection->u.sctp.side2hbTime = *t;
+    connection->u.sctp.trackers->side2HbCnt += 1;
+    connection->u.sctp.trackers->side2hbTime = *t;
     spindump_deepdeepdebugf("After processing side2HbCnt %d, side2hbTime %llu", 
-                            connection->u.sctp.side2HbCnt, connection->u.sctp.side2hbTime.tv_sec);
+                            connection->u.sctp.trackers->side2HbCnt, connection->u.sctp.trackers->side2hbTime);
 
     } else {
                 
-      connection->u.sctp.side1HbCnt += 1;
-      connection->u.sctp.side1hbTime = *t;
+      connection->u.sctp.trackers->side1HbCnt += 1;
+      connection->u.sctp.trackers->side1hbTime = *t;
       spindump_deepdeepdebugf("After processing side1HbCnt %d, side1hbTime %llu", 
-                              connection->u.sctp.side1HbCnt, connection->u.sctp.side1hbTime.tv_sec);
+                              connection->u.sctp.trackers->side1HbCnt, connection->u.sctp.trackers->side1hbTime);
 
       }
     } else {
@@ -231,9 +231,9 @@ spindump_analyze_process_sctp_markackreceived_hb(struct spindump_analyze* state,
                                                  struct spindump_connection* connection,
                                                  int fromResponder,
                                                  const unsigned int ipPacketLength,
-                                                 struct timeval* t) {
+                                                 spindump_time* t) {
 
-  struct timeval* ackto = 0;
+  spindump_time* ackto = 0;
   spindump_assert(state != 0);
   spindump_assert(connection != 0);
   spindump_assert(spindump_packet_isvalid(packet));
@@ -246,19 +246,19 @@ spindump_analyze_process_sctp_markackreceived_hb(struct spindump_analyze* state,
   // note that the measurment is made for the opposite side towards HB ACK
   if (fromResponder) {
         
-    if (connection->u.sctp.side1HbCnt == 1) {
-      ackto = &connection->u.sctp.side1hbTime;
+    if (connection->u.sctp.trackers->side1HbCnt == 1) {
+      ackto = &connection->u.sctp.trackers->side1hbTime;
     }    
     // reset the counter of HBs in any case
-    connection->u.sctp.side1HbCnt = 0;
+    connection->u.sctp.trackers->side1HbCnt = 0;
     
   } else {
               
-    if (connection->u.sctp.side2HbCnt == 1) {
-      ackto = &connection->u.sctp.side2hbTime;
+    if (connection->u.sctp.trackers->side2HbCnt == 1) {
+      ackto = &connection->u.sctp.trackers->side2hbTime;
     }    
     // reset the counter of HBs in any case
-    connection->u.sctp.side2HbCnt = 0;
+    connection->u.sctp.trackers->side2HbCnt = 0;
     
   }
 
@@ -303,7 +303,7 @@ spindump_analyze_process_sctp(struct spindump_analyze* state,
                               unsigned int ipHeaderSize,
                               uint8_t ipVersion,
                               uint8_t ecnFlags,
-                              const struct timeval* timestamp,
+                              const spindump_time* timestamp,
                               unsigned int ipPacketLength,
                               unsigned int sctpHeaderPosition,
                               unsigned int sctpLength,
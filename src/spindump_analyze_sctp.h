@@ -36,7 +36,7 @@ spindump_analyze_process_sctp(struct spindump_analyze* table,
                               unsigned int ipHeaderSize,
                               uint8_t ipVersion,
                               uint8_t ecnFlags,
-                              const struct timeval* timestamp,
+                              const spindump_time* timestamp,
                               unsigned int ipPacketLength,
                               unsigned int sctpHeaderPosition,
                               unsigned int sctpLength,
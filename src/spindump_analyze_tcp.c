@@ -36,7 +36,7 @@ spindump_analyze_process_tcp_markseqsent(struct spindump_connection* connection,
                                          tcp_seq seq,
                                          unsigned int payloadlen,
                                          tcp_ts ts_val,
-                                         struct timeval* t,
+                                         spindump_time* t,
                                          int finset);
 static void
 spindump_analyze_process_tcp_markackreceived(struct spindump_analyze* state,
@@ -47,7 +47,7 @@ spindump_analyze_process_tcp_markackreceived(struct spindump_analyze* state,
                                              tcp_seq seq,
                                              tcp_seq largest_sacked,
                                              tcp_ts ts_ecr,
-                                             struct timeval* t,
+                                             spindump_time* t,
                                              int* finset);
 
 //
@@ -69,7 +69,7 @@ spindump_analyze_process_tcp_markseqsent(struct spindump_connection* connection,
                                          tcp_seq seq,
                                          unsigned int payloadlen,
                                          tcp_ts ts_val,
-                                         struct timeval* t,
+                                         spindump_time* t,
                                          int finset) {
 
   spindump_assert(connection != 0);
@@ -78,10 +78,10 @@ spindump_analyze_process_tcp_markseqsent(struct spindump_connection* connection,
   spindump_assert(spindump_isbool(finset));
 
   if (fromResponder) {
-    spindump_seqtracker_add(&connection->u.tcp.side2Seqs,t,ts_val,seq,payloadlen,finset);
+    spindump_seqtracker_add(&connection->u.tcp.trackers->side2Seqs,t,ts_val,seq,payloadlen,finset);
     spindump_deepdebugf("responder sent SEQ %u..%u (FIN=%u)", seq, seq + payloadlen, finset);
   } else {
-    spindump_seqtracker_add(&connection->u.tcp.side1Seqs,t,ts_val,seq,payloadlen,finset);
+    spindump_seqtracker_add(&connection->u.tcp.trackers->side1Seqs,t,ts_val,seq,payloadlen,finset);
     spindump_deepdebugf("initiator sent SEQ %u..%u (FIN=%u)", seq, seq + payloadlen, finset);
   }
 }
@@ -104,10 +104,10 @@ spindump_analyze_process_tcp_markackreceived(struct spindump_analyze* state,
                                              tcp_seq seq,
                                              tcp_seq largest_sacked,
                                              tcp_ts ts_ecr,
-                                             struct timeval* t,
+                                             spindump_time* t,
                                              int* finset) {
 
-  struct timeval* ackto;
+  spindump_time* ackto;
   tcp_seq sentSeq;
 
   spindump_assert(state != 0);
@@ -119,7 +119,7 @@ spindump_analyze_process_tcp_markackreceived(struct spindump_analyze* state,
 
   if (fromResponder) {
 
-    ackto = spindump_seqtracker_ackto(&connection->u.tcp.side1Seqs,seq,largest_sacked,ts_ecr,t,&sentSeq,finset);
+    ackto = spindump_seqtracker_ackto(&connection->u.tcp.trackers->side1Seqs,seq,largest_sacked,ts_ecr,t,&sentSeq,finset);
 
     if (ackto != 0) {
 
@@ -148,7 +148,7 @@ spindump_analyze_process_tcp_markackreceived(struct spindump_analyze* state,
 
   } else {
 
-    ackto = spindump_seqtracker_ackto(&connection->u.tcp.side2Seqs,seq,largest_sacked,ts_ecr,t,&sentSeq,finset);
+    ackto = spindump_seqtracker_ackto(&connection->u.tcp.trackers->side2Seqs,seq,largest_sacked,ts_ecr,t,&sentSeq,finset);
 
     if (ackto != 0) {
 
@@ -197,7 +197,7 @@ spindump_analyze_process_tcp(struct spindump_analyze* state,
                              unsigned int ipHeaderSize,
                              uint8_t ipVersion,
                              uint8_t ecnFlags,
-                             const struct timeval* timestamp,
+                             const spindump_time* timestamp,
                              unsigned int ipPacketLength,
                              unsigned int tcpHeaderPosition,
                              unsigned int tcpLength,
@@ -293,9 +293,8 @@ spindump_analyze_process_tcp(struct spindump_analyze* state,
   }
   unsigned int size_tcppayload = tcpLength - tcpHeaderSize;
 #ifdef SPINDUMP_DEBUG
-  unsigned long long reception =
-    ((unsigned long long)(timestamp->tv_sec)) * 1000 * 1000 +
-    ((unsigned long long)(timestamp->tv_usec));
+  unsigned long long reception;
+  spindump_time_to_timestamp(timestamp,&reception);
   spindump_debugf("received an IPv%u TCP packet of %u bytes at time +%llu, payload size %u bytes",
                   ipVersion,
                   packet->etherlen,
@@ -58,7 +58,7 @@ spindump_analyze_process_udp(struct spindump_analyze* state,
                              unsigned int ipHeaderSize,
                              uint8_t ipVersion,
                              uint8_t ecnFlags,
-                             const struct timeval* timestamp,
+                             const spindump_time* timestamp,
                              unsigned int ipPacketLength,
                              unsigned int udpHeaderPosition,
                              unsigned int udpLength,
@@ -25,8 +25,20 @@
 #include <string.h>
 #include <math.h>
 #include "spindump_util.h"
+#include "spindump_pool.h"
 #include "spindump_bandwidth.h"
 
+//
+// Function prototypes ------------------------------------------------------------------------
+//
+
+static void
+spindump_bandwidth_series_pushslot(struct spindump_bandwidth_series* series);
+static void
+spindump_bandwidth_series_newpacket(struct spindump_bandwidth_series* series,
+                                    unsigned int bytes,
+                                    const spindump_time* timestamp);
+
 //
 // Actual code --------------------------------------------------------------------------------
 //
@@ -50,7 +62,7 @@ spindump_bandwidth_initialize(struct spindump_bandwidth* bandwidth,
 void
 spindump_bandwidth_newpacket(struct spindump_bandwidth* bandwidth,
                              unsigned int bytes,
-                             const struct timeval* timestamp) {
+                             const spindump_time* timestamp) {
 
   //
   // Sanity checks
@@ -102,6 +114,14 @@ spindump_bandwidth_newpacket(struct spindump_bandwidth* bandwidth,
     bandwidth->bytesInLastPeriod = bandwidth->bytesInThisPeriod;
   }
 
+  //
+  // Update the multi-resolution series, if enabled
+  //
+
+  if (bandwidth->series != 0) {
+    spindump_bandwidth_series_newpacket(bandwidth->series,bytes,timestamp);
+  }
+
   //
   // Debugs
   //
@@ -120,7 +140,7 @@ spindump_bandwidth_newpacket(struct spindump_bandwidth* bandwidth,
 void
 spindump_bandwidth_setcounter(struct spindump_bandwidth* bandwidth,
                               spindump_counter_64bit bytes,
-                              const struct timeval* timestamp) {
+                              const spindump_time* timestamp) {
   //
   // Sanity checks
   //
@@ -141,6 +161,9 @@ spindump_bandwidth_setcounter(struct spindump_bandwidth* bandwidth,
   bandwidth->bytesInLastPeriod = 0;
   memset(&bandwidth->thisPeriodStart,0,sizeof(bandwidth->thisPeriodStart));
   bandwidth->bytesInThisPeriod = 0;
+  if (bandwidth->series != 0) {
+    memset(bandwidth->series,0,sizeof(*bandwidth->series));
+  }
   
 }
 
@@ -176,6 +199,141 @@ spindump_bandwidth_periodbytes_to_bytespersec(const struct spindump_bandwidth* b
 void
 spindump_bandwidth_uninitialize(struct spindump_bandwidth* bandwidth) {
   spindump_assert(bandwidth != 0);
-  // No-op// 
+  if (bandwidth->series != 0) {
+    spindump_pool_free(bandwidth->series,sizeof(*bandwidth->series));
+    bandwidth->series = 0;
+  }
+}
+
+//
+// Start keeping a multi-resolution series of byte counts for a
+// bandwidth tracker. This allows peak rates at different resolutions
+// to be reported. Returns 0 if memory could not be allocated, and 1
+// otherwise.
+//
+
+int
+spindump_bandwidth_enableseries(struct spindump_bandwidth* bandwidth) {
+  spindump_assert(bandwidth != 0);
+  if (bandwidth->series != 0) return(1);
+  struct spindump_bandwidth_series* series =
+    (struct spindump_bandwidth_series*)spindump_pool_allocate(sizeof(*series));
+  if (series == 0) {
+    spindump_errorf("cannot allocate memory for a bandwidth series of size %lu", (unsigned long)sizeof(*series));
+    return(0);
+  }
+  memset(series,0,sizeof(*series));
+  bandwidth->series = series;
+  return(1);
+}
+
+//
+// Move the current coarsest period to the ring of completed periods,
+// and start a new, empty period
+//
+
+static void
+spindump_bandwidth_series_pushslot(struct spindump_bandwidth_series* series) {
+  series->slots[series->nextSlot] = series->current;
+  series->nextSlot = (series->nextSlot + 1) % spindump_bandwidth_series_nslots;
+  if (series->nSlots < spindump_bandwidth_series_nslots) series->nSlots++;
+  memset(&series->current,0,sizeof(series->current));
+}
+
+//
+// Update the multi-resolution series with a new packet. The periods
+// at each resolution are aligned to multiples of the resolution, so
+// every period is contained within one period of each coarser
+// resolution. This makes it possible to keep only the peak of each
+// finer resolution within a coarsest period.
+//
+
+static void
+spindump_bandwidth_series_newpacket(struct spindump_bandwidth_series* series,
+                                    unsigned int bytes,
+                                    const spindump_time* timestamp) {
+  unsigned long long usecs = *timestamp / spindump_time_nsecsperusec;
+  unsigned long long resolution = spindump_bandwidth_series_finestresolution;
+  for (unsigned int i = 0;
+       i < spindump_bandwidth_series_nresolutions;
+       i++, resolution *= spindump_bandwidth_series_resolutionfactor) {
+    unsigned long long index = usecs / resolution;
+    if (!series->started) {
+      series->periodIndex[i] = index;
+    } else if (index > series->periodIndex[i]) {
+      
+      //
+      // The period at this resolution has completed. Record its peak,
+      // and at the coarsest resolution, move to the next slot in the
+      // ring. Any periods skipped without packets become empty slots.
+      // If more periods were skipped than the ring holds, even the
+      // period that just completed is too old, and the ring has only
+      // empty periods.
+      //
+      
+      if (series->bytesInPeriod[i] > series->current.peakBytes[i]) {
+        series->current.peakBytes[i] = series->bytesInPeriod[i];
+      }
+      if (i == spindump_bandwidth_series_nresolutions - 1) {
+        unsigned long long completed = index - series->periodIndex[i];
+        if (completed > spindump_bandwidth_series_nslots) {
+          memset(series->slots,0,sizeof(series->slots));
+          memset(&series->current,0,sizeof(series->current));
+          series->nextSlot = 0;
+          series->nSlots = spindump_bandwidth_series_nslots;
+        } else {
+          for (; completed > 0; completed--) spindump_bandwidth_series_pushslot(series);
+        }
+      }
+      series->bytesInPeriod[i] = 0;
+      series->periodIndex[i] = index;
+    }
+    series->bytesInPeriod[i] += bytes;
+  }
+  series->started = 1;
+}
+
+//
+// Calculate the peak rates at each resolution, the mean rate, and the
+// burstiness of the completed periods in the multi-resolution series
+// of a bandwidth tracker, as of the given time. Periods that have
+// completed without packets since the last packet are counted as
+// empty, so that the peaks of idle connections age out of the
+// ring. All rates are in bytes per second. Returns 0 if there is no
+// series or no completed periods, and 1 otherwise.
+//
+
+int
+spindump_bandwidth_seriesstats(struct spindump_bandwidth* bandwidth,
+                               const spindump_time* now,
+                               struct spindump_bandwidth_series_stats* stats) {
+  spindump_assert(bandwidth != 0);
+  spindump_assert(now != 0);
+  spindump_assert(stats != 0);
+  memset(stats,0,sizeof(*stats));
+  struct spindump_bandwidth_series* series = bandwidth->series;
+  if (series == 0) return(0);
+  if (series->started) spindump_bandwidth_series_newpacket(series,0,now);
+  if (series->nSlots == 0) return(0);
+  spindump_counter_64bit total = 0;
+  unsigned long long resolution = spindump_bandwidth_series_finestresolution;
+  for (unsigned int i = 0;
+       i < spindump_bandwidth_series_nresolutions;
+       i++, resolution *= spindump_bandwidth_series_resolutionfactor) {
+    spindump_counter_64bit peak = 0;
+    for (unsigned int j = 0; j < series->nSlots; j++) {
+      spindump_counter_64bit bytes = series->slots[j].peakBytes[i];
+      if (bytes > peak) peak = bytes;
+      if (i == spindump_bandwidth_series_nresolutions - 1) total += bytes;
+    }
+    stats->peak[i] = (peak * 1000 * 1000) / resolution;
+    if (i == spindump_bandwidth_series_nresolutions - 1) {
+      stats->mean = (total * 1000 * 1000) / (series->nSlots * resolution);
+    }
+  }
+  if (stats->mean > 0) {
+    stats->burstiness = (unsigned int)((stats->peak[0] * 100) / stats->mean);
+  }
+  return(1);
 }
 
@@ -31,18 +31,61 @@
 //
 
 #define spindump_bandwidth_period_default             (1 * 1000 * 1000) // 1M us or 1s
+#define spindump_bandwidth_series_nresolutions        3                 // 100 ms, 1 s, and 10 s
+#define spindump_bandwidth_series_finestresolution    (100 * 1000)      // 100k us or 100 ms
+#define spindump_bandwidth_series_resolutionfactor    10                // each resolution 10x the previous one
+#define spindump_bandwidth_series_nslots              6                 // coarsest periods remembered, i.e., 1 min
 
 //
 // Data structures ----------------------------------------------------------------------------
 //
 
+enum spindump_bandwidth_series_mode {
+  spindump_bandwidth_series_none,
+  spindump_bandwidth_series_aggregates,
+  spindump_bandwidth_series_all
+};
+
+//
+// A slot in the ring of the bandwidth series represents one period
+// at the coarsest resolution. For each resolution, it holds the
+// largest number of bytes seen in a period of that resolution within
+// the slot's period. For the coarsest resolution that is simply the
+// number of bytes in the slot's period.
+//
+
+struct spindump_bandwidth_series_slot {
+  spindump_counter_64bit peakBytes[spindump_bandwidth_series_nresolutions];
+};
+
+struct spindump_bandwidth_series {
+  int                    started;            // has any packet been seen
+  unsigned long long     periodIndex
+    [spindump_bandwidth_series_nresolutions];  // current period at each resolution, as time / resolution
+  spindump_counter_64bit bytesInPeriod
+    [spindump_bandwidth_series_nresolutions];  // bytes during the current period at each resolution
+  struct spindump_bandwidth_series_slot
+                         current;            // the current (uncompleted) coarsest period
+  unsigned int           nSlots;             // number of completed slots in the ring
+  unsigned int           nextSlot;           // position in the ring for the next completed slot
+  struct spindump_bandwidth_series_slot
+                         slots[spindump_bandwidth_series_nslots];
+};
+
+struct spindump_bandwidth_series_stats {
+  spindump_counter_64bit peak[spindump_bandwidth_series_nresolutions]; // highest bytes/s at each resolution
+  spindump_counter_64bit mean;               // average bytes/s
+  unsigned int           burstiness;         // peak at the finest resolution vs. mean, in percent
+};
+
 struct spindump_bandwidth {
   unsigned long long     period;             // measurement period in microseconds
   spindump_counter_64bit bytes;              // all bytes, ever
   spindump_counter_64bit bytesInLastPeriod;  // bytes during the last completed period
-  struct timeval         thisPeriodStart;    // start of the current (uncompleted) period
+  spindump_time          thisPeriodStart;    // start of the current (uncompleted) period
   spindump_counter_64bit bytesInThisPeriod;  // bytes during the current (uncompleted) period
   unsigned int           periods;            // how many periods we've seen
+  struct spindump_bandwidth_series* series;  // multi-resolution history, or 0 if not enabled
 };
 
 //
@@ -55,14 +98,20 @@ spindump_bandwidth_initialize(struct spindump_bandwidth* bandwidth,
 void
 spindump_bandwidth_setcounter(struct spindump_bandwidth* bandwidth,
                               spindump_counter_64bit bytes,
-                              const struct timeval* timestamp);
+                              const spindump_time* timestamp);
 void
 spindump_bandwidth_newpacket(struct spindump_bandwidth* bandwidth,
                              unsigned int bytes,
-                             const struct timeval* timestamp);
+                             const spindump_time* timestamp);
 void
 spindump_bandwidth_uninitialize(struct spindump_bandwidth* bandwidth);
 spindump_counter_64bit
 spindump_bandwidth_periodbytes_to_bytespersec(const struct spindump_bandwidth* bandwidth);
+int
+spindump_bandwidth_enableseries(struct spindump_bandwidth* bandwidth);
+int
+spindump_bandwidth_seriesstats(struct spindump_bandwidth* bandwidth,
+                               const spindump_time* now,
+                               struct spindump_bandwidth_series_stats* stats);
 
 #endif // SPINDUMP_BANDWIDTH_H
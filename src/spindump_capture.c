@@ -21,8 +21,11 @@
 //
 
 #include <string.h>
+#include <errno.h>
 #include <stdlib.h>
 #include <unistd.h>
+#include <time.h>
+#include <pthread.h>
 #include <pcap.h>
 #include <sys/socket.h>
 #include <netdb.h>
@@ -32,6 +35,9 @@
 #include <netinet/icmp6.h>
 #include <netinet/if_ether.h>
 #include <arpa/inet.h>
+#ifdef __linux__
+#include <linux/if_packet.h>
+#endif
 #include "spindump_util.h"
 #include "spindump_protocols.h"
 #include "spindump_capture.h"
@@ -44,7 +50,37 @@ static struct spindump_capture_state*
 spindump_capture_initialize_aux(const char* interface,
                                 const char* file,
                                 const char* filter,
-                                unsigned int snaplen);
+                                unsigned int snaplen,
+                                enum spindump_capture_backend backend);
+static void
+spindump_capture_nextbatch_aux(struct spindump_capture_state* state,
+                               unsigned int maxPackets,
+                               struct spindump_packet** p_packets,
+                               unsigned int* p_nPackets,
+                               int* p_more,
+                               int wait,
+                               struct spindump_stats* stats);
+static void
+spindump_capture_nextbatch_ring(struct spindump_capture_state* state,
+                                unsigned int maxPackets,
+                                struct spindump_packet** p_packets,
+                                unsigned int* p_nPackets,
+                                int* p_more,
+                                struct spindump_stats* stats);
+static unsigned int
+spindump_capture_nextbatch_file(struct spindump_capture_state* state,
+                                struct spindump_packet* packets,
+                                unsigned int maxPackets,
+                                int* p_more);
+static void*
+spindump_capture_thread(void* arg);
+static int
+spindump_capture_getdrops_aux(struct spindump_capture_state* state,
+                              struct spindump_stats* stats);
+static void
+spindump_capture_stopthread(struct spindump_capture_state* state);
+static void
+spindump_capture_close(struct spindump_capture_state* state);
 
 //
 // Actual code --------------------------------------------------------------------------------
@@ -98,7 +134,8 @@ static struct spindump_capture_state*
 spindump_capture_initialize_aux(const char* interface,
                                 const char* file,
                                 const char* filter,
-                                unsigned int snaplen) {
+                                unsigned int snaplen,
+                                enum spindump_capture_backend backend) {
   //
   // Debugs
   // 
@@ -121,6 +158,7 @@ spindump_capture_initialize_aux(const char* interface,
   // 
 
   memset(state,0,sizeof(*state));
+  state->backend = backend;
 
   //
   // Determine what if anything we need to listen on
@@ -143,24 +181,68 @@ spindump_capture_initialize_aux(const char* interface,
     state->waitable = 0;
     return(state);
     
-  } else if (interface != 0) {
+  }
+
+  if (interface != 0 && ((int)snaplen) < 0) {
+    spindump_errorf("snaplen %u is too high", snaplen);
+    spindump_free(state);
+    return(0);
+  }
+  
+  if (interface != 0 && backend == spindump_capture_backend_tpacketv3) {
+
+    //
+    // Map a TPACKET_V3 ring for the interface. PCAP is only used for
+    // compiling the filter, for Ethernet headers.
+    //
 
-    if (((int)snaplen) < 0) {
-      spindump_errorf("snaplen %u is too high", snaplen);
+    state->tpacket = spindump_capture_tpacket_initialize(interface,snaplen);
+    if (state->tpacket == 0) {
+      spindump_free(state);
+      return(0);
+    }
+    state->handle = pcap_open_dead(DLT_EN10MB, (int)snaplen);
+    if (state->handle == 0) {
+      spindump_errorf("couldn't create a PCAP handle for filters");
+      spindump_capture_tpacket_uninitialize(state->tpacket);
       spindump_free(state);
       return(0);
     }
+    state->waitable = 0;
     
+  } else if (interface != 0) {
+
     //
-    // Open the PCAP interface
+    // Open the PCAP interface, with nanosecond timestamps if the PCAP
+    // library supports them
     // 
     
+#ifdef PCAP_TSTAMP_PRECISION_NANO
+    state->handle = pcap_create(interface, errbuf);
+    if (state->handle == 0) {
+      spindump_errorf("couldn't open device %s: %s", interface, errbuf);
+      spindump_free(state);
+      return(0);
+    }
+    pcap_set_snaplen(state->handle, (int)snaplen);
+    pcap_set_promisc(state->handle, promisc);
+    pcap_set_timeout(state->handle, spindump_capture_wait);
+    pcap_set_tstamp_precision(state->handle, PCAP_TSTAMP_PRECISION_NANO);
+    if (pcap_activate(state->handle) < 0) {
+      spindump_errorf("couldn't open device %s: %s", interface, pcap_geterr(state->handle));
+      pcap_close(state->handle);
+      spindump_free(state);
+      return(0);
+    }
+    state->nanoseconds = (pcap_get_tstamp_precision(state->handle) == PCAP_TSTAMP_PRECISION_NANO);
+#else
     state->handle = pcap_open_live(interface, (int)snaplen, promisc, spindump_capture_wait, errbuf);
     if (state->handle == 0) {
       spindump_errorf("couldn't open device %s: %s", interface, errbuf);
       spindump_free(state);
       return(0);
     }
+#endif
 
     //
     // Set "non-blocking" mode to enhance interface responsiveness. Using a timeout
@@ -188,12 +270,35 @@ spindump_capture_initialize_aux(const char* interface,
     state->waitable = 1;
     
   } else if (file != 0) {
+
+    //
+    // Map the file if it is in pcap or pcapng format, so that
+    // packets need not be copied. PCAP is then only used for
+    // compiling the filter. Otherwise, let PCAP read the file.
+    //
     
-    state->handle = pcap_open_offline(file, errbuf);
-    if (state->handle == 0) {
-      spindump_errorf("couldn't open file %s: %s", file, errbuf);
-      spindump_free(state);
-      return(0);
+    state->file = spindump_capture_file_initialize(file);
+    if (state->file != 0) {
+      state->handle = pcap_open_dead((int)spindump_capture_file_linktype(state->file),
+                                     (int)spindump_capture_file_snaplen(state->file));
+      if (state->handle == 0) {
+        spindump_errorf("couldn't create a PCAP handle for filters");
+        spindump_capture_file_uninitialize(state->file);
+        spindump_free(state);
+        return(0);
+      }
+    } else {
+#ifdef PCAP_TSTAMP_PRECISION_NANO
+      state->handle = pcap_open_offline_with_tstamp_precision(file, PCAP_TSTAMP_PRECISION_NANO, errbuf);
+      state->nanoseconds = 1;
+#else
+      state->handle = pcap_open_offline(file, errbuf);
+#endif
+      if (state->handle == 0) {
+        spindump_errorf("couldn't open file %s: %s", file, errbuf);
+        spindump_free(state);
+        return(0);
+      }
     }
 
     state->waitable = 0;
@@ -217,7 +322,7 @@ spindump_capture_initialize_aux(const char* interface,
   default:
     spindump_errorf("device %s doesn't provide Ethernet headers - value %u not supported",
                     interface, linktype);
-    pcap_close(state->handle);
+    spindump_capture_close(state);
     spindump_free(state);
     return(0);
   }
@@ -253,22 +358,42 @@ spindump_capture_initialize_aux(const char* interface,
     
     if (pcap_compile(state->handle, &state->compiledFilter, filter, 0, state->ourAddress) == -1) {
       spindump_errorf("couldn't parse filter %s: %s", filter, pcap_geterr(state->handle));
-      pcap_close(state->handle);
+      spindump_capture_close(state);
       spindump_free(state);
       return(0);
     }
     
     spindump_deepdebugf("installing filter...");
     
-    if (pcap_setfilter(state->handle, &state->compiledFilter) == -1) {
+    if (state->file != 0) {
+      state->filterInUserspace = 1;
+    } else if (state->tpacket != 0) {
+      if (!spindump_capture_tpacket_setfilter(state->tpacket, &state->compiledFilter)) {
+        spindump_errorf("couldn't install filter %s", filter);
+        spindump_capture_close(state);
+        spindump_free(state);
+        return(0);
+      }
+    } else if (pcap_setfilter(state->handle, &state->compiledFilter) == -1) {
       spindump_errorf("couldn't install filter %s: %s", filter, pcap_geterr(state->handle));
-      pcap_close(state->handle);
+      spindump_capture_close(state);
       spindump_free(state);
       return(0);
     }
 
   }
   
+  //
+  // The TPACKET_V3 socket starts receiving packets only now, after
+  // the filter is in place
+  //
+  
+  if (state->tpacket != 0 && !spindump_capture_tpacket_bind(state->tpacket)) {
+    spindump_capture_close(state);
+    spindump_free(state);
+    return(0);
+  }
+  
   spindump_debugf("PCAP initialized, own address %08x", state->ourAddress);
   
   //
@@ -286,21 +411,22 @@ struct spindump_capture_state*
 spindump_capture_initialize_file(const char* file,
                                  const char* filter) {
   spindump_debugf("opening capture file %s...", file);
-  return(spindump_capture_initialize_aux(0,file,filter,0));
+  return(spindump_capture_initialize_aux(0,file,filter,0,spindump_capture_backend_pcap));
 }
 
 //
 // Initialize a capture object to capture packets from a live
-// interface
+// interface, using the given capture backend
 //
 
 struct spindump_capture_state*
 spindump_capture_initialize_live(const char* interface,
                                  const char* filter,
-                                 unsigned int snaplen) {
+                                 unsigned int snaplen,
+                                 enum spindump_capture_backend backend) {
 
   spindump_debugf("opening capture on interface %s...", interface);
-  return(spindump_capture_initialize_aux(interface,0,filter,snaplen));
+  return(spindump_capture_initialize_aux(interface,0,filter,snaplen,backend));
   
 }
 
@@ -311,7 +437,7 @@ spindump_capture_initialize_live(const char* interface,
 struct spindump_capture_state*
 spindump_capture_initialize_null(void) {
   spindump_debugf("opening null capture...");
-  return(spindump_capture_initialize_aux(0,0,"",0));
+  return(spindump_capture_initialize_aux(0,0,"",0,spindump_capture_backend_pcap));
   
 }
 
@@ -346,11 +472,54 @@ spindump_capture_nextpacket(struct spindump_capture_state* state,
     return;
   }
   
+  //
+  // With a capture thread, take the next packet from its ring
+  //
+
+  if (state->ring != 0) {
+    struct spindump_packet* packets = 0;
+    unsigned int nPackets = 0;
+    spindump_capture_nextbatch_ring(state,1,&packets,&nPackets,p_more,stats);
+    *p_packet = (nPackets > 0) ? packets : 0;
+    return;
+  }
+  
+  //
+  // With a mapped file, take the next packet from the mapping
+  //
+
+  if (state->file != 0) {
+    unsigned int n = spindump_capture_nextbatch_file(state,&state->currentPacket,1,p_more);
+    *p_packet = (n > 0) ? &state->currentPacket : 0;
+    stats->receivedFrames += n;
+    return;
+  }
+  
+  //
+  // With the TPACKET_V3 backend, take the next packet from the ring
+  //
+
+  if (state->tpacket != 0) {
+    int ret = spindump_capture_tpacket_nextbatch(state->tpacket,
+                                                 &state->currentPacket,
+                                                 1,
+                                                 state->externalWait ? 0 : spindump_capture_wait_select / 1000);
+    if (ret > 0) {
+      *p_packet = &state->currentPacket;
+      stats->receivedFrames++;
+      *p_more = 1;
+    } else {
+      *p_packet = 0;
+      *p_more = (ret == 0);
+    }
+    return;
+  }
+  
   //
   // Otherwise, wait for the next packet
   //
   
-  if (state->waitable) {
+  if (state->waitable && !state->externalWait) {
     fd_set set = state->handleSet;
     struct timeval timeout = { .tv_sec = 0, .tv_usec = spindump_capture_wait_select };
     select(state->handleFD + 1, &set, NULL, NULL, &timeout);
@@ -371,7 +540,7 @@ spindump_capture_nextpacket(struct spindump_capture_state* state,
     // 
     
     *p_packet = packet;
-    packet->timestamp = header->ts;
+    spindump_timeval_to_time(&header->ts,state->nanoseconds,&packet->timestamp);
     packet->etherlen = header->len;
     packet->caplen = header->caplen;
     stats->receivedFrames++;
@@ -403,6 +572,443 @@ spindump_capture_nextpacket(struct spindump_capture_state* state,
   }
 }
 
+//
+// Make sure there is room for a batch of maxPackets packets in the
+// capture state. Returns 1 upon success, 0 upon failure.
+//
+
+static int
+spindump_capture_reservebatch(struct spindump_capture_state* state,
+                              unsigned int maxPackets) {
+
+  //
+  // The packet headers
+  //
+  
+  if (maxPackets > state->batchMax) {
+    unsigned int size = maxPackets * (unsigned int)sizeof(struct spindump_packet);
+    struct spindump_packet* batch = (struct spindump_packet*)spindump_malloc(size);
+    if (batch == 0) {
+      spindump_errorf("cannot allocate a batch of %u packets", maxPackets);
+      return(0);
+    }
+    if (state->batch != 0) spindump_free(state->batch);
+    state->batch = batch;
+    state->batchMax = maxPackets;
+  }
+
+  //
+  // The packet contents, when they need to be copied from PCAP. The
+  // buffer has room for at least one maximum size packet, and for
+  // the whole batch if that fits within spindump_capture_batchbuffer
+  // bytes.
+  //
+  
+  if (state->tpacket == 0) {
+    size_t snapshot = (size_t)pcap_snapshot(state->handle);
+    size_t size = snapshot * maxPackets;
+    if (size > spindump_capture_batchbuffer) size = spindump_capture_batchbuffer;
+    if (size < snapshot) size = snapshot;
+    if (size > state->batchBufferSize) {
+      unsigned char* buffer = (unsigned char*)spindump_malloc((unsigned int)size);
+      if (buffer == 0) {
+        spindump_errorf("cannot allocate a batch buffer of %lu bytes", (unsigned long)size);
+        return(0);
+      }
+      if (state->batchBuffer != 0) spindump_free(state->batchBuffer);
+      state->batchBuffer = buffer;
+      state->batchBufferSize = size;
+    }
+  }
+
+  return(1);
+}
+
+//
+// Retrieve up to maxPackets next packets from the capture interface
+// or file. The packets are stored in an array owned by the capture
+// state, and stay valid until the next call to
+// spindump_capture_nextbatch or spindump_capture_nextpacket. *p_packets
+// is set to the array and *p_nPackets to the number of packets in
+// it, which may be smaller than maxPackets even if more packets
+// follow.
+//
+
+void
+spindump_capture_nextbatch(struct spindump_capture_state* state,
+                           unsigned int maxPackets,
+                           struct spindump_packet** p_packets,
+                           unsigned int* p_nPackets,
+                           int* p_more,
+                           struct spindump_stats* stats) {
+  
+  //
+  // Check
+  // 
+  
+  spindump_assert(state != 0);
+  spindump_assert(maxPackets > 0);
+  spindump_assert(p_packets != 0);
+  spindump_assert(p_nPackets != 0);
+  spindump_assert(p_more != 0);
+  spindump_assert(stats != 0);
+
+  //
+  // Take the packets either from the capture thread or directly
+  //
+
+  if (state->ring != 0) {
+    spindump_capture_nextbatch_ring(state,maxPackets,p_packets,p_nPackets,p_more,stats);
+  } else {
+    spindump_capture_nextbatch_aux(state,maxPackets,p_packets,p_nPackets,p_more,!state->externalWait,stats);
+  }
+}
+
+//
+// Retrieve up to maxPackets next packets directly from the capture
+// interface or file. If wait is set, wait a moment for the first
+// packet. See spindump_capture_nextbatch.
+//
+
+static void
+spindump_capture_nextbatch_aux(struct spindump_capture_state* state,
+                               unsigned int maxPackets,
+                               struct spindump_packet** p_packets,
+                               unsigned int* p_nPackets,
+                               int* p_more,
+                               int wait,
+                               struct spindump_stats* stats) {
+  
+  *p_packets = 0;
+  *p_nPackets = 0;
+  *p_more = 1;
+  
+  //
+  // A null capture never returns packets
+  //
+
+  if (state->handle == 0) return;
+  if (!spindump_capture_reservebatch(state,maxPackets)) {
+    *p_more = 0;
+    return;
+  }
+  *p_packets = state->batch;
+  
+  //
+  // With a mapped file, the packets stay in the mapping
+  //
+
+  if (state->file != 0) {
+    *p_nPackets = spindump_capture_nextbatch_file(state,state->batch,maxPackets,p_more);
+    stats->receivedFrames += *p_nPackets;
+    return;
+  }
+  
+  //
+  // With the TPACKET_V3 backend, the packets stay in the ring
+  //
+
+  if (state->tpacket != 0) {
+    int ret = spindump_capture_tpacket_nextbatch(state->tpacket,
+                                                 state->batch,
+                                                 maxPackets,
+                                                 wait ? spindump_capture_wait_select / 1000 : 0);
+    if (ret > 0) {
+      *p_nPackets = (unsigned int)ret;
+      stats->receivedFrames += (unsigned int)ret;
+    } else if (ret < 0) {
+      *p_more = 0;
+    }
+    return;
+  }
+
+  //
+  // With PCAP, packets need to be copied, as PCAP reuses its buffer
+  // on the next read. Wait only for the first packet, and stop when
+  // no more packets are readily available or when the buffer might
+  // not have room for the next packet.
+  //
+  
+  if (state->waitable && wait) {
+    fd_set set = state->handleSet;
+    struct timeval timeout = { .tv_sec = 0, .tv_usec = spindump_capture_wait_select };
+    select(state->handleFD + 1, &set, NULL, NULL, &timeout);
+  }
+
+  size_t snapshot = (size_t)pcap_snapshot(state->handle);
+  size_t used = 0;
+  unsigned int n = 0;
+  while (n < maxPackets && state->batchBufferSize - used >= snapshot) {
+    
+    struct pcap_pkthdr* header = 0;
+    const unsigned char* contents = 0;
+    int ret = pcap_next_ex(state->handle, &header, &contents);
+    if (ret == 0) break;
+    if (ret != 1) {
+      *p_more = 0;
+      break;
+    }
+
+    struct spindump_packet* packet = &state->batch[n++];
+    memset(packet,0,sizeof(*packet));
+    unsigned int caplen = header->caplen;
+    if (caplen > state->batchBufferSize - used) caplen = (unsigned int)(state->batchBufferSize - used);
+    memcpy(state->batchBuffer + used,contents,caplen);
+    spindump_timeval_to_time(&header->ts,state->nanoseconds,&packet->timestamp);
+    packet->etherlen = header->len;
+    packet->caplen = caplen;
+    packet->contents = state->batchBuffer + used;
+    used += caplen;
+    stats->receivedFrames++;
+    
+  }
+  
+  *p_nPackets = n;
+}
+
+//
+// Read up to maxPackets next packets from a mapped file to the
+// packets array, and apply the filter, if any. Returns the number
+// of packets that passed the filter.
+//
+
+static unsigned int
+spindump_capture_nextbatch_file(struct spindump_capture_state* state,
+                                struct spindump_packet* packets,
+                                unsigned int maxPackets,
+                                int* p_more) {
+  
+  unsigned int n = spindump_capture_file_nextbatch(state->file,packets,maxPackets);
+  *p_more = (n > 0);
+  if (!state->filterInUserspace) return(n);
+  
+  unsigned int passed = 0;
+  for (unsigned int i = 0; i < n; i++) {
+    struct pcap_pkthdr header;
+    memset(&header,0,sizeof(header));
+    header.caplen = packets[i].caplen;
+    header.len = packets[i].etherlen;
+    if (pcap_offline_filter(&state->compiledFilter,&header,packets[i].contents) != 0) {
+      if (passed != i) packets[passed] = packets[i];
+      passed++;
+    }
+  }
+  return(passed);
+}
+
+//
+// Retrieve up to maxPackets next packets from the ring filled by the
+// capture thread. If the ring is empty, wait a moment so that the
+// caller does not need to spin, or if the caller waits on the ring's
+// notifier, ask the capture thread to signal it upon the next
+// packets. See spindump_capture_nextbatch.
+//
+
+static void
+spindump_capture_nextbatch_ring(struct spindump_capture_state* state,
+                                unsigned int maxPackets,
+                                struct spindump_packet** p_packets,
+                                unsigned int* p_nPackets,
+                                int* p_more,
+                                struct spindump_stats* stats) {
+  
+  struct spindump_capture_ring* ring = state->ring;
+  int finished = 0;
+  unsigned int n = spindump_capture_ring_get(ring,maxPackets,p_packets,&finished);
+  if (n == 0 && !finished && state->externalWait) {
+    n = spindump_capture_ring_preparewait(ring,maxPackets,p_packets,&finished);
+  } else if (n == 0 && !finished) {
+    struct timespec wait = { .tv_sec = 0, .tv_nsec = spindump_capture_wait * 1000 * 1000 };
+    nanosleep(&wait,0);
+    n = spindump_capture_ring_get(ring,maxPackets,p_packets,&finished);
+  }
+  
+  *p_nPackets = n;
+  *p_more = !finished;
+  stats->receivedFrames += n;
+  stats->captureRingHighWater = __atomic_load_n(&ring->highWater,__ATOMIC_RELAXED);
+  stats->captureRingOverflows = __atomic_load_n(&ring->overflows,__ATOMIC_RELAXED);
+  stats->captureKernelDrops = __atomic_load_n(&ring->kernelDrops,__ATOMIC_RELAXED);
+  stats->captureInterfaceDrops = __atomic_load_n(&ring->interfaceDrops,__ATOMIC_RELAXED);
+}
+
+//
+// Start a capture thread that reads packets from the interface and
+// copies them to a ring of ringSize packets, from which
+// spindump_capture_nextbatch and spindump_capture_nextpacket then
+// take them. This way, the analysis can fall behind momentarily
+// without the interface dropping packets. Packets are dropped (and
+// counted) only when the ring is full. Returns 1 upon success, 0 upon
+// failure.
+//
+
+int
+spindump_capture_startthread(struct spindump_capture_state* state,
+                             unsigned int ringSize) {
+  
+  spindump_assert(state != 0);
+  spindump_assert(state->ring == 0);
+  spindump_assert(ringSize > 0);
+  
+  if (state->handle == 0) {
+    spindump_errorf("cannot start a capture thread without an interface");
+    return(0);
+  }
+  
+  int snapshot = pcap_snapshot(state->handle);
+  struct spindump_capture_ring* ring =
+    spindump_capture_ring_initialize(ringSize,
+                                     snapshot > 0 ? (unsigned int)snapshot : spindump_capture_snaplen);
+  if (ring == 0) return(0);
+  
+  state->threadStop = 0;
+  state->ring = ring;
+  int ret = pthread_create(&state->thread,0,spindump_capture_thread,state);
+  if (ret != 0) {
+    spindump_errorf("cannot create a capture thread: %s", strerror(ret));
+    state->ring = 0;
+    spindump_capture_ring_uninitialize(ring);
+    return(0);
+  }
+  
+  spindump_debugf("started a capture thread with a ring of %u packets", ring->nSlots);
+  return(1);
+}
+
+//
+// The capture thread: move packets from the interface to the ring
+// until the capture ends or the thread is asked to stop. As only this
+// thread uses the capture, it also samples the drop counts of the
+// capture now and then, and publishes them through the ring.
+//
+
+static void*
+spindump_capture_thread(void* arg) {
+  
+  struct spindump_capture_state* state = (struct spindump_capture_state*)arg;
+  struct spindump_capture_ring* ring = state->ring;
+  struct spindump_stats* stats = spindump_stats_initialize();
+  int more = (stats != 0);
+  spindump_time previousDrops = 0;
+  
+  while (more && !__atomic_load_n(&state->threadStop,__ATOMIC_ACQUIRE)) {
+    struct spindump_packet* packets = 0;
+    unsigned int nPackets = 0;
+    spindump_capture_nextbatch_aux(state,spindump_capture_batchsize,&packets,&nPackets,&more,1,stats);
+    for (unsigned int i = 0; i < nPackets; i++) {
+      spindump_capture_ring_put(ring,&packets[i]);
+    }
+    if (nPackets > 0) spindump_capture_ring_wakeup(ring);
+    spindump_time now;
+    spindump_getcurrenttime(&now);
+    if (spindump_timediffinusecs(&now,&previousDrops) >= spindump_capture_dropsperiod &&
+        spindump_capture_getdrops_aux(state,stats)) {
+      spindump_capture_ring_setdrops(ring,stats->captureKernelDrops,stats->captureInterfaceDrops);
+      previousDrops = now;
+    }
+  }
+  
+  if (stats != 0 && spindump_capture_getdrops_aux(state,stats)) {
+    spindump_capture_ring_setdrops(ring,stats->captureKernelDrops,stats->captureInterfaceDrops);
+  }
+  spindump_capture_ring_finish(ring);
+  if (stats != 0) spindump_stats_uninitialize(stats);
+  return(0);
+}
+
+//
+// Stop the capture thread, if any, and delete its ring
+//
+
+static void
+spindump_capture_stopthread(struct spindump_capture_state* state) {
+  if (state->ring == 0) return;
+  __atomic_store_n(&state->threadStop,1,__ATOMIC_RELEASE);
+  pthread_join(state->thread,0);
+  spindump_capture_ring_uninitialize(state->ring);
+  state->ring = 0;
+}
+
+//
+// Make the capture socket a member of the PACKET_FANOUT group
+// "group", so that the kernel distributes the packets among the
+// sockets in the group. Packets are distributed by a hash of their
+// addresses and ports, which is the same for both directions of a
+// flow, so all packets of a connection go to the same socket. Only
+// live capture on Linux is supported. Returns 1 upon success, 0 upon
+// failure.
+//
+
+int
+spindump_capture_setfanout(struct spindump_capture_state* state,
+                           unsigned int group) {
+
+  //
+  // Check
+  //
+  
+  spindump_assert(state != 0);
+
+#if defined(__linux__) && defined(PACKET_FANOUT)
+  
+  //
+  // Find the socket
+  //
+  
+  int fd;
+  if (state->tpacket != 0) {
+    fd = state->tpacket->fd;
+  } else if (state->waitable) {
+    fd = state->handleFD;
+  } else {
+    spindump_errorf("packet fanout requires live capture");
+    return(0);
+  }
+
+  //
+  // Join the group
+  //
+  
+  int arg = (int)((group & 0xffff) | ((PACKET_FANOUT_HASH | PACKET_FANOUT_FLAG_DEFRAG) << 16));
+  if (setsockopt(fd,SOL_PACKET,PACKET_FANOUT,&arg,sizeof(arg)) < 0) {
+    spindump_errorf("cannot join packet fanout group %u: %s", group, strerror(errno));
+    return(0);
+  }
+
+  spindump_debugf("joined packet fanout group %u", group);
+  return(1);
+  
+#else
+
+  (void)group;
+  spindump_errorf("packet fanout is not supported on this platform");
+  return(0);
+  
+#endif
+  
+}
+
+//
+// Map a capture backend name, as given on the command line, to the
+// backend. Returns 1 upon success, 0 if the name is not recognised.
+//
+
+int
+spindump_capture_parsebackend(const char* name,
+                              enum spindump_capture_backend* backend) {
+  spindump_assert(name != 0);
+  spindump_assert(backend != 0);
+  if (strcmp(name,"pcap") == 0) {
+    *backend = spindump_capture_backend_pcap;
+    return(1);
+  } else if (strcmp(name,"tpacketv3") == 0) {
+    *backend = spindump_capture_backend_tpacketv3;
+    return(1);
+  } else {
+    return(0);
+  }
+}
+
 //
 // Return the currently used data link layer type
 //
@@ -412,6 +1018,96 @@ spindump_capture_getlinktype(struct spindump_capture_state* state) {
   return(state->linktype);
 }
 
+//
+// Return a file descriptor that becomes readable when packets may be
+// available, or -1 if there's none (e.g., when reading from a file,
+// or for a null capture). If a descriptor is returned, the caller
+// takes over the waiting, and spindump_capture_nextbatch no longer
+// waits for packets but returns immediately if there are none. The
+// caller should then wait on the descriptor only after a call that
+// returned no packets.
+//
+
+int
+spindump_capture_getselectablefd(struct spindump_capture_state* state) {
+  
+  spindump_assert(state != 0);
+  
+  int fd = -1;
+  if (state->ring != 0) {
+    fd = state->ring->notifier.readFd;
+  } else if (state->file != 0 || state->handle == 0) {
+    fd = -1;
+  } else if (state->tpacket != 0) {
+    fd = state->tpacket->fd;
+  } else if (state->waitable) {
+    fd = state->handleFD;
+  }
+  
+  if (fd >= 0) state->externalWait = 1;
+  return(fd);
+}
+
+//
+// Update the counts of packets dropped in the kernel and in the
+// interface, for live captures. The counts are totals since the
+// capture was opened. (Drops from the capture ring, if any, are
+// counted as packets are taken from the ring.) Returns 1 if the
+// counts were updated, 0 if they are not available.
+//
+// With a capture thread, the counts are the ones the capture thread
+// published most recently. Otherwise, this must be called from the
+// thread that reads packets from the capture.
+//
+
+int
+spindump_capture_getdrops(struct spindump_capture_state* state,
+                          struct spindump_stats* stats) {
+  
+  spindump_assert(state != 0);
+  spindump_assert(stats != 0);
+  
+  if (state->ring != 0) {
+    stats->captureKernelDrops = __atomic_load_n(&state->ring->kernelDrops,__ATOMIC_RELAXED);
+    stats->captureInterfaceDrops = __atomic_load_n(&state->ring->interfaceDrops,__ATOMIC_RELAXED);
+    return(1);
+  }
+  return(spindump_capture_getdrops_aux(state,stats));
+}
+
+//
+// Read the drop counts from the capture itself, for
+// spindump_capture_getdrops.
+//
+// The PCAP library only has 32-bit counts, so its kernel drops are
+// added to the 64-bit total as the increase since the previous call,
+// which stays correct when the PCAP count wraps around.
+//
+
+static int
+spindump_capture_getdrops_aux(struct spindump_capture_state* state,
+                              struct spindump_stats* stats) {
+  
+  if (state->tpacket != 0) {
+    unsigned long long drops;
+    if (!spindump_capture_tpacket_getdrops(state->tpacket,&drops)) return(0);
+    stats->captureKernelDrops = drops;
+    return(1);
+  } else if (state->waitable) {
+    struct pcap_stat pcapStats;
+    memset(&pcapStats,0,sizeof(pcapStats));
+    if (pcap_stats(state->handle,&pcapStats) < 0) {
+      spindump_debugf("cannot get capture statistics: %s", pcap_geterr(state->handle));
+      return(0);
+    }
+    stats->captureKernelDrops += (uint32_t)(pcapStats.ps_drop - (uint32_t)stats->captureKernelDrops);
+    stats->captureInterfaceDrops = pcapStats.ps_ifdrop;
+    return(1);
+  } else {
+    return(0);
+  }
+}
+
 //
 // Delete the object, close the PCAP interface
 //
@@ -429,9 +1125,9 @@ spindump_capture_uninitialize(struct spindump_capture_state* state) {
   // Close and cleanup
   // 
 
-  if (state->handle != 0) {
-    pcap_close(state->handle);
-  }
+  spindump_capture_close(state);
+  if (state->batch != 0) spindump_free(state->batch);
+  if (state->batchBuffer != 0) spindump_free(state->batchBuffer);
   memset(state,0,sizeof(*state));
   
   //
@@ -441,3 +1137,23 @@ spindump_capture_uninitialize(struct spindump_capture_state* state) {
   spindump_free(state);
 }
 
+//
+// Close the PCAP handle, the TPACKET_V3 ring, and the mapped file, if any
+//
+
+static void
+spindump_capture_close(struct spindump_capture_state* state) {
+  spindump_capture_stopthread(state);
+  if (state->tpacket != 0) {
+    spindump_capture_tpacket_uninitialize(state->tpacket);
+    state->tpacket = 0;
+  }
+  if (state->file != 0) {
+    spindump_capture_file_uninitialize(state->file);
+    state->file = 0;
+  }
+  if (state->handle != 0) {
+    pcap_close(state->handle);
+    state->handle = 0;
+  }
+}
@@ -24,9 +24,13 @@
 //
 
 #include <pcap.h>
+#include <pthread.h>
 #include "spindump_protocols.h"
 #include "spindump_packet.h"
 #include "spindump_stats.h"
+#include "spindump_capture_tpacket.h"
+#include "spindump_capture_ring.h"
+#include "spindump_capture_file.h"
 
 //
 // Capture parameters -------------------------------------------------------------------------
@@ -35,6 +39,9 @@
 #define spindump_capture_snaplen        128   // bytes
 #define spindump_capture_wait           1     // ms
 #define spindump_capture_wait_select    5000  // usec
+#define spindump_capture_batchsize      32    // packets
+#define spindump_capture_batchbuffer    (4*1024*1024) // bytes
+#define spindump_capture_dropsperiod    (100*1000) // usec between updates of drop counts by capturing threads
 
 //
 // Capture data structures --------------------------------------------------------------------
@@ -47,9 +54,20 @@ enum spindump_capture_linktype {
   spindump_capture_linktype_raw
 };
 
+enum spindump_capture_backend {
+  spindump_capture_backend_pcap,
+  spindump_capture_backend_tpacketv3
+};
+
 struct spindump_capture_state {
+  enum spindump_capture_backend backend;
   pcap_t *handle;
+  struct spindump_capture_tpacket* tpacket;
+  struct spindump_capture_file* file;
+  int filterInUserspace;
   int waitable;
+  int externalWait;                             // the caller waits on spindump_capture_getselectablefd
+  int nanoseconds;                              // PCAP headers have nanoseconds in tv_usec
   int handleFD;
   fd_set handleSet;
   enum spindump_capture_linktype linktype;
@@ -58,6 +76,13 @@ struct spindump_capture_state {
   uint32_t ourLocalBroadcastAddress;
   struct bpf_program compiledFilter;
   struct spindump_packet currentPacket;
+  struct spindump_packet* batch;
+  unsigned int batchMax;
+  unsigned char* batchBuffer;
+  size_t batchBufferSize;
+  struct spindump_capture_ring* ring;           // set if a capture thread is running
+  pthread_t thread;
+  int threadStop;
 };
 
 //
@@ -69,20 +94,42 @@ spindump_capture_defaultinterface(void);
 struct spindump_capture_state*
 spindump_capture_initialize_live(const char* interface,
                                  const char* filter,
-                                 unsigned int snaplen);
+                                 unsigned int snaplen,
+                                 enum spindump_capture_backend backend);
 struct spindump_capture_state*
 spindump_capture_initialize_file(const char* file,
                                  const char* filter);
 struct spindump_capture_state*
 spindump_capture_initialize_null(void);
+int
+spindump_capture_startthread(struct spindump_capture_state* state,
+                             unsigned int ringSize);
+int
+spindump_capture_setfanout(struct spindump_capture_state* state,
+                           unsigned int group);
+int
+spindump_capture_parsebackend(const char* name,
+                              enum spindump_capture_backend* backend);
 enum spindump_capture_linktype
 spindump_capture_getlinktype(struct spindump_capture_state* state);
+int
+spindump_capture_getselectablefd(struct spindump_capture_state* state);
+int
+spindump_capture_getdrops(struct spindump_capture_state* state,
+                          struct spindump_stats* stats);
 void
 spindump_capture_nextpacket(struct spindump_capture_state* state,
                             struct spindump_packet** p_packet,
                             int* p_more,
                             struct spindump_stats* stats);
 void
+spindump_capture_nextbatch(struct spindump_capture_state* state,
+                           unsigned int maxPackets,
+                           struct spindump_packet** p_packets,
+                           unsigned int* p_nPackets,
+                           int* p_more,
+                           struct spindump_stats* stats);
+void
 spindump_capture_uninitialize(struct spindump_capture_state* state);
 
 #endif // SPINDUMP_CAPTURE_H
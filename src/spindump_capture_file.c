@@ -0,0 +1,527 @@
+
+//
+//
+//  ////////////////////////////////////////////////////////////////////////////////////
+//  /////////                                                                ///////////
+//  //////       SSS    PPPP    I   N    N   DDDD    U   U   M   M   PPPP         //////
+//  //          S       P   P   I   NN   N   D   D   U   U   MM MM   P   P            //
+//  /            SSS    PPPP    I   N NN N   D   D   U   U   M M M   PPPP              /
+//  //              S   P       I   N   NN   D   D   U   U   M   M   P                //
+//  ////         SSS    P       I   N    N   DDDD     UUU    M   M   P            //////
+//  /////////                                                                ///////////
+//  ////////////////////////////////////////////////////////////////////////////////////
+//
+//  SPINDUMP (C) 2018-2020 BY ERICSSON RESEARCH
+//  AUTHOR: JARI ARKKO
+//
+
+//
+// Includes -----------------------------------------------------------------------------------
+//
+
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <pcap.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include "spindump_util.h"
+#include "spindump_capture_file.h"
+
+//
+// Parameters ---------------------------------------------------------------------------------
+//
+
+#define spindump_capture_file_pcap_headerlen    24
+#define spindump_capture_file_pcap_recordlen    16
+#define spindump_capture_file_pcap_magic        0xa1b2c3d4
+#define spindump_capture_file_pcap_magic_nano   0xa1b23c4d
+#define spindump_capture_file_pcapng_shb        0x0a0d0d0a
+#define spindump_capture_file_pcapng_idb        1
+#define spindump_capture_file_pcapng_pb         2
+#define spindump_capture_file_pcapng_spb        3
+#define spindump_capture_file_pcapng_epb        6
+#define spindump_capture_file_pcapng_byteorder  0x1a2b3c4d
+#define spindump_capture_file_pcapng_tsresol    9
+#define spindump_capture_file_pcapng_tsoffset   14
+#define spindump_capture_file_linktype_raw      101
+#define spindump_capture_file_nolinktype        0xffffffff
+
+//
+// Function prototypes ------------------------------------------------------------------------
+//
+
+static uint16_t
+spindump_capture_file_get16(struct spindump_capture_file* file,
+                            size_t offset);
+static uint32_t
+spindump_capture_file_get32(struct spindump_capture_file* file,
+                            size_t offset);
+static int
+spindump_capture_file_pcapng_block(struct spindump_capture_file* file,
+                                   struct spindump_packet* packet);
+static int
+spindump_capture_file_pcapng_interface(struct spindump_capture_file* file,
+                                       size_t block,
+                                       uint32_t length);
+static void
+spindump_capture_file_settimestamp(struct spindump_packet* packet,
+                                   uint64_t timestamp,
+                                   uint64_t unitsPerSecond,
+                                   int64_t offset);
+
+//
+// Actual code --------------------------------------------------------------------------------
+//
+
+//
+// Map a pcap or pcapng file. Returns 0 if the file cannot be opened
+// or is not in a format known to this reader, in which case PCAP
+// may still be able to read it.
+//
+
+struct spindump_capture_file*
+spindump_capture_file_initialize(const char* name) {
+
+  //
+  // Allocate
+  //
+
+  spindump_assert(name != 0);
+  unsigned int size = sizeof(struct spindump_capture_file);
+  struct spindump_capture_file* file = (struct spindump_capture_file*)spindump_malloc(size);
+  if (file == 0) {
+    spindump_errorf("cannot allocate file capture state of %u bytes", size);
+    return(0);
+  }
+  memset(file,0,sizeof(*file));
+
+  //
+  // Map the file
+  //
+
+  int fd = open(name,O_RDONLY);
+  struct stat st;
+  if (fd < 0 || fstat(fd,&st) < 0 || st.st_size < spindump_capture_file_pcap_headerlen) {
+    spindump_debugf("cannot map file %s: %s", name, fd < 0 ? strerror(errno) : "too short");
+    if (fd >= 0) close(fd);
+    spindump_free(file);
+    return(0);
+  }
+  file->size = (size_t)st.st_size;
+  void* map = mmap(0,file->size,PROT_READ,MAP_PRIVATE,fd,0);
+  close(fd);
+  if (map == MAP_FAILED) {
+    spindump_debugf("cannot map file %s: %s", name, strerror(errno));
+    spindump_free(file);
+    return(0);
+  }
+  file->map = (const uint8_t*)map;
+  madvise(map,file->size,MADV_SEQUENTIAL);
+
+  //
+  // Look at the magic number to determine the format and byte order
+  //
+
+  uint32_t magic;
+  memcpy(&magic,file->map,sizeof(magic));
+  if (magic == spindump_capture_file_pcapng_shb) {
+    
+    //
+    // A pcapng file. Read blocks up to the first interface
+    // description, which determines the link type.
+    //
+    
+    file->pcapng = 1;
+    file->linktype = spindump_capture_file_nolinktype;
+    spindump_getcurrenttime(&file->previousTimestamp);
+    while (file->nInterfaces == 0) {
+      struct spindump_packet packet;
+      if (spindump_capture_file_pcapng_block(file,&packet) != 0) {
+        spindump_debugf("no interface description before packets in %s", name);
+        spindump_capture_file_uninitialize(file);
+        return(0);
+      }
+    }
+    
+  } else if (magic == spindump_capture_file_pcap_magic ||
+             magic == spindump_capture_file_pcap_magic_nano ||
+             magic == __builtin_bswap32(spindump_capture_file_pcap_magic) ||
+             magic == __builtin_bswap32(spindump_capture_file_pcap_magic_nano)) {
+
+    //
+    // A pcap file, with microsecond or nanosecond timestamps
+    //
+
+    file->swapped = (magic != spindump_capture_file_pcap_magic &&
+                     magic != spindump_capture_file_pcap_magic_nano);
+    uint32_t ordered = spindump_capture_file_get32(file,0);
+    file->unitsPerSecond = (ordered == spindump_capture_file_pcap_magic_nano) ? 1000000000 : 1000000;
+    file->snaplen = spindump_capture_file_get32(file,16);
+    file->linktype = spindump_capture_file_get32(file,20) & 0xffff;
+    file->position = spindump_capture_file_pcap_headerlen;
+    
+  } else {
+    
+    spindump_debugf("file %s is not a pcap or pcapng file", name);
+    spindump_capture_file_uninitialize(file);
+    return(0);
+    
+  }
+
+  //
+  // Done
+  //
+  
+  spindump_debugf("mapped %s file %s of %lu bytes, link type %u",
+                  file->pcapng ? "pcapng" : "pcap",
+                  name, (unsigned long)file->size, file->linktype);
+  return(file);
+}
+
+//
+// Return the PCAP data link type (DLT_ value) of the file
+//
+
+unsigned int
+spindump_capture_file_linktype(struct spindump_capture_file* file) {
+  spindump_assert(file != 0);
+  if (file->linktype == spindump_capture_file_linktype_raw) return(DLT_RAW);
+  return(file->linktype);
+}
+
+//
+// Return the snapshot length of the file
+//
+
+unsigned int
+spindump_capture_file_snaplen(struct spindump_capture_file* file) {
+  spindump_assert(file != 0);
+  if (file->snaplen == 0 || file->snaplen > spindump_capture_file_maxsnaplen) {
+    return(spindump_capture_file_maxsnaplen);
+  }
+  return(file->snaplen);
+}
+
+//
+// Read up to maxPackets next packets from the file. The packet
+// contents are not copied, they point to the mapped file. Returns the
+// number of packets read, 0 at the end of the file or upon an error
+// in the file.
+//
+
+unsigned int
+spindump_capture_file_nextbatch(struct spindump_capture_file* file,
+                                struct spindump_packet* packets,
+                                unsigned int maxPackets) {
+
+  spindump_assert(file != 0);
+  spindump_assert(packets != 0);
+  
+  unsigned int n = 0;
+  while (n < maxPackets) {
+    
+    struct spindump_packet* packet = &packets[n];
+    memset(packet,0,sizeof(*packet));
+    
+    if (file->pcapng) {
+
+      //
+      // Skip any non-packet blocks
+      //
+      
+      int ret = spindump_capture_file_pcapng_block(file,packet);
+      if (ret < 0) break;
+      if (ret > 0) n++;
+      
+    } else {
+
+      //
+      // Read the next record
+      //
+      
+      if (file->size - file->position < spindump_capture_file_pcap_recordlen) break;
+      uint32_t seconds = spindump_capture_file_get32(file,file->position);
+      uint32_t fraction = spindump_capture_file_get32(file,file->position + 4);
+      uint32_t caplen = spindump_capture_file_get32(file,file->position + 8);
+      uint32_t len = spindump_capture_file_get32(file,file->position + 12);
+      size_t data = file->position + spindump_capture_file_pcap_recordlen;
+      if (caplen > file->size - data) {
+        spindump_warnf("truncated packet at offset %lu in the input file", (unsigned long)file->position);
+        file->position = file->size;
+        break;
+      }
+      spindump_capture_file_settimestamp(packet,
+                                         (uint64_t)seconds * file->unitsPerSecond + fraction,
+                                         file->unitsPerSecond,
+                                         0);
+      packet->etherlen = len;
+      packet->caplen = caplen;
+      packet->contents = file->map + data;
+      file->position = data + caplen;
+      n++;
+      
+    }
+  }
+
+  return(n);
+}
+
+//
+// Unmap the file and free the state
+//
+
+void
+spindump_capture_file_uninitialize(struct spindump_capture_file* file) {
+  spindump_assert(file != 0);
+  if (file->map != 0) munmap((void*)file->map,file->size);
+  spindump_free(file);
+}
+
+//
+// Read a 16-bit value from the file, in the byte order of the file
+//
+
+static uint16_t
+spindump_capture_file_get16(struct spindump_capture_file* file,
+                            size_t offset) {
+  uint16_t value;
+  memcpy(&value,file->map + offset,sizeof(value));
+  return(file->swapped ? __builtin_bswap16(value) : value);
+}
+
+//
+// Read a 32-bit value from the file, in the byte order of the file
+//
+
+static uint32_t
+spindump_capture_file_get32(struct spindump_capture_file* file,
+                            size_t offset) {
+  uint32_t value;
+  memcpy(&value,file->map + offset,sizeof(value));
+  return(file->swapped ? __builtin_bswap32(value) : value);
+}
+
+//
+// Read the next pcapng block. Returns 1 if the block was a packet,
+// which is then stored in *packet, 0 if it was some other block, and
+// -1 at the end of the file or upon an error in the file.
+//
+
+static int
+spindump_capture_file_pcapng_block(struct spindump_capture_file* file,
+                                   struct spindump_packet* packet) {
+
+  //
+  // Read the block header
+  //
+  
+  size_t block = file->position;
+  if (file->size - block < 12) return(-1);
+  uint32_t type;
+  memcpy(&type,file->map + block,sizeof(type));
+  if (type == spindump_capture_file_pcapng_shb) {
+    uint32_t byteorder;
+    memcpy(&byteorder,file->map + block + 8,sizeof(byteorder));
+    if (byteorder == spindump_capture_file_pcapng_byteorder) {
+      file->swapped = 0;
+    } else if (byteorder == __builtin_bswap32(spindump_capture_file_pcapng_byteorder)) {
+      file->swapped = 1;
+    } else {
+      spindump_warnf("invalid pcapng section at offset %lu in the input file", (unsigned long)block);
+      return(-1);
+    }
+    file->nInterfaces = 0;
+  } else {
+    type = spindump_capture_file_get32(file,block);
+  }
+  uint32_t length = spindump_capture_file_get32(file,block + 4);
+  if (length < 12 || (length & 3) != 0 || length > file->size - block) {
+    spindump_warnf("invalid pcapng block at offset %lu in the input file", (unsigned long)block);
+    file->position = file->size;
+    return(-1);
+  }
+  file->position = block + length;
+  
+  //
+  // Interpret it
+  //
+
+  uint32_t interface = 0;
+  uint64_t timestamp = 0;
+  uint32_t caplen;
+  uint32_t len;
+  size_t data;
+  
+  switch (type) {
+    
+  case spindump_capture_file_pcapng_idb:
+    if (!spindump_capture_file_pcapng_interface(file,block,length)) {
+      file->position = file->size;
+      return(-1);
+    }
+    return(0);
+    
+  case spindump_capture_file_pcapng_epb:
+    if (length < 32) return(0);
+    interface = spindump_capture_file_get32(file,block + 8);
+    timestamp = ((uint64_t)spindump_capture_file_get32(file,block + 12) << 32) |
+      spindump_capture_file_get32(file,block + 16);
+    caplen = spindump_capture_file_get32(file,block + 20);
+    len = spindump_capture_file_get32(file,block + 24);
+    data = block + 28;
+    break;
+    
+  case spindump_capture_file_pcapng_pb:
+    if (length < 32) return(0);
+    interface = spindump_capture_file_get16(file,block + 8);
+    timestamp = ((uint64_t)spindump_capture_file_get32(file,block + 12) << 32) |
+      spindump_capture_file_get32(file,block + 16);
+    caplen = spindump_capture_file_get32(file,block + 20);
+    len = spindump_capture_file_get32(file,block + 24);
+    data = block + 28;
+    break;
+    
+  case spindump_capture_file_pcapng_spb:
+    if (length < 16) return(0);
+    len = spindump_capture_file_get32(file,block + 8);
+    data = block + 12;
+    caplen = length - 16;
+    if (caplen > len) caplen = len;
+    if (file->nInterfaces > 0 &&
+        file->interfaces[0].snaplen > 0 &&
+        caplen > file->interfaces[0].snaplen) {
+      caplen = file->interfaces[0].snaplen;
+    }
+    break;
+    
+  default:
+    return(0);
+    
+  }
+
+  //
+  // Check the packet against its interface and block
+  //
+
+  if (interface >= file->nInterfaces) {
+    spindump_warnf("packet for an unknown interface %u in the input file", interface);
+    file->position = file->size;
+    return(-1);
+  }
+  if (caplen > block + length - 4 - data) {
+    spindump_warnf("truncated packet at offset %lu in the input file", (unsigned long)block);
+    file->position = file->size;
+    return(-1);
+  }
+
+  //
+  // Return the packet. Simple packet blocks have no timestamp, use
+  // the timestamp of the previous packet, or the time the file was
+  // opened if there was none.
+  //
+
+  struct spindump_capture_file_interface* iface = &file->interfaces[interface];
+  if (type == spindump_capture_file_pcapng_spb) {
+    packet->timestamp = file->previousTimestamp;
+  } else {
+    spindump_capture_file_settimestamp(packet,timestamp,iface->unitsPerSecond,iface->offset);
+    file->previousTimestamp = packet->timestamp;
+  }
+  packet->etherlen = len;
+  packet->caplen = caplen;
+  packet->contents = file->map + data;
+  return(1);
+}
+
+//
+// Read a pcapng interface description block. Returns 1 upon success,
+// 0 upon failure.
+//
+
+static int
+spindump_capture_file_pcapng_interface(struct spindump_capture_file* file,
+                                       size_t block,
+                                       uint32_t length) {
+
+  //
+  // Check that there is room for it, and that all interfaces use the
+  // same link type
+  //
+  
+  if (length < 20) return(1);
+  if (file->nInterfaces >= spindump_capture_file_maxinterfaces) {
+    spindump_warnf("too many interfaces in the input file, maximum is %u",
+                   spindump_capture_file_maxinterfaces);
+    return(0);
+  }
+  struct spindump_capture_file_interface* iface = &file->interfaces[file->nInterfaces];
+  iface->linktype = spindump_capture_file_get16(file,block + 8);
+  iface->snaplen = spindump_capture_file_get32(file,block + 12);
+  iface->unitsPerSecond = 1000000;
+  iface->offset = 0;
+  if (file->linktype == spindump_capture_file_nolinktype) {
+    file->linktype = iface->linktype;
+    file->snaplen = iface->snaplen;
+  } else if (iface->linktype != file->linktype) {
+    spindump_warnf("interfaces with different link types (%u and %u) in the input file",
+                   file->linktype, iface->linktype);
+    return(0);
+  }
+
+  //
+  // Look for the timestamp resolution and offset options
+  //
+  
+  size_t option = block + 16;
+  size_t end = block + length - 4;
+  while (end - option >= 4) {
+    uint16_t code = spindump_capture_file_get16(file,option);
+    uint16_t optionLength = spindump_capture_file_get16(file,option + 2);
+    if (code == 0 || optionLength > end - option - 4) break;
+    if (code == spindump_capture_file_pcapng_tsresol && optionLength >= 1) {
+      uint8_t resolution = file->map[option + 4];
+      unsigned int exponent = resolution & 0x7f;
+      if ((resolution & 0x80) ? exponent > 63 : exponent > 19) {
+        spindump_warnf("unsupported timestamp resolution %u in the input file", resolution);
+        return(0);
+      }
+      uint64_t base = (resolution & 0x80) ? 2 : 10;
+      iface->unitsPerSecond = 1;
+      for (unsigned int i = 0; i < exponent; i++) iface->unitsPerSecond *= base;
+    } else if (code == spindump_capture_file_pcapng_tsoffset && optionLength >= 8) {
+      uint64_t offset;
+      memcpy(&offset,file->map + option + 4,sizeof(offset));
+      iface->offset = (int64_t)(file->swapped ? __builtin_bswap64(offset) : offset);
+    }
+    option += 4 + (((size_t)optionLength + 3) & ~(size_t)3);
+  }
+  
+  file->nInterfaces++;
+  return(1);
+}
+
+//
+// Convert a timestamp in units of 1/unitsPerSecond seconds to the
+// nanosecond timestamp of a packet.
+//
+
+static void
+spindump_capture_file_settimestamp(struct spindump_packet* packet,
+                                   uint64_t timestamp,
+                                   uint64_t unitsPerSecond,
+                                   int64_t offset) {
+  uint64_t seconds = timestamp / unitsPerSecond;
+  uint64_t fraction = timestamp % unitsPerSecond;
+  uint64_t nanoseconds;
+  if (unitsPerSecond <= spindump_time_nsecspersec && spindump_time_nsecspersec % unitsPerSecond == 0) {
+    nanoseconds = fraction * (spindump_time_nsecspersec / unitsPerSecond);
+  } else if (unitsPerSecond % spindump_time_nsecspersec == 0) {
+    nanoseconds = fraction / (unitsPerSecond / spindump_time_nsecspersec);
+  } else {
+    nanoseconds = (uint64_t)(((double)fraction * (double)spindump_time_nsecspersec) / (double)unitsPerSecond);
+  }
+  packet->timestamp = (spindump_time)((int64_t)seconds + offset) * spindump_time_nsecspersec + nanoseconds;
+}
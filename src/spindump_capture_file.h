@@ -0,0 +1,88 @@
+
+//
+//
+//  ////////////////////////////////////////////////////////////////////////////////////
+//  /////////                                                                ///////////
+//  //////       SSS    PPPP    I   N    N   DDDD    U   U   M   M   PPPP         //////
+//  //          S       P   P   I   NN   N   D   D   U   U   MM MM   P   P            //
+//  /            SSS    PPPP    I   N NN N   D   D   U   U   M M M   PPPP              /
+//  //              S   P       I   N   NN   D   D   U   U   M   M   P                //
+//  ////         SSS    P       I   N    N   DDDD     UUU    M   M   P            //////
+//  /////////                                                                ///////////
+//  ////////////////////////////////////////////////////////////////////////////////////
+//
+//  SPINDUMP (C) 2018-2020 BY ERICSSON RESEARCH
+//  AUTHOR: JARI ARKKO
+//
+
+#ifndef SPINDUMP_CAPTURE_FILE_H
+#define SPINDUMP_CAPTURE_FILE_H
+
+//
+// Includes -----------------------------------------------------------------------------------
+//
+
+#include <stdint.h>
+#include <stddef.h>
+#include "spindump_packet.h"
+
+//
+// Parameters ---------------------------------------------------------------------------------
+//
+
+#define spindump_capture_file_maxinterfaces 64
+#define spindump_capture_file_maxsnaplen    262144 // bytes, as in PCAP
+
+//
+// Data structures ----------------------------------------------------------------------------
+//
+
+//
+// The properties of one interface in a pcapng file
+//
+
+struct spindump_capture_file_interface {
+  unsigned int linktype;                       // LINKTYPE_ value from the file
+  unsigned int snaplen;                        // Snapshot length, 0 if unlimited
+  uint64_t unitsPerSecond;                     // Timestamp resolution
+  int64_t offset;                              // Seconds to add to timestamps
+};
+
+//
+// The state of a memory-mapped pcap or pcapng file. The packets are
+// not copied; the packet contents point directly into the mapping,
+// and stay valid until the file is closed.
+//
+
+struct spindump_capture_file {
+  const uint8_t* map;                          // The mapped file
+  size_t size;                                 // Size of the mapping, in bytes
+  size_t position;                             // Offset of the next record or block
+  int pcapng;                                  // Whether the file is in pcapng format
+  int swapped;                                 // Whether the byte order is not ours
+  unsigned int linktype;                       // DLT_ value for the whole file
+  unsigned int snaplen;                        // Snapshot length for the whole file
+  uint64_t unitsPerSecond;                     // Timestamp resolution of a pcap file
+  spindump_time previousTimestamp;             // Timestamp of the previous packet, for simple packet blocks
+  unsigned int nInterfaces;                    // Interfaces in the current pcapng section
+  struct spindump_capture_file_interface interfaces[spindump_capture_file_maxinterfaces];
+};
+
+//
+// External API interface to this module ------------------------------------------------------
+//
+
+struct spindump_capture_file*
+spindump_capture_file_initialize(const char* name);
+unsigned int
+spindump_capture_file_linktype(struct spindump_capture_file* file);
+unsigned int
+spindump_capture_file_snaplen(struct spindump_capture_file* file);
+unsigned int
+spindump_capture_file_nextbatch(struct spindump_capture_file* file,
+                                struct spindump_packet* packets,
+                                unsigned int maxPackets);
+void
+spindump_capture_file_uninitialize(struct spindump_capture_file* file);
+
+#endif // SPINDUMP_CAPTURE_FILE_H
@@ -0,0 +1,249 @@
+
+//
+//
+//  ////////////////////////////////////////////////////////////////////////////////////
+//  /////////                                                                ///////////
+//  //////       SSS    PPPP    I   N    N   DDDD    U   U   M   M   PPPP         //////
+//  //          S       P   P   I   NN   N   D   D   U   U   MM MM   P   P            //
+//  /            SSS    PPPP    I   N NN N   D   D   U   U   M M M   PPPP              /
+//  //              S   P       I   N   NN   D   D   U   U   M   M   P                //
+//  ////         SSS    P       I   N    N   DDDD     UUU    M   M   P            //////
+//  /////////                                                                ///////////
+//  ////////////////////////////////////////////////////////////////////////////////////
+//
+//  SPINDUMP (C) 2018-2020 BY ERICSSON RESEARCH
+//  AUTHOR: JARI ARKKO
+//
+
+//
+// Includes -----------------------------------------------------------------------------------
+//
+
+#include <string.h>
+#include "spindump_util.h"
+#include "spindump_capture_ring.h"
+
+//
+// Actual code --------------------------------------------------------------------------------
+//
+
+//
+// Create a ring with room for at least nSlots packets of at most
+// slotSize bytes each. Returns 0 upon failure.
+//
+
+struct spindump_capture_ring*
+spindump_capture_ring_initialize(unsigned int nSlots,
+                                 unsigned int slotSize) {
+
+  //
+  // Checks
+  //
+
+  spindump_assert(nSlots > 0);
+  spindump_assert(slotSize > 0);
+  if (nSlots > spindump_capture_ring_maxslots) {
+    spindump_errorf("capture ring of %u packets is too large, maximum is %u",
+                    nSlots, spindump_capture_ring_maxslots);
+    return(0);
+  }
+  
+  //
+  // Allocate
+  //
+
+  unsigned int size = sizeof(struct spindump_capture_ring);
+  struct spindump_capture_ring* ring = (struct spindump_capture_ring*)spindump_malloc(size);
+  if (ring == 0) {
+    spindump_errorf("cannot allocate capture ring of %u bytes", size);
+    return(0);
+  }
+  memset(ring,0,sizeof(*ring));
+  ring->notifier.readFd = ring->notifier.writeFd = -1;
+  ring->nSlots = 1;
+  while (ring->nSlots < nSlots) ring->nSlots *= 2;
+  ring->slotSize = slotSize;
+  
+  unsigned long long packetsSize = ring->nSlots * (unsigned long long)sizeof(struct spindump_packet);
+  unsigned long long bufferSize = ring->nSlots * (unsigned long long)slotSize;
+  if (bufferSize > 0xffffffffU) {
+    spindump_errorf("capture ring of %u packets of %u bytes is too large", ring->nSlots, slotSize);
+    spindump_free(ring);
+    return(0);
+  }
+  ring->packets = (struct spindump_packet*)spindump_malloc((unsigned int)packetsSize);
+  ring->buffer = (unsigned char*)spindump_malloc((unsigned int)bufferSize);
+  if (ring->packets == 0 || ring->buffer == 0) {
+    spindump_errorf("cannot allocate capture ring of %llu bytes", packetsSize + bufferSize);
+    spindump_capture_ring_uninitialize(ring);
+    return(0);
+  }
+  if (!spindump_poll_notifier_initialize(&ring->notifier)) {
+    spindump_capture_ring_uninitialize(ring);
+    return(0);
+  }
+  
+  //
+  // Done
+  //
+  
+  spindump_debugf("capture ring of %u packets of %u bytes", ring->nSlots, slotSize);
+  return(ring);
+}
+
+//
+// Add a copy of a packet to the ring. Called by the producer. Returns
+// 1 upon success, and 0 if the ring was full and the packet was
+// dropped.
+//
+
+int
+spindump_capture_ring_put(struct spindump_capture_ring* ring,
+                          const struct spindump_packet* packet) {
+
+  //
+  // Check for space
+  //
+  
+  unsigned int head = ring->head;
+  unsigned int tail = __atomic_load_n(&ring->tail,__ATOMIC_ACQUIRE);
+  unsigned int inUse = head - tail;
+  if (inUse >= ring->nSlots) {
+    __atomic_fetch_add(&ring->overflows,1,__ATOMIC_RELAXED);
+    return(0);
+  }
+
+  //
+  // Copy the packet
+  //
+  
+  unsigned int slot = head & (ring->nSlots - 1);
+  struct spindump_packet* copy = &ring->packets[slot];
+  unsigned char* contents = ring->buffer + (size_t)slot * ring->slotSize;
+  *copy = *packet;
+  if (copy->caplen > ring->slotSize) copy->caplen = ring->slotSize;
+  memcpy(contents,packet->contents,copy->caplen);
+  copy->contents = contents;
+
+  //
+  // Publish it. The counters are only written here, but are read
+  // by other threads for statistics.
+  //
+  
+  __atomic_store_n(&ring->head,head + 1,__ATOMIC_RELEASE);
+  if (inUse + 1 > __atomic_load_n(&ring->highWater,__ATOMIC_RELAXED)) {
+    __atomic_store_n(&ring->highWater,inUse + 1,__ATOMIC_RELAXED);
+  }
+  return(1);
+}
+
+//
+// Publish the drop counts of the capture, which only the producer
+// can read from the capture. Called by the producer.
+//
+
+void
+spindump_capture_ring_setdrops(struct spindump_capture_ring* ring,
+                               spindump_counter_64bit kernelDrops,
+                               spindump_counter_32bit interfaceDrops) {
+  __atomic_store_n(&ring->kernelDrops,kernelDrops,__ATOMIC_RELAXED);
+  __atomic_store_n(&ring->interfaceDrops,interfaceDrops,__ATOMIC_RELAXED);
+}
+
+//
+// Mark that the producer will not add any more packets
+//
+
+void
+spindump_capture_ring_finish(struct spindump_capture_ring* ring) {
+  __atomic_store_n(&ring->finished,1,__ATOMIC_RELEASE);
+  spindump_capture_ring_wakeup(ring);
+}
+
+//
+// Signal the notifier, if the consumer is waiting on it. Called by
+// the producer after it has added packets.
+//
+
+void
+spindump_capture_ring_wakeup(struct spindump_capture_ring* ring) {
+  __atomic_thread_fence(__ATOMIC_SEQ_CST);
+  if (__atomic_load_n(&ring->waiting,__ATOMIC_RELAXED) &&
+      __atomic_exchange_n(&ring->waiting,0,__ATOMIC_ACQ_REL)) {
+    spindump_poll_notifier_signal(&ring->notifier);
+  }
+}
+
+//
+// Take up to maxPackets packets from the ring. Called by the
+// consumer. The packets taken in the previous call are given back to
+// the producer. The returned packets are consecutive in
+// *p_packets. *p_finished is set if the ring is empty and the
+// producer has finished. Returns the number of packets taken.
+//
+
+unsigned int
+spindump_capture_ring_get(struct spindump_capture_ring* ring,
+                          unsigned int maxPackets,
+                          struct spindump_packet** p_packets,
+                          int* p_finished) {
+
+  //
+  // Give back the previous packets
+  //
+  
+  unsigned int tail = ring->tail + ring->nTaken;
+  __atomic_store_n(&ring->tail,tail,__ATOMIC_RELEASE);
+  ring->nTaken = 0;
+
+  //
+  // See what is available, up to the end of the ring
+  //
+
+  int finished = __atomic_load_n(&ring->finished,__ATOMIC_ACQUIRE);
+  unsigned int head = __atomic_load_n(&ring->head,__ATOMIC_ACQUIRE);
+  unsigned int available = head - tail;
+  unsigned int slot = tail & (ring->nSlots - 1);
+  if (available > ring->nSlots - slot) available = ring->nSlots - slot;
+  if (available > maxPackets) available = maxPackets;
+  
+  ring->nTaken = available;
+  *p_packets = &ring->packets[slot];
+  *p_finished = (available == 0 && finished);
+  return(available);
+}
+
+//
+// Called by the consumer when spindump_capture_ring_get found the
+// ring empty, before waiting on the notifier. Asks the producer to
+// signal the notifier upon the next packets, and then checks the ring
+// again, in case packets were added in between. Returns the number of
+// packets taken, as spindump_capture_ring_get. The notifier should
+// only be waited on if no packets were taken.
+//
+
+unsigned int
+spindump_capture_ring_preparewait(struct spindump_capture_ring* ring,
+                                  unsigned int maxPackets,
+                                  struct spindump_packet** p_packets,
+                                  int* p_finished) {
+  spindump_poll_notifier_clear(&ring->notifier);
+  __atomic_store_n(&ring->waiting,1,__ATOMIC_RELAXED);
+  __atomic_thread_fence(__ATOMIC_SEQ_CST);
+  unsigned int n = spindump_capture_ring_get(ring,maxPackets,p_packets,p_finished);
+  if (n > 0 || *p_finished) __atomic_store_n(&ring->waiting,0,__ATOMIC_RELAXED);
+  return(n);
+}
+
+//
+// Free the ring
+//
+
+void
+spindump_capture_ring_uninitialize(struct spindump_capture_ring* ring) {
+  spindump_assert(ring != 0);
+  if (ring->packets != 0) spindump_free(ring->packets);
+  if (ring->buffer != 0) spindump_free(ring->buffer);
+  if (ring->notifier.readFd >= 0) spindump_poll_notifier_uninitialize(&ring->notifier);
+  spindump_free(ring);
+}
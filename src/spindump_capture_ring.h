@@ -0,0 +1,105 @@
+
+//
+//
+//  ////////////////////////////////////////////////////////////////////////////////////
+//  /////////                                                                ///////////
+//  //////       SSS    PPPP    I   N    N   DDDD    U   U   M   M   PPPP         //////
+//  //          S       P   P   I   NN   N   D   D   U   U   MM MM   P   P            //
+//  /            SSS    PPPP    I   N NN N   D   D   U   U   M M M   PPPP              /
+//  //              S   P       I   N   NN   D   D   U   U   M   M   P                //
+//  ////         SSS    P       I   N    N   DDDD     UUU    M   M   P            //////
+//  /////////                                                                ///////////
+//  ////////////////////////////////////////////////////////////////////////////////////
+//
+//  SPINDUMP (C) 2018-2020 BY ERICSSON RESEARCH
+//  AUTHOR: JARI ARKKO
+//
+
+#ifndef SPINDUMP_CAPTURE_RING_H
+#define SPINDUMP_CAPTURE_RING_H
+
+//
+// Includes -----------------------------------------------------------------------------------
+//
+
+#include <stdint.h>
+#include "spindump_util.h"
+#include "spindump_packet.h"
+#include "spindump_poll.h"
+
+//
+// Parameters ---------------------------------------------------------------------------------
+//
+
+#define spindump_capture_ring_maxslots  (1024*1024)
+#define spindump_capture_ring_cacheline 64
+
+//
+// Data structures ----------------------------------------------------------------------------
+//
+
+//
+// A lock-free ring of packets between one producer thread, which
+// captures packets, and one consumer thread, which analyzes them.
+// The producer only writes head, and the consumer only writes tail;
+// they are on different cache lines. Each slot has room for a copy of
+// the packet contents.
+//
+// The consumer takes a run of packets at a time, and analyzes them
+// directly from their slots. The slots are given back to the producer
+// upon the next call. When the ring is empty, the consumer may wait
+// on the notifier, which the producer then signals upon the next
+// packets.
+//
+
+struct spindump_capture_ring {
+  unsigned int nSlots;                          // a power of two
+  unsigned int slotSize;                        // bytes of packet contents per slot
+  struct spindump_packet* packets;
+  unsigned char* buffer;
+  uint8_t padding1[spindump_capture_ring_cacheline];
+  unsigned int head;                            // next slot to fill, written by the producer
+  unsigned int highWater;                       // most slots ever in use
+  spindump_counter_32bit overflows;             // packets dropped because the ring was full
+  spindump_counter_32bit interfaceDrops;        // latest drop counts of the capture, sampled by the producer
+  spindump_counter_64bit kernelDrops;
+  int finished;                                 // the producer will add no more packets
+  uint8_t padding2[spindump_capture_ring_cacheline];
+  unsigned int tail;                            // next slot to take, written by the consumer
+  unsigned int nTaken;                          // slots taken in the latest spindump_capture_ring_get
+  int waiting;                                  // the consumer waits on the notifier
+  struct spindump_poll_notifier notifier;       // signaled by the producer when the consumer is waiting
+};
+
+//
+// External API interface to this module ------------------------------------------------------
+//
+
+struct spindump_capture_ring*
+spindump_capture_ring_initialize(unsigned int nSlots,
+                                 unsigned int slotSize);
+int
+spindump_capture_ring_put(struct spindump_capture_ring* ring,
+                          const struct spindump_packet* packet);
+void
+spindump_capture_ring_setdrops(struct spindump_capture_ring* ring,
+                               spindump_counter_64bit kernelDrops,
+                               spindump_counter_32bit interfaceDrops);
+void
+spindump_capture_ring_finish(struct spindump_capture_ring* ring);
+void
+spindump_capture_ring_wakeup(struct spindump_capture_ring* ring);
+unsigned int
+spindump_capture_ring_get(struct spindump_capture_ring* ring,
+                          unsigned int maxPackets,
+                          struct spindump_packet** p_packets,
+                          int* p_finished);
+unsigned int
+spindump_capture_ring_preparewait(struct spindump_capture_ring* ring,
+                                  unsigned int maxPackets,
+                                  struct spindump_packet** p_packets,
+                                  int* p_finished);
+void
+spindump_capture_ring_uninitialize(struct spindump_capture_ring* ring);
+
+#endif // SPINDUMP_CAPTURE_RING_H
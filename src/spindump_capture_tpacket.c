@@ -0,0 +1,462 @@
+
+//
+//
+//  ////////////////////////////////////////////////////////////////////////////////////
+//  /////////                                                                ///////////
+//  //////       SSS    PPPP    I   N    N   DDDD    U   U   M   M   PPPP         //////
+//  //          S       P   P   I   NN   N   D   D   U   U   MM MM   P   P            //
+//  /            SSS    PPPP    I   N NN N   D   D   U   U   M M M   PPPP              /
+//  //              S   P       I   N   NN   D   D   U   U   M   M   P                //
+//  ////         SSS    P       I   N    N   DDDD     UUU    M   M   P            //////
+//  /////////                                                                ///////////
+//  ////////////////////////////////////////////////////////////////////////////////////
+//
+//  SPINDUMP (C) 2018-2020 BY ERICSSON RESEARCH
+//  AUTHOR: JARI ARKKO
+//
+
+//
+// Includes -----------------------------------------------------------------------------------
+//
+
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <pcap.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#ifdef __linux__
+#include <poll.h>
+#include <net/if.h>
+#include <net/if_arp.h>
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+#include <arpa/inet.h>
+#include <linux/if_ether.h>
+#include <linux/if_packet.h>
+#include <linux/filter.h>
+#endif
+#include "spindump_util.h"
+#include "spindump_capture_tpacket.h"
+
+//
+// Actual code --------------------------------------------------------------------------------
+//
+
+//
+// Return 1 if the TPACKET_V3 capture backend is available on this
+// platform, 0 otherwise.
+//
+
+int
+spindump_capture_tpacket_supported(void) {
+#ifdef __linux__
+  return(1);
+#else
+  return(0);
+#endif
+}
+
+#ifdef __linux__
+
+//
+// Return the block descriptor of the given block in the ring
+//
+
+static struct tpacket_block_desc*
+spindump_capture_tpacket_block(struct spindump_capture_tpacket* tpacket,
+                               unsigned int block) {
+  spindump_assert(block < tpacket->nBlocks);
+  return((struct tpacket_block_desc*)(void*)(tpacket->ring + (size_t)block * tpacket->blockSize));
+}
+
+#endif
+
+//
+// Open a packet socket on the given interface, and map a TPACKET_V3
+// receive ring for it. Only interfaces that provide Ethernet headers
+// are supported. Returns 0 upon failure.
+//
+// The socket receives no packets until spindump_capture_tpacket_bind
+// is called, so that a filter can be attached first.
+//
+
+struct spindump_capture_tpacket*
+spindump_capture_tpacket_initialize(const char* interface,
+                                    unsigned int snaplen) {
+
+  //
+  // Checks
+  //
+
+  spindump_assert(interface != 0);
+
+#ifdef __linux__
+
+  //
+  // Allocate
+  //
+
+  unsigned int size = sizeof(struct spindump_capture_tpacket);
+  struct spindump_capture_tpacket* tpacket = (struct spindump_capture_tpacket*)spindump_malloc(size);
+  if (tpacket == 0) {
+    spindump_errorf("cannot allocate TPACKET_V3 capture state for %u bytes", size);
+    return(0);
+  }
+  memset(tpacket,0,sizeof(*tpacket));
+  tpacket->snaplen = snaplen;
+  tpacket->blockSize = spindump_capture_tpacket_blocksize;
+  tpacket->nBlocks = spindump_capture_tpacket_nblocks;
+  tpacket->ringSize = (size_t)tpacket->blockSize * tpacket->nBlocks;
+
+  //
+  // Find the interface. Only a specific interface can be listened
+  // to, and it has to provide Ethernet headers.
+  //
+
+  if (strcmp(interface,"any") == 0) {
+    spindump_errorf("the TPACKET_V3 capture backend cannot listen on all interfaces, use --capture-backend pcap");
+    spindump_free(tpacket);
+    return(0);
+  }
+
+  tpacket->fd = socket(AF_PACKET, SOCK_RAW, 0);
+  if (tpacket->fd < 0) {
+    spindump_errorf("cannot open a packet socket: %s", strerror(errno));
+    spindump_free(tpacket);
+    return(0);
+  }
+
+  struct ifreq ifr;
+  memset(&ifr,0,sizeof(ifr));
+  if (strlen(interface) >= sizeof(ifr.ifr_name)) {
+    spindump_errorf("interface name %s is too long", interface);
+    spindump_capture_tpacket_uninitialize(tpacket);
+    return(0);
+  }
+  strncpy(ifr.ifr_name,interface,sizeof(ifr.ifr_name)-1);
+  if (ioctl(tpacket->fd,SIOCGIFHWADDR,&ifr) < 0) {
+    spindump_errorf("couldn't find device %s: %s", interface, strerror(errno));
+    spindump_capture_tpacket_uninitialize(tpacket);
+    return(0);
+  }
+  if (ifr.ifr_hwaddr.sa_family != ARPHRD_ETHER &&
+      ifr.ifr_hwaddr.sa_family != ARPHRD_LOOPBACK) {
+    spindump_errorf("device %s doesn't provide Ethernet headers - type %u not supported by the TPACKET_V3 capture backend",
+                    interface, ifr.ifr_hwaddr.sa_family);
+    spindump_capture_tpacket_uninitialize(tpacket);
+    return(0);
+  }
+  unsigned int ifindex = if_nametoindex(interface);
+  if (ifindex == 0) {
+    spindump_errorf("couldn't find device %s: %s", interface, strerror(errno));
+    spindump_capture_tpacket_uninitialize(tpacket);
+    return(0);
+  }
+  tpacket->ifindex = ifindex;
+
+  //
+  // Set up the ring
+  //
+
+  int version = TPACKET_V3;
+  if (setsockopt(tpacket->fd,SOL_PACKET,PACKET_VERSION,&version,sizeof(version)) < 0) {
+    spindump_errorf("cannot set TPACKET_V3 on the packet socket: %s", strerror(errno));
+    spindump_capture_tpacket_uninitialize(tpacket);
+    return(0);
+  }
+
+  struct tpacket_req3 req;
+  memset(&req,0,sizeof(req));
+  req.tp_block_size = tpacket->blockSize;
+  req.tp_block_nr = tpacket->nBlocks;
+  req.tp_frame_size = spindump_capture_tpacket_framesize;
+  req.tp_frame_nr = (tpacket->blockSize / spindump_capture_tpacket_framesize) * tpacket->nBlocks;
+  req.tp_retire_blk_tov = spindump_capture_tpacket_blocktimeout;
+  if (setsockopt(tpacket->fd,SOL_PACKET,PACKET_RX_RING,&req,sizeof(req)) < 0) {
+    spindump_errorf("cannot set up a TPACKET_V3 receive ring: %s", strerror(errno));
+    spindump_capture_tpacket_uninitialize(tpacket);
+    return(0);
+  }
+
+  void* ring = mmap(0,tpacket->ringSize,PROT_READ | PROT_WRITE,MAP_SHARED,tpacket->fd,0);
+  if (ring == MAP_FAILED) {
+    spindump_errorf("cannot map the TPACKET_V3 receive ring of %lu bytes: %s",
+                    (unsigned long)tpacket->ringSize, strerror(errno));
+    spindump_capture_tpacket_uninitialize(tpacket);
+    return(0);
+  }
+  tpacket->ring = (uint8_t*)ring;
+
+  spindump_debugf("TPACKET_V3 ring of %u blocks of %u bytes mapped on %s",
+                  tpacket->nBlocks, tpacket->blockSize, interface);
+
+  //
+  // Done
+  //
+
+  return(tpacket);
+
+#else
+
+  (void)snaplen;
+  spindump_errorf("the TPACKET_V3 capture backend is not supported on this platform, use --capture-backend pcap");
+  return(0);
+
+#endif
+
+}
+
+//
+// Install a compiled BPF filter on the packet socket. The program
+// has to have been compiled for Ethernet headers. Returns 1 upon
+// success, 0 upon failure.
+//
+
+int
+spindump_capture_tpacket_setfilter(struct spindump_capture_tpacket* tpacket,
+                                   struct bpf_program* program) {
+
+  //
+  // Checks
+  //
+
+  spindump_assert(tpacket != 0);
+  spindump_assert(program != 0);
+
+#ifdef __linux__
+
+  //
+  // An empty program accepts everything, no need to install it
+  //
+
+  if (program->bf_len == 0) return(1);
+
+  //
+  // Install the program. The kernel and PCAP instruction formats
+  // are the same.
+  //
+
+  struct sock_fprog fprog;
+  memset(&fprog,0,sizeof(fprog));
+  fprog.len = (unsigned short)program->bf_len;
+  fprog.filter = (struct sock_filter*)(void*)program->bf_insns;
+  if (setsockopt(tpacket->fd,SOL_SOCKET,SO_ATTACH_FILTER,&fprog,sizeof(fprog)) < 0) {
+    spindump_errorf("cannot attach a filter to the packet socket: %s", strerror(errno));
+    return(0);
+  }
+
+  return(1);
+
+#else
+
+  return(0);
+
+#endif
+
+}
+
+//
+// Bind the packet socket to its interface, for all protocols. Only
+// from this point on does the kernel put packets in the ring, so any
+// filter needs to have been attached before calling this. Returns 1
+// upon success, 0 upon failure.
+//
+
+int
+spindump_capture_tpacket_bind(struct spindump_capture_tpacket* tpacket) {
+
+  //
+  // Checks
+  //
+
+  spindump_assert(tpacket != 0);
+
+#ifdef __linux__
+
+  struct sockaddr_ll ll;
+  memset(&ll,0,sizeof(ll));
+  ll.sll_family = AF_PACKET;
+  ll.sll_protocol = htons(ETH_P_ALL);
+  ll.sll_ifindex = (int)tpacket->ifindex;
+  if (bind(tpacket->fd,(struct sockaddr*)&ll,sizeof(ll)) < 0) {
+    spindump_errorf("cannot bind the packet socket to interface %u: %s", tpacket->ifindex, strerror(errno));
+    return(0);
+  }
+
+  return(1);
+
+#else
+
+  return(0);
+
+#endif
+
+}
+
+//
+// Get up to maxPackets next packets from the ring, all from the same
+// block. The packet contents point to the ring, and stay valid until
+// the next call. If no packets are available, wait at most waitms
+// milliseconds for the kernel to hand over a block. Returns the
+// number of packets stored in packets[], or -1 upon error.
+//
+
+int
+spindump_capture_tpacket_nextbatch(struct spindump_capture_tpacket* tpacket,
+                                   struct spindump_packet* packets,
+                                   unsigned int maxPackets,
+                                   int waitms) {
+
+  //
+  // Checks
+  //
+
+  spindump_assert(tpacket != 0);
+  spindump_assert(packets != 0);
+  spindump_assert(maxPackets > 0);
+
+#ifdef __linux__
+
+  if (tpacket->remainingInBlock == 0) {
+
+    //
+    // All packets from the current block have been analyzed, hand
+    // the block back to the kernel and move on to the next one.
+    //
+
+    struct tpacket_block_desc* desc = spindump_capture_tpacket_block(tpacket,tpacket->currentBlock);
+    if (tpacket->blockOpen) {
+      __sync_synchronize();
+      desc->hdr.bh1.block_status = TP_STATUS_KERNEL;
+      tpacket->blockOpen = 0;
+      tpacket->currentBlock = (tpacket->currentBlock + 1) % tpacket->nBlocks;
+      desc = spindump_capture_tpacket_block(tpacket,tpacket->currentBlock);
+    }
+
+    //
+    // Only if the kernel has not yet filled the block do we need a
+    // system call, to wait for it.
+    //
+
+    if ((desc->hdr.bh1.block_status & TP_STATUS_USER) == 0) {
+      struct pollfd pfd;
+      memset(&pfd,0,sizeof(pfd));
+      pfd.fd = tpacket->fd;
+      pfd.events = POLLIN | POLLERR;
+      if (poll(&pfd,1,waitms) < 0 && errno != EINTR) {
+        spindump_errorf("cannot poll the packet socket: %s", strerror(errno));
+        return(-1);
+      }
+      if ((desc->hdr.bh1.block_status & TP_STATUS_USER) == 0) return(0);
+    }
+
+    __sync_synchronize();
+    tpacket->blockOpen = 1;
+    tpacket->remainingInBlock = desc->hdr.bh1.num_pkts;
+    tpacket->nextFrame = ((const uint8_t*)desc) + desc->hdr.bh1.offset_to_first_pkt;
+    spindump_deepdeepdebugf("TPACKET_V3 block %u with %u packets",
+                            tpacket->currentBlock, tpacket->remainingInBlock);
+
+  }
+
+  //
+  // Take the next packets from the block
+  //
+
+  unsigned int n = 0;
+  while (n < maxPackets && tpacket->remainingInBlock > 0) {
+    const struct tpacket3_hdr* hdr = (const struct tpacket3_hdr*)(const void*)tpacket->nextFrame;
+    struct spindump_packet* packet = &packets[n++];
+    memset(packet,0,sizeof(*packet));
+    packet->timestamp = ((spindump_time)hdr->tp_sec) * spindump_time_nsecspersec + hdr->tp_nsec;
+    packet->etherlen = hdr->tp_len;
+    packet->caplen = hdr->tp_snaplen < tpacket->snaplen ? hdr->tp_snaplen : tpacket->snaplen;
+    packet->contents = tpacket->nextFrame + hdr->tp_mac;
+    tpacket->nextFrame += hdr->tp_next_offset;
+    tpacket->remainingInBlock--;
+  }
+  
+  return((int)n);
+
+#else
+
+  (void)waitms;
+  return(-1);
+
+#endif
+
+}
+
+//
+// Get the number of packets dropped by the kernel since the ring was
+// created. The kernel resets its counters whenever they are
+// read, so they are accumulated here. Returns 1 upon success, 0 upon
+// failure.
+//
+
+int
+spindump_capture_tpacket_getdrops(struct spindump_capture_tpacket* tpacket,
+                                  unsigned long long* p_drops) {
+
+  //
+  // Checks
+  //
+
+  spindump_assert(tpacket != 0);
+  spindump_assert(p_drops != 0);
+
+#ifdef __linux__
+
+  //
+  // Read and accumulate the counter
+  //
+  
+  struct tpacket_stats_v3 kstats;
+  socklen_t size = sizeof(kstats);
+  memset(&kstats,0,sizeof(kstats));
+  if (getsockopt(tpacket->fd,SOL_PACKET,PACKET_STATISTICS,&kstats,&size) < 0) {
+    spindump_errorf("cannot get packet socket statistics: %s", strerror(errno));
+    return(0);
+  }
+  tpacket->drops += kstats.tp_drops;
+  *p_drops = tpacket->drops;
+  return(1);
+
+#else
+
+  *p_drops = 0;
+  return(0);
+
+#endif
+
+}
+
+//
+// Unmap the ring, close the socket, and free the state
+//
+
+void
+spindump_capture_tpacket_uninitialize(struct spindump_capture_tpacket* tpacket) {
+
+  //
+  // Checks
+  //
+
+  spindump_assert(tpacket != 0);
+
+  //
+  // Close and cleanup
+  //
+
+#ifdef __linux__
+  if (tpacket->ring != 0) {
+    munmap(tpacket->ring,tpacket->ringSize);
+  }
+  if (tpacket->fd >= 0) {
+    close(tpacket->fd);
+  }
+#endif
+  memset(tpacket,0,sizeof(*tpacket));
+  spindump_free(tpacket);
+}
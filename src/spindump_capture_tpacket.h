@@ -0,0 +1,91 @@
+
+//
+//
+//  ////////////////////////////////////////////////////////////////////////////////////
+//  /////////                                                                ///////////
+//  //////       SSS    PPPP    I   N    N   DDDD    U   U   M   M   PPPP         //////
+//  //          S       P   P   I   NN   N   D   D   U   U   MM MM   P   P            //
+//  /            SSS    PPPP    I   N NN N   D   D   U   U   M M M   PPPP              /
+//  //              S   P       I   N   NN   D   D   U   U   M   M   P                //
+//  ////         SSS    P       I   N    N   DDDD     UUU    M   M   P            //////
+//  /////////                                                                ///////////
+//  ////////////////////////////////////////////////////////////////////////////////////
+//
+//  SPINDUMP (C) 2018-2020 BY ERICSSON RESEARCH
+//  AUTHOR: JARI ARKKO
+//
+
+#ifndef SPINDUMP_CAPTURE_TPACKET_H
+#define SPINDUMP_CAPTURE_TPACKET_H
+
+//
+// Includes -----------------------------------------------------------------------------------
+//
+
+#include <stdint.h>
+#include <pcap.h>
+#include "spindump_packet.h"
+
+//
+// Parameters ---------------------------------------------------------------------------------
+//
+
+#define spindump_capture_tpacket_blocksize     (1024*1024) // bytes, multiple of page size
+#define spindump_capture_tpacket_nblocks       64
+#define spindump_capture_tpacket_framesize     2048        // bytes, nominal
+#define spindump_capture_tpacket_blocktimeout  1           // ms
+
+//
+// Data structures ----------------------------------------------------------------------------
+//
+
+//
+// The state of a TPACKET_V3 memory-mapped receive ring. The kernel
+// fills blocks of packets in the ring, and hands each block over to
+// us by setting its status. We walk through the packets of a block
+// without any system calls, and hand the block back to the kernel
+// only when moving on to the next block, i.e., after the last packet
+// from the block has been analyzed.
+//
+
+struct spindump_capture_tpacket {
+  int fd;                                      // The packet socket
+  unsigned int ifindex;                        // The interface the socket is bound to
+  unsigned int snaplen;                        // How much of each packet to report
+  uint8_t* ring;                               // The mapped ring of blocks
+  size_t ringSize;                             // Size of the mapping, in bytes
+  unsigned int blockSize;                      // Size of one block, in bytes
+  unsigned int nBlocks;                        // Number of blocks in the ring
+  unsigned int currentBlock;                   // The block we are reading or waiting for
+  int blockOpen;                               // Whether currentBlock is owned by us
+  unsigned int remainingInBlock;               // Packets not yet read from currentBlock
+  const uint8_t* nextFrame;                    // The next packet to read from currentBlock
+  unsigned long long drops;                    // Packets the kernel dropped for lack of ring space, so far
+};
+
+//
+// External API interface to this module ------------------------------------------------------
+//
+
+int
+spindump_capture_tpacket_supported(void);
+struct spindump_capture_tpacket*
+spindump_capture_tpacket_initialize(const char* interface,
+                                    unsigned int snaplen);
+int
+spindump_capture_tpacket_setfilter(struct spindump_capture_tpacket* tpacket,
+                                   struct bpf_program* program);
+int
+spindump_capture_tpacket_bind(struct spindump_capture_tpacket* tpacket);
+int
+spindump_capture_tpacket_nextbatch(struct spindump_capture_tpacket* tpacket,
+                                   struct spindump_packet* packets,
+                                   unsigned int maxPackets,
+                                   int waitms);
+int
+spindump_capture_tpacket_getdrops(struct spindump_capture_tpacket* tpacket,
+                                  unsigned long long* p_drops);
+void
+spindump_capture_tpacket_uninitialize(struct spindump_capture_tpacket* tpacket);
+
+#endif // SPINDUMP_CAPTURE_TPACKET_H
@@ -32,6 +32,7 @@
 #include "spindump_connections_set_iterator.h"
 #include "spindump_table.h"
 #include "spindump_stats.h"
+#include "spindump_pool.h"
 #include "spindump_analyze_quic_parser.h"
 #include "spindump_analyze.h"
 #include "spindump_spin.h"
@@ -61,9 +62,8 @@ spindump_connections_setisestablishing(const struct spindump_connection_set* set
 
 unsigned long long
 spindump_connections_lastaction(struct spindump_connection* connection,
-                                const struct timeval* now) {
-  spindump_assert(now->tv_sec > 0);
-  spindump_assert(now->tv_usec < 1000 * 1000);
+                                const spindump_time* now) {
+  spindump_assert(*now > 0);
   unsigned long long diff;
   if (spindump_iszerotime(&connection->latestPacketFromSide1)) {
     return(0);
@@ -334,6 +334,46 @@ spindump_connections_getports(struct spindump_connection* connection,
   }
 }
 
+//
+// Return an RTT tracker of a connection for reading, e.g.,
+// spindump_connections_rtt(connection->leftRTT). Connections get
+// their RTT trackers only upon the first measurement, and until then
+// an empty tracker with no measurements is returned.
+//
+
+struct spindump_rtt*
+spindump_connections_rtt(struct spindump_rtt* rtt) {
+  static _Thread_local int emptyInitialized = 0;
+  static _Thread_local struct spindump_rtt empty;
+  if (rtt != 0) return(rtt);
+  if (!emptyInitialized) {
+    spindump_rtt_initialize(&empty);
+    emptyInitialized = 1;
+  }
+  return(&empty);
+}
+
+//
+// Return an RTT tracker of a connection for a new measurement,
+// allocating it if this is the first measurement of its kind. Returns
+// 0 if memory could not be allocated.
+//
+
+struct spindump_rtt*
+spindump_connections_newrtt(struct spindump_rtt** p_rtt) {
+  spindump_assert(p_rtt != 0);
+  if (*p_rtt != 0) return(*p_rtt);
+  struct spindump_rtt* rtt = (struct spindump_rtt*)spindump_pool_allocate(sizeof(*rtt));
+  if (rtt == 0) {
+    spindump_errorf("cannot allocate memory for an RTT tracker of size %lu", (unsigned long)sizeof(*rtt));
+    return(0);
+  }
+  memset(rtt,0,sizeof(*rtt));
+  spindump_rtt_initialize(rtt);
+  *p_rtt = rtt;
+  return(rtt);
+}
+
 //
 // Report a new RTT measurement. This could have been determined in
 // many ways, by way of the initial packet exchange, looking at QUIC
@@ -354,8 +394,8 @@ spindump_connections_newrttmeasurement(struct spindump_analyze* state,
                                        unsigned int ipPacketLength,
                                        const int right,
                                        const int unidirectional,
-                                       const struct timeval* sent,
-                                       const struct timeval* rcvd,
+                                       const spindump_time* sent,
+                                       const spindump_time* rcvd,
                                        const char* why) {
 
   //
@@ -370,15 +410,34 @@ spindump_connections_newrttmeasurement(struct spindump_analyze* state,
   spindump_assert(rcvd != 0);
   spindump_assert(why != 0);
 
+  //
+  // If aggregates are updated elsewhere, only pass the measurement on
+  //
+
+  if (state->table->aggregateUpdateHandler != 0 && spindump_connections_isaggregate(connection)) {
+    struct spindump_connectionstable_aggregateupdate update;
+    memset(&update,0,sizeof(update));
+    update.type = spindump_connectionstable_aggregateupdate_rtt;
+    update.aggregate = connection;
+    update.ipPacketLength = ipPacketLength;
+    update.right = right;
+    update.unidirectional = unidirectional;
+    update.sent = *sent;
+    update.rcvd = *rcvd;
+    update.why = why;
+    (*state->table->aggregateUpdateHandler)(&update,state->table->aggregateUpdateHandlerData);
+    return(0);
+  }
+
   //
   // Calculate the RTT
   //
 
   spindump_deepdebugf("spindump_connections_newrttmeasurement due to %s", why);
-  spindump_deepdebugf("matching packet sent at %lu:%lu, response received %lu:%lu",
-                      sent->tv_sec, sent->tv_usec,
-                      rcvd->tv_sec, rcvd->tv_usec);
-  unsigned long long diff = spindump_timediffinusecs(rcvd,sent);
+  spindump_deepdebugf("matching packet sent at %llu, response received %llu",
+                      *sent, *rcvd);
+  unsigned long long diffNsec = spindump_timediffinnsecs(rcvd,sent);
+  unsigned long long diff = diffNsec / spindump_time_nsecsperusec;
   unsigned long ret;
 
   //
@@ -397,27 +456,19 @@ spindump_connections_newrttmeasurement(struct spindump_analyze* state,
   //
   
   spindump_deepdeepdebugf("newrtt point 2 (uni %u right %u)", unidirectional, right);
+  struct spindump_rtt* rtt;
   if (unidirectional) {
-    if (right) {
-      ret = spindump_rtt_newmeasurement(&connection->respToInitFullRTT,diff);
-      spindump_debugf("due to %s new calculated full RTT from responder = %lu us for connection %u",
-                      why, connection->respToInitFullRTT.lastRTT, connection->id);
-    } else {
-      ret = spindump_rtt_newmeasurement(&connection->initToRespFullRTT,diff);
-      spindump_debugf("due to %s new calculated full RTT from initiator = %lu us for connection %u",
-                      why, connection->initToRespFullRTT.lastRTT, connection->id);
-    }
+    rtt = spindump_connections_newrtt(right ? &connection->respToInitFullRTT : &connection->initToRespFullRTT);
   } else {
-    if (right) {
-      ret = spindump_rtt_newmeasurement(&connection->rightRTT,diff);
-      spindump_debugf("due to %s new calculated right RTT = %lu us for connection %u",
-                      why, connection->rightRTT.lastRTT, connection->id);
-    } else {
-      ret = spindump_rtt_newmeasurement(&connection->leftRTT,diff);
-      spindump_debugf("due to %s new calculated left RTT = %lu us for connection %u",
-                      why, connection->leftRTT.lastRTT, connection->id);
-    }
+    rtt = spindump_connections_newrtt(right ? &connection->rightRTT : &connection->leftRTT);
   }
+  if (rtt == 0) return(0);
+  ret = spindump_rtt_newmeasurement(rtt,diffNsec);
+  spindump_debugf("due to %s new calculated %s = %lu us for connection %u",
+                  why,
+                  (unidirectional ? (right ? "full RTT from responder" : "full RTT from initiator") :
+                   (right ? "right RTT" : "left RTT")),
+                  rtt->lastRTT, connection->id);
   
   //
   // Call some handlers, if any, for the new measurements
@@ -474,6 +525,132 @@ spindump_connections_newrttmeasurement(struct spindump_analyze* state,
   return(ret);
 }
 
+//
+// Add the bins of an RTT histogram, e.g., one reported by another
+// instance of Spindump, to an RTT histogram of a connection. The bins
+// are given in the sparse form of periodic events: nBins bin indexes
+// in a histogram of the given precision, and the number of
+// measurements in each.
+//
+// The same bins are added to any aggregate connection this
+// connection belongs to.
+//
+
+void
+spindump_connections_newrtthistogram(struct spindump_connection* connection,
+                                     const int right,
+                                     const int unidirectional,
+                                     unsigned int precision,
+                                     unsigned int nBins,
+                                     const unsigned int* indexes,
+                                     const unsigned int* counts) {
+
+  //
+  // Sanity checks
+  //
+  
+  spindump_assert(connection != 0);
+  spindump_assert(spindump_isbool(right));
+  spindump_assert(spindump_isbool(unidirectional));
+  spindump_assert(indexes != 0);
+  spindump_assert(counts != 0);
+  if (precision > spindump_rtt_histogram_maxprecision) {
+    spindump_errorf("RTT histogram precision %u is too high", precision);
+    return;
+  }
+  
+  //
+  // Add the bins to the connection
+  //
+
+  struct spindump_rtt* rtt;
+  if (unidirectional) {
+    rtt = spindump_connections_newrtt(right ? &connection->respToInitFullRTT : &connection->initToRespFullRTT);
+  } else {
+    rtt = spindump_connections_newrtt(right ? &connection->rightRTT : &connection->leftRTT);
+  }
+  if (rtt == 0) return;
+  unsigned int maxIndex = (spindump_rtt_histogram_maxexponent - precision + 1) << precision;
+  for (unsigned int i = 0; i < nBins; i++) {
+    if (indexes[i] >= maxIndex) continue;
+    if (!spindump_rtt_histogram_addbin(&rtt->histogram,precision,indexes[i],counts[i])) return;
+  }
+  spindump_deepdebugf("merged %u RTT histogram bins to connection %u", nBins, connection->id);
+  
+  //
+  // Loop through any possible aggregated connections this connection
+  // belongs to, and add the same bins there
+  //
+
+  struct spindump_connection_set_iterator iter;
+  for (spindump_connection_set_iterator_initialize(&connection->aggregates,&iter);
+       !spindump_connection_set_iterator_end(&iter);
+       ) {
+    struct spindump_connection* aggregate = spindump_connection_set_iterator_next(&iter);
+    spindump_assert(aggregate != 0);
+    spindump_connections_newrtthistogram(aggregate,right,unidirectional,precision,nBins,indexes,counts);
+  }
+}
+
+//
+// Add the bins of an RTT quantile sketch, e.g., one reported by
+// another instance of Spindump, to the quantile sketch of a
+// connection. The bins are given in the sparse form of periodic
+// events, see spindump_rtt_sketch_sparse.
+//
+// The same bins are added to any aggregate connection this
+// connection belongs to.
+//
+
+void
+spindump_connections_newrttsketch(struct spindump_connection* connection,
+                                  const int right,
+                                  const int unidirectional,
+                                  unsigned int offset,
+                                  unsigned int zeroCount,
+                                  unsigned int nBins,
+                                  const unsigned int* indexes,
+                                  const unsigned int* counts) {
+
+  //
+  // Sanity checks
+  //
+  
+  spindump_assert(connection != 0);
+  spindump_assert(spindump_isbool(right));
+  spindump_assert(spindump_isbool(unidirectional));
+  spindump_assert(indexes != 0);
+  spindump_assert(counts != 0);
+  
+  //
+  // Add the bins to the connection
+  //
+
+  struct spindump_rtt* rtt;
+  if (unidirectional) {
+    rtt = spindump_connections_newrtt(right ? &connection->respToInitFullRTT : &connection->initToRespFullRTT);
+  } else {
+    rtt = spindump_connections_newrtt(right ? &connection->rightRTT : &connection->leftRTT);
+  }
+  if (rtt == 0 || !spindump_rtt_newsketch(rtt)) return;
+  spindump_rtt_sketch_addsparse(rtt->sketch,offset,zeroCount,nBins,indexes,counts);
+  spindump_deepdebugf("merged %u RTT sketch bins to connection %u", nBins, connection->id);
+  
+  //
+  // Loop through any possible aggregated connections this connection
+  // belongs to, and add the same bins there
+  //
+
+  struct spindump_connection_set_iterator iter;
+  for (spindump_connection_set_iterator_initialize(&connection->aggregates,&iter);
+       !spindump_connection_set_iterator_end(&iter);
+       ) {
+    struct spindump_connection* aggregate = spindump_connection_set_iterator_next(&iter);
+    spindump_assert(aggregate != 0);
+    spindump_connections_newrttsketch(aggregate,right,unidirectional,offset,zeroCount,nBins,indexes,counts);
+  }
+}
+
 //
 // Binary-search a network matching an address and return the aggregate where
 // the network belongs to.
@@ -516,7 +693,7 @@ static int
 spindump_connections_setisclosed(const struct spindump_connection_set* set) {
   unsigned int i;
 
-  for (i = 0; i < set->nConnections; i++) {
+  for (i = 0; i < set->nSlots; i++) {
     struct spindump_connection* other = set->set[i];
     if (other != 0) {
       if (!spindump_connections_isclosed(other)) {
@@ -560,7 +737,7 @@ static int
 spindump_connections_setisestablishing(const struct spindump_connection_set* set) {
   unsigned int i;
 
-  for (i = 0; i < set->nConnections; i++) {
+  for (i = 0; i < set->nSlots; i++) {
     struct spindump_connection* other = set->set[i];
     if (other != 0) {
       if (!spindump_connections_isestablishing(other)) {
@@ -658,8 +835,8 @@ spindump_connections_aggregateset(const struct spindump_connection* connection)
   // static variable that we can return.
   //
 
-  static struct spindump_connection_set empty;
-  static int emptyInitialized = 0;
+  static _Thread_local struct spindump_connection_set empty;
+  static _Thread_local int emptyInitialized = 0;
   if (!emptyInitialized) {
     spindump_connections_set_initialize(&empty);
     emptyInitialized = 1;
@@ -920,7 +1097,7 @@ spindump_connections_match_multinet(const spindump_address* source,
 void
 spindump_connections_changeidentifiers(struct spindump_analyze* state,
                                        struct spindump_packet* packet,
-                                       const struct timeval* timestamp,
+                                       const spindump_time* timestamp,
                                        struct spindump_connection* connection) {
 
   //
@@ -951,7 +1128,7 @@ spindump_connections_changeidentifiers(struct spindump_analyze* state,
 void
 spindump_connections_changestate(struct spindump_analyze* state,
                                  struct spindump_packet* packet,
-                                 const struct timeval* timestamp,
+                                 const spindump_time* timestamp,
                                  struct spindump_connection* connection,
                                  enum spindump_connection_state newState) {
 
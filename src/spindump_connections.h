@@ -52,34 +52,37 @@ spindump_connections_markconnectiondeleted(struct spindump_connection* connectio
 void
 spindump_connections_changeidentifiers(struct spindump_analyze* state,
                                        struct spindump_packet* packet,
-                                       const struct timeval* timestamp,
+                                       const spindump_time* timestamp,
                                        struct spindump_connection* connection);
 void
 spindump_connections_changestate(struct spindump_analyze* state,
                                  struct spindump_packet* packet,
-                                 const struct timeval* timestamp,
+                                 const spindump_time* timestamp,
                                  struct spindump_connection* connection,
                                  enum spindump_connection_state newState);
 void
+spindump_connections_leaveaggregates(struct spindump_connection* connection,
+                                     struct spindump_connectionstable* table);
+void
 spindump_connections_delete(struct spindump_connection* connection);
 struct spindump_connection*
 spindump_connections_newconnection(struct spindump_connectionstable* table,
                                    enum spindump_connection_type type,
-                                   const struct timeval* when,
+                                   const spindump_time* when,
                                    int manuallyCreated);
 struct spindump_connection*
 spindump_connections_newconnection_icmp(const spindump_address* side1address,
                                         const spindump_address* side2address,
                                         u_int8_t side1peerType,
                                         u_int16_t side1peerId,
-                                        const struct timeval* when,
+                                        const spindump_time* when,
                                         struct spindump_connectionstable* table);
 struct spindump_connection*
 spindump_connections_newconnection_tcp(const spindump_address* side1address,
                                        const spindump_address* side2address,
                                        spindump_port side1port,
                                        spindump_port side2port,
-                                       const struct timeval* when,
+                                       const spindump_time* when,
                                        struct spindump_connectionstable* table);
 struct spindump_connection*
 spindump_connections_newconnection_sctp(const spindump_address* side1address,
@@ -87,35 +90,35 @@ spindump_connections_newconnection_sctp(const spindump_address* side1address,
                                         spindump_port side1port,
                                         spindump_port side2port,
                                         uint32_t side1Vtag,
-                                        const struct timeval* when,
+                                        const spindump_time* when,
                                         struct spindump_connectionstable* table);
 struct spindump_connection*
 spindump_connections_newconnection_udp(const spindump_address* side1address,
                                        const spindump_address* side2address,
                                        spindump_port side1port,
                                        spindump_port side2port,
-                                       const struct timeval* when,
+                                       const spindump_time* when,
                                        struct spindump_connectionstable* table);
 struct spindump_connection*
 spindump_connections_newconnection_dns(const spindump_address* side1address,
                                        const spindump_address* side2address,
                                        spindump_port side1port,
                                        spindump_port side2port,
-                                       const struct timeval* when,
+                                       const spindump_time* when,
                                        struct spindump_connectionstable* table);
 struct spindump_connection*
 spindump_connections_newconnection_coap(const spindump_address* side1address,
                                         const spindump_address* side2address,
                                         spindump_port side1port,
                                         spindump_port side2port,
-                                        const struct timeval* when,
+                                        const spindump_time* when,
                                         struct spindump_connectionstable* table);
 struct spindump_connection*
 spindump_connections_newconnection_quic_5tuple(const spindump_address* side1address,
                                                const spindump_address* side2address,
                                                spindump_port side1port,
                                                spindump_port side2port,
-                                               const struct timeval* when,
+                                               const spindump_time* when,
                                                struct spindump_connectionstable* table);
 struct spindump_connection*
 spindump_connections_newconnection_quic_5tupleandcids(const spindump_address* side1address,
@@ -124,42 +127,42 @@ spindump_connections_newconnection_quic_5tupleandcids(const spindump_address* si
                                                       spindump_port side2port,
                                                       struct spindump_quic_connectionid* destinationCid,
                                                       struct spindump_quic_connectionid* sourceCid,
-                                                      const struct timeval* when,
+                                                      const spindump_time* when,
                                                       struct spindump_connectionstable* table);
 struct spindump_connection*
 spindump_connections_newconnection_aggregate_hostpair(const spindump_address* side1address,
                                                       const spindump_address* side2address,
-                                                      const struct timeval* when,
+                                                      const spindump_time* when,
                                                       int manuallyCreated,
                                                       struct spindump_connectionstable* table);
 struct spindump_connection*
 spindump_connections_newconnection_aggregate_hostnetwork(const spindump_address* side1address,
                                                          const spindump_network* side2network,
-                                                         const struct timeval* when,
+                                                         const spindump_time* when,
                                                          int manuallyCreated,
                                                          struct spindump_connectionstable* table);
 struct spindump_connection*
 spindump_connections_newconnection_aggregate_networknetwork(int defaultMatch,
                                                             const spindump_network* side1network,
                                                             const spindump_network* side2network,
-                                                            const struct timeval* when,
+                                                            const spindump_time* when,
                                                             int manuallyCreated,
                                                             struct spindump_connectionstable* table);
 struct spindump_connection*
 spindump_connections_newconnection_aggregate_hostmultinet(const spindump_address* side1address,
                                                           const spindump_address* identifier,
-                                                          const struct timeval* when,
+                                                          const spindump_time* when,
                                                           int manuallyCreated,
                                                           struct spindump_connectionstable* table);
 struct spindump_connection*
 spindump_connections_newconnection_aggregate_networkmultinet(const spindump_network* side1network,
                                                              const spindump_address* identifier,
-                                                             const struct timeval* when,
+                                                             const spindump_time* when,
                                                              int manuallyCreated,
                                                              struct spindump_connectionstable* table);
 struct spindump_connection*
 spindump_connections_newconnection_aggregate_multicastgroup(const spindump_address* group,
-                                                            const struct timeval* when,
+                                                            const spindump_time* when,
                                                             int manuallyCreated,
                                                             struct spindump_connectionstable* table);
 struct spindump_connection*
@@ -295,6 +298,10 @@ spindump_connections_searchconnection_aggregate_networkmultinet(const spindump_n
 struct spindump_connection*
 spindump_connections_searchconnection_aggregate_multicastgroup(const spindump_address* address,
                                                                struct spindump_connectionstable* table);
+struct spindump_rtt*
+spindump_connections_rtt(struct spindump_rtt* rtt);
+struct spindump_rtt*
+spindump_connections_newrtt(struct spindump_rtt** p_rtt);
 unsigned long
 spindump_connections_newrttmeasurement(struct spindump_analyze* state,
                                        struct spindump_packet* packet,
@@ -302,10 +309,27 @@ spindump_connections_newrttmeasurement(struct spindump_analyze* state,
                                        unsigned int ipPacketLength,
                                        const int right,
                                        const int unidirectional,
-                                       const struct timeval* sent,
-                                       const struct timeval* rcvd,
+                                       const spindump_time* sent,
+                                       const spindump_time* rcvd,
                                        const char* why);
 void
+spindump_connections_newrtthistogram(struct spindump_connection* connection,
+                                     const int right,
+                                     const int unidirectional,
+                                     unsigned int precision,
+                                     unsigned int nBins,
+                                     const unsigned int* indexes,
+                                     const unsigned int* counts);
+void
+spindump_connections_newrttsketch(struct spindump_connection* connection,
+                                  const int right,
+                                  const int unidirectional,
+                                  unsigned int offset,
+                                  unsigned int zeroCount,
+                                  unsigned int nBins,
+                                  const unsigned int* indexes,
+                                  const unsigned int* counts);
+void
 spindump_connections_getaddresses(struct spindump_connection* connection,
                                   spindump_address** p_side1address,
                                   spindump_address** p_side2address);
@@ -397,11 +421,11 @@ spindump_connection_report_brief_notefieldval(struct spindump_connection* connec
 void
 spindump_connection_periodicreport(struct spindump_connection* connection,
                                    struct spindump_connectionstable* table,
-                                   const struct timeval* now,
+                                   const spindump_time* now,
                                    struct spindump_analyze* analyzer);
 unsigned long long
 spindump_connections_lastaction(struct spindump_connection* connection,
-                                const struct timeval* now);
+                                const spindump_time* now);
 int
 spindump_connection_typehasports(enum spindump_connection_type type);
 
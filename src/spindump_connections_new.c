@@ -33,8 +33,14 @@
 #include "spindump_spin_structs.h"
 #include "spindump_connections.h"
 #include "spindump_connections_set.h"
+#include "spindump_connections_set_iterator.h"
 #include "spindump_table.h"
+#include "spindump_table_index.h"
+#include "spindump_table_timers.h"
+#include "spindump_table_aggregates.h"
+#include "spindump_table_eviction.h"
 #include "spindump_stats.h"
+#include "spindump_pool.h"
 #include "spindump_analyze_quic_parser.h"
 #include "spindump_spin.h"
 #include "spindump_titalia_delaybit.h"
@@ -46,31 +52,59 @@
 // Function prototypes ------------------------------------------------------------------------
 //
 
-static void
+static void*
+spindump_connections_newconnection_trackers(size_t size);
+static int
 spindump_connections_newconnection_aux(struct spindump_connectionstable* table,
                                        struct spindump_connection* connection,
                                        enum spindump_connection_type type,
-                                       const struct timeval* when,
+                                       const spindump_time* when,
                                        int manuallyCreated);
 static void
+spindump_connections_delete_rtt(struct spindump_rtt* rtt);
+static void
+spindump_connections_newconnection_discard(struct spindump_connection* connection,
+                                           struct spindump_connectionstable* table);
+static void
+spindump_connections_newconnection_joinaggregate(struct spindump_connection* connection,
+                                                 struct spindump_connection* aggregate,
+                                                 struct spindump_connectionstable* table);
+static void
 spindump_connections_newconnection_addtoaggregates(struct spindump_connection* connection,
                                                    struct spindump_connectionstable* table);
 //
 // Actual code --------------------------------------------------------------------------------
 //
 
+//
+// Allocate a zeroed block for the protocol-specific trackers of a
+// connection. Returns 0 if memory could not be allocated.
+//
+
+static void*
+spindump_connections_newconnection_trackers(size_t size) {
+  void* trackers = spindump_pool_allocate(size);
+  if (trackers == 0) {
+    spindump_errorf("cannot allocate memory for connection trackers of size %lu", (unsigned long)size);
+    return(0);
+  }
+  memset(trackers,0,size);
+  return(trackers);
+}
+
 //
 // Helper function to fill in a new connection object with its basic
-// fields set correctly.
+// fields set correctly. Returns 1 upon success, and 0 if the
+// protocol-specific trackers could not be allocated.
 //
 // Note: this function is not thread safe.
 //
 
-static void
+static int
 spindump_connections_newconnection_aux(struct spindump_connectionstable* table,
                                        struct spindump_connection* connection,
                                        enum spindump_connection_type type,
-                                       const struct timeval* when,
+                                       const spindump_time* when,
                                        int manuallyCreated) {
 
   //
@@ -80,11 +114,12 @@ spindump_connections_newconnection_aux(struct spindump_connectionstable* table,
   memset(connection,0,sizeof(*connection));
 
   //
-  // Generate a unique id for a connection, using a counter
+  // Generate a unique id for a connection, using a counter that is
+  // shared by all analyzer threads
   // 
   
   static unsigned int generatedIdCounter = 0;
-  connection->id = generatedIdCounter++;
+  connection->id = __atomic_fetch_add(&generatedIdCounter,1,__ATOMIC_RELAXED);
   spindump_deepdeepdebugf("spindump_connections_newconnection_aux %u %s",
                           connection->id, spindump_connection_type_to_string(type));
   
@@ -102,8 +137,14 @@ spindump_connections_newconnection_aux(struct spindump_connectionstable* table,
   connection->packetsFromSide2 = 0;
   spindump_bandwidth_initialize(&connection->bytesFromSide1,table->bandwidthMeasurementPeriod);
   spindump_bandwidth_initialize(&connection->bytesFromSide2,table->bandwidthMeasurementPeriod);
-  spindump_rtt_initialize(&connection->leftRTT);
-  spindump_rtt_initialize(&connection->rightRTT);
+  if (table->bandwidthSeries == spindump_bandwidth_series_all ||
+      (table->bandwidthSeries == spindump_bandwidth_series_aggregates &&
+       spindump_connections_isaggregate(connection))) {
+    if (!spindump_bandwidth_enableseries(&connection->bytesFromSide1) ||
+        !spindump_bandwidth_enableseries(&connection->bytesFromSide2)) {
+      return(0);
+    }
+  }
   spindump_connections_set_initialize(&connection->aggregates);
   spindump_tags_copy(&connection->tags,&table->defaultTags);
   
@@ -116,41 +157,58 @@ spindump_connections_newconnection_aux(struct spindump_connectionstable* table,
   switch (type) {
 
   case spindump_connection_transport_tcp:
-    spindump_seqtracker_initialize(&connection->u.tcp.side1Seqs);
-    spindump_seqtracker_initialize(&connection->u.tcp.side2Seqs);
+    connection->u.tcp.trackers =
+      spindump_connections_newconnection_trackers(sizeof(*connection->u.tcp.trackers));
+    if (connection->u.tcp.trackers == 0) return(0);
+    spindump_seqtracker_initialize(&connection->u.tcp.trackers->side1Seqs);
+    spindump_seqtracker_initialize(&connection->u.tcp.trackers->side2Seqs);
+    spindump_seqtracker_setmaxwindow(&connection->u.tcp.trackers->side1Seqs,table->tcpWindow);
+    spindump_seqtracker_setmaxwindow(&connection->u.tcp.trackers->side2Seqs,table->tcpWindow);
     break;
 
   case spindump_connection_transport_sctp:
-    spindump_tsntracker_initialize(&connection->u.sctp.side1Seqs);
-    spindump_tsntracker_initialize(&connection->u.sctp.side2Seqs);
+    connection->u.sctp.trackers =
+      spindump_connections_newconnection_trackers(sizeof(*connection->u.sctp.trackers));
+    if (connection->u.sctp.trackers == 0) return(0);
+    spindump_tsntracker_initialize(&connection->u.sctp.trackers->side1Seqs);
+    spindump_tsntracker_initialize(&connection->u.sctp.trackers->side2Seqs);
     break;
   
   case spindump_connection_transport_udp:
     break;
 
   case spindump_connection_transport_dns:
-    spindump_messageidtracker_initialize(&connection->u.dns.side1MIDs);
-    spindump_messageidtracker_initialize(&connection->u.dns.side2MIDs);
+    connection->u.dns.trackers =
+      spindump_connections_newconnection_trackers(sizeof(*connection->u.dns.trackers));
+    if (connection->u.dns.trackers == 0) return(0);
+    spindump_messageidtracker_initialize(&connection->u.dns.trackers->side1MIDs);
+    spindump_messageidtracker_initialize(&connection->u.dns.trackers->side2MIDs);
     break;
 
   case spindump_connection_transport_coap:
-    spindump_messageidtracker_initialize(&connection->u.coap.side1MIDs);
-    spindump_messageidtracker_initialize(&connection->u.coap.side2MIDs);
+    connection->u.coap.trackers =
+      spindump_connections_newconnection_trackers(sizeof(*connection->u.coap.trackers));
+    if (connection->u.coap.trackers == 0) return(0);
+    spindump_messageidtracker_initialize(&connection->u.coap.trackers->side1MIDs);
+    spindump_messageidtracker_initialize(&connection->u.coap.trackers->side2MIDs);
     break;
 
   case spindump_connection_transport_quic:
-    spindump_spintracker_initialize(&connection->u.quic.spinFromPeer1to2);
-    spindump_spintracker_initialize(&connection->u.quic.spinFromPeer2to1);
-    spindump_delaybittracker_initialize(&connection->u.quic.delaybitFromPeer1to2);
-    spindump_delaybittracker_initialize(&connection->u.quic.delaybitFromPeer2to1);
-    spindump_rtloss1tracker_initialize(&connection->u.quic.rtloss1FromPeer1to2);
-    spindump_rtloss1tracker_initialize(&connection->u.quic.rtloss1FromPeer2to1);
-    spindump_rtloss2tracker_initialize(&connection->u.quic.rtloss2FromPeer1to2);
-    spindump_rtloss2tracker_initialize(&connection->u.quic.rtloss2FromPeer2to1);
-    spindump_qrlosstracker_initialize(&connection->u.quic.qrFromPeer1to2);
-    spindump_qrlosstracker_initialize(&connection->u.quic.qrFromPeer2to1);
-    spindump_qllosstracker_initialize(&connection->u.quic.qlFromPeer1to2);
-    spindump_qllosstracker_initialize(&connection->u.quic.qlFromPeer2to1);
+    connection->u.quic.trackers =
+      spindump_connections_newconnection_trackers(sizeof(*connection->u.quic.trackers));
+    if (connection->u.quic.trackers == 0) return(0);
+    spindump_spintracker_initialize(&connection->u.quic.trackers->spinFromPeer1to2);
+    spindump_spintracker_initialize(&connection->u.quic.trackers->spinFromPeer2to1);
+    spindump_delaybittracker_initialize(&connection->u.quic.trackers->delaybitFromPeer1to2);
+    spindump_delaybittracker_initialize(&connection->u.quic.trackers->delaybitFromPeer2to1);
+    spindump_rtloss1tracker_initialize(&connection->u.quic.trackers->rtloss1FromPeer1to2);
+    spindump_rtloss1tracker_initialize(&connection->u.quic.trackers->rtloss1FromPeer2to1);
+    spindump_rtloss2tracker_initialize(&connection->u.quic.trackers->rtloss2FromPeer1to2);
+    spindump_rtloss2tracker_initialize(&connection->u.quic.trackers->rtloss2FromPeer2to1);
+    spindump_qrlosstracker_initialize(&connection->u.quic.trackers->qrFromPeer1to2);
+    spindump_qrlosstracker_initialize(&connection->u.quic.trackers->qrFromPeer2to1);
+    spindump_qllosstracker_initialize(&connection->u.quic.trackers->qlFromPeer1to2);
+    spindump_qllosstracker_initialize(&connection->u.quic.trackers->qlFromPeer2to1);
     connection->u.quic.side1initialPacket = *when;
     spindump_zerotime(&connection->u.quic.side2initialResponsePacket);
     connection->u.quic.initialRightRTT = spindump_rtt_infinite;
@@ -158,7 +216,10 @@ spindump_connections_newconnection_aux(struct spindump_connectionstable* table,
     break;
 
   case spindump_connection_transport_icmp:
-    spindump_messageidtracker_initialize(&connection->u.icmp.side1Seqs);
+    connection->u.icmp.trackers =
+      spindump_connections_newconnection_trackers(sizeof(*connection->u.icmp.trackers));
+    if (connection->u.icmp.trackers == 0) return(0);
+    spindump_messageidtracker_initialize(&connection->u.icmp.trackers->side1Seqs);
     break;
 
   case spindump_connection_aggregate_hostpair:
@@ -191,6 +252,106 @@ spindump_connections_newconnection_aux(struct spindump_connectionstable* table,
     break;
     
   }
+
+  return(1);
+}
+
+//
+// Make a new connection a member of an aggregate, linking the two
+// both ways. If memory cannot be allocated for either link, the
+// connection is simply left out of the aggregate. The join is also
+// given to the aggregate update handler of the table, if any.
+//
+
+static void
+spindump_connections_newconnection_joinaggregate(struct spindump_connection* connection,
+                                                 struct spindump_connection* aggregate,
+                                                 struct spindump_connectionstable* table) {
+  
+  struct spindump_connection_set* members = 0;
+  switch (aggregate->type) {
+    
+  case spindump_connection_aggregate_hostpair:
+    members = &aggregate->u.aggregatehostpair.connections;
+    break;
+    
+  case spindump_connection_aggregate_hostnetwork:
+    members = &aggregate->u.aggregatehostnetwork.connections;
+    break;
+    
+  case spindump_connection_aggregate_hostmultinet:
+    members = &aggregate->u.aggregatehostmultinet.connections;
+    break;
+    
+  case spindump_connection_aggregate_networknetwork:
+    members = &aggregate->u.aggregatenetworknetwork.connections;
+    break;
+    
+  case spindump_connection_aggregate_networkmultinet:
+    members = &aggregate->u.aggregatenetworkmultinet.connections;
+    break;
+    
+  case spindump_connection_aggregate_multicastgroup:
+    members = &aggregate->u.aggregatemulticastgroup.connections;
+    break;
+
+  case spindump_connection_transport_udp:
+  case spindump_connection_transport_tcp:
+  case spindump_connection_transport_sctp:
+  case spindump_connection_transport_quic:
+  case spindump_connection_transport_dns:
+  case spindump_connection_transport_coap:
+  case spindump_connection_transport_icmp:
+  default:
+    spindump_errorf("invalid connection type %u in spindump_connections_newconnection_joinaggregate",
+                    aggregate->type);
+    return;
+    
+  }
+  
+  if (!spindump_connections_set_add(&connection->aggregates,aggregate)) {
+    spindump_errorf("connection %u left out of aggregate %u", connection->id, aggregate->id);
+    return;
+  }
+  if (!spindump_connections_set_add(members,connection)) {
+    spindump_errorf("connection %u left out of aggregate %u", connection->id, aggregate->id);
+    spindump_connections_set_remove(&connection->aggregates,aggregate);
+    return;
+  }
+  if (table->aggregateUpdateHandler != 0) {
+    struct spindump_connectionstable_aggregateupdate update;
+    memset(&update,0,sizeof(update));
+    update.type = spindump_connectionstable_aggregateupdate_join;
+    update.aggregate = aggregate;
+    update.connection = connection;
+    (*table->aggregateUpdateHandler)(&update,table->aggregateUpdateHandlerData);
+  }
+}
+
+//
+// Tell the aggregate update handler of the table, if any, that a
+// connection that is about to be deleted leaves its aggregates. The
+// connection is removed from the aggregates themselves in
+// spindump_connections_delete.
+//
+
+void
+spindump_connections_leaveaggregates(struct spindump_connection* connection,
+                                     struct spindump_connectionstable* table) {
+  spindump_assert(connection != 0);
+  spindump_assert(table != 0);
+  if (table->aggregateUpdateHandler == 0) return;
+  struct spindump_connection_set_iterator iter;
+  for (spindump_connection_set_iterator_initialize(&connection->aggregates,&iter);
+       !spindump_connection_set_iterator_end(&iter);
+       ) {
+    struct spindump_connectionstable_aggregateupdate update;
+    memset(&update,0,sizeof(update));
+    update.type = spindump_connectionstable_aggregateupdate_leave;
+    update.aggregate = spindump_connection_set_iterator_next(&iter);
+    update.connection = connection;
+    (*table->aggregateUpdateHandler)(&update,table->aggregateUpdateHandlerData);
+  }
 }
 
 //
@@ -204,114 +365,58 @@ static void
 spindump_connections_newconnection_addtoaggregates(struct spindump_connection* connection,
                                                    struct spindump_connectionstable* table) {
   struct spindump_connection* aggregate;
+  spindump_address* side1address = 0;
+  spindump_address* side2address = 0;
+  spindump_connections_getaddresses(connection,
+                                    &side1address,
+                                    &side2address);
 
+  if (side1address == 0 || side2address == 0) {
+    spindump_deepdebugf("can't figure out addresses from connection %u", connection->id);
+    return;
+  }
+  
+  //
+  // Look at the aggregates that the aggregate index says the
+  // connection's addresses might belong to. They come in table order,
+  // so a default match aggregate is skipped if and only if an
+  // earlier aggregate in the table matched.
+  //
+  
   spindump_debugf("looking at aggregates that the new connection %u might fit into",
                   connection->id);
   int seenMatch = 0;
-  for (unsigned int i = 0; i < table->nConnections; i++) {
-    aggregate = table->connections[i];
-    if (aggregate != 0 &&
-        spindump_connections_isaggregate_simple(aggregate)) {
-
-      spindump_deepdebugf("testing aggregate %u (tags %s, %u of %u connections) seen match = %u",
-                          aggregate->id, aggregate->tags.string, i, table->nConnections, seenMatch);
+  struct spindump_connection** candidates;
+  unsigned int nCandidates = spindump_connectionstable_aggregates_find(table,
+                                                                       side1address,
+                                                                       side2address,
+                                                                       &candidates);
+  for (unsigned int i = 0; i < nCandidates; i++) {
+    aggregate = candidates[i];
+    if (spindump_connections_isaggregate_simple(aggregate)) {
+
+      spindump_deepdebugf("testing aggregate %u (tags %s, %u of %u candidates) seen match = %u",
+                          aggregate->id, aggregate->tags.string, i, nCandidates, seenMatch);
       
       if (spindump_connections_matches_aggregate_connection(seenMatch,connection,aggregate)) {
 
         //
         // This aggregate matches the new connection. Add to a list of
-        // aggregates this connection belongs to.
+        // aggregates this connection belongs to, and the connection to
+        // the aggregate's list of what connections belong to it.
         // 
 
         seenMatch = 1;
         spindump_debugf("connection %u matches aggregate %u",
                         connection->id, aggregate->id);
-        spindump_connections_set_add(&connection->aggregates,aggregate);
-        
-        //
-        // Add to the aggregate's list of what connections belong to it.
-        // 
-        
-        switch (aggregate->type) {
-          
-        case spindump_connection_aggregate_hostpair:
-          spindump_connections_set_add(&aggregate->u.aggregatehostpair.connections,connection);
-          break;
-          
-        case spindump_connection_aggregate_hostnetwork:
-          spindump_connections_set_add(&aggregate->u.aggregatehostnetwork.connections,connection);
-          break;
-          
-        case spindump_connection_aggregate_hostmultinet:
-          spindump_connections_set_add(&aggregate->u.aggregatehostmultinet.connections,connection);
-          break;
-          
-        case spindump_connection_aggregate_networknetwork:
-          spindump_connections_set_add(&aggregate->u.aggregatenetworknetwork.connections,connection);
-          break;
-          
-        case spindump_connection_aggregate_networkmultinet:
-          spindump_connections_set_add(&aggregate->u.aggregatenetworkmultinet.connections,connection);
-          break;
-          
-        case spindump_connection_aggregate_multicastgroup:
-          spindump_connections_set_add(&aggregate->u.aggregatemulticastgroup.connections,connection);
-          break;
-
-        case spindump_connection_transport_udp:
-        case spindump_connection_transport_tcp:
-        case spindump_connection_transport_sctp:
-        case spindump_connection_transport_quic:
-        case spindump_connection_transport_dns:
-        case spindump_connection_transport_coap:
-        case spindump_connection_transport_icmp:
-        default:
-          spindump_errorf("invalid connection type %u in spindump_connections_newconnection_addtoaggregates",
-                          aggregate->type);
-          break;
-          
-        }
+        spindump_connections_newconnection_joinaggregate(connection,aggregate,table);
       }
     }
     
   }
 
-  spindump_address* side1address = 0;
-  spindump_address* side2address = 0;
-  spindump_connections_getaddresses(connection,
-                                    &side1address,
-                                    &side2address);
-
-  if (side1address == 0 || side2address == 0) {
-    spindump_deepdebugf("can't figure out addresses from connection %u", connection->id);
-
-  } else if ((aggregate = spindump_connections_match_multinet(side1address,side2address,table))) {
-
-    spindump_connections_set_add(&connection->aggregates,aggregate);
-
-    switch (aggregate->type) {
-    case spindump_connection_aggregate_hostmultinet:
-      spindump_connections_set_add(&aggregate->u.aggregatehostmultinet.connections,connection);
-      break;
-    case spindump_connection_aggregate_networkmultinet:
-      spindump_connections_set_add(&aggregate->u.aggregatenetworkmultinet.connections,connection);
-      break;
-    case spindump_connection_transport_tcp:
-    case spindump_connection_transport_udp:
-    case spindump_connection_transport_dns:
-    case spindump_connection_transport_coap:
-    case spindump_connection_transport_quic:
-    case spindump_connection_transport_icmp:
-    case spindump_connection_transport_sctp:
-    case spindump_connection_aggregate_hostpair:
-    case spindump_connection_aggregate_hostnetwork:
-    case spindump_connection_aggregate_networknetwork:
-    case spindump_connection_aggregate_multicastgroup:
-    default:
-      spindump_errorf("invalid connection type %u in spindump_connections_newconnection_addtoaggregates",
-                      aggregate->type);
-      break;
-    }
+  if ((aggregate = spindump_connections_match_multinet(side1address,side2address,table))) {
+    spindump_connections_newconnection_joinaggregate(connection,aggregate,table);
   }
 }
 
@@ -333,7 +438,7 @@ spindump_connections_newconnection_addtoaggregates(struct spindump_connection* c
 struct spindump_connection*
 spindump_connections_newconnection(struct spindump_connectionstable* table,
                                    enum spindump_connection_type type,
-                                   const struct timeval* when,
+                                   const spindump_time* when,
                                    int manuallyCreated) {
 
   //
@@ -350,7 +455,7 @@ spindump_connections_newconnection(struct spindump_connectionstable* table,
   // 
   
   unsigned int size = sizeof(struct spindump_connection);
-  struct spindump_connection* connection = (struct spindump_connection*)spindump_malloc(size);
+  struct spindump_connection* connection = (struct spindump_connection*)spindump_pool_allocate(size);
   if (connection == 0) {
     spindump_errorf("cannot allocate memory for a connection of size %u", size);
     return(0);
@@ -360,16 +465,28 @@ spindump_connections_newconnection(struct spindump_connectionstable* table,
   // Initialize counters etc
   // 
   
-  spindump_connections_newconnection_aux(table,connection,type,when,manuallyCreated);
+  if (!spindump_connections_newconnection_aux(table,connection,type,when,manuallyCreated)) {
+    spindump_bandwidth_uninitialize(&connection->bytesFromSide1);
+    spindump_bandwidth_uninitialize(&connection->bytesFromSide2);
+    spindump_pool_free(connection,size);
+    return(0);
+  }
+  connection->creationOrder = table->nextCreationOrder++;
+  spindump_connectionstable_updatetimeout(table,connection);
+  spindump_connectionstable_eviction_touch(table,connection);
   
   //
-  // Look for a place in the connections table
+  // Look for a place in the connections table, starting from the
+  // first unused position, if there are any
   // 
   
   unsigned int i;
-  for (i = 0; i < table->nConnections; i++) {
+  for (i = table->firstHole; table->nHoles > 0 && i < table->nConnections; i++) {
     if (table->connections[i] == 0) {
       table->connections[i] = connection;
+      connection->tableIndex = i;
+      table->nHoles--;
+      table->firstHole = i + 1;
       return(connection);
     }
   }
@@ -379,6 +496,7 @@ spindump_connections_newconnection(struct spindump_connectionstable* table,
   // 
 
   if (table->nConnections < table->maxNConnections) {
+    connection->tableIndex = table->nConnections;
     table->connections[table->nConnections++] = connection;
     return(connection);
   }
@@ -394,7 +512,8 @@ spindump_connections_newconnection(struct spindump_connectionstable* table,
   if (newtable == 0) {
     spindump_errorf("cannot allocate memory for a connection table of size %u", newtabsize);
     spindump_deepdebugf("free connection after an error");
-    spindump_free(connection);
+    spindump_connectionstable_timers_unschedule(table,connection);
+    spindump_pool_free(connection,sizeof(*connection));
     return(0);
   }
   table->connections = newtable;
@@ -404,12 +523,37 @@ spindump_connections_newconnection(struct spindump_connectionstable* table,
   }
   spindump_deepdebugf("free oldtable after a growth");
   spindump_free(oldtable);
+  connection->tableIndex = table->nConnections;
   table->connections[table->nConnections++] = connection;
   spindump_assert(table->nConnections < table->maxNConnections);
   return(connection);
   
 }
 
+//
+// Take a connection that was just created back out of the table and
+// delete it, when its setup cannot be completed. No handlers have
+// seen the connection yet, so none are called.
+//
+
+static void
+spindump_connections_newconnection_discard(struct spindump_connection* connection,
+                                           struct spindump_connectionstable* table) {
+  spindump_assert(connection != 0);
+  spindump_assert(table != 0);
+  spindump_assert(connection->tableIndex < table->nConnections);
+  spindump_assert(table->connections[connection->tableIndex] == connection);
+  spindump_debugf("discarding connection %u whose setup failed", connection->id);
+  table->connections[connection->tableIndex] = 0;
+  if (table->nHoles == 0 || connection->tableIndex < table->firstHole) table->firstHole = connection->tableIndex;
+  table->nHoles++;
+  spindump_connectionstable_timers_unschedule(table,connection);
+  spindump_connectionstable_aggregates_remove(table,connection);
+  spindump_connectionstable_eviction_remove(table,connection);
+  spindump_connections_leaveaggregates(connection,table);
+  spindump_connections_delete(connection);
+}
+
 //
 // Create a new connection for an ICMP flow that has been observed in
 // the network.
@@ -420,7 +564,7 @@ spindump_connections_newconnection_icmp(const spindump_address* side1address,
                                         const spindump_address* side2address,
                                         u_int8_t side1peerType,
                                         u_int16_t side1peerId,
-                                        const struct timeval* when,
+                                        const spindump_time* when,
                                         struct spindump_connectionstable* table) {
   spindump_assert(side1address != 0);
   spindump_assert(side2address != 0);
@@ -451,7 +595,7 @@ spindump_connections_newconnection_tcp(const spindump_address* side1address,
                                        const spindump_address* side2address,
                                        spindump_port side1port,
                                        spindump_port side2port,
-                                       const struct timeval* when,
+                                       const spindump_time* when,
                                        struct spindump_connectionstable* table) {
   
   spindump_assert(side1address != 0);
@@ -467,6 +611,7 @@ spindump_connections_newconnection_tcp(const spindump_address* side1address,
   connection->u.tcp.side2peerAddress = *side2address;
   connection->u.tcp.side1peerPort = side1port;
   connection->u.tcp.side2peerPort = side2port;
+  spindump_connectionstable_index_add(table,connection);
   spindump_connections_newconnection_addtoaggregates(connection,table);
   
   spindump_debugf("created a new TCP connection %u", connection->id);
@@ -485,7 +630,7 @@ spindump_connections_newconnection_sctp(const spindump_address* side1address,
                                         spindump_port side1port,
                                         spindump_port side2port,
                                         uint32_t side1Vtag,
-                                        const struct timeval* when,
+                                        const spindump_time* when,
                                         struct spindump_connectionstable* table) {
   
   spindump_assert(side1address != 0);
@@ -503,8 +648,9 @@ spindump_connections_newconnection_sctp(const spindump_address* side1address,
   connection->u.sctp.side2peerPort = side2port;
   connection->u.sctp.side1Vtag = side1Vtag;  // VTag from INIT chunk
   connection->u.sctp.side2Vtag = 0;  // VTag from INIT ACK chunk will be stored here
-  connection->u.sctp.side1HbCnt = 0;
-  connection->u.sctp.side2HbCnt = 0;
+  connection->u.sctp.trackers->side1HbCnt = 0;
+  connection->u.sctp.trackers->side2HbCnt = 0;
+  spindump_connectionstable_index_add(table,connection);
   spindump_connections_newconnection_addtoaggregates(connection,table);
   
   spindump_debugf("created a new SCTP connection %u", connection->id);
@@ -521,7 +667,7 @@ spindump_connections_newconnection_udp(const spindump_address* side1address,
                                        const spindump_address* side2address,
                                        spindump_port side1port,
                                        spindump_port side2port,
-                                       const struct timeval* when,
+                                       const spindump_time* when,
                                        struct spindump_connectionstable* table) {
   
   spindump_assert(side1address != 0);
@@ -537,6 +683,7 @@ spindump_connections_newconnection_udp(const spindump_address* side1address,
   connection->u.udp.side2peerAddress = *side2address;
   connection->u.udp.side1peerPort = side1port;
   connection->u.udp.side2peerPort = side2port;
+  spindump_connectionstable_index_add(table,connection);
   spindump_connections_newconnection_addtoaggregates(connection,table);
   
   spindump_debugf("created a new UDP connection %u", connection->id);
@@ -553,7 +700,7 @@ spindump_connections_newconnection_dns(const spindump_address* side1address,
                                        const spindump_address* side2address,
                                        spindump_port side1port,
                                        spindump_port side2port,
-                                       const struct timeval* when,
+                                       const spindump_time* when,
                                        struct spindump_connectionstable* table) {
   
   spindump_assert(side1address != 0);
@@ -569,6 +716,7 @@ spindump_connections_newconnection_dns(const spindump_address* side1address,
   connection->u.dns.side2peerAddress = *side2address;
   connection->u.dns.side1peerPort = side1port;
   connection->u.dns.side2peerPort = side2port;
+  spindump_connectionstable_index_add(table,connection);
   spindump_connections_newconnection_addtoaggregates(connection,table);
   
   spindump_debugf("created a new DNS connection %u", connection->id);
@@ -585,7 +733,7 @@ spindump_connections_newconnection_coap(const spindump_address* side1address,
                                         const spindump_address* side2address,
                                         spindump_port side1port,
                                         spindump_port side2port,
-                                        const struct timeval* when,
+                                        const spindump_time* when,
                                         struct spindump_connectionstable* table) {
   
   spindump_assert(side1address != 0);
@@ -601,6 +749,7 @@ spindump_connections_newconnection_coap(const spindump_address* side1address,
   connection->u.coap.side2peerAddress = *side2address;
   connection->u.coap.side1peerPort = side1port;
   connection->u.coap.side2peerPort = side2port;
+  spindump_connectionstable_index_add(table,connection);
   spindump_connections_newconnection_addtoaggregates(connection,table);
   
   spindump_debugf("created a new COAP connection %u", connection->id);
@@ -618,7 +767,7 @@ spindump_connections_newconnection_quic_5tuple(const spindump_address* side1addr
                                                const spindump_address* side2address,
                                                spindump_port side1port,
                                                spindump_port side2port,
-                                               const struct timeval* when,
+                                               const spindump_time* when,
                                                struct spindump_connectionstable* table) {
   
   spindump_assert(side1address != 0);
@@ -637,6 +786,7 @@ spindump_connections_newconnection_quic_5tuple(const spindump_address* side1addr
   connection->u.quic.side2peerPort = side2port;
   memset(&connection->u.quic.peer1ConnectionID,0,sizeof(struct spindump_quic_connectionid));
   memset(&connection->u.quic.peer2ConnectionID,0,sizeof(struct spindump_quic_connectionid));
+  spindump_connectionstable_index_add(table,connection);
   spindump_connections_newconnection_addtoaggregates(connection,table);
   
   spindump_debugf("created a new QUIC connection %u via a 5-tuple", connection->id);
@@ -656,7 +806,7 @@ spindump_connections_newconnection_quic_5tupleandcids(const spindump_address* si
                                                       spindump_port side2port,
                                                       struct spindump_quic_connectionid* destinationCid,
                                                       struct spindump_quic_connectionid* sourceCid,
-                                                      const struct timeval* when,
+                                                      const spindump_time* when,
                                                       struct spindump_connectionstable* table) {
   
   spindump_assert(side1address != 0);
@@ -677,6 +827,7 @@ spindump_connections_newconnection_quic_5tupleandcids(const spindump_address* si
   connection->u.quic.side2peerPort = side2port;
   memcpy(&connection->u.quic.peer1ConnectionID,sourceCid,sizeof(struct spindump_quic_connectionid));
   memcpy(&connection->u.quic.peer2ConnectionID,destinationCid,sizeof(struct spindump_quic_connectionid));
+  spindump_connectionstable_index_add(table,connection);
   spindump_connections_newconnection_addtoaggregates(connection,table);
   
   spindump_debugf("created a new QUIC connection %u via a 5-tuple and CIDs", connection->id);
@@ -691,7 +842,7 @@ spindump_connections_newconnection_quic_5tupleandcids(const spindump_address* si
 struct spindump_connection*
 spindump_connections_newconnection_aggregate_hostpair(const spindump_address* side1address,
                                                       const spindump_address* side2address,
-                                                      const struct timeval* when,
+                                                      const spindump_time* when,
                                                       int manuallyCreated,
                                                       struct spindump_connectionstable* table) {
   spindump_assert(side1address != 0);
@@ -706,6 +857,10 @@ spindump_connections_newconnection_aggregate_hostpair(const spindump_address* si
   connection->state = spindump_connection_state_static;
   connection->u.aggregatehostpair.side1peerAddress = *side1address;
   connection->u.aggregatehostpair.side2peerAddress = *side2address;
+  if (!spindump_connectionstable_aggregates_add(table,connection)) {
+    spindump_connections_newconnection_discard(connection,table);
+    return(0);
+  }
   
   spindump_debugf("created a new host pair aggregate onnection %u", connection->id);
   return(connection);
@@ -719,7 +874,7 @@ spindump_connections_newconnection_aggregate_hostpair(const spindump_address* si
 struct spindump_connection*
 spindump_connections_newconnection_aggregate_hostnetwork(const spindump_address* side1address,
                                                          const spindump_network* side2network,
-                                                         const struct timeval* when,
+                                                         const spindump_time* when,
                                                          int manuallyCreated,
                                                          struct spindump_connectionstable* table) {
   spindump_assert(side1address != 0);
@@ -734,6 +889,10 @@ spindump_connections_newconnection_aggregate_hostnetwork(const spindump_address*
   connection->state = spindump_connection_state_static;
   connection->u.aggregatehostnetwork.side1peerAddress = *side1address;
   connection->u.aggregatehostnetwork.side2Network = *side2network;
+  if (!spindump_connectionstable_aggregates_add(table,connection)) {
+    spindump_connections_newconnection_discard(connection,table);
+    return(0);
+  }
   
   spindump_debugf("created a new host-network aggregate onnection %u", connection->id);
   return(connection);
@@ -747,7 +906,7 @@ struct spindump_connection*
 spindump_connections_newconnection_aggregate_networknetwork(int defaultMatch,
                                                             const spindump_network* side1network,
                                                             const spindump_network* side2network,
-                                                            const struct timeval* when,
+                                                            const spindump_time* when,
                                                             int manuallyCreated,
                                                             struct spindump_connectionstable* table) {
   spindump_assert(side1network != 0);
@@ -765,6 +924,10 @@ spindump_connections_newconnection_aggregate_networknetwork(int defaultMatch,
   connection->u.aggregatenetworknetwork.side1Network = *side1network;
   connection->u.aggregatenetworknetwork.side2Network = *side2network;
   connection->u.aggregatenetworknetwork.defaultMatch = defaultMatch;
+  if (!spindump_connectionstable_aggregates_add(table,connection)) {
+    spindump_connections_newconnection_discard(connection,table);
+    return(0);
+  }
   
   spindump_debugf("created a new network-network aggregate onnection %u default match %u",
                   connection->id,
@@ -780,7 +943,7 @@ spindump_connections_newconnection_aggregate_networknetwork(int defaultMatch,
 struct spindump_connection*
 spindump_connections_newconnection_aggregate_hostmultinet(const spindump_address* side1address,
                                                           const spindump_address* identifier,
-                                                          const struct timeval* when,
+                                                          const spindump_time* when,
                                                           int manuallyCreated,
                                                           struct spindump_connectionstable* table) {
   spindump_assert(side1address != 0);
@@ -806,7 +969,7 @@ spindump_connections_newconnection_aggregate_hostmultinet(const spindump_address
 struct spindump_connection*
 spindump_connections_newconnection_aggregate_networkmultinet(const spindump_network* side1network,
                                                              const spindump_address* identifier,
-                                                             const struct timeval* when,
+                                                             const spindump_time* when,
                                                              int manuallyCreated,
                                                              struct spindump_connectionstable* table) {
   spindump_assert(side1network != 0);
@@ -831,7 +994,7 @@ spindump_connections_newconnection_aggregate_networkmultinet(const spindump_netw
 
 struct spindump_connection*
 spindump_connections_newconnection_aggregate_multicastgroup(const spindump_address* group,
-                                                            const struct timeval* when,
+                                                            const spindump_time* when,
                                                             int manuallyCreated,
                                                             struct spindump_connectionstable* table) {
   spindump_assert(group != 0);
@@ -844,11 +1007,27 @@ spindump_connections_newconnection_aggregate_multicastgroup(const spindump_addre
   
   connection->state = spindump_connection_state_static;
   connection->u.aggregatemulticastgroup.group = *group;
+  if (!spindump_connectionstable_aggregates_add(table,connection)) {
+    spindump_connections_newconnection_discard(connection,table);
+    return(0);
+  }
   
   spindump_debugf("created a new multicast group aggregate onnection %u", connection->id);
   return(connection);
 }
 
+//
+// Release an RTT tracker of a connection that is being deleted, if
+// the connection had one.
+//
+
+static void
+spindump_connections_delete_rtt(struct spindump_rtt* rtt) {
+  if (rtt == 0) return;
+  spindump_rtt_uninitialize(rtt);
+  spindump_pool_free(rtt,sizeof(*rtt));
+}
+
 //
 // Delete a connection object. This causes the physical deallocation
 // of the object, and is typically called by a periodic cleanup
@@ -863,33 +1042,39 @@ spindump_connections_delete(struct spindump_connection* connection) {
   switch (connection->type) {
     
   case spindump_connection_transport_tcp:
-    spindump_seqtracker_uninitialize(&connection->u.tcp.side1Seqs);
-    spindump_seqtracker_uninitialize(&connection->u.tcp.side2Seqs);
+    spindump_seqtracker_uninitialize(&connection->u.tcp.trackers->side1Seqs);
+    spindump_seqtracker_uninitialize(&connection->u.tcp.trackers->side2Seqs);
+    spindump_pool_free(connection->u.tcp.trackers,sizeof(*connection->u.tcp.trackers));
     break;
     
   case spindump_connection_transport_sctp:
-    spindump_tsntracker_uninitialize(&connection->u.sctp.side1Seqs);
-    spindump_tsntracker_uninitialize(&connection->u.sctp.side2Seqs);
+    spindump_tsntracker_uninitialize(&connection->u.sctp.trackers->side1Seqs);
+    spindump_tsntracker_uninitialize(&connection->u.sctp.trackers->side2Seqs);
+    spindump_pool_free(connection->u.sctp.trackers,sizeof(*connection->u.sctp.trackers));
     break;
 
   case spindump_connection_transport_udp:
     break;
     
   case spindump_connection_transport_dns:
-    spindump_messageidtracker_uninitialize(&connection->u.dns.side1MIDs);
-    spindump_messageidtracker_uninitialize(&connection->u.dns.side2MIDs);
+    spindump_messageidtracker_uninitialize(&connection->u.dns.trackers->side1MIDs);
+    spindump_messageidtracker_uninitialize(&connection->u.dns.trackers->side2MIDs);
+    spindump_pool_free(connection->u.dns.trackers,sizeof(*connection->u.dns.trackers));
     break;
     
   case spindump_connection_transport_coap:
-    spindump_messageidtracker_uninitialize(&connection->u.coap.side1MIDs);
-    spindump_messageidtracker_uninitialize(&connection->u.coap.side2MIDs);
+    spindump_messageidtracker_uninitialize(&connection->u.coap.trackers->side1MIDs);
+    spindump_messageidtracker_uninitialize(&connection->u.coap.trackers->side2MIDs);
+    spindump_pool_free(connection->u.coap.trackers,sizeof(*connection->u.coap.trackers));
     break;
     
   case spindump_connection_transport_quic:
+    spindump_pool_free(connection->u.quic.trackers,sizeof(*connection->u.quic.trackers));
     break;
     
   case spindump_connection_transport_icmp:
-    spindump_messageidtracker_uninitialize(&connection->u.icmp.side1Seqs);
+    spindump_messageidtracker_uninitialize(&connection->u.icmp.trackers->side1Seqs);
+    spindump_pool_free(connection->u.icmp.trackers,sizeof(*connection->u.icmp.trackers));
     break;
     
   case spindump_connection_aggregate_hostpair:
@@ -923,7 +1108,13 @@ spindump_connections_delete(struct spindump_connection* connection) {
     
   }
   
+  spindump_connections_delete_rtt(connection->leftRTT);
+  spindump_connections_delete_rtt(connection->rightRTT);
+  spindump_connections_delete_rtt(connection->respToInitFullRTT);
+  spindump_connections_delete_rtt(connection->initToRespFullRTT);
+  spindump_bandwidth_uninitialize(&connection->bytesFromSide1);
+  spindump_bandwidth_uninitialize(&connection->bytesFromSide2);
   spindump_connections_set_uninitialize(&connection->aggregates,connection);
   memset(connection,0x93,sizeof(*connection));
-  spindump_free(connection);
+  spindump_pool_free(connection,sizeof(*connection));
 }
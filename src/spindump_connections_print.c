@@ -620,27 +620,27 @@ spindump_connection_report(struct spindump_connection* connection,
   char rttbuf1[50];
   char rttbuf2[50];
   spindump_strlcpy(rttbuf1,
-                   spindump_rtt_tostring(connection->leftRTT.lastRTT),
+                   spindump_rtt_tostring(spindump_connections_rtt(connection->leftRTT)->lastRTT),
                    sizeof(rttbuf1));
   unsigned long dev;
   unsigned long filt;
-  unsigned long avg = spindump_rtt_calculateLastMovingAvgRTT(&connection->leftRTT,0,0,&dev,&filt);
+  unsigned long avg = spindump_rtt_calculateLastMovingAvgRTT(spindump_connections_rtt(connection->leftRTT),0,0,&dev,&filt);
   spindump_strlcpy(rttbuf2,
                    spindump_rtt_tostring(avg),
                    sizeof(rttbuf2));
   fprintf(file,"  last left RTT:           %38s\n", rttbuf1);
   fprintf(file,"  moving avg left RTT:     %38s\n", rttbuf2);
-  avg = spindump_rtt_calculateLastMovingAvgRTT(&connection->rightRTT,0,0,&dev,&filt);
+  avg = spindump_rtt_calculateLastMovingAvgRTT(spindump_connections_rtt(connection->rightRTT),0,0,&dev,&filt);
   spindump_strlcpy(rttbuf1,
-                   spindump_rtt_tostring(connection->rightRTT.lastRTT),
+                   spindump_rtt_tostring(spindump_connections_rtt(connection->rightRTT)->lastRTT),
                    sizeof(rttbuf1));
-  spindump_connection_report_rtt_histogram(&connection->leftRTT, file);
+  spindump_connection_report_rtt_histogram(spindump_connections_rtt(connection->leftRTT), file);
   spindump_strlcpy(rttbuf2,
                    spindump_rtt_tostring(avg),
                    sizeof(rttbuf2));
   fprintf(file,"  last right RTT:          %38s\n", rttbuf1);
   fprintf(file,"  moving avg right RTT:    %38s\n", rttbuf2);
-  spindump_connection_report_rtt_histogram(&connection->rightRTT, file);
+  spindump_connection_report_rtt_histogram(spindump_connections_rtt(connection->rightRTT), file);
 }
 
 //
@@ -693,7 +693,7 @@ spindump_connection_addresses(struct spindump_connection* connection,
   // Reserve buffer space, check there's enough space to print
   //
   
-  static char buf[200];
+  static _Thread_local char buf[200];
   memset(buf,0,sizeof(buf));
   if (maxlen <= 2) {
     buf[0] = 0;
@@ -1166,16 +1166,16 @@ spindump_connection_report_brief_notefieldval(struct spindump_connection* connec
     // Report spin status
     //
     
-    if (connection->u.quic.spinFromPeer1to2.totalSpins == 0 &&
-        connection->u.quic.spinFromPeer2to1.totalSpins == 0) {
+    if (connection->u.quic.trackers->spinFromPeer1to2.totalSpins == 0 &&
+        connection->u.quic.trackers->spinFromPeer2to1.totalSpins == 0) {
       spindump_deepdeepdebugf("report_brief_notefieldval point 5");
       spindump_connection_addtobuf(buf,bufsiz,"no spin","",1);
-    } else if (connection->u.quic.spinFromPeer1to2.totalSpins != 0 &&
-               connection->u.quic.spinFromPeer2to1.totalSpins == 0) {
+    } else if (connection->u.quic.trackers->spinFromPeer1to2.totalSpins != 0 &&
+               connection->u.quic.trackers->spinFromPeer2to1.totalSpins == 0) {
       spindump_deepdeepdebugf("report_brief_notefieldval point 6");
       spindump_connection_addtobuf(buf,bufsiz,"no R-spin","",1);
-    } else if (connection->u.quic.spinFromPeer1to2.totalSpins == 0 &&
-               connection->u.quic.spinFromPeer2to1.totalSpins != 0) {
+    } else if (connection->u.quic.trackers->spinFromPeer1to2.totalSpins == 0 &&
+               connection->u.quic.trackers->spinFromPeer2to1.totalSpins != 0) {
       spindump_deepdeepdebugf("report_brief_notefieldval point 7");
       spindump_connection_addtobuf(buf,bufsiz,"no I-spin","",1);
     } else {
@@ -1190,9 +1190,9 @@ spindump_connection_report_brief_notefieldval(struct spindump_connection* connec
   // 
   
   if (connection->type == spindump_connection_transport_dns) {
-    if (connection->u.dns.lastQueriedName[0] != 0) {
+    if (connection->u.dns.trackers->lastQueriedName[0] != 0) {
       spindump_deepdeepdebugf("report_brief_notefieldval point 9");
-      spindump_connection_addtobuf(buf,bufsiz,"Q ",connection->u.dns.lastQueriedName,1);
+      spindump_connection_addtobuf(buf,bufsiz,"Q ",connection->u.dns.trackers->lastQueriedName,1);
     }
   }
   
@@ -1251,14 +1251,14 @@ spindump_connection_report_brief(struct spindump_connection* connection,
   unsigned long filt;
   if (avg) {
     unsigned long devLeft;
-    unsigned long avgLeft = spindump_rtt_calculateLastMovingAvgRTT(&connection->leftRTT,0,0,&devLeft,&filt);
+    unsigned long avgLeft = spindump_rtt_calculateLastMovingAvgRTT(spindump_connections_rtt(connection->leftRTT),0,0,&devLeft,&filt);
     spindump_strlcpy(rttbuf1,spindump_rtt_tostring(avgLeft),sizeof(rttbuf1));
     unsigned long devRight;
-    unsigned long avgRight = spindump_rtt_calculateLastMovingAvgRTT(&connection->rightRTT,0,0,&devRight,&filt);
+    unsigned long avgRight = spindump_rtt_calculateLastMovingAvgRTT(spindump_connections_rtt(connection->rightRTT),0,0,&devRight,&filt);
     spindump_strlcpy(rttbuf2,spindump_rtt_tostring(avgRight),sizeof(rttbuf2));
   } else {
-    spindump_strlcpy(rttbuf1,spindump_rtt_tostring(connection->leftRTT.lastRTT),sizeof(rttbuf1));
-    spindump_strlcpy(rttbuf2,spindump_rtt_tostring(connection->rightRTT.lastRTT),sizeof(rttbuf2));
+    spindump_strlcpy(rttbuf1,spindump_rtt_tostring(spindump_connections_rtt(connection->leftRTT)->lastRTT),sizeof(rttbuf1));
+    spindump_strlcpy(rttbuf2,spindump_rtt_tostring(spindump_connections_rtt(connection->rightRTT)->lastRTT),sizeof(rttbuf2));
   }
   spindump_deepdeepdebugf("report_brief point 3");
   unsigned int addrsiz = spindump_connection_report_brief_variablesize(linelen);
@@ -1294,13 +1294,19 @@ spindump_connection_report_brief(struct spindump_connection* connection,
 void
 spindump_connection_periodicreport(struct spindump_connection* connection,
                                    struct spindump_connectionstable* table,
-                                   const struct timeval* now,
+                                   const spindump_time* now,
                                    struct spindump_analyze* analyzer) {
   spindump_deepdeepdebugf("spindump_connection_periodicreport period %u in progress %u connection id %u (%s)",
                           table->periodicReportPeriod,
                           table->performingPeriodicReport,
                           connection->id,
                           connection->tags.string);
+
+  //
+  // Aggregates that are updated elsewhere are reported there
+  //
+
+  if (table->aggregateUpdateHandler != 0 && spindump_connections_isaggregate(connection)) return;
   spindump_analyze_process_handlers(analyzer,
                                     spindump_analyze_event_periodic,
                                     now,
@@ -1308,10 +1314,24 @@ spindump_connection_periodicreport(struct spindump_connection* connection,
                                     0,
                                     0,
                                     connection);
+
+  //
+  // The RTT quantiles and histograms in the next report cover only
+  // the measurements made after this report. Aggregates merged to a
+  // coordinator keep their measurements until they are merged.
+  //
+
+  if (table->mergedAggregates && spindump_connections_isaggregate(connection)) return;
+  if (connection->leftRTT != 0) spindump_rtt_newinterval(connection->leftRTT);
+  if (connection->rightRTT != 0) spindump_rtt_newinterval(connection->rightRTT);
+  if (connection->initToRespFullRTT != 0) spindump_rtt_newinterval(connection->initToRespFullRTT);
+  if (connection->respToInitFullRTT != 0) spindump_rtt_newinterval(connection->respToInitFullRTT);
 }
 
 //
-// Print an RTT histogram to the given file
+// Print an RTT histogram to the given file, as a bar with the
+// measurements in the ranges of 100us-1ms, 1-10ms, 10-100ms,
+// 100ms-1s, and 1-10s, each range divided in ten
 //
 
 static void
@@ -1319,18 +1339,34 @@ spindump_connection_report_rtt_histogram(struct spindump_rtt* rtt,
                                          FILE* file)
 {
   const char *marker[] = { "_", "\u2591", "\u2592", "\u2593", "\u2588" };
+  unsigned long cells[5][10];
   unsigned long max = 0;
   unsigned long sum = 0;
   char buff[256+1];
   memset(buff, 0, sizeof(buff) * sizeof(char));
-
-  //Search for the max number of RTT samples in an interval
+  memset(cells, 0, sizeof(cells));
+  
+  //Collect the histogram bins to the cells by the lowest value in each bin
+  //Search for the max number of RTT samples in a cell
   //Calculate the total number of RTT samples (sum)
+  const struct spindump_rtt_histogram* histogram = &rtt->histogram;
+  for (unsigned int k = 0; histogram->bins != 0 && k < histogram->nBins; ++k) {
+    if (histogram->bins[k] == 0) continue;
+    unsigned long long value = spindump_rtt_histogram_binvalue(histogram->precision,k);
+    unsigned long long decade = 100;
+    int i = 0;
+    while (i < 4 && value >= decade * 10) {
+      decade *= 10;
+      i++;
+    }
+    if (value >= decade * 10) continue;
+    cells[i][value / decade] += histogram->bins[k];
+  }
   for (int i = 0; i < 5; ++i)
     for (int j = 0; j < 10; ++j) {
-      sum += rtt->rttHisto[i][j];
-      if (rtt->rttHisto[i][j] > max)
-        max = rtt->rttHisto[i][j];
+      sum += cells[i][j];
+      if (cells[i][j] > max)
+        max = cells[i][j];
     }
 
   if(sum < 10) //min 10 samples to plot histogram
@@ -1338,12 +1374,12 @@ spindump_connection_report_rtt_histogram(struct spindump_rtt* rtt,
 
   for (int i = 0; i < 5; ++i) {
     for (int j = 0; j < 10; ++j) {
-      if (rtt->rttHisto[i][j] == 0) {
+      if (cells[i][j] == 0) {
         strcat(buff, marker[0]);
         continue;
       }
 
-      double ratio = (double) rtt->rttHisto[i][j] / (double) max;
+      double ratio = (double) cells[i][j] / (double) max;
       if (ratio < 0.25)
         strcat(buff, marker[1]);
       else if (ratio < 0.5)
@@ -1363,32 +1399,24 @@ spindump_connection_report_rtt_histogram(struct spindump_rtt* rtt,
   spindump_connection_report_rtt_histogram_json(rtt,file);
 }
 
+//
+// Print the non-empty bins of an RTT histogram to the given file, in
+// the same sparse JSON form as in periodic events
+//
+
 static void
 spindump_connection_report_rtt_histogram_json(struct spindump_rtt* rtt,
                                               FILE* file)
 {
-  /*unsigned int max = rtt->rttHisto[0][0];
-  //Search for the max RTT
-  for (int i = 0; i < 5; ++i)
-    for (int j = 0; j < 10; ++j)
-    if (rtt->rttHisto[i][j] > max)
-      max = rtt->rttHisto[i][j];
-  if(max == 0)
-    return;*/
-
-  char* ident="  ";
-  fprintf(file,"%s[\n",ident);
-
-  for (int i = 0; i < 5; ++i) {
-    if (i>0) fprintf(file,",\n");
-    fprintf(file,"%s  [",ident);
-    for (int j = 0; j < 10; ++j) {
-      if (j>0) fprintf(file,",");
-      fprintf(file,"%lu",rtt->rttHisto[i][j]);
-    }
-    fprintf(file,"]");
+  const struct spindump_rtt_histogram* histogram = &rtt->histogram;
+  unsigned int n = 0;
+  
+  fprintf(file,"  { \"Hist_precision\": %u, \"Hist\": [", histogram->precision);
+  for (unsigned int i = 0; histogram->bins != 0 && i < histogram->nBins; i++) {
+    if (histogram->bins[i] == 0) continue;
+    fprintf(file,"%s[%u,%u]", n > 0 ? "," : "", i, histogram->bins[i]);
+    n++;
   }
-  fprintf(file,"\n%s]\n",ident);
-
+  fprintf(file,"] }\n");
 }
 
@@ -32,6 +32,7 @@
 #include "spindump_spin_structs.h"
 #include "spindump_connections.h"
 #include "spindump_table.h"
+#include "spindump_table_index.h"
 #include "spindump_stats.h"
 #include "spindump_analyze_quic_parser.h"
 #include "spindump_analyze_quic_parser_util.h"
@@ -45,6 +46,26 @@ static int
 spindump_connections_match(struct spindump_connection* connection,
                            struct spindump_connection_searchcriteria* criteria,
                            int* fromResponder);
+static int
+spindump_connections_search_canuseindex(struct spindump_connection_searchcriteria* criteria);
+static struct spindump_connection*
+spindump_connections_search_index(struct spindump_connection_searchcriteria* criteria,
+                                  struct spindump_connectionstable* table,
+                                  int* fromResponder);
+static int
+spindump_connections_search_canusecidindex(struct spindump_connection_searchcriteria* criteria);
+static void
+spindump_connections_search_cidbucket(struct spindump_connection_searchcriteria* criteria,
+                                      struct spindump_connectionstable* table,
+                                      unsigned int side,
+                                      const unsigned char* id,
+                                      unsigned int length,
+                                      struct spindump_connection** found,
+                                      int* fromResponder);
+static struct spindump_connection*
+spindump_connections_search_cidindex(struct spindump_connection_searchcriteria* criteria,
+                                     struct spindump_connectionstable* table,
+                                     int* fromResponder);
 
 //
 // Actual code --------------------------------------------------------------------------------
@@ -466,6 +487,194 @@ spindump_connections_match(struct spindump_connection* connection,
   return(1);
 }
 
+//
+// Can the search criteria be satisfied by looking at the table index
+// only? This is the case when the criteria determine the connection
+// type and both addresses and ports, and the type is one that is kept
+// in the index.
+//
+
+static int
+spindump_connections_search_canuseindex(struct spindump_connection_searchcriteria* criteria) {
+  return(criteria->matchType &&
+         spindump_connectionstable_index_isindexed(criteria->type) &&
+         (criteria->matchAddresses == spindump_connection_searchcriteria_srcdst_both ||
+          criteria->matchAddresses == spindump_connection_searchcriteria_srcdst_both_allowreverse) &&
+         (criteria->matchPorts == spindump_connection_searchcriteria_srcdst_both ||
+          criteria->matchPorts == spindump_connection_searchcriteria_srcdst_both_allowreverse));
+}
+
+//
+// Search for a connection using the table index. Only the connections
+// in the bucket that corresponds to the addresses and ports need to be
+// compared against the criteria.
+//
+// If several connections match, the one earliest in the table is
+// returned, as would be the case with a search through the whole
+// table.
+//
+
+static struct spindump_connection*
+spindump_connections_search_index(struct spindump_connection_searchcriteria* criteria,
+                                  struct spindump_connectionstable* table,
+                                  int* fromResponder) {
+  uint32_t hash = spindump_connectionstable_index_hash(criteria->type,
+                                                       &criteria->side1address,
+                                                       &criteria->side2address,
+                                                       criteria->side1port,
+                                                       criteria->side2port);
+  struct spindump_connection* found = 0;
+  for (struct spindump_connection* connection = spindump_connectionstable_index_bucket(table,hash);
+       connection != 0;
+       connection = connection->indexNext) {
+    
+    if (connection->indexHash != hash) continue;
+    if (found != 0 && connection->tableIndex > found->tableIndex) continue;
+    spindump_deepdeepdebugf("index search compares to connection %u", connection->id);
+    
+    int candidateFromResponder = 0;
+    if (spindump_connections_match(connection,criteria,&candidateFromResponder)) {
+      found = connection;
+      *fromResponder = candidateFromResponder;
+    }
+    
+  }
+
+  if (found != 0) {
+    spindump_debugf("found an existing %s connection %u",
+                    spindump_connection_type_to_string(found->type),
+                    found->id);
+  }
+  
+  return(found);
+}
+
+//
+// Can the search criteria be satisfied by looking at the QUIC
+// connection ID indexes? This is the case for QUIC searches that
+// involve connection IDs, either full or partial ones.
+//
+
+static int
+spindump_connections_search_canusecidindex(struct spindump_connection_searchcriteria* criteria) {
+  return(criteria->matchType &&
+         criteria->type == spindump_connection_transport_quic &&
+         (criteria->matchQuicCids == spindump_connection_searchcriteria_srcdst_sourceonly ||
+          criteria->matchQuicCids == spindump_connection_searchcriteria_srcdst_destinationonly ||
+          criteria->matchQuicCids == spindump_connection_searchcriteria_srcdst_both ||
+          criteria->matchQuicCids == spindump_connection_searchcriteria_srcdst_both_allowreverse ||
+          criteria->matchPartialDestinationCid ||
+          criteria->matchPartialSourceCid));
+}
+
+//
+// Compare the connections in one connection ID index bucket against
+// the criteria. Only connections whose indexed connection ID has the
+// given length and bytes are considered. If a matching connection is
+// found earlier in the table than *found, *found and *fromResponder
+// are updated.
+//
+
+static void
+spindump_connections_search_cidbucket(struct spindump_connection_searchcriteria* criteria,
+                                      struct spindump_connectionstable* table,
+                                      unsigned int side,
+                                      const unsigned char* id,
+                                      unsigned int length,
+                                      struct spindump_connection** found,
+                                      int* fromResponder) {
+  uint32_t hash = spindump_connectionstable_cidindex_hash(id,length);
+  for (struct spindump_connection* connection = spindump_connectionstable_cidindex_bucket(table,side,hash);
+       connection != 0;
+       connection = connection->cidIndexNext[side]) {
+    
+    if (connection->cidIndexHash[side] != hash) continue;
+    if (connection->cidIndexLength[side] != spindump_min(length,spindump_connectionstable_cidindex_maxlen)) continue;
+    if (*found != 0 && connection->tableIndex > (*found)->tableIndex) continue;
+    spindump_deepdeepdebugf("cid index search compares to connection %u", connection->id);
+    int candidateFromResponder = 0;
+    if (spindump_connections_match(connection,criteria,&candidateFromResponder)) {
+      *found = connection;
+      *fromResponder = candidateFromResponder;
+    }
+    
+  }
+}
+
+//
+// Search for a QUIC connection using the connection ID indexes. Full
+// connection IDs need one probe per possible direction. A partial
+// connection ID (from a short header packet, where the length is not
+// known) needs one probe per connection ID length in use, looking at
+// the corresponding prefix of the given bytes.
+//
+// As with the 5-tuple index, the connection earliest in the table is
+// returned if several match.
+//
+
+static struct spindump_connection*
+spindump_connections_search_cidindex(struct spindump_connection_searchcriteria* criteria,
+                                     struct spindump_connectionstable* table,
+                                     int* fromResponder) {
+  struct spindump_connection* found = 0;
+  const unsigned int peer1 = spindump_connectionstable_cidindex_peer1;
+  const unsigned int peer2 = spindump_connectionstable_cidindex_peer2;
+  
+  switch (criteria->matchQuicCids) {
+    
+  case spindump_connection_searchcriteria_srcdst_sourceonly:
+    spindump_connections_search_cidbucket(criteria,table,peer1,
+                                          criteria->side1connectionId.id,
+                                          criteria->side1connectionId.len,
+                                          &found,fromResponder);
+    break;
+    
+  case spindump_connection_searchcriteria_srcdst_destinationonly:
+  case spindump_connection_searchcriteria_srcdst_both:
+    spindump_connections_search_cidbucket(criteria,table,peer2,
+                                          criteria->side2connectionId.id,
+                                          criteria->side2connectionId.len,
+                                          &found,fromResponder);
+    break;
+    
+  case spindump_connection_searchcriteria_srcdst_both_allowreverse:
+    spindump_connections_search_cidbucket(criteria,table,peer2,
+                                          criteria->side2connectionId.id,
+                                          criteria->side2connectionId.len,
+                                          &found,fromResponder);
+    spindump_connections_search_cidbucket(criteria,table,peer2,
+                                          criteria->side1connectionId.id,
+                                          criteria->side1connectionId.len,
+                                          &found,fromResponder);
+    break;
+    
+  default:
+    {
+      unsigned int side = criteria->matchPartialDestinationCid ? peer2 : peer1;
+      const unsigned char* partial =
+        criteria->matchPartialDestinationCid ? criteria->partialDestinationCid : criteria->partialSourceCid;
+      spindump_assert(partial != 0);
+      for (unsigned int length = 0; length <= spindump_connectionstable_cidindex_maxlen; length++) {
+        if (!spindump_connectionstable_cidindex_haslength(table,side,length)) continue;
+        spindump_connections_search_cidbucket(criteria,table,side,
+                                              partial,
+                                              length,
+                                              &found,fromResponder);
+      }
+    }
+    break;
+    
+  }
+  
+  if (found != 0) {
+    spindump_debugf("found an existing %s connection %u",
+                    spindump_connection_type_to_string(found->type),
+                    found->id);
+  }
+  
+  return(found);
+}
+
 //
 // Search for a connection based on given criteria
 //
@@ -484,7 +693,19 @@ spindump_connections_search(struct spindump_connection_searchcriteria* criteria,
   spindump_assert(fromResponder != 0);
   
   //
-  // Search the table
+  // Use the index when we can
+  // 
+
+  if (spindump_connections_search_canuseindex(criteria)) {
+    return(spindump_connections_search_index(criteria,table,fromResponder));
+  }
+  
+  if (spindump_connections_search_canusecidindex(criteria)) {
+    return(spindump_connections_search_cidindex(criteria,table,fromResponder));
+  }
+  
+  //
+  // Otherwise, search the table
   // 
 
   for (unsigned i = 0; i < table->nConnections; i++) {
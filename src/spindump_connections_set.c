@@ -22,9 +22,11 @@
 
 #include <stdlib.h>
 #include <string.h>
+#include <stdint.h>
 #include "spindump_util.h"
 #include "spindump_connections_set.h"
 #include "spindump_connections.h"
+#include "spindump_pool.h"
 
 //
 // Function prototypes ------------------------------------------------------------------------
@@ -114,6 +116,13 @@ spindump_connections_set_unlinkfromset(struct spindump_connection* connection,
 // An initialized connection set must be de-initialized before
 // deallocation with the spindump_connections_set_uninitialize
 // function.
+//
+// The connections of a set are kept in an array in the order they
+// were added. Removal leaves an empty position behind, so that the
+// positions of the other connections do not change; the empty
+// positions are reclaimed when the array would otherwise need to
+// grow. Larger sets also have a hash table from connections to their
+// positions, making membership tests and removal take constant time.
 // 
 
 void
@@ -134,17 +143,179 @@ spindump_connections_set_uninitialize(struct spindump_connection_set* set,
   spindump_assert(set != 0);
   if (set->maxNConnections > 0) {
     unsigned int i;
-    for (i = 0; i < set->nConnections; i++) {
+    for (i = 0; i < set->nSlots; i++) {
       struct spindump_connection* connection = set->set[i];
-      spindump_assert(connection != 0);
-      spindump_connections_set_unlinkfromset(connection,owner);
+      if (connection != 0) {
+        spindump_connections_set_unlinkfromset(connection,owner);
+      }
     }
     spindump_deepdebugf("freeting the set table in spindump_connections_set_uninitialize");
-    spindump_free(set->set);
+    spindump_pool_free(set->set,set->maxNConnections * sizeof(struct spindump_connection*));
+  }
+  if (set->buckets != 0) {
+    spindump_pool_free(set->buckets,set->nBuckets * sizeof(unsigned int));
   }
   memset(set,0,sizeof(*set));
 }
 
+//
+// Calculate the hash of a connection, for the hash table of a set
+//
+
+static unsigned int
+spindump_connections_set_hash(const struct spindump_connection* connection) {
+  uintptr_t value = (uintptr_t)connection;
+  return((unsigned int)((value >> 4) * 2654435761U));
+}
+
+//
+// Find the hash table bucket that points to a given connection in a
+// set that has a hash table. Return set->nBuckets if the connection
+// is not in the set.
+//
+
+static unsigned int
+spindump_connections_set_findbucket(const struct spindump_connection_set* set,
+                                    const struct spindump_connection* connection) {
+  spindump_assert(set->nBuckets > 0);
+  unsigned int mask = set->nBuckets - 1;
+  for (unsigned int bucket = spindump_connections_set_hash(connection) & mask;
+       set->buckets[bucket] != 0;
+       bucket = (bucket + 1) & mask) {
+    if (set->set[set->buckets[bucket] - 1] == connection) return(bucket);
+  }
+  return(set->nBuckets);
+}
+
+//
+// Find the position of a connection in a set. Return set->nSlots if
+// the connection is not in the set.
+//
+
+static unsigned int
+spindump_connections_set_find(const struct spindump_connection_set* set,
+                              const struct spindump_connection* connection) {
+  if (set->nBuckets > 0) {
+    unsigned int bucket = spindump_connections_set_findbucket(set,connection);
+    if (bucket == set->nBuckets) return(set->nSlots);
+    return(set->buckets[bucket] - 1);
+  }
+  for (unsigned int i = 0; i < set->nSlots; i++) {
+    if (set->set[i] == connection) return(i);
+  }
+  return(set->nSlots);
+}
+
+//
+// Add the connection at a given position to the hash table of a set
+//
+
+static void
+spindump_connections_set_hashposition(struct spindump_connection_set* set,
+                                      unsigned int position) {
+  unsigned int mask = set->nBuckets - 1;
+  unsigned int bucket = spindump_connections_set_hash(set->set[position]) & mask;
+  while (set->buckets[bucket] != 0) bucket = (bucket + 1) & mask;
+  set->buckets[bucket] = position + 1;
+}
+
+//
+// Empty a bucket in the hash table of a set. Any entries after it in
+// the same run of occupied buckets are moved back if they otherwise
+// could no longer be found.
+//
+
+static void
+spindump_connections_set_unhashbucket(struct spindump_connection_set* set,
+                                      unsigned int bucket) {
+  unsigned int mask = set->nBuckets - 1;
+  unsigned int hole = bucket;
+  unsigned int i = bucket;
+  for (;;) {
+    i = (i + 1) & mask;
+    if (set->buckets[i] == 0) break;
+    unsigned int home = spindump_connections_set_hash(set->set[set->buckets[i] - 1]) & mask;
+    if (((i - home) & mask) >= ((i - hole) & mask)) {
+      set->buckets[hole] = set->buckets[i];
+      hole = i;
+    }
+  }
+  set->buckets[hole] = 0;
+}
+
+//
+// Move the connections of a set to a new array of a given size,
+// dropping the positions of removed connections but otherwise
+// keeping the order, and rebuild the hash table. Return 1 upon
+// success, 0 if memory could not be allocated, in which case the set
+// is left as it was.
+//
+
+static int
+spindump_connections_set_reallocate(struct spindump_connection_set* set,
+                                    unsigned int newN) {
+  
+  spindump_assert(newN >= set->nConnections);
+  
+  //
+  // Allocate the new array and, for larger sets, a hash table sized
+  // to stay at most half full
+  //
+  
+  unsigned int size = newN * sizeof(struct spindump_connection*);
+  struct spindump_connection** newSet = (struct spindump_connection**)spindump_pool_allocate(size);
+  if (newSet == 0) {
+    spindump_errorf("cannot allocate connection set of %u bytes", size);
+    return(0);
+  }
+  unsigned int nBuckets = 0;
+  unsigned int* buckets = 0;
+  if (newN > spindump_connection_set_hashthreshold) {
+    nBuckets = 1;
+    while (nBuckets < 2 * newN) nBuckets *= 2;
+    unsigned int bucketsSize = nBuckets * sizeof(unsigned int);
+    buckets = (unsigned int*)spindump_pool_allocate(bucketsSize);
+    if (buckets == 0) {
+      spindump_errorf("cannot allocate connection set hash of %u bytes", bucketsSize);
+      spindump_pool_free(newSet,size);
+      return(0);
+    }
+    memset(buckets,0,bucketsSize);
+  }
+  
+  //
+  // Move the connections
+  //
+  
+  memset(newSet,0,size);
+  unsigned int n = 0;
+  for (unsigned int i = 0; i < set->nSlots; i++) {
+    if (set->set[i] != 0) newSet[n++] = set->set[i];
+  }
+  spindump_assert(n == set->nConnections);
+  if (set->set != 0) {
+    spindump_pool_free(set->set,set->maxNConnections * sizeof(struct spindump_connection*));
+  }
+  set->set = newSet;
+  set->nSlots = n;
+  set->maxNConnections = newN;
+
+  //
+  // Rebuild the hash table
+  //
+  
+  if (set->buckets != 0) {
+    spindump_pool_free(set->buckets,set->nBuckets * sizeof(unsigned int));
+  }
+  set->buckets = buckets;
+  set->nBuckets = nBuckets;
+  for (unsigned int i = 0; nBuckets > 0 && i < set->nSlots; i++) {
+    spindump_connections_set_hashposition(set,i);
+  }
+  
+  return(1);
+}
+
 //
 // Determine if a given connection is in the set.
 // 
@@ -154,17 +325,15 @@ spindump_connections_set_inset(struct spindump_connection_set* set,
                                struct spindump_connection* connection) {
   spindump_assert(set != 0);
   spindump_assert(connection != 0);
-  for (unsigned int i = 0; i < set->nConnections; i++) {
-    if (set->set[i] == connection) return(1);
-  }
-  return(0);
+  return(spindump_connections_set_find(set,connection) < set->nSlots);
 }
 
 //
-// Add a new connection to the set.
+// Add a new connection to the set. Return 1 upon success, 0 if
+// memory could not be allocated.
 // 
 
-void
+int
 spindump_connections_set_add(struct spindump_connection_set* set,
                              struct spindump_connection* connection) {
   spindump_assert(set != 0);
@@ -179,45 +348,32 @@ spindump_connections_set_add(struct spindump_connection_set* set,
     
     spindump_assert(set->nConnections == 0);
     spindump_assert(set->maxNConnections == 0);
-    unsigned int defaultN = 10;
-    unsigned int size = defaultN * sizeof(struct spindump_connection*);
-    set->set = (struct spindump_connection**)spindump_malloc(size);
-    if (set->set == 0) {
-      spindump_fatalf("cannot allocate connection set of %u bytes", size);
-    }
-    memset(set->set,0,size);
-    set->maxNConnections = defaultN;
-    set->nConnections = 1;
-    set->set[0] = connection;
-
-  } else if (set->nConnections < set->maxNConnections) {
+    if (!spindump_connections_set_reallocate(set,spindump_connection_set_defaultsize)) return(0);
 
-    //
-    // Still space at the table, just add to it
-    // 
-    
-    set->set[set->nConnections++] = connection;
-    
-  } else {
+  } else if (set->nSlots == set->maxNConnections) {
     
     //
-    // Expand the already existing table
+    // No space at the end of the table. Reclaim the positions of
+    // removed connections if they are at least half of the table,
+    // otherwise expand the table.
     // 
     
     spindump_assert(set->maxNConnections > 0);
-    unsigned int newN = 2 * set->maxNConnections;
-    unsigned int size = newN * sizeof(struct spindump_connection*);
-    struct spindump_connection** newSet = (struct spindump_connection**)spindump_malloc(size);
-    if (newSet == 0) {
-      spindump_fatalf("cannot expand connection set to %u bytes", size);
-    }
-    memset(newSet,0,size);
-    memcpy(newSet,set->set,set->maxNConnections * sizeof(struct spindump_connection*));
-    set->maxNConnections = newN;
-    set->set = newSet;
-    set->set[set->nConnections++] = connection;
+    unsigned int newN = set->nConnections <= set->maxNConnections / 2 ? set->maxNConnections : 2 * set->maxNConnections;
+    if (!spindump_connections_set_reallocate(set,newN)) return(0);
     
   }
+
+  //
+  // There is now space at the end of the table, add there
+  // 
+  
+  spindump_assert(set->nSlots < set->maxNConnections);
+  set->set[set->nSlots] = connection;
+  if (set->nBuckets > 0) spindump_connections_set_hashposition(set,set->nSlots);
+  set->nSlots++;
+  set->nConnections++;
+  return(1);
 }
 
 //
@@ -232,35 +388,40 @@ spindump_connections_set_remove(struct spindump_connection_set* set,
   spindump_assert(set->nConnections > 0);
   spindump_assert(set->maxNConnections > 0);
   spindump_assert(set->set != 0);
-  
-  for (unsigned int i = 0; i < set->nConnections; i++) {
-    if (set->set[i] == connection) {
-      for (unsigned int j = i+1; j < set->nConnections; j++) {
-        set->set[j-1] = set->set[j];
-      }
-      set->set[set->nConnections -1] = 0;
-      set->nConnections--;
-      return;
-    }
+
+  unsigned int position;
+  if (set->nBuckets > 0) {
+    unsigned int bucket = spindump_connections_set_findbucket(set,connection);
+    position = bucket < set->nBuckets ? set->buckets[bucket] - 1 : set->nSlots;
+    if (bucket < set->nBuckets) spindump_connections_set_unhashbucket(set,bucket);
+  } else {
+    position = spindump_connections_set_find(set,connection);
   }
   
-  spindump_errorf("attempted to remove connection %u from a set that does not include that connection",
-                  connection->id);
+  if (position == set->nSlots) {
+    spindump_errorf("attempted to remove connection %u from a set that does not include that connection",
+                    connection->id);
+    return;
+  }
+
+  set->set[position] = 0;
+  set->nConnections--;
+  while (set->nSlots > 0 && set->set[set->nSlots - 1] == 0) set->nSlots--;
 }
 
 //
 // Return a string listing (some maximum number of) connection IDs of
 // the connections in the set.
 // 
-// Note: This function is not thread safe.
+// Note: the returned buffer is per thread.
 //
 
 const char*
 spindump_connections_set_listids(struct spindump_connection_set* set) {
-  static char buf[200];
+  static _Thread_local char buf[200];
   int seenone = 0;
   memset(buf,0,sizeof(buf));
-  for (unsigned int i = 0; i < set->nConnections; i++) {
+  for (unsigned int i = 0; i < set->nSlots; i++) {
     struct spindump_connection* connection = set->set[i];
     if (connection != 0) {
       snprintf(buf+strlen(buf),
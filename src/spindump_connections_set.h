@@ -47,7 +47,7 @@ spindump_connections_set_uninitialize(struct spindump_connection_set* set,
 int
 spindump_connections_set_inset(struct spindump_connection_set* set,
                                struct spindump_connection* connection);
-void
+int
 spindump_connections_set_add(struct spindump_connection_set* set,
                              struct spindump_connection* connection);
 void
@@ -44,11 +44,19 @@ spindump_connection_set_iterator_initialize(struct spindump_connection_set* set,
 //
 // Is the iterator at end? If yes, return 1, otherwise 0.
 //
+// The positions of connections that have been removed from the set
+// are skipped. Removing connections from the set while iterating over
+// it is allowed, but adding connections may reorganize the set.
+//
 
 int
 spindump_connection_set_iterator_end(struct spindump_connection_set_iterator* iter) {
   spindump_assert(iter != 0);
-  return(iter->iteration >= iter->set->nConnections);
+  while (iter->iteration < iter->set->nSlots &&
+         iter->set->set[iter->iteration] == 0) {
+    iter->iteration++;
+  }
+  return(iter->iteration >= iter->set->nSlots);
 }
 
 //
@@ -46,6 +46,8 @@
 //
 
 #define spindump_connection_max_handlers 32         // should be equivalent to spindump_analyze_max_handlers
+#define spindump_connection_set_defaultsize 10      // initial allocation for the connections of a set
+#define spindump_connection_set_hashthreshold 16    // sets allocated larger than this get a hash of their members
 
 //
 // Data structures ----------------------------------------------------------------------------
@@ -87,15 +89,73 @@ struct spindump_quic_connectionid {
 };
 
 struct spindump_connection_set {
-  unsigned int nConnections;
-  unsigned int maxNConnections;
-  struct spindump_connection** set;
+  unsigned int nConnections;                        // number of connections in the set
+  unsigned int nSlots;                              // used positions in set, including those of removed connections
+  unsigned int maxNConnections;                     // allocated size of set
+  unsigned int nBuckets;                            // size of buckets, a power of two, or 0 for small sets
+  struct spindump_connection** set;                 // connections in the order they were added, 0 if removed
+  unsigned int* buckets;                            // positions in set plus one, by connection hash; 0 if empty
 };
 
 typedef uint64_t spindump_handler_mask;
 
+struct spindump_connectionstable_aggregatenode;
+
+//
+// The protocol-specific trackers of a connection are kept in separately
+// allocated blocks, so that the connection object itself stays small
+// and only the protocols that need them pay for them. The pointers to
+// these blocks are in the protocol-specific part of the connection.
+//
+
+struct spindump_connection_tcptrackers {
+  struct spindump_seqtracker side1Seqs;             // when did we see sequence numbers from side1?
+  struct spindump_seqtracker side2Seqs;             // when did we see sequence numbers from side2?
+};
+
+struct spindump_connection_sctptrackers {
+  struct spindump_tsntracker side1Seqs;             // when did we see sequence numbers from side1?
+  struct spindump_tsntracker side2Seqs;             // when did we see sequence numbers from side2?
+  uint8_t side1HbCnt;                               // Number of HBs inflight seen from side 1
+  spindump_time side1hbTime;                        // the time of the last HB seen from side 1
+  uint8_t side2HbCnt;                               // Number of HBs inflight seen from side 2
+  spindump_time side2hbTime;                        // the time of the last HB seen from side 2
+};
+
+struct spindump_connection_midtrackers {
+  struct spindump_messageidtracker side1MIDs;       // when did we see message IDs from side1?
+  struct spindump_messageidtracker side2MIDs;       // when did we see message IDs from side2?
+  char lastQueriedName[40];                         // the latest name that was queried (DNS only)
+};
+
+struct spindump_connection_quictrackers {
+  struct spindump_spintracker spinFromPeer1to2;     // tracking spin bit flips from side 1 to 2
+  struct spindump_spintracker spinFromPeer2to1;     // tracking spin bit flips from side 2 to 1
+  struct spindump_delaybittracker delaybitFromPeer1to2; // tracking delay bit from side 1 to 2
+  struct spindump_delaybittracker delaybitFromPeer2to1; // tracking delay bit from side 2 to 1
+  struct spindump_rtloss1tracker rtloss1FromPeer1to2;   // tracking round trip loss (1 bit) from side 1 to 2
+  struct spindump_rtloss1tracker rtloss1FromPeer2to1;   // tracking round trip loss (1 bit) from side 2 to 1
+  struct spindump_rtloss2tracker rtloss2FromPeer1to2;   // tracking round trip loss (2 bits) from side 1 to 2
+  struct spindump_rtloss2tracker rtloss2FromPeer2to1;   // tracking round trip loss (2 bits) from side 2 to 1
+  struct spindump_qrlosstracker qrFromPeer1to2;         // tracking T.Italia QR from side 1 to 2
+  struct spindump_qrlosstracker qrFromPeer2to1;         // tracking T.Italia QR from side 2 to 1
+  struct spindump_qllosstracker qlFromPeer1to2;         // tracking Orange QL from side 1 to 2
+  struct spindump_qllosstracker qlFromPeer2to1;         // tracking Orange QL from side 2 to 1
+  struct spindump_qrloss qrLossesFrom1to2;              // T.Italia QR lossrate measured from side 1 to 2
+  struct spindump_qrloss qrLossesFrom2to1;              // T.Italia QR lossrate measured from side 2 to 1
+};
+
+struct spindump_connection_icmptrackers {
+  struct spindump_messageidtracker side1Seqs;       // latest sequence numbers from side1
+};
+
 struct spindump_connection {
 
+  //
+  // The fields needed on every packet and when looking up connections
+  // come first, to keep them on as few cache lines as possible
+  //
+  
   unsigned int id;                                  // sequentially allocated descriptive id for the connection
   enum spindump_connection_type type;               // the type of the connection (tcp, icmp, aggregate, etc)
   enum spindump_connection_state state;             // current state (establishing/established/etc)
@@ -104,33 +164,27 @@ struct spindump_connection {
   int deleted;                                      // is the connection closed/deleted (but not yet removed)?
   spindump_tags tags;                               // tags associated with the connection
   uint8_t padding[4];                               // unused padding to align the next field properly
-  struct timeval creationTime;                      // when did we see the first packet?
-  struct timeval latestPacketFromSide1;             // when did we see the last packet from side 1?
-  struct timeval latestPacketFromSide2;             // when did we see the last packet from side 2?
+  spindump_time creationTime;                       // when did we see the first packet?
+  spindump_time latestPacketFromSide1;              // when did we see the last packet from side 1?
+  spindump_time latestPacketFromSide2;              // when did we see the last packet from side 2?
   spindump_counter_64bit packetsFromSide1;          // packet counts
   spindump_counter_64bit packetsFromSide2;          // packet counts
   struct spindump_bandwidth bytesFromSide1;         // byte counts
   struct spindump_bandwidth bytesFromSide2;         // byte counts
-  spindump_counter_64bit ect0FromInitiator;         // ECN ECT(0) counts
-  spindump_counter_64bit ect0FromResponder;         // ECN ECT(0) counts
-  spindump_counter_64bit ect1FromInitiator;         // ECN ECT(1) counts
-  spindump_counter_64bit ect1FromResponder;         // ECN ECT(1) counts
-  spindump_counter_64bit ceFromInitiator;           // ECN CE counts
-  spindump_counter_64bit ceFromResponder;           // ECN CE counts
-  struct spindump_rtloss rtLossesFrom1to2;          // RT lossrate measured in UL
-  struct spindump_rtloss rtLossesFrom2to1;          // RT lossrate measured in DL
-  float qLossesFrom1to2;                            // Square bit lossrate measured in UL
-  float qLossesFrom2to1;                            // Square bit lossrate measured in DL
-  float rLossesFrom1to2;                            // Retransmit bit lossrate measured in UL
-  float rLossesFrom2to1;                            // Retransmit bit lossrate measured in DL
-  struct spindump_rtt leftRTT;                      // left-side (side 1) RTT calculations
-  struct spindump_rtt rightRTT;                     // right-side (side 2) RTT calculations
-  struct spindump_rtt respToInitFullRTT;            // end-to-end RTT calculations observed from responder
-  struct spindump_rtt initToRespFullRTT;            // end-to-end RTT calculations observed from initiator
-  struct spindump_connection_set aggregates;        // aggregate connection sets where this connection belongs to
-  spindump_handler_mask handlerMask;                // handler bit mask for connection-specific handlers
-  void* handlerConnectionDatas
-        [spindump_connection_max_handlers];         // data store for registered handlers to add data to a connection
+  unsigned int tableIndex;                          // position of this connection in the connections table
+  uint32_t indexHash;                               // hash of the addresses and ports, for the table index
+  struct spindump_connection* indexNext;            // next connection in the same table index bucket
+  uint32_t cidIndexHash[2];                         // hashes of the QUIC peer1 and peer2 CIDs, for the CID index
+  unsigned int cidIndexLength[2];                   // lengths of the CIDs, as they were when indexed
+  struct spindump_connection* cidIndexNext[2];      // next connections in the same CID index buckets
+  unsigned long timerDeadline;                      // second at which the timeouts need to be checked next
+  struct spindump_connection* timerNext;            // next connection in the same timer slot
+  struct spindump_connection** timerPprev;          // pointer to this connection in the timer slot, 0 if not scheduled
+  struct spindump_connection* evictionPrev;         // less recently active connection in the same eviction list
+  struct spindump_connection* evictionNext;         // more recently active connection in the same eviction list
+  unsigned int evictionList;                        // eviction list this connection is in, or none
+  uint8_t padding2[4];                              // unused padding to align the next field properly
+  unsigned long long creationOrder;                 // orders connections by when they were created
 
   union {
 
@@ -139,11 +193,10 @@ struct spindump_connection {
       spindump_address side2peerAddress;            // destination address for the initial packet
       spindump_port side1peerPort;                  // source port for the initial packe
       spindump_port side2peerPort;                  // destination port for the initial packet
-      uint8_t padding[4];                           // unused
-      struct spindump_seqtracker side1Seqs;         // when did we see sequence numbers from side1?
-      struct spindump_seqtracker side2Seqs;         // when did we see sequence numbers from side2?
       int finFromSide1;                             // seen a FIN from side1?
       int finFromSide2;                             // seen a FIN from side2?
+      uint8_t padding[4];                           // unused padding to align the next field properly
+      struct spindump_connection_tcptrackers* trackers; // sequence number trackers
     } tcp;
 
     struct {
@@ -153,13 +206,8 @@ struct spindump_connection {
       spindump_port side2peerPort;                  // destination port for the initial packet
       uint32_t side1Vtag;                           // Vtag of association for side1
       uint32_t side2Vtag;                           // Vtag of association for side2
-      struct spindump_tsntracker side1Seqs;         // when did we see sequence numbers from side1?
-      struct spindump_tsntracker side2Seqs;         // when did we see sequence numbers from side2?
-      //uint8_t padding[4];                           // unused
-      uint8_t side1HbCnt;                           // Number of HBs inflight seen from side 1
-      struct timeval side1hbTime;                   // the time of the last HB seen from side 1
-      uint8_t side2HbCnt;                           // Number of HBs inflight seen from side 2
-      struct timeval side2hbTime;                   // the time of the last HB seen from side 2
+      uint8_t padding[4];                           // unused padding to align the next field properly
+      struct spindump_connection_sctptrackers* trackers; // TSN and heartbeat trackers
     } sctp;
 
     struct {
@@ -176,9 +224,7 @@ struct spindump_connection {
       spindump_port side1peerPort;                  // source port for the initial packe
       spindump_port side2peerPort;                  // destination port for the initial packet
       uint8_t padding[4];                           // unused padding to align the next field properly
-      struct spindump_messageidtracker side1MIDs;   // when did we see message IDs from side1?
-      struct spindump_messageidtracker side2MIDs;   // when did we see message IDs from side2?
-      char lastQueriedName[40];                     // the latest name that was queried
+      struct spindump_connection_midtrackers* trackers; // message ID trackers and the latest queried name
     } dns;
 
     struct {
@@ -189,8 +235,7 @@ struct spindump_connection {
       int dtls;                                     // is DTLS/TLS in use?
       spindump_tls_version dtlsVersion;             // which DTLS/TLS version is in use
       uint8_t padding[6];                           // unused padding to align the next field properly
-      struct spindump_messageidtracker side1MIDs;   // when did we see message IDs from side1?
-      struct spindump_messageidtracker side2MIDs;   // when did we see message IDs from side2?
+      struct spindump_connection_midtrackers* trackers; // message ID trackers
     } coap;
 
     struct {
@@ -205,25 +250,11 @@ struct spindump_connection {
       spindump_port side1peerPort;                  // source port for the initial packe
       spindump_port side2peerPort;                  // destination port for the initial packet
       int attempted0Rtt;                            // whether connection attempted to use 0-RTT setup
-      struct timeval side1initialPacket;            // the time of the initial packet from side 1
-      struct timeval side2initialResponsePacket;    // the time of the initial response packet from side 2
+      spindump_time side1initialPacket;             // the time of the initial packet from side 1
+      spindump_time side2initialResponsePacket;     // the time of the initial response packet from side 2
       unsigned long initialRightRTT;                // initial packet exchange RTT in us
       unsigned long initialLeftRTT;                 // initial packet exchange RTT in us (only available sometimes)
-      struct spindump_spintracker spinFromPeer1to2; // tracking spin bit flips from side 1 to 2
-      struct spindump_spintracker spinFromPeer2to1; // tracking spin bit flips from side 2 to 1
-      struct spindump_delaybittracker delaybitFromPeer1to2; // tracking delay bit from side 1 to 2
-      struct spindump_delaybittracker delaybitFromPeer2to1; // tracking delay bit from side 2 to 1
-      struct spindump_rtloss1tracker rtloss1FromPeer1to2;   // tracking round trip loss (1 bit) from side 1 to 2
-      struct spindump_rtloss1tracker rtloss1FromPeer2to1;   // tracking round trip loss (1 bit) from side 2 to 1
-      struct spindump_rtloss2tracker rtloss2FromPeer1to2;   // tracking round trip loss (2 bits) from side 1 to 2
-      struct spindump_rtloss2tracker rtloss2FromPeer2to1;   // tracking round trip loss (2 bits) from side 2 to 1
-      struct spindump_qrlosstracker qrFromPeer1to2;         // tracking T.Italia QR from side 1 to 2
-      struct spindump_qrlosstracker qrFromPeer2to1;         // tracking T.Italia QR from side 2 to 1
-      struct spindump_qllosstracker qlFromPeer1to2;         // tracking Orange QL from side 1 to 2
-      struct spindump_qllosstracker qlFromPeer2to1;         // tracking Orange QL from side 2 to 1
-      struct spindump_qrloss qrLossesFrom1to2;        // T.Italia QR lossrate measured from side 1 to 2
-      struct spindump_qrloss qrLossesFrom2to1;        // T.Italia QR lossrate measured from side 2 to 1
-      //uint8_t padding2[8];                          // unused padding to align the structure size properly
+      struct spindump_connection_quictrackers* trackers; // spin bit, delay bit, and loss trackers
     } quic;
 
     struct {
@@ -232,8 +263,8 @@ struct spindump_connection {
       uint8_t side1peerType;                        // the ICMP type used in a request from side 1
       uint8_t padding1;                             // unused padding to align the next field properly
       uint16_t side1peerId;                         // the ICMP id used in a request from side 1
-      struct spindump_messageidtracker side1Seqs;   // latest sequence numbers from side1
-      uint8_t padding2[2];                          // unused padding to align the size of the structure properly
+      uint8_t padding2[4];                          // unused padding to align the next field properly
+      struct spindump_connection_icmptrackers* trackers; // sequence number tracker
     } icmp;
 
     struct {
@@ -274,6 +305,35 @@ struct spindump_connection {
 
   } u;
 
+  //
+  // The rest of the fields are not needed when looking up connections
+  //
+  
+  spindump_counter_64bit ect0FromInitiator;         // ECN ECT(0) counts
+  spindump_counter_64bit ect0FromResponder;         // ECN ECT(0) counts
+  spindump_counter_64bit ect1FromInitiator;         // ECN ECT(1) counts
+  spindump_counter_64bit ect1FromResponder;         // ECN ECT(1) counts
+  spindump_counter_64bit ceFromInitiator;           // ECN CE counts
+  spindump_counter_64bit ceFromResponder;           // ECN CE counts
+  struct spindump_rtloss rtLossesFrom1to2;          // RT lossrate measured in UL
+  struct spindump_rtloss rtLossesFrom2to1;          // RT lossrate measured in DL
+  float qLossesFrom1to2;                            // Square bit lossrate measured in UL
+  float qLossesFrom2to1;                            // Square bit lossrate measured in DL
+  float rLossesFrom1to2;                            // Retransmit bit lossrate measured in UL
+  float rLossesFrom2to1;                            // Retransmit bit lossrate measured in DL
+  struct spindump_rtt* leftRTT;                     // left-side (side 1) RTT calculations, 0 if none yet
+  struct spindump_rtt* rightRTT;                    // right-side (side 2) RTT calculations, 0 if none yet
+  struct spindump_rtt* respToInitFullRTT;           // end-to-end RTT calculations observed from responder, 0 if none yet
+  struct spindump_rtt* initToRespFullRTT;           // end-to-end RTT calculations observed from initiator, 0 if none yet
+  struct spindump_connection_set aggregates;        // aggregate connection sets where this connection belongs to
+  struct spindump_connectionstable_aggregatenode*
+    aggregateIndexNode[2];                          // for aggregates, the prefixes under which this one is indexed
+  struct spindump_connection* aggregateIndexNext[2];// next aggregates indexed under the same prefixes
+  const char* deleteReason;                         // reason reported when the connection is deleted, set only for evictions
+  spindump_handler_mask handlerMask;                // handler bit mask for connection-specific handlers
+  void* handlerConnectionDatas
+        [spindump_connection_max_handlers];         // data store for registered handlers to add data to a connection
+
 };
 
 struct spindump_connection_network {
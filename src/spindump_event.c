@@ -94,6 +94,26 @@ spindump_event_initialize(enum spindump_event_type eventType,
                           bytesFromSide1, bytesFromSide2);
 }
 
+//
+// Create a capture event, reporting how many frames were captured
+// and dropped during the period that ended at the given time. A
+// capture event is not about any connection, so the connection
+// fields of the event are left empty.
+//
+
+void
+spindump_event_initialize_capture(unsigned long long timestamp,
+                                  const struct spindump_event_capture* capture,
+                                  struct spindump_event* event) {
+  spindump_assert(capture != 0);
+  spindump_assert(event != 0);
+  memset(event,0,sizeof(*event));
+  event->eventType = spindump_event_type_capture;
+  event->timestamp = timestamp;
+  spindump_tags_initialize(&event->tags);
+  event->u.capture = *capture;
+}
+
 //
 // Get the name of the event as a string. The returned string is
 // static, ie. should not be deallocated by the caller.
@@ -119,6 +139,7 @@ spindump_event_type_tostring(enum spindump_event_type type) {
   case spindump_event_type_qrloss_measurement: return("qrloss");
   case spindump_event_type_qlloss_measurement: return("qlloss");
   case spindump_event_type_packet: return("packet");
+  case spindump_event_type_capture: return("capture");
   default:
     spindump_errorf("invalid event type");
     return("UNKNOWN");
@@ -146,6 +167,20 @@ spindump_event_equal(const struct spindump_event* event1,
 
   if (event1->eventType != event2->eventType) return(0);
 
+  //
+  // Capture events are not about any connection, compare only the
+  // capture counts
+  //
+
+  if (event1->eventType == spindump_event_type_capture) {
+    if (event1->timestamp != event2->timestamp) return(0);
+    if (event1->u.capture.receivedFrames != event2->u.capture.receivedFrames) return(0);
+    if (event1->u.capture.kernelDrops != event2->u.capture.kernelDrops) return(0);
+    if (event1->u.capture.interfaceDrops != event2->u.capture.interfaceDrops) return(0);
+    if (event1->u.capture.ringOverflows != event2->u.capture.ringOverflows) return(0);
+    return(1);
+  }
+
   //
   // Compare common fields
   //
@@ -175,6 +210,7 @@ spindump_event_equal(const struct spindump_event* event1,
   case spindump_event_type_change_connection:
     break;
   case spindump_event_type_connection_delete:
+    if (strcmp(event1->u.connectionDelete.reason,event2->u.connectionDelete.reason) != 0) return(0);
     break;
   case spindump_event_type_new_rtt_measurement:
     if (event1->u.newRttMeasurement.measurement != event2->u.newRttMeasurement.measurement) return(0);
@@ -183,11 +219,43 @@ spindump_event_equal(const struct spindump_event* event1,
     if (event1->u.newRttMeasurement.avgRtt != event2->u.newRttMeasurement.avgRtt) return(0);
     if (event1->u.newRttMeasurement.devRtt != event2->u.newRttMeasurement.devRtt) return(0);
     if (event1->u.newRttMeasurement.filtAvgRtt != event2->u.newRttMeasurement.filtAvgRtt) return(0);
+    if (event1->u.newRttMeasurement.rttNsec != event2->u.newRttMeasurement.rttNsec) return(0);
+    if (event1->u.newRttMeasurement.p50Rtt != event2->u.newRttMeasurement.p50Rtt) return(0);
+    if (event1->u.newRttMeasurement.p95Rtt != event2->u.newRttMeasurement.p95Rtt) return(0);
+    if (event1->u.newRttMeasurement.p99Rtt != event2->u.newRttMeasurement.p99Rtt) return(0);
     break;
   case spindump_event_type_periodic:
     if (event1->u.periodic.rttRight != event2->u.periodic.rttRight) return(0);
     if (event1->u.periodic.avgRttRight != event2->u.periodic.avgRttRight) return(0);
     if (event1->u.periodic.devRttRight != event2->u.periodic.devRttRight) return(0);
+    if (event1->u.periodic.p50RttRight != event2->u.periodic.p50RttRight) return(0);
+    if (event1->u.periodic.p95RttRight != event2->u.periodic.p95RttRight) return(0);
+    if (event1->u.periodic.p99RttRight != event2->u.periodic.p99RttRight) return(0);
+    if (event1->u.periodic.histRight.nBins != event2->u.periodic.histRight.nBins) return(0);
+    if (event1->u.periodic.histRight.nBins > 0) {
+      if (event1->u.periodic.histRight.precision != event2->u.periodic.histRight.precision) return(0);
+      for (unsigned int i = 0; i < event1->u.periodic.histRight.nBins; i++) {
+        if (event1->u.periodic.histRight.indexes[i] != event2->u.periodic.histRight.indexes[i]) return(0);
+        if (event1->u.periodic.histRight.counts[i] != event2->u.periodic.histRight.counts[i]) return(0);
+      }
+    }
+    if (event1->u.periodic.sketchRight.nBins != event2->u.periodic.sketchRight.nBins) return(0);
+    if (event1->u.periodic.sketchRight.zeroCount != event2->u.periodic.sketchRight.zeroCount) return(0);
+    if (event1->u.periodic.sketchRight.nBins > 0) {
+      if (event1->u.periodic.sketchRight.offset != event2->u.periodic.sketchRight.offset) return(0);
+      for (unsigned int i = 0; i < event1->u.periodic.sketchRight.nBins; i++) {
+        if (event1->u.periodic.sketchRight.indexes[i] != event2->u.periodic.sketchRight.indexes[i]) return(0);
+        if (event1->u.periodic.sketchRight.counts[i] != event2->u.periodic.sketchRight.counts[i]) return(0);
+      }
+    }
+    for (unsigned int i = 0; i < spindump_bandwidth_series_nresolutions; i++) {
+      if (event1->u.periodic.bwSeries1.peak[i] != event2->u.periodic.bwSeries1.peak[i]) return(0);
+      if (event1->u.periodic.bwSeries2.peak[i] != event2->u.periodic.bwSeries2.peak[i]) return(0);
+    }
+    if (event1->u.periodic.bwSeries1.mean != event2->u.periodic.bwSeries1.mean) return(0);
+    if (event1->u.periodic.bwSeries2.mean != event2->u.periodic.bwSeries2.mean) return(0);
+    if (event1->u.periodic.bwSeries1.burstiness != event2->u.periodic.bwSeries1.burstiness) return(0);
+    if (event1->u.periodic.bwSeries2.burstiness != event2->u.periodic.bwSeries2.burstiness) return(0);
     break;
   case spindump_event_type_spin_flip:
     if (event1->u.spinFlip.direction != event2->u.spinFlip.direction) return(0);
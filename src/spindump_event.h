@@ -44,7 +44,8 @@ enum spindump_event_type {
   spindump_event_type_qrloss_measurement = 9,
   spindump_event_type_qlloss_measurement = 10,
   spindump_event_type_periodic = 11,
-  spindump_event_type_packet = 12
+  spindump_event_type_packet = 12,
+  spindump_event_type_capture = 13
 };
 
 enum spindump_direction {
@@ -61,6 +62,10 @@ enum spindump_measurement_type {
 // Parameters ---------------------------------------------------------------------------------
 //
 
+#define spindump_event_reason_maxlength    30
+#define spindump_event_histogram_maxbins   64
+#define spindump_event_sketch_maxbins      64
+
 //
 // Data structures ----------------------------------------------------------------------------
 //
@@ -74,7 +79,7 @@ struct spindump_event_change_connection {
 };
 
 struct spindump_event_connection_delete {
-  unsigned char padding;
+  char reason[spindump_event_reason_maxlength];     // why the connection was deleted, if known
 };
 
 struct spindump_event_packet {
@@ -90,12 +95,40 @@ struct spindump_event_new_rtt_measurement {
   unsigned long devRtt;
   unsigned long filtAvgRtt;
   unsigned long minRtt;
+  unsigned long long rttNsec;                   // rtt in nanoseconds, 0 if not reported
+  unsigned long p50Rtt;                         // median rtt, 0 if not reported
+  unsigned long p95Rtt;                         // 95th percentile rtt, 0 if not reported
+  unsigned long p99Rtt;                         // 99th percentile rtt, 0 if not reported
+};
+
+struct spindump_event_histogram {
+  unsigned int precision;                       // precision of the bins, see spindump_rtt_histogram
+  unsigned int nBins;                           // number of non-empty bins, 0 if not reported
+  unsigned int indexes[spindump_event_histogram_maxbins]; // indexes of the bins, in increasing order
+  unsigned int counts[spindump_event_histogram_maxbins];  // number of measurements in each bin
+};
+
+struct spindump_event_sketch {
+  unsigned int offset;                          // index of the first bin, see spindump_rtt_sketch
+  unsigned int zeroCount;                       // number of zero measurements
+  unsigned int nBins;                           // number of non-empty bins, 0 if not reported
+  unsigned int indexes[spindump_event_sketch_maxbins]; // indexes of the bins relative to offset, in increasing order
+  unsigned int counts[spindump_event_sketch_maxbins];  // number of measurements in each bin
 };
 
 struct spindump_event_periodic {
   unsigned long rttRight;
   unsigned long avgRttRight;
   unsigned long devRttRight;
+  unsigned long p50RttRight;                    // median right rtt, 0 if not reported
+  unsigned long p95RttRight;                    // 95th percentile right rtt, 0 if not reported
+  unsigned long p99RttRight;                    // 99th percentile right rtt, 0 if not reported
+  struct spindump_event_histogram histRight;    // histogram of right rtts in the period
+  struct spindump_event_sketch sketchRight;     // quantile sketch of right rtts in the period
+  struct spindump_bandwidth_series_stats
+    bwSeries1;                                  // rates from side 1 in the last minute, 0s if not reported
+  struct spindump_bandwidth_series_stats
+    bwSeries2;                                  // rates from side 2 in the last minute, 0s if not reported
 };
 
 struct spindump_event_spin_flip {
@@ -137,6 +170,13 @@ struct spindump_event_qlloss_measurement {
   char lLoss[spindump_lossfield_charlength];
 };
 
+struct spindump_event_capture {
+  spindump_counter_64bit receivedFrames;        // frames captured during the period
+  spindump_counter_64bit kernelDrops;           // frames dropped by the kernel during the period
+  spindump_counter_64bit interfaceDrops;        // frames dropped by the interface during the period
+  spindump_counter_64bit ringOverflows;         // frames dropped from the capture ring during the period
+};
+
 #define spindump_event_sessionidmaxlength  (18*2*2+1)
 #define spindump_event_notes_maxlength     30
 
@@ -170,6 +210,7 @@ struct spindump_event {
     struct spindump_event_rtloss_measurement rtlossMeasurement;
     struct spindump_event_qrloss_measurement qrlossMeasurement;
     struct spindump_event_qlloss_measurement qllossMeasurement;
+    struct spindump_event_capture capture;
   } u;
 };
 
@@ -195,6 +236,10 @@ spindump_event_initialize(enum spindump_event_type eventType,
                           const spindump_tags* tags,
                           const char* notes,
                           struct spindump_event* event);
+void
+spindump_event_initialize_capture(unsigned long long timestamp,
+                                  const struct spindump_event_capture* capture,
+                                  struct spindump_event* event);
 int
 spindump_event_equal(const struct spindump_event* event1,
                      const struct spindump_event* event2);
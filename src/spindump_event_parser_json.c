@@ -49,6 +49,16 @@ static int
 spindump_event_parser_json_parse_aux_periodic(const struct spindump_json_value* json,
                                               struct spindump_event* event);
 static int
+spindump_event_parser_json_parse_aux_histogram(const struct spindump_json_value* json,
+                                               struct spindump_event_histogram* histogram);
+static int
+spindump_event_parser_json_parse_aux_sketch(const struct spindump_json_value* json,
+                                            struct spindump_event_sketch* sketch);
+static int
+spindump_event_parser_json_parse_aux_bandwidthseries(const struct spindump_json_value* json,
+                                                     unsigned int side,
+                                                     struct spindump_bandwidth_series_stats* stats);
+static int
 spindump_event_parser_json_parse_aux_spin_flip(const struct spindump_json_value* json,
                                                struct spindump_event* event);
 static int
@@ -69,6 +79,9 @@ spindump_event_parser_json_parse_aux_qlloss_measurement(const struct spindump_js
 static int
 spindump_event_parser_json_parse_aux_packet(const struct spindump_json_value* json,
                                             struct spindump_event* event);
+static int
+spindump_event_parser_json_parse_aux_capture(const struct spindump_json_value* json,
+                                             struct spindump_event* event);
 static void
 spindump_event_parser_json_textparse_callback(const struct spindump_json_value* value,
                                               const struct spindump_json_schema* type,
@@ -193,6 +206,41 @@ static struct spindump_json_schema fieldceschema = {
   .callback = 0
 };
 
+static struct spindump_json_schema fieldcountschema = {
+  .type = spindump_json_schema_type_integer,
+  .callback = 0
+};
+
+static struct spindump_json_schema fieldhistbinschema = {
+  .type = spindump_json_schema_type_array,
+  .callback = 0,
+  .u = {
+    .array = {
+      .schema = &fieldcountschema
+    }
+  }
+};
+
+static struct spindump_json_schema fieldhistschema = {
+  .type = spindump_json_schema_type_array,
+  .callback = 0,
+  .u = {
+    .array = {
+      .schema = &fieldhistbinschema
+    }
+  }
+};
+
+static struct spindump_json_schema fieldpeaksschema = {
+  .type = spindump_json_schema_type_array,
+  .callback = 0,
+  .u = {
+    .array = {
+      .schema = &fieldcountschema
+    }
+  }
+};
+
 static struct spindump_json_schema fieldlossschema = {
   .type = spindump_json_schema_type_string,
   .callback = 0
@@ -223,18 +271,22 @@ static struct spindump_json_schema recordschema = {
   .callback = 0,
   .u = {
     .record = {
-      .nFields = 43,
+      .nFields = 77,
       .fields = {
         { .required = 1, .name = "Event", .schema = &fieldeventschema },
-        { .required = 1, .name = "Type", .schema = &fieldtypeschema },
-        { .required = 1, .name = "State", .schema = &fieldstateschema },
-        { .required = 1, .name = "Addrs", .schema = &fieldaddrsschema },
-        { .required = 1, .name = "Session", .schema = &fieldsessionschema },
+        { .required = 0, .name = "Type", .schema = &fieldtypeschema },
+        { .required = 0, .name = "State", .schema = &fieldstateschema },
+        { .required = 0, .name = "Addrs", .schema = &fieldaddrsschema },
+        { .required = 0, .name = "Session", .schema = &fieldsessionschema },
         { .required = 1, .name = "Ts", .schema = &fieldtsschema },
         { .required = 0, .name = "Left_rtt", .schema = &fieldrttschema },
         { .required = 0, .name = "Right_rtt", .schema = &fieldrttschema },
         { .required = 0, .name = "Full_rtt_initiator", .schema = &fieldrttschema },
         { .required = 0, .name = "Full_rtt_responder", .schema = &fieldrttschema },
+        { .required = 0, .name = "Left_rtt_ns", .schema = &fieldrttschema },
+        { .required = 0, .name = "Right_rtt_ns", .schema = &fieldrttschema },
+        { .required = 0, .name = "Full_rtt_initiator_ns", .schema = &fieldrttschema },
+        { .required = 0, .name = "Full_rtt_responder_ns", .schema = &fieldrttschema },
         { .required = 0, .name = "Avg_left_rtt", .schema = &fieldrttschema },
         { .required = 0, .name = "Avg_right_rtt", .schema = &fieldrttschema },
         { .required = 0, .name = "Avg_full_rtt_initiator", .schema = &fieldrttschema },
@@ -251,13 +303,36 @@ static struct spindump_json_schema recordschema = {
         { .required = 0, .name = "Min_right_rtt", .schema = &fieldrttschema },
         { .required = 0, .name = "Min_full_rtt_initiator", .schema = &fieldrttschema },
         { .required = 0, .name = "Min_full_rtt_responder", .schema = &fieldrttschema },
+        { .required = 0, .name = "P50_left_rtt", .schema = &fieldrttschema },
+        { .required = 0, .name = "P50_right_rtt", .schema = &fieldrttschema },
+        { .required = 0, .name = "P50_full_rtt_initiator", .schema = &fieldrttschema },
+        { .required = 0, .name = "P50_full_rtt_responder", .schema = &fieldrttschema },
+        { .required = 0, .name = "P95_left_rtt", .schema = &fieldrttschema },
+        { .required = 0, .name = "P95_right_rtt", .schema = &fieldrttschema },
+        { .required = 0, .name = "P95_full_rtt_initiator", .schema = &fieldrttschema },
+        { .required = 0, .name = "P95_full_rtt_responder", .schema = &fieldrttschema },
+        { .required = 0, .name = "P99_left_rtt", .schema = &fieldrttschema },
+        { .required = 0, .name = "P99_right_rtt", .schema = &fieldrttschema },
+        { .required = 0, .name = "P99_full_rtt_initiator", .schema = &fieldrttschema },
+        { .required = 0, .name = "P99_full_rtt_responder", .schema = &fieldrttschema },
+        { .required = 0, .name = "Hist_precision", .schema = &fieldcountschema },
+        { .required = 0, .name = "Hist_right_rtt", .schema = &fieldhistschema },
+        { .required = 0, .name = "Sketch_offset", .schema = &fieldcountschema },
+        { .required = 0, .name = "Sketch_zero", .schema = &fieldcountschema },
+        { .required = 0, .name = "Sketch_right_rtt", .schema = &fieldhistschema },
+        { .required = 0, .name = "Peak_bw1", .schema = &fieldpeaksschema },
+        { .required = 0, .name = "Peak_bw2", .schema = &fieldpeaksschema },
+        { .required = 0, .name = "Mean_bw1", .schema = &fieldcountschema },
+        { .required = 0, .name = "Mean_bw2", .schema = &fieldcountschema },
+        { .required = 0, .name = "Burst1", .schema = &fieldcountschema },
+        { .required = 0, .name = "Burst2", .schema = &fieldcountschema },
         { .required = 0, .name = "Value", .schema = &fieldvalueschema },
         { .required = 0, .name = "Transition", .schema = &fieldtransitionschema },
         { .required = 0, .name = "Who", .schema = &fieldwhoschema },
-        { .required = 1, .name = "Packets1", .schema = &fieldpackets1schema },
-        { .required = 1, .name = "Packets2", .schema = &fieldpackets2schema },
-        { .required = 1, .name = "Bytes1", .schema = &fieldbytes1schema },
-        { .required = 1, .name = "Bytes2", .schema = &fieldbytes2schema },
+        { .required = 0, .name = "Packets1", .schema = &fieldpackets1schema },
+        { .required = 0, .name = "Packets2", .schema = &fieldpackets2schema },
+        { .required = 0, .name = "Bytes1", .schema = &fieldbytes1schema },
+        { .required = 0, .name = "Bytes2", .schema = &fieldbytes2schema },
         { .required = 0, .name = "Bandwidth1", .schema = &fieldbandwidth1schema },
         { .required = 0, .name = "Bandwidth2", .schema = &fieldbandwidth2schema },
         { .required = 0, .name = "Ecn0", .schema = &fieldecn0schema },
@@ -270,7 +345,11 @@ static struct spindump_json_schema recordschema = {
         { .required = 0, .name = "Length", .schema = &fieldlengthschema },
         { .required = 0, .name = "Dir", .schema = &fielddirschema },
         { .required = 0, .name = "Tags", .schema = &fieldtagsschema },
-        { .required = 0, .name = "Notes", .schema = &fieldnotesschema }
+        { .required = 0, .name = "Notes", .schema = &fieldnotesschema },
+        { .required = 0, .name = "Received", .schema = &fieldcountschema },
+        { .required = 0, .name = "Kernel_drops", .schema = &fieldcountschema },
+        { .required = 0, .name = "Interface_drops", .schema = &fieldcountschema },
+        { .required = 0, .name = "Ring_overflows", .schema = &fieldcountschema }
       }
     }
   }
@@ -416,6 +495,31 @@ spindump_event_parser_json_parse(const struct spindump_json_value* json,
     spindump_errorf("Invalid event type %s", eventType);
     return(0);
   }
+  
+  //
+  // Capture events are not about any connection, and have only the
+  // capture counts
+  //
+
+  if (event->eventType == spindump_event_type_capture) {
+    return(spindump_event_parser_json_parse_aux_capture(json,event));
+  }
+
+  //
+  // Other events are about a connection, check that the connection
+  // fields are there
+  //
+  
+  static const char* connectionFields[] = {
+    "Type", "State", "Addrs", "Session", "Packets1", "Packets2", "Bytes1", "Bytes2"
+  };
+  for (unsigned int i = 0; i < sizeof(connectionFields) / sizeof(connectionFields[0]); i++) {
+    if (spindump_json_value_getfield(connectionFields[i],json) == 0) {
+      spindump_errorf("Missing field %s in a %s event", connectionFields[i], eventType);
+      return(0);
+    }
+  }
+  
   const char* connectionType = spindump_json_value_getstring(spindump_json_value_getrequiredfield("Type",json));
   if (!spindump_connection_string_to_connectiontype(connectionType,&event->connectionType)) {
     spindump_errorf("Invalid connection type %s", connectionType);
@@ -618,9 +722,14 @@ static int
 spindump_event_parser_json_parse_aux_connection_delete(const struct spindump_json_value* json,
                                                        struct spindump_event* event) {
   //
-  // This always succeeds
+  // The reason is optional, so this always succeeds
   //
   
+  const struct spindump_json_value* reason = spindump_json_value_getfield("Reason",json);
+  if (reason != 0) {
+    const char* reasonString = spindump_json_value_getstring(reason);
+    strncpy(event->u.connectionDelete.reason,reasonString,sizeof(event->u.connectionDelete.reason)-1);
+  }
   return(1);
 }
 
@@ -637,6 +746,10 @@ spindump_event_parser_json_parse_aux_new_rtt_measurement(const struct spindump_j
   const struct spindump_json_value* devfield = 0;
   const struct spindump_json_value* minfield = 0;
   const struct spindump_json_value* filtavgfield = 0;
+  const struct spindump_json_value* nsfield = 0;
+  const struct spindump_json_value* p50field = 0;
+  const struct spindump_json_value* p95field = 0;
+  const struct spindump_json_value* p99field = 0;
   if ((field = spindump_json_value_getfield("Left_rtt",json)) != 0) {
     event->u.newRttMeasurement.measurement = spindump_measurement_type_bidirectional;
     event->u.newRttMeasurement.direction = spindump_direction_frominitiator;
@@ -644,6 +757,10 @@ spindump_event_parser_json_parse_aux_new_rtt_measurement(const struct spindump_j
     devfield = spindump_json_value_getfield("Dev_left_rtt",json);
     minfield = spindump_json_value_getfield("Min_left_rtt",json);
     filtavgfield = spindump_json_value_getfield("Filt_avg_left_rtt",json);
+    nsfield = spindump_json_value_getfield("Left_rtt_ns",json);
+    p50field = spindump_json_value_getfield("P50_left_rtt",json);
+    p95field = spindump_json_value_getfield("P95_left_rtt",json);
+    p99field = spindump_json_value_getfield("P99_left_rtt",json);
   } else if ((field = spindump_json_value_getfield("Right_rtt",json)) != 0) {
     event->u.newRttMeasurement.measurement = spindump_measurement_type_bidirectional;
     event->u.newRttMeasurement.direction = spindump_direction_fromresponder;
@@ -651,6 +768,10 @@ spindump_event_parser_json_parse_aux_new_rtt_measurement(const struct spindump_j
     devfield = spindump_json_value_getfield("Dev_right_rtt",json);
     minfield = spindump_json_value_getfield("Min_right_rtt",json);
     filtavgfield = spindump_json_value_getfield("Filt_avg_right_rtt",json);
+    nsfield = spindump_json_value_getfield("Right_rtt_ns",json);
+    p50field = spindump_json_value_getfield("P50_right_rtt",json);
+    p95field = spindump_json_value_getfield("P95_right_rtt",json);
+    p99field = spindump_json_value_getfield("P99_right_rtt",json);
   } else if ((field = spindump_json_value_getfield("Full_rtt_initiator",json)) != 0) {
     event->u.newRttMeasurement.measurement = spindump_measurement_type_unidirectional;
     event->u.newRttMeasurement.direction = spindump_direction_frominitiator;
@@ -658,6 +779,10 @@ spindump_event_parser_json_parse_aux_new_rtt_measurement(const struct spindump_j
     devfield = spindump_json_value_getfield("Dev_full_rtt_initiator",json);
     minfield = spindump_json_value_getfield("Min_full_rtt_initiator",json);
     filtavgfield = spindump_json_value_getfield("Filt_avg_full_rtt_initiator",json);
+    nsfield = spindump_json_value_getfield("Full_rtt_initiator_ns",json);
+    p50field = spindump_json_value_getfield("P50_full_rtt_initiator",json);
+    p95field = spindump_json_value_getfield("P95_full_rtt_initiator",json);
+    p99field = spindump_json_value_getfield("P99_full_rtt_initiator",json);
   } else if ((field = spindump_json_value_getfield("Full_rtt_responder",json)) != 0) {
     event->u.newRttMeasurement.measurement = spindump_measurement_type_unidirectional;
     event->u.newRttMeasurement.direction = spindump_direction_fromresponder;
@@ -665,6 +790,10 @@ spindump_event_parser_json_parse_aux_new_rtt_measurement(const struct spindump_j
     devfield = spindump_json_value_getfield("Dev_full_rtt_responder",json);
     minfield = spindump_json_value_getfield("Min_full_rtt_responder",json);
     filtavgfield = spindump_json_value_getfield("Filt_avg_full_rtt_responder",json);
+    nsfield = spindump_json_value_getfield("Full_rtt_responder_ns",json);
+    p50field = spindump_json_value_getfield("P50_full_rtt_responder",json);
+    p95field = spindump_json_value_getfield("P95_full_rtt_responder",json);
+    p99field = spindump_json_value_getfield("P99_full_rtt_responder",json);
   } else {
     spindump_errorf("new RTT measurement event does not have the necessary JSON fields");
     return(0);
@@ -691,6 +820,10 @@ spindump_event_parser_json_parse_aux_new_rtt_measurement(const struct spindump_j
       (filtAvgValue = spindump_json_value_getinteger(filtavgfield)) > 0) {
     event->u.newRttMeasurement.filtAvgRtt = (unsigned long)filtAvgValue;
   }
+  event->u.newRttMeasurement.rttNsec = (nsfield != 0 ? spindump_json_value_getinteger(nsfield) : 0);
+  event->u.newRttMeasurement.p50Rtt = (p50field != 0 ? (unsigned long)spindump_json_value_getinteger(p50field) : 0);
+  event->u.newRttMeasurement.p95Rtt = (p95field != 0 ? (unsigned long)spindump_json_value_getinteger(p95field) : 0);
+  event->u.newRttMeasurement.p99Rtt = (p99field != 0 ? (unsigned long)spindump_json_value_getinteger(p99field) : 0);
   return(1);
 }
 
@@ -705,6 +838,10 @@ spindump_event_parser_json_parse_aux_periodic(const struct spindump_json_value*
   const struct spindump_json_value* field = 0;
   const struct spindump_json_value* avgfield = 0;
   const struct spindump_json_value* devfield = 0;
+  if (!spindump_event_parser_json_parse_aux_bandwidthseries(json,1,&event->u.periodic.bwSeries1) ||
+      !spindump_event_parser_json_parse_aux_bandwidthseries(json,2,&event->u.periodic.bwSeries2)) {
+    return(0);
+  }
   if ((field = spindump_json_value_getfield("Right_rtt",json)) != 0) {
     avgfield = spindump_json_value_getfield("Avg_right_rtt",json);
     devfield = spindump_json_value_getfield("Dev_right_rtt",json);
@@ -712,7 +849,8 @@ spindump_event_parser_json_parse_aux_periodic(const struct spindump_json_value*
     event->u.periodic.rttRight = spindump_rtt_infinite;
     event->u.periodic.avgRttRight = spindump_rtt_infinite;
     event->u.periodic.devRttRight = spindump_rtt_infinite;
-    return(1);
+    return(spindump_event_parser_json_parse_aux_histogram(json,&event->u.periodic.histRight) &&
+           spindump_event_parser_json_parse_aux_sketch(json,&event->u.periodic.sketchRight));
   }
   unsigned long long value = spindump_json_value_getinteger(field);
   unsigned long long avgValue;
@@ -726,6 +864,141 @@ spindump_event_parser_json_parse_aux_periodic(const struct spindump_json_value*
       (devValue = spindump_json_value_getinteger(devfield)) > 0) {
     event->u.periodic.devRttRight = (unsigned long)devValue;
   }
+  const struct spindump_json_value* p50field = spindump_json_value_getfield("P50_right_rtt",json);
+  const struct spindump_json_value* p95field = spindump_json_value_getfield("P95_right_rtt",json);
+  const struct spindump_json_value* p99field = spindump_json_value_getfield("P99_right_rtt",json);
+  event->u.periodic.p50RttRight = (p50field != 0 ? (unsigned long)spindump_json_value_getinteger(p50field) : 0);
+  event->u.periodic.p95RttRight = (p95field != 0 ? (unsigned long)spindump_json_value_getinteger(p95field) : 0);
+  event->u.periodic.p99RttRight = (p99field != 0 ? (unsigned long)spindump_json_value_getinteger(p99field) : 0);
+  return(spindump_event_parser_json_parse_aux_histogram(json,&event->u.periodic.histRight) &&
+         spindump_event_parser_json_parse_aux_sketch(json,&event->u.periodic.sketchRight));
+}
+
+//
+// Copy the optional sparse RTT histogram ("Hist_precision" and
+// "Hist_right_rtt") from a JSON event to the event struct. Return
+// value is 0 upon error, 1 upon success.
+//
+
+static int
+spindump_event_parser_json_parse_aux_histogram(const struct spindump_json_value* json,
+                                               struct spindump_event_histogram* histogram) {
+  const struct spindump_json_value* precisionField = spindump_json_value_getfield("Hist_precision",json);
+  const struct spindump_json_value* binsField = spindump_json_value_getfield("Hist_right_rtt",json);
+  histogram->precision = 0;
+  histogram->nBins = 0;
+  if (binsField == 0) return(1);
+  if (precisionField == 0) {
+    spindump_errorf("Missing field Hist_precision in a periodic event");
+    return(0);
+  }
+  unsigned long long precision = spindump_json_value_getinteger(precisionField);
+  if (precision > spindump_rtt_histogram_maxprecision) {
+    spindump_errorf("Invalid histogram precision %llu in a periodic event", precision);
+    return(0);
+  }
+  histogram->precision = (unsigned int)precision;
+  const struct spindump_json_value* bin;
+  for (unsigned int i = 0; (bin = spindump_json_value_getarrayelem(i,binsField)) != 0; i++) {
+    const struct spindump_json_value* indexElem = spindump_json_value_getarrayelem(0,bin);
+    const struct spindump_json_value* countElem = spindump_json_value_getarrayelem(1,bin);
+    if (indexElem == 0 || countElem == 0) {
+      spindump_errorf("Histogram bins in a periodic event need to be [index,count] pairs");
+      return(0);
+    }
+    if (histogram->nBins >= spindump_event_histogram_maxbins) {
+      spindump_errorf("Too many histogram bins in a periodic event (max %u)",
+                      spindump_event_histogram_maxbins);
+      return(0);
+    }
+    histogram->indexes[histogram->nBins] = (unsigned int)spindump_json_value_getinteger(indexElem);
+    histogram->counts[histogram->nBins] = (unsigned int)spindump_json_value_getinteger(countElem);
+    histogram->nBins++;
+  }
+  return(1);
+}
+
+//
+// Copy the optional sparse RTT quantile sketch ("Sketch_offset",
+// "Sketch_zero", and "Sketch_right_rtt") from a JSON event to the
+// event struct. Return value is 0 upon error, 1 upon success.
+//
+
+static int
+spindump_event_parser_json_parse_aux_sketch(const struct spindump_json_value* json,
+                                            struct spindump_event_sketch* sketch) {
+  const struct spindump_json_value* offsetField = spindump_json_value_getfield("Sketch_offset",json);
+  const struct spindump_json_value* zeroField = spindump_json_value_getfield("Sketch_zero",json);
+  const struct spindump_json_value* binsField = spindump_json_value_getfield("Sketch_right_rtt",json);
+  sketch->offset = 0;
+  sketch->zeroCount = 0;
+  sketch->nBins = 0;
+  if (binsField == 0) return(1);
+  if (offsetField == 0) {
+    spindump_errorf("Missing field Sketch_offset in a periodic event");
+    return(0);
+  }
+  unsigned long long offset = spindump_json_value_getinteger(offsetField);
+  if (offset >= spindump_rtt_sketch_maxindex) {
+    spindump_errorf("Invalid sketch offset %llu in a periodic event", offset);
+    return(0);
+  }
+  sketch->offset = (unsigned int)offset;
+  if (zeroField != 0) {
+    sketch->zeroCount = (unsigned int)spindump_json_value_getinteger(zeroField);
+  }
+  const struct spindump_json_value* bin;
+  for (unsigned int i = 0; (bin = spindump_json_value_getarrayelem(i,binsField)) != 0; i++) {
+    const struct spindump_json_value* indexElem = spindump_json_value_getarrayelem(0,bin);
+    const struct spindump_json_value* countElem = spindump_json_value_getarrayelem(1,bin);
+    if (indexElem == 0 || countElem == 0) {
+      spindump_errorf("Sketch bins in a periodic event need to be [index,count] pairs");
+      return(0);
+    }
+    if (sketch->nBins >= spindump_event_sketch_maxbins) {
+      spindump_errorf("Too many sketch bins in a periodic event (max %u)",
+                      spindump_event_sketch_maxbins);
+      return(0);
+    }
+    sketch->indexes[sketch->nBins] = (unsigned int)spindump_json_value_getinteger(indexElem);
+    sketch->counts[sketch->nBins] = (unsigned int)spindump_json_value_getinteger(countElem);
+    sketch->nBins++;
+  }
+  return(1);
+}
+
+//
+// Copy the optional bandwidth series rates ("Peak_bwN", "Mean_bwN",
+// and "BurstN") of the given side from a JSON event to the event
+// struct. Return value is 0 upon error, 1 upon success.
+//
+
+static int
+spindump_event_parser_json_parse_aux_bandwidthseries(const struct spindump_json_value* json,
+                                                     unsigned int side,
+                                                     struct spindump_bandwidth_series_stats* stats) {
+  char peakName[20];
+  char meanName[20];
+  char burstName[20];
+  snprintf(peakName,sizeof(peakName),"Peak_bw%u",side);
+  snprintf(meanName,sizeof(meanName),"Mean_bw%u",side);
+  snprintf(burstName,sizeof(burstName),"Burst%u",side);
+  memset(stats,0,sizeof(*stats));
+  const struct spindump_json_value* peakField = spindump_json_value_getfield(peakName,json);
+  if (peakField == 0) return(1);
+  for (unsigned int i = 0; i < spindump_bandwidth_series_nresolutions; i++) {
+    const struct spindump_json_value* peakElem = spindump_json_value_getarrayelem(i,peakField);
+    if (peakElem == 0) {
+      spindump_errorf("Field %s in a periodic event needs %u values",
+                      peakName, spindump_bandwidth_series_nresolutions);
+      return(0);
+    }
+    stats->peak[i] = spindump_json_value_getinteger(peakElem);
+  }
+  const struct spindump_json_value* meanField = spindump_json_value_getfield(meanName,json);
+  const struct spindump_json_value* burstField = spindump_json_value_getfield(burstName,json);
+  if (meanField != 0) stats->mean = spindump_json_value_getinteger(meanField);
+  if (burstField != 0) stats->burstiness = (unsigned int)spindump_json_value_getinteger(burstField);
   return(1);
 }
 
@@ -965,6 +1238,34 @@ spindump_event_parser_json_parse_aux_packet(const struct spindump_json_value* js
   return(1);
 }
 
+//
+// Copy fields from JSON event to the event struct, for events of the
+// type "capture". Return value is 0 upon error, 1 upon success.
+//
+
+static int
+spindump_event_parser_json_parse_aux_capture(const struct spindump_json_value* json,
+                                             struct spindump_event* event) {
+  const struct spindump_json_value* receivedField = spindump_json_value_getfield("Received",json);
+  const struct spindump_json_value* kernelDropsField = spindump_json_value_getfield("Kernel_drops",json);
+  const struct spindump_json_value* interfaceDropsField = spindump_json_value_getfield("Interface_drops",json);
+  const struct spindump_json_value* ringOverflowsField = spindump_json_value_getfield("Ring_overflows",json);
+  
+  if (receivedField == 0 || kernelDropsField == 0 || interfaceDropsField == 0 || ringOverflowsField == 0) {
+    spindump_errorf("capture event does not have the necessary JSON fields");
+    return(0);
+  }
+
+  struct spindump_event_capture capture;
+  capture.receivedFrames = spindump_json_value_getinteger(receivedField);
+  capture.kernelDrops = spindump_json_value_getinteger(kernelDropsField);
+  capture.interfaceDrops = spindump_json_value_getinteger(interfaceDropsField);
+  capture.ringOverflows = spindump_json_value_getinteger(ringOverflowsField);
+  unsigned long long ts = spindump_json_value_getinteger(spindump_json_value_getrequiredfield("Ts",json));
+  spindump_event_initialize_capture(ts,&capture,event);
+  return(1);
+}
+
 //
 // The next helper function maps a string to an event type.
 //
@@ -1013,6 +1314,9 @@ spindump_event_parser_json_converteventtype(const char* string,
   } else if (strcasecmp("packet",string) == 0) {
     *type = spindump_event_type_packet;
     return(1);
+  } else if (strcasecmp("capture",string) == 0) {
+    *type = spindump_event_type_capture;
+    return(1);
   } else {
     return(0);
   }
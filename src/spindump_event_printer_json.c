@@ -57,6 +57,24 @@ spindump_event_printer_json_print(const struct spindump_event* event,
 #define addtobuffer2(x,y)   snprintf(buffer + strlen(buffer),length - 1 - strlen(buffer),x,y)
 #define addtobuffer3(x,y,z) snprintf(buffer + strlen(buffer),length - 1 - strlen(buffer),x,y,z)
 
+  //
+  // Capture events are not about any connection, and have only the
+  // capture counts
+  //
+
+  if (event->eventType == spindump_event_type_capture) {
+    addtobuffer3("{ \"Event\": \"%s\", \"Ts\": %llu",
+                 spindump_event_type_tostring(event->eventType),
+                 event->timestamp);
+    addtobuffer2(", \"Received\": %llu", event->u.capture.receivedFrames);
+    addtobuffer2(", \"Kernel_drops\": %llu", event->u.capture.kernelDrops);
+    addtobuffer2(", \"Interface_drops\": %llu", event->u.capture.interfaceDrops);
+    addtobuffer2(", \"Ring_overflows\": %llu", event->u.capture.ringOverflows);
+    addtobuffer1(" }");
+    *consumed = strlen(buffer);
+    return(strlen(buffer) < length - 1);
+  }
+  
   //
   // Basic information about the connection
   //
@@ -94,12 +112,18 @@ spindump_event_printer_json_print(const struct spindump_event* event,
     break;
     
   case spindump_event_type_connection_delete:
+    if (event->u.connectionDelete.reason[0] != 0) {
+      addtobuffer2(", \"Reason\": \"%s\"", event->u.connectionDelete.reason);
+    }
     break;
     
   case spindump_event_type_new_rtt_measurement:
     if (event->u.newRttMeasurement.measurement == spindump_measurement_type_bidirectional) {
       if (event->u.newRttMeasurement.direction == spindump_direction_frominitiator) {
         addtobuffer2(", \"Left_rtt\": %lu", event->u.newRttMeasurement.rtt);
+        if (event->u.newRttMeasurement.rttNsec > 0) {
+          addtobuffer2(", \"Left_rtt_ns\": %llu", event->u.newRttMeasurement.rttNsec);
+        }
         if (event->u.newRttMeasurement.avgRtt > 0) {
           addtobuffer2(", \"Avg_left_rtt\": %lu", event->u.newRttMeasurement.avgRtt);
           addtobuffer2(", \"Dev_left_rtt\": %lu", event->u.newRttMeasurement.devRtt);
@@ -110,8 +134,16 @@ spindump_event_printer_json_print(const struct spindump_event* event,
        if (event->u.newRttMeasurement.minRtt > 0) {
           addtobuffer2(", \"Min_left_rtt\": %lu", event->u.newRttMeasurement.minRtt);
        }
+        if (event->u.newRttMeasurement.p99Rtt > 0) {
+          addtobuffer2(", \"P50_left_rtt\": %lu", event->u.newRttMeasurement.p50Rtt);
+          addtobuffer2(", \"P95_left_rtt\": %lu", event->u.newRttMeasurement.p95Rtt);
+          addtobuffer2(", \"P99_left_rtt\": %lu", event->u.newRttMeasurement.p99Rtt);
+        }
       } else {
         addtobuffer2(", \"Right_rtt\": %lu", event->u.newRttMeasurement.rtt);
+        if (event->u.newRttMeasurement.rttNsec > 0) {
+          addtobuffer2(", \"Right_rtt_ns\": %llu", event->u.newRttMeasurement.rttNsec);
+        }
         if (event->u.newRttMeasurement.avgRtt > 0) {
           addtobuffer2(", \"Avg_right_rtt\": %lu", event->u.newRttMeasurement.avgRtt);
           addtobuffer2(", \"Dev_right_rtt\": %lu", event->u.newRttMeasurement.devRtt);
@@ -122,11 +154,19 @@ spindump_event_printer_json_print(const struct spindump_event* event,
        if (event->u.newRttMeasurement.minRtt > 0) {
           addtobuffer2(", \"Min_right_rtt\": %lu", event->u.newRttMeasurement.minRtt);
        }
+        if (event->u.newRttMeasurement.p99Rtt > 0) {
+          addtobuffer2(", \"P50_right_rtt\": %lu", event->u.newRttMeasurement.p50Rtt);
+          addtobuffer2(", \"P95_right_rtt\": %lu", event->u.newRttMeasurement.p95Rtt);
+          addtobuffer2(", \"P99_right_rtt\": %lu", event->u.newRttMeasurement.p99Rtt);
+        }
 
       }
     } else {
       if (event->u.newRttMeasurement.direction == spindump_direction_frominitiator) {
         addtobuffer2(", \"Full_rtt_initiator\": %lu", event->u.newRttMeasurement.rtt);
+        if (event->u.newRttMeasurement.rttNsec > 0) {
+          addtobuffer2(", \"Full_rtt_initiator_ns\": %llu", event->u.newRttMeasurement.rttNsec);
+        }
         if (event->u.newRttMeasurement.avgRtt > 0) {
           addtobuffer2(", \"Avg_full_rtt_initiator\": %lu", event->u.newRttMeasurement.avgRtt);
           addtobuffer2(", \"Dev_full_rtt_initiator\": %lu", event->u.newRttMeasurement.devRtt);
@@ -137,8 +177,16 @@ spindump_event_printer_json_print(const struct spindump_event* event,
        if (event->u.newRttMeasurement.minRtt > 0) {
           addtobuffer2(", \"Min_full_rtt_initiator\": %lu", event->u.newRttMeasurement.minRtt);
        }
+        if (event->u.newRttMeasurement.p99Rtt > 0) {
+          addtobuffer2(", \"P50_full_rtt_initiator\": %lu", event->u.newRttMeasurement.p50Rtt);
+          addtobuffer2(", \"P95_full_rtt_initiator\": %lu", event->u.newRttMeasurement.p95Rtt);
+          addtobuffer2(", \"P99_full_rtt_initiator\": %lu", event->u.newRttMeasurement.p99Rtt);
+        }
       } else {
         addtobuffer2(", \"Full_rtt_responder\": %lu", event->u.newRttMeasurement.rtt);
+        if (event->u.newRttMeasurement.rttNsec > 0) {
+          addtobuffer2(", \"Full_rtt_responder_ns\": %llu", event->u.newRttMeasurement.rttNsec);
+        }
         if (event->u.newRttMeasurement.avgRtt > 0) {
           addtobuffer2(", \"Avg_full_rtt_responder\": %lu", event->u.newRttMeasurement.avgRtt);
           addtobuffer2(", \"Dev_full_rtt_responder\": %lu", event->u.newRttMeasurement.devRtt);
@@ -149,6 +197,11 @@ spindump_event_printer_json_print(const struct spindump_event* event,
        if (event->u.newRttMeasurement.minRtt > 0) {
           addtobuffer2(", \"Min_full_rtt_responder\": %lu", event->u.newRttMeasurement.minRtt);
        }
+        if (event->u.newRttMeasurement.p99Rtt > 0) {
+          addtobuffer2(", \"P50_full_rtt_responder\": %lu", event->u.newRttMeasurement.p50Rtt);
+          addtobuffer2(", \"P95_full_rtt_responder\": %lu", event->u.newRttMeasurement.p95Rtt);
+          addtobuffer2(", \"P99_full_rtt_responder\": %lu", event->u.newRttMeasurement.p99Rtt);
+        }
       }
     }
     break;
@@ -160,6 +213,51 @@ spindump_event_printer_json_print(const struct spindump_event* event,
         addtobuffer2(", \"Avg_right_rtt\": %lu", event->u.periodic.avgRttRight);
         addtobuffer2(", \"Dev_right_rtt\": %lu", event->u.periodic.devRttRight);
       }
+      if (event->u.periodic.p99RttRight > 0) {
+        addtobuffer2(", \"P50_right_rtt\": %lu", event->u.periodic.p50RttRight);
+        addtobuffer2(", \"P95_right_rtt\": %lu", event->u.periodic.p95RttRight);
+        addtobuffer2(", \"P99_right_rtt\": %lu", event->u.periodic.p99RttRight);
+      }
+    }
+    if (event->u.periodic.histRight.nBins > 0) {
+      addtobuffer2(", \"Hist_precision\": %u", event->u.periodic.histRight.precision);
+      addtobuffer1(", \"Hist_right_rtt\": [");
+      for (unsigned int i = 0; i < event->u.periodic.histRight.nBins; i++) {
+        if (i > 0) addtobuffer1(",");
+        addtobuffer3("[%u,%u]",
+                     event->u.periodic.histRight.indexes[i],
+                     event->u.periodic.histRight.counts[i]);
+      }
+      addtobuffer1("]");
+    }
+    if (event->u.periodic.sketchRight.nBins > 0 || event->u.periodic.sketchRight.zeroCount > 0) {
+      addtobuffer2(", \"Sketch_offset\": %u", event->u.periodic.sketchRight.offset);
+      addtobuffer2(", \"Sketch_zero\": %u", event->u.periodic.sketchRight.zeroCount);
+      addtobuffer1(", \"Sketch_right_rtt\": [");
+      for (unsigned int i = 0; i < event->u.periodic.sketchRight.nBins; i++) {
+        if (i > 0) addtobuffer1(",");
+        addtobuffer3("[%u,%u]",
+                     event->u.periodic.sketchRight.indexes[i],
+                     event->u.periodic.sketchRight.counts[i]);
+      }
+      addtobuffer1("]");
+    }
+    {
+      const struct spindump_bandwidth_series_stats* bwSeries[2] = {
+        &event->u.periodic.bwSeries1,
+        &event->u.periodic.bwSeries2
+      };
+      for (unsigned int side = 0; side < 2; side++) {
+        if (bwSeries[side]->peak[0] == 0) continue;
+        addtobuffer2(", \"Peak_bw%u\": [", side + 1);
+        for (unsigned int i = 0; i < spindump_bandwidth_series_nresolutions; i++) {
+          if (i > 0) addtobuffer1(",");
+          addtobuffer2("%llu", bwSeries[side]->peak[i]);
+        }
+        addtobuffer1("]");
+        addtobuffer3(", \"Mean_bw%u\": %llu", side + 1, bwSeries[side]->mean);
+        addtobuffer3(", \"Burst%u\": %u", side + 1, bwSeries[side]->burstiness);
+      }
     }
     break;
     
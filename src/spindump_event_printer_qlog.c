@@ -94,6 +94,25 @@ spindump_event_printer_qlog_print(const struct spindump_event* event,
 #define addtobuffer2(x,y)   snprintf(buffer + strlen(buffer),length - 1 - strlen(buffer),x,y)
 #define addtobuffer3(x,y,z) snprintf(buffer + strlen(buffer),length - 1 - strlen(buffer),x,y,z)
 
+  //
+  // Capture events are not about any connection, and have only the
+  // capture counts
+  //
+
+  if (event->eventType == spindump_event_type_capture) {
+    addtobuffer1("     {");
+    addtobuffer2("\"time\": %llu, ", event->timestamp);
+    addtobuffer1("\"event\": \"capture\", ");
+    addtobuffer1("\n      \"data\": {");
+    addtobuffer2("\"received\": %llu", event->u.capture.receivedFrames);
+    addtobuffer2(", \"kernel_drops\": %llu", event->u.capture.kernelDrops);
+    addtobuffer2(", \"interface_drops\": %llu", event->u.capture.interfaceDrops);
+    addtobuffer2(", \"ring_overflows\": %llu", event->u.capture.ringOverflows);
+    addtobuffer1("}}");
+    *consumed = strlen(buffer);
+    return(strlen(buffer) < length - 1);
+  }
+  
   addtobuffer1("     {");
   addtobuffer2("\"time\": %llu, ", event->timestamp);
   addtobuffer2("\"protocol_type\": %s, ", spindump_connection_type_to_string(event->connectionType));
@@ -278,12 +297,18 @@ spindump_event_printer_qlog_print_type_specific_measurements(const struct spindu
     break;
     
   case spindump_event_type_connection_delete:
+    if (event->u.connectionDelete.reason[0] != 0) {
+      addtobuffer2(", \"reason\": \"%s\"", event->u.connectionDelete.reason);
+    }
     break;
     
   case spindump_event_type_new_rtt_measurement:
     if (event->u.newRttMeasurement.measurement == spindump_measurement_type_bidirectional) {
       if (event->u.newRttMeasurement.direction == spindump_direction_frominitiator) {
         addtobuffer2(", \"left_rtt\": %lu", event->u.newRttMeasurement.rtt);
+        if (event->u.newRttMeasurement.rttNsec > 0) {
+          addtobuffer2(", \"left_rtt_ns\": %llu", event->u.newRttMeasurement.rttNsec);
+        }
         if (event->u.newRttMeasurement.avgRtt > 0) {
           addtobuffer2(", \"avg_left_rtt\": %lu", event->u.newRttMeasurement.avgRtt);
           addtobuffer2(", \"dev_left_rtt\": %lu", event->u.newRttMeasurement.devRtt);
@@ -294,8 +319,16 @@ spindump_event_printer_qlog_print_type_specific_measurements(const struct spindu
        if (event->u.newRttMeasurement.minRtt > 0) {
           addtobuffer2(", \"min_left_rtt\": %lu", event->u.newRttMeasurement.minRtt);
        }
+        if (event->u.newRttMeasurement.p99Rtt > 0) {
+          addtobuffer2(", \"p50_left_rtt\": %lu", event->u.newRttMeasurement.p50Rtt);
+          addtobuffer2(", \"p95_left_rtt\": %lu", event->u.newRttMeasurement.p95Rtt);
+          addtobuffer2(", \"p99_left_rtt\": %lu", event->u.newRttMeasurement.p99Rtt);
+        }
       } else {
         addtobuffer2(", \"right_rtt\": %lu", event->u.newRttMeasurement.rtt);
+        if (event->u.newRttMeasurement.rttNsec > 0) {
+          addtobuffer2(", \"right_rtt_ns\": %llu", event->u.newRttMeasurement.rttNsec);
+        }
         if (event->u.newRttMeasurement.avgRtt > 0) {
           addtobuffer2(", \"avg_right_rtt\": %lu", event->u.newRttMeasurement.avgRtt);
           addtobuffer2(", \"dev_right_rtt\": %lu", event->u.newRttMeasurement.devRtt);
@@ -306,11 +339,19 @@ spindump_event_printer_qlog_print_type_specific_measurements(const struct spindu
        if (event->u.newRttMeasurement.minRtt > 0) {
           addtobuffer2(", \"min_right_rtt\": %lu", event->u.newRttMeasurement.minRtt);
        }
+        if (event->u.newRttMeasurement.p99Rtt > 0) {
+          addtobuffer2(", \"p50_right_rtt\": %lu", event->u.newRttMeasurement.p50Rtt);
+          addtobuffer2(", \"p95_right_rtt\": %lu", event->u.newRttMeasurement.p95Rtt);
+          addtobuffer2(", \"p99_right_rtt\": %lu", event->u.newRttMeasurement.p99Rtt);
+        }
 
       }
     } else {
       if (event->u.newRttMeasurement.direction == spindump_direction_frominitiator) {
         addtobuffer2(", \"full_rtt_initiator\": %lu", event->u.newRttMeasurement.rtt);
+        if (event->u.newRttMeasurement.rttNsec > 0) {
+          addtobuffer2(", \"full_rtt_initiator_ns\": %llu", event->u.newRttMeasurement.rttNsec);
+        }
         if (event->u.newRttMeasurement.avgRtt > 0) {
           addtobuffer2(", \"avg_full_rtt_initiator\": %lu", event->u.newRttMeasurement.avgRtt);
           addtobuffer2(", \"dev_full_rtt_initiator\": %lu", event->u.newRttMeasurement.devRtt);
@@ -321,8 +362,16 @@ spindump_event_printer_qlog_print_type_specific_measurements(const struct spindu
        if (event->u.newRttMeasurement.minRtt > 0) {
           addtobuffer2(", \"min_full_rtt_initiator\": %lu", event->u.newRttMeasurement.minRtt);
        }
+        if (event->u.newRttMeasurement.p99Rtt > 0) {
+          addtobuffer2(", \"p50_full_rtt_initiator\": %lu", event->u.newRttMeasurement.p50Rtt);
+          addtobuffer2(", \"p95_full_rtt_initiator\": %lu", event->u.newRttMeasurement.p95Rtt);
+          addtobuffer2(", \"p99_full_rtt_initiator\": %lu", event->u.newRttMeasurement.p99Rtt);
+        }
       } else {
         addtobuffer2(", \"full_rtt_responder\": %lu", event->u.newRttMeasurement.rtt);
+        if (event->u.newRttMeasurement.rttNsec > 0) {
+          addtobuffer2(", \"full_rtt_responder_ns\": %llu", event->u.newRttMeasurement.rttNsec);
+        }
         if (event->u.newRttMeasurement.avgRtt > 0) {
           addtobuffer2(", \"avg_full_rtt_responder\": %lu", event->u.newRttMeasurement.avgRtt);
           addtobuffer2(", \"dev_full_rtt_responder\": %lu", event->u.newRttMeasurement.devRtt);
@@ -333,6 +382,11 @@ spindump_event_printer_qlog_print_type_specific_measurements(const struct spindu
        if (event->u.newRttMeasurement.minRtt > 0) {
           addtobuffer2(", \"min_full_rtt_responder\": %lu", event->u.newRttMeasurement.minRtt);
        }
+        if (event->u.newRttMeasurement.p99Rtt > 0) {
+          addtobuffer2(", \"p50_full_rtt_responder\": %lu", event->u.newRttMeasurement.p50Rtt);
+          addtobuffer2(", \"p95_full_rtt_responder\": %lu", event->u.newRttMeasurement.p95Rtt);
+          addtobuffer2(", \"p99_full_rtt_responder\": %lu", event->u.newRttMeasurement.p99Rtt);
+        }
       }
     }
     break;
@@ -344,6 +398,51 @@ spindump_event_printer_qlog_print_type_specific_measurements(const struct spindu
         addtobuffer2(", \"avg_right_rtt\": %lu", event->u.periodic.avgRttRight);
         addtobuffer2(", \"dev_right_rtt\": %lu", event->u.periodic.devRttRight);
       }
+      if (event->u.periodic.p99RttRight > 0) {
+        addtobuffer2(", \"p50_right_rtt\": %lu", event->u.periodic.p50RttRight);
+        addtobuffer2(", \"p95_right_rtt\": %lu", event->u.periodic.p95RttRight);
+        addtobuffer2(", \"p99_right_rtt\": %lu", event->u.periodic.p99RttRight);
+      }
+    }
+    if (event->u.periodic.histRight.nBins > 0) {
+      addtobuffer2(", \"hist_precision\": %u", event->u.periodic.histRight.precision);
+      addtobuffer1(", \"hist_right_rtt\": [");
+      for (unsigned int i = 0; i < event->u.periodic.histRight.nBins; i++) {
+        if (i > 0) addtobuffer1(",");
+        addtobuffer3("[%u,%u]",
+                     event->u.periodic.histRight.indexes[i],
+                     event->u.periodic.histRight.counts[i]);
+      }
+      addtobuffer1("]");
+    }
+    if (event->u.periodic.sketchRight.nBins > 0 || event->u.periodic.sketchRight.zeroCount > 0) {
+      addtobuffer2(", \"sketch_offset\": %u", event->u.periodic.sketchRight.offset);
+      addtobuffer2(", \"sketch_zero\": %u", event->u.periodic.sketchRight.zeroCount);
+      addtobuffer1(", \"sketch_right_rtt\": [");
+      for (unsigned int i = 0; i < event->u.periodic.sketchRight.nBins; i++) {
+        if (i > 0) addtobuffer1(",");
+        addtobuffer3("[%u,%u]",
+                     event->u.periodic.sketchRight.indexes[i],
+                     event->u.periodic.sketchRight.counts[i]);
+      }
+      addtobuffer1("]");
+    }
+    {
+      const struct spindump_bandwidth_series_stats* bwSeries[2] = {
+        &event->u.periodic.bwSeries1,
+        &event->u.periodic.bwSeries2
+      };
+      for (unsigned int side = 0; side < 2; side++) {
+        if (bwSeries[side]->peak[0] == 0) continue;
+        addtobuffer2(", \"peak_bw%u\": [", side + 1);
+        for (unsigned int i = 0; i < spindump_bandwidth_series_nresolutions; i++) {
+          if (i > 0) addtobuffer1(",");
+          addtobuffer2("%llu", bwSeries[side]->peak[i]);
+        }
+        addtobuffer1("]");
+        addtobuffer3(", \"mean_bw%u\": %llu", side + 1, bwSeries[side]->mean);
+        addtobuffer3(", \"burst%u\": %u", side + 1, bwSeries[side]->burstiness);
+      }
     }
     break;
     
@@ -63,6 +63,27 @@ spindump_event_printer_text_print(const struct spindump_event* event,
 #define addtobuffer4(x,y,z,v)   snprintf(buffer + strlen(buffer),length - 1 - strlen(buffer),x,y,z,v)
 #define addtobuffer5(x,y,z,v,t) snprintf(buffer + strlen(buffer),length - 1 - strlen(buffer),x,y,z,v,t)
 
+  //
+  // Capture events are not about any connection, and have only the
+  // capture counts
+  //
+
+  if (event->eventType == spindump_event_type_capture) {
+    addtobuffer3("%s at %llu ",
+                 spindump_event_type_tostring(event->eventType),
+                 event->timestamp);
+    addtobuffer3("received %llu kernel drops %llu ",
+                 event->u.capture.receivedFrames,
+                 event->u.capture.kernelDrops);
+    addtobuffer3("interface drops %llu ring overflows %llu",
+                 event->u.capture.interfaceDrops,
+                 event->u.capture.ringOverflows);
+    length++;
+    addtobuffer1("\n");
+    *consumed = strlen(buffer);
+    return(strlen(buffer) < length - 1);
+  }
+  
   //
   // Basic information about the connection
   //
@@ -99,6 +120,9 @@ spindump_event_printer_text_print(const struct spindump_event* event,
     break;
     
   case spindump_event_type_connection_delete:
+    if (event->u.connectionDelete.reason[0] != 0) {
+      addtobuffer4("reason %c%s%c ", 34, event->u.connectionDelete.reason, 34);
+    }
     break;
     
   case spindump_event_type_new_rtt_measurement:
@@ -115,6 +139,9 @@ spindump_event_printer_text_print(const struct spindump_event* event,
         addtobuffer2("full (responder) %lu ", event->u.newRttMeasurement.rtt);
       }
     }
+    if (event->u.newRttMeasurement.rttNsec > 0) {
+      addtobuffer2("ns %llu ", event->u.newRttMeasurement.rttNsec);
+    }
     if (event->u.newRttMeasurement.avgRtt > 0) {
       addtobuffer2("avg %lu ", event->u.newRttMeasurement.avgRtt);
       addtobuffer2("dev %lu ", event->u.newRttMeasurement.devRtt);
@@ -122,6 +149,11 @@ spindump_event_printer_text_print(const struct spindump_event* event,
     if (event->u.newRttMeasurement.filtAvgRtt > 0) {
       addtobuffer2("filtavg %lu ", event->u.newRttMeasurement.filtAvgRtt);
     }
+    if (event->u.newRttMeasurement.p99Rtt > 0) {
+      addtobuffer2("p50 %lu ", event->u.newRttMeasurement.p50Rtt);
+      addtobuffer2("p95 %lu ", event->u.newRttMeasurement.p95Rtt);
+      addtobuffer2("p99 %lu ", event->u.newRttMeasurement.p99Rtt);
+    }
     break;
     
   case spindump_event_type_periodic:
@@ -131,6 +163,37 @@ spindump_event_printer_text_print(const struct spindump_event* event,
         addtobuffer2("avg %lu ", event->u.periodic.avgRttRight);
         addtobuffer2("dev %lu ", event->u.periodic.devRttRight);
       }
+      if (event->u.periodic.p99RttRight > 0) {
+        addtobuffer2("p50 %lu ", event->u.periodic.p50RttRight);
+        addtobuffer2("p95 %lu ", event->u.periodic.p95RttRight);
+        addtobuffer2("p99 %lu ", event->u.periodic.p99RttRight);
+      }
+    }
+    if (event->u.periodic.histRight.nBins > 0) {
+      addtobuffer2("hist %u ", event->u.periodic.histRight.precision);
+      for (unsigned int i = 0; i < event->u.periodic.histRight.nBins; i++) {
+        if (i > 0) addtobuffer1(",");
+        addtobuffer3("%u:%u",
+                     event->u.periodic.histRight.indexes[i],
+                     event->u.periodic.histRight.counts[i]);
+      }
+      addtobuffer1(" ");
+    }
+    {
+      const struct spindump_bandwidth_series_stats* bwSeries[2] = {
+        &event->u.periodic.bwSeries1,
+        &event->u.periodic.bwSeries2
+      };
+      for (unsigned int side = 0; side < 2; side++) {
+        if (bwSeries[side]->peak[0] == 0) continue;
+        addtobuffer2("peak%u ", side + 1);
+        for (unsigned int i = 0; i < spindump_bandwidth_series_nresolutions; i++) {
+          if (i > 0) addtobuffer1(",");
+          addtobuffer2("%llu", bwSeries[side]->peak[i]);
+        }
+        addtobuffer3(" mean%u %llu ", side + 1, bwSeries[side]->mean);
+        addtobuffer3("burst%u %u ", side + 1, bwSeries[side]->burstiness);
+      }
     }
     break;
     
@@ -22,6 +22,7 @@
 
 #include <stdio.h>
 #include <string.h>
+#include <pthread.h>
 #include "spindump_util.h"
 #include "spindump_analyze.h"
 #include "spindump_connections.h"
@@ -31,6 +32,7 @@
 #include "spindump_eventformatter_json.h"
 #include "spindump_eventformatter_qlog.h"
 #include "spindump_event.h"
+#include "spindump_stats.h"
 
 //
 // Function prototypes ------------------------------------------------------------------------
@@ -58,7 +60,7 @@ spindump_eventformatter_measurement_one(struct spindump_analyze* state,
                                         void* handlerData,
                                         void** handlerConnectionData,
                                         spindump_analyze_event event,
-                                        const struct timeval* timestamp,
+                                        const spindump_time* timestamp,
                                         const int fromResponder,
                                         const unsigned int ipPacketLength,
                                         struct spindump_packet* packet,
@@ -79,6 +81,9 @@ spindump_eventformatter_initialize(struct spindump_analyze* analyzer,
                                    int aggregatesOnly,
                                    int averageRtts,
                                    int minimumRtts,
+                                   int nanosecondRtts,
+                                   int quantileRtts,
+                                   int histogramRtts,
                                    unsigned int filterExceptionalValuesPercentage);
 static const char*
 spindump_eventformatter_mediatype(enum spindump_eventformatter_outputformat format);
@@ -86,6 +91,27 @@ static void
 spindump_eventformatter_deliverdata_remoteblock(struct spindump_eventformatter* formatter,
                                                 unsigned long length,
                                                 const uint8_t* data);
+static void
+spindump_eventformatter_deliverdata_aux(struct spindump_eventformatter* formatter,
+                                        int amble,
+                                        unsigned long length,
+                                        const uint8_t* data);
+static void
+spindump_eventformatter_measurement_format(struct spindump_eventformatter* formatter,
+                                           spindump_analyze_event event,
+                                           const struct spindump_event* eventobj,
+                                           struct spindump_connection* connection);
+static void
+spindump_eventformatter_record(struct spindump_eventformatter* formatter,
+                               struct spindump_analyze* state,
+                               spindump_analyze_event event,
+                               const struct spindump_event* eventobj,
+                               struct spindump_connection* connection);
+static void
+spindump_eventformatter_quantiles(const struct spindump_rtt* rtt,
+                                  unsigned long* p50,
+                                  unsigned long* p95,
+                                  unsigned long* p99);
 
 //
 // Actual code --------------------------------------------------------------------------------
@@ -107,6 +133,9 @@ spindump_eventformatter_initialize(struct spindump_analyze* analyzer,
                                    int aggregatesOnly,
                                    int averageRtts,
                                    int minimumRtts,
+                                   int nanosecondRtts,
+                                   int quantileRtts,
+                                   int histogramRtts,
                                    unsigned int filterExceptionalValuesPercentage) {
   
   //
@@ -146,9 +175,25 @@ spindump_eventformatter_initialize(struct spindump_analyze* analyzer,
   formatter->aggregatesOnly = aggregatesOnly;
   formatter->averageRtts = averageRtts;
   formatter->minimumRtts = minimumRtts;
+  formatter->nanosecondRtts = nanosecondRtts;
+  formatter->quantileRtts = quantileRtts;
+  formatter->histogramRtts = histogramRtts;
   spindump_deepdeepdebugf("spindump_eventformatter_initialize: averageRtts set to %u", formatter->averageRtts);
   formatter->filterExceptionalValuesPercentage = filterExceptionalValuesPercentage;
   spindump_deepdeepdebugf("filter filterExceptionalValuesPercentage = %u", formatter->filterExceptionalValuesPercentage);
+  formatter->coordinator = 0;
+  formatter->skipAggregates = 0;
+
+  //
+  // The lock is recursive, as delivering data may lead to sending
+  // pooled data, which delivers a new preamble
+  //
+  
+  pthread_mutexattr_t attr;
+  pthread_mutexattr_init(&attr);
+  pthread_mutexattr_settype(&attr,PTHREAD_MUTEX_RECURSIVE);
+  pthread_mutex_init(&formatter->lock,&attr);
+  pthread_mutexattr_destroy(&attr);
   
   //
   // Register a handler for relevant events
@@ -186,6 +231,9 @@ spindump_eventformatter_initialize_file(struct spindump_analyze* analyzer,
                                         int aggregatesOnly,
                                         int averageRtts,
                                         int minimumRtts,
+                                        int nanosecondRtts,
+                                        int quantileRtts,
+                                        int histogramRtts,
                                         unsigned int filterExceptionalValuesPercentage) {
   
   //
@@ -207,6 +255,9 @@ spindump_eventformatter_initialize_file(struct spindump_analyze* analyzer,
                                                                                  aggregatesOnly,
                                                                                  averageRtts,
                                                                                  minimumRtts,
+                                                                                 nanosecondRtts,
+                                                                                 quantileRtts,
+                                                                                 histogramRtts,
                                                                                  filterExceptionalValuesPercentage);
   if (formatter == 0) {
     return(0);
@@ -250,6 +301,9 @@ spindump_eventformatter_initialize_remote(struct spindump_analyze* analyzer,
                                           int aggregatesOnly,
                                           int averageRtts,
                                           int minimumRtts,
+                                          int nanosecondRtts,
+                                          int quantileRtts,
+                                          int histogramRtts,
                                           unsigned int filterExceptionalValuesPercentage) {
   
   //
@@ -272,6 +326,9 @@ spindump_eventformatter_initialize_remote(struct spindump_analyze* analyzer,
                                                                                  aggregatesOnly,
                                                                                  averageRtts,
                                                                                  minimumRtts,
+                                                                                 nanosecondRtts,
+                                                                                 quantileRtts,
+                                                                                 histogramRtts,
                                                                                  filterExceptionalValuesPercentage);
   if (formatter == 0) {
     return(0);
@@ -336,6 +393,161 @@ spindump_eventformatter_initialize_remote(struct spindump_analyze* analyzer,
   return(formatter);
 }
 
+//
+// Create a formatter for the events of an analyzer running in another
+// thread. The formatter uses the same settings as the coordinator
+// formatter, and its output goes to the coordinator formatter's
+// output, one whole record at a time. The coordinator formatter
+// takes care of the preamble and postamble. Aggregates are not
+// reported by worker formatters, as the coordinator reports the
+// aggregates merged from all workers.
+//
+
+struct spindump_eventformatter*
+spindump_eventformatter_initialize_worker(struct spindump_analyze* analyzer,
+                                          struct spindump_eventformatter* coordinator) {
+
+  //
+  // Checks
+  //
+
+  spindump_assert(analyzer != 0);
+  spindump_assert(coordinator != 0);
+  spindump_assert(coordinator->coordinator == 0);
+
+  //
+  // Call the basic eventformatter initialization
+  //
+
+  struct spindump_eventformatter* formatter =
+    spindump_eventformatter_initialize(analyzer,
+                                       coordinator->format,
+                                       coordinator->querier,
+                                       coordinator->reportSpins,
+                                       coordinator->reportSpinFlips,
+                                       coordinator->reportRtLoss,
+                                       coordinator->reportQrLoss,
+                                       coordinator->reportQlLoss,
+                                       coordinator->reportPackets,
+                                       coordinator->reportNotes,
+                                       coordinator->anonymizeLeft,
+                                       coordinator->anonymizeRight,
+                                       coordinator->aggregatesOnly,
+                                       coordinator->averageRtts,
+                                       coordinator->minimumRtts,
+                                       coordinator->nanosecondRtts,
+                                       coordinator->quantileRtts,
+                                       coordinator->histogramRtts,
+                                       coordinator->filterExceptionalValuesPercentage);
+  if (formatter == 0) {
+    return(0);
+  }
+
+  //
+  // Do the worker-specific setup
+  //
+
+  formatter->coordinator = coordinator;
+  formatter->skipAggregates = 1;
+  
+  //
+  // Done. Return the object.
+  //
+
+  return(formatter);
+}
+
+//
+// Create a formatter that records the events of an analyzer running
+// in another thread, instead of outputting them. The formatter uses
+// the same settings as the coordinator formatter. The recorded events
+// are output in a deterministic order by calling
+// spindump_eventformatter_mergerecords on the coordinator formatter.
+//
+
+struct spindump_eventformatter*
+spindump_eventformatter_initialize_recorder(struct spindump_analyze* analyzer,
+                                            struct spindump_eventformatter* coordinator) {
+  struct spindump_eventformatter* formatter =
+    spindump_eventformatter_initialize_worker(analyzer,coordinator);
+  if (formatter == 0) {
+    return(0);
+  }
+  formatter->skipAggregates = 0;
+  formatter->recording = 1;
+  return(formatter);
+}
+
+//
+// Set the key under which a recording formatter records the next
+// events
+//
+
+void
+spindump_eventformatter_setrecordkey(struct spindump_eventformatter* formatter,
+                                     unsigned long long key) {
+  spindump_assert(formatter != 0);
+  spindump_assert(formatter->recording);
+  formatter->recordKey = key;
+}
+
+//
+// Output the events recorded by a number of recording formatters, and
+// clear the records. The records of each formatter are in the order
+// they were recorded, and they are merged so that the events come in
+// the order of their keys, and events with the same key in the order
+// of the creation of their connections.
+//
+
+void
+spindump_eventformatter_mergerecords(struct spindump_eventformatter* formatter,
+                                     unsigned int nRecorders,
+                                     struct spindump_eventformatter** recorders) {
+  
+  //
+  // Checks
+  //
+
+  spindump_assert(formatter != 0);
+  spindump_assert(formatter->coordinator == 0);
+  spindump_assert(recorders != 0);
+  spindump_assert(nRecorders <= spindump_eventformatter_maxrecorders);
+
+  //
+  // Merge
+  //
+  
+  unsigned int positions[spindump_eventformatter_maxrecorders];
+  memset(positions,0,sizeof(positions));
+  for (;;) {
+    struct spindump_eventformatter_record* next = 0;
+    unsigned int nextRecorder = 0;
+    for (unsigned int i = 0; i < nRecorders; i++) {
+      struct spindump_eventformatter* recorder = recorders[i];
+      spindump_assert(recorder->recording);
+      if (positions[i] == recorder->nRecords) continue;
+      struct spindump_eventformatter_record* record = &recorder->records[positions[i]];
+      if (next == 0 ||
+          record->key < next->key ||
+          (record->key == next->key && record->order < next->order)) {
+        next = record;
+        nextRecorder = i;
+      }
+    }
+    if (next == 0) break;
+    spindump_eventformatter_measurement_format(formatter,next->event,&next->eventobj,0);
+    positions[nextRecorder]++;
+  }
+
+  //
+  // Clear the records
+  //
+  
+  for (unsigned int i = 0; i < nRecorders; i++) {
+    recorders[i]->nRecords = 0;
+  }
+}
+
 //
 // Close the formatter, and emit any final text that may be needed
 //
@@ -348,15 +560,17 @@ spindump_eventformatter_uninitialize(struct spindump_eventformatter* formatter)
   //
   
   spindump_assert(formatter != 0);
-  spindump_assert(formatter->file != 0 || formatter->nRemotes > 0);
+  spindump_assert(formatter->file != 0 || formatter->nRemotes > 0 || formatter->coordinator != 0);
   spindump_assert(formatter->analyzer != 0);
 
   //
   // Emit whatever post-amble is needed in the output
   //
-  
-  spindump_eventformatter_measurement_end(formatter);
-  spindump_eventformatter_sendpooled(formatter);
+
+  if (formatter->coordinator == 0) {
+    spindump_eventformatter_measurement_end(formatter);
+    spindump_eventformatter_sendpooled(formatter);
+  }
   
   //
   // Unregister whatever we registered as handlers in the analyzer
@@ -372,6 +586,8 @@ spindump_eventformatter_uninitialize(struct spindump_eventformatter* formatter)
   // Free the memory
   //
   
+  pthread_mutex_destroy(&formatter->lock);
+  if (formatter->records != 0) spindump_free(formatter->records);
   spindump_free(formatter);
 }
 
@@ -543,6 +759,22 @@ spindump_eventformatter_measurement_endaux(struct spindump_eventformatter* forma
   }
 }
 
+//
+// Set the median, 95th and 99th percentile of the RTTs in a tracker,
+// or leave them as zero if there are no measurements.
+//
+
+static void
+spindump_eventformatter_quantiles(const struct spindump_rtt* rtt,
+                                  unsigned long* p50,
+                                  unsigned long* p95,
+                                  unsigned long* p99) {
+  if (rtt->sketch == 0 || rtt->sketch->count == 0) return;
+  *p50 = spindump_rtt_sketch_quantile(rtt->sketch,0.50);
+  *p95 = spindump_rtt_sketch_quantile(rtt->sketch,0.95);
+  *p99 = spindump_rtt_sketch_quantile(rtt->sketch,0.99);
+}
+
 //
 // Function that gets called whenever a new RTT data has come in for
 // any connection.  This is activated when the --textual mode is on.
@@ -553,7 +785,7 @@ spindump_eventformatter_measurement_one(struct spindump_analyze* state,
                                         void* handlerData,
                                         void** handlerConnectionData,
                                         spindump_analyze_event event,
-                                        const struct timeval* timestamp,
+                                        const spindump_time* timestamp,
                                         const int fromResponder,
                                         const unsigned int ipPacketLength,
                                         struct spindump_packet* packet,
@@ -585,15 +817,14 @@ spindump_eventformatter_measurement_one(struct spindump_analyze* state,
   
   spindump_deepdeepdebugf("point 2");
   if (formatter->aggregatesOnly && !spindump_connections_isaggregate(connection)) return;
+  if (formatter->skipAggregates && spindump_connections_isaggregate(connection)) return;
   
   //
   // Construct the time stamp
   //
   
   unsigned long long timestamplonglong;
-  timestamplonglong =
-      ((unsigned long long)timestamp->tv_sec) * 1000 * 1000 +
-      (unsigned long long)timestamp->tv_usec;
+  spindump_time_to_timestamp(timestamp,&timestamplonglong);
   spindump_deepdeepdebugf("event generation relative %u %llu %llu",
                           state->showRelativeTime,
                           state->firstEventTime,
@@ -808,16 +1039,21 @@ spindump_eventformatter_measurement_one(struct spindump_analyze* state,
     break;
 
   case spindump_analyze_event_connectiondelete:
+    if (connection->deleteReason != 0) {
+      strncpy(eventobj.u.connectionDelete.reason,
+              connection->deleteReason,
+              sizeof(eventobj.u.connectionDelete.reason) - 1);
+    }
     break;
 
   case spindump_analyze_event_periodic:
-    eventobj.u.periodic.rttRight = connection->rightRTT.lastRTT;
+    eventobj.u.periodic.rttRight = spindump_connections_rtt(connection->rightRTT)->lastRTT;
     eventobj.u.periodic.avgRttRight = 0;
     eventobj.u.periodic.devRttRight = 0;
     if (formatter->averageRtts) {
       unsigned long dev;
       unsigned long filtavg = 0;
-      unsigned long avg = spindump_rtt_calculateLastMovingAvgRTT(&connection->rightRTT,
+      unsigned long avg = spindump_rtt_calculateLastMovingAvgRTT(spindump_connections_rtt(connection->rightRTT),
                                                                  formatter->filterExceptionalValuesPercentage > 0,
                                                                  formatter->filterExceptionalValuesPercentage,
                                                                  &dev,
@@ -825,6 +1061,32 @@ spindump_eventformatter_measurement_one(struct spindump_analyze* state,
       eventobj.u.periodic.avgRttRight = avg;
       eventobj.u.periodic.devRttRight = dev;
     }
+    if (formatter->quantileRtts) {
+      spindump_eventformatter_quantiles(spindump_connections_rtt(connection->rightRTT),
+                                        &eventobj.u.periodic.p50RttRight,
+                                        &eventobj.u.periodic.p95RttRight,
+                                        &eventobj.u.periodic.p99RttRight);
+      const struct spindump_rtt_sketch* sketch = spindump_connections_rtt(connection->rightRTT)->sketch;
+      if (sketch != 0) {
+        spindump_rtt_sketch_sparse(sketch,
+                                   spindump_event_sketch_maxbins,
+                                   &eventobj.u.periodic.sketchRight.offset,
+                                   &eventobj.u.periodic.sketchRight.zeroCount,
+                                   &eventobj.u.periodic.sketchRight.nBins,
+                                   eventobj.u.periodic.sketchRight.indexes,
+                                   eventobj.u.periodic.sketchRight.counts);
+      }
+    }
+    if (formatter->histogramRtts) {
+      spindump_rtt_histogram_sparse(&spindump_connections_rtt(connection->rightRTT)->histogram,
+                                    spindump_event_histogram_maxbins,
+                                    &eventobj.u.periodic.histRight.precision,
+                                    &eventobj.u.periodic.histRight.nBins,
+                                    eventobj.u.periodic.histRight.indexes,
+                                    eventobj.u.periodic.histRight.counts);
+    }
+    spindump_bandwidth_seriesstats(&connection->bytesFromSide1,timestamp,&eventobj.u.periodic.bwSeries1);
+    spindump_bandwidth_seriesstats(&connection->bytesFromSide2,timestamp,&eventobj.u.periodic.bwSeries2);
     spindump_deepdeepdebugf("periodic eventobj.avgRttRight = %lu, averageRtts = %u",
                             eventobj.u.periodic.avgRttRight,
                             formatter->averageRtts);
@@ -833,14 +1095,16 @@ spindump_eventformatter_measurement_one(struct spindump_analyze* state,
   case spindump_analyze_event_newleftrttmeasurement:
     eventobj.u.newRttMeasurement.measurement = spindump_measurement_type_bidirectional;
     eventobj.u.newRttMeasurement.direction = spindump_direction_frominitiator;
-    eventobj.u.newRttMeasurement.rtt = connection->leftRTT.lastRTT;
+    eventobj.u.newRttMeasurement.rtt = spindump_connections_rtt(connection->leftRTT)->lastRTT;
+    eventobj.u.newRttMeasurement.rttNsec =
+      formatter->nanosecondRtts ? spindump_connections_rtt(connection->leftRTT)->lastRTTNsec : 0;
     eventobj.u.newRttMeasurement.avgRtt = 0;
     eventobj.u.newRttMeasurement.devRtt = 0;
     eventobj.u.newRttMeasurement.minRtt = 0;
     if (formatter->averageRtts) {
       unsigned long dev;
       unsigned long filtavg = 0;
-      unsigned long avg = spindump_rtt_calculateLastMovingAvgRTT(&connection->leftRTT,
+      unsigned long avg = spindump_rtt_calculateLastMovingAvgRTT(spindump_connections_rtt(connection->leftRTT),
                                                                  formatter->filterExceptionalValuesPercentage > 0,
                                                                  formatter->filterExceptionalValuesPercentage,
                                                                  &dev,
@@ -852,15 +1116,23 @@ spindump_eventformatter_measurement_one(struct spindump_analyze* state,
     }
     if (formatter->minimumRtts) {
 
-      eventobj.u.newRttMeasurement.minRtt = connection->leftRTT.minimumRTT;
+      eventobj.u.newRttMeasurement.minRtt = spindump_connections_rtt(connection->leftRTT)->minimumRTT;
 
     }
+    if (formatter->quantileRtts) {
+      spindump_eventformatter_quantiles(spindump_connections_rtt(connection->leftRTT),
+                                        &eventobj.u.newRttMeasurement.p50Rtt,
+                                        &eventobj.u.newRttMeasurement.p95Rtt,
+                                        &eventobj.u.newRttMeasurement.p99Rtt);
+    }
     break;
     
   case spindump_analyze_event_newrightrttmeasurement:
     eventobj.u.newRttMeasurement.measurement = spindump_measurement_type_bidirectional;
     eventobj.u.newRttMeasurement.direction = spindump_direction_fromresponder;
-    eventobj.u.newRttMeasurement.rtt = connection->rightRTT.lastRTT;
+    eventobj.u.newRttMeasurement.rtt = spindump_connections_rtt(connection->rightRTT)->lastRTT;
+    eventobj.u.newRttMeasurement.rttNsec =
+      formatter->nanosecondRtts ? spindump_connections_rtt(connection->rightRTT)->lastRTTNsec : 0;
     eventobj.u.newRttMeasurement.avgRtt = 0;
     eventobj.u.newRttMeasurement.devRtt = 0;
     eventobj.u.newRttMeasurement.minRtt = 0;
@@ -868,7 +1140,7 @@ spindump_eventformatter_measurement_one(struct spindump_analyze* state,
     if (formatter->averageRtts) {
       unsigned long dev;
       unsigned long filtavg = 0;
-      unsigned long avg = spindump_rtt_calculateLastMovingAvgRTT(&connection->rightRTT,
+      unsigned long avg = spindump_rtt_calculateLastMovingAvgRTT(spindump_connections_rtt(connection->rightRTT),
                                                                  formatter->filterExceptionalValuesPercentage > 0,
                                                                  formatter->filterExceptionalValuesPercentage,
                                                                  &dev,
@@ -881,9 +1153,15 @@ spindump_eventformatter_measurement_one(struct spindump_analyze* state,
 
     if (formatter->minimumRtts) {
 
-      eventobj.u.newRttMeasurement.minRtt = connection->rightRTT.minimumRTT;
+      eventobj.u.newRttMeasurement.minRtt = spindump_connections_rtt(connection->rightRTT)->minimumRTT;
 
   }
+    if (formatter->quantileRtts) {
+      spindump_eventformatter_quantiles(spindump_connections_rtt(connection->rightRTT),
+                                        &eventobj.u.newRttMeasurement.p50Rtt,
+                                        &eventobj.u.newRttMeasurement.p95Rtt,
+                                        &eventobj.u.newRttMeasurement.p99Rtt);
+    }
     spindump_deepdeepdebugf("eventobj.avgRtt = %lu, averageRtts = %u",
                             eventobj.u.newRttMeasurement.avgRtt,
                             formatter->averageRtts);
@@ -892,7 +1170,9 @@ spindump_eventformatter_measurement_one(struct spindump_analyze* state,
   case spindump_analyze_event_newinitrespfullrttmeasurement:
     eventobj.u.newRttMeasurement.measurement = spindump_measurement_type_unidirectional;
     eventobj.u.newRttMeasurement.direction = spindump_direction_frominitiator;
-    eventobj.u.newRttMeasurement.rtt = connection->initToRespFullRTT.lastRTT;
+    eventobj.u.newRttMeasurement.rtt = spindump_connections_rtt(connection->initToRespFullRTT)->lastRTT;
+    eventobj.u.newRttMeasurement.rttNsec =
+      formatter->nanosecondRtts ? spindump_connections_rtt(connection->initToRespFullRTT)->lastRTTNsec : 0;
     eventobj.u.newRttMeasurement.avgRtt = 0;
     eventobj.u.newRttMeasurement.devRtt = 0;
     eventobj.u.newRttMeasurement.minRtt = 0;
@@ -900,7 +1180,7 @@ spindump_eventformatter_measurement_one(struct spindump_analyze* state,
     if (formatter->averageRtts) {
       unsigned long dev;
       unsigned long filtavg = 0;
-      unsigned long avg = spindump_rtt_calculateLastMovingAvgRTT(&connection->initToRespFullRTT,
+      unsigned long avg = spindump_rtt_calculateLastMovingAvgRTT(spindump_connections_rtt(connection->initToRespFullRTT),
                                                                  formatter->filterExceptionalValuesPercentage > 0,
                                                                  formatter->filterExceptionalValuesPercentage,
                                                                  &dev,
@@ -913,16 +1193,24 @@ spindump_eventformatter_measurement_one(struct spindump_analyze* state,
 
     if (formatter->minimumRtts) {
 
-      eventobj.u.newRttMeasurement.minRtt = connection->initToRespFullRTT.minimumRTT;
+      eventobj.u.newRttMeasurement.minRtt = spindump_connections_rtt(connection->initToRespFullRTT)->minimumRTT;
 
     }
+    if (formatter->quantileRtts) {
+      spindump_eventformatter_quantiles(spindump_connections_rtt(connection->initToRespFullRTT),
+                                        &eventobj.u.newRttMeasurement.p50Rtt,
+                                        &eventobj.u.newRttMeasurement.p95Rtt,
+                                        &eventobj.u.newRttMeasurement.p99Rtt);
+    }
 
     break;
 
   case spindump_analyze_event_newrespinitfullrttmeasurement:
     eventobj.u.newRttMeasurement.measurement = spindump_measurement_type_unidirectional;
     eventobj.u.newRttMeasurement.direction = spindump_direction_fromresponder;
-    eventobj.u.newRttMeasurement.rtt = connection->respToInitFullRTT.lastRTT;
+    eventobj.u.newRttMeasurement.rtt = spindump_connections_rtt(connection->respToInitFullRTT)->lastRTT;
+    eventobj.u.newRttMeasurement.rttNsec =
+      formatter->nanosecondRtts ? spindump_connections_rtt(connection->respToInitFullRTT)->lastRTTNsec : 0;
     eventobj.u.newRttMeasurement.avgRtt = 0;
     eventobj.u.newRttMeasurement.devRtt = 0;
     eventobj.u.newRttMeasurement.minRtt = 0;
@@ -930,7 +1218,7 @@ spindump_eventformatter_measurement_one(struct spindump_analyze* state,
     if (formatter->averageRtts) {
       unsigned long dev;
       unsigned long filtavg = 0;
-      unsigned long avg = spindump_rtt_calculateLastMovingAvgRTT(&connection->respToInitFullRTT,
+      unsigned long avg = spindump_rtt_calculateLastMovingAvgRTT(spindump_connections_rtt(connection->respToInitFullRTT),
                                                                  formatter->filterExceptionalValuesPercentage > 0,
                                                                  formatter->filterExceptionalValuesPercentage,
                                                                  &dev,
@@ -942,33 +1230,39 @@ spindump_eventformatter_measurement_one(struct spindump_analyze* state,
     }
     if (formatter->minimumRtts) {
 
-      eventobj.u.newRttMeasurement.minRtt = connection->respToInitFullRTT.minimumRTT;
+      eventobj.u.newRttMeasurement.minRtt = spindump_connections_rtt(connection->respToInitFullRTT)->minimumRTT;
 
     }
+    if (formatter->quantileRtts) {
+      spindump_eventformatter_quantiles(spindump_connections_rtt(connection->respToInitFullRTT),
+                                        &eventobj.u.newRttMeasurement.p50Rtt,
+                                        &eventobj.u.newRttMeasurement.p95Rtt,
+                                        &eventobj.u.newRttMeasurement.p99Rtt);
+    }
     break;
 
   case spindump_analyze_event_initiatorspinflip:
     spindump_assert(connection->type == spindump_connection_transport_quic);
     eventobj.u.spinFlip.direction = spindump_direction_frominitiator;
-    eventobj.u.spinFlip.spin0to1 = connection->u.quic.spinFromPeer1to2.lastSpin;
+    eventobj.u.spinFlip.spin0to1 = connection->u.quic.trackers->spinFromPeer1to2.lastSpin;
     break;
 
   case spindump_analyze_event_responderspinflip:
     spindump_assert(connection->type == spindump_connection_transport_quic);
     eventobj.u.spinFlip.direction = spindump_direction_fromresponder;
-    eventobj.u.spinFlip.spin0to1 = connection->u.quic.spinFromPeer2to1.lastSpin;
+    eventobj.u.spinFlip.spin0to1 = connection->u.quic.trackers->spinFromPeer2to1.lastSpin;
     break;
     
   case spindump_analyze_event_initiatorspinvalue:
     spindump_assert(connection->type == spindump_connection_transport_quic);
     eventobj.u.spinValue.direction = spindump_direction_frominitiator;
-    eventobj.u.spinValue.value = (uint8_t)connection->u.quic.spinFromPeer1to2.lastSpin;
+    eventobj.u.spinValue.value = (uint8_t)connection->u.quic.trackers->spinFromPeer1to2.lastSpin;
     break;
 
   case spindump_analyze_event_responderspinvalue:
     spindump_assert(connection->type == spindump_connection_transport_quic);
     eventobj.u.spinValue.direction = spindump_direction_fromresponder;
-    eventobj.u.spinValue.value = (uint8_t)connection->u.quic.spinFromPeer2to1.lastSpin;
+    eventobj.u.spinValue.value = (uint8_t)connection->u.quic.trackers->spinFromPeer2to1.lastSpin;
     break;
 
   case spindump_analyze_event_initiatorecnce:
@@ -996,18 +1290,18 @@ spindump_eventformatter_measurement_one(struct spindump_analyze* state,
 
   case spindump_analyze_event_initiatorqrlossmeasurement:
     eventobj.u.qrlossMeasurement.direction = spindump_direction_frominitiator;
-    sprintf(eventobj.u.qrlossMeasurement.avgLoss, "%.3f", connection->u.quic.qrLossesFrom1to2.averageLossRate * 100);
-    sprintf(eventobj.u.qrlossMeasurement.totLoss, "%.3f", connection->u.quic.qrLossesFrom1to2.totalLossRate * 100);
-    sprintf(eventobj.u.qrlossMeasurement.avgRefLoss, "%.3f", connection->u.quic.qrLossesFrom1to2.averageRefLossRate * 100);
-    sprintf(eventobj.u.qrlossMeasurement.totRefLoss, "%.3f", connection->u.quic.qrLossesFrom1to2.totalRefLossRate * 100);
+    sprintf(eventobj.u.qrlossMeasurement.avgLoss, "%.3f", connection->u.quic.trackers->qrLossesFrom1to2.averageLossRate * 100);
+    sprintf(eventobj.u.qrlossMeasurement.totLoss, "%.3f", connection->u.quic.trackers->qrLossesFrom1to2.totalLossRate * 100);
+    sprintf(eventobj.u.qrlossMeasurement.avgRefLoss, "%.3f", connection->u.quic.trackers->qrLossesFrom1to2.averageRefLossRate * 100);
+    sprintf(eventobj.u.qrlossMeasurement.totRefLoss, "%.3f", connection->u.quic.trackers->qrLossesFrom1to2.totalRefLossRate * 100);
     break;
 
   case spindump_analyze_event_responderqrlossmeasurement:
     eventobj.u.qrlossMeasurement.direction = spindump_direction_fromresponder;
-    sprintf(eventobj.u.qrlossMeasurement.avgLoss, "%.3f", connection->u.quic.qrLossesFrom2to1.averageLossRate * 100);
-    sprintf(eventobj.u.qrlossMeasurement.totLoss, "%.3f", connection->u.quic.qrLossesFrom2to1.totalLossRate * 100);
-    sprintf(eventobj.u.qrlossMeasurement.avgRefLoss, "%.3f", connection->u.quic.qrLossesFrom2to1.averageRefLossRate * 100);
-    sprintf(eventobj.u.qrlossMeasurement.totRefLoss, "%.3f", connection->u.quic.qrLossesFrom2to1.totalRefLossRate * 100);
+    sprintf(eventobj.u.qrlossMeasurement.avgLoss, "%.3f", connection->u.quic.trackers->qrLossesFrom2to1.averageLossRate * 100);
+    sprintf(eventobj.u.qrlossMeasurement.totLoss, "%.3f", connection->u.quic.trackers->qrLossesFrom2to1.totalLossRate * 100);
+    sprintf(eventobj.u.qrlossMeasurement.avgRefLoss, "%.3f", connection->u.quic.trackers->qrLossesFrom2to1.averageRefLossRate * 100);
+    sprintf(eventobj.u.qrlossMeasurement.totRefLoss, "%.3f", connection->u.quic.trackers->qrLossesFrom2to1.totalRefLossRate * 100);
     break;
 
   case spindump_analyze_event_initiatorqllossmeasurement:
@@ -1034,18 +1328,35 @@ spindump_eventformatter_measurement_one(struct spindump_analyze* state,
   }
 
   //
-  // Based on the format type, provide different kinds of output
+  // Output the event, or record it for later output
   //
 
+  if (formatter->recording) {
+    spindump_eventformatter_record(formatter,state,event,&eventobj,connection);
+  } else {
+    spindump_eventformatter_measurement_format(formatter,event,&eventobj,connection);
+  }
+}
+
+//
+// Based on the format type, provide different kinds of output for an
+// event
+//
+
+static void
+spindump_eventformatter_measurement_format(struct spindump_eventformatter* formatter,
+                                           spindump_analyze_event event,
+                                           const struct spindump_event* eventobj,
+                                           struct spindump_connection* connection) {
   switch (formatter->format) {
   case spindump_eventformatter_outputformat_text:
-    spindump_eventformatter_measurement_one_text(formatter,event,&eventobj,connection);
+    spindump_eventformatter_measurement_one_text(formatter,event,eventobj,connection);
     break;
   case spindump_eventformatter_outputformat_json:
-    spindump_eventformatter_measurement_one_json(formatter,event,&eventobj,connection);
+    spindump_eventformatter_measurement_one_json(formatter,event,eventobj,connection);
     break;
   case spindump_eventformatter_outputformat_qlog:
-    spindump_eventformatter_measurement_one_qlog(formatter,event,&eventobj,connection);
+    spindump_eventformatter_measurement_one_qlog(formatter,event,eventobj,connection);
     break;
   default:
     spindump_errorf("invalid output format in internal variable");
@@ -1053,6 +1364,42 @@ spindump_eventformatter_measurement_one(struct spindump_analyze* state,
   }
 }
 
+//
+// Record an event in a recording formatter. The record key is the
+// one last set with spindump_eventformatter_setrecordkey, plus one
+// for the events of periodic reports, which come after the other
+// events of a periodic check.
+//
+
+static void
+spindump_eventformatter_record(struct spindump_eventformatter* formatter,
+                               struct spindump_analyze* state,
+                               spindump_analyze_event event,
+                               const struct spindump_event* eventobj,
+                               struct spindump_connection* connection) {
+  if (formatter->nRecords == formatter->maxRecords) {
+    unsigned int newMax = formatter->maxRecords == 0 ? 64 : formatter->maxRecords * 2;
+    unsigned long size = newMax * sizeof(struct spindump_eventformatter_record);
+    struct spindump_eventformatter_record* newRecords =
+      (struct spindump_eventformatter_record*)spindump_malloc(size);
+    if (newRecords == 0) {
+      spindump_errorf("cannot allocate memory for event records (%lu bytes)", size);
+      return;
+    }
+    if (formatter->records != 0) {
+      memcpy(newRecords,formatter->records,formatter->nRecords * sizeof(struct spindump_eventformatter_record));
+      spindump_free(formatter->records);
+    }
+    formatter->records = newRecords;
+    formatter->maxRecords = newMax;
+  }
+  struct spindump_eventformatter_record* record = &formatter->records[formatter->nRecords++];
+  record->key = formatter->recordKey + (state->table->performingPeriodicReport ? 1 : 0);
+  record->order = connection->creationOrder;
+  record->event = event;
+  record->eventobj = *eventobj;
+}
+
 //
 // Determine Internet media type based on the format
 //
@@ -1072,6 +1419,62 @@ spindump_eventformatter_mediatype(enum spindump_eventformatter_outputformat form
   }
 }
 
+//
+// Report the capture counts from stats as a capture event, i.e., how
+// many frames were captured and dropped since the previous capture
+// report from this formatter. The timestamp is the end of the
+// period.
+//
+
+void
+spindump_eventformatter_capturereport(struct spindump_eventformatter* formatter,
+                                      const spindump_time* timestamp,
+                                      const struct spindump_stats* stats) {
+
+  //
+  // Sanity checks
+  //
+  
+  spindump_assert(formatter != 0);
+  spindump_assert(timestamp != 0);
+  spindump_assert(stats != 0);
+
+  //
+  // Determine the counts during the period
+  //
+  
+  struct spindump_event_capture totals;
+  totals.receivedFrames = stats->receivedFrames;
+  totals.kernelDrops = stats->captureKernelDrops;
+  totals.interfaceDrops = stats->captureInterfaceDrops;
+  totals.ringOverflows = stats->captureRingOverflows;
+  struct spindump_event_capture capture;
+  capture.receivedFrames = (spindump_counter_32bit)(totals.receivedFrames - formatter->captureTotals.receivedFrames);
+  capture.kernelDrops = totals.kernelDrops - formatter->captureTotals.kernelDrops;
+  capture.interfaceDrops = (spindump_counter_32bit)(totals.interfaceDrops - formatter->captureTotals.interfaceDrops);
+  capture.ringOverflows = (spindump_counter_32bit)(totals.ringOverflows - formatter->captureTotals.ringOverflows);
+  formatter->captureTotals = totals;
+
+  //
+  // Construct the time stamp
+  //
+  
+  unsigned long long timestamplonglong;
+  spindump_time_to_timestamp(timestamp,&timestamplonglong);
+  if (formatter->analyzer->showRelativeTime &&
+      timestamplonglong >= formatter->analyzer->firstEventTime) {
+    timestamplonglong -= formatter->analyzer->firstEventTime;
+  }
+  
+  //
+  // Output the event
+  //
+  
+  struct spindump_event eventobj;
+  spindump_event_initialize_capture(timestamplonglong,&capture,&eventobj);
+  spindump_eventformatter_measurement_format(formatter,0,&eventobj,0);
+}
+
 //
 // If a number of updates have been pooled to a server, send them now.
 //
@@ -1079,6 +1482,8 @@ spindump_eventformatter_mediatype(enum spindump_eventformatter_outputformat form
 void
 spindump_eventformatter_sendpooled(struct spindump_eventformatter* formatter) {
   spindump_assert(formatter != 0);
+  spindump_assert(formatter->coordinator == 0);
+  pthread_mutex_lock(&formatter->lock);
   if (formatter->bytesInBlock > formatter->preambleLength) {
     spindump_deepdebugf("sendpooled bytes %lu", formatter->bytesInBlock);
     unsigned long postambleLength;
@@ -1091,6 +1496,7 @@ spindump_eventformatter_sendpooled(struct spindump_eventformatter* formatter) {
     formatter->bytesInBlock = 0;
     spindump_eventformatter_measurement_begin(formatter);
   }
+  pthread_mutex_unlock(&formatter->lock);
 }
 
 //
@@ -1100,12 +1506,33 @@ spindump_eventformatter_sendpooled(struct spindump_eventformatter* formatter) {
 // could either be printed or queued up for storage to be later
 // delivered via HTTP to a collector point.
 //
+// The output of worker formatters goes to their coordinator
+// formatter. All output is done under the lock of the formatter that
+// owns the output, so that records from different threads are not
+// mixed.
+//
 
 void
 spindump_eventformatter_deliverdata(struct spindump_eventformatter* formatter,
                                     int amble,
                                     unsigned long length,
                                     const uint8_t* data) {
+  struct spindump_eventformatter* target =
+    formatter->coordinator != 0 ? formatter->coordinator : formatter;
+  pthread_mutex_lock(&target->lock);
+  spindump_eventformatter_deliverdata_aux(target,amble,length,data);
+  pthread_mutex_unlock(&target->lock);
+}
+
+//
+// Deliver data to the output of this formatter, the lock being held
+//
+
+static void
+spindump_eventformatter_deliverdata_aux(struct spindump_eventformatter* formatter,
+                                        int amble,
+                                        unsigned long length,
+                                        const uint8_t* data) {
   spindump_deepdeepdebugf("eventformatter: spindump_eventformatter_deliverdata %u bytes\n%s",
                           length, data);
   if (formatter->file != 0) {
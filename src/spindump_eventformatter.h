@@ -24,7 +24,9 @@
 //
 
 #include <stdio.h>
+#include <pthread.h>
 #include "spindump_util.h"
+#include "spindump_event.h"
 
 //
 // Data types ---------------------------------------------------------------------------------
@@ -47,14 +49,25 @@ enum spindump_eventformatter_outputformat {
 // Parameters ---------------------------------------------------------------------------------
 //
 
+#define spindump_eventformatter_maxrecorders    65 // one for each of 64 threads, and one for the coordinator
+#define spindump_eventformatter_maxeventlength 2048 // room for one printed event, including histograms
+
 //
 // Data structures ----------------------------------------------------------------------------
 //
 
 struct spindump_analyze;
+struct spindump_stats;
 struct spindump_reverse_dns;
 struct spindump_remote_client;
 
+struct spindump_eventformatter_record {
+  unsigned long long key;                      // position of the event in the merged output
+  unsigned long long order;                    // creationOrder of the connection, for events with the same key
+  uint32_t event;                              // the spindump_analyze_event
+  struct spindump_event eventobj;
+};
+
 struct spindump_eventformatter {
   FILE* file;
   unsigned long blockSize;
@@ -78,11 +91,23 @@ struct spindump_eventformatter {
   int aggregatesOnly;
   int averageRtts;
   int minimumRtts;
+  int nanosecondRtts;
+  int quantileRtts;
+  int histogramRtts;
   unsigned int filterExceptionalValuesPercentage;
   enum spindump_eventformatter_outputformat format;
   size_t preambleLength;
   size_t midambleLength;
   size_t postambleLength;
+  struct spindump_eventformatter* coordinator; // if set, output goes through this formatter
+  int skipAggregates;
+  pthread_mutex_t lock;                        // serializes output from several threads
+  int recording;                               // if set, events are recorded rather than output
+  unsigned long long recordKey;                // key of the events recorded next
+  unsigned int nRecords;
+  unsigned int maxRecords;
+  struct spindump_eventformatter_record* records;
+  struct spindump_event_capture captureTotals; // capture counts in total at the previous capture report
 };
 
 //
@@ -106,6 +131,9 @@ spindump_eventformatter_initialize_file(struct spindump_analyze* analyzer,
                                         int aggregatesOnly,
                                         int averageRtts,
                                         int minimumRtts,
+                                        int nanosecondRtts,
+                                        int quantileRtts,
+                                        int histogramRtts,
                                         unsigned int filterExceptionalValuesPercentage);
 struct spindump_eventformatter*
 spindump_eventformatter_initialize_remote(struct spindump_analyze* analyzer,
@@ -126,7 +154,27 @@ spindump_eventformatter_initialize_remote(struct spindump_analyze* analyzer,
                                           int aggregatesOnly,
                                           int averageRtts,
                                           int minimumRtts,
+                                          int nanosecondRtts,
+                                          int quantileRtts,
+                                          int histogramRtts,
                                           unsigned int filterExceptionalValuesPercentage);
+struct spindump_eventformatter*
+spindump_eventformatter_initialize_worker(struct spindump_analyze* analyzer,
+                                          struct spindump_eventformatter* coordinator);
+struct spindump_eventformatter*
+spindump_eventformatter_initialize_recorder(struct spindump_analyze* analyzer,
+                                            struct spindump_eventformatter* coordinator);
+void
+spindump_eventformatter_setrecordkey(struct spindump_eventformatter* formatter,
+                                     unsigned long long key);
+void
+spindump_eventformatter_mergerecords(struct spindump_eventformatter* formatter,
+                                     unsigned int nRecorders,
+                                     struct spindump_eventformatter** recorders);
+void
+spindump_eventformatter_capturereport(struct spindump_eventformatter* formatter,
+                                      const spindump_time* timestamp,
+                                      const struct spindump_stats* stats);
 void
 spindump_eventformatter_sendpooled(struct spindump_eventformatter* formatter);
 void
@@ -99,7 +99,7 @@ spindump_eventformatter_measurement_one_json(struct spindump_eventformatter* for
                                              const struct spindump_event* eventobj,
                                              struct spindump_connection* connection) {
   
-  char buf[400];
+  char buf[spindump_eventformatter_maxeventlength];
   size_t consumed;
   spindump_event_printer_json_print(eventobj,buf,sizeof(buf)-1,&consumed);
   spindump_assert(consumed < sizeof(buf));
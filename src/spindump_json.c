@@ -30,8 +30,8 @@
 // Parameters ---------------------------------------------------------------------------------
 //
 
-#define maxSchemaFields 20
-#define maxOtherFields 20
+#define maxSchemaFields spindump_json_maxfields
+#define maxOtherFields 32
 
 //
 // Function prototypes ------------------------------------------------------------------------
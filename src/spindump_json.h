@@ -30,7 +30,7 @@
 // Parameters ---------------------------------------------------------------------------------
 //
 
-#define spindump_json_maxfields 46
+#define spindump_json_maxfields 80
 
 //
 // Data types ---------------------------------------------------------------------------------
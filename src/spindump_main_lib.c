@@ -39,6 +39,8 @@
 #include "spindump_eventformatter.h"
 #include "spindump_main.h"
 #include "spindump_main_lib.h"
+#include "spindump_main_threads.h"
+#include "spindump_main_prefilter.h"
 #include "spindump_bandwidth.h"
 
 //
@@ -58,6 +60,9 @@ static void
 spindump_main_configuration_defaultvalues(struct spindump_main_configuration* config);
 static enum spindump_eventformatter_outputformat
 spindump_main_parseformat(const char* string);
+static int
+spindump_main_parsesize(const char* string,
+                        unsigned long long* size);
 static struct spindump_main_network_entry *
 spindump_main_read_networks(const char *file);
 static int
@@ -150,9 +155,20 @@ spindump_main_configuration_defaultvalues(struct spindump_main_configuration* co
   config->jsonInputFile = 0;
   config->filter = 0;
   config->snaplen = spindump_capture_snaplen;
+  config->snaplenSet = 0;
+  config->prefilter = 0;
+  config->prefilterProtocols = spindump_main_prefilter_all;
+  config->captureBackend = spindump_capture_backend_pcap;
+  config->batchSize = 0;
+  config->captureRing = 0;
+  config->nThreads = 1;
   config->toolmode = spindump_toolmode_visual;
   config->format = spindump_eventformatter_outputformat_text;
   config->maxReceive = 0;
+  config->preallocateConnections = 0;
+  config->maxConnections = 0;
+  config->tcpWindow = spindump_seqtracker_maxnstored;
+  config->memoryLimit = 0;
   config->showRelativeTime = 0;
   config->showStats = 0;
   config->reverseDns = 0;
@@ -164,12 +180,18 @@ spindump_main_configuration_defaultvalues(struct spindump_main_configuration* co
   config->reportPackets = 0;
   config->reportNotes = 1;
   config->reportMinimumRtt = 0;
+  config->reportNanosecondRtt = 0;
+  config->reportQuantileRtt = 0;
+  config->reportRttHistogram = 0;
+  config->rttHistogramPrecision = spindump_rtt_histogram_defaultprecision;
   config->anonymizeLeft = 0;
   config->anonymizeRight = 0;
   config->filterExceptionalValuesPercentage = 0; // no filtering of RTT values
   config->updatePeriod = 500 * 1000; // 0.5s
   config->bandwidthMeasurementPeriod = spindump_bandwidth_period_default;
+  config->bandwidthSeries = spindump_bandwidth_series_none;
   config->periodicReportPeriod = 0; // not enabled, values in seconds
+  config->captureReportPeriod = 0; // not enabled, values in seconds
   config->nAggregates = 0;
   config->remoteBlockSize = 16 * 1024;
   config->nRemotes = 0;
@@ -332,6 +354,30 @@ spindump_main_processargs(int argc,
 
       config->reportMinimumRtt = 1;
 
+    } else if (strcmp(argv[0],"--report-ns-rtt") == 0) {
+
+      config->reportNanosecondRtt = 1;
+
+    } else if (strcmp(argv[0],"--not-report-ns-rtt") == 0) {
+
+      config->reportNanosecondRtt = 0;
+
+    } else if (strcmp(argv[0],"--report-quantile-rtt") == 0) {
+
+      config->reportQuantileRtt = 1;
+
+    } else if (strcmp(argv[0],"--not-report-quantile-rtt") == 0) {
+
+      config->reportQuantileRtt = 0;
+
+    } else if (strcmp(argv[0],"--report-rtt-histogram") == 0) {
+
+      config->reportRttHistogram = 1;
+
+    } else if (strcmp(argv[0],"--not-report-rtt-histogram") == 0) {
+
+      config->reportRttHistogram = 0;
+
     } else if (strcmp(argv[0],"--anonymize") == 0) {
 
       config->anonymizeLeft = 1;
@@ -403,9 +449,59 @@ spindump_main_processargs(int argc,
       }
       
       config->snaplen = (unsigned int)arg;
+      config->snaplenSet = 1;
       
       argc--; argv++;
 
+    } else if (strcmp(argv[0],"--prefilter") == 0) {
+
+      config->prefilter = 1;
+
+    } else if (strcmp(argv[0],"--prefilter-protocols") == 0 && argc > 1) {
+
+      if (!spindump_main_prefilter_parseprotocols(argv[1],&config->prefilterProtocols)) {
+        exit(1);
+      }
+      config->prefilter = 1;
+      argc--; argv++;
+
+    } else if (strcmp(argv[0],"--capture-backend") == 0 && argc > 1) {
+
+      if (!spindump_capture_parsebackend(argv[1],&config->captureBackend)) {
+        spindump_errorf("expected pcap or tpacketv3 for --capture-backend, got %s", argv[1]);
+        exit(1);
+      }
+      argc--; argv++;
+
+    } else if (strcmp(argv[0],"--batch-size") == 0 && argc > 1) {
+
+      if (!isdigit(*(argv[1])) || atoi(argv[1]) <= 0) {
+        spindump_errorf("expected a positive numeric argument for --batch-size, got %s", argv[1]);
+        exit(1);
+      }
+      config->batchSize = (unsigned int)atoi(argv[1]);
+      argc--; argv++;
+
+    } else if (strcmp(argv[0],"--capture-ring") == 0 && argc > 1) {
+
+      if (!isdigit(*(argv[1])) || atoi(argv[1]) <= 0 || atoi(argv[1]) > spindump_capture_ring_maxslots) {
+        spindump_errorf("expected a numeric argument between 1 and %u for --capture-ring, got %s",
+                        spindump_capture_ring_maxslots, argv[1]);
+        exit(1);
+      }
+      config->captureRing = (unsigned int)atoi(argv[1]);
+      argc--; argv++;
+
+    } else if (strcmp(argv[0],"--threads") == 0 && argc > 1) {
+
+      if (!isdigit(*(argv[1])) || atoi(argv[1]) <= 0 || atoi(argv[1]) > spindump_main_threads_max) {
+        spindump_errorf("expected a numeric argument between 1 and %u for --threads, got %s",
+                        spindump_main_threads_max, argv[1]);
+        exit(1);
+      }
+      config->nThreads = (unsigned int)atoi(argv[1]);
+      argc--; argv++;
+
     } else if (strcmp(argv[0],"--filter-exceptional-values") == 0 && argc > 1) {
 
       if (!isdigit(argv[1][0])) {
@@ -489,6 +585,41 @@ spindump_main_processargs(int argc,
       config->maxReceive = (unsigned int)atoi(argv[1]);
       argc--; argv++;
       
+    } else if (strcmp(argv[0],"--preallocate-connections") == 0 && argc > 1) {
+
+      if (!isdigit(*(argv[1]))) {
+        spindump_errorf("expected a numeric argument for --preallocate-connections, got %s", argv[1]);
+        exit(1);
+      }
+      config->preallocateConnections = (unsigned int)atoi(argv[1]);
+      argc--; argv++;
+      
+    } else if (strcmp(argv[0],"--max-connections") == 0 && argc > 1) {
+
+      if (!isdigit(*(argv[1]))) {
+        spindump_errorf("expected a numeric argument for --max-connections, got %s", argv[1]);
+        exit(1);
+      }
+      config->maxConnections = (unsigned int)atoi(argv[1]);
+      argc--; argv++;
+      
+    } else if (strcmp(argv[0],"--tcp-window") == 0 && argc > 1) {
+
+      if (!isdigit(*(argv[1])) || atoi(argv[1]) <= 0) {
+        spindump_errorf("expected a positive numeric argument for --tcp-window, got %s", argv[1]);
+        exit(1);
+      }
+      config->tcpWindow = (unsigned int)atoi(argv[1]);
+      argc--; argv++;
+      
+    } else if (strcmp(argv[0],"--memory-limit") == 0 && argc > 1) {
+
+      if (!spindump_main_parsesize(argv[1],&config->memoryLimit)) {
+        spindump_errorf("expected a memory size for --memory-limit, got %s", argv[1]);
+        exit(1);
+      }
+      argc--; argv++;
+      
     } else if (strcmp(argv[0],"--bandwidth-period") == 0 && argc > 1) {
 
       if (!isdigit(argv[1][0])) {
@@ -507,6 +638,18 @@ spindump_main_processargs(int argc,
       
       argc--; argv++;
       
+    } else if (strcmp(argv[0],"--report-bandwidth-series") == 0) {
+
+      config->bandwidthSeries = spindump_bandwidth_series_all;
+      
+    } else if (strcmp(argv[0],"--report-bandwidth-series-aggregates") == 0) {
+
+      config->bandwidthSeries = spindump_bandwidth_series_aggregates;
+      
+    } else if (strcmp(argv[0],"--not-report-bandwidth-series") == 0) {
+
+      config->bandwidthSeries = spindump_bandwidth_series_none;
+      
     } else if (strcmp(argv[0],"--report-only-periodically") == 0 && argc > 1) {
 
       if (!isdigit(argv[1][0])) {
@@ -525,6 +668,43 @@ spindump_main_processargs(int argc,
       
       argc--; argv++;
       
+    } else if (strcmp(argv[0],"--rtt-histogram-precision") == 0 && argc > 1) {
+
+      if (!isdigit(argv[1][0])) {
+        spindump_errorf("the --rtt-histogram-precision argument needs to be numeric");
+        exit(1);
+      }
+
+      int arg = atoi(argv[1]);
+      
+      if (arg > spindump_rtt_histogram_maxprecision) {
+        spindump_errorf("the --rtt-histogram-precision argument can be at most %u",
+                        spindump_rtt_histogram_maxprecision);
+        exit(1);
+      }
+      
+      config->rttHistogramPrecision = (unsigned int)arg;
+      
+      argc--; argv++;
+      
+    } else if (strcmp(argv[0],"--report-capture-drops") == 0 && argc > 1) {
+
+      if (!isdigit(argv[1][0])) {
+        spindump_errorf("the --report-capture-drops argument needs to be numeric");
+        exit(1);
+      }
+
+      int arg = atoi(argv[1]);
+      
+      if (arg < 0) {
+        spindump_errorf("the --report-capture-drops argument can not be negative");
+        exit(1);
+      }
+      
+      config->captureReportPeriod = (unsigned int)arg;
+      
+      argc--; argv++;
+      
     } else if (strcmp(argv[0],"--aggregate") == 0 && argc > 1) {
 
       //
@@ -844,6 +1024,32 @@ spindump_main_parseformat(const char* string) {
   }
 }
 
+//
+// Parse a memory size, given as a number of bytes, optionally
+// followed by k, m, or g for kilobytes, megabytes, or gigabytes.
+// Return 1 upon success, 0 if the input is invalid.
+//
+
+static int
+spindump_main_parsesize(const char* string,
+                        unsigned long long* size) {
+  spindump_assert(string != 0);
+  spindump_assert(size != 0);
+  if (!isdigit(*string)) return(0);
+  char* end = 0;
+  unsigned long long value = strtoull(string,&end,10);
+  switch (tolower(*end)) {
+  case 0: break;
+  case 'k': value *= 1024; end++; break;
+  case 'm': value *= 1024 * 1024; end++; break;
+  case 'g': value *= 1024 * 1024 * 1024; end++; break;
+  default: return(0);
+  }
+  if (*end != 0) return(0);
+  *size = value;
+  return(1);
+}
+
 //
 // Read CIDR format networks from file, one per line.
 //
@@ -963,6 +1169,14 @@ spindump_main_help(void) {
   printf("    --not-report-packets    Do not report update on every packet.\n");
   printf("    --report-notes          Report additional textual notes in events (default is not).\n");
   printf("    --not-report-notes      Do not report additional textual notes.\n");
+  printf("    --report-ns-rtt         Report RTT measurements also in nanoseconds (default is not).\n");
+  printf("    --not-report-ns-rtt     Report RTT measurements only in microseconds.\n");
+  printf("    --report-quantile-rtt   Report the median, 95th and 99th percentile RTTs\n");
+  printf("    --not-report-quantile-rtt (default is not).\n");
+  printf("    --report-rtt-histogram  Report RTT histograms in periodic reports\n");
+  printf("    --not-report-rtt-histogram (default is not).\n");
+  printf("    --rtt-histogram-precision n  Divide each doubling of RTT values to 2^n\n");
+  printf("                            histogram bins (default is 3).\n");
   printf("\n");
   printf("    --anonymize             Anonymization control.\n");
   printf("    --not-anonymize\n");
@@ -990,17 +1204,53 @@ spindump_main_help(void) {
   printf("                            Spindump.\n");
   printf("\n");
   printf("    --max-receive n         Sets a limit of how many packets the tool accepts.\n");
+  printf("    --preallocate-connections n\n");
+  printf("                            Reserve memory for n connections at startup. The default is 0,\n");
+  printf("                            i.e., memory is reserved as needed.\n");
+  printf("    --tcp-window n          Remember up to n sent TCP segments per direction for matching\n");
+  printf("                            with ACKs. The default is %u.\n", spindump_seqtracker_maxnstored);
+  printf("    --max-connections n     Keep at most n connections, evicting the least recently active\n");
+  printf("                            ones. The default is 0, i.e., no limit.\n");
+  printf("    --memory-limit n        Keep the memory used for connections below n bytes, evicting\n");
+  printf("                            connections as needed. A k, m, or g suffix stands for kilo-,\n");
+  printf("                            mega-, or gigabytes. The default is 0, i.e., no limit.\n");
   printf("\n");
   printf("    --bandwidth-period n    Sets the length of bandwidth measurement period, in\n");
   printf("                            microseconds. The default is %llu or %.2f.\n",
          (unsigned long long)spindump_bandwidth_period_default,
          (spindump_bandwidth_period_default * 1.0) / 1000000.0);
+  printf("    --report-bandwidth-series\n");
+  printf("    --report-bandwidth-series-aggregates\n");
+  printf("    --not-report-bandwidth-series\n");
+  printf("                            Keep the byte counts of the last minute at 100 ms, 1 s, and 10 s\n");
+  printf("                            resolutions, and report peak rates, mean rate, and burstiness in\n");
+  printf("                            periodic reports. This can be done for all connections, only for\n");
+  printf("                            aggregates, or not at all. The default is not at all.\n");
   printf("    --report-only-periodically n\n");
   printf("                            Make only periodic reports every n seconds. The default is 0,\n");
    printf("                            which disables the periodic mode.\n");
+  printf("    --report-capture-drops n\n");
+  printf("                            Report every n seconds how many packets were captured and how\n");
+  printf("                            many were dropped in the kernel, the interface, or the capture\n");
+  printf("                            ring. The default is 0, which disables these reports.\n");
   printf("\n");
   printf("    --interface i           Set the interface to listen on, or the capture\n");
   printf("    --snaplen n             How many bytes of the packet is captured (default is %u)\n", spindump_capture_snaplen);
+  printf("    --prefilter             Capture only packets that Spindump can analyze, using a filter\n");
+  printf("                            generated from the configuration, and combined with any filter\n");
+  printf("                            given. Unless --snaplen is given, capture only as many bytes as\n");
+  printf("                            the analysis needs.\n");
+  printf("    --prefilter-protocols l Like --prefilter, but capture only the protocols in the comma-\n");
+  printf("                            separated list l, of tcp, udp, quic, dns, coap, icmp, and sctp.\n");
+  printf("    --capture-backend b     Capture packets using PCAP (pcap, the default) or a memory-mapped\n");
+  printf("                            TPACKET_V3 ring (tpacketv3, Linux only).\n");
+  printf("    --batch-size n          Capture and analyze up to n packets at a time. The default is %u\n", spindump_capture_batchsize);
+  printf("                            for live capture and 1 for PCAP files.\n");
+  printf("    --capture-ring n        Capture live traffic in a separate thread, which passes packets\n");
+  printf("                            to the analysis through a ring of n packets. The default is 0,\n");
+  printf("                            i.e., no separate capture thread.\n");
+  printf("    --threads n             Analyze live traffic (Linux only) or a PCAP file in n threads, each\n");
+  printf("                            with its own share of the connections. The default is 1.\n");
   printf("    --input-file f          Give a PCAP file to read from.\n");
   printf("    --json-input-file f     Give a JSON file (produced by Spindump) to read from.\n");
   printf("    --remote u              Send connections information to spindump running elsewhere, at URL u\n");
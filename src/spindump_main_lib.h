@@ -26,6 +26,8 @@
 #include "spindump_util.h"
 #include "spindump_main.h"
 #include "spindump_tags.h"
+#include "spindump_bandwidth.h"
+#include "spindump_capture.h"
 
 //
 // Parameters ---------------------------------------------------------------------------------
@@ -79,9 +81,20 @@ struct spindump_main_configuration {
   const char* jsonInputFile;
   char* filter;
   unsigned int snaplen;
+  int snaplenSet;
+  int prefilter;
+  unsigned int prefilterProtocols;
+  enum spindump_capture_backend captureBackend;
+  unsigned int batchSize;
+  unsigned int captureRing;
+  unsigned int nThreads;
   enum spindump_toolmode toolmode;
   enum spindump_eventformatter_outputformat format;
   unsigned int maxReceive;
+  unsigned int preallocateConnections;
+  unsigned int maxConnections;
+  unsigned int tcpWindow;
+  unsigned long long memoryLimit;
   int showRelativeTime;
   int showStats;
   int reverseDns;
@@ -93,6 +106,10 @@ struct spindump_main_configuration {
   int reportQlLoss;
   int reportNotes;
   int reportMinimumRtt;
+  int reportNanosecondRtt;
+  int reportQuantileRtt;
+  int reportRttHistogram;
+  unsigned int rttHistogramPrecision;
   int averageMode;
   int aggregateMode;
   int anonymizeLeft;
@@ -100,7 +117,9 @@ struct spindump_main_configuration {
   unsigned int filterExceptionalValuesPercentage;
   unsigned long long updatePeriod;
   unsigned long long bandwidthMeasurementPeriod;
+  enum spindump_bandwidth_series_mode bandwidthSeries;
   unsigned int periodicReportPeriod;
+  unsigned int captureReportPeriod;
   unsigned int nAggregates;
   struct spindump_main_aggregate aggregates[spindump_main_maxnaggregates];
   unsigned int nAggrnetws;
@@ -31,6 +31,9 @@
 #include "spindump_util.h"
 #include "spindump_capture.h"
 #include "spindump_analyze.h"
+#include "spindump_pool.h"
+#include "spindump_poll.h"
+#include "spindump_table_eviction.h"
 #include "spindump_report.h"
 #include "spindump_remote_client.h"
 #include "spindump_remote_server.h"
@@ -39,14 +42,14 @@
 #include "spindump_main.h"
 #include "spindump_main_lib.h"
 #include "spindump_main_loop.h"
+#include "spindump_main_threads.h"
+#include "spindump_main_prefilter.h"
+#include "spindump_main_offline.h"
 
 //
 // Function prototypes ------------------------------------------------------------------------
 //
 
-static void
-spindump_main_loop_initialize_aggregates(struct spindump_main_configuration* config,
-                                         struct spindump_analyze* analyzer);
 static void
 spindump_main_loop_packetloop(struct spindump_main_state* state,
                               struct spindump_analyze* analyzer,
@@ -62,6 +65,25 @@ spindump_main_loop_packetloop(struct spindump_main_state* state,
                               int closedMode,
                               int udpMode,
                               int reverseDnsMode);
+static unsigned long long
+spindump_main_loop_timerperiod(struct spindump_main_configuration* config);
+
+//
+// Macros -------------------------------------------------------------------------------------
+//
+
+//
+// The sources of work that the packet loop waits on, and how often
+// the connections need to be checked for timeouts (usecs)
+//
+
+#define spindump_main_loop_source_capture     0
+#define spindump_main_loop_source_timer       1
+#define spindump_main_loop_source_collector   2
+#define spindump_main_loop_source_input       3
+#define spindump_main_loop_ready(source)      (1U << (source))
+#define spindump_main_loop_allsources         0xfU
+#define spindump_main_loop_checkperiod        (1000 * 1000)
 
 //
 // Actual code --------------------------------------------------------------------------------
@@ -98,28 +120,76 @@ spindump_main_loop_operation(struct spindump_main_state* state) {
 
   spindump_deepdeepdebugf("main loop, analyzer initialization");
   if (config->toolmode == spindump_toolmode_visual) config->periodicReportPeriod = 0;
+  spindump_rtt_histogram_setprecision(config->rttHistogramPrecision);
+  spindump_rtt_settracking(config->reportQuantileRtt,config->reportRttHistogram);
   struct spindump_analyze* analyzer = spindump_analyze_initialize(config->showRelativeTime,
                                                                   config-> filterExceptionalValuesPercentage,
                                                                   config->bandwidthMeasurementPeriod,
                                                                   config->periodicReportPeriod,
                                                                   &config->defaultTags);
   if (analyzer == 0) exit(1);
+  if (config->preallocateConnections > 0 &&
+      !spindump_pool_preallocate(sizeof(struct spindump_connection),config->preallocateConnections)) {
+    exit(1);
+  }
+  spindump_connectionstable_eviction_setlimits(analyzer->table,config->maxConnections,config->memoryLimit);
+  analyzer->table->tcpWindow = config->tcpWindow;
+  analyzer->table->bandwidthSeries = config->bandwidthSeries;
 
   //
   // Initialize the capture interface
   //
 
   struct spindump_capture_state* capturer = 0;
+  struct spindump_main_threads* threads = 0;
+  struct spindump_main_offline* offline = 0;
 
   spindump_deepdeepdebugf("main loop, capturer initialization");
-  if (config->inputFile != 0) {
+  if (config->prefilter && config->jsonInputFile == 0 && !config->collector &&
+      !spindump_main_prefilter_apply(config)) {
+    exit(1);
+  }
+  if (config->captureRing > 0 &&
+      (config->inputFile != 0 || config->jsonInputFile != 0 || config->collector)) {
+    spindump_errorf("--capture-ring requires live capture");
+    exit(1);
+  }
+  if (config->nThreads > 1 && config->inputFile != 0) {
+    if (config->toolmode != spindump_toolmode_textual && config->toolmode != spindump_toolmode_silent) {
+      spindump_errorf("--threads requires --textual or --silent mode");
+      exit(1);
+    }
+    if (config->maxConnections > 0 || config->memoryLimit > 0 || config->nRemotes > 0) {
+      spindump_errorf("--threads with --input-file cannot be used with --max-connections, --memory-limit, or --remote");
+      exit(1);
+    }
+    offline = spindump_main_offline_initialize(state,config->nThreads);
+    if (offline == 0) exit(1);
+    capturer = spindump_capture_initialize_file(config->inputFile,config->filter);
+  } else if (config->nThreads > 1) {
+    if (config->jsonInputFile != 0 || config->collector ||
+        config->toolmode == spindump_toolmode_visual) {
+      spindump_errorf("--threads requires live capture or --input-file, and --textual or --silent mode");
+      exit(1);
+    }
+    threads = spindump_main_threads_initialize(state,config->nThreads);
+    if (threads == 0) exit(1);
+    capturer = spindump_capture_initialize_null();
+  } else if (config->inputFile != 0) {
     capturer = spindump_capture_initialize_file(config->inputFile,config->filter);
   } else if (config->jsonInputFile) {
     capturer = spindump_capture_initialize_null();
   } else if (config->collector) {
     capturer = spindump_capture_initialize_null();
   } else {
-    capturer = spindump_capture_initialize_live(config->interface,config->filter,config->snaplen);
+    capturer = spindump_capture_initialize_live(config->interface,
+                                                config->filter,
+                                                config->snaplen,
+                                                config->captureBackend);
+    if (capturer != 0 && config->captureRing > 0 &&
+        !spindump_capture_startthread(capturer,config->captureRing)) {
+      exit(1);
+    }
   }
   
   if (capturer == 0) exit(1);
@@ -246,6 +316,9 @@ spindump_main_loop_operation(struct spindump_main_state* state) {
                                                         config->aggregateMode,
                                                         config->averageMode,
                                                         config->reportMinimumRtt,
+                                                        config->reportNanosecondRtt,
+                                                        config->reportQuantileRtt,
+                                                        config->reportRttHistogram,
                                                         config->filterExceptionalValuesPercentage);
   }
   
@@ -268,6 +341,9 @@ spindump_main_loop_operation(struct spindump_main_state* state) {
                                                                 config->aggregateMode,
                                                                 config->averageMode,
                                                                 config->reportMinimumRtt,
+                                                                config->reportNanosecondRtt,
+                                                                config->reportQuantileRtt,
+                                                                config->reportRttHistogram,
                                                                 config->filterExceptionalValuesPercentage);
   }
 
@@ -276,27 +352,35 @@ spindump_main_loop_operation(struct spindump_main_state* state) {
   //
 
   spindump_deepdeepdebugf("main loop operation, entering aggregate creation");
-  spindump_main_loop_initialize_aggregates(config,analyzer);
+  if (offline == 0) {
+    spindump_main_loop_initialize_aggregates(config,analyzer,threads != 0 ? threads->aggregates : 0);
+  }
   
   //
   // Enter the main packet-waiting-loop
   //
   
   spindump_deepdeepdebugf("main loop operation, entering packetloop");
-  spindump_main_loop_packetloop(state,
-                                analyzer,
-                                capturer,
-                                reporter,
-                                formatter,
-                                remoteFormatter,
-                                server,
-                                jsonFileReader,
-                                querier,
-                                averageMode,
-                                aggregateMode,
-                                closedMode,
-                                udpMode,
-                                reverseDnsMode);
+  if (threads != 0) {
+    spindump_main_threads_run(threads,state,analyzer,formatter,remoteFormatter);
+  } else if (offline != 0) {
+    spindump_main_offline_run(offline,state,analyzer,capturer,formatter);
+  } else {
+    spindump_main_loop_packetloop(state,
+                                  analyzer,
+                                  capturer,
+                                  reporter,
+                                  formatter,
+                                  remoteFormatter,
+                                  server,
+                                  jsonFileReader,
+                                  querier,
+                                  averageMode,
+                                  aggregateMode,
+                                  closedMode,
+                                  udpMode,
+                                  reverseDnsMode);
+  }
   
   //
   // Done
@@ -313,25 +397,39 @@ spindump_main_loop_operation(struct spindump_main_state* state) {
   if (config->showStats) {
     spindump_stats_report(spindump_analyze_getstats(analyzer),
                           stdout);
-    spindump_connectionstable_report(analyzer->table,
-                                     stdout,
-                                     config->anonymizeLeft,
-                                     querier);
+    if (offline != 0) {
+      spindump_main_offline_report(offline,
+                                   stdout,
+                                   config->anonymizeLeft,
+                                   querier);
+    } else {
+      spindump_connectionstable_report(analyzer->table,
+                                       stdout,
+                                       config->anonymizeLeft,
+                                       querier);
+    }
   }
   // Only free interface string if it was allocated by us
   if (interface_allocated) {
     spindump_free(config->interface);
   }
   spindump_report_uninitialize(reporter);
+  if (offline != 0) spindump_main_offline_uninitialize(offline);
   spindump_analyze_uninitialize(analyzer);
+  spindump_pool_uninitialize();
   spindump_capture_uninitialize(capturer);
+  if (threads != 0) spindump_main_threads_uninitialize(threads);
   spindump_reverse_dns_uninitialize(querier);
   if (server != 0) spindump_remote_server_close(server);
   if (jsonFileReader != 0) spindump_remote_file_close(jsonFileReader);
 }
 
 //
-// Function to wait for packets in a loop and process them
+// Function to wait for packets in a loop and process them. The loop
+// waits until one of its sources of work is ready: the capture
+// interface, a timer for periodic checks and screen updates, events
+// queued by the collector's daemon thread, or user input. Work is
+// done only for the sources that are ready.
 //
 
 static void
@@ -354,17 +452,53 @@ spindump_main_loop_packetloop(struct spindump_main_state* state,
   // Main operation
   //
   
-  struct timeval now;
-  struct timeval previousPacketTimestamp;
-  struct timeval previousupdate;
+  spindump_time now;
+  spindump_time previousPacketTimestamp;
+  spindump_time previousupdate;
   spindump_zerotime(&previousPacketTimestamp);
   spindump_zerotime(&previousupdate);
-  struct spindump_packet* packet = 0;
+  struct spindump_packet* packets = 0;
+  unsigned int nPackets = 0;
   struct spindump_main_configuration* config = &state->config;
   int more = 1;
   int seenEof = 0;
   int firstEof = 1;
   
+  //
+  // Register the sources to wait on. Packets from a file and events
+  // from a JSON file can be read without waiting, and so can packets
+  // from a capture interface that has no file descriptor to wait on.
+  // A collector without input files has no packets at all.
+  //
+
+  int offlineInput = (config->inputFile != 0 || config->jsonInputFile != 0);
+  int noPackets = (!offlineInput && config->collector);
+  struct spindump_poll* poller = spindump_poll_initialize();
+  if (poller == 0) exit(1);
+  int captureFd = spindump_capture_getselectablefd(capturer);
+  if (captureFd >= 0 &&
+      !spindump_poll_add(poller,captureFd,spindump_main_loop_source_capture)) {
+    exit(1);
+  }
+  if (server != 0 &&
+      !spindump_poll_add(poller,
+                         spindump_remote_server_getselectablefd(server),
+                         spindump_main_loop_source_collector)) {
+    exit(1);
+  }
+  if (config->toolmode == spindump_toolmode_visual &&
+      !spindump_poll_add(poller,STDIN_FILENO,spindump_main_loop_source_input)) {
+    exit(1);
+  }
+  if (!spindump_poll_settimer(poller,
+                              spindump_main_loop_source_timer,
+                              spindump_main_loop_timerperiod(config))) {
+    exit(1);
+  }
+  int pending = !noPackets;
+  spindump_time previousCaptureReport;
+  spindump_getcurrenttime(&previousCaptureReport);
+  
   spindump_deepdebugf("main packet loop");
   while (!state->interrupt &&
          more &&
@@ -372,20 +506,58 @@ spindump_main_loop_packetloop(struct spindump_main_state* state,
           spindump_analyze_getstats(analyzer)->receivedFrames < config->maxReceive)) {
     
     //
-    // Get a packet, if any. Analyze it.
+    // Wait until there's something to do. While packets keep coming,
+    // the other sources are only checked, without waiting. When
+    // packets can be read without waiting, everything is done for
+    // every batch, as before; except in the visual mode, where the
+    // user input is still checked.
     //
 
-    spindump_capture_nextpacket(capturer,&packet,&more,spindump_analyze_getstats(analyzer));
-    spindump_assert(spindump_isbool(more));
-    
-    if (packet != 0) {
-      struct spindump_connection* connection = 0;
-      spindump_analyze_process(analyzer,
-                               spindump_capture_getlinktype(capturer),
-                               packet,
-                               &connection);
+    uint32_t ready;
+    if (pending && captureFd < 0 && config->toolmode != spindump_toolmode_visual) {
+      ready = spindump_main_loop_allsources;
+    } else {
+      ready = spindump_poll_wait(poller,!pending);
+      if (pending) ready |= spindump_main_loop_ready(spindump_main_loop_source_capture);
     }
+    
+    //
+    // Get a batch of packets, if any. Analyze them. The rest of the
+    // loop is run once per batch.
+    //
 
+    nPackets = 0;
+    if (ready & spindump_main_loop_ready(spindump_main_loop_source_capture)) {
+      
+      unsigned int batchSize = config->batchSize;
+      if (batchSize == 0) batchSize = config->inputFile != 0 ? 1 : spindump_capture_batchsize;
+      if (config->maxReceive > 0 &&
+          config->maxReceive - spindump_analyze_getstats(analyzer)->receivedFrames < batchSize) {
+        batchSize = config->maxReceive - spindump_analyze_getstats(analyzer)->receivedFrames;
+      }
+      spindump_capture_nextbatch(capturer,batchSize,&packets,&nPackets,&more,spindump_analyze_getstats(analyzer));
+      spindump_assert(spindump_isbool(more));
+      
+      if (nPackets > 0) {
+        spindump_analyze_process_batch(analyzer,
+                                       spindump_capture_getlinktype(capturer),
+                                       packets,
+                                       nPackets);
+      }
+      
+      //
+      // Keep reading packets until there are no more. Only then is
+      // it time to wait.
+      //
+      
+      if (captureFd >= 0) {
+        pending = (nPackets > 0);
+      } else {
+        pending = more && !noPackets;
+      }
+      
+    }
+    
     //
     // If we are in visual mode, keep the display up even if the
     // packets came from a PCAP file and we run out of more packets
@@ -397,7 +569,7 @@ spindump_main_loop_packetloop(struct spindump_main_state* state,
     }
     
     if (!more &&
-        (config->inputFile != 0 || config->jsonInputFile != 0) &&
+        offlineInput &&
         config->toolmode == spindump_toolmode_visual) more = 1;
     
     //
@@ -407,8 +579,8 @@ spindump_main_loop_packetloop(struct spindump_main_state* state,
     //
 
     if (config->inputFile != 0) {
-      if (packet != 0) {
-        now = previousPacketTimestamp = packet->timestamp;
+      if (nPackets > 0) {
+        now = previousPacketTimestamp = packets[nPackets-1].timestamp;
       } else {
         now = previousPacketTimestamp;
       }
@@ -424,9 +596,8 @@ spindump_main_loop_packetloop(struct spindump_main_state* state,
       spindump_getcurrenttime(&now);
     }
     
-    spindump_deepdeepdebugf("time check %u.%u %u", now.tv_sec, now.tv_usec, seenEof);
-    spindump_assert(now.tv_sec > 0 || seenEof);
-    spindump_assert(now.tv_usec <= 1000 * 1000);
+    spindump_deepdeepdebugf("time check %llu %u", now, seenEof);
+    spindump_assert(now > 0 || seenEof);
 
     //
     // Check if there's any report from clients to our server, and
@@ -434,7 +605,8 @@ spindump_main_loop_packetloop(struct spindump_main_state* state,
     // tables.
     //
 
-    if (server != 0) {
+    if (server != 0 &&
+        (ready & spindump_main_loop_ready(spindump_main_loop_source_collector))) {
       while (spindump_remote_server_getupdate(server,analyzer)) {
       }
     }
@@ -445,18 +617,35 @@ spindump_main_loop_packetloop(struct spindump_main_state* state,
     // tables.
     //
     
-    if (jsonFileReader != 0) {
+    if (jsonFileReader != 0 &&
+        (ready & spindump_main_loop_ready(spindump_main_loop_source_capture))) {
       while (spindump_remote_file_getupdate(jsonFileReader,analyzer,&previousPacketTimestamp)) {
       }
       more = 0;
+      pending = 0;
+    }
+    
+    //
+    // Evict connections if the new packets or updates took us over
+    // the connection or memory limits.
+    //
+
+    if (ready & (spindump_main_loop_ready(spindump_main_loop_source_capture) |
+                 spindump_main_loop_ready(spindump_main_loop_source_collector))) {
+      spindump_connectionstable_eviction_enforce(analyzer->table,
+                                                 analyzer,
+                                                 config->toolmode == spindump_toolmode_connection);
     }
     
     //
     // See if we need to do any periodic maintenance (timeouts etc) of
-    // the set of connections we have.
+    // the set of connections we have. With input files, the time
+    // moves with the packets and events, so check after every batch;
+    // otherwise, when the timer fires.
     //
     
-    if (now.tv_sec > 0 &&
+    if (!spindump_iszerotime(&now) &&
+        (offlineInput || (ready & spindump_main_loop_ready(spindump_main_loop_source_timer))) &&
         spindump_connectionstable_periodiccheck(analyzer->table,
                                                 &now,
                                                 analyzer,
@@ -467,6 +656,25 @@ spindump_main_loop_packetloop(struct spindump_main_state* state,
       }
     }
 
+    //
+    // Update the counts of packets dropped in the capture when the
+    // timer fires, and report them if it is time to do so. The timer
+    // may fire a bit early, so the report is due already half a timer
+    // period before the end of the reporting period.
+    //
+
+    if (!offlineInput && !noPackets &&
+        (ready & spindump_main_loop_ready(spindump_main_loop_source_timer))) {
+      struct spindump_stats* stats = spindump_analyze_getstats(analyzer);
+      spindump_capture_getdrops(capturer,stats);
+      if (config->captureReportPeriod > 0 &&
+          spindump_timediffinusecs(&now,&previousCaptureReport) + spindump_main_loop_timerperiod(config) / 2 >=
+          config->captureReportPeriod * 1000ULL * 1000ULL) {
+        spindump_main_loop_capturereport(stats,formatter,remoteFormatter,&now);
+        previousCaptureReport = now;
+      }
+    }
+    
     //
     // See if it is time to update the screen periodically
     //
@@ -493,6 +701,7 @@ spindump_main_loop_packetloop(struct spindump_main_state* state,
     // Check if we have any user input
     //
 
+    if ((ready & spindump_main_loop_ready(spindump_main_loop_source_input)) == 0) continue;
     double commandArgument;
     enum spindump_report_command command = spindump_report_checkinput(reporter,&commandArgument);
     
@@ -526,6 +735,9 @@ spindump_main_loop_packetloop(struct spindump_main_state* state,
       {
         double result = floor(commandArgument * 1000 * 1000);
         config->updatePeriod = (unsigned long long)result;
+        spindump_poll_settimer(poller,
+                               spindump_main_loop_source_timer,
+                               spindump_main_loop_timerperiod(config));
       }
       break;
       
@@ -555,17 +767,56 @@ spindump_main_loop_packetloop(struct spindump_main_state* state,
     }
   }
 
+  spindump_poll_uninitialize(poller);
 }
 
 //
-// Helper function to initialize an aggregate connection object for
-// the analyzer
+// Determine how often the timer of the packet loop should fire: at
+// least once a second for the periodic checks, and in the visual
+// mode, as often as the screen is updated
 //
 
-static void
+static unsigned long long
+spindump_main_loop_timerperiod(struct spindump_main_configuration* config) {
+  unsigned long long period = spindump_main_loop_checkperiod;
+  if (config->toolmode == spindump_toolmode_visual &&
+      config->updatePeriod > 0 &&
+      config->updatePeriod < period) {
+    period = config->updatePeriod;
+  }
+  return(period);
+}
+
+//
+// Report the capture counts from stats as capture events, through
+// the formatters that exist
+//
+
+void
+spindump_main_loop_capturereport(const struct spindump_stats* stats,
+                                 struct spindump_eventformatter* formatter,
+                                 struct spindump_eventformatter* remoteFormatter,
+                                 const spindump_time* now) {
+  if (formatter != 0) {
+    spindump_eventformatter_capturereport(formatter,now,stats);
+  }
+  if (remoteFormatter != 0) {
+    spindump_eventformatter_capturereport(remoteFormatter,now,stats);
+  }
+}
+
+//
+// Helper function to initialize the configured aggregate connection
+// objects for the analyzer. If aggregates is non-zero, the created
+// aggregates are stored there, in the configured order (0 for those
+// that could not be created).
+//
+
+void
 spindump_main_loop_initialize_aggregates(struct spindump_main_configuration* config,
-                                         struct spindump_analyze* analyzer) {
-  struct timeval startTime;
+                                         struct spindump_analyze* analyzer,
+                                         struct spindump_connection** aggregates) {
+  spindump_time startTime;
   struct spindump_connectionstable* table = analyzer->table;
   spindump_getcurrenttime(&startTime);
   spindump_deepdeepdebugf("spindump_main_loop_initialize_aggregate network %u", config->nAggrnetws);
@@ -635,12 +886,15 @@ spindump_main_loop_initialize_aggregates(struct spindump_main_configuration* con
                                                                                          1,
                                                                                          analyzer->table);
     }
+    if (aggregates != 0) {
+      aggregates[i] = aggregateConnection;
+    }
     if (aggregateConnection != 0) {
       spindump_tags_copy(&aggregateConnection->tags,&aggregate->tags);
       spindump_deepdebugf("created a manually configured aggregate connection %u tags = %s",
                           aggregateConnection->id,
                           aggregateConnection->tags.string);
-      struct timeval now;
+      spindump_time now;
       spindump_getcurrenttime(&now);
       spindump_analyze_process_handlers(analyzer,
                                         spindump_analyze_event_newconnection,
@@ -31,7 +31,21 @@
 // External API interface to this module ------------------------------------------------------
 //
 
+struct spindump_analyze;
+struct spindump_connection;
+struct spindump_stats;
+struct spindump_eventformatter;
+
 void
 spindump_main_loop_operation(struct spindump_main_state* state);
+void
+spindump_main_loop_initialize_aggregates(struct spindump_main_configuration* config,
+                                         struct spindump_analyze* analyzer,
+                                         struct spindump_connection** aggregates);
+void
+spindump_main_loop_capturereport(const struct spindump_stats* stats,
+                                 struct spindump_eventformatter* formatter,
+                                 struct spindump_eventformatter* remoteFormatter,
+                                 const spindump_time* now);
 
 #endif // SPINDUMP_MAIN_LOOP_H
@@ -0,0 +1,1025 @@
+
+//
+//
+//  ////////////////////////////////////////////////////////////////////////////////////
+//  /////////                                                                ///////////
+//  //////       SSS    PPPP    I   N    N   DDDD    U   U   M   M   PPPP         //////
+//  //          S       P   P   I   NN   N   D   D   U   U   MM MM   P   P            //
+//  /            SSS    PPPP    I   N NN N   D   D   U   U   M M M   PPPP              /
+//  //              S   P       I   N   NN   D   D   U   U   M   M   P                //
+//  ////         SSS    P       I   N    N   DDDD     UUU    M   M   P            //////
+//  /////////                                                                ///////////
+//  ////////////////////////////////////////////////////////////////////////////////////
+//
+//  SPINDUMP (C) 2018-2020 BY ERICSSON RESEARCH
+//  AUTHOR: JARI ARKKO
+//
+
+//
+// Includes -----------------------------------------------------------------------------------
+//
+
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include "spindump_util.h"
+#include "spindump_capture.h"
+#include "spindump_analyze.h"
+#include "spindump_connections.h"
+#include "spindump_connections_set.h"
+#include "spindump_pool.h"
+#include "spindump_stats.h"
+#include "spindump_table.h"
+#include "spindump_table_index.h"
+#include "spindump_eventformatter.h"
+#include "spindump_remote_client.h"
+#include "spindump_main.h"
+#include "spindump_main_lib.h"
+#include "spindump_main_loop.h"
+#include "spindump_main_offline.h"
+
+//
+// Function prototypes ------------------------------------------------------------------------
+//
+
+static void*
+spindump_main_offline_worker(void* arg);
+static struct spindump_analyze*
+spindump_main_offline_analyzer(struct spindump_main_configuration* config);
+static int
+spindump_main_offline_worker_setup(struct spindump_main_offline_worker* worker);
+static void
+spindump_main_offline_worker_chunk(struct spindump_main_offline_worker* worker);
+static void
+spindump_main_offline_worker_update(const struct spindump_connectionstable_aggregateupdate* update,
+                                    void* handlerData);
+static int
+spindump_main_offline_read(struct spindump_main_offline* offline,
+                           struct spindump_main_state* state,
+                           struct spindump_analyze* analyzer,
+                           struct spindump_capture_state* capturer);
+static int
+spindump_main_offline_copy(struct spindump_main_offline* offline,
+                           const struct spindump_packet* packet,
+                           size_t* p_used);
+static uint8_t
+spindump_main_offline_route(struct spindump_main_offline* offline,
+                            struct spindump_packet* packet);
+static void
+spindump_main_offline_merge(struct spindump_main_offline* offline);
+static void
+spindump_main_offline_replay(struct spindump_main_offline* offline);
+static void
+spindump_main_offline_apply(struct spindump_main_offline* offline,
+                            const struct spindump_main_offline_update* entry,
+                            struct spindump_packet* packet,
+                            spindump_counter_32bit handlerCalls);
+static struct spindump_connection_set*
+spindump_main_offline_members(struct spindump_connection* aggregate);
+static unsigned int
+spindump_main_offline_id(struct spindump_main_offline* offline,
+                         unsigned long long creationOrder);
+static void
+spindump_main_offline_command(struct spindump_main_offline* offline,
+                              enum spindump_main_offline_command command);
+static void
+spindump_main_offline_wait(struct spindump_main_offline* offline);
+static int
+spindump_main_offline_compare(const void* a,
+                              const void* b);
+
+//
+// Macros -------------------------------------------------------------------------------------
+//
+
+//
+// The connections created by the packet at a given index of the
+// file are ordered after those created by the earlier packets, and
+// the manually configured aggregates, which get creationOrders from
+// zero on. Each packet's records in the output have a key between
+// those of the previous and the next packet, and so do the records
+// of the periodic check made after the packet, if any. Within the
+// keys of a packet, the events from each update of the aggregates
+// get a key between those of the worker's events before and after
+// the update.
+//
+
+#define spindump_main_offline_creationorder(index) (((index) + 1) << 16)
+#define spindump_main_offline_key(index)           (((index) + 1) << 10)
+#define spindump_main_offline_checkkey(index)      (spindump_main_offline_key(index) + 1022)
+
+//
+// Actual code --------------------------------------------------------------------------------
+//
+
+//
+// Create the state for analyzing a PCAP file in several threads. The
+// packets of the file are divided among the workers by their
+// addresses, so that each connection is analyzed by only one worker,
+// and the events of the workers are output in the order in which one
+// analyzer would have produced them. Each worker has its own copy of
+// the aggregates, but the updates to them are made by the
+// coordinator to one combined set of aggregates, in the order of the
+// packets. The threads are started only in spindump_main_offline_run.
+//
+
+struct spindump_main_offline*
+spindump_main_offline_initialize(struct spindump_main_state* state,
+                                 unsigned int nWorkers) {
+
+  //
+  // Checks
+  //
+
+  spindump_assert(state != 0);
+  spindump_assert(nWorkers > 1 && nWorkers < spindump_eventformatter_maxrecorders);
+
+  //
+  // Allocate
+  //
+
+  unsigned int size = sizeof(struct spindump_main_offline);
+  struct spindump_main_offline* offline = (struct spindump_main_offline*)spindump_malloc(size);
+  if (offline == 0) {
+    spindump_errorf("cannot allocate offline analysis state of %u bytes", size);
+    return(0);
+  }
+  memset(offline,0,sizeof(*offline));
+  offline->state = state;
+  offline->nWorkers = nWorkers;
+  pthread_mutex_init(&offline->lock,0);
+  pthread_cond_init(&offline->workCond,0);
+  pthread_cond_init(&offline->doneCond,0);
+
+  size = nWorkers * (unsigned int)sizeof(struct spindump_main_offline_worker);
+  offline->workers = (struct spindump_main_offline_worker*)spindump_malloc(size);
+  offline->packets = (struct spindump_packet*)spindump_malloc(spindump_main_offline_chunk * sizeof(struct spindump_packet));
+  offline->owners = (uint8_t*)spindump_malloc(spindump_main_offline_chunk * sizeof(uint8_t));
+  offline->batchEnds = (uint8_t*)spindump_malloc(spindump_main_offline_chunk * sizeof(uint8_t));
+  offline->nCreated = (unsigned int*)spindump_malloc(spindump_main_offline_chunk * sizeof(unsigned int));
+  offline->offsets = (size_t*)spindump_malloc(spindump_main_offline_chunk * sizeof(size_t));
+  if (offline->workers == 0 ||
+      offline->packets == 0 ||
+      offline->owners == 0 ||
+      offline->batchEnds == 0 ||
+      offline->nCreated == 0 ||
+      offline->offsets == 0) {
+    spindump_errorf("cannot allocate offline analysis state for %u workers", nWorkers);
+    spindump_main_offline_uninitialize(offline);
+    return(0);
+  }
+  memset(offline->workers,0,size);
+  for (unsigned int i = 0; i < nWorkers; i++) {
+    offline->workers[i].index = i;
+    offline->workers[i].offline = offline;
+  }
+
+  //
+  // Done
+  //
+
+  return(offline);
+}
+
+//
+// Analyze the packets of the file in the worker threads. The
+// coordinator reads a chunk of packets from the file, decides which
+// worker analyzes each packet, and lets the workers analyze the
+// chunk. The workers' events are recorded, and after each chunk the
+// coordinator outputs them through its formatter. In the end, the
+// workers' statistics are collected to the coordinator's analyzer.
+//
+
+void
+spindump_main_offline_run(struct spindump_main_offline* offline,
+                          struct spindump_main_state* state,
+                          struct spindump_analyze* analyzer,
+                          struct spindump_capture_state* capturer,
+                          struct spindump_eventformatter* formatter) {
+
+  //
+  // Checks
+  //
+
+  spindump_assert(offline != 0);
+  spindump_assert(state != 0);
+  spindump_assert(analyzer != 0);
+  spindump_assert(capturer != 0);
+  offline->formatter = formatter;
+  offline->linktype = spindump_capture_getlinktype(capturer);
+
+  //
+  // Create the combined aggregates
+  //
+
+  offline->analyzer = spindump_main_offline_analyzer(&state->config);
+  if (offline->analyzer == 0) return;
+  if (formatter != 0) {
+    offline->recorder = spindump_eventformatter_initialize_recorder(offline->analyzer,formatter);
+    if (offline->recorder == 0) return;
+  }
+  spindump_main_loop_initialize_aggregates(&state->config,offline->analyzer,0);
+
+  //
+  // Start the workers, and wait until they have set up their
+  // analyzers
+  //
+
+  pthread_mutex_lock(&offline->lock);
+  offline->command = spindump_main_offline_command_setup;
+  offline->pending = 0;
+  for (unsigned int i = 0; i < offline->nWorkers; i++) {
+    struct spindump_main_offline_worker* worker = &offline->workers[i];
+    if (pthread_create(&worker->thread,0,spindump_main_offline_worker,worker) != 0) {
+      spindump_errorf("cannot create worker thread %u", i);
+      offline->failed = 1;
+      break;
+    }
+    worker->running = 1;
+    offline->pending++;
+  }
+  pthread_mutex_unlock(&offline->lock);
+  spindump_main_offline_wait(offline);
+  if (offline->failed) return;
+
+  //
+  // Output the events from the creation of the aggregates
+  //
+
+  offline->nextId = (unsigned int)offline->analyzer->table->nextCreationOrder;
+  spindump_main_offline_merge(offline);
+  
+  //
+  // Analyze the file a chunk at a time
+  //
+
+  int more = 1;
+  while (more) {
+    more = spindump_main_offline_read(offline,state,analyzer,capturer);
+    if (offline->nPackets == 0) break;
+    spindump_main_offline_command(offline,spindump_main_offline_command_chunk);
+    spindump_main_offline_merge(offline);
+    offline->first += offline->nPackets;
+  }
+
+  //
+  // Collect the statistics
+  //
+  
+  spindump_main_offline_command(offline,spindump_main_offline_command_finish);
+  for (unsigned int i = 0; i < offline->nWorkers; i++) {
+    spindump_stats_add(spindump_analyze_getstats(analyzer),&offline->workers[i].stats);
+  }
+  spindump_stats_add(spindump_analyze_getstats(analyzer),spindump_analyze_getstats(offline->analyzer));
+}
+
+//
+// Read the next chunk of packets from the file, and decide which
+// worker analyzes each packet. The packets are read in the same
+// batches as when they are analyzed in one thread, as the
+// connections are checked for timeouts etc. after each batch. Return
+// 1 if there may be more packets, 0 if not.
+//
+
+static int
+spindump_main_offline_read(struct spindump_main_offline* offline,
+                           struct spindump_main_state* state,
+                           struct spindump_analyze* analyzer,
+                           struct spindump_capture_state* capturer) {
+
+  struct spindump_main_configuration* config = &state->config;
+  struct spindump_stats* stats = spindump_analyze_getstats(analyzer);
+  size_t used = 0;
+  int more = 1;
+  offline->nPackets = 0;
+  
+  while (!state->interrupt &&
+         more &&
+         (config->maxReceive == 0 || stats->receivedFrames < config->maxReceive)) {
+
+    //
+    // Determine the batch size as in spindump_main_loop_packetloop,
+    // and check that the whole batch fits in the chunk
+    //
+    
+    unsigned int batchSize = config->batchSize > 0 ? config->batchSize : 1;
+    if (config->maxReceive > 0 &&
+        config->maxReceive - stats->receivedFrames < batchSize) {
+      batchSize = config->maxReceive - stats->receivedFrames;
+    }
+    if (batchSize > spindump_main_offline_chunk) batchSize = spindump_main_offline_chunk;
+    if (offline->nPackets + batchSize > spindump_main_offline_chunk) break;
+
+    //
+    // Read the batch
+    //
+    
+    struct spindump_packet* packets = 0;
+    unsigned int nPackets = 0;
+    spindump_capture_nextbatch(capturer,batchSize,&packets,&nPackets,&more,stats);
+    for (unsigned int i = 0; i < nPackets; i++) {
+      unsigned int j = offline->nPackets;
+      offline->packets[j] = packets[i];
+      offline->batchEnds[j] = (i + 1 == nPackets);
+      if (capturer->file == 0 && !spindump_main_offline_copy(offline,&packets[i],&used)) {
+        state->interrupt = 1;
+        more = 0;
+        break;
+      }
+      offline->nPackets++;
+    }
+    
+  }
+
+  //
+  // Point to the copies of the packets, if the packets had to be
+  // copied
+  //
+  
+  if (capturer->file == 0) {
+    for (unsigned int j = 0; j < offline->nPackets; j++) {
+      offline->packets[j].contents = offline->contents + offline->offsets[j];
+    }
+  }
+  
+  //
+  // Decide who analyzes what
+  //
+  
+  if (offline->first == 0 && offline->nPackets > 0) {
+    spindump_time_to_timestamp(&offline->packets[0].timestamp,&offline->firstTimestamp);
+  }
+  for (unsigned int j = 0; j < offline->nPackets; j++) {
+    offline->owners[j] = spindump_main_offline_route(offline,&offline->packets[j]);
+  }
+  
+  return(more && !state->interrupt);
+}
+
+//
+// Copy the contents of a packet, when reading from a capture that
+// reuses its buffers. The copies of the packets of a chunk are in
+// the contents buffer, which is grown as needed. Return 1 upon
+// success, 0 if memory could not be allocated.
+//
+
+static int
+spindump_main_offline_copy(struct spindump_main_offline* offline,
+                           const struct spindump_packet* packet,
+                           size_t* p_used) {
+  if (*p_used + packet->caplen > offline->contentsSize) {
+    size_t newSize = offline->contentsSize == 0 ? 1024 * 1024 : offline->contentsSize * 2;
+    while (newSize < *p_used + packet->caplen) newSize *= 2;
+    unsigned char* newContents = (unsigned char*)spindump_malloc(newSize);
+    if (newContents == 0) {
+      spindump_errorf("cannot allocate %lu bytes for packets", (unsigned long)newSize);
+      return(0);
+    }
+    if (offline->contents != 0) {
+      memcpy(newContents,offline->contents,*p_used);
+      spindump_free(offline->contents);
+    }
+    offline->contents = newContents;
+    offline->contentsSize = newSize;
+  }
+  memcpy(offline->contents + *p_used,packet->contents,packet->caplen);
+  offline->offsets[offline->nPackets] = *p_used;
+  *p_used += packet->caplen;
+  return(1);
+}
+
+//
+// Decide which worker analyzes a packet. Packets between the same
+// two addresses go to the same worker, regardless of the direction,
+// whether they belong to aggregates or not. Packets that are not IP
+// go to the first worker.
+//
+
+static uint8_t
+spindump_main_offline_route(struct spindump_main_offline* offline,
+                            struct spindump_packet* packet) {
+  spindump_address source;
+  spindump_address destination;
+  if (!spindump_analyze_getaddresses(offline->linktype,packet,&source,&destination)) {
+    return(0);
+  }
+  uint32_t hash = spindump_connectionstable_index_hash(spindump_connection_aggregate_hostpair,
+                                                       &source,
+                                                       &destination,
+                                                       0,
+                                                       0);
+  return((uint8_t)(hash % offline->nWorkers));
+}
+
+//
+// Update the combined aggregates, and output the events the workers
+// recorded while analyzing the chunk together with those of the
+// aggregates. The connections created in the chunk get the ids they
+// would have had if one analyzer had analyzed the packets in
+// order. The workers must be waiting for a command.
+//
+
+static void
+spindump_main_offline_merge(struct spindump_main_offline* offline) {
+
+  //
+  // Make the workers' updates to the combined aggregates
+  //
+
+  spindump_main_offline_replay(offline);
+  
+  //
+  // Turn the numbers of connections created by the packets into the
+  // ids of the first connection created by each packet
+  //
+  
+  for (unsigned int j = 0; j < offline->nPackets; j++) {
+    unsigned int n = offline->nCreated[j];
+    offline->nCreated[j] = offline->nextId;
+    offline->nextId += n;
+  }
+
+  //
+  // Set the ids in the recorded events and in the connections
+  //
+  
+  unsigned long long chunkOrder = spindump_main_offline_creationorder(offline->first);
+  struct spindump_eventformatter* recorders[spindump_eventformatter_maxrecorders];
+  unsigned int nRecorders = 0;
+  if (offline->recorder != 0) recorders[nRecorders++] = offline->recorder;
+  for (unsigned int i = 0; i < offline->nWorkers; i++) {
+    struct spindump_main_offline_worker* worker = &offline->workers[i];
+    if (worker->recorder != 0) {
+      recorders[nRecorders++] = worker->recorder;
+      for (unsigned int k = 0; k < worker->recorder->nRecords; k++) {
+        struct spindump_eventformatter_record* record = &worker->recorder->records[k];
+        if (record->order >= chunkOrder) {
+          record->eventobj.id = spindump_main_offline_id(offline,record->order);
+        }
+      }
+    }
+    struct spindump_connectionstable* table = worker->analyzer->table;
+    for (unsigned int k = table->nConnections; k > 0; k--) {
+      struct spindump_connection* connection = table->connections[k-1];
+      if (connection == 0) continue;
+      if (connection->creationOrder < chunkOrder) break;
+      connection->id = spindump_main_offline_id(offline,connection->creationOrder);
+    }
+  }
+
+  //
+  // Output the events
+  //
+  
+  if (offline->formatter != 0) {
+    spindump_eventformatter_mergerecords(offline->formatter,nRecorders,recorders);
+  }
+}
+
+//
+// Make the updates the workers made to their copies of the
+// aggregates in the chunk to the combined aggregates, in the order
+// one analyzer would have made them, and make the periodic checks of
+// the combined aggregates after the batches of packets
+//
+
+static void
+spindump_main_offline_replay(struct spindump_main_offline* offline) {
+
+  struct spindump_analyze* analyzer = offline->analyzer;
+  struct spindump_stats* stats = spindump_analyze_getstats(analyzer);
+  unsigned int positions[spindump_eventformatter_maxrecorders];
+  memset(positions,0,sizeof(positions));
+  if (analyzer->firstEventTime == 0) analyzer->firstEventTime = offline->firstTimestamp;
+  
+  for (unsigned int j = 0; j < offline->nPackets; j++) {
+
+    //
+    // The updates from analyzing the packet. The packet given to the
+    // aggregates tells whether any handlers were called for it
+    // before each update, in the worker or here.
+    //
+    
+    struct spindump_packet packet = offline->packets[j];
+    spindump_counter_32bit handlerCalls = stats->analyzerHandlerCalls;
+    uint8_t owner = offline->owners[j];
+    struct spindump_main_offline_worker* worker = &offline->workers[owner];
+    while (positions[owner] < worker->nUpdates &&
+           worker->updates[positions[owner]].packet == j &&
+           !worker->updates[positions[owner]].check) {
+      spindump_main_offline_apply(offline,&worker->updates[positions[owner]++],&packet,handlerCalls);
+    }
+
+    //
+    // The updates from the periodic checks after the packet, and the
+    // check of the combined aggregates
+    //
+    
+    if (!offline->batchEnds[j]) continue;
+    for (unsigned int i = 0; i < offline->nWorkers; i++) {
+      worker = &offline->workers[i];
+      while (positions[i] < worker->nUpdates &&
+             worker->updates[positions[i]].packet == j) {
+        spindump_assert(worker->updates[positions[i]].check);
+        spindump_main_offline_apply(offline,&worker->updates[positions[i]++],&packet,handlerCalls);
+      }
+    }
+    if (!spindump_iszerotime(&packet.timestamp)) {
+      if (offline->recorder != 0) {
+        spindump_eventformatter_setrecordkey(offline->recorder,spindump_main_offline_checkkey(offline->first + j));
+      }
+      spindump_connectionstable_periodiccheck(analyzer->table,&packet.timestamp,analyzer,0);
+    }
+    
+  }
+  
+  for (unsigned int i = 0; i < offline->nWorkers; i++) {
+    spindump_assert(positions[i] == offline->workers[i].nUpdates);
+  }
+}
+
+//
+// Make one update of a worker's copy of an aggregate to the combined
+// aggregate. The combined aggregate has the same position in its
+// table as the copy.
+//
+
+static void
+spindump_main_offline_apply(struct spindump_main_offline* offline,
+                            const struct spindump_main_offline_update* entry,
+                            struct spindump_packet* packet,
+                            spindump_counter_32bit handlerCalls) {
+
+  const struct spindump_connectionstable_aggregateupdate* update = &entry->update;
+  struct spindump_analyze* analyzer = offline->analyzer;
+  struct spindump_connectionstable* table = analyzer->table;
+  spindump_assert(update->aggregate->tableIndex < table->nConnections);
+  struct spindump_connection* aggregate = table->connections[update->aggregate->tableIndex];
+  spindump_assert(aggregate != 0);
+  spindump_assert(aggregate->creationOrder == update->aggregate->creationOrder);
+  if (offline->recorder != 0) {
+    spindump_eventformatter_setrecordkey(offline->recorder,entry->key);
+  }
+  
+  struct spindump_connection_set* members;
+  switch (update->type) {
+
+  case spindump_connectionstable_aggregateupdate_join:
+    members = spindump_main_offline_members(aggregate);
+    if (members != 0 && !spindump_connections_set_add(members,update->connection)) {
+      spindump_errorf("connection left out of aggregate %u", aggregate->id);
+    }
+    break;
+
+  case spindump_connectionstable_aggregateupdate_leave:
+    members = spindump_main_offline_members(aggregate);
+    if (members != 0 && spindump_connections_set_inset(members,update->connection)) {
+      spindump_connections_set_remove(members,update->connection);
+    }
+    break;
+
+  case spindump_connectionstable_aggregateupdate_packet:
+    packet->analyzerHandlerCalls = update->handled ? handlerCalls - 1 : handlerCalls;
+    spindump_analyze_process_pakstats(analyzer,
+                                      aggregate,
+                                      &update->timestamp,
+                                      update->fromResponder,
+                                      packet,
+                                      update->ipPacketLength,
+                                      update->ecnFlags);
+    break;
+
+  case spindump_connectionstable_aggregateupdate_rtt:
+    spindump_connections_newrttmeasurement(analyzer,
+                                           packet,
+                                           aggregate,
+                                           update->ipPacketLength,
+                                           update->right,
+                                           update->unidirectional,
+                                           &update->sent,
+                                           &update->rcvd,
+                                           update->why);
+    break;
+
+  default:
+    spindump_errorf("invalid aggregate update type %u", update->type);
+    break;
+    
+  }
+}
+
+//
+// Return the set of the connections that belong to an aggregate
+//
+
+static struct spindump_connection_set*
+spindump_main_offline_members(struct spindump_connection* aggregate) {
+  switch (aggregate->type) {
+  case spindump_connection_aggregate_hostpair:
+    return(&aggregate->u.aggregatehostpair.connections);
+  case spindump_connection_aggregate_hostnetwork:
+    return(&aggregate->u.aggregatehostnetwork.connections);
+  case spindump_connection_aggregate_networknetwork:
+    return(&aggregate->u.aggregatenetworknetwork.connections);
+  case spindump_connection_aggregate_hostmultinet:
+    return(&aggregate->u.aggregatehostmultinet.connections);
+  case spindump_connection_aggregate_networkmultinet:
+    return(&aggregate->u.aggregatenetworkmultinet.connections);
+  case spindump_connection_aggregate_multicastgroup:
+    return(&aggregate->u.aggregatemulticastgroup.connections);
+  case spindump_connection_transport_udp:
+  case spindump_connection_transport_tcp:
+  case spindump_connection_transport_sctp:
+  case spindump_connection_transport_quic:
+  case spindump_connection_transport_dns:
+  case spindump_connection_transport_coap:
+  case spindump_connection_transport_icmp:
+  default:
+    spindump_errorf("invalid aggregate type %u", aggregate->type);
+    return(0);
+  }
+}
+
+//
+// Determine the id of a connection created in the current chunk, from
+// its creationOrder
+//
+
+static unsigned int
+spindump_main_offline_id(struct spindump_main_offline* offline,
+                         unsigned long long creationOrder) {
+  unsigned long long j = (creationOrder >> 16) - 1 - offline->first;
+  spindump_assert(j < offline->nPackets);
+  return(offline->nCreated[j] + (unsigned int)(creationOrder & 0xffff));
+}
+
+//
+// Give the workers a command, and wait until they all have completed
+// it
+//
+
+static void
+spindump_main_offline_command(struct spindump_main_offline* offline,
+                              enum spindump_main_offline_command command) {
+  pthread_mutex_lock(&offline->lock);
+  offline->command = command;
+  offline->generation++;
+  offline->pending = 0;
+  for (unsigned int i = 0; i < offline->nWorkers; i++) {
+    if (offline->workers[i].running) offline->pending++;
+  }
+  pthread_cond_broadcast(&offline->workCond);
+  pthread_mutex_unlock(&offline->lock);
+  spindump_main_offline_wait(offline);
+}
+
+//
+// Wait until all workers have completed the current command
+//
+
+static void
+spindump_main_offline_wait(struct spindump_main_offline* offline) {
+  pthread_mutex_lock(&offline->lock);
+  while (offline->pending > 0) {
+    pthread_cond_wait(&offline->doneCond,&offline->lock);
+  }
+  pthread_mutex_unlock(&offline->lock);
+}
+
+//
+// The main function of a worker thread
+//
+
+static void*
+spindump_main_offline_worker(void* arg) {
+
+  //
+  // Checks
+  //
+
+  spindump_assert(arg != 0);
+  struct spindump_main_offline_worker* worker = (struct spindump_main_offline_worker*)arg;
+  struct spindump_main_offline* offline = worker->offline;
+  spindump_deepdebugf("offline worker %u starting", worker->index);
+
+  //
+  // Set up the analyzer. This is done in the worker thread, so that
+  // the connections are allocated from the memory pool of the thread.
+  //
+
+  int ok = spindump_main_offline_worker_setup(worker);
+  unsigned int generation = 0;
+  pthread_mutex_lock(&offline->lock);
+  if (!ok) offline->failed = 1;
+
+  //
+  // Complete commands until released
+  //
+  
+  for (;;) {
+
+    if (--offline->pending == 0) {
+      pthread_cond_signal(&offline->doneCond);
+    }
+    if (offline->command == spindump_main_offline_command_release) break;
+    while (offline->generation == generation) {
+      pthread_cond_wait(&offline->workCond,&offline->lock);
+    }
+    generation = offline->generation;
+    enum spindump_main_offline_command command = offline->command;
+    pthread_mutex_unlock(&offline->lock);
+    
+    switch (command) {
+      
+    case spindump_main_offline_command_chunk:
+      if (worker->analyzer != 0) spindump_main_offline_worker_chunk(worker);
+      break;
+      
+    case spindump_main_offline_command_finish:
+      if (worker->analyzer != 0) {
+        worker->stats = *spindump_analyze_getstats(worker->analyzer);
+        spindump_pool_getstats(&worker->stats);
+      }
+      break;
+      
+    case spindump_main_offline_command_release:
+      if (worker->recorder != 0) spindump_eventformatter_uninitialize(worker->recorder);
+      if (worker->analyzer != 0) spindump_analyze_uninitialize(worker->analyzer);
+      if (worker->updates != 0) spindump_free(worker->updates);
+      worker->recorder = 0;
+      worker->analyzer = 0;
+      worker->updates = 0;
+      spindump_pool_uninitialize();
+      break;
+
+    case spindump_main_offline_command_setup:
+    default:
+      break;
+      
+    }
+    
+    pthread_mutex_lock(&offline->lock);
+    
+  }
+  
+  pthread_mutex_unlock(&offline->lock);
+  spindump_deepdebugf("offline worker %u done", worker->index);
+  return(0);
+}
+
+//
+// Create an analyzer for the coordinator or a worker
+//
+
+static struct spindump_analyze*
+spindump_main_offline_analyzer(struct spindump_main_configuration* config) {
+  struct spindump_analyze* analyzer = spindump_analyze_initialize(config->showRelativeTime,
+                                                                  config->filterExceptionalValuesPercentage,
+                                                                  config->bandwidthMeasurementPeriod,
+                                                                  config->periodicReportPeriod,
+                                                                  &config->defaultTags);
+  if (analyzer == 0) return(0);
+  analyzer->table->tcpWindow = config->tcpWindow;
+  analyzer->table->bandwidthSeries = config->bandwidthSeries;
+  return(analyzer);
+}
+
+//
+// Set up the analyzer, formatter, and the copy of the aggregates of a
+// worker. The copies only keep track of which connections belong to
+// them, and the updates to them are left for the coordinator. They
+// have the ids of the combined aggregates, and are created before
+// the formatter, so that their events are not recorded. Returns 1
+// upon success, 0 upon failure.
+//
+
+static int
+spindump_main_offline_worker_setup(struct spindump_main_offline_worker* worker) {
+  
+  struct spindump_main_offline* offline = worker->offline;
+  struct spindump_main_configuration* config = &offline->state->config;
+  struct spindump_analyze* analyzer = spindump_main_offline_analyzer(config);
+  if (analyzer == 0) return(0);
+  if (config->preallocateConnections > 0 &&
+      !spindump_pool_preallocate(sizeof(struct spindump_connection),
+                                 (config->preallocateConnections + offline->nWorkers - 1) / offline->nWorkers)) {
+    spindump_analyze_uninitialize(analyzer);
+    return(0);
+  }
+
+  spindump_main_loop_initialize_aggregates(config,analyzer,0);
+  struct spindump_connectionstable* table = analyzer->table;
+  struct spindump_connectionstable* combined = offline->analyzer->table;
+  spindump_assert(table->nConnections == combined->nConnections);
+  for (unsigned int k = 0; k < table->nConnections; k++) {
+    table->connections[k]->id = combined->connections[k]->id;
+  }
+  table->aggregateUpdateHandler = spindump_main_offline_worker_update;
+  table->aggregateUpdateHandlerData = worker;
+
+  if (offline->formatter != 0) {
+    worker->recorder = spindump_eventformatter_initialize_recorder(analyzer,offline->formatter);
+    if (worker->recorder == 0) {
+      spindump_analyze_uninitialize(analyzer);
+      return(0);
+    }
+  }
+  
+  worker->analyzer = analyzer;
+  return(1);
+}
+
+//
+// Analyze this worker's packets in the chunk, and check the
+// connections for timeouts etc. after each batch of packets, like
+// spindump_main_loop_packetloop does
+//
+
+static void
+spindump_main_offline_worker_chunk(struct spindump_main_offline_worker* worker) {
+  
+  struct spindump_main_offline* offline = worker->offline;
+  struct spindump_analyze* analyzer = worker->analyzer;
+  struct spindump_connectionstable* table = analyzer->table;
+  if (analyzer->firstEventTime == 0) analyzer->firstEventTime = offline->firstTimestamp;
+  worker->nUpdates = 0;
+  
+  for (unsigned int j = 0; j < offline->nPackets; j++) {
+
+    unsigned long long index = offline->first + j;
+    struct spindump_packet* packet = &offline->packets[j];
+    worker->packet = j;
+    
+    if (offline->owners[j] == worker->index) {
+      unsigned long long creationOrder = spindump_main_offline_creationorder(index);
+      table->nextCreationOrder = creationOrder;
+      worker->check = 0;
+      worker->key = spindump_main_offline_key(index);
+      if (worker->recorder != 0) {
+        spindump_eventformatter_setrecordkey(worker->recorder,worker->key);
+      }
+      struct spindump_connection* connection = 0;
+      spindump_analyze_process(analyzer,offline->linktype,packet,&connection);
+      offline->nCreated[j] = (unsigned int)(table->nextCreationOrder - creationOrder);
+    }
+
+    if (offline->batchEnds[j] && !spindump_iszerotime(&packet->timestamp)) {
+      worker->check = 1;
+      worker->key = spindump_main_offline_checkkey(index);
+      if (worker->recorder != 0) {
+        spindump_eventformatter_setrecordkey(worker->recorder,worker->key);
+      }
+      spindump_connectionstable_periodiccheck(table,&packet->timestamp,analyzer,0);
+    }
+    
+  }
+}
+
+//
+// Remember an update to the worker's copy of an aggregate, for the
+// coordinator to make to the combined aggregate. The worker's events
+// after an update of a packet get a later key than the events from
+// the update.
+//
+
+static void
+spindump_main_offline_worker_update(const struct spindump_connectionstable_aggregateupdate* update,
+                                    void* handlerData) {
+  
+  struct spindump_main_offline_worker* worker = (struct spindump_main_offline_worker*)handlerData;
+  struct spindump_main_offline* offline = worker->offline;
+  if (worker->nUpdates == worker->maxUpdates) {
+    unsigned int newMax = worker->maxUpdates == 0 ? 64 : worker->maxUpdates * 2;
+    unsigned long size = newMax * sizeof(struct spindump_main_offline_update);
+    struct spindump_main_offline_update* newUpdates = (struct spindump_main_offline_update*)spindump_malloc(size);
+    if (newUpdates == 0) {
+      spindump_errorf("cannot allocate memory for aggregate updates (%lu bytes)", size);
+      return;
+    }
+    if (worker->updates != 0) {
+      memcpy(newUpdates,worker->updates,worker->nUpdates * sizeof(struct spindump_main_offline_update));
+      spindump_free(worker->updates);
+    }
+    worker->updates = newUpdates;
+    worker->maxUpdates = newMax;
+  }
+  
+  struct spindump_main_offline_update* entry = &worker->updates[worker->nUpdates++];
+  entry->packet = worker->packet;
+  entry->check = worker->check;
+  entry->key = worker->key + 1;
+  entry->update = *update;
+  
+  if (!worker->check &&
+      (update->type == spindump_connectionstable_aggregateupdate_packet ||
+       update->type == spindump_connectionstable_aggregateupdate_rtt) &&
+      worker->key + 2 < spindump_main_offline_checkkey(offline->first + worker->packet)) {
+    worker->key += 2;
+    if (worker->recorder != 0) {
+      spindump_eventformatter_setrecordkey(worker->recorder,worker->key);
+    }
+  }
+}
+
+//
+// Print out the connections of all workers and the combined
+// aggregates, in the order in which they were created
+//
+
+void
+spindump_main_offline_report(struct spindump_main_offline* offline,
+                             FILE* file,
+                             int anonymize,
+                             struct spindump_reverse_dns* querier) {
+
+  //
+  // Collect the connections
+  //
+
+  spindump_assert(offline != 0);
+  unsigned int n = 0;
+  if (offline->analyzer != 0) n += offline->analyzer->table->nConnections;
+  for (unsigned int i = 0; i < offline->nWorkers; i++) {
+    if (offline->workers[i].analyzer != 0) n += offline->workers[i].analyzer->table->nConnections;
+  }
+  if (n == 0) return;
+  unsigned int size = n * (unsigned int)sizeof(struct spindump_connection*);
+  struct spindump_connection** connections = (struct spindump_connection**)spindump_malloc(size);
+  if (connections == 0) {
+    spindump_errorf("cannot allocate %u bytes for the connections report", size);
+    return;
+  }
+  n = 0;
+  if (offline->analyzer != 0) {
+    struct spindump_connectionstable* table = offline->analyzer->table;
+    for (unsigned int k = 0; k < table->nConnections; k++) {
+      if (table->connections[k] != 0) connections[n++] = table->connections[k];
+    }
+  }
+  for (unsigned int i = 0; i < offline->nWorkers; i++) {
+    if (offline->workers[i].analyzer == 0) continue;
+    struct spindump_connectionstable* table = offline->workers[i].analyzer->table;
+    for (unsigned int k = 0; k < table->nConnections; k++) {
+      struct spindump_connection* connection = table->connections[k];
+      if (connection != 0 && !spindump_connections_isaggregate(connection)) connections[n++] = connection;
+    }
+  }
+
+  //
+  // Print them in order
+  //
+  
+  qsort(connections,n,sizeof(struct spindump_connection*),spindump_main_offline_compare);
+  for (unsigned int k = 0; k < n; k++) {
+    spindump_connection_report(connections[k],file,anonymize,querier);
+  }
+  spindump_free(connections);
+}
+
+//
+// Order connections by their creationOrder
+//
+
+static int
+spindump_main_offline_compare(const void* a,
+                              const void* b) {
+  const struct spindump_connection* connectionA = *(const struct spindump_connection* const*)a;
+  const struct spindump_connection* connectionB = *(const struct spindump_connection* const*)b;
+  if (connectionA->creationOrder < connectionB->creationOrder) return(-1);
+  if (connectionA->creationOrder > connectionB->creationOrder) return(1);
+  return(0);
+}
+
+//
+// Stop the worker threads, and free the state. The combined
+// aggregates are freed first, as they refer to the connections of
+// the workers. This needs to be done before the memory pool of the
+// calling thread is uninitialized.
+//
+
+void
+spindump_main_offline_uninitialize(struct spindump_main_offline* offline) {
+  spindump_assert(offline != 0);
+  if (offline->recorder != 0) spindump_eventformatter_uninitialize(offline->recorder);
+  if (offline->analyzer != 0) spindump_analyze_uninitialize(offline->analyzer);
+  if (offline->workers != 0) {
+    spindump_main_offline_command(offline,spindump_main_offline_command_release);
+    for (unsigned int i = 0; i < offline->nWorkers; i++) {
+      struct spindump_main_offline_worker* worker = &offline->workers[i];
+      if (!worker->running) continue;
+      pthread_join(worker->thread,0);
+      worker->running = 0;
+    }
+    spindump_free(offline->workers);
+  }
+  if (offline->packets != 0) spindump_free(offline->packets);
+  if (offline->owners != 0) spindump_free(offline->owners);
+  if (offline->batchEnds != 0) spindump_free(offline->batchEnds);
+  if (offline->nCreated != 0) spindump_free(offline->nCreated);
+  if (offline->offsets != 0) spindump_free(offline->offsets);
+  if (offline->contents != 0) spindump_free(offline->contents);
+  pthread_mutex_destroy(&offline->lock);
+  pthread_cond_destroy(&offline->workCond);
+  pthread_cond_destroy(&offline->doneCond);
+  spindump_free(offline);
+}
@@ -0,0 +1,144 @@
+
+//
+//
+//  ////////////////////////////////////////////////////////////////////////////////////
+//  /////////                                                                ///////////
+//  //////       SSS    PPPP    I   N    N   DDDD    U   U   M   M   PPPP         //////
+//  //          S       P   P   I   NN   N   D   D   U   U   MM MM   P   P            //
+//  /            SSS    PPPP    I   N NN N   D   D   U   U   M M M   PPPP              /
+//  //              S   P       I   N   NN   D   D   U   U   M   M   P                //
+//  ////         SSS    P       I   N    N   DDDD     UUU    M   M   P            //////
+//  /////////                                                                ///////////
+//  ////////////////////////////////////////////////////////////////////////////////////
+//
+//  SPINDUMP (C) 2018-2020 BY ERICSSON RESEARCH
+//  AUTHOR: JARI ARKKO
+//
+
+#ifndef SPINDUMP_MAIN_OFFLINE_H
+#define SPINDUMP_MAIN_OFFLINE_H
+
+//
+// Includes -----------------------------------------------------------------------------------
+//
+
+#include <stdio.h>
+#include <pthread.h>
+#include "spindump_util.h"
+#include "spindump_capture.h"
+#include "spindump_analyze.h"
+#include "spindump_eventformatter.h"
+#include "spindump_remote_client.h"
+#include "spindump_main.h"
+#include "spindump_main_lib.h"
+
+//
+// Parameters ---------------------------------------------------------------------------------
+//
+
+#define spindump_main_offline_chunk           65536 // packets
+
+//
+// Data structures ----------------------------------------------------------------------------
+//
+
+//
+// What the workers are asked to do next
+//
+
+enum spindump_main_offline_command {
+  spindump_main_offline_command_setup,
+  spindump_main_offline_command_chunk,
+  spindump_main_offline_command_finish,
+  spindump_main_offline_command_release
+};
+
+//
+// An update of an aggregate, made by a worker to its copy of the
+// aggregate, and later by the coordinator to the combined aggregate
+//
+
+struct spindump_main_offline_update {
+  unsigned int packet;                          // index of the packet in the chunk
+  int check;                                    // made in the periodic check after the packet
+  unsigned long long key;                       // key of the events of the update
+  struct spindump_connectionstable_aggregateupdate update;
+};
+
+//
+// A worker thread, with its own analyzer and connection table
+//
+
+struct spindump_main_offline_worker {
+  unsigned int index;
+  pthread_t thread;
+  int running;                                  // thread has been started
+  struct spindump_main_offline* offline;
+  struct spindump_analyze* analyzer;
+  struct spindump_eventformatter* recorder;     // records the worker's events, if there is output
+  struct spindump_stats stats;                  // statistics when the worker finished
+  unsigned int packet;                          // the packet being analyzed, index in the chunk
+  int check;                                    // in the periodic check after the packet
+  unsigned long long key;                       // key of the events recorded next
+  unsigned int nUpdates;
+  unsigned int maxUpdates;
+  struct spindump_main_offline_update* updates; // the worker's aggregate updates in the chunk
+};
+
+//
+// The state of the coordinator and the workers. The coordinator
+// reads the packets of the file a chunk at a time, and the workers
+// analyze the chunk while the coordinator waits. The fields from
+// command on are protected by the lock.
+//
+
+struct spindump_main_offline {
+  struct spindump_main_state* state;
+  unsigned int nWorkers;
+  struct spindump_main_offline_worker* workers;
+  struct spindump_eventformatter* formatter;    // the coordinator's formatter, if any
+  struct spindump_analyze* analyzer;            // has the combined aggregates
+  struct spindump_eventformatter* recorder;     // records the events of the combined aggregates
+  pthread_mutex_t lock;
+  pthread_cond_t workCond;                      // the workers wait for a command
+  pthread_cond_t doneCond;                      // the coordinator waits for the workers
+  enum spindump_main_offline_command command;
+  unsigned int generation;                      // incremented for every command
+  unsigned int pending;                         // workers that have not completed the command
+  int failed;                                   // a worker could not be set up
+  enum spindump_capture_linktype linktype;
+  unsigned long long first;                     // index of the chunk's first packet in the file
+  unsigned int nPackets;
+  struct spindump_packet* packets;              // the packets of the chunk
+  uint8_t* owners;                              // the worker that analyzes each packet
+  uint8_t* batchEnds;                           // whether a packet ends a capture batch
+  unsigned int* nCreated;                       // number of connections each packet created
+  size_t* offsets;                              // where each packet is in contents
+  unsigned char* contents;                      // packet copies, if the capture reuses its buffers
+  size_t contentsSize;
+  unsigned long long firstTimestamp;            // the time of the first packet in the file
+  unsigned int nextId;                          // the id of the next new connection
+};
+
+//
+// External API interface to this module ------------------------------------------------------
+//
+
+struct spindump_main_offline*
+spindump_main_offline_initialize(struct spindump_main_state* state,
+                                 unsigned int nWorkers);
+void
+spindump_main_offline_run(struct spindump_main_offline* offline,
+                          struct spindump_main_state* state,
+                          struct spindump_analyze* analyzer,
+                          struct spindump_capture_state* capturer,
+                          struct spindump_eventformatter* formatter);
+void
+spindump_main_offline_report(struct spindump_main_offline* offline,
+                             FILE* file,
+                             int anonymize,
+                             struct spindump_reverse_dns* querier);
+void
+spindump_main_offline_uninitialize(struct spindump_main_offline* offline);
+
+#endif // SPINDUMP_MAIN_OFFLINE_H
@@ -0,0 +1,463 @@
+
+//
+//
+//  ////////////////////////////////////////////////////////////////////////////////////
+//  /////////                                                                ///////////
+//  //////       SSS    PPPP    I   N    N   DDDD    U   U   M   M   PPPP         //////
+//  //          S       P   P   I   NN   N   D   D   U   U   MM MM   P   P            //
+//  /            SSS    PPPP    I   N NN N   D   D   U   U   M M M   PPPP              /
+//  //              S   P       I   N   NN   D   D   U   U   M   M   P                //
+//  ////         SSS    P       I   N    N   DDDD     UUU    M   M   P            //////
+//  /////////                                                                ///////////
+//  ////////////////////////////////////////////////////////////////////////////////////
+//
+//  SPINDUMP (C) 2018-2020 BY ERICSSON RESEARCH
+//  AUTHOR: JARI ARKKO
+//
+
+//
+// Includes -----------------------------------------------------------------------------------
+//
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <netinet/in.h>
+#include <netinet/icmp6.h>
+#include "spindump_util.h"
+#include "spindump_protocols.h"
+#include "spindump_analyze_coap.h"
+#include "spindump_analyze_dns.h"
+#include "spindump_analyze_quic_parser.h"
+#include "spindump_remote_client.h"
+#include "spindump_main.h"
+#include "spindump_main_lib.h"
+#include "spindump_main_prefilter.h"
+
+//
+// Data types ---------------------------------------------------------------------------------
+//
+
+struct spindump_main_prefilter_protocol {
+  const char* name;
+  unsigned int protocol;
+  unsigned int headerSize;      // bytes needed after the IP header, 0 if as many as configured
+};
+
+//
+// Macros -------------------------------------------------------------------------------------
+//
+
+//
+// The largest link layer header is the Linux cooked one, and the
+// largest IP header is an IPv4 header with options, larger than an
+// IPv6 header with a fragment header.
+//
+
+#define spindump_main_prefilter_maxlinkheader   spindump_linux_sll_header_size
+#define spindump_main_prefilter_maxipheader     60
+#define spindump_main_prefilter_maxtcpheader    60
+
+//
+// Variables ----------------------------------------------------------------------------------
+//
+
+//
+// The protocols, and how much of their headers the analyzers
+// need. All UDP packets are checked for DNS and QUIC, and QUIC, DNS,
+// and SCTP analysis may look deep into the packets.
+//
+
+static const struct spindump_main_prefilter_protocol spindump_main_prefilter_protocols[] = {
+  { "tcp",  spindump_main_prefilter_tcp,  spindump_main_prefilter_maxtcpheader },
+  { "udp",  spindump_main_prefilter_udp,  0 },
+  { "quic", spindump_main_prefilter_quic, 0 },
+  { "dns",  spindump_main_prefilter_dns,  0 },
+  { "coap", spindump_main_prefilter_coap, (spindump_udp_header_size +
+                                           spindump_dtls_recordlayer_header_size +
+                                           spindump_dtls_handshake_header_size) },
+  { "icmp", spindump_main_prefilter_icmp, spindump_icmp_echo_header_size },
+  { "sctp", spindump_main_prefilter_sctp, 0 }
+};
+
+#define spindump_main_prefilter_nprotocols \
+  (sizeof(spindump_main_prefilter_protocols) / sizeof(spindump_main_prefilter_protocols[0]))
+
+//
+// Function prototypes ------------------------------------------------------------------------
+//
+
+static int
+spindump_main_prefilter_isselected(const struct spindump_main_configuration* config,
+                                   unsigned int protocol);
+static void
+spindump_main_prefilter_protocolexpression(unsigned int protocol,
+                                           char* buf,
+                                           size_t size);
+static int
+spindump_main_prefilter_useaggregates(const struct spindump_main_configuration* config);
+static int
+spindump_main_prefilter_aggregateexpression(const struct spindump_main_configuration* config,
+                                            const struct spindump_main_aggregate* aggregate,
+                                            char* filter,
+                                            size_t size);
+static void
+spindump_main_prefilter_hostexpression(const spindump_address* address,
+                                       char* filter,
+                                       size_t size);
+static void
+spindump_main_prefilter_networkexpression(const spindump_network* network,
+                                          char* filter,
+                                          size_t size);
+
+//
+// Actual code --------------------------------------------------------------------------------
+//
+
+//
+// Parse a comma-separated list of protocol names, such as
+// "tcp,quic,icmp". Returns 1 upon success, 0 upon failure.
+//
+
+int
+spindump_main_prefilter_parseprotocols(const char* string,
+                                       unsigned int* p_protocols) {
+
+  spindump_assert(string != 0);
+  spindump_assert(p_protocols != 0);
+
+  unsigned int protocols = 0;
+  const char* name = string;
+  for (;;) {
+    const char* end = strchr(name,',');
+    size_t length = (end != 0) ? (size_t)(end - name) : strlen(name);
+    unsigned int i;
+    for (i = 0; i < spindump_main_prefilter_nprotocols; i++) {
+      const char* known = spindump_main_prefilter_protocols[i].name;
+      if (strlen(known) == length && strncmp(known,name,length) == 0) break;
+    }
+    if (i == spindump_main_prefilter_nprotocols) {
+      spindump_errorf("unknown protocol in %s, expected tcp, udp, quic, dns, coap, icmp, or sctp", string);
+      return(0);
+    }
+    protocols |= spindump_main_prefilter_protocols[i].protocol;
+    if (end == 0) break;
+    name = end + 1;
+  }
+
+  *p_protocols = protocols;
+  return(1);
+}
+
+//
+// Generate a capture filter from the configuration. The filter lets
+// through only IP packets that are not later fragments, of the
+// configured protocols, and in the aggregate mode, if all that is
+// reported are the configured aggregates, only packets that belong
+// to some aggregate. Returns a newly allocated string, or 0 upon
+// failure.
+//
+
+char*
+spindump_main_prefilter_generate(const struct spindump_main_configuration* config) {
+
+  //
+  // Allocate room for the filter
+  //
+
+  spindump_assert(config != 0);
+  spindump_assert(config->prefilterProtocols != 0);
+  size_t size = 1024 + (2 * config->nAggregates + config->nAggrnetws) * 128;
+  char* filter = (char*)spindump_malloc((unsigned long)size);
+  if (filter == 0) {
+    spindump_errorf("cannot allocate a filter of %lu bytes", (unsigned long)size);
+    return(0);
+  }
+
+  //
+  // Protocols
+  //
+
+  spindump_strlcpy(filter,"(ip6 or ip[6:2] & 0x1fff = 0) and (",size);
+  int first = 1;
+  for (unsigned int i = 0; i < spindump_main_prefilter_nprotocols; i++) {
+    unsigned int protocol = spindump_main_prefilter_protocols[i].protocol;
+    if (!spindump_main_prefilter_isselected(config,protocol)) continue;
+    char expression[200];
+    spindump_main_prefilter_protocolexpression(protocol,expression,sizeof(expression));
+    if (!first) spindump_strlcat(filter," or ",size);
+    spindump_strlcat(filter,"(",size);
+    spindump_strlcat(filter,expression,size);
+    spindump_strlcat(filter,")",size);
+    first = 0;
+  }
+  spindump_strlcat(filter,")",size);
+
+  //
+  // Aggregates
+  //
+
+  if (spindump_main_prefilter_useaggregates(config)) {
+    size_t length = strlen(filter);
+    spindump_strlcat(filter," and (",size);
+    first = 1;
+    for (unsigned int i = 0; i < config->nAggregates; i++) {
+      char expression[1024 + spindump_main_prefilter_maxnetworks * 128];
+      if (!spindump_main_prefilter_aggregateexpression(config,
+                                                       &config->aggregates[i],
+                                                       expression,
+                                                       sizeof(expression))) {
+        continue;
+      }
+      if (!first) spindump_strlcat(filter," or ",size);
+      spindump_strlcat(filter,expression,size);
+      first = 0;
+    }
+    if (first) {
+      filter[length] = 0;
+    } else {
+      spindump_strlcat(filter,")",size);
+    }
+  }
+
+  return(filter);
+}
+
+//
+// Determine how many bytes of each packet need to be captured for
+// the configured protocols, at most the configured snaplen
+//
+
+unsigned int
+spindump_main_prefilter_snaplen(const struct spindump_main_configuration* config) {
+  unsigned int needed = 0;
+  for (unsigned int i = 0; i < spindump_main_prefilter_nprotocols; i++) {
+    const struct spindump_main_prefilter_protocol* protocol = &spindump_main_prefilter_protocols[i];
+    if (!spindump_main_prefilter_isselected(config,protocol->protocol)) continue;
+    if (protocol->headerSize == 0) return(config->snaplen);
+    if (protocol->headerSize > needed) needed = protocol->headerSize;
+  }
+  needed += spindump_main_prefilter_maxlinkheader + spindump_main_prefilter_maxipheader;
+  return(needed < config->snaplen ? needed : config->snaplen);
+}
+
+//
+// Add the generated filter to the configured filter, if any, and
+// reduce the snaplen, unless it has been configured. Returns 1 upon
+// success, 0 upon failure.
+//
+
+int
+spindump_main_prefilter_apply(struct spindump_main_configuration* config) {
+
+  spindump_assert(config != 0);
+  char* generated = spindump_main_prefilter_generate(config);
+  if (generated == 0) return(0);
+
+  if (config->filter != 0) {
+    unsigned long n = strlen(config->filter) + strlen(generated) + 12;
+    char* combined = (char*)spindump_malloc(n);
+    if (combined == 0) {
+      spindump_errorf("cannot allocate a filter of %lu bytes", n);
+      spindump_free(generated);
+      return(0);
+    }
+    snprintf(combined,n,"(%s) and (%s)",config->filter,generated);
+    spindump_free(config->filter);
+    spindump_free(generated);
+    config->filter = combined;
+  } else {
+    config->filter = generated;
+  }
+
+  if (!config->snaplenSet) {
+    config->snaplen = spindump_main_prefilter_snaplen(config);
+  }
+
+  spindump_debugf("generated filter %s, snaplen %u", config->filter, config->snaplen);
+  return(1);
+}
+
+//
+// Is a protocol needed in the filter? Not if it is part of UDP that
+// is let through anyway.
+//
+
+static int
+spindump_main_prefilter_isselected(const struct spindump_main_configuration* config,
+                                   unsigned int protocol) {
+  if ((config->prefilterProtocols & protocol) == 0) return(0);
+  if (protocol == spindump_main_prefilter_quic ||
+      protocol == spindump_main_prefilter_dns ||
+      protocol == spindump_main_prefilter_coap) {
+    return((config->prefilterProtocols & spindump_main_prefilter_udp) == 0);
+  }
+  return(1);
+}
+
+//
+// Write the filter expression for a protocol to buf. ICMP is
+// analyzed only for echo requests and replies.
+//
+
+static void
+spindump_main_prefilter_protocolexpression(unsigned int protocol,
+                                           char* buf,
+                                           size_t size) {
+  switch (protocol) {
+  case spindump_main_prefilter_tcp:
+    snprintf(buf,size,"tcp");
+    break;
+  case spindump_main_prefilter_udp:
+    snprintf(buf,size,"udp");
+    break;
+  case spindump_main_prefilter_quic:
+    snprintf(buf,size,"udp port %u or udp port %u or udp port %u or udp port %u",
+             SPINDUMP_QUIC_PORT1, SPINDUMP_QUIC_PORT2, SPINDUMP_QUIC_PORT3, SPINDUMP_QUIC_PORT4);
+    break;
+  case spindump_main_prefilter_dns:
+    snprintf(buf,size,"udp port %u",
+             SPINDUMP_DNS_PORT);
+    break;
+  case spindump_main_prefilter_coap:
+    snprintf(buf,size,"udp port %u or udp port %u",
+             SPINDUMP_COAP_PORT1, SPINDUMP_COAP_PORT2);
+    break;
+  case spindump_main_prefilter_icmp:
+    snprintf(buf,size,
+             "icmp[icmptype] = icmp-echo or icmp[icmptype] = icmp-echoreply or "
+             "(icmp6 and (ip6[40] = %u or ip6[40] = %u))",
+             ICMP6_ECHO_REQUEST, ICMP6_ECHO_REPLY);
+    break;
+  case spindump_main_prefilter_sctp:
+    snprintf(buf,size,"sctp");
+    break;
+  default:
+    spindump_errorf("invalid protocol %u", protocol);
+    snprintf(buf,size,"ip or ip6");
+    break;
+  }
+}
+
+//
+// Can the filter be limited to the configured aggregates? Only if
+// just the aggregates are reported, and the aggregate mode cannot be
+// toggled, and no aggregate matches everything. Too long lists of
+// networks are not worth putting in a filter.
+//
+
+static int
+spindump_main_prefilter_useaggregates(const struct spindump_main_configuration* config) {
+  if (!config->aggregateMode) return(0);
+  if (config->toolmode != spindump_toolmode_textual &&
+      config->toolmode != spindump_toolmode_silent) return(0);
+  if (config->nAggregates == 0) return(0);
+  if (config->nAggrnetws > spindump_main_prefilter_maxnetworks) return(0);
+  for (unsigned int i = 0; i < config->nAggregates; i++) {
+    if (config->aggregates[i].defaultMatch) return(0);
+  }
+  return(1);
+}
+
+//
+// Write the filter expression for the packets of an aggregate to
+// filter. Returns 0 if the aggregate can match no packets.
+//
+
+static int
+spindump_main_prefilter_aggregateexpression(const struct spindump_main_configuration* config,
+                                            const struct spindump_main_aggregate* aggregate,
+                                            char* filter,
+                                            size_t size) {
+
+  char side[200];
+  spindump_strlcpy(filter,"((",size);
+
+  //
+  // The first side, which for a multicast group is all there is
+  //
+
+  if (aggregate->side1ishost) {
+    spindump_main_prefilter_hostexpression(&aggregate->side1address,side,sizeof(side));
+  } else {
+    spindump_main_prefilter_networkexpression(&aggregate->side1network,side,sizeof(side));
+  }
+  spindump_strlcat(filter,side,size);
+  spindump_strlcat(filter,")",size);
+  if (aggregate->ismulticastgroup) {
+    spindump_strlcat(filter,")",size);
+    return(1);
+  }
+
+  //
+  // The second side
+  //
+
+  spindump_strlcat(filter," and (",size);
+  if (aggregate->side2type == host) {
+    spindump_main_prefilter_hostexpression(&aggregate->side2address,side,sizeof(side));
+    spindump_strlcat(filter,side,size);
+  } else if (aggregate->side2type == network) {
+    spindump_main_prefilter_networkexpression(&aggregate->side2network,side,sizeof(side));
+    spindump_strlcat(filter,side,size);
+  } else {
+    int first = 1;
+    for (unsigned int i = 0; i < config->nAggrnetws; i++) {
+      if (config->aggrnetws[i].aggregate != aggregate) continue;
+      spindump_main_prefilter_networkexpression(&config->aggrnetws[i].network,side,sizeof(side));
+      if (!first) spindump_strlcat(filter," or ",size);
+      spindump_strlcat(filter,side,size);
+      first = 0;
+    }
+    if (first) return(0);
+  }
+  spindump_strlcat(filter,"))",size);
+  return(1);
+}
+
+//
+// Write the filter expression for a host to filter
+//
+
+static void
+spindump_main_prefilter_hostexpression(const spindump_address* address,
+                                       char* filter,
+                                       size_t size) {
+  snprintf(filter,size,"host %s",spindump_address_tostring(address));
+}
+
+//
+// Write the filter expression for a network to filter. A zero-length
+// prefix matches all of IPv4 or IPv6. The PCAP library refuses
+// networks with bits set after the prefix, so those are cleared.
+//
+
+static void
+spindump_main_prefilter_networkexpression(const spindump_network* network,
+                                          char* filter,
+                                          size_t size) {
+  if (network->length == 0) {
+    snprintf(filter,size,"%s",network->address.ss_family == AF_INET6 ? "ip6" : "ip");
+    return;
+  }
+
+  spindump_network prefix = *network;
+  uint8_t* bytes;
+  unsigned int nBytes;
+  if (prefix.address.ss_family == AF_INET6) {
+    bytes = ((struct sockaddr_in6*)&prefix.address)->sin6_addr.s6_addr;
+    nBytes = 16;
+  } else {
+    bytes = (uint8_t*)&((struct sockaddr_in*)&prefix.address)->sin_addr.s_addr;
+    nBytes = 4;
+  }
+  for (unsigned int i = 0; i < nBytes; i++) {
+    unsigned int bit = i * 8;
+    if (bit >= prefix.length) {
+      bytes[i] = 0;
+    } else if (bit + 8 > prefix.length) {
+      bytes[i] &= (uint8_t)(0xff << (8 - (prefix.length - bit)));
+    }
+  }
+  snprintf(filter,size,"net %s",spindump_network_tostring(&prefix));
+}
@@ -0,0 +1,68 @@
+
+//
+//
+//  ////////////////////////////////////////////////////////////////////////////////////
+//  /////////                                                                ///////////
+//  //////       SSS    PPPP    I   N    N   DDDD    U   U   M   M   PPPP         //////
+//  //          S       P   P   I   NN   N   D   D   U   U   MM MM   P   P            //
+//  /            SSS    PPPP    I   N NN N   D   D   U   U   M M M   PPPP              /
+//  //              S   P       I   N   NN   D   D   U   U   M   M   P                //
+//  ////         SSS    P       I   N    N   DDDD     UUU    M   M   P            //////
+//  /////////                                                                ///////////
+//  ////////////////////////////////////////////////////////////////////////////////////
+//
+//  SPINDUMP (C) 2018-2020 BY ERICSSON RESEARCH
+//  AUTHOR: JARI ARKKO
+//
+
+#ifndef SPINDUMP_MAIN_PREFILTER_H
+#define SPINDUMP_MAIN_PREFILTER_H
+
+//
+// Includes -----------------------------------------------------------------------------------
+//
+
+#include "spindump_util.h"
+
+//
+// Parameters ---------------------------------------------------------------------------------
+//
+
+#define spindump_main_prefilter_maxnetworks   256 // beyond this, aggregates do not limit the filter
+
+//
+// Data types ---------------------------------------------------------------------------------
+//
+
+//
+// The protocols that the generated filter lets through. The quic,
+// dns, and coap protocols are UDP on the ports that Spindump uses to
+// recognize them, and are only needed if all of UDP is not.
+//
+
+#define spindump_main_prefilter_tcp           1
+#define spindump_main_prefilter_udp           2
+#define spindump_main_prefilter_quic          4
+#define spindump_main_prefilter_dns           8
+#define spindump_main_prefilter_coap         16
+#define spindump_main_prefilter_icmp         32
+#define spindump_main_prefilter_sctp         64
+#define spindump_main_prefilter_all         127
+
+//
+// External API interface to this module ------------------------------------------------------
+//
+
+struct spindump_main_configuration;
+
+int
+spindump_main_prefilter_parseprotocols(const char* string,
+                                       unsigned int* p_protocols);
+char*
+spindump_main_prefilter_generate(const struct spindump_main_configuration* config);
+unsigned int
+spindump_main_prefilter_snaplen(const struct spindump_main_configuration* config);
+int
+spindump_main_prefilter_apply(struct spindump_main_configuration* config);
+
+#endif // SPINDUMP_MAIN_PREFILTER_H
@@ -0,0 +1,692 @@
+
+//
+//
+//  ////////////////////////////////////////////////////////////////////////////////////
+//  /////////                                                                ///////////
+//  //////       SSS    PPPP    I   N    N   DDDD    U   U   M   M   PPPP         //////
+//  //          S       P   P   I   NN   N   D   D   U   U   MM MM   P   P            //
+//  /            SSS    PPPP    I   N NN N   D   D   U   U   M M M   PPPP              /
+//  //              S   P       I   N   NN   D   D   U   U   M   M   P                //
+//  ////         SSS    P       I   N    N   DDDD     UUU    M   M   P            //////
+//  /////////                                                                ///////////
+//  ////////////////////////////////////////////////////////////////////////////////////
+//
+//  SPINDUMP (C) 2018-2020 BY ERICSSON RESEARCH
+//  AUTHOR: JARI ARKKO
+//
+
+//
+// Includes -----------------------------------------------------------------------------------
+//
+
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <pthread.h>
+#include "spindump_util.h"
+#include "spindump_capture.h"
+#include "spindump_analyze.h"
+#include "spindump_connections.h"
+#include "spindump_pool.h"
+#include "spindump_stats.h"
+#include "spindump_table_eviction.h"
+#include "spindump_eventformatter.h"
+#include "spindump_remote_client.h"
+#include "spindump_main.h"
+#include "spindump_main_lib.h"
+#include "spindump_main_loop.h"
+#include "spindump_main_threads.h"
+
+//
+// Function prototypes ------------------------------------------------------------------------
+//
+
+static void*
+spindump_main_threads_worker(void* arg);
+static int
+spindump_main_threads_worker_setup(struct spindump_main_threads_worker* worker,
+                                   unsigned int nWorkers,
+                                   struct spindump_eventformatter** p_formatter,
+                                   struct spindump_eventformatter** p_remoteFormatter);
+static void
+spindump_main_threads_mergeaggregates(struct spindump_main_threads* threads,
+                                      struct spindump_main_threads_worker* worker,
+                                      struct spindump_analyze* analyzer,
+                                      const spindump_time* now);
+static void
+spindump_main_threads_mergertt(struct spindump_connection* connection,
+                               struct spindump_rtt* source,
+                               struct spindump_main_threads_mark* mark,
+                               unsigned int kind);
+static void
+spindump_main_threads_replayrtts(struct spindump_main_threads* threads,
+                                 struct spindump_analyze* analyzer,
+                                 const spindump_time* now);
+static struct spindump_rtt*
+spindump_main_threads_targetrtt(struct spindump_connection* connection,
+                                unsigned int kind);
+static int
+spindump_main_threads_interrupted(struct spindump_main_state* state);
+static void
+spindump_main_threads_interrupt(struct spindump_main_state* state);
+
+//
+// Actual code --------------------------------------------------------------------------------
+//
+
+//
+// Create the worker threads' state, and open a live capture for each
+// worker. The captures form a PACKET_FANOUT group, in which the
+// kernel distributes packets to workers by a hash of the flow, so
+// that each connection is seen by only one worker. The threads are
+// started only in spindump_main_threads_run, but the captures need
+// to be opened here, before privileges are dropped.
+//
+
+struct spindump_main_threads*
+spindump_main_threads_initialize(struct spindump_main_state* state,
+                                 unsigned int nWorkers) {
+
+  //
+  // Checks
+  //
+
+  spindump_assert(state != 0);
+  spindump_assert(nWorkers > 1 && nWorkers <= spindump_main_threads_max);
+  struct spindump_main_configuration* config = &state->config;
+  
+  //
+  // Allocate
+  //
+
+  unsigned int size = sizeof(struct spindump_main_threads);
+  struct spindump_main_threads* threads = (struct spindump_main_threads*)spindump_malloc(size);
+  if (threads == 0) {
+    spindump_errorf("cannot allocate thread state of %u bytes", size);
+    return(0);
+  }
+  memset(threads,0,sizeof(*threads));
+  
+  size = nWorkers * (unsigned int)sizeof(struct spindump_main_threads_worker);
+  threads->workers = (struct spindump_main_threads_worker*)spindump_malloc(size);
+  if (threads->workers == 0) {
+    spindump_errorf("cannot allocate worker state of %u bytes", size);
+    spindump_free(threads);
+    return(0);
+  }
+  memset(threads->workers,0,size);
+  threads->nWorkers = nWorkers;
+  threads->nAggregates = config->nAggregates;
+
+  if (threads->nAggregates > 0) {
+    size = threads->nAggregates * (unsigned int)sizeof(struct spindump_connection*);
+    threads->aggregates = (struct spindump_connection**)spindump_malloc(size);
+    if (threads->aggregates == 0) {
+      spindump_errorf("cannot allocate aggregate table of %u bytes", size);
+      spindump_main_threads_uninitialize(threads);
+      return(0);
+    }
+    memset(threads->aggregates,0,size);
+  }
+  
+  //
+  // Open the captures
+  //
+
+  unsigned int group = ((unsigned int)getpid()) & 0xffff;
+  for (unsigned int i = 0; i < nWorkers; i++) {
+    
+    struct spindump_main_threads_worker* worker = &threads->workers[i];
+    worker->index = i;
+    worker->state = state;
+    pthread_mutex_init(&worker->lock,0);
+    pthread_cond_init(&worker->cond,0);
+    
+    if (threads->nAggregates > 0) {
+      size = threads->nAggregates * (unsigned int)sizeof(struct spindump_connection*);
+      worker->aggregates = (struct spindump_connection**)spindump_malloc(size);
+      unsigned int marksSize = threads->nAggregates * (unsigned int)sizeof(struct spindump_main_threads_mark);
+      worker->marks = (struct spindump_main_threads_mark*)spindump_malloc(marksSize);
+      if (worker->aggregates == 0 || worker->marks == 0) {
+        spindump_errorf("cannot allocate aggregate tables for worker %u", i);
+        spindump_main_threads_uninitialize(threads);
+        return(0);
+      }
+      memset(worker->aggregates,0,size);
+      memset(worker->marks,0,marksSize);
+    }
+    
+    worker->capturer = spindump_capture_initialize_live(config->interface,
+                                                        config->filter,
+                                                        config->snaplen,
+                                                        config->captureBackend);
+    if (worker->capturer == 0 ||
+        !spindump_capture_setfanout(worker->capturer,group) ||
+        (config->captureRing > 0 &&
+         !spindump_capture_startthread(worker->capturer,config->captureRing))) {
+      spindump_main_threads_uninitialize(threads);
+      return(0);
+    }
+    
+  }
+
+  //
+  // Done
+  //
+
+  spindump_debugf("opened %u worker captures in fanout group %u", nWorkers, group);
+  return(threads);
+}
+
+//
+// Run the worker threads, and act as the coordinator until they all
+// have finished. The coordinator merges the worker's aggregates into
+// its own analyzer's aggregates, reports them, and in the end
+// collects the worker's statistics. The events from the workers are
+// output through the coordinator's formatters.
+//
+
+void
+spindump_main_threads_run(struct spindump_main_threads* threads,
+                          struct spindump_main_state* state,
+                          struct spindump_analyze* analyzer,
+                          struct spindump_eventformatter* formatter,
+                          struct spindump_eventformatter* remoteFormatter) {
+
+  //
+  // Checks
+  //
+
+  spindump_assert(threads != 0);
+  spindump_assert(state != 0);
+  spindump_assert(analyzer != 0);
+  struct spindump_main_configuration* config = &state->config;
+
+  //
+  // Start the workers
+  //
+
+  for (unsigned int i = 0; i < threads->nWorkers; i++) {
+    struct spindump_main_threads_worker* worker = &threads->workers[i];
+    worker->coordinatorFormatter = formatter;
+    worker->coordinatorRemoteFormatter = remoteFormatter;
+    if (pthread_create(&worker->thread,0,spindump_main_threads_worker,worker) != 0) {
+      spindump_errorf("cannot create worker thread %u", i);
+      spindump_main_threads_interrupt(state);
+      break;
+    }
+    worker->running = 1;
+  }
+
+  //
+  // Merge from the workers periodically, until all have finished
+  //
+
+  spindump_time previousCaptureReport;
+  spindump_getcurrenttime(&previousCaptureReport);
+  for (;;) {
+
+    struct timespec pause = { .tv_sec = 0, .tv_nsec = spindump_main_threads_mergeperiod * 1000 };
+    nanosleep(&pause,0);
+    spindump_time now;
+    spindump_getcurrenttime(&now);
+
+    unsigned int nRunning = 0;
+    unsigned int nFinished = 0;
+    unsigned long long received = 0;
+    for (unsigned int i = 0; i < threads->nWorkers; i++) {
+      struct spindump_main_threads_worker* worker = &threads->workers[i];
+      if (!worker->running) continue;
+      nRunning++;
+      pthread_mutex_lock(&worker->lock);
+      if (worker->analyzer != 0) {
+        spindump_main_threads_mergeaggregates(threads,worker,analyzer,&now);
+        received += spindump_analyze_getstats(worker->analyzer)->receivedFrames;
+      }
+      if (worker->finished) nFinished++;
+      pthread_mutex_unlock(&worker->lock);
+    }
+    spindump_main_threads_replayrtts(threads,analyzer,&now);
+    
+    if (config->maxReceive > 0 && received >= config->maxReceive) {
+      spindump_main_threads_interrupt(state);
+    }
+    if (nFinished == nRunning) break;
+    
+    if (spindump_connectionstable_periodiccheck(analyzer->table,
+                                                &now,
+                                                analyzer,
+                                                config->toolmode == spindump_toolmode_connection)) {
+      if (remoteFormatter != 0 && config->remoteBlockSize > 0) {
+        spindump_eventformatter_sendpooled(remoteFormatter);
+      }
+    }
+
+    //
+    // Report the capture counts of all workers together, if it is
+    // time to do so
+    //
+
+    if (config->captureReportPeriod > 0 &&
+        spindump_timediffinusecs(&now,&previousCaptureReport) >=
+        config->captureReportPeriod * 1000ULL * 1000ULL) {
+      struct spindump_stats captureStats;
+      memset(&captureStats,0,sizeof(captureStats));
+      for (unsigned int i = 0; i < threads->nWorkers; i++) {
+        struct spindump_main_threads_worker* worker = &threads->workers[i];
+        if (!worker->running) continue;
+        pthread_mutex_lock(&worker->lock);
+        if (worker->analyzer != 0) {
+          const struct spindump_stats* workerStats = spindump_analyze_getstats(worker->analyzer);
+          captureStats.receivedFrames += workerStats->receivedFrames;
+          captureStats.captureKernelDrops += workerStats->captureKernelDrops;
+          captureStats.captureInterfaceDrops += workerStats->captureInterfaceDrops;
+          captureStats.captureRingOverflows += workerStats->captureRingOverflows;
+        }
+        pthread_mutex_unlock(&worker->lock);
+      }
+      spindump_main_loop_capturereport(&captureStats,formatter,remoteFormatter,&now);
+      previousCaptureReport = now;
+    }
+    
+  }
+
+  //
+  // Collect the statistics, and let the workers clean up
+  //
+  
+  for (unsigned int i = 0; i < threads->nWorkers; i++) {
+    struct spindump_main_threads_worker* worker = &threads->workers[i];
+    if (!worker->running) continue;
+    pthread_mutex_lock(&worker->lock);
+    spindump_stats_add(spindump_analyze_getstats(analyzer),&worker->stats);
+    worker->released = 1;
+    pthread_cond_signal(&worker->cond);
+    pthread_mutex_unlock(&worker->lock);
+    pthread_join(worker->thread,0);
+    worker->running = 0;
+  }
+}
+
+//
+// The main function of a worker thread
+//
+
+static void*
+spindump_main_threads_worker(void* arg) {
+
+  //
+  // Checks
+  //
+
+  spindump_assert(arg != 0);
+  struct spindump_main_threads_worker* worker = (struct spindump_main_threads_worker*)arg;
+  struct spindump_main_state* state = worker->state;
+  struct spindump_main_configuration* config = &state->config;
+  spindump_deepdebugf("worker %u starting", worker->index);
+
+  //
+  // Set up the analyzer. This is done in the worker thread, so that
+  // the connections are allocated from the memory pool of the thread.
+  //
+
+  struct spindump_eventformatter* formatter = 0;
+  struct spindump_eventformatter* remoteFormatter = 0;
+  pthread_mutex_lock(&worker->lock);
+  if (!spindump_main_threads_worker_setup(worker,config->nThreads,&formatter,&remoteFormatter)) {
+    spindump_main_threads_interrupt(state);
+  }
+  struct spindump_analyze* analyzer = worker->analyzer;
+  pthread_mutex_unlock(&worker->lock);
+  
+  //
+  // Packet loop. Only the packet capture is done without the lock.
+  //
+
+  unsigned int batchSize = config->batchSize > 0 ? config->batchSize : spindump_capture_batchsize;
+  int more = 1;
+  spindump_time previousDrops = 0;
+  while (analyzer != 0 && more && !spindump_main_threads_interrupted(state)) {
+
+    struct spindump_stats captureStats;
+    struct spindump_packet* packets = 0;
+    unsigned int nPackets = 0;
+    memset(&captureStats,0,sizeof(captureStats));
+    spindump_capture_nextbatch(worker->capturer,batchSize,&packets,&nPackets,&more,&captureStats);
+
+    pthread_mutex_lock(&worker->lock);
+    struct spindump_stats* stats = spindump_analyze_getstats(analyzer);
+    stats->receivedFrames += captureStats.receivedFrames;
+    if (worker->capturer->ring != 0) {
+      stats->captureRingHighWater = captureStats.captureRingHighWater;
+      stats->captureRingOverflows = captureStats.captureRingOverflows;
+    }
+    if (nPackets > 0) {
+      spindump_analyze_process_batch(analyzer,
+                                     spindump_capture_getlinktype(worker->capturer),
+                                     packets,
+                                     nPackets);
+    }
+    spindump_time now;
+    spindump_getcurrenttime(&now);
+    
+    //
+    // Update the drop counts now and then. Only this thread uses the
+    // capture, so the coordinator reads the counts from the
+    // statistics, under the lock.
+    //
+    
+    if (spindump_timediffinusecs(&now,&previousDrops) >= spindump_capture_dropsperiod) {
+      spindump_capture_getdrops(worker->capturer,stats);
+      previousDrops = now;
+    }
+    spindump_connectionstable_eviction_enforce(analyzer->table,
+                                               analyzer,
+                                               config->toolmode == spindump_toolmode_connection);
+    spindump_connectionstable_periodiccheck(analyzer->table,
+                                            &now,
+                                            analyzer,
+                                            config->toolmode == spindump_toolmode_connection);
+    pthread_mutex_unlock(&worker->lock);
+    
+  }
+
+  //
+  // Done with packets. Wait until the coordinator has merged the
+  // final results.
+  //
+
+  pthread_mutex_lock(&worker->lock);
+  if (analyzer != 0) {
+    spindump_capture_getdrops(worker->capturer,spindump_analyze_getstats(analyzer));
+    worker->stats = *spindump_analyze_getstats(analyzer);
+  }
+  worker->finished = 1;
+  while (!worker->released) {
+    pthread_cond_wait(&worker->cond,&worker->lock);
+  }
+  worker->analyzer = 0;
+  pthread_mutex_unlock(&worker->lock);
+
+  //
+  // Clean up
+  //
+
+  if (formatter != 0) spindump_eventformatter_uninitialize(formatter);
+  if (remoteFormatter != 0) spindump_eventformatter_uninitialize(remoteFormatter);
+  if (analyzer != 0) spindump_analyze_uninitialize(analyzer);
+  spindump_pool_uninitialize();
+  spindump_deepdebugf("worker %u done", worker->index);
+  return(0);
+}
+
+//
+// Set up the analyzer, formatters, and aggregates of a worker. The
+// connection limits are divided evenly among the workers. Returns 1
+// upon success, 0 upon failure.
+//
+
+static int
+spindump_main_threads_worker_setup(struct spindump_main_threads_worker* worker,
+                                   unsigned int nWorkers,
+                                   struct spindump_eventformatter** p_formatter,
+                                   struct spindump_eventformatter** p_remoteFormatter) {
+  
+  struct spindump_main_configuration* config = &worker->state->config;
+  struct spindump_analyze* analyzer = spindump_analyze_initialize(config->showRelativeTime,
+                                                                  config->filterExceptionalValuesPercentage,
+                                                                  config->bandwidthMeasurementPeriod,
+                                                                  config->periodicReportPeriod,
+                                                                  &config->defaultTags);
+  if (analyzer == 0) return(0);
+  if (config->preallocateConnections > 0 &&
+      !spindump_pool_preallocate(sizeof(struct spindump_connection),
+                                 (config->preallocateConnections + nWorkers - 1) / nWorkers)) {
+    spindump_analyze_uninitialize(analyzer);
+    return(0);
+  }
+  spindump_connectionstable_eviction_setlimits(analyzer->table,
+                                               (config->maxConnections + nWorkers - 1) / nWorkers,
+                                               (config->memoryLimit + nWorkers - 1) / nWorkers);
+  analyzer->table->tcpWindow = config->tcpWindow;
+  analyzer->table->bandwidthSeries = config->bandwidthSeries;
+  analyzer->table->mergedAggregates = 1;
+
+  if (worker->coordinatorFormatter != 0) {
+    *p_formatter = spindump_eventformatter_initialize_worker(analyzer,worker->coordinatorFormatter);
+    if (*p_formatter == 0) {
+      spindump_analyze_uninitialize(analyzer);
+      return(0);
+    }
+  }
+  if (worker->coordinatorRemoteFormatter != 0) {
+    *p_remoteFormatter = spindump_eventformatter_initialize_worker(analyzer,worker->coordinatorRemoteFormatter);
+    if (*p_remoteFormatter == 0) {
+      if (*p_formatter != 0) spindump_eventformatter_uninitialize(*p_formatter);
+      *p_formatter = 0;
+      spindump_analyze_uninitialize(analyzer);
+      return(0);
+    }
+  }
+  
+  spindump_main_loop_initialize_aggregates(config,analyzer,worker->aggregates);
+  worker->analyzer = analyzer;
+  return(1);
+}
+
+//
+// Merge the changes in the aggregates of a worker since the previous
+// merge to the corresponding aggregates of the coordinator. Packet
+// and byte counts are added. The RTT histograms and quantile sketches
+// are merged as a whole, and the minimum RTTs are combined. The most
+// recent new RTT measurements are taken for
+// spindump_main_threads_replayrtts. The worker's lock must be held.
+//
+
+static void
+spindump_main_threads_mergeaggregates(struct spindump_main_threads* threads,
+                                      struct spindump_main_threads_worker* worker,
+                                      struct spindump_analyze* analyzer,
+                                      const spindump_time* now) {
+  for (unsigned int i = 0; i < threads->nAggregates; i++) {
+
+    struct spindump_connection* source = worker->aggregates[i];
+    struct spindump_connection* target = threads->aggregates[i];
+    if (source == 0 || target == 0) continue;
+    struct spindump_main_threads_mark* mark = &worker->marks[i];
+
+    //
+    // Packet and byte counts
+    //
+    
+    spindump_counter_64bit fromSide1Diff = source->packetsFromSide1 - mark->packetsFromSide1;
+    spindump_counter_64bit fromSide2Diff = source->packetsFromSide2 - mark->packetsFromSide2;
+    spindump_counter_64bit bytesFromSide1Diff = source->bytesFromSide1.bytes - mark->bytesFromSide1;
+    spindump_counter_64bit bytesFromSide2Diff = source->bytesFromSide2.bytes - mark->bytesFromSide2;
+    if (fromSide1Diff > 0) target->latestPacketFromSide1 = *now;
+    if (fromSide2Diff > 0) target->latestPacketFromSide2 = *now;
+    target->packetsFromSide1 += fromSide1Diff;
+    target->packetsFromSide2 += fromSide2Diff;
+    spindump_bandwidth_newpacket(&target->bytesFromSide1,(unsigned int)bytesFromSide1Diff,now);
+    spindump_bandwidth_newpacket(&target->bytesFromSide2,(unsigned int)bytesFromSide2Diff,now);
+    mark->packetsFromSide1 = source->packetsFromSide1;
+    mark->packetsFromSide2 = source->packetsFromSide2;
+    mark->bytesFromSide1 = source->bytesFromSide1.bytes;
+    mark->bytesFromSide2 = source->bytesFromSide2.bytes;
+
+    //
+    // RTT measurements
+    //
+    
+    spindump_main_threads_mergertt(target,source->leftRTT,mark,0);
+    spindump_main_threads_mergertt(target,source->rightRTT,mark,1);
+    spindump_main_threads_mergertt(target,source->initToRespFullRTT,mark,2);
+    spindump_main_threads_mergertt(target,source->respToInitFullRTT,mark,3);
+    
+  }
+}
+
+//
+// Move the RTT histogram and quantile sketch of a worker's aggregate
+// to the coordinator's aggregate, combine the minimum RTTs, and take
+// the most recent RTT measurements made since the previous merge. The
+// kind is the index of the RTT in the mark's tables.
+//
+
+static void
+spindump_main_threads_mergertt(struct spindump_connection* connection,
+                               struct spindump_rtt* source,
+                               struct spindump_main_threads_mark* mark,
+                               unsigned int kind) {
+  if (source == 0) return;
+  struct spindump_rtt* target = spindump_main_threads_targetrtt(connection,kind);
+  if (target == 0) return;
+  spindump_rtt_mergeinterval(target,source);
+  if (source->minimumRTT < target->minimumRTT) target->minimumRTT = source->minimumRTT;
+  
+  //
+  // Take the new measurements that are still in the worker's table
+  // of recent measurements. The previous ones have already been
+  // replayed.
+  //
+  
+  unsigned int n = source->nMeasurements - mark->rttMeasurements[kind];
+  mark->rttMeasurements[kind] = source->nMeasurements;
+  mark->newRtts[kind] = n;
+  unsigned int available = (n > spindump_rtt_nrecent) ? spindump_rtt_nrecent : n;
+  for (unsigned int i = available; i > 0; i--) {
+    unsigned long rtt = source->recentRTTs[(source->recentTableIndex + spindump_rtt_nrecent - i) % spindump_rtt_nrecent];
+    mark->newRttsNsec[kind][available - i] =
+      (i == 1) ? source->lastRTTNsec : (unsigned long long)rtt * spindump_time_nsecsperusec;
+  }
+}
+
+//
+// Feed the RTT measurements taken from the workers at this merge to the
+// coordinator's aggregates as if they had been measured there, for
+// the latest and the average RTTs. As the average is over the
+// spindump_rtt_nrecent most recent measurements, at most that many
+// measurements are fed in, taken from the workers in proportion to
+// the number of new measurements each of them made. Otherwise a
+// worker with few measurements would count as much as a busy one.
+//
+
+static void
+spindump_main_threads_replayrtts(struct spindump_main_threads* threads,
+                                 struct spindump_analyze* analyzer,
+                                 const spindump_time* now) {
+  for (unsigned int i = 0; i < threads->nAggregates; i++) {
+    struct spindump_connection* target = threads->aggregates[i];
+    if (target == 0) continue;
+    for (unsigned int kind = 0; kind < 4; kind++) {
+
+      //
+      // Count the new measurements of all workers
+      //
+      
+      unsigned long long total = 0;
+      for (unsigned int w = 0; w < threads->nWorkers; w++) {
+        if (threads->workers[w].marks == 0) continue;
+        total += threads->workers[w].marks[i].newRtts[kind];
+      }
+      if (total == 0) continue;
+      unsigned long long quota = (total > spindump_rtt_nrecent) ? spindump_rtt_nrecent : total;
+
+      //
+      // Replay each worker's share of the quota, its most recent
+      // measurements
+      //
+      
+      unsigned long long cumulative = 0;
+      unsigned long long replayed = 0;
+      for (unsigned int w = 0; w < threads->nWorkers; w++) {
+        if (threads->workers[w].marks == 0) continue;
+        struct spindump_main_threads_mark* mark = &threads->workers[w].marks[i];
+        unsigned int n = mark->newRtts[kind];
+        if (n == 0) continue;
+        unsigned int kept = (n > spindump_rtt_nrecent) ? spindump_rtt_nrecent : n;
+        cumulative += n;
+        unsigned int share = (unsigned int)(cumulative * quota / total - replayed);
+        replayed += share;
+        spindump_assert(share <= kept);
+        for (unsigned int j = kept - share; j < kept; j++) {
+          unsigned long long rttNsec = mark->newRttsNsec[kind][j];
+          if (rttNsec > *now) continue;
+          spindump_time sent = *now - rttNsec;
+          spindump_connections_newrttmeasurement(analyzer,
+                                                 0,
+                                                 target,
+                                                 0, // packet length not known
+                                                 (int)(kind & 1),
+                                                 (int)(kind >> 1),
+                                                 &sent,
+                                                 now,
+                                                 "worker update");
+        }
+        mark->newRtts[kind] = 0;
+      }
+    }
+  }
+}
+
+//
+// Return the coordinator's RTT tracker of an aggregate for the given
+// kind of RTT: left, right, init-resp, or resp-init
+//
+
+static struct spindump_rtt*
+spindump_main_threads_targetrtt(struct spindump_connection* connection,
+                                unsigned int kind) {
+  switch (kind) {
+  case 0: return(spindump_connections_newrtt(&connection->leftRTT));
+  case 1: return(spindump_connections_newrtt(&connection->rightRTT));
+  case 2: return(spindump_connections_newrtt(&connection->initToRespFullRTT));
+  default: return(spindump_connections_newrtt(&connection->respToInitFullRTT));
+  }
+}
+
+//
+// Check whether the program has been interrupted, by a signal or
+// another thread
+//
+
+static int
+spindump_main_threads_interrupted(struct spindump_main_state* state) {
+  return(__atomic_load_n(&state->interrupt,__ATOMIC_RELAXED) != 0);
+}
+
+//
+// Ask all threads to stop
+//
+
+static void
+spindump_main_threads_interrupt(struct spindump_main_state* state) {
+  __atomic_store_n(&state->interrupt,1,__ATOMIC_RELAXED);
+}
+
+//
+// Close the captures and free the thread state. The threads must
+// have been stopped.
+//
+
+void
+spindump_main_threads_uninitialize(struct spindump_main_threads* threads) {
+  spindump_assert(threads != 0);
+  if (threads->workers != 0) {
+    for (unsigned int i = 0; i < threads->nWorkers; i++) {
+      struct spindump_main_threads_worker* worker = &threads->workers[i];
+      spindump_assert(!worker->running);
+      if (worker->capturer != 0) spindump_capture_uninitialize(worker->capturer);
+      if (worker->aggregates != 0) spindump_free(worker->aggregates);
+      if (worker->marks != 0) spindump_free(worker->marks);
+      if (worker->state != 0) {
+        pthread_mutex_destroy(&worker->lock);
+        pthread_cond_destroy(&worker->cond);
+      }
+    }
+    spindump_free(threads->workers);
+  }
+  if (threads->aggregates != 0) spindump_free(threads->aggregates);
+  spindump_free(threads);
+}
@@ -0,0 +1,108 @@
+
+//
+//
+//  ////////////////////////////////////////////////////////////////////////////////////
+//  /////////                                                                ///////////
+//  //////       SSS    PPPP    I   N    N   DDDD    U   U   M   M   PPPP         //////
+//  //          S       P   P   I   NN   N   D   D   U   U   MM MM   P   P            //
+//  /            SSS    PPPP    I   N NN N   D   D   U   U   M M M   PPPP              /
+//  //              S   P       I   N   NN   D   D   U   U   M   M   P                //
+//  ////         SSS    P       I   N    N   DDDD     UUU    M   M   P            //////
+//  /////////                                                                ///////////
+//  ////////////////////////////////////////////////////////////////////////////////////
+//
+//  SPINDUMP (C) 2018-2020 BY ERICSSON RESEARCH
+//  AUTHOR: JARI ARKKO
+//
+
+#ifndef SPINDUMP_MAIN_THREADS_H
+#define SPINDUMP_MAIN_THREADS_H
+
+//
+// Includes -----------------------------------------------------------------------------------
+//
+
+#include <pthread.h>
+#include "spindump_util.h"
+#include "spindump_capture.h"
+#include "spindump_analyze.h"
+#include "spindump_eventformatter.h"
+#include "spindump_remote_client.h"
+#include "spindump_main.h"
+#include "spindump_main_lib.h"
+
+//
+// Parameters ---------------------------------------------------------------------------------
+//
+
+#define spindump_main_threads_max             64
+#define spindump_main_threads_mergeperiod     10000 // usec
+
+//
+// Data structures ----------------------------------------------------------------------------
+//
+
+//
+// How much of a worker's aggregate has already been merged into the
+// coordinator's corresponding aggregate
+//
+
+struct spindump_main_threads_mark {
+  spindump_counter_64bit packetsFromSide1;
+  spindump_counter_64bit packetsFromSide2;
+  spindump_counter_64bit bytesFromSide1;
+  spindump_counter_64bit bytesFromSide2;
+  unsigned int rttMeasurements[4];              // left, right, init-resp, resp-init
+  unsigned int newRtts[4];                      // measurements since the previous replay, of each kind
+  unsigned long long
+    newRttsNsec[4][spindump_rtt_nrecent];       // the most recent of them, oldest first
+};
+
+//
+// A worker thread, with its own capture, analyzer, and connection
+// table. The lock is held while the worker updates its analyzer, and
+// by the coordinator when merging from the analyzer.
+//
+
+struct spindump_main_threads_worker {
+  unsigned int index;
+  pthread_t thread;
+  pthread_mutex_t lock;
+  pthread_cond_t cond;
+  int running;                                  // thread has been started
+  int finished;                                 // thread has exited its packet loop
+  int released;                                 // thread may clean up and exit
+  struct spindump_main_state* state;
+  struct spindump_eventformatter* coordinatorFormatter;
+  struct spindump_eventformatter* coordinatorRemoteFormatter;
+  struct spindump_capture_state* capturer;
+  struct spindump_analyze* analyzer;
+  struct spindump_connection** aggregates;      // the worker's aggregates, as configured
+  struct spindump_main_threads_mark* marks;     // one per aggregate
+  struct spindump_stats stats;                  // statistics when the worker finished
+};
+
+struct spindump_main_threads {
+  unsigned int nWorkers;
+  unsigned int nAggregates;
+  struct spindump_main_threads_worker* workers;
+  struct spindump_connection** aggregates;      // the coordinator's aggregates
+};
+
+//
+// External API interface to this module ------------------------------------------------------
+//
+
+struct spindump_main_threads*
+spindump_main_threads_initialize(struct spindump_main_state* state,
+                                 unsigned int nWorkers);
+void
+spindump_main_threads_run(struct spindump_main_threads* threads,
+                          struct spindump_main_state* state,
+                          struct spindump_analyze* analyzer,
+                          struct spindump_eventformatter* formatter,
+                          struct spindump_eventformatter* remoteFormatter);
+void
+spindump_main_threads_uninitialize(struct spindump_main_threads* threads);
+
+#endif // SPINDUMP_MAIN_THREADS_H
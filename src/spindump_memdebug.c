@@ -31,31 +31,81 @@
 #ifdef SPINDUMP_MEMDEBUG
 
 //
-// Debug version of "malloc"
+// Put the memory tags around a block of size + fulloverhead bytes,
+// and return a pointer to the user part of the block
 //
 
 void*
-spindump_memdebug_malloc(size_t size) {
+spindump_memdebug_tagblock(void* block,
+                           size_t size) {
+  spindump_assert(block != 0);
   spindump_assert(size > 0);
   spindump_assert(strlen(spindump_memorytag_begin) == spindump_memorytag_tagoverhead);
   spindump_assert(strlen(spindump_memorytag_end) == spindump_memorytag_tagoverhead);
+  spindump_assert(strlen(spindump_memorytag_freed) == spindump_memorytag_tagoverhead);
   spindump_assert(spindump_memorytag_beginoverhead % 4 == 0);
+  char* charBlock = (char*)block;
+  size_t* blockSize = (size_t*)(charBlock + spindump_memorytag_tagoverhead);
+  void* userBlock = (void*)(charBlock + spindump_memorytag_beginoverhead);
+  char* blockEnd = charBlock + spindump_memorytag_beginoverhead + size;
+  memcpy(charBlock,spindump_memorytag_begin,spindump_memorytag_tagoverhead);
+  *blockSize = size;
+  memcpy(blockEnd,spindump_memorytag_end,spindump_memorytag_tagoverhead);
+#ifdef SPINDUMP_MEMDEBUG_TRASHMEM
+  memset(userBlock,0xf7,size);
+#endif
+  return(userBlock);
+}
+
+//
+// Check the memory tags around the user part of a block, and mark the
+// block freed. Return a pointer to the beginning of the whole block.
+//
+
+void*
+spindump_memdebug_untagblock(void* ptr) {
+  spindump_assert(ptr != 0);
+  char* block = ((char*)ptr) - spindump_memorytag_beginoverhead;
+  size_t* blockSize = (size_t*)(block + spindump_memorytag_tagoverhead);
+  size_t size = *blockSize;
+  spindump_assert(size > 0);
+  char* blockEnd = block + spindump_memorytag_beginoverhead + size;
+  spindump_assert(memcmp(block,spindump_memorytag_begin,spindump_memorytag_tagoverhead) == 0);
+  spindump_assert(memcmp(blockEnd,spindump_memorytag_end,spindump_memorytag_tagoverhead) == 0);
+  memcpy(block,spindump_memorytag_freed,spindump_memorytag_tagoverhead);
+#ifdef SPINDUMP_MEMDEBUG_TRASHMEM
+  memset(ptr,0x6f,size);
+#endif
+  return((void*)block);
+}
+
+//
+// Check that a block that is not supposed to be in use has been
+// marked freed, i.e., that it has not been freed twice or written to
+// after freeing (at least not at the beginning).
+//
+
+void
+spindump_memdebug_checkfreedblock(void* ptr) {
+  spindump_assert(ptr != 0);
+  char* block = ((char*)ptr) - spindump_memorytag_beginoverhead;
+  spindump_assert(memcmp(block,spindump_memorytag_freed,spindump_memorytag_tagoverhead) == 0);
+}
+
+//
+// Debug version of "malloc"
+//
+
+void*
+spindump_memdebug_malloc(size_t size) {
+  spindump_assert(size > 0);
   size_t newSize = size + spindump_memorytag_fulloverhead;
   spindump_assert(newSize > size);
   char* block = (char*)malloc(newSize);
   if (block == 0) {
     return(0);
   } else {
-    size_t* blockSize = (size_t*)(block + spindump_memorytag_tagoverhead);
-    void* userBlock = (void*)(block + spindump_memorytag_beginoverhead);
-    char* blockEnd = block + spindump_memorytag_beginoverhead + size;
-    memcpy(block,spindump_memorytag_begin,spindump_memorytag_tagoverhead);
-    *blockSize = size;
-    memcpy(blockEnd,spindump_memorytag_end,spindump_memorytag_tagoverhead);
-#ifdef SPINDUMP_MEMDEBUG_TRASHMEM
-    memset(userBlock,0xf7,size);
-#endif
-    return(userBlock);
+    return(spindump_memdebug_tagblock(block,size));
   }
 }
 
@@ -83,17 +133,7 @@ spindump_memdebug_strdup(const char* string) {
 void
 spindump_memdebug_free(void* ptr) {
   spindump_assert(ptr != 0);
-  char* block = ((char*)ptr) - spindump_memorytag_beginoverhead;
-  size_t* blockSize = (size_t*)(block + spindump_memorytag_tagoverhead);
-  size_t size = *blockSize;
-  spindump_assert(size > 0);
-  char* blockEnd = block + spindump_memorytag_beginoverhead + size;
-  spindump_assert(memcmp(block,spindump_memorytag_begin,spindump_memorytag_tagoverhead) == 0);
-  spindump_assert(memcmp(blockEnd,spindump_memorytag_end,spindump_memorytag_tagoverhead) == 0);
-#ifdef SPINDUMP_MEMDEBUG_TRASHMEM
-  memset(ptr,0x6f,size);
-#endif
-  free(block);
+  free(spindump_memdebug_untagblock(ptr));
 }
 
 #endif // SPINDUMP_MEMDEBUG
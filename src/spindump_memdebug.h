@@ -37,6 +37,7 @@
 #define spindump_memorytag_fulloverhead                  (spindump_memorytag_beginoverhead+spindump_memorytag_endoverhead)
 #define spindump_memorytag_begin                         "firsttag"
 #define spindump_memorytag_end                           "xyzaazbb"
+#define spindump_memorytag_freed                         "freedtag"
 
 //
 // External API interface to this module ------------------------------------------------------
@@ -48,5 +49,12 @@ char*
 spindump_memdebug_strdup(const char* string);
 void
 spindump_memdebug_free(void* ptr);
+void*
+spindump_memdebug_tagblock(void* block,
+                           size_t size);
+void*
+spindump_memdebug_untagblock(void* ptr);
+void
+spindump_memdebug_checkfreedblock(void* ptr);
 
 #endif // SPINDUMP_MEMDEBUG_H
@@ -23,8 +23,39 @@
 #include <string.h>
 #include <stdlib.h>
 #include "spindump_util.h"
+#include "spindump_pool.h"
 #include "spindump_mid.h"
 
+//
+// Function prototypes ------------------------------------------------------------------------
+//
+
+static unsigned int
+spindump_messageidtracker_hash(const struct spindump_messageidtracker* tracker,
+                               const uint16_t messageid);
+static struct spindump_messageidstore*
+spindump_messageidtracker_find(struct spindump_messageidtracker* tracker,
+                               const uint16_t messageid);
+static void
+spindump_messageidtracker_remove(struct spindump_messageidtracker* tracker,
+                                 struct spindump_messageidstore* entry);
+static int
+spindump_messageidtracker_isexpired(const struct spindump_messageidstore* entry,
+                                    const spindump_time* ts);
+static struct spindump_messageidstore*
+spindump_messageidtracker_findadded(struct spindump_messageidtracker* tracker,
+                                    const struct spindump_messageidstore* added);
+static void
+spindump_messageidtracker_popoldest(struct spindump_messageidtracker* tracker);
+static void
+spindump_messageidtracker_expire(struct spindump_messageidtracker* tracker,
+                                 const spindump_time* ts);
+static void
+spindump_messageidtracker_compact(struct spindump_messageidtracker* tracker);
+static int
+spindump_messageidtracker_resize(struct spindump_messageidtracker* tracker,
+                                 unsigned int newNStored);
+
 //
 // Actual code --------------------------------------------------------------------------------
 //
@@ -36,107 +67,320 @@
 // request. These trackers are used e.g. in the COAP and DNS protocol
 // analyzers.
 //
+// The outstanding identifiers are kept in an open-addressed hash
+// table with linear probing, so that adding and matching identifiers
+// takes constant time even with thousands of requests in flight. The
+// table is allocated when the first identifier is added, and grows
+// as needed.
+//
+// The identifiers are also kept in a ring in the order they were
+// added. Identifiers that have not been responded to within
+// spindump_messageidtracker_lifetime expire, and are dropped from
+// the head of the ring as new identifiers are added. If the table is
+// full even so, the oldest identifier is dropped to make room for
+// the new one. Responded identifiers stay in the ring until they
+// reach its head, or until the ring fills up and is compacted.
+//
 
 void
 spindump_messageidtracker_initialize(struct spindump_messageidtracker* tracker) {
   spindump_assert(tracker != 0);
   memset(tracker,0,sizeof(*tracker));
-  tracker->messageidindex = 0;
 }
 
 //
-// Add a new message ID to the tracker
+// Find the position in the table where a search for a message ID
+// starts
+//
+
+static unsigned int
+spindump_messageidtracker_hash(const struct spindump_messageidtracker* tracker,
+                               const uint16_t messageid) {
+  uint32_t hash = ((uint32_t)messageid * 2654435761U) >> 16;
+  return(hash & (tracker->nStored - 1));
+}
+
+//
+// Find the table entry of an outstanding message ID, or return 0 if
+// there is no such entry
+//
+
+static struct spindump_messageidstore*
+spindump_messageidtracker_find(struct spindump_messageidtracker* tracker,
+                               const uint16_t messageid) {
+  if (tracker->stored == 0) return(0);
+  for (unsigned int i = spindump_messageidtracker_hash(tracker,messageid);
+       tracker->stored[i].outstanding;
+       i = (i + 1) & (tracker->nStored - 1)) {
+    if (tracker->stored[i].messageid == messageid) return(&tracker->stored[i]);
+  }
+  return(0);
+}
+
+//
+// Remove an entry from the table. The entries after it in the same
+// run of used entries are moved back as needed, so that searches
+// never need to skip over removed entries.
+//
+
+static void
+spindump_messageidtracker_remove(struct spindump_messageidtracker* tracker,
+                                 struct spindump_messageidstore* entry) {
+  unsigned int mask = tracker->nStored - 1;
+  unsigned int hole = (unsigned int)(entry - tracker->stored);
+  for (unsigned int i = (hole + 1) & mask;
+       tracker->stored[i].outstanding;
+       i = (i + 1) & mask) {
+    unsigned int home = spindump_messageidtracker_hash(tracker,tracker->stored[i].messageid);
+    int reachable = (hole <= i) ? (hole < home && home <= i) : (hole < home || home <= i);
+    if (reachable) continue;
+    tracker->stored[hole] = tracker->stored[i];
+    hole = i;
+  }
+  tracker->stored[hole].outstanding = 0;
+  tracker->n--;
+}
+
+//
+// Has an outstanding message ID been waiting for a response for so
+// long that no response is expected anymore?
+//
+
+static int
+spindump_messageidtracker_isexpired(const struct spindump_messageidstore* entry,
+                                    const spindump_time* ts) {
+  return(*ts > entry->received &&
+         *ts - entry->received > spindump_messageidtracker_lifetime);
+}
+
+//
+// Find the table entry of a message ID in the ring of added IDs, if
+// it is still outstanding from that same addition. Otherwise the ID
+// has since been responded to, expired, or dropped, and 0 is
+// returned.
+//
+
+static struct spindump_messageidstore*
+spindump_messageidtracker_findadded(struct spindump_messageidtracker* tracker,
+                                    const struct spindump_messageidstore* added) {
+  struct spindump_messageidstore* entry = spindump_messageidtracker_find(tracker,added->messageid);
+  if (entry == 0 || entry->addition != added->addition) return(0);
+  return(entry);
+}
+
+//
+// Drop the oldest ID from the ring, and if it is still outstanding,
+// from the table as well
+//
+
+static void
+spindump_messageidtracker_popoldest(struct spindump_messageidtracker* tracker) {
+  spindump_assert(tracker->nOrder > 0);
+  struct spindump_messageidstore* entry =
+    spindump_messageidtracker_findadded(tracker,&tracker->order[tracker->orderFirst]);
+  if (entry != 0) spindump_messageidtracker_remove(tracker,entry);
+  tracker->orderFirst = (tracker->orderFirst + 1) & (tracker->nStored - 1);
+  tracker->nOrder--;
+}
+
+//
+// Drop the IDs at the head of the ring that have expired or are no
+// longer outstanding. Each added ID is dropped only once, so this
+// takes constant time per added ID on average.
+//
+
+static void
+spindump_messageidtracker_expire(struct spindump_messageidtracker* tracker,
+                                 const spindump_time* ts) {
+  while (tracker->nOrder > 0) {
+    struct spindump_messageidstore* entry =
+      spindump_messageidtracker_findadded(tracker,&tracker->order[tracker->orderFirst]);
+    if (entry != 0 && !spindump_messageidtracker_isexpired(entry,ts)) return;
+    spindump_messageidtracker_popoldest(tracker);
+  }
+}
+
+//
+// Remove the IDs that are no longer outstanding from a full ring,
+// keeping the order of the others. As the table is at most three
+// quarters full, this frees at least a quarter of the ring.
+//
+
+static void
+spindump_messageidtracker_compact(struct spindump_messageidtracker* tracker) {
+  unsigned int mask = tracker->nStored - 1;
+  unsigned int kept = 0;
+  for (unsigned int i = 0; i < tracker->nOrder; i++) {
+    struct spindump_messageidstore* added = &tracker->order[(tracker->orderFirst + i) & mask];
+    if (spindump_messageidtracker_findadded(tracker,added) == 0) continue;
+    tracker->order[(tracker->orderFirst + kept) & mask] = *added;
+    kept++;
+  }
+  spindump_deepdebugf("compacted a message ID ring from %u to %u IDs", tracker->nOrder, kept);
+  tracker->nOrder = kept;
+}
+
+//
+// Move the outstanding message IDs to a table and a ring of a new
+// size. Returns 1 upon success, and 0 if memory could not be
+// allocated, in which case the tracker is unchanged.
+//
+
+static int
+spindump_messageidtracker_resize(struct spindump_messageidtracker* tracker,
+                                 unsigned int newNStored) {
+  
+  //
+  // Allocate
+  //
+  
+  unsigned int size = newNStored * (unsigned int)sizeof(struct spindump_messageidstore);
+  struct spindump_messageidstore* newStored = (struct spindump_messageidstore*)spindump_pool_allocate(size);
+  if (newStored == 0) {
+    spindump_errorf("cannot allocate message ID tracker of %u bytes", size);
+    return(0);
+  }
+  struct spindump_messageidstore* newOrder = (struct spindump_messageidstore*)spindump_pool_allocate(size);
+  if (newOrder == 0) {
+    spindump_errorf("cannot allocate message ID tracker of %u bytes", size);
+    spindump_pool_free(newStored,size);
+    return(0);
+  }
+  memset(newStored,0,size);
+  memset(newOrder,0,size);
+  
+  //
+  // Copy the outstanding IDs to the new ring in the order they were
+  // added
+  //
+  
+  unsigned int newN = 0;
+  for (unsigned int i = 0; i < tracker->nOrder; i++) {
+    const struct spindump_messageidstore* added = &tracker->order[(tracker->orderFirst + i) & (tracker->nStored - 1)];
+    if (spindump_messageidtracker_findadded(tracker,added) != 0) newOrder[newN++] = *added;
+  }
+  spindump_assert(newN == tracker->n);
+  
+  //
+  // Take the new table and ring into use, and insert the IDs to the
+  // table
+  //
+  
+  if (tracker->stored != 0) {
+    unsigned int oldSize = tracker->nStored * (unsigned int)sizeof(struct spindump_messageidstore);
+    spindump_pool_free(tracker->stored,oldSize);
+    spindump_pool_free(tracker->order,oldSize);
+  }
+  tracker->stored = newStored;
+  tracker->order = newOrder;
+  tracker->nStored = newNStored;
+  tracker->orderFirst = 0;
+  tracker->nOrder = newN;
+  for (unsigned int i = 0; i < newN; i++) {
+    unsigned int j = spindump_messageidtracker_hash(tracker,newOrder[i].messageid);
+    while (newStored[j].outstanding) j = (j + 1) & (newNStored - 1);
+    newStored[j] = newOrder[i];
+    newStored[j].outstanding = 1;
+  }
+  spindump_deepdebugf("resized a message ID tracker to %u entries with %u outstanding IDs",
+                      tracker->nStored, tracker->n);
+  return(1);
+}
+
+//
+// Add a new message ID to the tracker. If the same message ID is
+// already outstanding, the time of the earlier request is kept.
 //
 
 void
 spindump_messageidtracker_add(struct spindump_messageidtracker* tracker,
-                              const struct timeval* ts,
+                              const spindump_time* ts,
                               const uint16_t messageid) {
   spindump_assert(tracker != 0);
-  spindump_assert(tracker->messageidindex < spindump_messageidtracker_nstored);
+  spindump_assert(ts != 0);
   spindump_deepdeepdebugf("registering a message id of %u", messageid);
-  tracker->stored[tracker->messageidindex].outstanding = 1;
-  tracker->stored[tracker->messageidindex].received = *ts;
-  tracker->stored[tracker->messageidindex].messageid = messageid;
-  tracker->messageidindex++;
-  tracker->messageidindex %= spindump_messageidtracker_nstored;
-  spindump_assert(tracker->messageidindex < spindump_messageidtracker_nstored);
+  
+  //
+  // Allocate the table upon the first message ID, and drop the IDs
+  // that have expired
+  //
+  
+  if (tracker->stored == 0 &&
+      !spindump_messageidtracker_resize(tracker,spindump_messageidtracker_nstored)) {
+    return;
+  }
+  spindump_messageidtracker_expire(tracker,ts);
+  
+  //
+  // A retransmitted request keeps the time of the original request,
+  // unless the original has already expired
+  //
+  
+  struct spindump_messageidstore* entry = spindump_messageidtracker_find(tracker,messageid);
+  if (entry != 0) {
+    if (!spindump_messageidtracker_isexpired(entry,ts)) return;
+    spindump_messageidtracker_remove(tracker,entry);
+  }
+
+  //
+  // Keep the table at most three quarters full, by growing it or, if
+  // it cannot grow, by dropping the oldest outstanding ID. Make room
+  // in the ring by dropping the IDs no longer outstanding.
+  //
+  
+  if ((tracker->n + 1) * 4 > tracker->nStored * 3 &&
+      (tracker->nStored >= spindump_messageidtracker_maxnstored ||
+       !spindump_messageidtracker_resize(tracker,tracker->nStored * 2))) {
+    spindump_deepdebugf("message ID tracker full, dropping the oldest message id");
+    while (tracker->nOrder > 0 && (tracker->n + 1) * 4 > tracker->nStored * 3) {
+      spindump_messageidtracker_popoldest(tracker);
+    }
+  }
+  if (tracker->nOrder == tracker->nStored) spindump_messageidtracker_compact(tracker);
+  spindump_assert(tracker->nOrder < tracker->nStored);
+  
+  //
+  // Insert the new message ID to the table and the ring
+  //
+  
+  unsigned int i = spindump_messageidtracker_hash(tracker,messageid);
+  while (tracker->stored[i].outstanding) i = (i + 1) & (tracker->nStored - 1);
+  tracker->stored[i].received = *ts;
+  tracker->stored[i].messageid = messageid;
+  tracker->stored[i].outstanding = 1;
+  tracker->stored[i].addition = tracker->nAdditions++;
+  tracker->n++;
+  tracker->order[(tracker->orderFirst + tracker->nOrder) & (tracker->nStored - 1)] = tracker->stored[i];
+  tracker->nOrder++;
 }
 
 //
 // Determine what time the request message was sent for a given
-// message ID. Return a pointer to that time, or 0 if no such message
-// ID has been seen.
+// message ID, when a response arrives at time ts. Return a pointer to
+// that time, or 0 if no such message ID is outstanding. The message
+// ID is no longer outstanding after this.
 //
 
-const struct timeval*
+const spindump_time*
 spindump_messageidtracker_ackto(struct spindump_messageidtracker* tracker,
+                                const spindump_time* ts,
                                 const uint16_t messageid) {
-  
-  //
-  // Find the earliest sent packet that this could be an
-  // acknowledgment for.
-  // 
-  
-  struct spindump_messageidstore* chosen = 0;
-  for (unsigned int i = 0; i < spindump_messageidtracker_nstored; i++) {
-    
-    struct spindump_messageidstore* candidate = &tracker->stored[i];
-
-    //
-    // Is this entry in use? If not, go to next
-    // 
-
-    if (!candidate->outstanding) continue;
-    
-    //
-    // Is this previously seen message ID the one acked by message id
-    // "messageid"?
-    // 
-    
-    if (candidate->messageid == messageid) {
-      
-      //
-      // It is. Now see if this is the earliest one.
-      // 
-      
-      if (chosen == 0)
-        chosen = candidate;
-      else if (spindump_isearliertime(&chosen->received,&candidate->received))
-        chosen = candidate;
-    }
-  }
-  
-  if (chosen != 0) {
-    
-    //
-    // Found. Return the time when that packet was sent.
-    // But first, clear the message id stores from all entries
-    // sent earlier than the one that we found. And clear this
-    // entry too.
-    // 
-
-    for (unsigned int j = 0; j < spindump_messageidtracker_nstored; j++) {
-      struct spindump_messageidstore* other = &tracker->stored[j];
-      if (other->outstanding && spindump_isearliertime(&chosen->received,&other->received)) {
-        other->outstanding = 0;
-      }
-    }
-    
-    chosen->outstanding = 0;
-    spindump_deepdeepdebugf("matched to an earlier message id of %u", messageid);
-    return(&chosen->received);
-    
-  } else {
-    
-    //
-    // Not found
-    // 
-    
+  spindump_assert(tracker != 0);
+  spindump_assert(ts != 0);
+  struct spindump_messageidstore* entry = spindump_messageidtracker_find(tracker,messageid);
+  if (entry == 0) {
     spindump_deepdeepdebugf("did not find a match to an earlier message id of %u", messageid);
     return(0);
-    
   }
+  int expired = spindump_messageidtracker_isexpired(entry,ts);
+  tracker->matched = entry->received;
+  spindump_messageidtracker_remove(tracker,entry);
+  if (expired) {
+    spindump_deepdeepdebugf("the earlier message id of %u has already expired", messageid);
+    return(0);
+  }
+  spindump_deepdeepdebugf("matched to an earlier message id of %u", messageid);
+  return(&tracker->matched);
 }
 
 //
@@ -146,6 +390,10 @@ spindump_messageidtracker_ackto(struct spindump_messageidtracker* tracker,
 void
 spindump_messageidtracker_uninitialize(struct spindump_messageidtracker* tracker) {
   spindump_assert(tracker != 0);
-  // no-op
+  if (tracker->stored != 0) {
+    unsigned int size = tracker->nStored * (unsigned int)sizeof(struct spindump_messageidstore);
+    spindump_pool_free(tracker->stored,size);
+    spindump_pool_free(tracker->order,size);
+  }
+  memset(tracker,0,sizeof(*tracker));
 }
-
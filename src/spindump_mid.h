@@ -31,23 +31,37 @@
 // Parameters ---------------------------------------------------------------------------------
 //
 
-#define spindump_messageidtracker_nstored               8
+#ifndef spindump_messageidtracker_nstored
+#define spindump_messageidtracker_nstored               16   // initial table size, a power of two
+#endif
+#ifndef spindump_messageidtracker_maxnstored
+#define spindump_messageidtracker_maxnstored            4096 // largest table size, a power of two
+#endif
+#ifndef spindump_messageidtracker_lifetime
+#define spindump_messageidtracker_lifetime              (10 * spindump_time_nsecspersec) // after this, no response is expected
+#endif
 
 //
 // Data structures ----------------------------------------------------------------------------
 //
 
 struct spindump_messageidstore {
-  struct timeval received;
-  int outstanding;
+  spindump_time received;
   uint16_t messageid;
-  uint16_t padding; // unused
+  uint16_t outstanding;
+  uint32_t addition; // sequence number of the addition of the ID
 };
 
 struct spindump_messageidtracker {
-  unsigned int messageidindex;
-  unsigned int padding; // unused padding to align the next field properly
-  struct spindump_messageidstore stored[spindump_messageidtracker_nstored];
+  struct spindump_messageidstore* stored; // open-addressed hash table of outstanding IDs; 0 until first ID
+  struct spindump_messageidstore* order;  // ring of the added IDs, oldest first, including ones no longer
+                                          // outstanding; 0 until first ID
+  unsigned int nStored;                   // allocated size of the table and the ring, a power of two
+  unsigned int n;                         // number of outstanding IDs in the table
+  unsigned int orderFirst;                // position of the oldest ID in the ring
+  unsigned int nOrder;                    // number of IDs in the ring
+  uint32_t nAdditions;                    // number of IDs added so far, wraps around
+  spindump_time matched;                  // when the most recently matched ID was sent
 };
 
 //
@@ -58,10 +72,11 @@ void
 spindump_messageidtracker_initialize(struct spindump_messageidtracker* tracker);
 void
 spindump_messageidtracker_add(struct spindump_messageidtracker* tracker,
-                              const struct timeval* ts,
+                              const spindump_time* ts,
                               const uint16_t messageid);
-const struct timeval*
+const spindump_time*
 spindump_messageidtracker_ackto(struct spindump_messageidtracker* tracker,
+                                const spindump_time* ts,
                                 const uint16_t messageid);
 void
 spindump_messageidtracker_uninitialize(struct spindump_messageidtracker* tracker);
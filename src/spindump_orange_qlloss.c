@@ -27,15 +27,15 @@ void
 spindump_qllosstracker_observeandcalculateloss(struct spindump_analyze* state,
                                                struct spindump_packet* packet,
                                                struct spindump_connection* connection,
-                                               struct timeval* ts,
+                                               spindump_time* ts,
                                                int fromResponder,
                                                unsigned int ipPacketLength,
                                                int ql) {
   struct spindump_qllosstracker* tracker;
   if (fromResponder)
-    tracker = &connection->u.quic.qlFromPeer2to1;
+    tracker = &connection->u.quic.trackers->qlFromPeer2to1;
   else
-    tracker = &connection->u.quic.qlFromPeer1to2;
+    tracker = &connection->u.quic.trackers->qlFromPeer1to2;
   
   // 
   // Let's extract the sQuare and Retransmit bits
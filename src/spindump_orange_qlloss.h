@@ -36,7 +36,7 @@ void
 spindump_qllosstracker_observeandcalculateloss(struct spindump_analyze* state,
                                                struct spindump_packet* packet,
                                                struct spindump_connection* connection,
-                                               struct timeval* ts,
+                                               spindump_time* ts,
                                                int fromResponder,
                                                unsigned int ipPacketLength,
                                                int ql);
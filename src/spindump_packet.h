@@ -34,7 +34,7 @@ struct spindump_packet {
   unsigned int etherlen;                       // The size of the packet, including the
                                                // Ethernet header
   unsigned int caplen;                         // How much of the packet was captured
-  struct timeval timestamp;                    // Reception time of the packet
+  spindump_time timestamp;                     // Reception time of the packet, in nanoseconds
   const unsigned char* contents;               // The whole received packet
   spindump_counter_32bit analyzerHandlerCalls; // A counter, used to determine whether to call
                                                // an extra handler, in case no other handler was
@@ -0,0 +1,350 @@
+
+//
+//
+//  ////////////////////////////////////////////////////////////////////////////////////
+//  /////////                                                                ///////////
+//  //////       SSS    PPPP    I   N    N   DDDD    U   U   M   M   PPPP         //////
+//  //          S       P   P   I   NN   N   D   D   U   U   MM MM   P   P            //
+//  /            SSS    PPPP    I   N NN N   D   D   U   U   M M M   PPPP              /
+//  //              S   P       I   N   NN   D   D   U   U   M   M   P                //
+//  ////         SSS    P       I   N    N   DDDD     UUU    M   M   P            //////
+//  /////////                                                                ///////////
+//  ////////////////////////////////////////////////////////////////////////////////////
+//
+//  SPINDUMP (C) 2018-2020 BY ERICSSON RESEARCH
+//  AUTHOR: JARI ARKKO
+//
+
+//
+// Includes -----------------------------------------------------------------------------------
+//
+
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#ifdef __linux__
+#include <sys/epoll.h>
+#include <sys/timerfd.h>
+#include <sys/eventfd.h>
+#endif
+#include "spindump_util.h"
+#include "spindump_poll.h"
+
+//
+// Function prototypes ------------------------------------------------------------------------
+//
+
+#ifndef __linux__
+static int
+spindump_poll_timeoutms(struct spindump_poll* poller);
+static int
+spindump_poll_timerexpired(struct spindump_poll* poller);
+#endif
+
+//
+// Actual code --------------------------------------------------------------------------------
+//
+
+//
+// Create a poller with no sources. Returns 0 upon failure.
+//
+
+struct spindump_poll*
+spindump_poll_initialize(void) {
+
+  //
+  // Allocate
+  //
+
+  unsigned int size = sizeof(struct spindump_poll);
+  struct spindump_poll* poller = (struct spindump_poll*)spindump_malloc(size);
+  if (poller == 0) {
+    spindump_errorf("cannot allocate poller of %u bytes", size);
+    return(0);
+  }
+
+  //
+  // Initialize
+  //
+
+  memset(poller,0,sizeof(*poller));
+  poller->epollFd = -1;
+  poller->timerFd = -1;
+
+#ifdef __linux__
+  poller->epollFd = epoll_create1(EPOLL_CLOEXEC);
+  if (poller->epollFd < 0) {
+    spindump_errorf("cannot create an epoll instance: %s", strerror(errno));
+    spindump_free(poller);
+    return(0);
+  }
+#endif
+
+  return(poller);
+}
+
+//
+// Add a file descriptor to wait on. The source is reported ready by
+// spindump_poll_wait when the descriptor is readable. Returns 1 upon
+// success, 0 upon failure.
+//
+
+int
+spindump_poll_add(struct spindump_poll* poller,
+                  int fd,
+                  unsigned int source) {
+
+  spindump_assert(poller != 0);
+  spindump_assert(fd >= 0);
+  spindump_assert(source < spindump_poll_maxsources);
+  spindump_assert(!poller->timerSet || source != poller->timerSource);
+  if (poller->nFds >= spindump_poll_maxsources) {
+    spindump_errorf("cannot wait on more than %u file descriptors", spindump_poll_maxsources);
+    return(0);
+  }
+
+#ifdef __linux__
+  struct epoll_event event;
+  memset(&event,0,sizeof(event));
+  event.events = EPOLLIN;
+  event.data.u32 = source;
+  if (epoll_ctl(poller->epollFd,EPOLL_CTL_ADD,fd,&event) < 0) {
+    spindump_errorf("cannot add a file descriptor to epoll: %s", strerror(errno));
+    return(0);
+  }
+#endif
+
+  struct pollfd* entry = &poller->fds[poller->nFds];
+  memset(entry,0,sizeof(*entry));
+  entry->fd = fd;
+  entry->events = POLLIN;
+  poller->fdSources[poller->nFds] = source;
+  poller->nFds++;
+  return(1);
+}
+
+//
+// Set a timer that makes the source ready every period
+// microseconds. If a timer has already been set, it is restarted with
+// the new period. Returns 1 upon success, 0 upon failure.
+//
+
+int
+spindump_poll_settimer(struct spindump_poll* poller,
+                       unsigned int source,
+                       unsigned long long period) {
+
+  spindump_assert(poller != 0);
+  spindump_assert(source < spindump_poll_maxsources);
+  spindump_assert(period > 0);
+  spindump_assert(!poller->timerSet || source == poller->timerSource);
+
+#ifdef __linux__
+  if (poller->timerFd < 0) {
+    poller->timerFd = timerfd_create(CLOCK_MONOTONIC,TFD_NONBLOCK | TFD_CLOEXEC);
+    if (poller->timerFd < 0) {
+      spindump_errorf("cannot create a timer: %s", strerror(errno));
+      return(0);
+    }
+    struct epoll_event event;
+    memset(&event,0,sizeof(event));
+    event.events = EPOLLIN;
+    event.data.u32 = source;
+    if (epoll_ctl(poller->epollFd,EPOLL_CTL_ADD,poller->timerFd,&event) < 0) {
+      spindump_errorf("cannot add a timer to epoll: %s", strerror(errno));
+      close(poller->timerFd);
+      poller->timerFd = -1;
+      return(0);
+    }
+  }
+  struct itimerspec spec;
+  memset(&spec,0,sizeof(spec));
+  spec.it_interval.tv_sec = (time_t)(period / (1000 * 1000));
+  spec.it_interval.tv_nsec = (long)((period % (1000 * 1000)) * 1000);
+  spec.it_value = spec.it_interval;
+  if (timerfd_settime(poller->timerFd,0,&spec,0) < 0) {
+    spindump_errorf("cannot set a timer: %s", strerror(errno));
+    return(0);
+  }
+#endif
+
+  poller->timerSet = 1;
+  poller->timerSource = source;
+  poller->timerPeriod = period;
+  spindump_getcurrenttime(&poller->timerNext);
+  poller->timerNext += period * spindump_time_nsecsperusec;
+  return(1);
+}
+
+//
+// Wait until at least one source is ready, or if block is zero, just
+// check which sources are ready. Returns a bit mask of the ready
+// sources, with bit n set for source n. The timer source is cleared
+// when reported; file descriptors are cleared by reading from them.
+// A signal interrupts the wait, and then the mask may be zero.
+//
+
+uint32_t
+spindump_poll_wait(struct spindump_poll* poller,
+                   int block) {
+
+  spindump_assert(poller != 0);
+  spindump_assert(spindump_isbool(block));
+  uint32_t ready = 0;
+
+#ifdef __linux__
+
+  struct epoll_event events[spindump_poll_maxsources + 1];
+  int n = epoll_wait(poller->epollFd,events,spindump_poll_maxsources + 1,block ? -1 : 0);
+  if (n < 0) {
+    if (errno != EINTR) spindump_errorf("cannot wait in epoll: %s", strerror(errno));
+    return(0);
+  }
+  for (int i = 0; i < n; i++) {
+    unsigned int source = events[i].data.u32;
+    if (poller->timerSet && source == poller->timerSource) {
+      uint64_t expirations;
+      if (read(poller->timerFd,&expirations,sizeof(expirations)) < 0 && errno != EAGAIN) {
+        spindump_errorf("cannot read a timer: %s", strerror(errno));
+      }
+    }
+    ready |= (1U << source);
+  }
+
+#else
+
+  int n = poll(poller->fds,(nfds_t)poller->nFds,block ? spindump_poll_timeoutms(poller) : 0);
+  if (n < 0) {
+    if (errno != EINTR) spindump_errorf("cannot poll: %s", strerror(errno));
+    return(0);
+  }
+  for (unsigned int i = 0; i < poller->nFds && n > 0; i++) {
+    if (poller->fds[i].revents != 0) {
+      ready |= (1U << poller->fdSources[i]);
+    }
+  }
+  if (spindump_poll_timerexpired(poller)) {
+    ready |= (1U << poller->timerSource);
+  }
+
+#endif
+
+  return(ready);
+}
+
+#ifndef __linux__
+
+//
+// Without a timerfd, determine how many milliseconds poll() may wait
+// before the timer expires, or -1 if there's no timer
+//
+
+static int
+spindump_poll_timeoutms(struct spindump_poll* poller) {
+  if (!poller->timerSet) return(-1);
+  spindump_time now;
+  spindump_getcurrenttime(&now);
+  if (!spindump_isearliertime(&poller->timerNext,&now)) return(0);
+  unsigned long long left = spindump_timediffinusecs(&poller->timerNext,&now);
+  return((int)((left + 999) / 1000));
+}
+
+//
+// Without a timerfd, check if the timer has expired, and if so,
+// schedule its next expiry
+//
+
+static int
+spindump_poll_timerexpired(struct spindump_poll* poller) {
+  if (!poller->timerSet) return(0);
+  spindump_time now;
+  spindump_getcurrenttime(&now);
+  if (spindump_isearliertime(&poller->timerNext,&now)) return(0);
+  unsigned long long late = spindump_timediffinusecs(&now,&poller->timerNext);
+  unsigned long long next = poller->timerPeriod - late % poller->timerPeriod;
+  poller->timerNext = now + next * spindump_time_nsecsperusec;
+  return(1);
+}
+
+#endif
+
+//
+// Close the timer and the epoll instance, and free the poller. The
+// file descriptors added to the poller are not closed.
+//
+
+void
+spindump_poll_uninitialize(struct spindump_poll* poller) {
+  spindump_assert(poller != 0);
+  if (poller->timerFd >= 0) close(poller->timerFd);
+  if (poller->epollFd >= 0) close(poller->epollFd);
+  spindump_free(poller);
+}
+
+//
+// Create a notifier. Returns 1 upon success, 0 upon failure.
+//
+
+int
+spindump_poll_notifier_initialize(struct spindump_poll_notifier* notifier) {
+
+  spindump_assert(notifier != 0);
+
+#ifdef __linux__
+  int fd = eventfd(0,EFD_NONBLOCK | EFD_CLOEXEC);
+  if (fd < 0) {
+    spindump_errorf("cannot create an eventfd: %s", strerror(errno));
+    return(0);
+  }
+  notifier->readFd = notifier->writeFd = fd;
+#else
+  int fds[2];
+  if (pipe(fds) < 0) {
+    spindump_errorf("cannot create a pipe: %s", strerror(errno));
+    return(0);
+  }
+  fcntl(fds[0],F_SETFL,fcntl(fds[0],F_GETFL) | O_NONBLOCK);
+  fcntl(fds[1],F_SETFL,fcntl(fds[1],F_GETFL) | O_NONBLOCK);
+  notifier->readFd = fds[0];
+  notifier->writeFd = fds[1];
+#endif
+
+  return(1);
+}
+
+//
+// Make the notifier readable. May be called from any thread.
+//
+
+void
+spindump_poll_notifier_signal(struct spindump_poll_notifier* notifier) {
+  uint64_t one = 1;
+  if (write(notifier->writeFd,&one,sizeof(one)) < 0 && errno != EAGAIN) {
+    spindump_errorf("cannot signal a notifier: %s", strerror(errno));
+  }
+}
+
+//
+// Make the notifier no longer readable. Called by the thread that
+// waits on it, before it checks for whatever the notifier signals, so
+// that no signal is lost.
+//
+
+void
+spindump_poll_notifier_clear(struct spindump_poll_notifier* notifier) {
+  uint64_t value;
+  while (read(notifier->readFd,&value,sizeof(value)) > 0) {
+  }
+}
+
+//
+// Close the notifier
+//
+
+void
+spindump_poll_notifier_uninitialize(struct spindump_poll_notifier* notifier) {
+  spindump_assert(notifier != 0);
+  if (notifier->writeFd != notifier->readFd) close(notifier->writeFd);
+  close(notifier->readFd);
+}
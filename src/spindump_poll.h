@@ -0,0 +1,97 @@
+
+//
+//
+//  ////////////////////////////////////////////////////////////////////////////////////
+//  /////////                                                                ///////////
+//  //////       SSS    PPPP    I   N    N   DDDD    U   U   M   M   PPPP         //////
+//  //          S       P   P   I   NN   N   D   D   U   U   MM MM   P   P            //
+//  /            SSS    PPPP    I   N NN N   D   D   U   U   M M M   PPPP              /
+//  //              S   P       I   N   NN   D   D   U   U   M   M   P                //
+//  ////         SSS    P       I   N    N   DDDD     UUU    M   M   P            //////
+//  /////////                                                                ///////////
+//  ////////////////////////////////////////////////////////////////////////////////////
+//
+//  SPINDUMP (C) 2018-2020 BY ERICSSON RESEARCH
+//  AUTHOR: JARI ARKKO
+//
+
+#ifndef SPINDUMP_POLL_H
+#define SPINDUMP_POLL_H
+
+//
+// Includes -----------------------------------------------------------------------------------
+//
+
+#include <stdint.h>
+#include <poll.h>
+#include <sys/time.h>
+
+//
+// Parameters ---------------------------------------------------------------------------------
+//
+
+#define spindump_poll_maxsources 8
+
+//
+// Data structures ----------------------------------------------------------------------------
+//
+
+//
+// A poller waits until one of a number of sources is ready. Each
+// source is a file descriptor, or a periodic timer, and is identified
+// by a number between 0 and spindump_poll_maxsources-1. On Linux,
+// epoll and timerfd are used; elsewhere, poll() and a timeout.
+//
+
+struct spindump_poll {
+  int epollFd;                                      // -1 if poll() is used
+  unsigned int nFds;                                // file descriptor sources
+  struct pollfd fds[spindump_poll_maxsources];
+  unsigned int fdSources[spindump_poll_maxsources];
+  int timerSet;                                     // is there a timer?
+  unsigned int timerSource;
+  int timerFd;                                      // -1 if there's no timerfd
+  unsigned long long timerPeriod;                   // usecs
+  spindump_time timerNext;                          // when the timer expires next, without a timerfd
+};
+
+//
+// A notifier is a file descriptor that one thread can make readable
+// to wake up another thread waiting in a poller. On Linux, it is an
+// eventfd; elsewhere, a pipe.
+//
+
+struct spindump_poll_notifier {
+  int readFd;
+  int writeFd;
+};
+
+//
+// External API interface to this module ------------------------------------------------------
+//
+
+struct spindump_poll*
+spindump_poll_initialize(void);
+int
+spindump_poll_add(struct spindump_poll* poller,
+                  int fd,
+                  unsigned int source);
+int
+spindump_poll_settimer(struct spindump_poll* poller,
+                       unsigned int source,
+                       unsigned long long period);
+uint32_t
+spindump_poll_wait(struct spindump_poll* poller,
+                   int block);
+void
+spindump_poll_uninitialize(struct spindump_poll* poller);
+int
+spindump_poll_notifier_initialize(struct spindump_poll_notifier* notifier);
+void
+spindump_poll_notifier_signal(struct spindump_poll_notifier* notifier);
+void
+spindump_poll_notifier_clear(struct spindump_poll_notifier* notifier);
+void
+spindump_poll_notifier_uninitialize(struct spindump_poll_notifier* notifier);
+
+#endif // SPINDUMP_POLL_H
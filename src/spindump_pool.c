@@ -0,0 +1,318 @@
+
+//
+//
+//  ////////////////////////////////////////////////////////////////////////////////////
+//  /////////                                                                ///////////
+//  //////       SSS    PPPP    I   N    N   DDDD    U   U   M   M   PPPP         //////
+//  //          S       P   P   I   NN   N   D   D   U   U   MM MM   P   P            //
+//  /            SSS    PPPP    I   N NN N   D   D   U   U   M M M   PPPP              /
+//  //              S   P       I   N   NN   D   D   U   U   M   M   P                //
+//  ////         SSS    P       I   N    N   DDDD     UUU    M   M   P            //////
+//  /////////                                                                ///////////
+//  ////////////////////////////////////////////////////////////////////////////////////
+//
+//  SPINDUMP (C) 2018-2020 BY ERICSSON RESEARCH
+//  AUTHOR: JARI ARKKO
+//
+
+//
+// Includes -----------------------------------------------------------------------------------
+//
+
+#include <stdlib.h>
+#include <string.h>
+#include "spindump_util.h"
+#include "spindump_pool.h"
+
+//
+// Data structures ----------------------------------------------------------------------------
+//
+
+struct spindump_pool_slab {
+  struct spindump_pool_slab* next;                  // next slab of the same size class
+  uint8_t padding[spindump_pool_alignment - sizeof(struct spindump_pool_slab*)]; // objects start aligned after this
+};
+
+struct spindump_pool_class {
+  size_t objectSize;                                // size of objects in this class, as given by users
+  size_t stride;                                    // distance between objects in a slab
+  unsigned int objectsPerSlab;
+  unsigned int nSlabs;
+  unsigned int nObjects;                            // objects in all slabs
+  unsigned int nInUse;                              // objects given out and not yet freed
+  void* freeList;                                   // freed objects, linked through their first bytes
+  void* freshList;                                  // objects never given out, linked the same way
+  struct spindump_pool_slab* slabs;
+};
+
+struct spindump_pool {
+  unsigned int nClasses;
+  struct spindump_pool_class classes[spindump_pool_maxclasses];
+  spindump_counter_64bit allocations;               // objects given out from the pool
+  spindump_counter_64bit reuses;                    // ... of which were previously freed objects
+  spindump_counter_64bit directAllocations;         // objects allocated outside the pool
+  size_t bytesInUse;                                // memory given out and not yet freed, including direct allocations
+};
+
+//
+// Variables ----------------------------------------------------------------------------------
+//
+
+static _Thread_local struct spindump_pool spindump_pool_state;
+
+//
+// Function prototypes ------------------------------------------------------------------------
+//
+
+static struct spindump_pool_class*
+spindump_pool_getclass(size_t size,
+                       int create);
+static int
+spindump_pool_addslab(struct spindump_pool_class* sizeClass);
+
+//
+// Actual code --------------------------------------------------------------------------------
+//
+
+//
+// Find the size class for objects of a given size. If there is no
+// such class and create is set, make one. Return 0 if the objects
+// are not pooled.
+//
+// Classes are created on first use, and are not removed until
+// spindump_pool_uninitialize is called. So an object freed with the
+// same size as it was allocated with always finds the same class (or
+// lack of one).
+//
+// Note: each thread has a pool of its own, objects must be freed by
+// the thread that allocated them.
+//
+
+static struct spindump_pool_class*
+spindump_pool_getclass(size_t size,
+                       int create) {
+  
+  spindump_assert(size > 0);
+  if (size > spindump_pool_maxobjectsize) return(0);
+  
+  for (unsigned int i = 0; i < spindump_pool_state.nClasses; i++) {
+    if (spindump_pool_state.classes[i].objectSize == size) return(&spindump_pool_state.classes[i]);
+  }
+  
+  if (!create || spindump_pool_state.nClasses == spindump_pool_maxclasses) return(0);
+  
+  //
+  // Make a new class. Objects are padded to the alignment, and when
+  // debugging memory, carry the same tags as spindump_malloc'ed
+  // blocks.
+  //
+  
+  struct spindump_pool_class* sizeClass = &spindump_pool_state.classes[spindump_pool_state.nClasses++];
+  memset(sizeClass,0,sizeof(*sizeClass));
+  sizeClass->objectSize = size;
+  size_t stride = size;
+#ifdef SPINDUMP_MEMDEBUG
+  stride += spindump_memorytag_fulloverhead;
+#endif
+  if (stride < sizeof(void*)) stride = sizeof(void*);
+  sizeClass->stride = (stride + spindump_pool_alignment - 1) / spindump_pool_alignment * spindump_pool_alignment;
+  sizeClass->objectsPerSlab = (unsigned int)(spindump_pool_slabsize / sizeClass->stride);
+  if (sizeClass->objectsPerSlab < spindump_pool_minobjectsperslab) sizeClass->objectsPerSlab = spindump_pool_minobjectsperslab;
+  spindump_debugf("created a pool for objects of %u bytes, %u per slab",
+                  (unsigned int)size, sizeClass->objectsPerSlab);
+  return(sizeClass);
+}
+
+//
+// Allocate a new slab for a class, and put its objects on the fresh
+// list. Return 1 upon success, 0 if memory could not be allocated.
+//
+
+static int
+spindump_pool_addslab(struct spindump_pool_class* sizeClass) {
+  
+  size_t size = sizeof(struct spindump_pool_slab) + sizeClass->objectsPerSlab * sizeClass->stride;
+  struct spindump_pool_slab* slab = (struct spindump_pool_slab*)spindump_malloc(size);
+  if (slab == 0) {
+    spindump_errorf("cannot allocate a pool slab of %u bytes", (unsigned int)size);
+    return(0);
+  }
+  slab->next = sizeClass->slabs;
+  sizeClass->slabs = slab;
+  sizeClass->nSlabs++;
+  sizeClass->nObjects += sizeClass->objectsPerSlab;
+  
+  //
+  // Link the objects to the fresh list, in order, so that they get
+  // used from the beginning of the slab
+  //
+  
+  char* objects = (char*)(slab + 1);
+  for (unsigned int i = sizeClass->objectsPerSlab; i > 0; i--) {
+    void* object = objects + (i - 1) * sizeClass->stride;
+#ifdef SPINDUMP_MEMDEBUG
+    object = spindump_memdebug_tagblock(object,sizeClass->objectSize);
+    spindump_memdebug_untagblock(object);
+#endif
+    *(void**)object = sizeClass->freshList;
+    sizeClass->freshList = object;
+  }
+  
+  return(1);
+}
+
+//
+// Allocate an object of a given size. Objects up to
+// spindump_pool_maxobjectsize bytes come from a pool of same-sized
+// objects, and larger ones directly from spindump_malloc. Return 0
+// if memory could not be allocated.
+//
+// Objects need to be freed with spindump_pool_free, giving the same
+// size.
+//
+
+void*
+spindump_pool_allocate(size_t size) {
+  
+  struct spindump_pool_class* sizeClass = spindump_pool_getclass(size,1);
+  if (sizeClass == 0) {
+    spindump_pool_state.directAllocations++;
+    void* object = spindump_malloc(size);
+    if (object != 0) spindump_pool_state.bytesInUse += size;
+    return(object);
+  }
+  
+  //
+  // Previously freed objects are used first, and only then objects
+  // that have never been given out, so that reuses can be counted
+  //
+  
+  void** list = &sizeClass->freeList;
+  int reused = 1;
+  if (*list == 0) {
+    list = &sizeClass->freshList;
+    reused = 0;
+    if (*list == 0 && !spindump_pool_addslab(sizeClass)) return(0);
+  }
+  
+  void* object = *list;
+#ifdef SPINDUMP_MEMDEBUG
+  spindump_memdebug_checkfreedblock(object);
+#endif
+  *list = *(void**)object;
+#ifdef SPINDUMP_MEMDEBUG
+  object = spindump_memdebug_tagblock((char*)object - spindump_memorytag_beginoverhead,size);
+#endif
+  sizeClass->nInUse++;
+  spindump_pool_state.bytesInUse += sizeClass->stride;
+  spindump_pool_state.allocations++;
+  if (reused) spindump_pool_state.reuses++;
+  return(object);
+}
+
+//
+// Return an object to the pool
+//
+
+void
+spindump_pool_free(void* object,
+                   size_t size) {
+  
+  spindump_assert(object != 0);
+  struct spindump_pool_class* sizeClass = spindump_pool_getclass(size,0);
+  if (sizeClass == 0) {
+    spindump_assert(spindump_pool_state.bytesInUse >= size);
+    spindump_pool_state.bytesInUse -= size;
+    spindump_free(object);
+    return;
+  }
+  
+  spindump_assert(sizeClass->nInUse > 0);
+  spindump_assert(spindump_pool_state.bytesInUse >= sizeClass->stride);
+  spindump_pool_state.bytesInUse -= sizeClass->stride;
+#ifdef SPINDUMP_MEMDEBUG
+  spindump_memdebug_untagblock(object);
+#endif
+  *(void**)object = sizeClass->freeList;
+  sizeClass->freeList = object;
+  sizeClass->nInUse--;
+}
+
+//
+// Make sure there are at least nObjects free objects of a given size
+// in the pool, so that they can be allocated without further
+// allocations from the system. Return 1 upon success, 0 if memory
+// could not be allocated or the size is not pooled.
+//
+
+int
+spindump_pool_preallocate(size_t size,
+                          unsigned int nObjects) {
+  struct spindump_pool_class* sizeClass = spindump_pool_getclass(size,1);
+  if (sizeClass == 0) {
+    spindump_errorf("cannot preallocate objects of %u bytes", (unsigned int)size);
+    return(0);
+  }
+  while (sizeClass->nObjects - sizeClass->nInUse < nObjects) {
+    if (!spindump_pool_addslab(sizeClass)) return(0);
+  }
+  spindump_debugf("preallocated %u objects of %u bytes", nObjects, (unsigned int)size);
+  return(1);
+}
+
+//
+// Return the amount of memory currently given out through the pool,
+// in bytes. This includes the objects allocated outside the pool, but
+// not the free objects kept in the pool for reuse.
+//
+
+size_t
+spindump_pool_bytesinuse(void) {
+  return(spindump_pool_state.bytesInUse);
+}
+
+//
+// Copy the pool statistics to a statistics object
+//
+
+void
+spindump_pool_getstats(struct spindump_stats* stats) {
+  spindump_assert(stats != 0);
+  stats->poolSlabs = 0;
+  stats->poolBytes = 0;
+  stats->poolObjectsInUse = 0;
+  stats->poolObjectsFree = 0;
+  for (unsigned int i = 0; i < spindump_pool_state.nClasses; i++) {
+    const struct spindump_pool_class* sizeClass = &spindump_pool_state.classes[i];
+    stats->poolSlabs += sizeClass->nSlabs;
+    stats->poolBytes += sizeClass->nSlabs * (sizeof(struct spindump_pool_slab) + sizeClass->objectsPerSlab * sizeClass->stride);
+    stats->poolObjectsInUse += sizeClass->nInUse;
+    stats->poolObjectsFree += sizeClass->nObjects - sizeClass->nInUse;
+  }
+  stats->poolAllocations = spindump_pool_state.allocations;
+  stats->poolReuses = spindump_pool_state.reuses;
+  stats->poolDirectAllocations = spindump_pool_state.directAllocations;
+}
+
+//
+// Free all the slabs of the pool. All objects need to have been freed
+// before calling this function.
+//
+
+void
+spindump_pool_uninitialize(void) {
+  for (unsigned int i = 0; i < spindump_pool_state.nClasses; i++) {
+    struct spindump_pool_class* sizeClass = &spindump_pool_state.classes[i];
+    if (sizeClass->nInUse > 0) {
+      spindump_debugf("%u pooled objects of %u bytes still in use at uninitialization",
+                      sizeClass->nInUse, (unsigned int)sizeClass->objectSize);
+    }
+    while (sizeClass->slabs != 0) {
+      struct spindump_pool_slab* next = sizeClass->slabs->next;
+      spindump_deepdebugf("free a pool slab in spindump_pool_uninitialize");
+      spindump_free(sizeClass->slabs);
+      sizeClass->slabs = next;
+    }
+  }
+  memset(&spindump_pool_state,0,sizeof(spindump_pool_state));
+}
@@ -0,0 +1,58 @@
+
+//
+//
+//  ////////////////////////////////////////////////////////////////////////////////////
+//  /////////                                                                ///////////
+//  //////       SSS    PPPP    I   N    N   DDDD    U   U   M   M   PPPP         //////
+//  //          S       P   P   I   NN   N   D   D   U   U   MM MM   P   P            //
+//  /            SSS    PPPP    I   N NN N   D   D   U   U   M M M   PPPP              /
+//  //              S   P       I   N   NN   D   D   U   U   M   M   P                //
+//  ////         SSS    P       I   N    N   DDDD     UUU    M   M   P            //////
+//  /////////                                                                ///////////
+//  ////////////////////////////////////////////////////////////////////////////////////
+//
+//  SPINDUMP (C) 2018-2020 BY ERICSSON RESEARCH
+//  AUTHOR: JARI ARKKO
+//
+
+#ifndef SPINDUMP_POOL_H
+#define SPINDUMP_POOL_H
+
+//
+// Includes -----------------------------------------------------------------------------------
+//
+
+#include <stdlib.h>
+#include "spindump_util.h"
+#include "spindump_stats.h"
+
+//
+// Parameters ---------------------------------------------------------------------------------
+//
+
+#define spindump_pool_maxclasses                        16 // number of different object sizes pooled
+#define spindump_pool_maxobjectsize            (64 * 1024) // larger objects are allocated directly
+#define spindump_pool_slabsize                (256 * 1024) // approximate size of one slab, in bytes
+#define spindump_pool_minobjectsperslab                  4
+#define spindump_pool_alignment                         16
+
+//
+// External API interface to this module ------------------------------------------------------
+//
+
+void*
+spindump_pool_allocate(size_t size);
+void
+spindump_pool_free(void* object,
+                   size_t size);
+int
+spindump_pool_preallocate(size_t size,
+                          unsigned int nObjects);
+size_t
+spindump_pool_bytesinuse(void);
+void
+spindump_pool_getstats(struct spindump_stats* stats);
+void
+spindump_pool_uninitialize(void);
+
+#endif // SPINDUMP_POOL_H
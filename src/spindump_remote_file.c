@@ -252,7 +252,7 @@ spindump_remote_file_close(struct spindump_remote_file* object) {
 int
 spindump_remote_file_getupdate(struct spindump_remote_file* object,
                                struct spindump_analyze* analyzer,
-                               struct timeval* timestamp) {
+                               spindump_time* timestamp) {
 
   //
   // Sanity checks and debugs
@@ -270,7 +270,7 @@ spindump_remote_file_getupdate(struct spindump_remote_file* object,
     for (unsigned int i = 0; i < object->nEvents; i++) {
       const struct spindump_event* event = &object->events[i];
       struct spindump_connection* connection = 0;
-      spindump_timestamp_to_timeval(event->timestamp,timestamp);
+      spindump_timestamp_to_time(event->timestamp,timestamp);
       spindump_deepdeepdebugf("spindump_remote_file_getupdate reading timestamp %llu from callback", event->timestamp);
       spindump_analyze_processevent(analyzer,event,&connection);
     }
@@ -54,7 +54,7 @@ spindump_remote_file_init(const char* filename);
 int
 spindump_remote_file_getupdate(struct spindump_remote_file* file,
                                struct spindump_analyze* analyzer,
-                               struct timeval* timestamp);
+                               spindump_time* timestamp);
 void
 spindump_remote_file_close(struct spindump_remote_file* file);
 
@@ -145,6 +145,10 @@ spindump_remote_server_init(spindump_port port) {
   server->nextAddItemIndex = 0;
   server->nextConsumeItemIndex = 0;
   memset(&server->items[0],0,sizeof(server->items));
+  if (!spindump_poll_notifier_initialize(&server->notifier)) {
+    spindump_free(server);
+    return(0);
+  }
 
   //
   // Kick the server going
@@ -157,6 +161,7 @@ spindump_remote_server_init(spindump_port port) {
                                     MHD_OPTION_END);
   if (server->daemon == 0) {
     spindump_errorf("cannot open a server daemon on port %u", server->listenport);
+    spindump_poll_notifier_uninitialize(&server->notifier);
     spindump_free(server);
     return(0);
   }
@@ -191,6 +196,7 @@ spindump_remote_server_close(struct spindump_remote_server* server) {
       spindump_json_value_free(server->items[i]);
     }
   }
+  spindump_poll_notifier_uninitialize(&server->notifier);
   spindump_free(server);
 }
 
@@ -200,6 +206,10 @@ spindump_remote_server_close(struct spindump_remote_server* server) {
 // The spindump_remote_server_getupdate function pulls one such
 // reported event from the server queue and lets the caller handle it.
 //
+// When the queue is empty, the notifier (see
+// spindump_remote_server_getselectablefd) is cleared, so that it
+// becomes readable again only when new events are queued.
+//
 
 int
 spindump_remote_server_getupdate(struct spindump_remote_server* server,
@@ -218,6 +228,9 @@ spindump_remote_server_getupdate(struct spindump_remote_server* server,
   // Check if there is items for us to take
   //
   
+  if (server->nextConsumeItemIndex >= server->nextAddItemIndex) {
+    spindump_poll_notifier_clear(&server->notifier);
+  }
   if (server->nextConsumeItemIndex < server->nextAddItemIndex) {
     unsigned int index = server->nextConsumeItemIndex++ % SPINDUMP_REMOTE_SERVER_MAXSUBMISSIONS;
     spindump_deepdeepdebugf("spindump_remote_server_getupdate took an item %u", index);
@@ -236,6 +249,17 @@ spindump_remote_server_getupdate(struct spindump_remote_server* server,
   }
 }
 
+//
+// Return a file descriptor that becomes readable when events have
+// been queued, for the caller to wait on.
+//
+
+int
+spindump_remote_server_getselectablefd(struct spindump_remote_server* server) {
+  spindump_assert(server != 0);
+  return(server->notifier.readFd);
+}
+
 //
 // Find or allocate a connection object that can be used to store
 // information belonging to a particular client.
@@ -824,6 +848,7 @@ spindump_remote_server_jsonrecordorarraycallback(const struct spindump_json_valu
     }
     server->items[index] = copy;
     server->nextAddItemIndex++;
+    spindump_poll_notifier_signal(&server->notifier);
     spindump_deepdeepdebugf("added an item to the main thread's queue of events to index %u number %u",
                             index,
                             server->nextAddItemIndex);
@@ -29,6 +29,7 @@
 #include "spindump_table.h"
 #include "spindump_eventformatter.h"
 #include "spindump_json.h"
+#include "spindump_poll.h"
 
 //
 // Parameters ---------------------------------------------------------------------------------
@@ -68,6 +69,7 @@ struct spindump_remote_server {
   atomic_uint nextConsumeItemIndex;                   // written by main thread, read by daemon thread
   struct spindump_json_value*
       items[SPINDUMP_REMOTE_SERVER_MAXSUBMISSIONS];   // written by daemon thread, read by the main thread
+  struct spindump_poll_notifier notifier;             // signaled by daemon thread, cleared by main thread
 };
 
 //
@@ -79,6 +81,8 @@ spindump_remote_server_init(spindump_port port);
 int
 spindump_remote_server_getupdate(struct spindump_remote_server* server,
                                  struct spindump_analyze* analyzer);
+int
+spindump_remote_server_getselectablefd(struct spindump_remote_server* server);
 void
 spindump_remote_server_close(struct spindump_remote_server* server);
 
@@ -25,17 +25,37 @@
 #include <stdlib.h>
 #include <string.h>
 #include "spindump_util.h"
+#include "spindump_pool.h"
 #include "spindump_rtt.h"
 
+//
+// Variables ----------------------------------------------------------------------------------
+//
+
+static unsigned int spindump_rtt_histogram_precision = spindump_rtt_histogram_defaultprecision;
+static int spindump_rtt_trackquantiles = 0;
+static int spindump_rtt_trackhistograms = 0;
+
 //
 // Function prototypes ------------------------------------------------------------------------
 //
 
 static int
-spindump_rtt_valuewithinlimits(unsigned long val,
-                               unsigned int n,
-                               struct spindump_rtt* rtt,
-                               unsigned int filterLimitPercentage);
+spindump_rtt_filterlimits(unsigned int n,
+                          struct spindump_rtt* rtt,
+                          unsigned int filterLimitPercentage,
+                          unsigned long* lowerlimit,
+                          unsigned long* upperlimit);
+static void
+spindump_rtt_addrecent(struct spindump_rtt* rtt,
+                       unsigned long val);
+static void
+spindump_rtt_removerecent(struct spindump_rtt* rtt,
+                          unsigned long val);
+static void
+spindump_rtt_sketch_addtobin(struct spindump_rtt_sketch* sketch,
+                             int index,
+                             unsigned int n);
 
 //
 // Actual code --------------------------------------------------------------------------------
@@ -49,27 +69,54 @@ void
 spindump_rtt_initialize(struct spindump_rtt* rtt) {
   spindump_assert(rtt != 0);
   rtt->lastRTT = spindump_rtt_infinite;
+  rtt->lastRTTNsec = 0;
   rtt->lastMovingAvgRTT = spindump_rtt_infinite;
   rtt->lastStandardDeviation = spindump_rtt_infinite;
   rtt->minimumRTT = spindump_rtt_infinite;
   rtt->recentTableIndex = 0;
+  rtt->nMeasurements = 0;
   for (unsigned int i = 0; i < spindump_rtt_nrecent; i++) {
     rtt->recentRTTs[i] = spindump_rtt_infinite;
   }
+  rtt->nRecent = 0;
+  rtt->recentSum = 0;
+  rtt->recentSumSquares = 0;
+  rtt->sketch = 0;
+  rtt->mergedIntervals = 0;
+  spindump_rtt_histogram_initialize(&rtt->histogram);
 }
 
 //
-// Provide a new measurement point
+// Set whether RTT trackers keep a quantile sketch and a histogram of
+// their measurements. Both take memory
+// for every tracker that has measurements, so they are only kept if
+// they are reported.
+//
+
+void
+spindump_rtt_settracking(int quantiles,
+                         int histograms) {
+  spindump_assert(spindump_isbool(quantiles));
+  spindump_assert(spindump_isbool(histograms));
+  spindump_rtt_trackquantiles = quantiles;
+  spindump_rtt_trackhistograms = histograms;
+}
+
+//
+// Provide a new measurement point, in nanoseconds. Returns the
+// measurement in microseconds.
 //
 
 unsigned long
 spindump_rtt_newmeasurement(struct spindump_rtt* rtt,
-                            unsigned long long timediff) {
+                            unsigned long long timediffNsec) {
   
   //
   // Sanity checks and normalization
   // 
   
+  rtt->lastRTTNsec = timediffNsec;
+  unsigned long long timediff = timediffNsec / spindump_time_nsecsperusec;
   if (timediff > spindump_rtt_max) {
     timediff = spindump_rtt_max;
   } else {
@@ -83,19 +130,33 @@ spindump_rtt_newmeasurement(struct spindump_rtt* rtt,
   rtt->lastRTT = (unsigned long)timediff;
 
   //
-  // Update the RTT histogram
+  // Update the RTT histogram and the quantile sketch, if they are
+  // tracked
   //
 
-  spindump_rtt_update_histogram(rtt);
+  if (spindump_rtt_trackhistograms && !rtt->mergedIntervals) {
+    spindump_rtt_histogram_addbin(&rtt->histogram,
+                                  rtt->histogram.precision,
+                                  spindump_rtt_histogram_index(rtt->histogram.precision,rtt->lastRTT),
+                                  1);
+  }
+  if (spindump_rtt_trackquantiles && !rtt->mergedIntervals && spindump_rtt_newsketch(rtt)) {
+    spindump_rtt_sketch_add(rtt->sketch,timediffNsec);
+  }
 
   //
   // Update the table for moving average
   // 
   
   spindump_assert(rtt->recentTableIndex < spindump_rtt_nrecent);
+  if (rtt->recentRTTs[rtt->recentTableIndex] != spindump_rtt_infinite) {
+    spindump_rtt_removerecent(rtt,rtt->recentRTTs[rtt->recentTableIndex]);
+  }
+  spindump_rtt_addrecent(rtt,rtt->lastRTT);
   rtt->recentRTTs[rtt->recentTableIndex] = rtt->lastRTT;
   rtt->recentTableIndex++;
   rtt->recentTableIndex %= spindump_rtt_nrecent;
+  rtt->nMeasurements++;
   spindump_assert(rtt->recentTableIndex < spindump_rtt_nrecent);
 
   //
@@ -109,6 +170,19 @@ spindump_rtt_newmeasurement(struct spindump_rtt* rtt,
   return(rtt->lastRTT);
 }
 
+//
+// Start a new measurement interval, for the quantiles and the
+// histogram. The moving averages and the minimum RTT are not
+// affected.
+//
+
+void
+spindump_rtt_newinterval(struct spindump_rtt* rtt) {
+  spindump_assert(rtt != 0);
+  if (rtt->sketch != 0) spindump_rtt_sketch_initialize(rtt->sketch);
+  spindump_rtt_histogram_reset(&rtt->histogram);
+}
+
 //
 // Uninitialize the RTT tracker object
 //
@@ -116,47 +190,140 @@ spindump_rtt_newmeasurement(struct spindump_rtt* rtt,
 void
 spindump_rtt_uninitialize(struct spindump_rtt* rtt) {
   spindump_assert(rtt != 0);
-  // No-op// 
+  if (rtt->sketch != 0) {
+    spindump_pool_free(rtt->sketch,sizeof(*rtt->sketch));
+    rtt->sketch = 0;
+  }
+  spindump_rtt_histogram_uninitialize(&rtt->histogram);
+}
+
+//
+// Make sure an RTT tracker has a quantile sketch, allocating an empty
+// one if needed. Returns 1 upon success, 0 if memory could not be
+// allocated.
+//
+
+int
+spindump_rtt_newsketch(struct spindump_rtt* rtt) {
+  spindump_assert(rtt != 0);
+  if (rtt->sketch != 0) return(1);
+  unsigned int size = sizeof(*rtt->sketch);
+  rtt->sketch = (struct spindump_rtt_sketch*)spindump_pool_allocate(size);
+  if (rtt->sketch == 0) {
+    spindump_errorf("cannot allocate memory for an RTT quantile sketch of size %u", size);
+    return(0);
+  }
+  spindump_rtt_sketch_initialize(rtt->sketch);
+  return(1);
 }
 
+//
+// Move the histogram and quantile sketch measurements of another RTT
+// tracker to an RTT tracker, and start a new interval in the other
+// one. From then on, the tracker's histogram and sketch only get
+// measurements through this function, so that the measurements
+// merged are not counted again when they are also fed to the tracker
+// through spindump_rtt_newmeasurement. Returns 1 upon success, 0 if
+// memory could not be allocated, in which case some measurements are
+// lost but none are counted twice.
+//
+
+int
+spindump_rtt_mergeinterval(struct spindump_rtt* rtt,
+                           struct spindump_rtt* other) {
+  spindump_assert(rtt != 0);
+  spindump_assert(other != 0);
+  rtt->mergedIntervals = 1;
+  int ok = 1;
+  if (other->sketch != 0 && other->sketch->count > 0) {
+    if (spindump_rtt_newsketch(rtt)) {
+      spindump_rtt_sketch_merge(rtt->sketch,other->sketch);
+    } else {
+      ok = 0;
+    }
+  }
+  if (!spindump_rtt_histogram_merge(&rtt->histogram,&other->histogram)) ok = 0;
+  spindump_rtt_newinterval(other);
+  return(ok);
+}
+
+//
+// Add a measurement to the running sums and the sorted table of the
+// recent measurements
+//
+
+static void
+spindump_rtt_addrecent(struct spindump_rtt* rtt,
+                       unsigned long val) {
+  spindump_assert(rtt->nRecent < spindump_rtt_nrecent);
+  unsigned int i = rtt->nRecent;
+  while (i > 0 && rtt->sortedRTTs[i-1] > val) {
+    rtt->sortedRTTs[i] = rtt->sortedRTTs[i-1];
+    i--;
+  }
+  rtt->sortedRTTs[i] = val;
+  rtt->nRecent++;
+  rtt->recentSum += (unsigned long long)val;
+  rtt->recentSumSquares += (unsigned long long)val * (unsigned long long)val;
+}
+
+//
+// Remove a measurement that falls off the table of recent
+// measurements from the running sums and the sorted table
+//
+
+static void
+spindump_rtt_removerecent(struct spindump_rtt* rtt,
+                          unsigned long val) {
+  spindump_assert(rtt->nRecent > 0);
+  unsigned int i = 0;
+  while (i < rtt->nRecent && rtt->sortedRTTs[i] != val) i++;
+  spindump_assert(i < rtt->nRecent);
+  for (; i + 1 < rtt->nRecent; i++) {
+    rtt->sortedRTTs[i] = rtt->sortedRTTs[i+1];
+  }
+  rtt->nRecent--;
+  rtt->recentSum -= (unsigned long long)val;
+  rtt->recentSumSquares -= (unsigned long long)val * (unsigned long long)val;
+}
+
+//
+// Determine the range of values that are not exceptional, based on
+// the previously calculated average and standard deviation. Returns 0
+// if no filtering should be done, e.g., if there are too few
+// measurements.
+//
+
 static int
-spindump_rtt_valuewithinlimits(unsigned long val,
-                               unsigned int n,
-                               struct spindump_rtt* rtt,
-                               unsigned int filterLimitPercentage) {
-  spindump_deepdeepdebugf("filter check val %lu percentage = %u avg %lu dev %lu n %u",
-                          val,
+spindump_rtt_filterlimits(unsigned int n,
+                          struct spindump_rtt* rtt,
+                          unsigned int filterLimitPercentage,
+                          unsigned long* lowerlimit,
+                          unsigned long* upperlimit) {
+  spindump_deepdeepdebugf("filter check percentage = %u avg %lu dev %lu n %u",
                           filterLimitPercentage,
                           rtt->lastMovingAvgRTT,
                           rtt->lastStandardDeviation,
                           n);
   if (rtt->lastMovingAvgRTT == spindump_rtt_infinite) {
     spindump_deepdeepdebugf("filter exception 1");
-    return(1);
+    return(0);
   }
   if (rtt->lastStandardDeviation == spindump_rtt_infinite) {
     spindump_deepdeepdebugf("filter exception 2");
-    return(1);
+    return(0);
   }
   if (n < spindump_rtt_nminfilter) {
     spindump_deepdeepdebugf("filter exception 3: %u", n);
-    return(1);
+    return(0);
   }
   unsigned long limitdiff =
     (filterLimitPercentage * rtt->lastStandardDeviation) / 100;
-  unsigned long lowerlimit =
+  *lowerlimit =
     rtt->lastMovingAvgRTT > limitdiff ? rtt->lastMovingAvgRTT - limitdiff : 0;
-  unsigned long upperlimit =
+  *upperlimit =
     (rtt->lastMovingAvgRTT + limitdiff >= rtt->lastMovingAvgRTT) ? rtt->lastMovingAvgRTT + limitdiff : spindump_rtt_max;
-  spindump_deepdeepdebugf("filter value %lu limitdiff %lu to within %lu..%lu", val, limitdiff, lowerlimit, upperlimit);
-  if (val < lowerlimit) {
-    spindump_deepdeepdebugf("filter away, too low");
-    return(0);
-  }
-  if (val > upperlimit) {
-    spindump_deepdeepdebugf("filter away, too high");
-    return(0);
-  }
+  spindump_deepdeepdebugf("filter limitdiff %lu to within %lu..%lu", limitdiff, *lowerlimit, *upperlimit);
   return(1);
 }
 
@@ -166,6 +333,11 @@ spindump_rtt_valuewithinlimits(unsigned long val,
 // should be performed, and if so, what percentage of standard
 // deviation is considered exceptional. Output parameters are the
 // standard deviation and filtered average.
+//
+// The sums needed for the average and standard deviation, and the
+// measurements in sorted order, are maintained as measurements come
+// in, so this takes constant time apart from skipping the filtered
+// away measurements.
 // 
   
 unsigned long
@@ -175,11 +347,6 @@ spindump_rtt_calculateLastMovingAvgRTT(struct spindump_rtt* rtt,
                                        unsigned long* standardDeviation,
                                        unsigned long* filteredAvg) {
   
-  unsigned long long sum = 0;
-  unsigned long long devSum = 0;
-  unsigned int n = 0;
-  unsigned int i;
-
   //
   // Sanity checks
   //
@@ -193,13 +360,8 @@ spindump_rtt_calculateLastMovingAvgRTT(struct spindump_rtt* rtt,
   // Calculate basic moving average
   //
   
-  for (i = 0; i < spindump_rtt_nrecent; i++) {
-    unsigned long val = rtt->recentRTTs[i];
-    if (val != spindump_rtt_infinite) {
-      sum += (unsigned long long)val;
-      n++;
-    }
-  }
+  unsigned long long sum = rtt->recentSum;
+  unsigned int n = rtt->nRecent;
   
   if (n == 0) {
     *standardDeviation = 0;
@@ -213,20 +375,15 @@ spindump_rtt_calculateLastMovingAvgRTT(struct spindump_rtt* rtt,
   unsigned long long avg = sum / (unsigned long long)n;
   
   //
-  // Calculate standard deviation
+  // Calculate standard deviation. The sum of squared differences from
+  // the (truncated) average is sum(val^2) - 2*avg*sum(val) + n*avg^2,
+  // which is exact in unsigned arithmetic as the result fits.
   //
 
   unsigned long dev = 0;
   if (n > 1) {
-    for (i = 0; i < spindump_rtt_nrecent; i++) {
-      unsigned long long val = (unsigned long long)(rtt->recentRTTs[i]);
-      if (val != spindump_rtt_infinite) {
-        unsigned long long diff = val > avg ? val - avg : avg - val;
-        devSum += (diff * diff);
-        spindump_deepdeepdebugf("standard deviation val %llu avg %llu diff %llu sqrt %llu",
-                                val, avg, diff, diff * diff);
-      }
-    }
+    unsigned long long devSum =
+      rtt->recentSumSquares - 2 * avg * sum + (unsigned long long)n * avg * avg;
     double realResult = floor(sqrt((1.0/(n-1))*(double)devSum));
     dev = (unsigned long)realResult;
     spindump_deepdeepdebugf("standard deviation n = %u avg = %llu devSum = %llu ", n, avg, devSum);
@@ -235,27 +392,31 @@ spindump_rtt_calculateLastMovingAvgRTT(struct spindump_rtt* rtt,
   }
   
   //
-  // Calculate filtered moving average
+  // Calculate filtered moving average, by leaving out the
+  // measurements at both ends of the sorted table that are outside
+  // the limits
   //
 
-  unsigned int fn = 0;
-  unsigned long long fsum = 0;
+  unsigned int fn = n;
+  unsigned long long fsum = sum;
+  unsigned long lowerlimit;
+  unsigned long upperlimit;
   
-  if (filter) {
-
-    for (i = 0; i < spindump_rtt_nrecent; i++) {
-      unsigned long val = rtt->recentRTTs[i];
-      if (val != spindump_rtt_infinite &&
-          (filter == 0 ||
-           spindump_rtt_valuewithinlimits(val,n,rtt,filterLimitPercentage))) {
-        fsum += (unsigned long long)val;
-        fn++;
-      }
+  if (filter &&
+      spindump_rtt_filterlimits(n,rtt,filterLimitPercentage,&lowerlimit,&upperlimit)) {
+    unsigned int low = 0;
+    unsigned int high = n;
+    while (low < high && rtt->sortedRTTs[low] < lowerlimit) {
+      fsum -= (unsigned long long)rtt->sortedRTTs[low];
+      fn--;
+      low++;
     }
-    
-  } else {
-    fsum = sum;
-    fn = n;
+    while (high > low && rtt->sortedRTTs[high-1] > upperlimit) {
+      fsum -= (unsigned long long)rtt->sortedRTTs[high-1];
+      fn--;
+      high--;
+    }
+    spindump_deepdeepdebugf("filtered away %u too low and %u too high", low, n - high);
   }
   
   unsigned long long favg = fn > 0 ? fsum / (unsigned long long)fn : 0;
@@ -297,12 +458,12 @@ spindump_rtt_calculateLastMovingAvgRTT(struct spindump_rtt* rtt,
 // ms". The returned buffer need not be deallocated, but it will not
 // survive the next call to this same function.
 //
-// Note: not thread safe.
+// Note: the returned buffer is per thread.
 //
 
 const char*
 spindump_rtt_tostring(unsigned long rttval) {
-  static char buf[50];
+  static _Thread_local char buf[50];
 
   if (rttval == spindump_rtt_infinite) {
     snprintf(buf,sizeof(buf)-1,"n/a");
@@ -321,41 +482,463 @@ spindump_rtt_tostring(unsigned long rttval) {
 
 
 //
-// This function update the RTT histogram
-// based on the rtt->lastRTT value
+// Set the precision of the RTT histograms initialized from now on, in
+// bits. Each power-of-two range of values is divided into
+// 2^precision bins.
+//
+
+void
+spindump_rtt_histogram_setprecision(unsigned int precision) {
+  spindump_assert(precision <= spindump_rtt_histogram_maxprecision);
+  spindump_rtt_histogram_precision = precision;
+}
+
 //
-// There are 6 levels of delay intervals in this histogram
-// level 0: 0, 100, 200 ... 900us
-// level 1: 1, 2, 3 ... 9ms
-// level 2: 10, 20, 30 ... 90ms
-// level 3: 100, 200, 300 .. 900ms
-// level 4: 1, 2, 3 ... 9s
-// level 5: 10, 20, 30 ... 60s
+// Initialize an RTT histogram to have no measurements, with the
+// precision set earlier
 //
+
 void
-spindump_rtt_update_histogram(struct spindump_rtt* rtt) {
-  unsigned long long rttval = rtt->lastRTT;
-  unsigned int bin_idx = 6;
-  unsigned int level = 5;
-
-  if (rttval < 1000) { //1ms
-    level = 0;
-    bin_idx = (unsigned  int)((double) rttval / 100.0);
-  } else if (rttval < 10 * 1000) { //10ms
-    level = 1;
-    bin_idx = (unsigned  int)((double) rttval / 1000.0);
-  } else if (rttval < 100 * 1000) { //100ms
-    level = 2;
-    bin_idx = (unsigned int)((double) rttval / (10.0 * 1000.0));
-  } else if (rttval < 1000 * 1000) { //1s
-    level = 3;
-    bin_idx = (unsigned int)((double) rttval / (100.0 * 1000.0));
-  } else if (rttval < 10 * 1000 * 1000) { //10s
-    level = 4;
-    bin_idx = (unsigned int)((double) rttval / (1000.0 * 1000.0));
-  } else {
-    bin_idx = (unsigned int)((double) rttval / (10.0 * 1000.0 * 1000.0));
+spindump_rtt_histogram_initialize(struct spindump_rtt_histogram* histogram) {
+  spindump_assert(histogram != 0);
+  histogram->precision = spindump_rtt_histogram_precision;
+  histogram->nBins = (spindump_rtt_histogram_maxexponent - histogram->precision + 1) << histogram->precision;
+  histogram->count = 0;
+  histogram->bins = 0;
+}
+
+//
+// Return the index of the bin for a value (in microseconds) in a
+// histogram of the given precision
+//
+
+unsigned int
+spindump_rtt_histogram_index(unsigned int precision,
+                             unsigned long long value) {
+  spindump_assert(precision <= spindump_rtt_histogram_maxprecision);
+  if (value >= (1ULL << spindump_rtt_histogram_maxexponent)) {
+    value = (1ULL << spindump_rtt_histogram_maxexponent) - 1;
+  }
+  if (value < (1ULL << precision)) return((unsigned int)value);
+  unsigned int exponent = (unsigned int)(63 - __builtin_clzll(value));
+  unsigned int shift = exponent - precision;
+  return(((shift + 1) << precision) + (unsigned int)((value >> shift) - (1ULL << precision)));
+}
+
+//
+// Return the lowest value (in microseconds) of a bin in a histogram
+// of the given precision
+//
+
+unsigned long long
+spindump_rtt_histogram_binvalue(unsigned int precision,
+                                unsigned int index) {
+  spindump_assert(precision <= spindump_rtt_histogram_maxprecision);
+  if (index < (1U << precision)) return(index);
+  unsigned int shift = (index >> precision) - 1;
+  unsigned long long sub = index & ((1U << precision) - 1);
+  return(((1ULL << precision) + sub) << shift);
+}
+
+//
+// Add n measurements to a histogram, in the bin of the given index in
+// a histogram of the given precision. Returns 0 if memory for the bins
+// could not be allocated, and 1 otherwise.
+//
+
+int
+spindump_rtt_histogram_addbin(struct spindump_rtt_histogram* histogram,
+                              unsigned int precision,
+                              unsigned int index,
+                              unsigned int n) {
+  spindump_assert(histogram != 0);
+  if (histogram->bins == 0) {
+    size_t size = histogram->nBins * sizeof(histogram->bins[0]);
+    histogram->bins = (unsigned int*)spindump_pool_allocate(size);
+    if (histogram->bins == 0) {
+      spindump_errorf("cannot allocate memory for an RTT histogram of size %lu", (unsigned long)size);
+      return(0);
+    }
+    memset(histogram->bins,0,size);
+  }
+  if (precision != histogram->precision) {
+    index = spindump_rtt_histogram_index(histogram->precision,
+                                         spindump_rtt_histogram_binvalue(precision,index));
+  }
+  spindump_assert(index < histogram->nBins);
+  histogram->bins[index] += n;
+  histogram->count += n;
+  return(1);
+}
+
+//
+// Add the measurements of another histogram to a histogram. Returns 0
+// if memory could not be allocated, and 1 otherwise.
+//
+
+int
+spindump_rtt_histogram_merge(struct spindump_rtt_histogram* histogram,
+                             const struct spindump_rtt_histogram* other) {
+  spindump_assert(histogram != 0);
+  spindump_assert(other != 0);
+  if (other->bins == 0) return(1);
+  for (unsigned int i = 0; i < other->nBins; i++) {
+    if (other->bins[i] > 0 &&
+        !spindump_rtt_histogram_addbin(histogram,other->precision,i,other->bins[i])) {
+      return(0);
+    }
+  }
+  return(1);
+}
+
+//
+// Clear the measurements from a histogram, e.g., to start a new
+// measurement interval
+//
+
+void
+spindump_rtt_histogram_reset(struct spindump_rtt_histogram* histogram) {
+  spindump_assert(histogram != 0);
+  if (histogram->bins != 0) memset(histogram->bins,0,histogram->nBins * sizeof(histogram->bins[0]));
+  histogram->count = 0;
+}
+
+//
+// Get the non-empty bins of a histogram in a sparse form, at most
+// maxBins of them, into the output parameters indexes and counts. If
+// there are more non-empty bins than that, the bins are combined by
+// lowering the precision until they fit. The precision used and the
+// number of bins are set in the output parameters p_precision and
+// p_nBins.
+//
+
+void
+spindump_rtt_histogram_sparse(const struct spindump_rtt_histogram* histogram,
+                              unsigned int maxBins,
+                              unsigned int* p_precision,
+                              unsigned int* p_nBins,
+                              unsigned int* indexes,
+                              unsigned int* counts) {
+  
+  spindump_assert(histogram != 0);
+  spindump_assert(maxBins > 0);
+  *p_precision = histogram->precision;
+  *p_nBins = 0;
+  if (histogram->bins == 0) return;
+  
+  //
+  // Find the highest precision at which the bins fit. The bins of a
+  // lower precision are unions of the bins of a higher precision, and
+  // bins in increasing order stay in increasing order.
+  //
+  
+  unsigned int precision = histogram->precision;
+  for (;;) {
+    unsigned int n = 0;
+    unsigned int previous = 0;
+    for (unsigned int i = 0; i < histogram->nBins; i++) {
+      if (histogram->bins[i] == 0) continue;
+      unsigned int index = spindump_rtt_histogram_index(precision,
+                                                        spindump_rtt_histogram_binvalue(histogram->precision,i));
+      if (n == 0 || index != previous) n++;
+      previous = index;
+    }
+    if (n <= maxBins || precision == 0) break;
+    precision--;
+  }
+
+  //
+  // Fill in the bins at that precision
+  //
+  
+  unsigned int n = 0;
+  for (unsigned int i = 0; i < histogram->nBins; i++) {
+    if (histogram->bins[i] == 0) continue;
+    unsigned int index = spindump_rtt_histogram_index(precision,
+                                                      spindump_rtt_histogram_binvalue(histogram->precision,i));
+    if (n > 0 && indexes[n-1] == index) {
+      counts[n-1] += histogram->bins[i];
+    } else if (n < maxBins) {
+      indexes[n] = index;
+      counts[n] = histogram->bins[i];
+      n++;
+    } else {
+      counts[n-1] += histogram->bins[i];
+    }
+  }
+  *p_precision = precision;
+  *p_nBins = n;
+}
+
+//
+// Free the bins of a histogram
+//
+
+void
+spindump_rtt_histogram_uninitialize(struct spindump_rtt_histogram* histogram) {
+  spindump_assert(histogram != 0);
+  if (histogram->bins != 0) {
+    spindump_pool_free(histogram->bins,histogram->nBins * sizeof(histogram->bins[0]));
+    histogram->bins = 0;
+  }
+  histogram->count = 0;
+}
+
+//
+// Initialize a quantile sketch to have no measurements
+//
+
+void
+spindump_rtt_sketch_initialize(struct spindump_rtt_sketch* sketch) {
+  spindump_assert(sketch != 0);
+  memset(sketch,0,sizeof(*sketch));
+}
+
+//
+// Add n measurements in the bin of the given index, moving the
+// window of bins if needed. The window moves up for higher values,
+// collapsing the lowest bins, and down for lower values as long as
+// no non-empty bin falls off the top. Values still below the window
+// are counted in the lowest bin.
+//
+
+static void
+spindump_rtt_sketch_addtobin(struct spindump_rtt_sketch* sketch,
+                             int index,
+                             unsigned int n) {
+
+  const int nbins = spindump_rtt_sketch_nbins;
+  
+  //
+  // An empty sketch places the window around the first value
+  //
+  
+  if (sketch->count == sketch->zeroCount) {
+    sketch->offset = index - nbins / 2;
+  }
+
+  if (index >= sketch->offset + nbins) {
+
+    //
+    // Move the window up, collapsing the bins that fall off into the
+    // lowest bin
+    //
+    
+    int shift = index - (sketch->offset + nbins - 1);
+    unsigned int collapsed = 0;
+    for (int i = 0; i < shift && i < nbins; i++) collapsed += sketch->bins[i];
+    if (shift < nbins) {
+      memmove(&sketch->bins[0],&sketch->bins[shift],(size_t)(nbins - shift) * sizeof(sketch->bins[0]));
+      memset(&sketch->bins[nbins - shift],0,(size_t)shift * sizeof(sketch->bins[0]));
+    } else {
+      memset(&sketch->bins[0],0,sizeof(sketch->bins));
+    }
+    sketch->bins[0] += collapsed;
+    sketch->offset += shift;
+    
+  } else if (index < sketch->offset) {
+
+    //
+    // Move the window down, as far as there is room above the
+    // highest non-empty bin
+    //
+    
+    int highest = nbins - 1;
+    while (highest >= 0 && sketch->bins[highest] == 0) highest--;
+    int shift = sketch->offset - index;
+    if (shift > nbins - 1 - highest) shift = nbins - 1 - highest;
+    if (shift > 0) {
+      memmove(&sketch->bins[shift],&sketch->bins[0],(size_t)(nbins - shift) * sizeof(sketch->bins[0]));
+      memset(&sketch->bins[0],0,(size_t)shift * sizeof(sketch->bins[0]));
+      sketch->offset -= shift;
+    }
+    if (index < sketch->offset) index = sketch->offset;
+    
+  }
+
+  //
+  // Add to the bin
+  //
+  
+  sketch->bins[index - sketch->offset] += n;
+  sketch->count += n;
+}
+
+//
+// Add a new measurement, in nanoseconds, to a quantile sketch
+//
+
+void
+spindump_rtt_sketch_add(struct spindump_rtt_sketch* sketch,
+                        unsigned long long valueNsec) {
+  spindump_assert(sketch != 0);
+  if (valueNsec == 0) {
+    sketch->zeroCount++;
+    sketch->count++;
+    return;
   }
+  double value = (double)valueNsec / (double)spindump_time_nsecsperusec;
+  double gamma = (1.0 + spindump_rtt_sketch_accuracy) / (1.0 - spindump_rtt_sketch_accuracy);
+  int index = (int)ceil(log(value) / log(gamma));
+  spindump_rtt_sketch_addtobin(sketch,index,1);
+}
+
+//
+// Merge the measurements of another sketch to a sketch. The result is
+// as if the measurements had been added to the sketch one by one,
+// except that the bins of the other sketch were added highest first,
+// so that the window of bins moves up only once.
+//
+
+void
+spindump_rtt_sketch_merge(struct spindump_rtt_sketch* sketch,
+                          const struct spindump_rtt_sketch* other) {
+  spindump_assert(sketch != 0);
+  spindump_assert(other != 0);
+  for (int i = spindump_rtt_sketch_nbins - 1; i >= 0; i--) {
+    if (other->bins[i] > 0) {
+      spindump_rtt_sketch_addtobin(sketch,other->offset + i,other->bins[i]);
+    }
+  }
+  sketch->zeroCount += other->zeroCount;
+  sketch->count += other->zeroCount;
+}
+
+//
+// Return the non-empty bins of a sketch in a sparse form, e.g., to
+// be reported to other instances of Spindump: the index of the first
+// bin in *p_offset, at most maxBins bin indexes relative to that
+// offset in increasing order, and the number of measurements in each
+// bin. If there are more non-empty bins, the lowest ones are
+// collapsed to the next one up, as in the sketch itself. Bins below
+// 1 microsecond (index 0) are reported in bin 0, as the offset is
+// unsigned. The number of zero measurements is returned in
+// *p_zeroCount.
+//
+
+void
+spindump_rtt_sketch_sparse(const struct spindump_rtt_sketch* sketch,
+                           unsigned int maxBins,
+                           unsigned int* p_offset,
+                           unsigned int* p_zeroCount,
+                           unsigned int* p_nBins,
+                           unsigned int* indexes,
+                           unsigned int* counts) {
+  
+  spindump_assert(sketch != 0);
+  spindump_assert(maxBins > 0);
+  
+  //
+  // Determine how many of the lowest non-empty bins need to be
+  // collapsed
+  //
 
-  rtt->rttHisto[level][bin_idx]++;
+  unsigned int nonEmpty = 0;
+  for (unsigned int i = 0; i < spindump_rtt_sketch_nbins; i++) {
+    if (sketch->bins[i] > 0) nonEmpty++;
+  }
+  unsigned int collapse = (nonEmpty > maxBins) ? nonEmpty - maxBins : 0;
+  
+  //
+  // Fill in the bins, with absolute indexes first
+  //
+  
+  unsigned int n = 0;
+  unsigned int seen = 0;
+  for (unsigned int i = 0; i < spindump_rtt_sketch_nbins; i++) {
+    if (sketch->bins[i] == 0) continue;
+    int signedIndex = sketch->offset + (int)i;
+    unsigned int index = (signedIndex < 0) ? 0 : (unsigned int)signedIndex;
+    if (n > 0 && (seen <= collapse || indexes[n-1] == index)) {
+      indexes[n-1] = index;
+      counts[n-1] += sketch->bins[i];
+    } else {
+      indexes[n] = index;
+      counts[n] = sketch->bins[i];
+      n++;
+    }
+    seen++;
+  }
+
+  //
+  // Make the indexes relative to the first one
+  //
+  
+  *p_offset = (n > 0) ? indexes[0] : 0;
+  for (unsigned int i = 0; i < n; i++) indexes[i] -= *p_offset;
+  *p_zeroCount = sketch->zeroCount;
+  *p_nBins = n;
+}
+
+//
+// Add the bins of a sketch in the sparse form of
+// spindump_rtt_sketch_sparse to a sketch. As with
+// spindump_rtt_sketch_merge, the bins are added highest first.
+//
+
+void
+spindump_rtt_sketch_addsparse(struct spindump_rtt_sketch* sketch,
+                              unsigned int offset,
+                              unsigned int zeroCount,
+                              unsigned int nBins,
+                              const unsigned int* indexes,
+                              const unsigned int* counts) {
+  spindump_assert(sketch != 0);
+  spindump_assert(indexes != 0);
+  spindump_assert(counts != 0);
+  for (unsigned int i = nBins; i > 0; i--) {
+    if (offset >= spindump_rtt_sketch_maxindex ||
+        indexes[i-1] >= spindump_rtt_sketch_maxindex - offset ||
+        counts[i-1] == 0) {
+      continue;
+    }
+    spindump_rtt_sketch_addtobin(sketch,(int)(offset + indexes[i-1]),counts[i-1]);
+  }
+  sketch->zeroCount += zeroCount;
+  sketch->count += zeroCount;
+}
+
+//
+// Return the given quantile (0.0 to 1.0, e.g., 0.95) of the
+// measurements in a sketch, in microseconds. Returns
+// spindump_rtt_infinite if there are no measurements.
+//
+
+unsigned long
+spindump_rtt_sketch_quantile(const struct spindump_rtt_sketch* sketch,
+                             double quantile) {
+
+  //
+  // Checks
+  //
+  
+  spindump_assert(sketch != 0);
+  spindump_assert(quantile >= 0.0 && quantile <= 1.0);
+  if (sketch->count == 0) return(spindump_rtt_infinite);
+
+  //
+  // Find the bin where the rank of the quantile falls in
+  //
+  
+  unsigned long long rank = (unsigned long long)(quantile * (double)(sketch->count - 1));
+  unsigned long long seen = sketch->zeroCount;
+  if (rank < seen) return(0);
+  int index = sketch->offset + spindump_rtt_sketch_nbins - 1;
+  for (int i = 0; i < spindump_rtt_sketch_nbins; i++) {
+    seen += sketch->bins[i];
+    if (rank < seen) {
+      index = sketch->offset + i;
+      break;
+    }
+  }
+
+  //
+  // Return the value in the middle of the bin, in the sense of
+  // relative error
+  //
+  
+  double gamma = (1.0 + spindump_rtt_sketch_accuracy) / (1.0 - spindump_rtt_sketch_accuracy);
+  double value = 2.0 * pow(gamma,(double)index) / (gamma + 1.0);
+  if (value >= (double)spindump_rtt_max) return(spindump_rtt_max);
+  return((unsigned long)(value + 0.5));
 }
@@ -25,6 +25,12 @@
 
 #define spindump_rtt_nrecent     20
 #define spindump_rtt_nminfilter   5
+#define spindump_rtt_sketch_nbins       256
+#define spindump_rtt_sketch_accuracy   0.02  /* relative error of quantiles */
+#define spindump_rtt_sketch_maxindex    1024  /* bins beyond this in sketches from elsewhere are ignored */
+#define spindump_rtt_histogram_defaultprecision   3
+#define spindump_rtt_histogram_maxprecision       7
+#define spindump_rtt_histogram_maxexponent       26  /* values up to 2^26 us, over spindump_rtt_maxlegal */
 
 //
 // Data structures ----------------------------------------------------------------------------
@@ -34,18 +40,65 @@
 #define spindump_rtt_max             0xfffffffe
 #define spindump_rtt_maxlegal    (60*1000*1000)  /* 60s or 60M us */
 
+//
+// A quantile sketch, with logarithmically sized bins such that any
+// quantile is found within spindump_rtt_sketch_accuracy relative
+// error (as in DDSketch). Bin i covers values (gamma^(i-1),gamma^i]
+// microseconds, where gamma is (1+accuracy)/(1-accuracy). The bins
+// are a window of consecutive indexes starting from "offset"; when
+// the values span a larger range than the window, the lowest bins are
+// collapsed, so the high quantiles stay accurate. Sketches can be
+// merged, e.g., to combine measurements from several sources.
+//
+
+struct spindump_rtt_sketch {
+  int offset;                                // index of the first bin in bins[]
+  unsigned int zeroCount;                    // number of measurements below 1 ns
+  unsigned long long count;                  // number of measurements in total
+  unsigned int
+    bins[spindump_rtt_sketch_nbins];         // number of measurements in each bin
+};
+
+//
+// A histogram with log-linear bins, as in HdrHistogram. Values below
+// 2^precision microseconds have a bin each, and each power-of-two
+// range above that is divided into 2^precision bins, so that the bins
+// are at most 1/2^precision of their values wide. The precision is
+// set at startup for all histograms, but histograms of different
+// precision can be merged too. The bins are allocated upon the first
+// measurement, and only if histograms are tracked at all.
+//
+
+struct spindump_rtt_histogram {
+  unsigned int precision;                    // number of bits of precision
+  unsigned int nBins;                        // number of bins
+  unsigned long long count;                  // number of measurements in total
+  unsigned int* bins;                        // number of measurements in each bin, or 0 if none
+};
+
 struct spindump_rtt {
   unsigned long lastRTT;                     // in usecs, spindump_rtt_infinite if not set
+  unsigned long long lastRTTNsec;            // in nsecs, 0 if not set
   unsigned long lastMovingAvgRTT;            // in usecs, spindump_rtt_infinite if not set
   unsigned long lastStandardDeviation;       // in usecs, spindump_rtt_infinite if not set
   unsigned long minimumRTT;                  // in usecs, spindump_rtt_infinite if not set
   unsigned int recentTableIndex;             // where the next recent RTT measurement will
                                              // be placed in
-  unsigned int padding;                      // unused padding to align the next field properly
+  unsigned int nMeasurements;                // number of measurements so far, wraps around
   unsigned long
     recentRTTs[spindump_rtt_nrecent];        // recent RTT measurements, in usec. Value 
                                              // positions via above index.
-  unsigned long rttHisto[6][10];             // RTT histograms 100us-1ms-10ms-100ms-1s-10s resolution
+  unsigned int nRecent;                      // number of measurements in recentRTTs
+  unsigned long long recentSum;              // sum of the measurements in recentRTTs
+  unsigned long long recentSumSquares;       // sum of their squares
+  unsigned long
+    sortedRTTs[spindump_rtt_nrecent];        // the same measurements in increasing order,
+                                             // nRecent first positions used
+  struct spindump_rtt_histogram histogram;   // histogram of the measurements since the last reset
+  struct spindump_rtt_sketch* sketch;        // quantile sketch of the measurements since the last reset,
+                                             // 0 until the first measurement or if quantiles are not tracked
+  int mergedIntervals;                       // the histogram and the sketch get measurements only
+                                             // through spindump_rtt_mergeinterval
 };
 
 //
@@ -56,7 +109,7 @@ void
 spindump_rtt_initialize(struct spindump_rtt* rtt);
 unsigned long
 spindump_rtt_newmeasurement(struct spindump_rtt* rtt,
-                            unsigned long long timediff);
+                            unsigned long long timediffNsec);
 unsigned long
 spindump_rtt_calculateLastMovingAvgRTT(struct spindump_rtt* rtt,
                                        int filter,
@@ -66,8 +119,71 @@ spindump_rtt_calculateLastMovingAvgRTT(struct spindump_rtt* rtt,
 const char*
 spindump_rtt_tostring(unsigned long rttval);
 void
+spindump_rtt_newinterval(struct spindump_rtt* rtt);
+void
 spindump_rtt_uninitialize(struct spindump_rtt* rtt);
 void
-spindump_rtt_update_histogram(struct spindump_rtt* rtt);
+spindump_rtt_settracking(int quantiles,
+                         int histograms);
+int
+spindump_rtt_newsketch(struct spindump_rtt* rtt);
+int
+spindump_rtt_mergeinterval(struct spindump_rtt* rtt,
+                           struct spindump_rtt* other);
+void
+spindump_rtt_histogram_setprecision(unsigned int precision);
+void
+spindump_rtt_histogram_initialize(struct spindump_rtt_histogram* histogram);
+int
+spindump_rtt_histogram_addbin(struct spindump_rtt_histogram* histogram,
+                              unsigned int precision,
+                              unsigned int index,
+                              unsigned int n);
+int
+spindump_rtt_histogram_merge(struct spindump_rtt_histogram* histogram,
+                             const struct spindump_rtt_histogram* other);
+void
+spindump_rtt_histogram_reset(struct spindump_rtt_histogram* histogram);
+void
+spindump_rtt_histogram_sparse(const struct spindump_rtt_histogram* histogram,
+                              unsigned int maxBins,
+                              unsigned int* p_precision,
+                              unsigned int* p_nBins,
+                              unsigned int* indexes,
+                              unsigned int* counts);
+unsigned int
+spindump_rtt_histogram_index(unsigned int precision,
+                             unsigned long long value);
+unsigned long long
+spindump_rtt_histogram_binvalue(unsigned int precision,
+                                unsigned int index);
+void
+spindump_rtt_histogram_uninitialize(struct spindump_rtt_histogram* histogram);
+void
+spindump_rtt_sketch_initialize(struct spindump_rtt_sketch* sketch);
+void
+spindump_rtt_sketch_add(struct spindump_rtt_sketch* sketch,
+                        unsigned long long valueNsec);
+void
+spindump_rtt_sketch_merge(struct spindump_rtt_sketch* sketch,
+                          const struct spindump_rtt_sketch* other);
+void
+spindump_rtt_sketch_sparse(const struct spindump_rtt_sketch* sketch,
+                           unsigned int maxBins,
+                           unsigned int* p_offset,
+                           unsigned int* p_zeroCount,
+                           unsigned int* p_nBins,
+                           unsigned int* indexes,
+                           unsigned int* counts);
+void
+spindump_rtt_sketch_addsparse(struct spindump_rtt_sketch* sketch,
+                              unsigned int offset,
+                              unsigned int zeroCount,
+                              unsigned int nBins,
+                              const unsigned int* indexes,
+                              const unsigned int* counts);
+unsigned long
+spindump_rtt_sketch_quantile(const struct spindump_rtt_sketch* sketch,
+                             double quantile);
 
 #endif // SPINDUMP_RTT_H
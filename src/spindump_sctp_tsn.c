@@ -49,7 +49,7 @@ spindump_tsntracker_initialize(struct spindump_tsntracker* tracker) {
 //
 void
 spindump_tsntracker_add(struct spindump_tsntracker* tracker,
-                        struct timeval* ts,
+                        spindump_time* ts,
                         sctp_tsn tsn) {
   spindump_assert(tracker != 0);
   spindump_assert(tracker->seqindex < spindump_tsntracker_nstored);
@@ -67,7 +67,7 @@ spindump_tsntracker_add(struct spindump_tsntracker* tracker,
 // sequence number. Return a pointer to that time, or 0 if no such
 // sequence number has been seen.
 //
-struct timeval*
+spindump_time*
 spindump_tsntracker_ackto(struct spindump_tsntracker* tracker,
                           sctp_tsn ackTsn,
                           sctp_tsn* sentTsn) {
@@ -42,7 +42,7 @@ typedef uint32_t sctp_tsn;
 //
 
 struct spindump_tsnstore {
-  struct timeval received;
+  spindump_time received;
   int outstanding;
   sctp_tsn tsn;
 };
@@ -60,9 +60,9 @@ void
 spindump_tsntracker_initialize(struct spindump_tsntracker* tracker);
 void
 spindump_tsntracker_add(struct spindump_tsntracker* tracker,
-                        struct timeval* ts,
+                        spindump_time* ts,
                         sctp_tsn tsn);
-struct timeval*
+spindump_time*
 spindump_tsntracker_ackto(struct spindump_tsntracker* tracker,
                           sctp_tsn ackTsn,
                           sctp_tsn* sentTsn);
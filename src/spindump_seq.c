@@ -24,6 +24,25 @@
 #include <stdlib.h>
 #include "spindump_util.h"
 #include "spindump_seq.h"
+#include "spindump_pool.h"
+
+//
+// Function prototypes ------------------------------------------------------------------------
+//
+
+static inline struct spindump_seqstore*
+spindump_seqtracker_get(struct spindump_seqtracker* tracker,
+                        unsigned int i);
+static int
+spindump_seqtracker_grow(struct spindump_seqtracker* tracker);
+static void
+spindump_seqtracker_dropoldest(struct spindump_seqtracker* tracker);
+static inline int
+spindump_seqtracker_matches(const struct spindump_seqstore* candidate,
+                            tcp_seq highestacked);
+static unsigned int
+spindump_seqtracker_find(struct spindump_seqtracker* tracker,
+                         tcp_seq highestacked);
 
 //
 // Actual code --------------------------------------------------------------------------------
@@ -36,12 +55,92 @@
 // that sequence number These trackers are used in the TCP protocol
 // analyzer. There's two trackers, one for each direction.
 //
+// The segments are kept in a ring, in the order they were sent. When
+// the ring is full and its oldest segment has not been acked yet, the
+// ring grows, up to a maximum window size; otherwise the oldest
+// segment is forgotten. No memory is allocated until the first
+// segment is added.
+//
 
 void
 spindump_seqtracker_initialize(struct spindump_seqtracker* tracker) {
   spindump_assert(tracker != 0);
   memset(tracker,0,sizeof(*tracker));
-  tracker->seqindex = 0;
+  tracker->maxNStored = spindump_seqtracker_maxnstored;
+}
+
+//
+// Set the largest number of segments the tracker remembers. A window
+// smaller than the default initial window is used as is.
+//
+
+void
+spindump_seqtracker_setmaxwindow(struct spindump_seqtracker* tracker,
+                                 unsigned int maxNStored) {
+  spindump_assert(tracker != 0);
+  spindump_assert(maxNStored > 0);
+  tracker->maxNStored = maxNStored;
+}
+
+//
+// Get the ith oldest segment in the tracker
+//
+
+static inline struct spindump_seqstore*
+spindump_seqtracker_get(struct spindump_seqtracker* tracker,
+                        unsigned int i) {
+  spindump_assert(i < tracker->n);
+  unsigned int position = tracker->first + i;
+  if (position >= tracker->nStored) position -= tracker->nStored;
+  return(&tracker->stored[position]);
+}
+
+//
+// Allocate the ring, or make it larger. Return 1 upon success, 0 if
+// memory could not be allocated.
+//
+
+static int
+spindump_seqtracker_grow(struct spindump_seqtracker* tracker) {
+  unsigned int newNStored = tracker->nStored == 0 ? spindump_seqtracker_nstored : 2 * tracker->nStored;
+  if (newNStored > tracker->maxNStored) newNStored = tracker->maxNStored;
+  spindump_assert(newNStored > tracker->nStored);
+  unsigned int size = newNStored * sizeof(struct spindump_seqstore);
+  struct spindump_seqstore* newStored = (struct spindump_seqstore*)spindump_pool_allocate(size);
+  if (newStored == 0) {
+    spindump_errorf("cannot allocate sequence number tracker of %u bytes", size);
+    return(0);
+  }
+  for (unsigned int i = 0; i < tracker->n; i++) {
+    newStored[i] = *spindump_seqtracker_get(tracker,i);
+  }
+  if (tracker->stored != 0) {
+    spindump_pool_free(tracker->stored,tracker->nStored * sizeof(struct spindump_seqstore));
+  }
+  tracker->stored = newStored;
+  tracker->nStored = newNStored;
+  tracker->first = 0;
+  return(1);
+}
+
+//
+// Forget the oldest segment in the tracker
+//
+
+static void
+spindump_seqtracker_dropoldest(struct spindump_seqtracker* tracker) {
+  spindump_assert(tracker->n > 0);
+  tracker->first++;
+  if (tracker->first == tracker->nStored) tracker->first = 0;
+  tracker->n--;
+  if (tracker->nAcked > 0) tracker->nAcked--;
+  if (tracker->n > 0) {
+    struct spindump_seqstore* oldest = spindump_seqtracker_get(tracker,0);
+    if (oldest->outoforder) {
+      oldest->outoforder = 0;
+      tracker->nOutOfOrder--;
+    }
+  }
 }
 
 //
@@ -50,38 +149,133 @@ spindump_seqtracker_initialize(struct spindump_seqtracker* tracker) {
 
 void
 spindump_seqtracker_add(struct spindump_seqtracker* tracker,
-                        struct timeval* ts,
+                        spindump_time* ts,
                         tcp_ts ts_val,
                         tcp_seq seq,
                         unsigned int payloadlen,
                         int finset) {
   spindump_assert(tracker != 0);
-  spindump_assert(tracker->seqindex < spindump_seqtracker_nstored);
   spindump_assert(finset == 0 || finset == 1);
-  tracker->stored[tracker->seqindex].valid = 1;
-  tracker->stored[tracker->seqindex].acked = 0;
-  tracker->stored[tracker->seqindex].received = *ts;
-  tracker->stored[tracker->seqindex].ts_val = ts_val;
-  tracker->stored[tracker->seqindex].seq = seq;
-  tracker->stored[tracker->seqindex].len = payloadlen;
-  tracker->stored[tracker->seqindex].finset = finset;
-  tracker->seqindex++;
-  tracker->seqindex %= spindump_seqtracker_nstored;
-  spindump_assert(tracker->seqindex < spindump_seqtracker_nstored);
+
+  //
+  // Make space for the segment
+  //
+  
+  if (tracker->n == tracker->nStored) {
+    int oldestunacked = tracker->n > 0 && tracker->nAcked == 0 && !spindump_seqtracker_get(tracker,0)->acked;
+    if ((tracker->nStored == 0 || oldestunacked) &&
+        tracker->nStored < tracker->maxNStored &&
+        spindump_seqtracker_grow(tracker)) {
+      spindump_deepdebugf("grew sequence number tracker to %u segments", tracker->nStored);
+    } else if (tracker->n > 0) {
+      spindump_seqtracker_dropoldest(tracker);
+    } else {
+      return;
+    }
+  }
+
+  //
+  // Add the segment as the newest one
+  //
+  
+  tracker->n++;
+  struct spindump_seqstore* stored = spindump_seqtracker_get(tracker,tracker->n - 1);
+  stored->acked = 0;
+  stored->received = *ts;
+  stored->ts_val = ts_val;
+  stored->seq = seq;
+  stored->len = payloadlen;
+  stored->finset = finset;
+  stored->outoforder = 0;
+  if (tracker->n > 1) {
+    const struct spindump_seqstore* previous = spindump_seqtracker_get(tracker,tracker->n - 2);
+    if (seq < previous->seq || seq + payloadlen < previous->seq + previous->len) {
+      stored->outoforder = 1;
+      tracker->nOutOfOrder++;
+    }
+  }
+}
+
+//
+// Check whether a segment is acked by a given highest acked sequence
+// number
+//
+
+static inline int
+spindump_seqtracker_matches(const struct spindump_seqstore* candidate,
+                            tcp_seq highestacked) {
+  return(candidate->seq == highestacked ||
+         (candidate->seq <= highestacked &&
+          highestacked < candidate->seq + candidate->len));
+}
+
+//
+// Find the latest sent segment that the highest acked sequence number
+// could be an acknowledgment for. Return its index, or tracker->n if
+// there is no such segment.
+//
+// When the sequence numbers and ends of the segments in the ring do
+// not go back, the latest segment that starts at or before the
+// highest acked sequence number is the only one that needs to be
+// checked, and it can be found with a binary search. Otherwise, such
+// as after retransmissions, all segments are checked.
+//
+
+static unsigned int
+spindump_seqtracker_find(struct spindump_seqtracker* tracker,
+                         tcp_seq highestacked) {
+  
+  if (tracker->nOutOfOrder == 0) {
+    
+    unsigned int low = 0;
+    unsigned int high = tracker->n;
+    while (low < high) {
+      unsigned int middle = low + (high - low) / 2;
+      if (spindump_seqtracker_get(tracker,middle)->seq <= highestacked) {
+        low = middle + 1;
+      } else {
+        high = middle;
+      }
+    }
+    if (low > 0 && spindump_seqtracker_matches(spindump_seqtracker_get(tracker,low - 1),highestacked)) {
+      return(low - 1);
+    }
+    return(tracker->n);
+    
+  } else {
+
+    unsigned int chosen = tracker->n;
+    for (unsigned int i = 0; i < tracker->n; i++) {
+      struct spindump_seqstore* candidate = spindump_seqtracker_get(tracker,i);
+      spindump_deepdebugf("compare received ACK %u to candidate earlier sent SEQ %u..%u len %u acked %u",
+                          highestacked,
+                          candidate->seq, candidate->seq + candidate->len,
+                          candidate->len,
+                          candidate->acked);
+      if (spindump_seqtracker_matches(candidate,highestacked) &&
+          (chosen == tracker->n ||
+           !spindump_isearliertime(&spindump_seqtracker_get(tracker,chosen)->received,&candidate->received))) {
+        chosen = i;
+      }
+    }
+    return(chosen);
+    
+  }
 }
 
 //
 // Determine what time the request message was sent for a given
 // sequence number. Return a pointer to that time, or 0 if no such
-// sequence number has been seen.
+// sequence number has been seen. The pointer is valid until the next
+// segment is added to the tracker.
 //
 
-struct timeval*
+spindump_time*
 spindump_seqtracker_ackto(struct spindump_seqtracker* tracker,
                           tcp_seq seq,
                           tcp_seq sack,
                           tcp_ts ts_ecr,
-                          struct timeval* t,
+                          spindump_time* t,
                           tcp_seq* sentSeq,
                           int* sentFin) {
   
@@ -99,74 +293,34 @@ spindump_seqtracker_ackto(struct spindump_seqtracker* tracker,
   spindump_assert(sentSeq != 0);
   
   //
-  // Find the earliest sent packet that this could be an
+  // Find the latest sent packet that this could be an
   // acknowledgment for.
   // 
   
-  struct spindump_seqstore* chosen = 0;
-  for (unsigned int i = 0; i < spindump_seqtracker_nstored; i++) {
-    
-    struct spindump_seqstore* candidate = &tracker->stored[i];
-
-    //
-    // Is this entry in use? If not, go to next
-     // 
-
-    if (!candidate->valid) continue;
-    
-    //
-    // Is this previously seen TCP segment the one
-    // acked by sequence number "seq"?
-    // 
-    
-    spindump_deepdebugf("compare received ACK %u (%u) to candidate earlier sent SEQ %u..%u at -%llu ago len %u valid %u acked %u",
-                        highestacked, seq,
-                        candidate->seq, candidate->seq + candidate->len,
-                        spindump_timediffinusecs(t,
-                                                 &candidate->received),
-                        candidate->len,
-                        candidate->valid,
-                        candidate->acked);
-    
-    if (candidate->seq == highestacked ||
-        (candidate->seq <= highestacked &&
-         highestacked < candidate->seq + candidate->len)) {
-      
-      //
-      // It is. Now see if this is the earliest one.
-      // 
-      
-      if (chosen == 0) {
-        spindump_deepdebugf("first matching candidate chosen");
-        chosen = candidate;
-     } else if (spindump_isearliertime(&candidate->received,&chosen->received)) {
-        spindump_deepdebugf("earlier matching candidate chosen");
-        chosen = candidate;
-      }
-    }
-  }
+  unsigned int index = spindump_seqtracker_find(tracker,highestacked);
   
-  if (chosen != 0) {
+  if (index < tracker->n) {
     
     //
     // Found. Return the time when that packet was sent.
-    // But first, clear the sequence stores from all entries
-    // sent earlier than the one that we found. And clear this
-    // entry too.
+    // But first, mark all entries sent earlier than the one that we
+    // found as acked. And mark this entry too.
     // 
 
-    for (unsigned int j = 0; j < spindump_seqtracker_nstored; j++) {
-      struct spindump_seqstore* other = &tracker->stored[j];
-      if (other->valid && !other->acked && spindump_isearliertime(&chosen->received,&other->received)) {
-        other->acked = 1;
-      }
+    struct spindump_seqstore* chosen = spindump_seqtracker_get(tracker,index);
+    int alreadyacked = chosen->acked || index < tracker->nAcked;
+    unsigned int earlier = index;
+    while (earlier > tracker->nAcked &&
+           !spindump_isearliertime(&chosen->received,&spindump_seqtracker_get(tracker,earlier - 1)->received)) {
+      earlier--;
     }
+    if (earlier > tracker->nAcked) tracker->nAcked = earlier;
 
     //
     // Did we already ack this earlier? If yes, we can't say anything about RTT.
     //
 
-    if (chosen->acked) {
+    if (alreadyacked) {
       *sentSeq = chosen->seq;
       *sentFin = chosen->finset;
       return(0);
@@ -201,5 +355,8 @@ spindump_seqtracker_ackto(struct spindump_seqtracker* tracker,
 void
 spindump_seqtracker_uninitialize(struct spindump_seqtracker* tracker) {
   spindump_assert(tracker != 0);
-  // no-op
+  if (tracker->stored != 0) {
+    spindump_pool_free(tracker->stored,tracker->nStored * sizeof(struct spindump_seqstore));
+  }
+  memset(tracker,0,sizeof(*tracker));
 }
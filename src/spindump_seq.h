@@ -32,7 +32,10 @@
 //
 
 #ifndef spindump_seqtracker_nstored
-#define spindump_seqtracker_nstored             50
+#define spindump_seqtracker_nstored             50 // initial window, in segments
+#endif
+#ifndef spindump_seqtracker_maxnstored
+#define spindump_seqtracker_maxnstored          50 // default largest window, in segments
 #endif
 
 //
@@ -40,20 +43,23 @@
 //
 
 struct spindump_seqstore {
-  struct timeval received;
-  int valid;
+  spindump_time received;
   int acked;
   unsigned int len;
   int finset;
+  int outoforder;    // sequence numbers go back from the segment sent before this one
   tcp_ts ts_val;
   tcp_seq seq;
-  //char padding[2]; // unused
 };
 
 struct spindump_seqtracker {
-  struct spindump_seqstore stored[spindump_seqtracker_nstored];
-  unsigned int seqindex;
-  //char padding[4]; // unused
+  struct spindump_seqstore* stored; // ring of segments, in the order they were sent; 0 until first segment
+  unsigned int nStored;             // allocated size of the ring
+  unsigned int maxNStored;          // largest size the ring may grow to
+  unsigned int first;               // position of the oldest segment in the ring
+  unsigned int n;                   // number of segments in the ring
+  unsigned int nAcked;              // the oldest nAcked segments are all acked
+  unsigned int nOutOfOrder;         // number of segments in the ring marked outoforder
 };
 
 //
@@ -63,18 +69,21 @@ struct spindump_seqtracker {
 void
 spindump_seqtracker_initialize(struct spindump_seqtracker* tracker);
 void
+spindump_seqtracker_setmaxwindow(struct spindump_seqtracker* tracker,
+                                 unsigned int maxNStored);
+void
 spindump_seqtracker_add(struct spindump_seqtracker* tracker,
-                        struct timeval* ts,
+                        spindump_time* ts,
                         tcp_ts ts_val,
                         tcp_seq seq,
                         unsigned int payloadlen,
                         int finset);
-struct timeval*
+spindump_time*
 spindump_seqtracker_ackto(struct spindump_seqtracker* tracker,
                           tcp_seq seq,
                           tcp_seq sack,
                           tcp_ts ts_ecr,
-                          struct timeval* t,
+                          spindump_time* t,
                           tcp_seq* sentSeq,
                           int* sentFin);
 void
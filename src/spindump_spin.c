@@ -35,17 +35,17 @@ spindump_spintracker_observespin(struct spindump_analyze* state,
                                  struct spindump_packet* packet,
                                  struct spindump_connection* connection,
                                  struct spindump_spintracker* tracker,
-                                 struct timeval* ts,
+                                 spindump_time* ts,
                                  int spin,
                                  int fromResponder,
                                  unsigned int ipPacketLength,
                                  int* p_spin0to1);
 
-static struct timeval*
+static spindump_time*
 spindump_spintracker_match_unidirectional_spin(struct spindump_spintracker* tracker,
                                                int spin0to1);
 
-static struct timeval*
+static spindump_time*
 spindump_spintracker_match_bidirectional_spin(struct spindump_spintracker* tracker,
                                               int requireExactSpinValue,
                                               int spin0to1);
@@ -153,7 +153,7 @@ void
 spindump_spintracker_observespinandcalculatertt(struct spindump_analyze* state,
                                                 struct spindump_packet* packet,
                                                 struct spindump_connection* connection,
-                                                struct timeval* ts,
+                                                spindump_time* ts,
                                                 int spin,
                                                 int fromResponder,
                                                 unsigned int ipPacketLength,
@@ -161,11 +161,11 @@ spindump_spintracker_observespinandcalculatertt(struct spindump_analyze* state,
   struct spindump_spintracker* tracker;
   struct spindump_spintracker* otherDirectionTracker;
   if (fromResponder) {
-    tracker = &connection->u.quic.spinFromPeer2to1;
-    otherDirectionTracker = &connection->u.quic.spinFromPeer1to2;
+    tracker = &connection->u.quic.trackers->spinFromPeer2to1;
+    otherDirectionTracker = &connection->u.quic.trackers->spinFromPeer1to2;
   } else {
-    tracker = &connection->u.quic.spinFromPeer1to2;
-    otherDirectionTracker = &connection->u.quic.spinFromPeer2to1;
+    tracker = &connection->u.quic.trackers->spinFromPeer1to2;
+    otherDirectionTracker = &connection->u.quic.trackers->spinFromPeer2to1;
   }
   
   int spin0to1;
@@ -185,7 +185,7 @@ spindump_spintracker_observespinandcalculatertt(struct spindump_analyze* state,
     // Responder spin flips match with equal flips, initiator flips match with inverse flips.
     //
     
-    struct timeval* otherSpinTime =
+    spindump_time* otherSpinTime =
       spindump_spintracker_match_bidirectional_spin(otherDirectionTracker,
                                                     1,
                                                     fromResponder ? spin0to1 : !spin0to1);
@@ -244,7 +244,7 @@ spindump_spintracker_observespin(struct spindump_analyze* state,
                                  struct spindump_packet* packet,
                                  struct spindump_connection* connection,
                                  struct spindump_spintracker* tracker,
-                                 struct timeval* ts,
+                                 spindump_time* ts,
                                  int spin,
                                  int fromResponder,
                                  unsigned int ipPacketLength,
@@ -343,7 +343,7 @@ spindump_spintracker_observespin(struct spindump_analyze* state,
 
 void
 spindump_spintracker_add(struct spindump_spintracker* tracker,
-                         struct timeval* ts,
+                         spindump_time* ts,
                          int spin0to1) {
 
   spindump_assert(tracker != 0);
@@ -364,7 +364,7 @@ spindump_spintracker_add(struct spindump_spintracker* tracker,
 // packet flow).
 //
 
-struct timeval*
+spindump_time*
 spindump_spintracker_match_unidirectional_spin(struct spindump_spintracker* tracker,
                                                int spin0to1) {
   
@@ -400,7 +400,7 @@ spindump_spintracker_match_unidirectional_spin(struct spindump_spintracker* trac
 // Match a spin flip from one side to the other side
 //
 
-struct timeval*
+spindump_time*
 spindump_spintracker_match_bidirectional_spin(struct spindump_spintracker* tracker,
                                               int requireExactSpinValue,
                                               int spin0to1) {
@@ -37,13 +37,13 @@ void
 spindump_spintracker_initialize(struct spindump_spintracker* tracker);
 void
 spindump_spintracker_add(struct spindump_spintracker* tracker,
-                         struct timeval* ts,
+                         spindump_time* ts,
                          int spin0to1);
 void
 spindump_spintracker_observespinandcalculatertt(struct spindump_analyze* state,
                                                 struct spindump_packet* packet,
                                                 struct spindump_connection* connection,
-                                                struct timeval* ts,
+                                                spindump_time* ts,
                                                 int spin,
                                                 int fromResponder,
                                                 unsigned int ipPacketLength,
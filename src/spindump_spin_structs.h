@@ -50,7 +50,7 @@
 struct spindump_spinstore {
   int outstanding;
   int spin0to1;
-  struct timeval received;
+  spindump_time received;
 };
 
 struct spindump_spintracker {
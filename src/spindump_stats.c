@@ -25,6 +25,7 @@
 #include <stdlib.h>
 #include "spindump_util.h"
 #include "spindump_stats.h"
+#include "spindump_pool.h"
 
 //
 // Actual code --------------------------------------------------------------------------------
@@ -62,13 +63,21 @@ spindump_stats_initialize(void) {
 }
 
 //
-// Print the statistics out
+// Print the statistics out. The memory pool statistics of the calling
+// thread are added to any pool statistics already in the statistics
+// object, such as those collected from worker threads.
 //
 
 void
 spindump_stats_report(struct spindump_stats* stats,
                       FILE* file) {
   fprintf(file,"received frames:                        %8u\n", stats->receivedFrames);
+  fprintf(file,"capture ring high-water mark:           %8u\n", stats->captureRingHighWater);
+  fprintf(file,"capture ring overflows:                 %8u\n", stats->captureRingOverflows);
+  fprintf(file,"capture drops in the kernel:            %8llu\n", stats->captureKernelDrops);
+  fprintf(file,"capture drops in the interface:         %8u\n", stats->captureInterfaceDrops);
+  fprintf(file,"capture reports from remotes:           %8u\n", stats->remoteCaptureReports);
+  fprintf(file,"capture drops reported by remotes:      %8llu\n", stats->remoteCaptureDrops);
   fprintf(file,"analyzer handler calls:                 %8u\n", stats->analyzerHandlerCalls);
   fprintf(file,"frame not long enough for Ethernet hdr: %8u\n", stats->notEnoughPacketForEthernetHdr);
   fprintf(file,"received IPv4 packets:                  %8u\n", stats->receivedIp);
@@ -95,6 +104,10 @@ spindump_stats_report(struct spindump_stats* stats,
   fprintf(file,"packet not long enough for COAP hdr:    %8u\n", stats->notEnoughPacketForCoapHdr);
   fprintf(file,"COAP version is not supported:          %8u\n", stats->unrecognisedCoapVersion);
   fprintf(file,"COAP message was not trackable:         %8u\n", stats->untrackableCoapMessage);
+  fprintf(file,"DNS responses matched to a request:     %8u\n", stats->matchedDnsResponse);
+  fprintf(file,"DNS responses without a request:        %8u\n", stats->unmatchedDnsResponse);
+  fprintf(file,"COAP responses matched to a request:    %8u\n", stats->matchedCoapResponse);
+  fprintf(file,"COAP responses without a request:       %8u\n", stats->unmatchedCoapResponse);
   fprintf(file,"TLS message not parsable:               %8u\n", stats->invalidTlsPacket);
   fprintf(file,"received QUIC packets:                  %8u\n", stats->receivedQuic);
   fprintf(file,"packet not long enough for QUIC hdr:    %8u\n", stats->notEnoughPacketForQuicHdr);
@@ -121,6 +134,107 @@ spindump_stats_report(struct spindump_stats* stats,
   fprintf(file,"connections, QUIC:                      %8u\n", stats->connectionsQuic);
   fprintf(file,"connections, deleted after closing:     %8u\n", stats->connectionsDeletedClosed);
   fprintf(file,"connections, deleted after inactive:    %8u\n", stats->connectionsDeletedInactive);
+  fprintf(file,"connections, evicted when establishing: %8u\n", stats->connectionsEvictedEstablishing);
+  fprintf(file,"connections, evicted after closing:     %8u\n", stats->connectionsEvictedClosed);
+  fprintf(file,"connections, evicted while active:      %8u\n", stats->connectionsEvictedActive);
+  struct spindump_stats pool;
+  memset(&pool,0,sizeof(pool));
+  spindump_pool_getstats(&pool);
+  fprintf(file,"memory pool objects in use:             %8u\n", stats->poolObjectsInUse + pool.poolObjectsInUse);
+  fprintf(file,"memory pool allocations:                %8llu\n", stats->poolAllocations + pool.poolAllocations);
+  fprintf(file,"memory pool allocations reusing memory: %8llu\n", stats->poolReuses + pool.poolReuses);
+  fprintf(file,"allocations too large for memory pool:  %8llu\n", stats->poolDirectAllocations + pool.poolDirectAllocations);
+}
+
+//
+// Add the statistics from another statistics object to this one,
+// e.g., to combine statistics from several analyzers.
+//
+
+void
+spindump_stats_add(struct spindump_stats* stats,
+                   const struct spindump_stats* other) {
+  spindump_assert(stats != 0);
+  spindump_assert(other != 0);
+  stats->receivedFrames += other->receivedFrames;
+  if (other->captureRingHighWater > stats->captureRingHighWater) {
+    stats->captureRingHighWater = other->captureRingHighWater;
+  }
+  stats->captureRingOverflows += other->captureRingOverflows;
+  stats->captureKernelDrops += other->captureKernelDrops;
+  stats->captureInterfaceDrops += other->captureInterfaceDrops;
+  stats->remoteCaptureReports += other->remoteCaptureReports;
+  stats->remoteCaptureDrops += other->remoteCaptureDrops;
+  stats->analyzerHandlerCalls += other->analyzerHandlerCalls;
+  stats->notEnoughPacketForEthernetHdr += other->notEnoughPacketForEthernetHdr;
+  stats->receivedIp += other->receivedIp;
+  stats->receivedIpv6 += other->receivedIpv6;
+  stats->receivedIpBytes += other->receivedIpBytes;
+  stats->receivedIpv6Bytes += other->receivedIpv6Bytes;
+  stats->invalidIpHdrSize += other->invalidIpHdrSize;
+  stats->notEnoughPacketForIpHdr += other->notEnoughPacketForIpHdr;
+  stats->versionMismatch += other->versionMismatch;
+  stats->invalidIpLength += other->invalidIpLength;
+  stats->unhandledFragment += other->unhandledFragment;
+  stats->fragmentTooShort += other->fragmentTooShort;
+  stats->receivedIcmp += other->receivedIcmp;
+  stats->invalidIcmpHdrSize += other->invalidIcmpHdrSize;
+  stats->notEnoughPacketForIcmpHdr += other->notEnoughPacketForIcmpHdr;
+  stats->unsupportedIcmpType += other->unsupportedIcmpType;
+  stats->invalidIcmpCode += other->invalidIcmpCode;
+  stats->receivedIcmpEcho += other->receivedIcmpEcho;
+  stats->receivedUdp += other->receivedUdp;
+  stats->notEnoughPacketForUdpHdr += other->notEnoughPacketForUdpHdr;
+  stats->notEnoughPacketForDnsHdr += other->notEnoughPacketForDnsHdr;
+  stats->notEnoughPacketForCoapHdr += other->notEnoughPacketForCoapHdr;
+  stats->unrecognisedCoapVersion += other->unrecognisedCoapVersion;
+  stats->untrackableCoapMessage += other->untrackableCoapMessage;
+  stats->matchedDnsResponse += other->matchedDnsResponse;
+  stats->unmatchedDnsResponse += other->unmatchedDnsResponse;
+  stats->matchedCoapResponse += other->matchedCoapResponse;
+  stats->unmatchedCoapResponse += other->unmatchedCoapResponse;
+  stats->invalidTlsPacket += other->invalidTlsPacket;
+  stats->receivedQuic += other->receivedQuic;
+  stats->notEnoughPacketForQuicHdr += other->notEnoughPacketForQuicHdr;
+  stats->notEnoughPacketForQuicHdrToken += other->notEnoughPacketForQuicHdrToken;
+  stats->notEnoughPacketForQuicHdrLength += other->notEnoughPacketForQuicHdrLength;
+  stats->notAbleToHandleGoogleQuicCoalescing += other->notAbleToHandleGoogleQuicCoalescing;
+  stats->unrecognisedQuicVersion += other->unrecognisedQuicVersion;
+  stats->unsupportedQuicVersion += other->unsupportedQuicVersion;
+  stats->unrecognisedQuicType += other->unrecognisedQuicType;
+  stats->unsupportedQuicType += other->unsupportedQuicType;
+  stats->receivedTcp += other->receivedTcp;
+  stats->notEnoughPacketForTcpHdr += other->notEnoughPacketForTcpHdr;
+  stats->invalidTcpHdrSize += other->invalidTcpHdrSize;
+  stats->invalidTcpOptSize += other->invalidTcpOptSize;
+  stats->unknownTcpConnection += other->unknownTcpConnection;
+  stats->unknownSctpConnection += other->unknownSctpConnection;
+  stats->receivedSctp += other->receivedSctp;
+  stats->notEnoughPacketForSctpHdr += other->notEnoughPacketForSctpHdr;
+  stats->protocolNotSupported += other->protocolNotSupported;
+  stats->unsupportedEthertype += other->unsupportedEthertype;
+  stats->unsupportedNulltype += other->unsupportedNulltype;
+  stats->invalidRtt += other->invalidRtt;
+  stats->connections += other->connections;
+  stats->connectionsIcmp += other->connectionsIcmp;
+  stats->connectionsTcp += other->connectionsTcp;
+  stats->connectionsSctp += other->connectionsSctp;
+  stats->connectionsUdp += other->connectionsUdp;
+  stats->connectionsDns += other->connectionsDns;
+  stats->connectionsCoap += other->connectionsCoap;
+  stats->connectionsQuic += other->connectionsQuic;
+  stats->connectionsDeletedClosed += other->connectionsDeletedClosed;
+  stats->connectionsDeletedInactive += other->connectionsDeletedInactive;
+  stats->connectionsEvictedEstablishing += other->connectionsEvictedEstablishing;
+  stats->connectionsEvictedClosed += other->connectionsEvictedClosed;
+  stats->connectionsEvictedActive += other->connectionsEvictedActive;
+  stats->poolSlabs += other->poolSlabs;
+  stats->poolObjectsInUse += other->poolObjectsInUse;
+  stats->poolObjectsFree += other->poolObjectsFree;
+  stats->poolBytes += other->poolBytes;
+  stats->poolAllocations += other->poolAllocations;
+  stats->poolReuses += other->poolReuses;
+  stats->poolDirectAllocations += other->poolDirectAllocations;
 }
 
 //
@@ -32,6 +32,12 @@
 
 struct spindump_stats {
   spindump_counter_32bit receivedFrames;
+  spindump_counter_32bit captureRingHighWater;
+  spindump_counter_32bit captureRingOverflows;
+  spindump_counter_64bit captureKernelDrops;
+  spindump_counter_32bit captureInterfaceDrops;
+  spindump_counter_32bit remoteCaptureReports;
+  spindump_counter_64bit remoteCaptureDrops;
   spindump_counter_32bit analyzerHandlerCalls;
   spindump_counter_32bit notEnoughPacketForEthernetHdr;
   spindump_counter_32bit receivedIp;
@@ -56,6 +62,10 @@ struct spindump_stats {
   spindump_counter_32bit notEnoughPacketForCoapHdr;
   spindump_counter_32bit unrecognisedCoapVersion;
   spindump_counter_32bit untrackableCoapMessage;
+  spindump_counter_32bit matchedDnsResponse;
+  spindump_counter_32bit unmatchedDnsResponse;
+  spindump_counter_32bit matchedCoapResponse;
+  spindump_counter_32bit unmatchedCoapResponse;
   spindump_counter_32bit invalidTlsPacket;
   spindump_counter_32bit receivedQuic;
   spindump_counter_32bit notEnoughPacketForQuicHdr;
@@ -88,6 +98,16 @@ struct spindump_stats {
   spindump_counter_32bit connectionsQuic;
   spindump_counter_32bit connectionsDeletedClosed;
   spindump_counter_32bit connectionsDeletedInactive;
+  spindump_counter_32bit connectionsEvictedEstablishing;
+  spindump_counter_32bit connectionsEvictedClosed;
+  spindump_counter_32bit connectionsEvictedActive;
+  spindump_counter_32bit poolSlabs;
+  spindump_counter_32bit poolObjectsInUse;
+  spindump_counter_32bit poolObjectsFree;
+  spindump_counter_64bit poolBytes;
+  spindump_counter_64bit poolAllocations;
+  spindump_counter_64bit poolReuses;
+  spindump_counter_64bit poolDirectAllocations;
   // uint8_t padding2[4]; // unused padding to align the next field properly
 };
 
@@ -101,6 +121,9 @@ void
 spindump_stats_report(struct spindump_stats* stats,
                       FILE* file);
 void
+spindump_stats_add(struct spindump_stats* stats,
+                   const struct spindump_stats* other);
+void
 spindump_stats_uninitialize(struct spindump_stats* state);
 
 #endif // SPINDUMP_STATS_H
@@ -25,6 +25,10 @@
 #include "spindump_table_structs.h"
 #include "spindump_connections_structs.h"
 #include "spindump_table.h"
+#include "spindump_table_index.h"
+#include "spindump_table_timers.h"
+#include "spindump_table_aggregates.h"
+#include "spindump_table_eviction.h"
 #include "spindump_connections.h"
 #include "spindump_stats.h"
 #include "spindump_analyze.h"
@@ -33,9 +37,12 @@
 // Function prototypes ------------------------------------------------------------------------
 //
 
-static void
+static int
+spindump_connectionstable_timeoutdeadline(const struct spindump_connection* connection,
+                                          unsigned long* deadline);
+static int
 spindump_connectionstable_periodiccheck_aux(struct spindump_connection* connection,
-                                            const struct timeval* now,
+                                            const spindump_time* now,
                                             struct spindump_connectionstable* table,
                                             struct spindump_analyze* analyzer,
                                             int print_info);
@@ -43,7 +50,7 @@ static void
 spindump_connectionstable_compresstable(struct spindump_connectionstable* table);
 static void
 spindump_connectionstable_periodicreport(struct spindump_connectionstable* table,
-                                         const struct timeval* now,
+                                         const spindump_time* now,
                                          struct spindump_analyze* analyzer);
 
 //
@@ -93,6 +100,10 @@ spindump_connectionstable_initialize(unsigned long long bandwidthMeasurementPeri
   }
   table->nConnections = 0;
   table->maxNConnections = variabletabelements;
+  table->nHoles = 0;
+  table->firstHole = 0;
+  table->tcpWindow = spindump_seqtracker_maxnstored;
+  table->bandwidthSeries = spindump_bandwidth_series_none;
   
   //
   // Allocate the actual table of connections
@@ -115,6 +126,35 @@ spindump_connectionstable_initialize(unsigned long long bandwidthMeasurementPeri
     table->connections[i] = 0;
   }
   
+  //
+  // Allocate the address and port index for the connections
+  // 
+  
+  if (!spindump_connectionstable_index_initialize(table)) {
+    spindump_deepdebugf("free table after an error");
+    spindump_free(table->connections);
+    spindump_free(table);
+    return(0);
+  }
+  
+  //
+  // Initialize the timers for connection timeouts
+  // 
+  
+  spindump_connectionstable_timers_initialize(table);
+  
+  //
+  // Initialize the index of aggregates
+  // 
+  
+  spindump_connectionstable_aggregates_initialize(table);
+  
+  //
+  // Initialize the eviction lists, with no limits
+  // 
+  
+  spindump_connectionstable_eviction_initialize(table);
+  
   //
   // Done. Return the table.
   // 
@@ -153,6 +193,10 @@ spindump_connectionstable_uninitialize(struct spindump_connectionstable* table)
   // Free up the connections table resources themselves
   //
   
+  spindump_connectionstable_index_uninitialize(table);
+  spindump_connectionstable_timers_uninitialize(table);
+  spindump_connectionstable_aggregates_uninitialize(table);
+  spindump_connectionstable_eviction_uninitialize(table);
   memset(table->connections,0xFF,table->maxNConnections * sizeof(struct spindump_connection*));
   spindump_deepdebugf("free table->connections in spindump_connections_freetable");
   spindump_free(table->connections);
@@ -166,15 +210,90 @@ spindump_connectionstable_uninitialize(struct spindump_connectionstable* table)
   //
 }
 
+//
+// Determine the second at which the timeouts of a connection need to
+// be checked next, based on the connection's latest packets and
+// state. Return 1 and set *deadline if there is such a second, or 0 if
+// the connection cannot currently time out.
+//
+// The deadline is allowed to be too early, as the check itself is
+// exact. It must never be too late, so the connection needs to be
+// rescheduled whenever its timeout gets shorter (e.g., when it is
+// marked deleted).
+//
+
+static int
+spindump_connectionstable_timeoutdeadline(const struct spindump_connection* connection,
+                                          unsigned long* deadline) {
+  
+  spindump_assert(connection != 0);
+  spindump_assert(deadline != 0);
+  
+  //
+  // Find out the time of the latest activity, like
+  // spindump_connections_lastaction() does
+  //
+  
+  if (connection->manuallyCreated) return(0);
+  if (spindump_iszerotime(&connection->latestPacketFromSide1)) return(0);
+  const spindump_time* latest = &connection->latestPacketFromSide1;
+  if (!spindump_iszerotime(&connection->latestPacketFromSide2) &&
+      spindump_isearliertime(&connection->latestPacketFromSide2,latest)) {
+    latest = &connection->latestPacketFromSide2;
+  }
+  
+  //
+  // Find out the timeout that applies first
+  //
+  
+  unsigned long long timeout;
+  if (connection->deleted) {
+    timeout = spindump_connection_deleted_timeout;
+  } else if (spindump_connections_isestablishing(connection)) {
+    timeout = spindump_connection_establishing_timeout;
+  } else if (!connection->remote) {
+    timeout = spindump_connection_inactive_timeout;
+  } else {
+    return(0);
+  }
+  
+  *deadline = (unsigned long)((*latest / spindump_time_nsecsperusec + timeout) / (1000 * 1000));
+  return(1);
+}
+
+//
+// Update the scheduled timeout check of a connection, after a packet
+// or some other change in the connection. As the checks can happen
+// early, only a timeout that comes earlier than the scheduled check
+// requires moving the connection in the timers. This function needs
+// to be called when a connection has been created, or its state has
+// changed.
+//
+
+void
+spindump_connectionstable_updatetimeout(struct spindump_connectionstable* table,
+                                        struct spindump_connection* connection) {
+  spindump_assert(table != 0);
+  spindump_assert(connection != 0);
+  unsigned long deadline;
+  if (!spindump_connectionstable_timeoutdeadline(connection,&deadline)) {
+    spindump_connectionstable_timers_unschedule(table,connection);
+  } else if (!spindump_connectionstable_timers_isscheduled(connection) ||
+             deadline < connection->timerDeadline) {
+    spindump_connectionstable_timers_schedule(table,connection,deadline);
+  }
+}
+
 //
 // Perform a check if a given connection needs idle timeout or some
-// other action. This function gets called every few seconds to scan
-// through a connection.
+// other action. This function gets called for connections whose
+// timeout checks are due, as determined by the table timers. Return
+// 1 if the connection was deleted, 0 otherwise.
 //
 
-static void
+static int
 spindump_connectionstable_periodiccheck_aux(struct spindump_connection* connection,
-                                            const struct timeval* now,
+                                            const spindump_time* now,
                                             struct spindump_connectionstable* table,
                                             struct spindump_analyze* analyzer,
                                             int print_info) {
@@ -186,8 +305,7 @@ spindump_connectionstable_periodiccheck_aux(struct spindump_connection* connecti
 
   spindump_assert(connection != 0);
   spindump_assert(now != 0);
-  spindump_assert(now->tv_sec > 0);
-  spindump_assert(now->tv_usec < 1000 * 1000);
+  spindump_assert(*now > 0);
   spindump_assert(table != 0);
   spindump_assert(analyzer != 0);
   
@@ -197,7 +315,7 @@ spindump_connectionstable_periodiccheck_aux(struct spindump_connection* connecti
   // periodic cleanup.
   //
 
-  if (connection->manuallyCreated) return;
+  if (connection->manuallyCreated) return(0);
   
   //
   // See when the last event related to this connection was
@@ -217,6 +335,7 @@ spindump_connectionstable_periodiccheck_aux(struct spindump_connection* connecti
     
     spindump_connectionstable_deleteconnection(connection,table,analyzer,"closed",print_info);
     stats->connectionsDeletedClosed++;
+    return(1);
     
   } else if (spindump_connections_isestablishing(connection) &&
              lastAction >= (unsigned long long)(spindump_connection_establishing_timeout)) {
@@ -227,40 +346,50 @@ spindump_connectionstable_periodiccheck_aux(struct spindump_connection* connecti
                         (unsigned long long)(spindump_connection_establishing_timeout));
     spindump_connectionstable_deleteconnection(connection,table,analyzer,"failed connection attempt",print_info);
     stats->connectionsDeletedInactive++;
+    return(1);
     
   } else if (lastAction >= (unsigned long long)(spindump_connection_inactive_timeout) &&
              !connection->remote) {
     
     spindump_connectionstable_deleteconnection(connection,table,analyzer,"inactive",print_info);
     stats->connectionsDeletedInactive++;
+    return(1);
     
   }
+  
+  return(0);
 }
 
 //
 // Compress the connections table by moving connections in the table
 // closer to the beginning of the table. This makes allocation easier,
-// as new entries can be added to the end.
+// as new entries can be added to the end. Only the part of the table
+// after the first unused position needs to be looked at.
 //
 
 static void
 spindump_connectionstable_compresstable(struct spindump_connectionstable* table) {
+  if (table->nHoles == 0) return;
   unsigned int shiftdown = 0;
-  for (unsigned int i = 0; i < table->nConnections; i++) {
+  for (unsigned int i = table->firstHole; i < table->nConnections; i++) {
     if (table->connections[i] == 0) {
       shiftdown++;
     } else if (shiftdown > 0) {
       table->connections[i-shiftdown] = table->connections[i];
+      table->connections[i-shiftdown]->tableIndex = i-shiftdown;
       table->connections[i] = 0;
     }
   }
+  spindump_assert(shiftdown == table->nHoles);
   table->nConnections -= shiftdown;
+  table->nHoles = 0;
+  table->firstHole = table->nConnections;
   if (shiftdown > 0) spindump_debugf("spindump_connectionstable_compresstable freed %u positions", shiftdown);
 }
 
 static void
 spindump_connectionstable_periodicreport(struct spindump_connectionstable* table,
-                                         const struct timeval* now,
+                                         const spindump_time* now,
                                          struct spindump_analyze* analyzer) {
   spindump_deepdeepdebugf("spindump_connectionstable_periodicreport");
   table->performingPeriodicReport = 1;
@@ -281,21 +410,29 @@ spindump_connectionstable_periodicreport(struct spindump_connectionstable* table
 
 int
 spindump_connectionstable_periodiccheck(struct spindump_connectionstable* table,
-                                        const struct timeval* now,
+                                        const spindump_time* now,
                                         struct spindump_analyze* analyzer,
                                         int print_info
                                         ) {
-  spindump_assert(now->tv_sec > 0);
-  spindump_assert(now->tv_usec < 1000 * 1000);
-  if (table->lastPeriodicCheck.tv_sec != now->tv_sec) {
+  spindump_assert(*now > 0);
+  unsigned long long nowSeconds = *now / spindump_time_nsecspersec;
+  if (table->lastPeriodicCheck / spindump_time_nsecspersec != nowSeconds) {
 
     //
-    // Do the check
+    // Do the check, for those connections whose timeouts may have
+    // expired by now. The others stay in the timers.
     //
     
-    for (unsigned int i = 0; i < table->nConnections; i++) {
-      struct spindump_connection* connection = table->connections[i];
-      if (connection != 0) spindump_connectionstable_periodiccheck_aux(connection,now,table,analyzer,print_info);
+    struct spindump_connection** due;
+    unsigned int nDue = spindump_connectionstable_timers_expire(table,(unsigned long)nowSeconds,&due);
+    for (unsigned int i = 0; i < nDue; i++) {
+      struct spindump_connection* connection = due[i];
+      if (!spindump_connectionstable_periodiccheck_aux(connection,now,table,analyzer,print_info)) {
+        unsigned long deadline;
+        if (spindump_connectionstable_timeoutdeadline(connection,&deadline)) {
+          spindump_connectionstable_timers_schedule(table,connection,deadline);
+        }
+      }
     }
     spindump_connectionstable_compresstable(table);
     table->lastPeriodicCheck = *now;
@@ -305,7 +442,7 @@ spindump_connectionstable_periodiccheck(struct spindump_connectionstable* table,
     //
     
     if (table->periodicReportPeriod != 0 &&
-        now->tv_sec - table->lastPeriodicReport.tv_sec >=  table->periodicReportPeriod) {
+        nowSeconds - table->lastPeriodicReport / spindump_time_nsecspersec >= table->periodicReportPeriod) {
       spindump_connectionstable_periodicreport(table,now,analyzer);
       table->lastPeriodicReport = *now;
     }
@@ -365,25 +502,28 @@ spindump_connectionstable_deleteconnection(struct spindump_connection* connectio
                                     &dummy,
                                     connection);
   spindump_deepdeepdebugf("delete calling handlers... done");
+  spindump_analyze_unregisterconnectionhandlers(analyzer,connection);
   
   //
-  // Delete the connection from the table
+  // Delete the connection from the table and its index. The
+  // connection knows its own position in the table.
   // 
 
-  int found = 0;
-  for (unsigned int i = 0; i < table->nConnections; i++) {
-    if (table->connections[i] == connection) {
-      found = 1;
-      table->connections[i] = 0;
-    }
-  }
-  
-  spindump_assert(found);
+  spindump_assert(connection->tableIndex < table->nConnections);
+  spindump_assert(table->connections[connection->tableIndex] == connection);
+  table->connections[connection->tableIndex] = 0;
+  if (table->nHoles == 0 || connection->tableIndex < table->firstHole) table->firstHole = connection->tableIndex;
+  table->nHoles++;
+  spindump_connectionstable_index_remove(table,connection);
+  spindump_connectionstable_timers_unschedule(table,connection);
+  spindump_connectionstable_aggregates_remove(table,connection);
+  spindump_connectionstable_eviction_remove(table,connection);
   
   //
   // Delete the object
   // 
 
+  spindump_connections_leaveaggregates(connection,table);
   spindump_connections_delete(connection);
 }
 
@@ -50,10 +50,13 @@ void
 spindump_connectionstable_uninitialize(struct spindump_connectionstable* table);
 int
 spindump_connectionstable_periodiccheck(struct spindump_connectionstable* table,
-                                        const struct timeval* now,
+                                        const spindump_time* now,
                                         struct spindump_analyze* analyzer,
                                         int print_info);
 void
+spindump_connectionstable_updatetimeout(struct spindump_connectionstable* table,
+                                        struct spindump_connection* connection);
+void
 spindump_connectionstable_deleteconnection(struct spindump_connection* connection,
                                            struct spindump_connectionstable* table,
                                            struct spindump_analyze* analyzer,
@@ -0,0 +1,485 @@
+
+//
+//
+//  ////////////////////////////////////////////////////////////////////////////////////
+//  /////////                                                                ///////////
+//  //////       SSS    PPPP    I   N    N   DDDD    U   U   M   M   PPPP         //////
+//  //          S       P   P   I   NN   N   D   D   U   U   MM MM   P   P            //
+//  /            SSS    PPPP    I   N NN N   D   D   U   U   M M M   PPPP              /
+//  //              S   P       I   N   NN   D   D   U   U   M   M   P                //
+//  ////         SSS    P       I   N    N   DDDD     UUU    M   M   P            //////
+//  /////////                                                                ///////////
+//  ////////////////////////////////////////////////////////////////////////////////////
+//
+//  SPINDUMP (C) 2018-2020 BY ERICSSON RESEARCH
+//  AUTHOR: JARI ARKKO
+//
+
+//
+// Includes -----------------------------------------------------------------------------------
+//
+
+#include <stdlib.h>
+#include <string.h>
+#include "spindump_util.h"
+#include "spindump_connections.h"
+#include "spindump_table_aggregates.h"
+
+//
+// Function prototypes ------------------------------------------------------------------------
+//
+
+static struct spindump_connectionstable_aggregatenode*
+spindump_connectionstable_aggregates_newnode(void);
+static void
+spindump_connectionstable_aggregates_freenode(struct spindump_connectionstable_aggregatenode* node);
+static struct spindump_connectionstable_aggregatenode**
+spindump_connectionstable_aggregates_trie(struct spindump_connectionstable* table,
+                                          const spindump_address* address,
+                                          const uint8_t** p_bits,
+                                          unsigned int* p_nbits);
+static unsigned int
+spindump_connectionstable_aggregates_bit(const uint8_t* bits,
+                                         unsigned int position);
+static unsigned int
+spindump_connectionstable_aggregates_keys(const struct spindump_connection* aggregate,
+                                          spindump_network* keys);
+static struct spindump_connection**
+spindump_connectionstable_aggregates_next(const struct spindump_connectionstable_aggregatenode* node,
+                                          struct spindump_connection* aggregate);
+static void
+spindump_connectionstable_aggregates_prune(struct spindump_connectionstable_aggregatenode** p_node,
+                                           const uint8_t* bits,
+                                           unsigned int depth,
+                                           unsigned int length);
+static void
+spindump_connectionstable_aggregates_collect(struct spindump_connectionstable* table,
+                                             const spindump_address* address);
+static int
+spindump_connectionstable_aggregates_addcandidate(struct spindump_connectionstable* table,
+                                                  struct spindump_connection* aggregate);
+static int
+spindump_connectionstable_aggregates_compare(const void* a,
+                                             const void* b);
+
+//
+// Actual code --------------------------------------------------------------------------------
+//
+
+//
+// Initialize the aggregate index of a table. The index is a binary
+// trie of address prefixes, one for IPv4 and one for IPv6. Each simple
+// (i.e., not multinet) aggregate is stored at the node for each of its
+// host addresses and networks, so that the aggregates that an address
+// may belong to are found on the path from the root to the address,
+// in time that depends on the address length rather than on the
+// number of aggregates or connections.
+//
+
+void
+spindump_connectionstable_aggregates_initialize(struct spindump_connectionstable* table) {
+  spindump_assert(table != 0);
+  table->aggregateTrieV4 = 0;
+  table->aggregateTrieV6 = 0;
+  table->nAggregateCandidates = 0;
+  table->maxNAggregateCandidates = 0;
+  table->aggregateCandidates = 0;
+}
+
+//
+// Free up the resources associated with the aggregate index. The
+// aggregates themselves are not affected.
+//
+
+void
+spindump_connectionstable_aggregates_uninitialize(struct spindump_connectionstable* table) {
+  spindump_assert(table != 0);
+  spindump_connectionstable_aggregates_freenode(table->aggregateTrieV4);
+  spindump_connectionstable_aggregates_freenode(table->aggregateTrieV6);
+  table->aggregateTrieV4 = 0;
+  table->aggregateTrieV6 = 0;
+  if (table->aggregateCandidates != 0) {
+    spindump_deepdebugf("free table->aggregateCandidates in spindump_connectionstable_aggregates_uninitialize");
+    spindump_free(table->aggregateCandidates);
+    table->aggregateCandidates = 0;
+  }
+  table->nAggregateCandidates = 0;
+  table->maxNAggregateCandidates = 0;
+}
+
+//
+// Allocate an empty trie node
+//
+
+static struct spindump_connectionstable_aggregatenode*
+spindump_connectionstable_aggregates_newnode(void) {
+  unsigned int size = sizeof(struct spindump_connectionstable_aggregatenode);
+  struct spindump_connectionstable_aggregatenode* node =
+    (struct spindump_connectionstable_aggregatenode*)spindump_malloc(size);
+  if (node == 0) {
+    spindump_errorf("cannot allocate an aggregate index node of %u bytes", size);
+    return(0);
+  }
+  memset(node,0,size);
+  return(node);
+}
+
+//
+// Free a trie node and all nodes below it
+//
+
+static void
+spindump_connectionstable_aggregates_freenode(struct spindump_connectionstable_aggregatenode* node) {
+  if (node == 0) return;
+  spindump_connectionstable_aggregates_freenode(node->children[0]);
+  spindump_connectionstable_aggregates_freenode(node->children[1]);
+  spindump_deepdeepdebugf("free an aggregate index node");
+  spindump_free(node);
+}
+
+//
+// Find the trie for the address family of a given address, and the
+// bits of the address in network byte order. Return 0 if addresses of
+// this family are not indexed.
+//
+
+static struct spindump_connectionstable_aggregatenode**
+spindump_connectionstable_aggregates_trie(struct spindump_connectionstable* table,
+                                          const spindump_address* address,
+                                          const uint8_t** p_bits,
+                                          unsigned int* p_nbits) {
+  switch (address->ss_family) {
+  case AF_INET:
+    *p_bits = (const uint8_t*)&((const struct sockaddr_in*)address)->sin_addr.s_addr;
+    *p_nbits = 32;
+    return(&table->aggregateTrieV4);
+  case AF_INET6:
+    *p_bits = ((const struct sockaddr_in6*)address)->sin6_addr.s6_addr;
+    *p_nbits = 128;
+    return(&table->aggregateTrieV6);
+  default:
+    return(0);
+  }
+}
+
+//
+// Get the bit at a given position of an address, counting from the
+// most significant bit
+//
+
+static unsigned int
+spindump_connectionstable_aggregates_bit(const uint8_t* bits,
+                                         unsigned int position) {
+  return((bits[position / 8] >> (7 - (position % 8))) & 1);
+}
+
+//
+// Determine the prefixes that a simple aggregate is indexed under. A
+// connection can only belong to the aggregate if one of its addresses
+// is within one of these prefixes. Return the number of prefixes
+// placed in keys, at most spindump_connectionstable_aggregates_nkeys.
+//
+
+static unsigned int
+spindump_connectionstable_aggregates_keys(const struct spindump_connection* aggregate,
+                                          spindump_network* keys) {
+  switch (aggregate->type) {
+    
+  case spindump_connection_aggregate_hostpair:
+    spindump_network_fromaddress(&aggregate->u.aggregatehostpair.side1peerAddress,&keys[0]);
+    spindump_network_fromaddress(&aggregate->u.aggregatehostpair.side2peerAddress,&keys[1]);
+    return(2);
+    
+  case spindump_connection_aggregate_hostnetwork:
+    spindump_network_fromaddress(&aggregate->u.aggregatehostnetwork.side1peerAddress,&keys[0]);
+    keys[1] = aggregate->u.aggregatehostnetwork.side2Network;
+    return(2);
+    
+  case spindump_connection_aggregate_networknetwork:
+    keys[0] = aggregate->u.aggregatenetworknetwork.side1Network;
+    keys[1] = aggregate->u.aggregatenetworknetwork.side2Network;
+    return(2);
+    
+  case spindump_connection_aggregate_multicastgroup:
+    spindump_network_fromaddress(&aggregate->u.aggregatemulticastgroup.group,&keys[0]);
+    return(1);
+    
+  case spindump_connection_transport_tcp:
+  case spindump_connection_transport_sctp:
+  case spindump_connection_transport_udp:
+  case spindump_connection_transport_dns:
+  case spindump_connection_transport_coap:
+  case spindump_connection_transport_quic:
+  case spindump_connection_transport_icmp:
+  case spindump_connection_aggregate_hostmultinet:
+  case spindump_connection_aggregate_networkmultinet:
+  default:
+    return(0);
+    
+  }
+}
+
+//
+// Find the link that follows a given aggregate in the list of a
+// given node. An aggregate is in a list at most once, but may be
+// linked either through its first or its second key.
+//
+
+static struct spindump_connection**
+spindump_connectionstable_aggregates_next(const struct spindump_connectionstable_aggregatenode* node,
+                                          struct spindump_connection* aggregate) {
+  if (aggregate->aggregateIndexNode[0] == node) return(&aggregate->aggregateIndexNext[0]);
+  spindump_assert(aggregate->aggregateIndexNode[1] == node);
+  return(&aggregate->aggregateIndexNext[1]);
+}
+
+//
+// Add a simple aggregate to the index. This needs to be done after
+// the addresses or networks of the aggregate have been set. Other
+// connection types are ignored.
+//
+// Return 1 upon success, 0 if memory could not be allocated. In the
+// latter case the aggregate is left out of the index altogether.
+//
+
+int
+spindump_connectionstable_aggregates_add(struct spindump_connectionstable* table,
+                                         struct spindump_connection* aggregate) {
+  
+  spindump_assert(table != 0);
+  spindump_assert(aggregate != 0);
+  spindump_assert(aggregate->aggregateIndexNode[0] == 0);
+  spindump_assert(aggregate->aggregateIndexNode[1] == 0);
+
+  spindump_network keys[spindump_connectionstable_aggregates_nkeys];
+  unsigned int nKeys = spindump_connectionstable_aggregates_keys(aggregate,keys);
+  
+  for (unsigned int key = 0; key < nKeys; key++) {
+
+    //
+    // Walk down the trie to the node of the prefix, creating nodes as
+    // needed
+    //
+    
+    const uint8_t* bits;
+    unsigned int nbits;
+    struct spindump_connectionstable_aggregatenode** p_node =
+      spindump_connectionstable_aggregates_trie(table,&keys[key].address,&bits,&nbits);
+    if (p_node == 0) continue;
+    unsigned int length = keys[key].length < nbits ? keys[key].length : nbits;
+    struct spindump_connectionstable_aggregatenode** p_root = p_node;
+    for (unsigned int depth = 0; ; depth++) {
+      if (*p_node == 0) *p_node = spindump_connectionstable_aggregates_newnode();
+      if (*p_node == 0) {
+        spindump_connectionstable_aggregates_prune(p_root,bits,0,length);
+        spindump_connectionstable_aggregates_remove(table,aggregate);
+        return(0);
+      }
+      if (depth == length) break;
+      p_node = &(*p_node)->children[spindump_connectionstable_aggregates_bit(bits,depth)];
+    }
+
+    //
+    // Link the aggregate to the node, unless the other key of the
+    // aggregate already took it there
+    //
+    
+    struct spindump_connectionstable_aggregatenode* node = *p_node;
+    if (key > 0 && aggregate->aggregateIndexNode[0] == node) continue;
+    aggregate->aggregateIndexNode[key] = node;
+    aggregate->aggregateIndexNext[key] = node->aggregates;
+    node->aggregates = aggregate;
+    spindump_deepdeepdebugf("indexed aggregate %u under %s",
+                            aggregate->id, spindump_network_tostring(&keys[key]));
+  }
+  
+  return(1);
+}
+
+//
+// Remove the trie nodes that no longer hold any aggregates along the
+// path to a given prefix. The root nodes are kept.
+//
+
+static void
+spindump_connectionstable_aggregates_prune(struct spindump_connectionstable_aggregatenode** p_node,
+                                           const uint8_t* bits,
+                                           unsigned int depth,
+                                           unsigned int length) {
+  struct spindump_connectionstable_aggregatenode* node = *p_node;
+  if (node == 0) return;
+  if (depth < length) {
+    spindump_connectionstable_aggregates_prune(&node->children[spindump_connectionstable_aggregates_bit(bits,depth)],
+                                               bits,
+                                               depth + 1,
+                                               length);
+  }
+  if (depth > 0 && node->aggregates == 0 && node->children[0] == 0 && node->children[1] == 0) {
+    spindump_deepdeepdebugf("free an aggregate index node after removal");
+    spindump_free(node);
+    *p_node = 0;
+  }
+}
+
+//
+// Remove an aggregate from the index. It is not an error to call this
+// for a connection that is not in the index.
+//
+
+void
+spindump_connectionstable_aggregates_remove(struct spindump_connectionstable* table,
+                                            struct spindump_connection* aggregate) {
+  
+  spindump_assert(table != 0);
+  spindump_assert(aggregate != 0);
+  
+  spindump_network keys[spindump_connectionstable_aggregates_nkeys];
+  unsigned int nKeys = spindump_connectionstable_aggregates_keys(aggregate,keys);
+  
+  for (unsigned int key = 0; key < nKeys; key++) {
+    
+    struct spindump_connectionstable_aggregatenode* node = aggregate->aggregateIndexNode[key];
+    if (node == 0) continue;
+
+    //
+    // Unlink from the list of the node
+    //
+    
+    struct spindump_connection** p_link = &node->aggregates;
+    while (*p_link != 0 && *p_link != aggregate) {
+      p_link = spindump_connectionstable_aggregates_next(node,*p_link);
+    }
+    spindump_assert(*p_link == aggregate);
+    *p_link = aggregate->aggregateIndexNext[key];
+    aggregate->aggregateIndexNode[key] = 0;
+    aggregate->aggregateIndexNext[key] = 0;
+
+    //
+    // Release nodes that are no longer needed
+    //
+    
+    const uint8_t* bits;
+    unsigned int nbits;
+    struct spindump_connectionstable_aggregatenode** p_root =
+      spindump_connectionstable_aggregates_trie(table,&keys[key].address,&bits,&nbits);
+    spindump_assert(p_root != 0);
+    unsigned int length = keys[key].length < nbits ? keys[key].length : nbits;
+    spindump_connectionstable_aggregates_prune(p_root,bits,0,length);
+  }
+}
+
+//
+// Add an aggregate to the array of candidates. Return 1 upon success,
+// 0 if memory could not be allocated.
+//
+
+static int
+spindump_connectionstable_aggregates_addcandidate(struct spindump_connectionstable* table,
+                                                  struct spindump_connection* aggregate) {
+  if (table->nAggregateCandidates == table->maxNAggregateCandidates) {
+    unsigned int newMax = table->maxNAggregateCandidates == 0 ? 16 : table->maxNAggregateCandidates * 2;
+    unsigned int size = newMax * sizeof(struct spindump_connection*);
+    struct spindump_connection** newCandidates = (struct spindump_connection**)spindump_malloc(size);
+    if (newCandidates == 0) {
+      spindump_errorf("cannot allocate the aggregate candidates array for %u bytes", size);
+      return(0);
+    }
+    if (table->aggregateCandidates != 0) {
+      memcpy(newCandidates,
+             table->aggregateCandidates,
+             table->nAggregateCandidates * sizeof(struct spindump_connection*));
+      spindump_deepdebugf("free table->aggregateCandidates after a growth");
+      spindump_free(table->aggregateCandidates);
+    }
+    table->aggregateCandidates = newCandidates;
+    table->maxNAggregateCandidates = newMax;
+  }
+  table->aggregateCandidates[table->nAggregateCandidates++] = aggregate;
+  return(1);
+}
+
+//
+// Collect the aggregates stored on the path from the root to a given
+// address, i.e., at all prefixes that contain the address
+//
+
+static void
+spindump_connectionstable_aggregates_collect(struct spindump_connectionstable* table,
+                                             const spindump_address* address) {
+  const uint8_t* bits;
+  unsigned int nbits;
+  struct spindump_connectionstable_aggregatenode** p_root =
+    spindump_connectionstable_aggregates_trie(table,address,&bits,&nbits);
+  if (p_root == 0) return;
+  struct spindump_connectionstable_aggregatenode* node = *p_root;
+  for (unsigned int depth = 0; node != 0; depth++) {
+    for (struct spindump_connection* aggregate = node->aggregates;
+         aggregate != 0;
+         aggregate = *spindump_connectionstable_aggregates_next(node,aggregate)) {
+      if (!spindump_connectionstable_aggregates_addcandidate(table,aggregate)) return;
+    }
+    if (depth == nbits) break;
+    node = node->children[spindump_connectionstable_aggregates_bit(bits,depth)];
+  }
+}
+
+//
+// Order connections by their position in the connections table
+//
+
+static int
+spindump_connectionstable_aggregates_compare(const void* a,
+                                             const void* b) {
+  const struct spindump_connection* connectionA = *(const struct spindump_connection* const*)a;
+  const struct spindump_connection* connectionB = *(const struct spindump_connection* const*)b;
+  if (connectionA->tableIndex < connectionB->tableIndex) return(-1);
+  if (connectionA->tableIndex > connectionB->tableIndex) return(1);
+  return(0);
+}
+
+//
+// Find the simple aggregates that traffic between two addresses may
+// belong to. Every aggregate that matches the addresses is included,
+// but the caller needs to check the candidates against the actual
+// matching rules, as e.g. a host-network aggregate is a candidate for
+// all traffic to and from the host.
+//
+// The candidates are returned via the output parameter p_candidates
+// in the order of their position in the connections table, the same
+// order in which a full sweep of the table would have visited them,
+// and without duplicates. The array is owned by the table, and is
+// valid until the next call. Return the number of candidates.
+//
+
+unsigned int
+spindump_connectionstable_aggregates_find(struct spindump_connectionstable* table,
+                                          const spindump_address* side1address,
+                                          const spindump_address* side2address,
+                                          struct spindump_connection*** p_candidates) {
+  
+  spindump_assert(table != 0);
+  spindump_assert(side1address != 0);
+  spindump_assert(side2address != 0);
+  spindump_assert(p_candidates != 0);
+
+  table->nAggregateCandidates = 0;
+  spindump_connectionstable_aggregates_collect(table,side1address);
+  spindump_connectionstable_aggregates_collect(table,side2address);
+
+  if (table->nAggregateCandidates > 1) {
+    qsort(table->aggregateCandidates,
+          table->nAggregateCandidates,
+          sizeof(struct spindump_connection*),
+          spindump_connectionstable_aggregates_compare);
+    unsigned int n = 1;
+    for (unsigned int i = 1; i < table->nAggregateCandidates; i++) {
+      if (table->aggregateCandidates[i] != table->aggregateCandidates[n-1]) {
+        table->aggregateCandidates[n++] = table->aggregateCandidates[i];
+      }
+    }
+    table->nAggregateCandidates = n;
+  }
+  
+  *p_candidates = table->aggregateCandidates;
+  return(table->nAggregateCandidates);
+}
@@ -0,0 +1,49 @@
+
+//
+//
+//  ////////////////////////////////////////////////////////////////////////////////////
+//  /////////                                                                ///////////
+//  //////       SSS    PPPP    I   N    N   DDDD    U   U   M   M   PPPP         //////
+//  //          S       P   P   I   NN   N   D   D   U   U   MM MM   P   P            //
+//  /            SSS    PPPP    I   N NN N   D   D   U   U   M M M   PPPP              /
+//  //              S   P       I   N   NN   D   D   U   U   M   M   P                //
+//  ////         SSS    P       I   N    N   DDDD     UUU    M   M   P            //////
+//  /////////                                                                ///////////
+//  ////////////////////////////////////////////////////////////////////////////////////
+//
+//  SPINDUMP (C) 2018-2020 BY ERICSSON RESEARCH
+//  AUTHOR: JARI ARKKO
+//
+
+#ifndef SPINDUMP_TABLE_AGGREGATES_H
+#define SPINDUMP_TABLE_AGGREGATES_H
+
+//
+// Includes -----------------------------------------------------------------------------------
+//
+
+#include "spindump_util.h"
+#include "spindump_connections_structs.h"
+#include "spindump_table_structs.h"
+
+//
+// External API interface to this module ------------------------------------------------------
+//
+
+void
+spindump_connectionstable_aggregates_initialize(struct spindump_connectionstable* table);
+void
+spindump_connectionstable_aggregates_uninitialize(struct spindump_connectionstable* table);
+int
+spindump_connectionstable_aggregates_add(struct spindump_connectionstable* table,
+                                         struct spindump_connection* aggregate);
+void
+spindump_connectionstable_aggregates_remove(struct spindump_connectionstable* table,
+                                            struct spindump_connection* aggregate);
+unsigned int
+spindump_connectionstable_aggregates_find(struct spindump_connectionstable* table,
+                                          const spindump_address* side1address,
+                                          const spindump_address* side2address,
+                                          struct spindump_connection*** p_candidates);
+
+#endif // SPINDUMP_TABLE_AGGREGATES_H
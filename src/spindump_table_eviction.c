@@ -0,0 +1,231 @@
+
+//
+//
+//  ////////////////////////////////////////////////////////////////////////////////////
+//  /////////                                                                ///////////
+//  //////       SSS    PPPP    I   N    N   DDDD    U   U   M   M   PPPP         //////
+//  //          S       P   P   I   NN   N   D   D   U   U   MM MM   P   P            //
+//  /            SSS    PPPP    I   N NN N   D   D   U   U   M M M   PPPP              /
+//  //              S   P       I   N   NN   D   D   U   U   M   M   P                //
+//  ////         SSS    P       I   N    N   DDDD     UUU    M   M   P            //////
+//  /////////                                                                ///////////
+//  ////////////////////////////////////////////////////////////////////////////////////
+//
+//  SPINDUMP (C) 2018-2020 BY ERICSSON RESEARCH
+//  AUTHOR: JARI ARKKO
+//
+
+//
+// Includes -----------------------------------------------------------------------------------
+//
+
+#include <stdlib.h>
+#include <string.h>
+#include "spindump_util.h"
+#include "spindump_table_eviction.h"
+#include "spindump_table.h"
+#include "spindump_connections.h"
+#include "spindump_analyze.h"
+#include "spindump_pool.h"
+
+//
+// Function prototypes ------------------------------------------------------------------------
+//
+
+static unsigned int
+spindump_connectionstable_eviction_list(const struct spindump_connection* connection);
+static int
+spindump_connectionstable_eviction_overlimit(const struct spindump_connectionstable* table);
+
+//
+// Actual code --------------------------------------------------------------------------------
+//
+
+//
+// Initialize the eviction lists of a table. The dynamically created
+// connections are kept in lists ordered by their latest activity,
+// one list for each eviction preference (establishing connections,
+// closed connections, and the rest). When the table is over its
+// limits, the least recently active connection from the most
+// preferred non-empty list is evicted. Manually created connections
+// are not in any list and are never evicted.
+//
+
+void
+spindump_connectionstable_eviction_initialize(struct spindump_connectionstable* table) {
+  spindump_assert(table != 0);
+  table->maxConnections = 0;
+  table->memoryLimit = 0;
+  memset(table->evictionOldest,0,sizeof(table->evictionOldest));
+  memset(table->evictionNewest,0,sizeof(table->evictionNewest));
+}
+
+//
+// Uninitialize the eviction lists of a table. The lists own no
+// memory, so there is nothing to free.
+//
+
+void
+spindump_connectionstable_eviction_uninitialize(struct spindump_connectionstable* table) {
+  spindump_assert(table != 0);
+  memset(table->evictionOldest,0,sizeof(table->evictionOldest));
+  memset(table->evictionNewest,0,sizeof(table->evictionNewest));
+}
+
+//
+// Set the limits of the table: the largest number of connections,
+// and the largest amount of memory (in bytes) allocated for them. A
+// limit of 0 means no limit.
+//
+
+void
+spindump_connectionstable_eviction_setlimits(struct spindump_connectionstable* table,
+                                             unsigned int maxConnections,
+                                             unsigned long long memoryLimit) {
+  spindump_assert(table != 0);
+  table->maxConnections = maxConnections;
+  table->memoryLimit = memoryLimit;
+}
+
+//
+// Determine which eviction list a connection belongs to, based on its
+// current state
+//
+
+static unsigned int
+spindump_connectionstable_eviction_list(const struct spindump_connection* connection) {
+  if (connection->manuallyCreated) return(spindump_connectionstable_eviction_none);
+  if (connection->deleted) return(spindump_connectionstable_eviction_closed);
+  if (spindump_connections_isestablishing(connection)) return(spindump_connectionstable_eviction_establishing);
+  return(spindump_connectionstable_eviction_active);
+}
+
+//
+// Mark a connection as the most recently active one, and move it to
+// the eviction list matching its current state. This function needs
+// to be called when a connection has been created, or it has seen
+// activity.
+//
+
+void
+spindump_connectionstable_eviction_touch(struct spindump_connectionstable* table,
+                                         struct spindump_connection* connection) {
+  spindump_assert(table != 0);
+  spindump_assert(connection != 0);
+  unsigned int list = spindump_connectionstable_eviction_list(connection);
+  if (list == connection->evictionList &&
+      (list == spindump_connectionstable_eviction_none || table->evictionNewest[list] == connection)) {
+    return;
+  }
+  spindump_connectionstable_eviction_remove(table,connection);
+  if (list == spindump_connectionstable_eviction_none) return;
+  connection->evictionList = list;
+  connection->evictionPrev = table->evictionNewest[list];
+  connection->evictionNext = 0;
+  if (connection->evictionPrev != 0) {
+    connection->evictionPrev->evictionNext = connection;
+  } else {
+    table->evictionOldest[list] = connection;
+  }
+  table->evictionNewest[list] = connection;
+}
+
+//
+// Remove a connection from the eviction lists, if it is in one
+//
+
+void
+spindump_connectionstable_eviction_remove(struct spindump_connectionstable* table,
+                                          struct spindump_connection* connection) {
+  spindump_assert(table != 0);
+  spindump_assert(connection != 0);
+  unsigned int list = connection->evictionList;
+  if (list == spindump_connectionstable_eviction_none) return;
+  spindump_assert(list < spindump_connectionstable_eviction_nlists);
+  if (connection->evictionPrev != 0) {
+    connection->evictionPrev->evictionNext = connection->evictionNext;
+  } else {
+    table->evictionOldest[list] = connection->evictionNext;
+  }
+  if (connection->evictionNext != 0) {
+    connection->evictionNext->evictionPrev = connection->evictionPrev;
+  } else {
+    table->evictionNewest[list] = connection->evictionPrev;
+  }
+  connection->evictionPrev = 0;
+  connection->evictionNext = 0;
+  connection->evictionList = spindump_connectionstable_eviction_none;
+}
+
+//
+// Is the table over its limits?
+//
+
+static int
+spindump_connectionstable_eviction_overlimit(const struct spindump_connectionstable* table) {
+  if (table->maxConnections > 0 &&
+      table->nConnections - table->nHoles > table->maxConnections) {
+    return(1);
+  }
+  if (table->memoryLimit > 0 &&
+      (unsigned long long)spindump_pool_bytesinuse() > table->memoryLimit) {
+    return(1);
+  }
+  return(0);
+}
+
+//
+// Evict connections until the table is within its limits, or there
+// are no more connections that can be evicted. Return the number of
+// connections evicted.
+//
+
+unsigned int
+spindump_connectionstable_eviction_enforce(struct spindump_connectionstable* table,
+                                           struct spindump_analyze* analyzer,
+                                           int print_info) {
+  spindump_assert(table != 0);
+  spindump_assert(analyzer != 0);
+  
+  unsigned int nEvicted = 0;
+  struct spindump_stats* stats = spindump_analyze_getstats(analyzer);
+  while (spindump_connectionstable_eviction_overlimit(table)) {
+    
+    //
+    // Find the least recently active connection in the most
+    // preferred list
+    //
+    
+    struct spindump_connection* connection = 0;
+    unsigned int list;
+    for (list = spindump_connectionstable_eviction_establishing;
+         list < spindump_connectionstable_eviction_nlists;
+         list++) {
+      connection = table->evictionOldest[list];
+      if (connection != 0) break;
+    }
+    if (connection == 0) break;
+    
+    //
+    // Evict it
+    //
+    
+    switch (list) {
+    case spindump_connectionstable_eviction_establishing:
+      stats->connectionsEvictedEstablishing++;
+      break;
+    case spindump_connectionstable_eviction_closed:
+      stats->connectionsEvictedClosed++;
+      break;
+    default:
+      stats->connectionsEvictedActive++;
+      break;
+    }
+    connection->deleteReason = "evicted";
+    spindump_connectionstable_deleteconnection(connection,table,analyzer,connection->deleteReason,print_info);
+    nEvicted++;
+  }
+  
+  if (nEvicted > 0) spindump_debugf("evicted %u connections to stay within table limits", nEvicted);
+  return(nEvicted);
+}
@@ -0,0 +1,58 @@
+
+//
+//
+//  ////////////////////////////////////////////////////////////////////////////////////
+//  /////////                                                                ///////////
+//  //////       SSS    PPPP    I   N    N   DDDD    U   U   M   M   PPPP         //////
+//  //          S       P   P   I   NN   N   D   D   U   U   MM MM   P   P            //
+//  /            SSS    PPPP    I   N NN N   D   D   U   U   M M M   PPPP              /
+//  //              S   P       I   N   NN   D   D   U   U   M   M   P                //
+//  ////         SSS    P       I   N    N   DDDD     UUU    M   M   P            //////
+//  /////////                                                                ///////////
+//  ////////////////////////////////////////////////////////////////////////////////////
+//
+//  SPINDUMP (C) 2018-2020 BY ERICSSON RESEARCH
+//  AUTHOR: JARI ARKKO
+//
+
+#ifndef SPINDUMP_TABLE_EVICTION_H
+#define SPINDUMP_TABLE_EVICTION_H
+
+//
+// Includes -----------------------------------------------------------------------------------
+//
+
+#include "spindump_util.h"
+#include "spindump_connections_structs.h"
+#include "spindump_table_structs.h"
+
+//
+// Forward declaration of structures ----------------------------------------------------------
+//
+
+struct spindump_analyze;
+
+//
+// External API interface to this module ------------------------------------------------------
+//
+
+void
+spindump_connectionstable_eviction_initialize(struct spindump_connectionstable* table);
+void
+spindump_connectionstable_eviction_uninitialize(struct spindump_connectionstable* table);
+void
+spindump_connectionstable_eviction_setlimits(struct spindump_connectionstable* table,
+                                             unsigned int maxConnections,
+                                             unsigned long long memoryLimit);
+void
+spindump_connectionstable_eviction_touch(struct spindump_connectionstable* table,
+                                         struct spindump_connection* connection);
+void
+spindump_connectionstable_eviction_remove(struct spindump_connectionstable* table,
+                                          struct spindump_connection* connection);
+unsigned int
+spindump_connectionstable_eviction_enforce(struct spindump_connectionstable* table,
+                                           struct spindump_analyze* analyzer,
+                                           int print_info);
+
+#endif // SPINDUMP_TABLE_EVICTION_H
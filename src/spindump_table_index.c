@@ -0,0 +1,527 @@
+
+//
+//
+//  ////////////////////////////////////////////////////////////////////////////////////
+//  /////////                                                                ///////////
+//  //////       SSS    PPPP    I   N    N   DDDD    U   U   M   M   PPPP         //////
+//  //          S       P   P   I   NN   N   D   D   U   U   MM MM   P   P            //
+//  /            SSS    PPPP    I   N NN N   D   D   U   U   M M M   PPPP              /
+//  //              S   P       I   N   NN   D   D   U   U   M   M   P                //
+//  ////         SSS    P       I   N    N   DDDD     UUU    M   M   P            //////
+//  /////////                                                                ///////////
+//  ////////////////////////////////////////////////////////////////////////////////////
+//
+//  SPINDUMP (C) 2018-2020 BY ERICSSON RESEARCH
+//  AUTHOR: JARI ARKKO
+//
+// 
+
+//
+// Includes -----------------------------------------------------------------------------------
+//
+
+#include <stdlib.h>
+#include <string.h>
+#include "spindump_util.h"
+#include "spindump_connections.h"
+#include "spindump_table_index.h"
+
+//
+// Function prototypes ------------------------------------------------------------------------
+//
+
+static uint32_t
+spindump_connectionstable_index_hashendpoint(uint32_t hash,
+                                             const spindump_address* address,
+                                             spindump_port port);
+static void
+spindump_connectionstable_index_grow(struct spindump_connectionstable* table);
+static int
+spindump_connectionstable_cidindex_initialize(struct spindump_connectionstable_cidindex* cidIndex);
+static void
+spindump_connectionstable_cidindex_uninitialize(struct spindump_connectionstable_cidindex* cidIndex);
+static struct spindump_quic_connectionid*
+spindump_connectionstable_cidindex_getcid(struct spindump_connection* connection,
+                                          unsigned int side);
+static void
+spindump_connectionstable_cidindex_grow(struct spindump_connectionstable_cidindex* cidIndex,
+                                        unsigned int side);
+static void
+spindump_connectionstable_cidindex_add(struct spindump_connectionstable* table,
+                                       struct spindump_connection* connection);
+static void
+spindump_connectionstable_cidindex_remove(struct spindump_connectionstable* table,
+                                          struct spindump_connection* connection);
+
+//
+// Actual code --------------------------------------------------------------------------------
+//
+
+//
+// Initialize the indexes of a connections table. The 5-tuple index is
+// a chained hash table, where each bucket holds a list of connections
+// linked through their indexNext fields. QUIC connections are in
+// addition kept in two connection ID indexes, one for the peer1 and
+// one for the peer2 connection IDs. Return 1 upon success, 0 if
+// memory could not be allocated.
+//
+
+int
+spindump_connectionstable_index_initialize(struct spindump_connectionstable* table) {
+  spindump_assert(table != 0);
+  unsigned int size = spindump_connectionstable_index_defaultsize * sizeof(struct spindump_connection*);
+  table->index = (struct spindump_connection**)spindump_malloc(size);
+  if (table->index == 0) {
+    spindump_errorf("cannot allocate the connection index for %u bytes", size);
+    return(0);
+  }
+  memset(table->index,0,size);
+  table->nIndexBuckets = spindump_connectionstable_index_defaultsize;
+  table->nIndexedConnections = 0;
+  memset(table->cidIndex,0,sizeof(table->cidIndex));
+  
+  for (unsigned int side = 0; side < spindump_connectionstable_cidindex_nsides; side++) {
+    if (!spindump_connectionstable_cidindex_initialize(&table->cidIndex[side])) {
+      spindump_connectionstable_index_uninitialize(table);
+      return(0);
+    }
+  }
+  
+  return(1);
+}
+
+//
+// Initialize one connection ID index. Return 1 upon success, 0 if
+// memory could not be allocated.
+//
+
+static int
+spindump_connectionstable_cidindex_initialize(struct spindump_connectionstable_cidindex* cidIndex) {
+  unsigned int size = spindump_connectionstable_cidindex_defaultsize * sizeof(struct spindump_connection*);
+  memset(cidIndex,0,sizeof(*cidIndex));
+  cidIndex->buckets = (struct spindump_connection**)spindump_malloc(size);
+  if (cidIndex->buckets == 0) {
+    spindump_errorf("cannot allocate the connection id index for %u bytes", size);
+    return(0);
+  }
+  memset(cidIndex->buckets,0,size);
+  cidIndex->nBuckets = spindump_connectionstable_cidindex_defaultsize;
+  return(1);
+}
+
+//
+// Free up the resources associated with one connection ID index
+//
+
+static void
+spindump_connectionstable_cidindex_uninitialize(struct spindump_connectionstable_cidindex* cidIndex) {
+  if (cidIndex->buckets != 0) {
+    spindump_deepdebugf("free cidIndex->buckets in spindump_connectionstable_cidindex_uninitialize");
+    spindump_free(cidIndex->buckets);
+  }
+  memset(cidIndex,0,sizeof(*cidIndex));
+}
+
+//
+// Free up the resources associated with the indexes. The connections
+// themselves are not affected.
+//
+
+void
+spindump_connectionstable_index_uninitialize(struct spindump_connectionstable* table) {
+  spindump_assert(table != 0);
+  if (table->index != 0) {
+    spindump_deepdebugf("free table->index in spindump_connectionstable_index_uninitialize");
+    spindump_free(table->index);
+    table->index = 0;
+  }
+  table->nIndexBuckets = 0;
+  table->nIndexedConnections = 0;
+  for (unsigned int side = 0; side < spindump_connectionstable_cidindex_nsides; side++) {
+    spindump_connectionstable_cidindex_uninitialize(&table->cidIndex[side]);
+  }
+}
+
+//
+// Is a given connection type kept in the 5-tuple index? These are the
+// connection types that are identified by a pair of addresses and a
+// pair of ports.
+//
+
+int
+spindump_connectionstable_index_isindexed(enum spindump_connection_type type) {
+  return(spindump_connection_typehasports(type));
+}
+
+//
+// Mix one endpoint (address and port) into a running FNV-1a hash
+//
+
+static uint32_t
+spindump_connectionstable_index_hashendpoint(uint32_t hash,
+                                             const spindump_address* address,
+                                             spindump_port port) {
+  unsigned int length;
+  const uint8_t* bytes = spindump_address_getrawbytes(address,&length);
+  for (unsigned int i = 0; i < length; i++) {
+    hash = (hash ^ bytes[i]) * 16777619U;
+  }
+  hash = (hash ^ (port & 0xff)) * 16777619U;
+  hash = (hash ^ (port >> 8)) * 16777619U;
+  return(hash);
+}
+
+//
+// Calculate the index hash for a connection of a given type between
+// two endpoints. The hash is direction-agnostic: the endpoints are
+// ordered before hashing, so that a packet from either side of the
+// connection maps to the same bucket.
+//
+
+uint32_t
+spindump_connectionstable_index_hash(enum spindump_connection_type type,
+                                     const spindump_address* side1address,
+                                     const spindump_address* side2address,
+                                     spindump_port side1port,
+                                     spindump_port side2port) {
+  spindump_assert(side1address != 0);
+  spindump_assert(side2address != 0);
+  
+  int order = spindump_address_compare(side1address,side2address);
+  if (order > 0 || (order == 0 && side1port > side2port)) {
+    const spindump_address* tmpaddress = side1address;
+    spindump_port tmpport = side1port;
+    side1address = side2address;
+    side1port = side2port;
+    side2address = tmpaddress;
+    side2port = tmpport;
+  }
+  
+  uint32_t hash = 2166136261U;
+  hash = (hash ^ (uint32_t)type) * 16777619U;
+  hash = spindump_connectionstable_index_hashendpoint(hash,side1address,side1port);
+  hash = spindump_connectionstable_index_hashendpoint(hash,side2address,side2port);
+  hash ^= hash >> 16;
+  return(hash);
+}
+
+//
+// Double the number of buckets in the index, and move the indexed
+// connections over to the new buckets. If memory cannot be allocated,
+// the index continues to work with the old, more crowded buckets.
+//
+
+static void
+spindump_connectionstable_index_grow(struct spindump_connectionstable* table) {
+  unsigned int newNBuckets = table->nIndexBuckets * 2;
+  unsigned int size = newNBuckets * sizeof(struct spindump_connection*);
+  struct spindump_connection** newIndex = (struct spindump_connection**)spindump_malloc(size);
+  if (newIndex == 0) {
+    spindump_errorf("cannot grow the connection index to %u bytes", size);
+    return;
+  }
+  memset(newIndex,0,size);
+  
+  //
+  // Move the chains over. Chains are kept in the order connections
+  // were added, so append to the tail of each new chain.
+  //
+  
+  for (unsigned int i = 0; i < table->nIndexBuckets; i++) {
+    struct spindump_connection* connection = table->index[i];
+    while (connection != 0) {
+      struct spindump_connection* next = connection->indexNext;
+      struct spindump_connection** place = &newIndex[connection->indexHash & (newNBuckets - 1)];
+      while (*place != 0) place = &(*place)->indexNext;
+      connection->indexNext = 0;
+      *place = connection;
+      connection = next;
+    }
+  }
+  
+  spindump_deepdebugf("free old index after a growth");
+  spindump_free(table->index);
+  table->index = newIndex;
+  table->nIndexBuckets = newNBuckets;
+  spindump_debugf("grew the connection index to %u buckets", newNBuckets);
+}
+
+//
+// Add a connection to the index. The connection's addresses and ports
+// (and for QUIC, connection IDs) need to have been set before calling
+// this function.
+//
+
+void
+spindump_connectionstable_index_add(struct spindump_connectionstable* table,
+                                    struct spindump_connection* connection) {
+  
+  spindump_assert(table != 0);
+  spindump_assert(table->index != 0);
+  spindump_assert(connection != 0);
+  spindump_assert(spindump_connectionstable_index_isindexed(connection->type));
+  
+  //
+  // Calculate the hash
+  //
+  
+  spindump_address* side1address = 0;
+  spindump_address* side2address = 0;
+  spindump_port side1port = 0;
+  spindump_port side2port = 0;
+  spindump_connections_getaddresses(connection,&side1address,&side2address);
+  spindump_connections_getports(connection,&side1port,&side2port);
+  spindump_assert(side1address != 0 && side2address != 0);
+  connection->indexHash = spindump_connectionstable_index_hash(connection->type,
+                                                               side1address,
+                                                               side2address,
+                                                               side1port,
+                                                               side2port);
+  
+  //
+  // Make room, if the buckets are getting too crowded
+  //
+  
+  if (table->nIndexedConnections >= table->nIndexBuckets * spindump_connectionstable_index_maxload) {
+    spindump_connectionstable_index_grow(table);
+  }
+  
+  //
+  // Link the connection at the end of its bucket
+  //
+  
+  struct spindump_connection** place = &table->index[connection->indexHash & (table->nIndexBuckets - 1)];
+  while (*place != 0) place = &(*place)->indexNext;
+  connection->indexNext = 0;
+  *place = connection;
+  table->nIndexedConnections++;
+  
+  //
+  // QUIC connections are also looked up by their connection IDs
+  //
+  
+  if (connection->type == spindump_connection_transport_quic) {
+    spindump_connectionstable_cidindex_add(table,connection);
+  }
+}
+
+//
+// Remove a connection from the index. It is not an error to call this
+// for a connection that is not in the index; nothing happens in that
+// case.
+//
+
+void
+spindump_connectionstable_index_remove(struct spindump_connectionstable* table,
+                                       struct spindump_connection* connection) {
+  spindump_assert(table != 0);
+  spindump_assert(connection != 0);
+  if (table->index == 0 || !spindump_connectionstable_index_isindexed(connection->type)) return;
+  if (connection->type == spindump_connection_transport_quic) {
+    spindump_connectionstable_cidindex_remove(table,connection);
+  }
+  struct spindump_connection** place = &table->index[connection->indexHash & (table->nIndexBuckets - 1)];
+  while (*place != 0) {
+    if (*place == connection) {
+      *place = connection->indexNext;
+      connection->indexNext = 0;
+      spindump_assert(table->nIndexedConnections > 0);
+      table->nIndexedConnections--;
+      return;
+    }
+    place = &(*place)->indexNext;
+  }
+}
+
+//
+// Return the first connection in the bucket for a given hash. The
+// rest of the bucket can be walked through the indexNext fields. Note
+// that the bucket may contain connections with other hashes, so the
+// caller needs to check them.
+//
+
+struct spindump_connection*
+spindump_connectionstable_index_bucket(struct spindump_connectionstable* table,
+                                       uint32_t hash) {
+  spindump_assert(table != 0);
+  spindump_assert(table->index != 0);
+  return(table->index[hash & (table->nIndexBuckets - 1)]);
+}
+
+//
+// Calculate the connection ID index hash for a connection ID of a
+// given length. Connection IDs of different lengths hash differently,
+// even if one is a prefix of the other. Overly long connection IDs
+// are hashed based on their first bytes only; the caller will compare
+// the full connection IDs anyway.
+//
+
+uint32_t
+spindump_connectionstable_cidindex_hash(const unsigned char* id,
+                                        unsigned int length) {
+  spindump_assert(id != 0 || length == 0);
+  if (length > spindump_connectionstable_cidindex_maxlen) length = spindump_connectionstable_cidindex_maxlen;
+  uint32_t hash = 2166136261U;
+  hash = (hash ^ length) * 16777619U;
+  for (unsigned int i = 0; i < length; i++) {
+    hash = (hash ^ id[i]) * 16777619U;
+  }
+  hash ^= hash >> 16;
+  return(hash);
+}
+
+//
+// Return the connection ID that a given connection ID index is for
+//
+
+static struct spindump_quic_connectionid*
+spindump_connectionstable_cidindex_getcid(struct spindump_connection* connection,
+                                          unsigned int side) {
+  spindump_assert(connection->type == spindump_connection_transport_quic);
+  spindump_assert(side < spindump_connectionstable_cidindex_nsides);
+  if (side == spindump_connectionstable_cidindex_peer1) {
+    return(&connection->u.quic.peer1ConnectionID);
+  } else {
+    return(&connection->u.quic.peer2ConnectionID);
+  }
+}
+
+//
+// Double the number of buckets in a connection ID index. As with the
+// 5-tuple index, failure to allocate memory leaves the old buckets in
+// use.
+//
+
+static void
+spindump_connectionstable_cidindex_grow(struct spindump_connectionstable_cidindex* cidIndex,
+                                        unsigned int side) {
+  unsigned int newNBuckets = cidIndex->nBuckets * 2;
+  unsigned int size = newNBuckets * sizeof(struct spindump_connection*);
+  struct spindump_connection** newBuckets = (struct spindump_connection**)spindump_malloc(size);
+  if (newBuckets == 0) {
+    spindump_errorf("cannot grow the connection id index to %u bytes", size);
+    return;
+  }
+  memset(newBuckets,0,size);
+  
+  for (unsigned int i = 0; i < cidIndex->nBuckets; i++) {
+    struct spindump_connection* connection = cidIndex->buckets[i];
+    while (connection != 0) {
+      struct spindump_connection* next = connection->cidIndexNext[side];
+      struct spindump_connection** place = &newBuckets[connection->cidIndexHash[side] & (newNBuckets - 1)];
+      while (*place != 0) place = &(*place)->cidIndexNext[side];
+      connection->cidIndexNext[side] = 0;
+      *place = connection;
+      connection = next;
+    }
+  }
+  
+  spindump_deepdebugf("free old connection id index after a growth");
+  spindump_free(cidIndex->buckets);
+  cidIndex->buckets = newBuckets;
+  cidIndex->nBuckets = newNBuckets;
+  spindump_debugf("grew the connection id index to %u buckets", newNBuckets);
+}
+
+//
+// Add a QUIC connection to both connection ID indexes, based on its
+// current connection IDs
+//
+
+static void
+spindump_connectionstable_cidindex_add(struct spindump_connectionstable* table,
+                                       struct spindump_connection* connection) {
+  for (unsigned int side = 0; side < spindump_connectionstable_cidindex_nsides; side++) {
+    struct spindump_connectionstable_cidindex* cidIndex = &table->cidIndex[side];
+    struct spindump_quic_connectionid* cid = spindump_connectionstable_cidindex_getcid(connection,side);
+    spindump_assert(cidIndex->buckets != 0);
+    connection->cidIndexHash[side] = spindump_connectionstable_cidindex_hash(cid->id,cid->len);
+    connection->cidIndexLength[side] = spindump_min(cid->len,spindump_connectionstable_cidindex_maxlen);
+    if (cidIndex->nIndexed >= cidIndex->nBuckets * spindump_connectionstable_index_maxload) {
+      spindump_connectionstable_cidindex_grow(cidIndex,side);
+    }
+    struct spindump_connection** place = &cidIndex->buckets[connection->cidIndexHash[side] & (cidIndex->nBuckets - 1)];
+    while (*place != 0) place = &(*place)->cidIndexNext[side];
+    connection->cidIndexNext[side] = 0;
+    *place = connection;
+    cidIndex->nIndexed++;
+    cidIndex->nOfLength[connection->cidIndexLength[side]]++;
+  }
+}
+
+//
+// Remove a QUIC connection from both connection ID indexes. The
+// connection is found based on the hashes stored when it was added,
+// so this works even if the connection IDs have changed since.
+//
+
+static void
+spindump_connectionstable_cidindex_remove(struct spindump_connectionstable* table,
+                                          struct spindump_connection* connection) {
+  for (unsigned int side = 0; side < spindump_connectionstable_cidindex_nsides; side++) {
+    struct spindump_connectionstable_cidindex* cidIndex = &table->cidIndex[side];
+    if (cidIndex->buckets == 0) continue;
+    struct spindump_connection** place = &cidIndex->buckets[connection->cidIndexHash[side] & (cidIndex->nBuckets - 1)];
+    while (*place != 0) {
+      if (*place == connection) {
+        *place = connection->cidIndexNext[side];
+        connection->cidIndexNext[side] = 0;
+        spindump_assert(cidIndex->nIndexed > 0);
+        spindump_assert(cidIndex->nOfLength[connection->cidIndexLength[side]] > 0);
+        cidIndex->nIndexed--;
+        cidIndex->nOfLength[connection->cidIndexLength[side]]--;
+        break;
+      }
+      place = &(*place)->cidIndexNext[side];
+    }
+  }
+}
+
+//
+// Update the connection ID indexes after the connection IDs of a QUIC
+// connection have changed. This needs to be called whenever
+// peer1ConnectionID or peer2ConnectionID is modified.
+//
+
+void
+spindump_connectionstable_cidindex_update(struct spindump_connectionstable* table,
+                                          struct spindump_connection* connection) {
+  spindump_assert(table != 0);
+  spindump_assert(connection != 0);
+  spindump_assert(connection->type == spindump_connection_transport_quic);
+  spindump_connectionstable_cidindex_remove(table,connection);
+  spindump_connectionstable_cidindex_add(table,connection);
+}
+
+//
+// Are there any connection IDs of a given length in a connection ID
+// index? This is used to skip lengths for which no partial connection
+// ID match is possible.
+//
+
+int
+spindump_connectionstable_cidindex_haslength(struct spindump_connectionstable* table,
+                                             unsigned int side,
+                                             unsigned int length) {
+  spindump_assert(table != 0);
+  spindump_assert(side < spindump_connectionstable_cidindex_nsides);
+  spindump_assert(length <= spindump_connectionstable_cidindex_maxlen);
+  return(table->cidIndex[side].nOfLength[length] > 0);
+}
+
+//
+// Return the first connection in the bucket for a given connection ID
+// hash. The rest of the bucket can be walked through the
+// cidIndexNext[side] fields. Again, the caller needs to check the
+// connections, as the bucket may contain other connection IDs.
+//
+
+struct spindump_connection*
+spindump_connectionstable_cidindex_bucket(struct spindump_connectionstable* table,
+                                          unsigned int side,
+                                          uint32_t hash) {
+  spindump_assert(table != 0);
+  spindump_assert(side < spindump_connectionstable_cidindex_nsides);
+  spindump_assert(table->cidIndex[side].buckets != 0);
+  return(table->cidIndex[side].buckets[hash & (table->cidIndex[side].nBuckets - 1)]);
+}
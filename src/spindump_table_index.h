@@ -0,0 +1,72 @@
+
+//
+//
+//  ////////////////////////////////////////////////////////////////////////////////////
+//  /////////                                                                ///////////
+//  //////       SSS    PPPP    I   N    N   DDDD    U   U   M   M   PPPP         //////
+//  //          S       P   P   I   NN   N   D   D   U   U   MM MM   P   P            //
+//  /            SSS    PPPP    I   N NN N   D   D   U   U   M M M   PPPP              /
+//  //              S   P       I   N   NN   D   D   U   U   M   M   P                //
+//  ////         SSS    P       I   N    N   DDDD     UUU    M   M   P            //////
+//  /////////                                                                ///////////
+//  ////////////////////////////////////////////////////////////////////////////////////
+//
+//  SPINDUMP (C) 2018-2020 BY ERICSSON RESEARCH
+//  AUTHOR: JARI ARKKO
+//
+// 
+
+#ifndef SPINDUMP_TABLE_INDEX_H
+#define SPINDUMP_TABLE_INDEX_H
+
+//
+// Includes -----------------------------------------------------------------------------------
+//
+
+#include <stdint.h>
+#include "spindump_util.h"
+#include "spindump_protocols.h"
+#include "spindump_connections_structs.h"
+#include "spindump_table_structs.h"
+
+//
+// External API interface to this module ------------------------------------------------------
+//
+
+int
+spindump_connectionstable_index_initialize(struct spindump_connectionstable* table);
+void
+spindump_connectionstable_index_uninitialize(struct spindump_connectionstable* table);
+int
+spindump_connectionstable_index_isindexed(enum spindump_connection_type type);
+uint32_t
+spindump_connectionstable_index_hash(enum spindump_connection_type type,
+                                     const spindump_address* side1address,
+                                     const spindump_address* side2address,
+                                     spindump_port side1port,
+                                     spindump_port side2port);
+void
+spindump_connectionstable_index_add(struct spindump_connectionstable* table,
+                                    struct spindump_connection* connection);
+void
+spindump_connectionstable_index_remove(struct spindump_connectionstable* table,
+                                       struct spindump_connection* connection);
+struct spindump_connection*
+spindump_connectionstable_index_bucket(struct spindump_connectionstable* table,
+                                       uint32_t hash);
+uint32_t
+spindump_connectionstable_cidindex_hash(const unsigned char* id,
+                                        unsigned int length);
+void
+spindump_connectionstable_cidindex_update(struct spindump_connectionstable* table,
+                                          struct spindump_connection* connection);
+int
+spindump_connectionstable_cidindex_haslength(struct spindump_connectionstable* table,
+                                             unsigned int side,
+                                             unsigned int length);
+struct spindump_connection*
+spindump_connectionstable_cidindex_bucket(struct spindump_connectionstable* table,
+                                          unsigned int side,
+                                          uint32_t hash);
+
+#endif // SPINDUMP_TABLE_INDEX_H
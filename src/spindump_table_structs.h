@@ -34,21 +34,115 @@
 //
 
 #define spindump_connectionstable_defaultsize 1024
+#define spindump_connectionstable_index_defaultsize 4096 // buckets, must be a power of two
+#define spindump_connectionstable_index_maxload 2        // connections per bucket before growing
+#define spindump_connectionstable_cidindex_defaultsize 1024 // buckets, must be a power of two
+#define spindump_connectionstable_cidindex_maxlen 20     // longest indexed CID; the parser may use the padding after id[]
+#define spindump_connectionstable_timers_nslots 256      // seconds, must exceed the longest connection timeout
+#define spindump_connectionstable_cidindex_peer1 0       // index of peer1ConnectionIDs
+#define spindump_connectionstable_cidindex_peer2 1       // index of peer2ConnectionIDs
+#define spindump_connectionstable_cidindex_nsides 2
+#define spindump_connectionstable_aggregates_nkeys 2    // prefixes an aggregate can be indexed under
+#define spindump_connectionstable_eviction_none 0       // not evictable, e.g., manually created aggregates
+#define spindump_connectionstable_eviction_establishing 1 // evicted first
+#define spindump_connectionstable_eviction_closed 2
+#define spindump_connectionstable_eviction_active 3     // evicted last
+#define spindump_connectionstable_eviction_nlists 4
 
 //
 // Data structures ----------------------------------------------------------------------------
 //
 
+struct spindump_connectionstable_cidindex {
+  unsigned int nBuckets;                            // number of buckets, a power of two
+  unsigned int nIndexed;                            // number of connections in the index
+  unsigned int nOfLength
+    [spindump_connectionstable_cidindex_maxlen+1];  // number of indexed CIDs of each length
+  struct spindump_connection** buckets;             // chains linked through cidIndexNext
+};
+
+struct spindump_connectionstable_aggregatenode {
+  struct spindump_connectionstable_aggregatenode*
+    children[2];                                    // longer prefixes, by the value of the next bit
+  struct spindump_connection* aggregates;           // aggregates indexed at this prefix, linked through aggregateIndexNext
+};
+
+//
+// An update of an aggregate connection that was not made, but given
+// to the aggregate update handler of the table. The handler may make
+// the same update to a copy of the aggregate in another table.
+//
+
+enum spindump_connectionstable_aggregateupdate_type {
+  spindump_connectionstable_aggregateupdate_join,   // a connection joined the aggregate
+  spindump_connectionstable_aggregateupdate_leave,  // a connection of the aggregate is deleted
+  spindump_connectionstable_aggregateupdate_packet, // see spindump_analyze_process_pakstats
+  spindump_connectionstable_aggregateupdate_rtt     // see spindump_connections_newrttmeasurement
+};
+
+struct spindump_connectionstable_aggregateupdate {
+  enum spindump_connectionstable_aggregateupdate_type type;
+  struct spindump_connection* aggregate;
+  struct spindump_connection* connection;           // the connection that joins or leaves
+  spindump_time timestamp;                          // for packets
+  int fromResponder;                                // for packets
+  unsigned int ipPacketLength;                      // for packets and RTTs
+  uint8_t ecnFlags;                                 // for packets
+  int handled;                                      // for packets, some handler was already called for the packet
+  int right;                                        // for RTTs
+  int unidirectional;                               // for RTTs
+  spindump_time sent;                               // for RTTs
+  spindump_time rcvd;                               // for RTTs
+  const char* why;                                  // for RTTs
+};
+
+typedef void (*spindump_connectionstable_aggregateupdatehandler)(const struct spindump_connectionstable_aggregateupdate* update,
+                                                                 void* handlerData);
+
 struct spindump_connectionstable {
   unsigned long long bandwidthMeasurementPeriod;
   unsigned int periodicReportPeriod;
   int performingPeriodicReport;
-  struct timeval lastPeriodicCheck;
-  struct timeval lastPeriodicReport;
+  spindump_time lastPeriodicCheck;
+  spindump_time lastPeriodicReport;
   spindump_tags defaultTags;
   unsigned int nConnections;
   unsigned int maxNConnections;
   struct spindump_connection** connections;
+  unsigned int nIndexBuckets;
+  unsigned int nIndexedConnections;
+  struct spindump_connection** index;
+  struct spindump_connectionstable_cidindex cidIndex[spindump_connectionstable_cidindex_nsides];
+  unsigned int nHoles;                              // number of unused positions below nConnections
+  unsigned int firstHole;                           // no unused positions below this one
+  unsigned long long nextCreationOrder;             // creationOrder of the next new connection
+  unsigned long timerSecond;                        // first second not yet processed by the timers
+  struct spindump_connection* timerSlots
+    [spindump_connectionstable_timers_nslots];      // connections to check, by second modulo nslots
+  unsigned int nTimerDue;                           // number of connections in timerDue
+  unsigned int maxNTimerDue;                        // allocated size of timerDue
+  struct spindump_connection** timerDue;            // connections whose checks are due
+  struct spindump_connectionstable_aggregatenode*
+    aggregateTrieV4;                                // index of simple aggregates, by IPv4 prefixes
+  struct spindump_connectionstable_aggregatenode*
+    aggregateTrieV6;                                // index of simple aggregates, by IPv6 prefixes
+  unsigned int nAggregateCandidates;                // number of aggregates in aggregateCandidates
+  unsigned int maxNAggregateCandidates;             // allocated size of aggregateCandidates
+  struct spindump_connection** aggregateCandidates; // aggregates that an address pair may belong to
+  unsigned long long memoryLimit;                   // most bytes allowed for connections, or 0 for no limit
+  struct spindump_connection* evictionOldest
+    [spindump_connectionstable_eviction_nlists];    // least recently active connections, by eviction list
+  struct spindump_connection* evictionNewest
+    [spindump_connectionstable_eviction_nlists];    // most recently active connections, by eviction list
+  unsigned int maxConnections;                      // most connections allowed in the table, or 0 for no limit
+  unsigned int tcpWindow;                           // largest window of sent TCP segments remembered, per direction
+  enum spindump_bandwidth_series_mode
+    bandwidthSeries;                                // which connections keep a multi-resolution bandwidth series
+  int mergedAggregates;                             // aggregates are merged to a coordinator, which starts
+                                                    // their RTT intervals
+  spindump_connectionstable_aggregateupdatehandler
+    aggregateUpdateHandler;                         // if set, aggregates are not updated, the updates go here
+  void* aggregateUpdateHandlerData;                 // data to pass to the aggregate update handler
   unsigned int nNetworks;
   struct spindump_connection_network *networks;
 };
@@ -0,0 +1,272 @@
+
+//
+//
+//  ////////////////////////////////////////////////////////////////////////////////////
+//  /////////                                                                ///////////
+//  //////       SSS    PPPP    I   N    N   DDDD    U   U   M   M   PPPP         //////
+//  //          S       P   P   I   NN   N   D   D   U   U   MM MM   P   P            //
+//  /            SSS    PPPP    I   N NN N   D   D   U   U   M M M   PPPP              /
+//  //              S   P       I   N   NN   D   D   U   U   M   M   P                //
+//  ////         SSS    P       I   N    N   DDDD     UUU    M   M   P            //////
+//  /////////                                                                ///////////
+//  ////////////////////////////////////////////////////////////////////////////////////
+//
+//  SPINDUMP (C) 2018-2020 BY ERICSSON RESEARCH
+//  AUTHOR: JARI ARKKO
+//
+
+//
+// Includes -----------------------------------------------------------------------------------
+//
+
+#include <stdlib.h>
+#include <string.h>
+#include "spindump_util.h"
+#include "spindump_table_timers.h"
+
+//
+// Function prototypes ------------------------------------------------------------------------
+//
+
+static void
+spindump_connectionstable_timers_link(struct spindump_connection** head,
+                                      struct spindump_connection* connection);
+static void
+spindump_connectionstable_timers_unlink(struct spindump_connection* connection);
+static int
+spindump_connectionstable_timers_adddue(struct spindump_connectionstable* table,
+                                        struct spindump_connection* connection);
+static int
+spindump_connectionstable_timers_compare(const void* a,
+                                         const void* b);
+
+//
+// Actual code --------------------------------------------------------------------------------
+//
+
+//
+// Initialize the connection timers of a table. The timers are a
+// timing wheel with one slot per second. Each slot holds a list of
+// connections whose timeouts need to be checked at that second (or at
+// a multiple of spindump_connectionstable_timers_nslots seconds
+// later). No memory is needed until connections expire.
+//
+
+void
+spindump_connectionstable_timers_initialize(struct spindump_connectionstable* table) {
+  spindump_assert(table != 0);
+  memset(table->timerSlots,0,sizeof(table->timerSlots));
+  table->timerSecond = 0;
+  table->timerDue = 0;
+  table->nTimerDue = 0;
+  table->maxNTimerDue = 0;
+}
+
+//
+// Free up the resources associated with the timers. The connections
+// are not affected, but they should no longer be in the timers.
+//
+
+void
+spindump_connectionstable_timers_uninitialize(struct spindump_connectionstable* table) {
+  spindump_assert(table != 0);
+  if (table->timerDue != 0) {
+    spindump_deepdebugf("free table->timerDue in spindump_connectionstable_timers_uninitialize");
+    spindump_free(table->timerDue);
+    table->timerDue = 0;
+  }
+  table->nTimerDue = 0;
+  table->maxNTimerDue = 0;
+}
+
+//
+// Link a connection to the beginning of a timer list
+//
+
+static void
+spindump_connectionstable_timers_link(struct spindump_connection** head,
+                                      struct spindump_connection* connection) {
+  connection->timerNext = *head;
+  if (*head != 0) (*head)->timerPprev = &connection->timerNext;
+  connection->timerPprev = head;
+  *head = connection;
+}
+
+//
+// Unlink a connection from whatever timer list it is in. As the
+// connection knows the pointer that points to it, this takes constant
+// time.
+//
+
+static void
+spindump_connectionstable_timers_unlink(struct spindump_connection* connection) {
+  spindump_assert(connection->timerPprev != 0);
+  *(connection->timerPprev) = connection->timerNext;
+  if (connection->timerNext != 0) connection->timerNext->timerPprev = connection->timerPprev;
+  connection->timerNext = 0;
+  connection->timerPprev = 0;
+}
+
+//
+// Is the connection in the timers?
+//
+
+int
+spindump_connectionstable_timers_isscheduled(const struct spindump_connection* connection) {
+  spindump_assert(connection != 0);
+  return(connection->timerPprev != 0);
+}
+
+//
+// Schedule a check of a connection at a given second. If the
+// connection was already scheduled, the old schedule is replaced.
+//
+// Deadlines in the past are moved to the first second that the timers
+// have not yet processed.
+//
+
+void
+spindump_connectionstable_timers_schedule(struct spindump_connectionstable* table,
+                                          struct spindump_connection* connection,
+                                          unsigned long deadline) {
+  spindump_assert(table != 0);
+  spindump_assert(connection != 0);
+  if (deadline < table->timerSecond) deadline = table->timerSecond;
+  if (spindump_connectionstable_timers_isscheduled(connection)) {
+    if (connection->timerDeadline == deadline) return;
+    spindump_connectionstable_timers_unlink(connection);
+  }
+  connection->timerDeadline = deadline;
+  spindump_connectionstable_timers_link(&table->timerSlots[deadline % spindump_connectionstable_timers_nslots],
+                                        connection);
+}
+
+//
+// Remove a connection from the timers. It is not an error to call
+// this for a connection that is not scheduled.
+//
+
+void
+spindump_connectionstable_timers_unschedule(struct spindump_connectionstable* table,
+                                            struct spindump_connection* connection) {
+  spindump_assert(table != 0);
+  spindump_assert(connection != 0);
+  if (spindump_connectionstable_timers_isscheduled(connection)) {
+    spindump_connectionstable_timers_unlink(connection);
+  }
+}
+
+//
+// Add a connection to the array of connections that are due. Return
+// 1 upon success, 0 if memory could not be allocated.
+//
+
+static int
+spindump_connectionstable_timers_adddue(struct spindump_connectionstable* table,
+                                        struct spindump_connection* connection) {
+  if (table->nTimerDue == table->maxNTimerDue) {
+    unsigned int newMax = table->maxNTimerDue == 0 ? 64 : table->maxNTimerDue * 2;
+    unsigned int size = newMax * sizeof(struct spindump_connection*);
+    struct spindump_connection** newDue = (struct spindump_connection**)spindump_malloc(size);
+    if (newDue == 0) {
+      spindump_errorf("cannot allocate the expired connections array for %u bytes", size);
+      return(0);
+    }
+    if (table->timerDue != 0) {
+      memcpy(newDue,table->timerDue,table->nTimerDue * sizeof(struct spindump_connection*));
+      spindump_deepdebugf("free table->timerDue after a growth");
+      spindump_free(table->timerDue);
+    }
+    table->timerDue = newDue;
+    table->maxNTimerDue = newMax;
+  }
+  table->timerDue[table->nTimerDue++] = connection;
+  return(1);
+}
+
+//
+// Order connections by their position in the connections table
+//
+
+static int
+spindump_connectionstable_timers_compare(const void* a,
+                                         const void* b) {
+  const struct spindump_connection* connectionA = *(const struct spindump_connection* const*)a;
+  const struct spindump_connection* connectionB = *(const struct spindump_connection* const*)b;
+  if (connectionA->tableIndex < connectionB->tableIndex) return(-1);
+  if (connectionA->tableIndex > connectionB->tableIndex) return(1);
+  return(0);
+}
+
+//
+// Advance the timers to the second "now", and collect the connections
+// whose checks are due by then. The connections are removed from the
+// timers, and returned via the output parameter p_due in the order of
+// their position in the connections table, the same order in which a
+// full sweep of the table would have visited them. The array is owned
+// by the table, and is valid until the next call. Return the number
+// of due connections.
+//
+// Only the slots for the seconds that have passed since the previous
+// call are looked at; after a long pause each slot is looked at
+// once.
+//
+
+unsigned int
+spindump_connectionstable_timers_expire(struct spindump_connectionstable* table,
+                                        unsigned long now,
+                                        struct spindump_connection*** p_due) {
+  
+  spindump_assert(table != 0);
+  spindump_assert(p_due != 0);
+  
+  table->nTimerDue = 0;
+  *p_due = table->timerDue;
+  if (now < table->timerSecond) return(0);
+  if (now - table->timerSecond >= spindump_connectionstable_timers_nslots) {
+    table->timerSecond = now - spindump_connectionstable_timers_nslots + 1;
+  }
+  
+  while (table->timerSecond <= now) {
+    
+    //
+    // Take the contents of the slot, and mark the second processed, so
+    // that any reschedules go to later slots
+    //
+    
+    unsigned long second = table->timerSecond++;
+    struct spindump_connection** slot = &table->timerSlots[second % spindump_connectionstable_timers_nslots];
+    if (*slot == 0) continue;
+    struct spindump_connection* expiring = *slot;
+    expiring->timerPprev = &expiring;
+    *slot = 0;
+    
+    //
+    // Go through the list. Connections that are not due yet belong to
+    // a later round of the wheel, and go back to the slot.
+    //
+    
+    while (expiring != 0) {
+      struct spindump_connection* connection = expiring;
+      spindump_connectionstable_timers_unlink(connection);
+      if (connection->timerDeadline > now || !spindump_connectionstable_timers_adddue(table,connection)) {
+        spindump_connectionstable_timers_link(slot,connection);
+      }
+    }
+    
+  }
+  
+  //
+  // Sort the due connections
+  //
+  
+  if (table->nTimerDue > 1) {
+    qsort(table->timerDue,
+          table->nTimerDue,
+          sizeof(struct spindump_connection*),
+          spindump_connectionstable_timers_compare);
+  }
+  
+  *p_due = table->timerDue;
+  return(table->nTimerDue);
+}
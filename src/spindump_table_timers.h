@@ -0,0 +1,51 @@
+
+//
+//
+//  ////////////////////////////////////////////////////////////////////////////////////
+//  /////////                                                                ///////////
+//  //////       SSS    PPPP    I   N    N   DDDD    U   U   M   M   PPPP         //////
+//  //          S       P   P   I   NN   N   D   D   U   U   MM MM   P   P            //
+//  /            SSS    PPPP    I   N NN N   D   D   U   U   M M M   PPPP              /
+//  //              S   P       I   N   NN   D   D   U   U   M   M   P                //
+//  ////         SSS    P       I   N    N   DDDD     UUU    M   M   P            //////
+//  /////////                                                                ///////////
+//  ////////////////////////////////////////////////////////////////////////////////////
+//
+//  SPINDUMP (C) 2018-2020 BY ERICSSON RESEARCH
+//  AUTHOR: JARI ARKKO
+//
+
+#ifndef SPINDUMP_TABLE_TIMERS_H
+#define SPINDUMP_TABLE_TIMERS_H
+
+//
+// Includes -----------------------------------------------------------------------------------
+//
+
+#include "spindump_util.h"
+#include "spindump_connections_structs.h"
+#include "spindump_table_structs.h"
+
+//
+// External API interface to this module ------------------------------------------------------
+//
+
+void
+spindump_connectionstable_timers_initialize(struct spindump_connectionstable* table);
+void
+spindump_connectionstable_timers_uninitialize(struct spindump_connectionstable* table);
+void
+spindump_connectionstable_timers_schedule(struct spindump_connectionstable* table,
+                                          struct spindump_connection* connection,
+                                          unsigned long deadline);
+void
+spindump_connectionstable_timers_unschedule(struct spindump_connectionstable* table,
+                                            struct spindump_connection* connection);
+int
+spindump_connectionstable_timers_isscheduled(const struct spindump_connection* connection);
+unsigned int
+spindump_connectionstable_timers_expire(struct spindump_connectionstable* table,
+                                        unsigned long now,
+                                        struct spindump_connection*** p_due);
+
+#endif // SPINDUMP_TABLE_TIMERS_H
@@ -24,6 +24,7 @@
 #include <stdio.h>
 #include <string.h>
 #include <ctype.h>
+#include <math.h>
 #include <unistd.h>
 #include <sys/socket.h>
 #include <netdb.h>
@@ -35,6 +36,11 @@
 #include "spindump_test.h"
 #include "spindump_protocols.h"
 #include "spindump_connections.h"
+#include "spindump_connections_set.h"
+#include "spindump_connections_set_iterator.h"
+#include "spindump_table_index.h"
+#include "spindump_table_aggregates.h"
+#include "spindump_table_eviction.h"
 #include "spindump_event.h"
 #include "spindump_event_parser_json.h"
 #include "spindump_event_parser_qlog.h"
@@ -46,6 +52,12 @@
 #include "spindump_json_value.h"
 #include "spindump_json.h"
 #include "spindump_analyze_quic_parser_util.h"
+#include "spindump_poll.h"
+#include "spindump_capture_ring.h"
+#include "spindump_remote_client.h"
+#include "spindump_main.h"
+#include "spindump_main_lib.h"
+#include "spindump_main_prefilter.h"
 
 //
 // Function prototypes ------------------------------------------------------------------------
@@ -53,8 +65,15 @@
 
 static void unittests(void);
 static void unittests_util(void);
+static void unittests_seq(void);
+static void unittests_mid(void);
+static void unittests_rtt(void);
+static void unittests_bandwidth(void);
+static void unittests_poll(void);
+static void unittests_ring(void);
 static void unittests_quicparser(void);
 static void unittests_table(void);
+static void unittests_prefilter(void);
 static void unittests_eventtextparser(void);
 static void unittests_eventjsonparser(void);
 static void unittests_jsonparser(void);
@@ -68,6 +87,16 @@ static void
 unittests_eventjsonparser_callback(const struct spindump_json_value* value,
                                    const struct spindump_json_schema* type,
                                    void* data);
+static void
+systemtests_counthandler(struct spindump_analyze* state,
+                         void* handlerData,
+                         void** handlerConnectionData,
+                         spindump_analyze_event event,
+                         const spindump_time* timestamp,
+                         const int fromResponder,
+                         const unsigned int ipPacketLength,
+                         struct spindump_packet* packet,
+                         struct spindump_connection* connection);
 
 //
 // Actual code --------------------------------------------------------------------------------
@@ -80,8 +109,15 @@ unittests_eventjsonparser_callback(const struct spindump_json_value* value,
 static void
 unittests(void) {
   unittests_util();
+  unittests_seq();
+  unittests_mid();
+  unittests_rtt();
+  unittests_bandwidth();
+  unittests_poll();
+  unittests_ring();
   unittests_quicparser();
   unittests_table();
+  unittests_prefilter();
   unittests_jsonvalue();
   unittests_jsonparser();
   unittests_eventtextparser();
@@ -182,6 +218,780 @@ unittests_util(void) {
   spindump_checktest(strcmp(id2s,"0102030405060708090a0b0c0d0e") == 0);
 }
 
+//
+// Unit tests for the poller and its notifiers
+//
+
+static void
+unittests_poll(void) {
+
+  printf("unit tests: poll...\n");
+
+  struct spindump_poll* poller = spindump_poll_initialize();
+  spindump_checktest(poller != 0);
+  struct spindump_poll_notifier notifier;
+  spindump_checktest(spindump_poll_notifier_initialize(&notifier));
+  spindump_checktest(spindump_poll_add(poller,notifier.readFd,2));
+
+  //
+  // A notifier is ready when signaled, until it is cleared
+  //
+
+  spindump_checktest(spindump_poll_wait(poller,0) == 0);
+  spindump_poll_notifier_signal(&notifier);
+  spindump_poll_notifier_signal(&notifier);
+  spindump_checktest(spindump_poll_wait(poller,0) == (1U << 2));
+  spindump_checktest(spindump_poll_wait(poller,1) == (1U << 2));
+  spindump_poll_notifier_clear(&notifier);
+  spindump_checktest(spindump_poll_wait(poller,0) == 0);
+
+  //
+  // A timer makes its source ready, and the poller clears it
+  //
+
+  spindump_checktest(spindump_poll_settimer(poller,5,10*1000));
+  spindump_checktest(spindump_poll_wait(poller,1) == (1U << 5));
+  spindump_checktest(spindump_poll_wait(poller,0) == 0);
+  spindump_checktest(spindump_poll_settimer(poller,5,1000*1000*1000));
+  spindump_checktest(spindump_poll_wait(poller,0) == 0);
+
+  spindump_poll_notifier_uninitialize(&notifier);
+  spindump_poll_uninitialize(poller);
+}
+
+//
+// Unit tests for the capture ring, from a single thread
+//
+
+static void
+unittests_ring(void) {
+
+  printf("unit tests: ring...\n");
+
+  //
+  // The number of slots is rounded up to a power of two, and packets
+  // are truncated to the slot size
+  //
+  
+  struct spindump_capture_ring* ring = spindump_capture_ring_initialize(5,4);
+  spindump_checktest(ring != 0);
+  spindump_checktest(ring->nSlots == 8);
+  unsigned char contents[6] = { 0, 1, 2, 3, 4, 5 };
+  struct spindump_packet packet;
+  memset(&packet,0,sizeof(packet));
+  packet.contents = contents;
+  packet.caplen = packet.etherlen = sizeof(contents);
+  
+  //
+  // A full ring drops and counts packets, and records its high water
+  // mark
+  //
+  
+  for (unsigned int i = 0; i < 8; i++) {
+    packet.timestamp = i;
+    contents[0] = (unsigned char)i;
+    spindump_checktest(spindump_capture_ring_put(ring,&packet));
+  }
+  spindump_checktest(ring->highWater == 8);
+  spindump_checktest(!spindump_capture_ring_put(ring,&packet));
+  spindump_checktest(ring->overflows == 1);
+  
+  //
+  // Taken packets keep their slots until the next get
+  //
+  
+  struct spindump_packet* packets = 0;
+  int finished = 1;
+  spindump_checktest(spindump_capture_ring_get(ring,3,&packets,&finished) == 3);
+  spindump_checktest(!finished);
+  for (unsigned int i = 0; i < 3; i++) {
+    spindump_checktest(packets[i].timestamp == i);
+    spindump_checktest(packets[i].caplen == 4 && packets[i].etherlen == sizeof(contents));
+    spindump_checktest(packets[i].contents[0] == i && packets[i].contents[3] == 3);
+  }
+  spindump_checktest(!spindump_capture_ring_put(ring,&packet));
+  spindump_checktest(ring->overflows == 2);
+
+  //
+  // A get returns packets up to the end of the ring, and releases the
+  // previous ones, so new packets can be put across the wrap point
+  //
+  
+  spindump_checktest(spindump_capture_ring_get(ring,100,&packets,&finished) == 5);
+  spindump_checktest(packets[0].timestamp == 3 && packets[4].timestamp == 7);
+  for (unsigned int i = 8; i < 11; i++) {
+    packet.timestamp = i;
+    contents[0] = (unsigned char)i;
+    spindump_checktest(spindump_capture_ring_put(ring,&packet));
+  }
+  spindump_checktest(ring->highWater == 8);
+  spindump_checktest(spindump_capture_ring_get(ring,100,&packets,&finished) == 3);
+  for (unsigned int i = 0; i < 3; i++) {
+    spindump_checktest(packets[i].timestamp == 8 + i && packets[i].contents[0] == 8 + i);
+  }
+  spindump_checktest(packets == &ring->packets[0]);
+  
+  //
+  // The ring is finished only when it is also empty
+  //
+  
+  packet.timestamp = 11;
+  spindump_checktest(spindump_capture_ring_put(ring,&packet));
+  spindump_capture_ring_finish(ring);
+  spindump_checktest(spindump_capture_ring_get(ring,100,&packets,&finished) == 1);
+  spindump_checktest(!finished && packets[0].timestamp == 11);
+  spindump_checktest(spindump_capture_ring_get(ring,100,&packets,&finished) == 0);
+  spindump_checktest(finished);
+  spindump_checktest(ring->head == 12 && ring->tail == 12);
+  spindump_capture_ring_uninitialize(ring);
+}
+
+//
+// Unit tests for the TCP sequence number tracker
+//
+
+static void
+unittests_seq(void) {
+
+  printf("unit tests: seq...\n");
+
+  //
+  // Send 60 segments of 1000 bytes each, one per millisecond, to a
+  // tracker that remembers 50 and to one that may grow to 100
+  //
+  
+  struct spindump_seqtracker fixed;
+  struct spindump_seqtracker growing;
+  spindump_seqtracker_initialize(&fixed);
+  spindump_seqtracker_initialize(&growing);
+  spindump_seqtracker_setmaxwindow(&growing,100);
+  spindump_time sent;
+  for (unsigned int i = 0; i < 60; i++) {
+    sent = 1000 * spindump_time_nsecspersec + i * 1000 * spindump_time_nsecsperusec;
+    spindump_seqtracker_add(&fixed,&sent,0,1000 * i,1000,0);
+    spindump_seqtracker_add(&growing,&sent,0,1000 * i,1000,0);
+  }
+  
+  //
+  // Acks for forgotten, already acked, and earlier segments give no
+  // RTT
+  //
+  
+  spindump_time now;
+  now = 1001 * spindump_time_nsecspersec;
+  tcp_seq sentSeq;
+  int sentFin;
+  spindump_time* ackto;
+  spindump_checktest(spindump_seqtracker_ackto(&fixed,6000,0,0,&now,&sentSeq,&sentFin) == 0);
+  spindump_checktest(sentSeq == 0);
+  ackto = spindump_seqtracker_ackto(&fixed,21000,0,0,&now,&sentSeq,&sentFin);
+  spindump_checktest(ackto != 0 && *ackto % spindump_time_nsecspersec == 20000 * spindump_time_nsecsperusec && sentSeq == 20000);
+  spindump_checktest(spindump_seqtracker_ackto(&fixed,21000,0,0,&now,&sentSeq,&sentFin) == 0);
+  spindump_checktest(spindump_seqtracker_ackto(&fixed,16000,0,0,&now,&sentSeq,&sentFin) == 0);
+  spindump_checktest(sentSeq == 15000);
+  ackto = spindump_seqtracker_ackto(&fixed,20500,30500,0,&now,&sentSeq,&sentFin);
+  spindump_checktest(ackto != 0 && *ackto % spindump_time_nsecspersec == 30000 * spindump_time_nsecsperusec);
+  
+  //
+  // A larger window keeps the early segments, and an ack matches the
+  // latest retransmission of a segment
+  //
+  
+  ackto = spindump_seqtracker_ackto(&growing,6000,0,0,&now,&sentSeq,&sentFin);
+  spindump_checktest(ackto != 0 && *ackto % spindump_time_nsecspersec == 5000 * spindump_time_nsecsperusec);
+  sent = 1000 * spindump_time_nsecspersec + 70000 * spindump_time_nsecsperusec;
+  spindump_seqtracker_add(&growing,&sent,0,40000,1000,1);
+  ackto = spindump_seqtracker_ackto(&growing,41000,0,0,&now,&sentSeq,&sentFin);
+  spindump_checktest(ackto != 0 && *ackto % spindump_time_nsecspersec == 70000 * spindump_time_nsecsperusec && sentSeq == 40000 && sentFin == 1);
+  spindump_checktest(spindump_seqtracker_ackto(&growing,50000,0,0,&now,&sentSeq,&sentFin) == 0);
+  
+  spindump_seqtracker_uninitialize(&fixed);
+  spindump_seqtracker_uninitialize(&growing);
+}
+
+//
+// Unit tests for the message ID tracker
+//
+
+static void
+unittests_mid(void) {
+
+  printf("unit tests: mid...\n");
+
+  //
+  // Thousands of outstanding message IDs, responded to in the reverse
+  // order, all match to the right requests
+  //
+  
+  struct spindump_messageidtracker tracker;
+  spindump_messageidtracker_initialize(&tracker);
+  spindump_time start = 1000 * spindump_time_nsecspersec;
+  spindump_time now = start + spindump_time_nsecspersec;
+  const spindump_time* ackto;
+  for (unsigned int i = 0; i < 3000; i++) {
+    spindump_time sent = start + i * spindump_time_nsecsperusec;
+    spindump_messageidtracker_add(&tracker,&sent,(uint16_t)(i * 40503));
+  }
+  spindump_checktest(tracker.n == 3000);
+  spindump_checktest(tracker.nStored <= spindump_messageidtracker_maxnstored);
+  for (unsigned int i = 3000; i > 0; i--) {
+    ackto = spindump_messageidtracker_ackto(&tracker,&now,(uint16_t)((i - 1) * 40503));
+    spindump_checktest(ackto != 0 && *ackto == start + (i - 1) * spindump_time_nsecsperusec);
+  }
+  spindump_checktest(tracker.n == 0);
+  spindump_checktest(spindump_messageidtracker_ackto(&tracker,&now,40503) == 0);
+
+  //
+  // A retransmitted request keeps the time of the first one, and a
+  // response after the lifetime of the request does not match
+  //
+  
+  spindump_time sent1 = start;
+  spindump_time sent2 = start + 1000 * spindump_time_nsecsperusec;
+  spindump_messageidtracker_add(&tracker,&sent1,7);
+  spindump_messageidtracker_add(&tracker,&sent2,7);
+  ackto = spindump_messageidtracker_ackto(&tracker,&now,7);
+  spindump_checktest(ackto != 0 && *ackto == sent1);
+  spindump_messageidtracker_add(&tracker,&sent1,8);
+  now = sent1 + spindump_messageidtracker_lifetime + 1;
+  spindump_checktest(spindump_messageidtracker_ackto(&tracker,&now,8) == 0);
+  spindump_checktest(tracker.n == 0);
+
+  //
+  // A full table drops the oldest message ID to make room for a new
+  // one, and the old ones expire when new ones are added
+  //
+  
+  unsigned int max = spindump_messageidtracker_maxnstored * 3 / 4;
+  for (unsigned int i = 0; i <= max; i++) {
+    spindump_time sent = sent1 + i;
+    spindump_messageidtracker_add(&tracker,&sent,(uint16_t)i);
+  }
+  spindump_checktest(tracker.n == max);
+  spindump_checktest(spindump_messageidtracker_ackto(&tracker,&sent1,0) == 0);
+  ackto = spindump_messageidtracker_ackto(&tracker,&sent1,(uint16_t)max);
+  spindump_checktest(ackto != 0 && *ackto == sent1 + max);
+  now = sent1 + max + spindump_messageidtracker_lifetime + 1;
+  spindump_messageidtracker_add(&tracker,&now,(uint16_t)max);
+  spindump_checktest(tracker.n == 1);
+  spindump_messageidtracker_uninitialize(&tracker);
+
+  //
+  // Unanswered message IDs at a steady rate of 1000/s fill the table,
+  // but the table does not grow beyond its maximum size, and new IDs
+  // are tracked while old ones expire
+  //
+  
+  spindump_messageidtracker_initialize(&tracker);
+  for (unsigned int i = 0; i < 20000; i++) {
+    spindump_time sent = start + i * (spindump_time_nsecspersec / 1000);
+    spindump_messageidtracker_add(&tracker,&sent,(uint16_t)(i * 40503));
+    spindump_checktest(tracker.n <= max);
+    spindump_checktest(tracker.nOrder < tracker.nStored);
+  }
+  spindump_checktest(tracker.nStored == spindump_messageidtracker_maxnstored);
+  spindump_checktest(tracker.n == max);
+  now = start + 20000 * (spindump_time_nsecspersec / 1000);
+  ackto = spindump_messageidtracker_ackto(&tracker,&now,(uint16_t)(19999 * 40503));
+  spindump_checktest(ackto != 0 && *ackto == now - spindump_time_nsecspersec / 1000);
+  spindump_checktest(spindump_messageidtracker_ackto(&tracker,&now,(uint16_t)((19999 - max) * 40503)) == 0);
+  
+  //
+  // Responded IDs do not fill the ring
+  //
+  
+  for (unsigned int i = 0; i < 20000; i++) {
+    spindump_time sent = now + i;
+    spindump_messageidtracker_add(&tracker,&sent,(uint16_t)i);
+    spindump_checktest(spindump_messageidtracker_ackto(&tracker,&sent,(uint16_t)i) != 0);
+  }
+  spindump_checktest(tracker.nOrder < tracker.nStored);
+  spindump_messageidtracker_uninitialize(&tracker);
+}
+
+//
+// Calculate the average, standard deviation and filtered average of
+// the recent measurements in an RTT tracker from scratch, as a
+// reference for spindump_rtt_calculateLastMovingAvgRTT
+//
+
+static unsigned long
+unittests_rtt_average(const struct spindump_rtt* rtt,
+                      unsigned int filterLimitPercentage,
+                      unsigned long* standardDeviation,
+                      unsigned long* filteredAvg) {
+  unsigned long long sum = 0;
+  unsigned int n = 0;
+  for (unsigned int i = 0; i < spindump_rtt_nrecent; i++) {
+    if (rtt->recentRTTs[i] == spindump_rtt_infinite) continue;
+    sum += rtt->recentRTTs[i];
+    n++;
+  }
+  spindump_assert(n > 0);
+  unsigned long long avg = sum / n;
+  unsigned long long devSum = 0;
+  for (unsigned int i = 0; i < spindump_rtt_nrecent; i++) {
+    if (rtt->recentRTTs[i] == spindump_rtt_infinite) continue;
+    unsigned long long diff = rtt->recentRTTs[i] > avg ? rtt->recentRTTs[i] - avg : avg - rtt->recentRTTs[i];
+    devSum += diff * diff;
+  }
+  *standardDeviation = n > 1 ? (unsigned long)floor(sqrt((1.0/(n-1))*(double)devSum)) : 0;
+  unsigned long long fsum = 0;
+  unsigned int fn = 0;
+  int filter = (rtt->lastMovingAvgRTT != spindump_rtt_infinite &&
+                rtt->lastStandardDeviation != spindump_rtt_infinite &&
+                n >= spindump_rtt_nminfilter);
+  unsigned long limitdiff = (filterLimitPercentage * rtt->lastStandardDeviation) / 100;
+  for (unsigned int i = 0; i < spindump_rtt_nrecent; i++) {
+    unsigned long val = rtt->recentRTTs[i];
+    if (val == spindump_rtt_infinite) continue;
+    if (filter && (val + limitdiff < rtt->lastMovingAvgRTT || val > rtt->lastMovingAvgRTT + limitdiff)) continue;
+    fsum += val;
+    fn++;
+  }
+  *filteredAvg = fn > 0 ? (unsigned long)(fsum / fn) : 0;
+  return((unsigned long)avg);
+}
+
+//
+// Unit tests for the RTT quantile sketches
+//
+
+static void
+unittests_rtt(void) {
+
+  printf("unit tests: rtt...\n");
+
+  //
+  // RTTs of 1 to 1000 ms, one of each. The quantiles should be within
+  // the accuracy of the sketch.
+  //
+
+#define checkquantile(S,Q,V)                                                     \
+  {                                                                              \
+    unsigned long quantile = spindump_rtt_sketch_quantile(S,Q);                  \
+    spindump_deepdeepdebugf("quantile %f = %lu", Q, quantile);                   \
+    spindump_checktest(quantile >= (V) - (V) / 50 && quantile <= (V) + (V) / 50); \
+  }
+  
+  //
+  // Without tracking, no sketch or histogram bins are allocated
+  //
+
+  struct spindump_rtt untracked;
+  spindump_rtt_initialize(&untracked);
+  spindump_rtt_newmeasurement(&untracked,1000 * spindump_time_nsecsperusec);
+  spindump_checktest(untracked.sketch == 0);
+  spindump_checktest(untracked.histogram.bins == 0);
+  spindump_checktest(untracked.histogram.count == 0);
+  spindump_rtt_uninitialize(&untracked);
+  spindump_rtt_settracking(1,1);
+  
+  struct spindump_rtt rtt;
+  spindump_rtt_initialize(&rtt);
+  spindump_checktest(rtt.sketch == 0);
+  for (unsigned long long i = 1; i <= 1000; i++) {
+    spindump_rtt_newmeasurement(&rtt,i * 1000 * spindump_time_nsecsperusec);
+  }
+  spindump_checktest(rtt.sketch != 0);
+  spindump_checktest(rtt.sketch->count == 1000);
+  checkquantile(rtt.sketch,0.50,500000UL);
+  checkquantile(rtt.sketch,0.95,950000UL);
+  checkquantile(rtt.sketch,0.99,990000UL);
+  spindump_rtt_newinterval(&rtt);
+  spindump_checktest(rtt.sketch->count == 0);
+  spindump_checktest(spindump_rtt_sketch_quantile(rtt.sketch,0.5) == spindump_rtt_infinite);
+  
+  //
+  // The same RTTs in two halves, merged
+  //
+
+  struct spindump_rtt_sketch low;
+  struct spindump_rtt_sketch high;
+  spindump_rtt_sketch_initialize(&low);
+  spindump_rtt_sketch_initialize(&high);
+  for (unsigned long long i = 1; i <= 1000; i++) {
+    spindump_rtt_sketch_add(i <= 500 ? &low : &high,i * 1000 * spindump_time_nsecsperusec);
+  }
+  checkquantile(&high,0.50,750000UL);
+  spindump_rtt_sketch_merge(&high,&low);
+  spindump_checktest(high.count == 1000);
+  checkquantile(&high,0.50,500000UL);
+  checkquantile(&high,0.99,990000UL);
+  
+  //
+  // Values too far apart for the bins collapse the lowest ones, but
+  // the high quantiles stay accurate. Zero values are counted
+  // separately.
+  //
+
+  struct spindump_rtt_sketch wide;
+  spindump_rtt_sketch_initialize(&wide);
+  spindump_rtt_sketch_add(&wide,0);
+  spindump_checktest(spindump_rtt_sketch_quantile(&wide,0.5) == 0);
+  for (unsigned long long i = 0; i < 100; i++) {
+    spindump_rtt_sketch_add(&wide,1000);
+    spindump_rtt_sketch_add(&wide,10 * spindump_time_nsecspersec);
+  }
+  spindump_checktest(wide.count == 201);
+  checkquantile(&wide,0.99,10000000UL);
+  spindump_checktest(spindump_rtt_sketch_quantile(&wide,0.0) == 0);
+  spindump_checktest(spindump_rtt_sketch_quantile(&wide,0.25) < 10000000UL / 50);
+  
+  //
+  // Sketches in sparse form, as sent to other instances. With room
+  // for all bins, the received sketch has the same quantiles. With
+  // fewer bins, the lowest ones are collapsed but the high quantiles
+  // stay accurate.
+  //
+
+  unsigned int sparseOffset;
+  unsigned int sparseZeros;
+  unsigned int sparseBins;
+  unsigned int sparseIndexes[spindump_rtt_sketch_nbins];
+  unsigned int sparseCounts[spindump_rtt_sketch_nbins];
+  struct spindump_rtt_sketch received;
+  spindump_rtt_sketch_sparse(&high,spindump_rtt_sketch_nbins,&sparseOffset,&sparseZeros,&sparseBins,sparseIndexes,sparseCounts);
+  spindump_checktest(sparseZeros == 0);
+  spindump_checktest(sparseBins > 64);
+  spindump_checktest(sparseIndexes[0] == 0);
+  spindump_rtt_sketch_initialize(&received);
+  spindump_rtt_sketch_addsparse(&received,sparseOffset,sparseZeros,sparseBins,sparseIndexes,sparseCounts);
+  spindump_checktest(received.count == 1000);
+  spindump_checktest(spindump_rtt_sketch_quantile(&received,0.01) == spindump_rtt_sketch_quantile(&high,0.01));
+  spindump_checktest(spindump_rtt_sketch_quantile(&received,0.5) == spindump_rtt_sketch_quantile(&high,0.5));
+  spindump_rtt_sketch_sparse(&high,64,&sparseOffset,&sparseZeros,&sparseBins,sparseIndexes,sparseCounts);
+  spindump_checktest(sparseBins == 64);
+  spindump_checktest(sparseIndexes[0] == 0 && sparseIndexes[63] == 63);
+  spindump_rtt_sketch_initialize(&received);
+  spindump_rtt_sketch_addsparse(&received,sparseOffset,sparseZeros,sparseBins,sparseIndexes,sparseCounts);
+  spindump_checktest(received.count == 1000);
+  checkquantile(&received,0.50,500000UL);
+  checkquantile(&received,0.99,990000UL);
+  spindump_rtt_sketch_sparse(&wide,64,&sparseOffset,&sparseZeros,&sparseBins,sparseIndexes,sparseCounts);
+  spindump_checktest(sparseZeros == 1);
+  spindump_rtt_sketch_addsparse(&received,sparseOffset,sparseZeros,sparseBins,sparseIndexes,sparseCounts);
+  spindump_checktest(received.count == 1201);
+  spindump_rtt_uninitialize(&rtt);
+  
+#undef checkquantile
+
+  //
+  // The incrementally maintained average, deviation and filtered
+  // average should be the same as when calculated from the recent
+  // measurements, also with duplicate values and after the table of
+  // recent measurements has wrapped around
+  //
+
+  struct spindump_rtt averaged;
+  spindump_rtt_initialize(&averaged);
+  unsigned long long seed = 1;
+  for (unsigned int i = 0; i < 200; i++) {
+    seed = seed * 6364136223846793005ULL + 1442695040888963407ULL;
+    unsigned long long rttNsec = (20000 + (seed >> 33) % (i % 7 == 0 ? 40000 : 2000)) * spindump_time_nsecsperusec;
+    if (i % 5 == 0) rttNsec = 21000 * spindump_time_nsecsperusec;
+    spindump_rtt_newmeasurement(&averaged,rttNsec);
+    unsigned long expectedDev;
+    unsigned long expectedFiltAvg;
+    unsigned long expectedAvg = unittests_rtt_average(&averaged,50,&expectedDev,&expectedFiltAvg);
+    unsigned long dev;
+    unsigned long filtAvg;
+    unsigned long avg = spindump_rtt_calculateLastMovingAvgRTT(&averaged,1,50,&dev,&filtAvg);
+    spindump_checktest(avg == expectedAvg);
+    spindump_checktest(dev == expectedDev);
+    spindump_checktest(filtAvg == expectedFiltAvg);
+  }
+  spindump_rtt_uninitialize(&averaged);
+
+  //
+  // Histogram bin indexes and the lowest values of the bins map to
+  // each other, and each value falls into a bin that is within the
+  // relative precision of the value
+  //
+
+  for (unsigned int precision = 0; precision <= spindump_rtt_histogram_maxprecision; precision++) {
+    unsigned int nBins = (spindump_rtt_histogram_maxexponent - precision + 1) << precision;
+    for (unsigned int i = 0; i < nBins; i++) {
+      spindump_checktest(spindump_rtt_histogram_index(precision,spindump_rtt_histogram_binvalue(precision,i)) == i);
+    }
+    for (unsigned long long value = 1; value < (1ULL << spindump_rtt_histogram_maxexponent); value = value * 3 + 1) {
+      unsigned int index = spindump_rtt_histogram_index(precision,value);
+      spindump_checktest(index < nBins);
+      unsigned long long low = spindump_rtt_histogram_binvalue(precision,index);
+      spindump_checktest(low <= value);
+      spindump_checktest(value - low <= (value >> precision));
+    }
+  }
+
+  //
+  // Histograms of different precisions merge, and when there are too
+  // many bins the sparse form lowers the precision but keeps all
+  // measurements
+  //
+
+  spindump_rtt_histogram_setprecision(spindump_rtt_histogram_maxprecision);
+  struct spindump_rtt fine;
+  spindump_rtt_initialize(&fine);
+  for (unsigned long long i = 1; i <= 1000; i++) {
+    spindump_rtt_newmeasurement(&fine,i * 1000 * spindump_time_nsecsperusec);
+  }
+  spindump_checktest(fine.histogram.count == 1000);
+  spindump_rtt_histogram_setprecision(spindump_rtt_histogram_defaultprecision);
+  struct spindump_rtt_histogram coarse;
+  spindump_rtt_histogram_initialize(&coarse);
+  spindump_checktest(spindump_rtt_histogram_addbin(&coarse,
+                                                   coarse.precision,
+                                                   spindump_rtt_histogram_index(coarse.precision,500),
+                                                   5));
+  spindump_checktest(spindump_rtt_histogram_merge(&coarse,&fine.histogram));
+  spindump_checktest(coarse.count == 1005);
+  unsigned int precision;
+  unsigned int nBins;
+  unsigned int indexes[spindump_event_histogram_maxbins];
+  unsigned int counts[spindump_event_histogram_maxbins];
+  spindump_rtt_histogram_sparse(&fine.histogram,spindump_event_histogram_maxbins,
+                                &precision,&nBins,indexes,counts);
+  spindump_checktest(precision < spindump_rtt_histogram_maxprecision);
+  spindump_checktest(nBins > 0 && nBins <= spindump_event_histogram_maxbins);
+  unsigned long long total = 0;
+  for (unsigned int i = 0; i < nBins; i++) {
+    spindump_checktest(i == 0 || indexes[i] > indexes[i-1]);
+    total += counts[i];
+  }
+  spindump_checktest(total == 1000);
+  spindump_checktest(spindump_rtt_histogram_binvalue(precision,indexes[0]) <= 1000);
+  spindump_rtt_newinterval(&fine);
+  spindump_checktest(fine.histogram.count == 0);
+  spindump_rtt_histogram_sparse(&fine.histogram,spindump_event_histogram_maxbins,
+                                &precision,&nBins,indexes,counts);
+  spindump_checktest(nBins == 0);
+  spindump_rtt_histogram_uninitialize(&coarse);
+  spindump_rtt_uninitialize(&fine);
+
+  //
+  // Merging intervals moves all measurements of the sketch and the
+  // histogram, and after that the measurements fed directly to the
+  // target are not counted in them again
+  //
+
+  struct spindump_rtt worker;
+  struct spindump_rtt coordinator;
+  spindump_rtt_initialize(&worker);
+  spindump_rtt_initialize(&coordinator);
+  for (unsigned int round = 0; round < 2; round++) {
+    for (unsigned long long i = 1; i <= 500; i++) {
+      spindump_rtt_newmeasurement(&worker,i * 1000 * spindump_time_nsecsperusec);
+    }
+    spindump_checktest(spindump_rtt_mergeinterval(&coordinator,&worker));
+    spindump_checktest(worker.sketch->count == 0);
+    spindump_checktest(worker.histogram.count == 0);
+    spindump_rtt_newmeasurement(&coordinator,1000 * spindump_time_nsecsperusec);
+  }
+  spindump_checktest(coordinator.sketch->count == 1000);
+  spindump_checktest(coordinator.histogram.count == 1000);
+  spindump_rtt_uninitialize(&worker);
+  spindump_rtt_uninitialize(&coordinator);
+  spindump_rtt_settracking(0,0);
+}
+
+//
+// Unit tests for the multi-resolution bandwidth series
+//
+
+static void
+unittests_bandwidth(void) {
+
+  printf("unit tests: bandwidth...\n");
+
+  struct spindump_bandwidth bandwidth;
+  struct spindump_bandwidth_series_stats stats;
+  spindump_time start = 1000 * spindump_time_nsecspersec;
+  spindump_time when;
+  spindump_bandwidth_initialize(&bandwidth,spindump_bandwidth_period_default);
+  spindump_checktest(!spindump_bandwidth_seriesstats(&bandwidth,&start,&stats));
+  spindump_checktest(spindump_bandwidth_enableseries(&bandwidth));
+  spindump_checktest(!spindump_bandwidth_seriesstats(&bandwidth,&start,&stats));
+
+  //
+  // 100 bytes every second for 20 seconds, and a burst of 900 bytes
+  // 50 ms after the fourth packet. The packet at 20 s completes the
+  // second 10 s period.
+  //
+  
+  for (unsigned long long i = 0; i <= 20; i++) {
+    when = start + i * spindump_time_nsecspersec;
+    spindump_bandwidth_newpacket(&bandwidth,100,&when);
+    if (i == 3) {
+      when += 50 * 1000 * spindump_time_nsecsperusec;
+      spindump_bandwidth_newpacket(&bandwidth,900,&when);
+    }
+  }
+  spindump_checktest(spindump_bandwidth_seriesstats(&bandwidth,&when,&stats));
+  spindump_checktest(stats.peak[0] == 10000);
+  spindump_checktest(stats.peak[1] == 1000);
+  spindump_checktest(stats.peak[2] == 190);
+  spindump_checktest(stats.mean == 145);
+  spindump_checktest(stats.burstiness == (10000 * 100) / 145);
+
+  //
+  // Without packets, the periods that completed since the last packet
+  // count as empty: at 45 s the ring has the periods until 20 s, the
+  // period of the last packet, and one empty period
+  //
+  
+  when = start + 45 * spindump_time_nsecspersec;
+  spindump_checktest(spindump_bandwidth_seriesstats(&bandwidth,&when,&stats));
+  spindump_checktest(bandwidth.series->nSlots == 4);
+  spindump_checktest(stats.peak[0] == 10000);
+  spindump_checktest(stats.mean == 75);
+
+  //
+  // After a long pause, the ring has only empty periods, also when
+  // the pause ends with a packet. Its period is in the ring once it
+  // completes.
+  //
+  
+  when = start + 200 * spindump_time_nsecspersec;
+  spindump_checktest(spindump_bandwidth_seriesstats(&bandwidth,&when,&stats));
+  spindump_checktest(bandwidth.series->nSlots == spindump_bandwidth_series_nslots);
+  spindump_checktest(stats.peak[0] == 0);
+  spindump_checktest(stats.peak[2] == 0);
+  spindump_checktest(stats.mean == 0);
+  when = start + 300 * spindump_time_nsecspersec;
+  spindump_bandwidth_newpacket(&bandwidth,100,&when);
+  spindump_checktest(spindump_bandwidth_seriesstats(&bandwidth,&when,&stats));
+  spindump_checktest(stats.peak[0] == 0);
+  spindump_checktest(stats.mean == 0);
+  when = start + 310 * spindump_time_nsecspersec;
+  spindump_checktest(spindump_bandwidth_seriesstats(&bandwidth,&when,&stats));
+  spindump_checktest(bandwidth.series->nSlots == spindump_bandwidth_series_nslots);
+  spindump_checktest(stats.peak[0] == 1000);
+  spindump_checktest(stats.peak[2] == 10);
+  spindump_checktest(stats.mean == 1);
+  spindump_bandwidth_uninitialize(&bandwidth);
+  spindump_checktest(bandwidth.series == 0);
+}
+
+//
+// Unit tests for the capture prefilter generated from the
+// configuration
+//
+
+static void
+unittests_prefilter(void) {
+
+  printf("unit tests: prefilter...\n");
+
+  static struct spindump_main_configuration config;
+  const char* fragments = "(ip6 or ip[6:2] & 0x1fff = 0)";
+  const char* icmp =
+    "(icmp[icmptype] = icmp-echo or icmp[icmptype] = icmp-echoreply or "
+    "(icmp6 and (ip6[40] = 128 or ip6[40] = 129)))";
+  char expected[1024];
+  char* filter;
+
+  //
+  // By default, all protocols are let through, and all of UDP has to
+  // be captured, so the snaplen stays as configured
+  //
+  
+  memset(&config,0,sizeof(config));
+  config.snaplen = spindump_capture_snaplen;
+  config.prefilterProtocols = spindump_main_prefilter_all;
+  config.toolmode = spindump_toolmode_textual;
+  filter = spindump_main_prefilter_generate(&config);
+  spindump_checktest(filter != 0);
+  snprintf(expected,sizeof(expected),"%s and ((tcp) or (udp) or %s or (sctp))",fragments,icmp);
+  spindump_checktest(strcmp(filter,expected) == 0);
+  spindump_free(filter);
+  spindump_checktest(spindump_main_prefilter_snaplen(&config) == spindump_capture_snaplen);
+  
+  //
+  // A subset of protocols. The UDP-based ones are filtered by their
+  // ports, and only the headers that their analyzers need are
+  // captured.
+  //
+  
+  spindump_checktest(spindump_main_prefilter_parseprotocols("dns,icmp",&config.prefilterProtocols));
+  spindump_checktest(config.prefilterProtocols == (spindump_main_prefilter_dns | spindump_main_prefilter_icmp));
+  filter = spindump_main_prefilter_generate(&config);
+  spindump_checktest(filter != 0);
+  snprintf(expected,sizeof(expected),"%s and ((udp port 53) or %s)",fragments,icmp);
+  spindump_checktest(strcmp(filter,expected) == 0);
+  spindump_free(filter);
+  spindump_checktest(spindump_main_prefilter_snaplen(&config) == spindump_capture_snaplen);
+  spindump_checktest(spindump_main_prefilter_parseprotocols("tcp,udp,quic",&config.prefilterProtocols));
+  filter = spindump_main_prefilter_generate(&config);
+  spindump_checktest(filter != 0);
+  snprintf(expected,sizeof(expected),"%s and ((tcp) or (udp))",fragments);
+  spindump_checktest(strcmp(filter,expected) == 0);
+  spindump_free(filter);
+  spindump_checktest(!spindump_main_prefilter_parseprotocols("tcp,ip",&config.prefilterProtocols));
+  
+  //
+  // The snaplen covers the largest link layer and IP headers, and
+  // the headers of the selected protocols
+  //
+  
+  unsigned int headers = spindump_linux_sll_header_size + 60;
+  config.snaplen = 1500;
+  spindump_checktest(spindump_main_prefilter_parseprotocols("tcp",&config.prefilterProtocols));
+  spindump_checktest(spindump_main_prefilter_snaplen(&config) == headers + 60);
+  spindump_checktest(spindump_main_prefilter_parseprotocols("icmp",&config.prefilterProtocols));
+  spindump_checktest(spindump_main_prefilter_snaplen(&config) == headers + spindump_icmp_echo_header_size);
+  spindump_checktest(spindump_main_prefilter_parseprotocols("coap,icmp",&config.prefilterProtocols));
+  spindump_checktest(spindump_main_prefilter_snaplen(&config) ==
+                     headers +
+                     spindump_udp_header_size +
+                     spindump_dtls_recordlayer_header_size +
+                     spindump_dtls_handshake_header_size);
+  config.snaplen = 100;
+  spindump_checktest(spindump_main_prefilter_snaplen(&config) == 100);
+  
+  //
+  // Aggregates limit the filter only in the aggregate mode, and not
+  // if some aggregate matches everything
+  //
+  
+  config.snaplen = spindump_capture_snaplen;
+  config.prefilterProtocols = spindump_main_prefilter_icmp;
+  config.nAggregates = 2;
+  config.aggregates[0].side1ishost = 1;
+  config.aggregates[0].side2type = network;
+  spindump_address_fromstring(&config.aggregates[0].side1address,"10.0.0.1");
+  spindump_network_fromstring(&config.aggregates[0].side2network,"192.168.1.0/24");
+  config.aggregates[1].side1ishost = 0;
+  config.aggregates[1].side2type = multinet;
+  spindump_network_fromstring(&config.aggregates[1].side1network,"2001:db8::/32");
+  config.nAggrnetws = 2;
+  config.aggrnetws[0].aggregate = &config.aggregates[1];
+  spindump_network_fromstring(&config.aggrnetws[0].network,"2001:db8:1::/48");
+  config.aggrnetws[1].aggregate = &config.aggregates[1];
+  spindump_network_fromstring(&config.aggrnetws[1].network,"::/0");
+  filter = spindump_main_prefilter_generate(&config);
+  spindump_checktest(filter != 0);
+  snprintf(expected,sizeof(expected),"%s and (%s)",fragments,icmp);
+  spindump_checktest(strcmp(filter,expected) == 0);
+  spindump_free(filter);
+  config.aggregateMode = 1;
+  filter = spindump_main_prefilter_generate(&config);
+  spindump_checktest(filter != 0);
+  snprintf(expected,sizeof(expected),
+           "%s and (%s) and "
+           "(((host 10.0.0.1) and (net 192.168.1.0/24)) or "
+           "((net 2001:db8::/32) and (net 2001:db8:1::/48 or ip6)))",
+           fragments,icmp);
+  spindump_checktest(strcmp(filter,expected) == 0);
+  spindump_free(filter);
+  config.aggregates[0].defaultMatch = 1;
+  filter = spindump_main_prefilter_generate(&config);
+  spindump_checktest(filter != 0);
+  snprintf(expected,sizeof(expected),"%s and (%s)",fragments,icmp);
+  spindump_checktest(strcmp(filter,expected) == 0);
+  spindump_free(filter);
+  spindump_checktest(spindump_main_prefilter_snaplen(&config) == headers + spindump_icmp_echo_header_size);
+}
+
 //
 // Unit tests for the QUIC parser
 //
@@ -237,9 +1047,8 @@ unittests_table(void) {
   spindump_address_fromstring(&address1,"127.0.0.1");
   spindump_address address2;
   spindump_address_fromstring(&address2,"127.0.0.2");
-  struct timeval when1;
-  when1.tv_sec = 17;
-  when1.tv_usec = 900 * 1000;
+  spindump_time when1;
+  when1 = 17 * spindump_time_nsecspersec + 900 * 1000 * spindump_time_nsecsperusec;
   struct spindump_connection* connection1 =
     spindump_connections_newconnection_icmp(&address1,
                                             &address2,
@@ -413,6 +1222,156 @@ unittests_table(void) {
   spindump_checktest(connection8 != 0);
   spindump_checktest(fromResponder == 0);
   spindump_checktest(connection8 == connection6);
+
+  //
+  // Search for the QUIC connection through the connection ID index:
+  // in reverse, by destination CID only, and by partial CIDs
+  // followed by other bytes, as in short header packets
+  //
+
+  spindump_checktest(spindump_connections_searchconnection_quic_cids_either(&cid2,&cid1,table,&fromResponder) == connection6);
+  spindump_checktest(fromResponder == 1);
+  spindump_checktest(spindump_connections_searchconnection_quic_destcid(&cid2,table) == 0);
+  spindump_checktest(spindump_connections_searchconnection_quic_destcid(&cid1,table) == connection6);
+  unsigned char partial[spindump_connectionstable_cidindex_maxlen];
+  memset(partial,0x77,sizeof(partial));
+  memcpy(partial,cid1.id,cid1.len);
+  spindump_checktest(spindump_connections_searchconnection_quic_partialcid_either(partial,table,&fromResponder) == connection6);
+  spindump_checktest(fromResponder == 0);
+  memset(partial,0x77,sizeof(partial));
+  memcpy(partial,cid2.id,cid2.len);
+  spindump_checktest(spindump_connections_searchconnection_quic_partialcid_either(partial,table,&fromResponder) == connection6);
+  spindump_checktest(fromResponder == 1);
+  partial[0] = 0x77;
+  spindump_checktest(spindump_connections_searchconnection_quic_partialcid_either(partial,table,&fromResponder) == 0);
+
+  //
+  // Change a CID and make sure the index follows
+  //
+
+  struct spindump_quic_connectionid cid3 = cid1;
+  cid3.len = 5;
+  cid3.id[0] = 99;
+  cid3.id[4] = 5;
+  connection6->u.quic.peer2ConnectionID = cid3;
+  spindump_connectionstable_cidindex_update(table,connection6);
+  spindump_checktest(spindump_connections_searchconnection_quic_destcid(&cid1,table) == 0);
+  spindump_checktest(spindump_connections_searchconnection_quic_destcid(&cid3,table) == connection6);
+  spindump_checktest(spindump_connections_searchconnection_quic_partialcid(cid3.id,table) == connection6);
+  spindump_checktest(spindump_connections_searchconnection_quic_partialcid(cid1.id,table) == 0);
+
+  //
+  // Search for TCP and UDP connections through the table index, in
+  // both directions, and enough of them to make the index grow
+  //
+
+  struct spindump_connection* connection9 =
+    spindump_connections_newconnection_tcp(&address1,&address2,5000,80,&when1,table);
+  spindump_checktest(connection9 != 0);
+  spindump_checktest(spindump_connections_searchconnection_tcp(&address1,&address2,5000,80,table) == connection9);
+  spindump_checktest(spindump_connections_searchconnection_tcp(&address2,&address1,80,5000,table) == 0);
+  spindump_checktest(spindump_connections_searchconnection_udp(&address1,&address2,5000,80,table) == 0);
+  spindump_checktest(spindump_connections_searchconnection_tcp_either(&address2,&address1,80,5000,table,&fromResponder) == connection9);
+  spindump_checktest(fromResponder == 1);
+
+  unsigned int nUdp = 3 * spindump_connectionstable_index_defaultsize;
+  for (unsigned int i = 0; i < nUdp; i++) {
+    spindump_checktest(spindump_connections_newconnection_udp(&address1,&address2,(spindump_port)(10000+i),53,&when1,table) != 0);
+  }
+  spindump_checktest(table->nIndexBuckets > spindump_connectionstable_index_defaultsize);
+  for (unsigned int i = 0; i < nUdp; i += 97) {
+    struct spindump_connection* connection10 =
+      spindump_connections_searchconnection_udp_either(&address2,&address1,53,(spindump_port)(10000+i),table,&fromResponder);
+    spindump_checktest(connection10 != 0);
+    spindump_checktest(connection10->u.udp.side1peerPort == 10000+i);
+    spindump_checktest(fromResponder == 1);
+  }
+
+  //
+  // Add new connections to aggregates through the aggregate index; a
+  // default match aggregate is used only when no other one matches
+  //
+
+  spindump_network network1;
+  spindump_network network2;
+  spindump_network network3;
+  spindump_network network4;
+  spindump_network_fromstring(&network1,"10.1.0.0/16");
+  spindump_network_fromstring(&network2,"192.168.0.0/16");
+  spindump_network_fromstring(&network3,"10.0.0.0/8");
+  spindump_network_fromstring(&network4,"0.0.0.0/0");
+  struct spindump_connection* aggregate1 =
+    spindump_connections_newconnection_aggregate_networknetwork(0,&network1,&network2,&when1,1,table);
+  struct spindump_connection* aggregate2 =
+    spindump_connections_newconnection_aggregate_networknetwork(1,&network3,&network4,&when1,1,table);
+  spindump_checktest(aggregate1 != 0);
+  spindump_checktest(aggregate2 != 0);
+  spindump_address address6;
+  spindump_address address7;
+  spindump_address address8;
+  spindump_address_fromstring(&address6,"10.1.2.3");
+  spindump_address_fromstring(&address7,"192.168.1.1");
+  spindump_address_fromstring(&address8,"10.2.3.4");
+  struct spindump_connection* connection11 =
+    spindump_connections_newconnection_udp(&address7,&address6,5000,53,&when1,table);
+  spindump_checktest(connection11 != 0);
+  spindump_checktest(connection11->aggregates.nConnections == 1);
+  spindump_checktest(spindump_connections_set_inset(&connection11->aggregates,aggregate1));
+  struct spindump_connection* connection12 =
+    spindump_connections_newconnection_udp(&address8,&address7,5000,53,&when1,table);
+  spindump_checktest(connection12 != 0);
+  spindump_checktest(connection12->aggregates.nConnections == 1);
+  spindump_checktest(spindump_connections_set_inset(&connection12->aggregates,aggregate2));
+  
+  struct spindump_connection** candidates;
+  spindump_checktest(spindump_connectionstable_aggregates_find(table,&address6,&address7,&candidates) == 2);
+  spindump_checktest(candidates[0] == aggregate1);
+  spindump_checktest(candidates[1] == aggregate2);
+  spindump_connectionstable_aggregates_remove(table,aggregate1);
+  spindump_checktest(spindump_connectionstable_aggregates_find(table,&address6,&address7,&candidates) == 1);
+  spindump_checktest(candidates[0] == aggregate2);
+  spindump_checktest(spindump_connectionstable_aggregates_find(table,&address1,&address2,&candidates) == 1);
+  spindump_connectionstable_aggregates_remove(table,aggregate2);
+  spindump_checktest(spindump_connectionstable_aggregates_find(table,&address6,&address7,&candidates) == 0);
+  
+  //
+  // Connection sets keep their order over removals and growth
+  //
+
+  static struct spindump_connection members[40];
+  struct spindump_connection_set set;
+  spindump_connections_set_initialize(&set);
+  unsigned int nAdded = 0;
+  for (unsigned int i = 0; i < 40; i++) nAdded += (unsigned int)spindump_connections_set_add(&set,&members[i]);
+  spindump_checktest(nAdded == 40);
+  spindump_checktest(set.nConnections == 40);
+  for (unsigned int i = 0; i < 40; i += 3) spindump_connections_set_remove(&set,&members[i]);
+  spindump_checktest(set.nConnections == 26);
+  for (unsigned int i = 0; i < 40; i++) {
+    spindump_checktest(spindump_connections_set_inset(&set,&members[i]) == (i % 3 != 0));
+  }
+  struct spindump_connection_set_iterator iter;
+  unsigned int previous = 0;
+  unsigned int seen = 0;
+  for (spindump_connection_set_iterator_initialize(&set,&iter);
+       !spindump_connection_set_iterator_end(&iter);
+       ) {
+    struct spindump_connection* member = spindump_connection_set_iterator_next(&iter);
+    unsigned int index = (unsigned int)(member - members);
+    spindump_checktest(seen == 0 || index > previous);
+    spindump_checktest(index % 3 != 0);
+    if (index % 2 == 0) spindump_connections_set_remove(&set,member);
+    previous = index;
+    seen++;
+  }
+  spindump_connection_set_iterator_uninitialize(&iter);
+  spindump_checktest(seen == 26);
+  spindump_checktest(set.nConnections == 13);
+  for (unsigned int i = 0; i < 40; i++) {
+    if (spindump_connections_set_inset(&set,&members[i])) spindump_connections_set_remove(&set,&members[i]);
+  }
+  spindump_checktest(set.nConnections == 0);
+  spindump_connections_set_uninitialize(&set,0);
   
   spindump_connectionstable_uninitialize(table);
 }
@@ -484,6 +1443,25 @@ unittests_eventjsonparser_callback(const struct spindump_json_value* value,
   parsedRecord = spindump_json_value_copy(value);
 }
 
+//
+// Helper function for systemtests; a handler that counts the number
+// of times it has been called.
+//
+
+static void
+systemtests_counthandler(struct spindump_analyze* state,
+                         void* handlerData,
+                         void** handlerConnectionData,
+                         spindump_analyze_event event,
+                         const spindump_time* timestamp,
+                         const int fromResponder,
+                         const unsigned int ipPacketLength,
+                         struct spindump_packet* packet,
+                         struct spindump_connection* connection) {
+  unsigned int* calls = (unsigned int*)handlerData;
+  (*calls)++;
+}
+
 //
 // Unittests -- spindump_event_parser_text
 //
@@ -571,6 +1549,99 @@ unittests_eventjsonparser(void) {
   spindump_assert(json->type == spindump_json_value_type_record);
   ret = spindump_event_parser_json_parse(json,&event2);
   spindump_assert(ret == 1);
+
+  //
+  // Print a capture event, parse it back, and see if we get the
+  // same event
+  //
+
+  struct spindump_event_capture capture;
+  capture.receivedFrames = 1045;
+  capture.kernelDrops = 12;
+  capture.interfaceDrops = 0;
+  capture.ringOverflows = 3;
+  spindump_event_initialize_capture(timestamp,&capture,&event1);
+  ret = spindump_event_printer_json_print(&event1,buf,sizeof(buf),&consumed);
+  spindump_assert(ret == 1);
+  const char* expectedCapture =
+    "{ \"Event\": \"capture\", \"Ts\": 1892188800001234, \"Received\": 1045, "
+    "\"Kernel_drops\": 12, \"Interface_drops\": 0, \"Ring_overflows\": 3 }";
+  spindump_assert(strcmp(buf,expectedCapture) == 0);
+  input = &buf[0];
+  ret = spindump_json_parse(&eventschema,0,&input);
+  spindump_assert(ret == 1);
+  json = parsedRecord;
+  spindump_assert(json != 0);
+  ret = spindump_event_parser_json_parse(json,&event2);
+  spindump_assert(ret == 1);
+  spindump_assert(spindump_event_equal(&event1,&event2));
+
+  //
+  // Print a periodic event with an RTT histogram, parse it back, and
+  // see if we get the same event
+  //
+
+  spindump_event_initialize(spindump_event_type_periodic,
+                            spindump_connection_transport_tcp,
+                            0,
+                            spindump_connection_state_established,
+                            &network1,
+                            &network2,
+                            "123:456",
+                            timestamp,
+                            1,
+                            1,
+                            2,
+                            3,
+                            1000,
+                            1000,
+                            0,
+                            0,
+                            &event1);
+  event1.u.periodic.rttRight = 20000;
+  event1.u.periodic.avgRttRight = 21000;
+  event1.u.periodic.devRttRight = 500;
+  event1.u.periodic.p50RttRight = 0;
+  event1.u.periodic.p95RttRight = 0;
+  event1.u.periodic.p99RttRight = 0;
+  event1.u.periodic.histRight.precision = 3;
+  event1.u.periodic.histRight.nBins = 3;
+  event1.u.periodic.histRight.indexes[0] = 100;
+  event1.u.periodic.histRight.counts[0] = 7;
+  event1.u.periodic.histRight.indexes[1] = 101;
+  event1.u.periodic.histRight.counts[1] = 1;
+  event1.u.periodic.histRight.indexes[2] = 120;
+  event1.u.periodic.histRight.counts[2] = 2;
+  event1.u.periodic.sketchRight.offset = 230;
+  event1.u.periodic.sketchRight.zeroCount = 1;
+  event1.u.periodic.sketchRight.nBins = 2;
+  event1.u.periodic.sketchRight.indexes[0] = 0;
+  event1.u.periodic.sketchRight.counts[0] = 8;
+  event1.u.periodic.sketchRight.indexes[1] = 5;
+  event1.u.periodic.sketchRight.counts[1] = 2;
+  event1.u.periodic.bwSeries2.peak[0] = 14280;
+  event1.u.periodic.bwSeries2.peak[1] = 1428;
+  event1.u.periodic.bwSeries2.peak[2] = 1142;
+  event1.u.periodic.bwSeries2.mean = 1142;
+  event1.u.periodic.bwSeries2.burstiness = 1250;
+  char periodicBuf[600];
+  ret = spindump_event_printer_json_print(&event1,periodicBuf,sizeof(periodicBuf),&consumed);
+  spindump_assert(ret == 1);
+  spindump_assert(strstr(periodicBuf,
+                         "\"Hist_precision\": 3, \"Hist_right_rtt\": [[100,7],[101,1],[120,2]]") != 0);
+  spindump_assert(strstr(periodicBuf,
+                         "\"Sketch_offset\": 230, \"Sketch_zero\": 1, \"Sketch_right_rtt\": [[0,8],[5,2]]") != 0);
+  spindump_assert(strstr(periodicBuf,
+                         "\"Peak_bw2\": [14280,1428,1142], \"Mean_bw2\": 1142, \"Burst2\": 1250") != 0);
+  spindump_assert(strstr(periodicBuf,"Peak_bw1") == 0);
+  input = &periodicBuf[0];
+  ret = spindump_json_parse(&eventschema,0,&input);
+  spindump_assert(ret == 1);
+  json = parsedRecord;
+  spindump_assert(json != 0);
+  ret = spindump_event_parser_json_parse(json,&event2);
+  spindump_assert(ret == 1);
+  spindump_assert(spindump_event_equal(&event1,&event2));
 }
 
 //
@@ -812,7 +1883,7 @@ systemtests(void) {
     0x5c, 0x4a, 0xb5, 0x1d, 0x00, 0x0d, 0x47, 0x6c
   };
   
-  packet1.timestamp.tv_usec = 0;
+  packet1.timestamp = 0;
   packet1.contents = packet1bytes;
   packet1.etherlen = sizeof(packet1bytes);
   packet1.caplen = packet1.etherlen;
@@ -839,7 +1910,7 @@ systemtests(void) {
     0xb4, 0xee, 0x00, 0x00,
     0x5c, 0x4a, 0xb5, 0x1d, 0x00, 0x0d, 0x47, 0x6c
   };
-  packet2.timestamp.tv_usec = 1;
+  packet2.timestamp = 1 * spindump_time_nsecsperusec;
   packet2.contents = packet2bytes;
   packet2.etherlen = sizeof(packet2bytes);
   packet2.caplen = packet2.etherlen;
@@ -853,8 +1924,11 @@ systemtests(void) {
   spindump_checktest(connection1->packetsFromSide2 == 1);
   spindump_checktest(connection1->bytesFromSide1.bytes == sizeof(packet1bytes) - spindump_ethernet_header_size);
   spindump_checktest(connection1->bytesFromSide2.bytes == sizeof(packet2bytes) - spindump_ethernet_header_size);
-  spindump_checktest(connection1->leftRTT.lastRTT == spindump_rtt_infinite);
-  spindump_checktest(connection1->rightRTT.lastRTT == 1);
+  spindump_checktest(spindump_connections_rtt(connection1->leftRTT)->lastRTT == spindump_rtt_infinite);
+  spindump_checktest(spindump_connections_rtt(connection1->rightRTT)->lastRTT == 1);
+  spindump_checktest(connection1->leftRTT == 0);
+  spindump_checktest(connection1->rightRTT != 0);
+  spindump_checktest(connection1->u.icmp.trackers != 0);
   
   //
   // Analyzer tests -- ICMP in the other direction (side 2 being the initiator)
@@ -879,7 +1953,7 @@ systemtests(void) {
     0x5c, 0x4a, 0xb5, 0x1d, 0x00, 0x0d, 0x47, 0x6c
   };
   
-  packet3.timestamp.tv_usec = 0;
+  packet3.timestamp = 0;
   packet3.contents = packet3bytes;
   packet3.etherlen = sizeof(packet3bytes);
   packet3.caplen = packet3.etherlen;
@@ -907,7 +1981,7 @@ systemtests(void) {
     0xb4, 0xee, 0x00, 0x00,
     0x5c, 0x4a, 0xb5, 0x1d, 0x00, 0x0d, 0x47, 0x6c
   };
-  packet4.timestamp.tv_usec = 1;
+  packet4.timestamp = 1 * spindump_time_nsecsperusec;
   packet4.contents = packet4bytes;
   packet4.etherlen = sizeof(packet4bytes);
   packet4.caplen = packet4.etherlen;
@@ -927,8 +2001,8 @@ systemtests(void) {
   spindump_checktest(connection2->packetsFromSide2 == 1);
   spindump_checktest(connection2->bytesFromSide1.bytes == sizeof(packet3bytes) - spindump_ethernet_header_size);
   spindump_checktest(connection2->bytesFromSide2.bytes == sizeof(packet4bytes) - spindump_ethernet_header_size);
-  spindump_checktest(connection2->leftRTT.lastRTT == spindump_rtt_infinite);
-  spindump_checktest(connection2->rightRTT.lastRTT == 1);
+  spindump_checktest(spindump_connections_rtt(connection2->leftRTT)->lastRTT == spindump_rtt_infinite);
+  spindump_checktest(spindump_connections_rtt(connection2->rightRTT)->lastRTT == 1);
   
   //
   // Analyzer tests -- DNS
@@ -954,7 +2028,7 @@ systemtests(void) {
     0x01
   };
   
-  packet5.timestamp.tv_usec = 0;
+  packet5.timestamp = 0;
   packet5.contents = packet5bytes;
   packet5.etherlen = sizeof(packet5bytes);
   packet5.caplen = packet5.etherlen;
@@ -985,7 +2059,7 @@ systemtests(void) {
     0x00, 0x00, 0x12, 0x00, 0x04, 0x97, 0x65, 0xc1, 0x43, 0xc0, 0x0c, 0x00, 0x01, 0x00, 0x01, 0x00,
     0x00, 0x00, 0x12, 0x00, 0x04, 0x97, 0x65, 0x41, 0x43
   };
-  packet6.timestamp.tv_usec = 1;
+  packet6.timestamp = 1 * spindump_time_nsecsperusec;
   packet6.contents = packet6bytes;
   packet6.etherlen = sizeof(packet6bytes);
   packet6.caplen = packet6.etherlen;
@@ -999,8 +2073,8 @@ systemtests(void) {
   spindump_checktest(connection3->packetsFromSide2 == 1);
   spindump_checktest(connection3->bytesFromSide1.bytes == sizeof(packet5bytes) - spindump_ethernet_header_size);
   spindump_checktest(connection3->bytesFromSide2.bytes == sizeof(packet6bytes) - spindump_ethernet_header_size);
-  spindump_checktest(connection3->leftRTT.lastRTT == spindump_rtt_infinite);
-  spindump_checktest(connection3->rightRTT.lastRTT == 1);
+  spindump_checktest(spindump_connections_rtt(connection3->leftRTT)->lastRTT == spindump_rtt_infinite);
+  spindump_checktest(spindump_connections_rtt(connection3->rightRTT)->lastRTT == 1);
   
   //
   // Analyzer tests -- DNS from the other direction
@@ -1026,7 +2100,7 @@ systemtests(void) {
     0x01
   };
   
-  packet7.timestamp.tv_usec = 0;
+  packet7.timestamp = 0;
   packet7.contents = packet7bytes;
   packet7.etherlen = sizeof(packet7bytes);
   packet7.caplen = packet7.etherlen;
@@ -1058,7 +2132,7 @@ systemtests(void) {
     0x00, 0x00, 0x12, 0x00, 0x04, 0x97, 0x65, 0xc1, 0x43, 0xc0, 0x0c, 0x00, 0x01, 0x00, 0x01, 0x00,
     0x00, 0x00, 0x12, 0x00, 0x04, 0x97, 0x65, 0x41, 0x43
   };
-  packet8.timestamp.tv_usec = 1;
+  packet8.timestamp = 1 * spindump_time_nsecsperusec;
   packet8.contents = packet8bytes;
   packet8.etherlen = sizeof(packet8bytes);
   packet8.caplen = packet8.etherlen;
@@ -1073,8 +2147,8 @@ systemtests(void) {
   spindump_checktest(connection4->packetsFromSide2 == 1);
   spindump_checktest(connection4->bytesFromSide1.bytes == sizeof(packet7bytes) - spindump_ethernet_header_size);
   spindump_checktest(connection4->bytesFromSide2.bytes == sizeof(packet8bytes) - spindump_ethernet_header_size);
-  spindump_checktest(connection4->leftRTT.lastRTT == spindump_rtt_infinite);
-  spindump_checktest(connection4->rightRTT.lastRTT == 1);
+  spindump_checktest(spindump_connections_rtt(connection4->leftRTT)->lastRTT == spindump_rtt_infinite);
+  spindump_checktest(spindump_connections_rtt(connection4->rightRTT)->lastRTT == 1);
 
   //
   // Analyzer tests -- capture length being first not the whole packet
@@ -1087,7 +2161,7 @@ systemtests(void) {
   
   spindump_checktest(spindump_analyze_getstats(analyzer)->notEnoughPacketForIpHdr == 0);
   
-  packet9.timestamp.tv_usec = 0;
+  packet9.timestamp = 0;
   packet9.contents = packet1bytes;
   packet9.etherlen = sizeof(packet1bytes);
   packet9.caplen = packet1.etherlen - 4; // miss the last bytes of the ICMPv6, should not matter
@@ -1096,7 +2170,7 @@ systemtests(void) {
   spindump_checktest(connection5 != 0);
 
   connection5 = 0;
-  packet9.timestamp.tv_usec = 0;
+  packet9.timestamp = 0;
   packet9.contents = packet1bytes;
   packet9.etherlen = sizeof(packet1bytes);
   packet9.caplen = packet1.etherlen - 20; // miss plenty, including some of the IPv6 header, should be an error
@@ -1126,7 +2200,7 @@ systemtests(void) {
   memset(&packet10, 0, sizeof(packet10));
   connection5 = 0;
 
-  packet10.timestamp.tv_usec = 0;
+  packet10.timestamp = 0;
   packet10.contents = bytesheap;
   packet10.etherlen = sizeof(shortipv4packetbytes);
   packet10.caplen = packet10.etherlen;
@@ -1151,7 +2225,7 @@ systemtests(void) {
 
   memset(&packet10, 0, sizeof(packet10));
   connection5 = 0;
-  packet10.timestamp.tv_usec = 0;
+  packet10.timestamp = 0;
   packet10.contents = bytesheap;
   packet10.etherlen = sizeof(shortipv6packetbytes);
   packet10.caplen = packet10.etherlen;
@@ -1168,7 +2242,7 @@ systemtests(void) {
   //
   
   connection5 = 0;
-  packet9.timestamp.tv_usec = 0;
+  packet9.timestamp = 0;
   packet9.contents = packet1bytes;
   packet9.etherlen = 12; // miss plenty, including all of IP and some of Ethernet header
   packet9.caplen = packet9.etherlen; 
@@ -1178,7 +2252,7 @@ systemtests(void) {
   spindump_checktest(spindump_analyze_getstats(analyzer)->notEnoughPacketForEthernetHdr == 1);
   
   connection5 = 0;
-  packet9.timestamp.tv_usec = 0;
+  packet9.timestamp = 0;
   packet9.contents = packet1bytes;
   packet9.etherlen = packet1.etherlen;
   packet9.caplen = 56; // include just two bytes of the ICMP part (14+40=54)
@@ -1188,7 +2262,7 @@ systemtests(void) {
   spindump_checktest(spindump_analyze_getstats(analyzer)->notEnoughPacketForIcmpHdr == 1);
   
   connection5 = 0;
-  packet9.timestamp.tv_usec = 0;
+  packet9.timestamp = 0;
   packet9.contents = packet1bytes;
   packet9.etherlen = packet1.etherlen;
   packet9.caplen = 58; // include ICMP header but no other parts (14+40=54)
@@ -1197,6 +2271,121 @@ systemtests(void) {
   spindump_checktest(connection5 == 0);
   spindump_checktest(spindump_analyze_getstats(analyzer)->notEnoughPacketForIcmpHdr == 2);
 
+  //
+  // Timeouts -- an inactive connection is deleted only when its
+  // timeout has passed, and a connection marked deleted sooner
+  //
+
+  spindump_address address1;
+  spindump_address address2;
+  spindump_address_fromstring(&address1,"10.0.0.1");
+  spindump_address_fromstring(&address2,"10.0.0.2");
+  spindump_time when;
+  when = 2000000000 * spindump_time_nsecspersec + 500000 * spindump_time_nsecsperusec;
+  struct spindump_connection* connection6 =
+    spindump_connections_newconnection_udp(&address1,&address2,1000,2000,&when,analyzer->table);
+  struct spindump_connection* connection7 =
+    spindump_connections_newconnection_udp(&address1,&address2,1001,2000,&when,analyzer->table);
+  spindump_checktest(connection6 != 0 && connection7 != 0);
+  spindump_connections_changestate(analyzer,&packet1,&when,connection6,spindump_connection_state_established);
+  spindump_connections_changestate(analyzer,&packet1,&when,connection7,spindump_connection_state_established);
+  spindump_connections_markconnectiondeleted(connection7);
+  spindump_connectionstable_updatetimeout(analyzer->table,connection6);
+  spindump_connectionstable_updatetimeout(analyzer->table,connection7);
+  when += 10 * spindump_time_nsecspersec;
+  spindump_connectionstable_periodiccheck(analyzer->table,&when,analyzer,0);
+  spindump_checktest(spindump_connections_searchconnection_udp(&address1,&address2,1000,2000,analyzer->table) == connection6);
+  spindump_checktest(spindump_connections_searchconnection_udp(&address1,&address2,1001,2000,analyzer->table) == 0);
+  when += 170 * spindump_time_nsecspersec - 100000 * spindump_time_nsecsperusec;
+  spindump_connectionstable_periodiccheck(analyzer->table,&when,analyzer,0);
+  spindump_checktest(spindump_connections_searchconnection_udp(&address1,&address2,1000,2000,analyzer->table) == connection6);
+  when += 1 * spindump_time_nsecspersec;
+  spindump_connectionstable_periodiccheck(analyzer->table,&when,analyzer,0);
+  spindump_checktest(spindump_connections_searchconnection_udp(&address1,&address2,1000,2000,analyzer->table) == 0);
+
+  //
+  // Eviction -- over the limits, establishing connections are evicted
+  // first, then closed ones, and then the least recently active ones.
+  // Manually created aggregates are never evicted.
+  //
+
+  struct spindump_analyze* evictor = spindump_analyze_initialize(0,0,1000000,0,0);
+  spindump_checktest(evictor != 0);
+  struct spindump_connectionstable* evictionTable = evictor->table;
+  struct spindump_stats* evictionStats = spindump_analyze_getstats(evictor);
+  spindump_network evictionNetwork;
+  spindump_network_fromstring(&evictionNetwork,"10.0.0.0/8");
+  struct spindump_connection* aggregate =
+    spindump_connections_newconnection_aggregate_networknetwork(0,&evictionNetwork,&evictionNetwork,&when,1,evictionTable);
+  struct spindump_connection* connection8 =
+    spindump_connections_newconnection_udp(&address1,&address2,3000,2000,&when,evictionTable);
+  struct spindump_connection* connection9 =
+    spindump_connections_newconnection_udp(&address1,&address2,3001,2000,&when,evictionTable);
+  struct spindump_connection* connection10 =
+    spindump_connections_newconnection_udp(&address1,&address2,3002,2000,&when,evictionTable);
+  struct spindump_connection* connection11 =
+    spindump_connections_newconnection_udp(&address1,&address2,3003,2000,&when,evictionTable);
+  spindump_checktest(aggregate != 0 && connection8 != 0 && connection9 != 0 && connection10 != 0 && connection11 != 0);
+  spindump_connections_changestate(evictor,&packet1,&when,connection8,spindump_connection_state_established);
+  spindump_connections_changestate(evictor,&packet1,&when,connection9,spindump_connection_state_established);
+  spindump_connections_changestate(evictor,&packet1,&when,connection10,spindump_connection_state_established);
+  spindump_connections_markconnectiondeleted(connection9);
+  spindump_connectionstable_eviction_touch(evictionTable,connection9);
+  spindump_connectionstable_eviction_touch(evictionTable,connection10);
+  spindump_connectionstable_eviction_touch(evictionTable,connection8);
+  spindump_connectionstable_eviction_setlimits(evictionTable,4,0);
+  spindump_checktest(spindump_connectionstable_eviction_enforce(evictionTable,evictor,0) == 1);
+  spindump_checktest(spindump_connections_searchconnection_udp(&address1,&address2,3003,2000,evictionTable) == 0);
+  spindump_checktest(evictionStats->connectionsEvictedEstablishing == 1);
+  spindump_connectionstable_eviction_setlimits(evictionTable,2,0);
+  spindump_checktest(spindump_connectionstable_eviction_enforce(evictionTable,evictor,0) == 2);
+  spindump_checktest(spindump_connections_searchconnection_udp(&address1,&address2,3000,2000,evictionTable) == connection8);
+  spindump_checktest(spindump_connections_searchconnection_udp(&address1,&address2,3001,2000,evictionTable) == 0);
+  spindump_checktest(spindump_connections_searchconnection_udp(&address1,&address2,3002,2000,evictionTable) == 0);
+  spindump_checktest(evictionStats->connectionsEvictedClosed == 1);
+  spindump_checktest(evictionStats->connectionsEvictedActive == 1);
+  spindump_connectionstable_eviction_setlimits(evictionTable,0,1);
+  spindump_checktest(spindump_connectionstable_eviction_enforce(evictionTable,evictor,0) == 1);
+  spindump_checktest(spindump_connections_searchconnection_udp(&address1,&address2,3000,2000,evictionTable) == 0);
+  spindump_checktest(evictionTable->connections[aggregate->tableIndex] == aggregate);
+  spindump_analyze_uninitialize(evictor);
+  
+  //
+  // Handlers -- global handlers are called for all connections, and
+  // connection-specific handlers only for the connections they have
+  // been registered for
+  //
+
+  struct spindump_analyze* dispatcher = spindump_analyze_initialize(0,0,1000000,0,0);
+  spindump_checktest(dispatcher != 0);
+  struct spindump_connectionstable* dispatchTable = dispatcher->table;
+  unsigned int globalCalls = 0;
+  unsigned int specificCalls = 0;
+  struct spindump_connection* connection12 =
+    spindump_connections_newconnection_udp(&address1,&address2,4000,2000,&when,dispatchTable);
+  struct spindump_connection* connection13 =
+    spindump_connections_newconnection_udp(&address1,&address2,4001,2000,&when,dispatchTable);
+  spindump_checktest(connection12 != 0 && connection13 != 0);
+  spindump_analyze_event specificEvents = spindump_analyze_event_newpacket | spindump_analyze_event_statechange;
+  spindump_analyze_registerhandler(dispatcher,spindump_analyze_event_newpacket,0,systemtests_counthandler,&globalCalls);
+  spindump_analyze_registerhandler(dispatcher,specificEvents,connection12,systemtests_counthandler,&specificCalls);
+  spindump_analyze_registerhandler(dispatcher,specificEvents,connection13,systemtests_counthandler,&specificCalls);
+  spindump_checktest(dispatcher->nHandlers == 2);
+  spindump_analyze_process_handlers(dispatcher,spindump_analyze_event_newpacket,&when,0,0,0,connection12);
+  spindump_checktest(globalCalls == 1 && specificCalls == 1);
+  spindump_analyze_process_handlers(dispatcher,spindump_analyze_event_statechange,&when,0,0,0,connection13);
+  spindump_checktest(globalCalls == 1 && specificCalls == 2);
+  spindump_analyze_unregisterhandler(dispatcher,specificEvents,connection12,systemtests_counthandler,&specificCalls);
+  spindump_analyze_process_handlers(dispatcher,spindump_analyze_event_newpacket,&when,0,0,0,connection12);
+  spindump_checktest(globalCalls == 2 && specificCalls == 2);
+  spindump_analyze_process_handlers(dispatcher,spindump_analyze_event_newpacket,&when,0,0,0,connection13);
+  spindump_checktest(globalCalls == 3 && specificCalls == 3);
+  spindump_connectionstable_deleteconnection(connection13,dispatchTable,dispatcher,"test",0);
+  spindump_checktest(dispatcher->nHandlers == 1);
+  spindump_analyze_unregisterhandler(dispatcher,spindump_analyze_event_newpacket,0,systemtests_counthandler,&globalCalls);
+  spindump_checktest(dispatcher->nHandlers == 0);
+  spindump_analyze_uninitialize(dispatcher);
+  
   //
   // Cleanup
   //
@@ -38,6 +38,14 @@ rm -f $debugfile
 #
 
 traces="trace_icmpv4_short
+        trace_file_pcap_swapped
+        trace_file_pcap_nano
+        trace_file_pcapng_epb
+        trace_file_pcapng_pb
+        trace_file_pcapng_spb
+        trace_file_pcapng_tsresol
+        trace_file_pcapng_truncated
+        trace_file_pcapng_corrupt
         trace_icmpv6_short
         trace_dns_simple
         trace_dns
@@ -60,6 +68,9 @@ traces="trace_icmpv4_short
         trace_cmd_aggregate_regular
         trace_cmd_aggregate_default
         trace_cmd_aggregate_multinet
+        trace_cmd_threads_aggregate
+        trace_cmd_threads_aggregate_members
+        trace_cmd_threads_flows
         trace_tcp_short
         trace_tcp_short_qlog
         trace_tcp_short_json trace_dns
@@ -34,7 +34,7 @@ void
 spindump_delaybittracker_observeandcalculatertt(struct spindump_analyze* state,
                                                 struct spindump_packet* packet,
                                                 struct spindump_connection* connection,
-                                                struct timeval* ts,
+                                                spindump_time* ts,
                                                 int fromResponder,
                                                 unsigned int ipPacketLength,
                                                 spindump_extrameas_int extrameasbits) {
@@ -52,11 +52,11 @@ spindump_delaybittracker_observeandcalculatertt(struct spindump_analyze* state,
   struct spindump_delaybittracker* tracker;
   struct spindump_delaybittracker* otherTracker;
   if (fromResponder) {
-    tracker = &connection->u.quic.delaybitFromPeer2to1;
-    otherTracker = &connection->u.quic.delaybitFromPeer1to2;
+    tracker = &connection->u.quic.trackers->delaybitFromPeer2to1;
+    otherTracker = &connection->u.quic.trackers->delaybitFromPeer1to2;
   } else {
-    tracker = &connection->u.quic.delaybitFromPeer1to2;
-    otherTracker = &connection->u.quic.delaybitFromPeer2to1;
+    tracker = &connection->u.quic.trackers->delaybitFromPeer1to2;
+    otherTracker = &connection->u.quic.trackers->delaybitFromPeer2to1;
   }
 
   //
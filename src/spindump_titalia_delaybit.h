@@ -37,7 +37,7 @@ void
 spindump_delaybittracker_observeandcalculatertt(struct spindump_analyze* state,
                                                 struct spindump_packet* packet,
                                                 struct spindump_connection* connection,
-                                                struct timeval* ts,
+                                                spindump_time* ts,
                                                 int fromResponder,
                                                 unsigned int ipPacketLength,
                                                 spindump_extrameas_int extrameasbits);
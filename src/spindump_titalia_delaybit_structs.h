@@ -38,7 +38,7 @@
 //
 
 struct spindump_delaybittracker {
-  struct timeval lastDelaySample;
+  spindump_time lastDelaySample;
 };
 
 #endif //SPINDUMP_SPINDUMP_DELAYBIT_STRUCTS_H
@@ -42,18 +42,18 @@ void
 spindump_qrlosstracker_observeandcalculateloss(struct spindump_analyze *state,
                                                struct spindump_packet *packet,
                                                struct spindump_connection *connection,
-                                               struct timeval *ts,
+                                               spindump_time *ts,
                                                int fromResponder,
                                                unsigned int ipPacketLength,
                                                int lossbits) {
   struct spindump_qrlosstracker *tracker;
   struct spindump_qrloss *lossRates;
   if (fromResponder) {
-    tracker = &connection->u.quic.qrFromPeer2to1;
-    lossRates = &connection->u.quic.qrLossesFrom2to1;
+    tracker = &connection->u.quic.trackers->qrFromPeer2to1;
+    lossRates = &connection->u.quic.trackers->qrLossesFrom2to1;
   } else {
-    tracker = &connection->u.quic.qrFromPeer1to2;
-    lossRates = &connection->u.quic.qrLossesFrom1to2;
+    tracker = &connection->u.quic.trackers->qrFromPeer1to2;
+    lossRates = &connection->u.quic.trackers->qrLossesFrom1to2;
   }
 
   //
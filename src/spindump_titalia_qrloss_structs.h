@@ -56,12 +56,12 @@ struct spindump_qrlosstracker {
   int currentSquareBit;
   spindump_counter_32bit squarePktCounter;
   spindump_counter_32bit holdingSquarePktCounter;
-  //struct timeval lastSquareTime;
+  //spindump_time lastSquareTime;
 
   int currentRefSquareBit;
   spindump_counter_32bit refSquarePktCounter;
   spindump_counter_32bit holdingRefSquarePktCounter;
-  //struct timeval lastRefSquareTime;
+  //spindump_time lastRefSquareTime;
 
   // Stats fields
   int refSquareStarting;
@@ -39,7 +39,7 @@ void
 spindump_rtloss1tracker_observeandcalculateloss(struct spindump_analyze* state,
                                                 struct spindump_packet* packet,
                                                 struct spindump_connection* connection,
-                                                struct timeval* ts,
+                                                spindump_time* ts,
                                                 int fromResponder,
                                                 unsigned int ipPacketLength,
                                                 spindump_extrameas_int extrameasbits,
@@ -55,8 +55,8 @@ spindump_rtloss1tracker_observeandcalculateloss(struct spindump_analyze* state,
   //
   
   struct spindump_rtloss1tracker* tracker;
-  if (fromResponder) tracker = &connection->u.quic.rtloss1FromPeer2to1;
-  else tracker = &connection->u.quic.rtloss1FromPeer1to2;
+  if (fromResponder) tracker = &connection->u.quic.trackers->rtloss1FromPeer2to1;
+  else tracker = &connection->u.quic.trackers->rtloss1FromPeer1to2;
 
   //
   // Compute round trip loss
@@ -146,7 +146,7 @@ void
 spindump_rtloss2tracker_observeandcalculateloss(struct spindump_analyze *state,
                                                 struct spindump_packet *packet,
                                                 struct spindump_connection *connection,
-                                                struct timeval *ts,
+                                                spindump_time *ts,
                                                 int fromResponder,
                                                 unsigned int ipPacketLength,
                                                 spindump_extrameas_int extrameasbits) {
@@ -161,8 +161,8 @@ spindump_rtloss2tracker_observeandcalculateloss(struct spindump_analyze *state,
   //
 
   struct spindump_rtloss2tracker *tracker;
-  if (fromResponder) tracker = &connection->u.quic.rtloss2FromPeer2to1;
-  else tracker = &connection->u.quic.rtloss2FromPeer1to2;
+  if (fromResponder) tracker = &connection->u.quic.trackers->rtloss2FromPeer2to1;
+  else tracker = &connection->u.quic.trackers->rtloss2FromPeer1to2;
   tracker->markedPktCounter++;
 
   //
@@ -170,7 +170,7 @@ spindump_rtloss2tracker_observeandcalculateloss(struct spindump_analyze *state,
   //
   
   unsigned long long timestamp;
-  spindump_timeval_to_timestamp(ts, &timestamp);
+  spindump_time_to_timestamp(ts, &timestamp);
 
   if (lossbits == 1) {
     if (tracker->reflectionPhase && timestamp > tracker->lockCounterTime) {
@@ -190,7 +190,7 @@ spindump_rtloss2tracker_observeandcalculateloss(struct spindump_analyze *state,
         spindump_warnf("rtloss2 rflCounter (%u) is greater than genCounter (%u), triggered at %lu (usec)",
                        tracker->rflCounter,
                        tracker->genCounter,
-                       tracker->lastRflTime.tv_usec);
+                       (unsigned long)((tracker->lastRflTime % spindump_time_nsecspersec) / spindump_time_nsecsperusec));
 
       } else if (tracker->genCounter > 0) {
         uint32_t losses = tracker->genCounter - tracker->rflCounter;
@@ -37,7 +37,7 @@ void
 spindump_rtloss1tracker_observeandcalculateloss(struct spindump_analyze* state,
                                                 struct spindump_packet* packet,
                                                 struct spindump_connection* connection,
-                                                struct timeval* ts,
+                                                spindump_time* ts,
                                                 int fromResponder,
                                                 unsigned int ipPacketLength,
                                                 spindump_extrameas_int extrameasbits,
@@ -46,7 +46,7 @@ void
 spindump_rtloss2tracker_observeandcalculateloss(struct spindump_analyze* state,
                                                 struct spindump_packet* packet,
                                                 struct spindump_connection* connection,
-                                                struct timeval* ts,
+                                                spindump_time* ts,
                                                 int fromResponder,
                                                 unsigned int ipPacketLength,
                                                 spindump_extrameas_int extrameasbits);
@@ -54,7 +54,7 @@ struct spindump_rtloss1tracker {
   int isLastSpinPeriodEmpty;
   spindump_counter_32bit currentCounter;
   spindump_counter_32bit previousCounter;
-  struct timeval lastLossTime;
+  spindump_time lastLossTime;
   // Stats fields
   spindump_counter_32bit markedPktCounter;
   spindump_counter_32bit generatedPktCounter;
@@ -69,7 +69,7 @@ struct spindump_rtloss2tracker {
     spindump_counter_32bit genCounter;
     spindump_counter_32bit rflCounter;
     unsigned long long lockCounterTime;
-    struct timeval lastRflTime;
+    spindump_time lastRflTime;
     // Stats fields
     spindump_counter_32bit markedPktCounter;
     spindump_counter_32bit generatedPktCounter;
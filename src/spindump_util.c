@@ -30,15 +30,29 @@
 #include <sys/time.h>
 #include <arpa/inet.h>
 #include <ifaddrs.h>
+#include <pthread.h>
 #include "spindump_util.h"
 
+//
+// Variables ----------------------------------------------------------------------------------
+//
+
+static unsigned long spindump_anon_seed = 0;
+static pthread_once_t spindump_anon_seed_once = PTHREAD_ONCE_INIT;
+static struct ifaddrs* spindump_address_interfaces = 0;
+static pthread_once_t spindump_address_interfaces_once = PTHREAD_ONCE_INIT;
+
 //
 // Function prototypes ------------------------------------------------------------------------
 //
 
+static void
+spindump_address_getinterfaces(void);
 static int
 spindump_address_islocalbroadcast(uint32_t address);
 static void
+spindump_anon_setseed(void);
+static void
 spindump_anon_aux(unsigned long seed,
                   unsigned char* bytes,
                   unsigned int length);
@@ -52,7 +66,7 @@ spindump_anon_aux(unsigned long seed,
 //
 
 void
-spindump_getcurrenttime(struct timeval* result) {
+spindump_getcurrenttime(spindump_time* result) {
 
   //
   // Sanity checks
@@ -64,9 +78,10 @@ spindump_getcurrenttime(struct timeval* result) {
   // Get the time, see if we can get it
   //
   
-  if (gettimeofday(result, 0) < 0) {
-    spindump_errorp("cannot determine current time via gettimeofday");
-    result->tv_sec = result->tv_usec = 0;
+  struct timespec now;
+  if (clock_gettime(CLOCK_REALTIME, &now) < 0) {
+    spindump_errorp("cannot determine current time via clock_gettime");
+    *result = 0;
     return;
   }
 
@@ -74,49 +89,43 @@ spindump_getcurrenttime(struct timeval* result) {
   // Sanity check the value gotten
   //
   
-  if (result->tv_usec >= 1000 * 1000) {
-    spindump_errorf("cannot have usec value greater than 1 000 000, got %lu", result->tv_usec);
-    result->tv_sec = result->tv_usec = 0;
+  if (now.tv_nsec < 0 || (unsigned long long)now.tv_nsec >= spindump_time_nsecspersec) {
+    spindump_errorf("cannot have nsec value greater than 1 000 000 000, got %ld", now.tv_nsec);
+    *result = 0;
     return;
   }
-  
+
+  *result = ((unsigned long long)now.tv_sec) * spindump_time_nsecspersec + (unsigned long long)now.tv_nsec;
 }
 
 //
-// Time subtraction
+// Time subtraction, in nanoseconds
 //
 
 unsigned long long
-spindump_timediffinusecs(const struct timeval* later,
-                         const struct timeval* earlier) {
+spindump_timediffinnsecs(const spindump_time* later,
+                         const spindump_time* earlier) {
   
   spindump_assert(earlier != 0);
   spindump_assert(later != 0);
-  spindump_assert(later->tv_usec < 1000 * 1000);
-  spindump_assert(earlier->tv_usec < 1000 * 1000);
   
-  if (later->tv_sec < earlier->tv_sec) {
-    spindump_errorf("expected later time to be greater, seconds go back %lus", earlier->tv_sec - later->tv_sec);
+  if (*later < *earlier) {
+    spindump_errorf("expected later time to be greater, time goes back %lluns (%llu to %llu)",
+                    *earlier - *later,
+                    *earlier, *later);
     return(0);
   }
-  if (later->tv_sec == earlier->tv_sec) {
-    if (later->tv_usec < earlier->tv_usec) {
-      spindump_errorf("spindump_timediffinusec: expected later time to be greater, secs both %lus, microsecond go back %luus (%lu to %lu)",
-                      earlier->tv_sec,
-                      earlier->tv_usec - later->tv_usec,
-                      earlier->tv_usec, later->tv_usec);
-      return(0);
-    } else {
-      return(((unsigned long long)later->tv_usec) - ((unsigned long long)earlier->tv_usec));
-    }
-  } else {
-    unsigned long long result = 1000 * 1000 * (((unsigned long long)later->tv_sec) -
-                                               ((unsigned long long)earlier->tv_sec) -
-                                               1);
-    result += ((unsigned long long)(1000*1000)) - (unsigned long long)earlier->tv_usec;
-    result += (unsigned long long)later->tv_usec;
-    return(result);
-  }
+  return(*later - *earlier);
+}
+
+//
+// Time subtraction, in microseconds
+//
+
+unsigned long long
+spindump_timediffinusecs(const spindump_time* later,
+                         const spindump_time* earlier) {
+  return(spindump_timediffinnsecs(later,earlier) / spindump_time_nsecsperusec);
 }
 
 //
@@ -125,21 +134,11 @@ spindump_timediffinusecs(const struct timeval* later,
 // 
 
 int
-spindump_isearliertime(const struct timeval* later,
-                       const struct timeval* earlier) {
+spindump_isearliertime(const spindump_time* later,
+                       const spindump_time* earlier) {
   spindump_assert(later != 0);
   spindump_assert(earlier != 0);
-  spindump_assert(later->tv_usec < 1000 * 1000);
-  spindump_assert(earlier->tv_usec < 1000 * 1000);
-  
-  if (earlier->tv_sec < later->tv_sec) {
-    return(1);
-  } else if (earlier->tv_sec == later->tv_sec &&
-             earlier->tv_usec < later->tv_usec) {
-    return(1);
-  } else {
-    return(0);
-  }
+  return(*earlier < *later);
 }
 
 //
@@ -147,9 +146,9 @@ spindump_isearliertime(const struct timeval* later,
 //
 
 void
-spindump_zerotime(struct timeval* result) {
+spindump_zerotime(spindump_time* result) {
   spindump_assert(result != 0);
-  memset(result,0,sizeof(*result));
+  *result = 0;
 }
 
 //
@@ -158,51 +157,69 @@ spindump_zerotime(struct timeval* result) {
 //
 
 const char*
-spindump_timetostring(const struct timeval* input,
+spindump_timetostring(const spindump_time* input,
                       char* output,
                       size_t outputLength) {
   spindump_assert(input != 0);
   spindump_assert(output != 0);
   spindump_assert(outputLength > 0);
   struct tm t;
-  localtime_r(&input->tv_sec,&t);
+  time_t seconds = (time_t)(*input / spindump_time_nsecspersec);
+  localtime_r(&seconds,&t);
   memset(output,0,outputLength);
   snprintf(output,outputLength - 1,"%02lu:%02lu:%02lu.%06lu",
            (unsigned long)t.tm_hour,
            (unsigned long)t.tm_min,
            (unsigned long)t.tm_sec,
-           (unsigned long)input->tv_usec);
+           (unsigned long)((*input % spindump_time_nsecspersec) / spindump_time_nsecsperusec));
   return(output);
 }
 
 //
-// Convert timeval (struct) to a timestamp (nr. useconds from 1970 Jan
-// 1).
+// Convert a time to a timestamp (nr. useconds from 1970 Jan 1).
 //
 
 void
-spindump_timeval_to_timestamp(const struct timeval* timev,
-                              unsigned long long* timestamp) {
-  spindump_assert(timev != 0);
+spindump_time_to_timestamp(const spindump_time* time,
+                           unsigned long long* timestamp) {
+  spindump_assert(time != 0);
   spindump_assert(timestamp != 0);
-  *timestamp = (unsigned long long)(timev->tv_usec);
-  *timestamp += 1000 * 1000 * (unsigned long long)(timev->tv_sec);
+  *timestamp = *time / spindump_time_nsecsperusec;
 }
 
 //
-// Convert a timestamp (nr. useconds from 1970 Jan 1) to a timeval
-// (struct).
+// Convert a timestamp (nr. useconds from 1970 Jan 1) to a time.
 //
 
 void
-spindump_timestamp_to_timeval(const unsigned long long timestamp,
-                              struct timeval* timev) {
-  spindump_deepdeepdebugf("spindump_timestamp_to_timeval %llu",
+spindump_timestamp_to_time(const unsigned long long timestamp,
+                           spindump_time* time) {
+  spindump_deepdeepdebugf("spindump_timestamp_to_time %llu",
                           timestamp);
   spindump_assert(timestamp != 0);
+  spindump_assert(time != 0);
+  *time = timestamp * spindump_time_nsecsperusec;
+}
+
+//
+// Convert timeval (struct) to a time. If nanoseconds is set, the
+// tv_usec field holds nanoseconds, as in PCAP headers with nanosecond
+// precision.
+//
+
+void
+spindump_timeval_to_time(const struct timeval* timev,
+                         int nanoseconds,
+                         spindump_time* time) {
   spindump_assert(timev != 0);
-  timev->tv_sec = timestamp / (1000*1000);
-  timev->tv_usec = timestamp % (1000*1000);
+  spindump_assert(spindump_isbool(nanoseconds));
+  spindump_assert(time != 0);
+  *time = ((unsigned long long)timev->tv_sec) * spindump_time_nsecspersec;
+  if (nanoseconds) {
+    *time += (unsigned long long)timev->tv_usec;
+  } else {
+    *time += ((unsigned long long)timev->tv_usec) * spindump_time_nsecsperusec;
+  }
 }
 
 //
@@ -284,9 +301,17 @@ spindump_address_length(const spindump_address* address) {
 }
 
 //
-// Multicast address check
+// Read the local interface addresses, once, also when called from
+// several threads
 //
-// Note: This function is not thread safe.
+
+static void
+spindump_address_getinterfaces(void) {
+  if (getifaddrs(&spindump_address_interfaces) != 0) spindump_address_interfaces = 0;
+}
+
+//
+// Multicast address check
 //
 
 static int
@@ -302,11 +327,8 @@ spindump_address_islocalbroadcast(uint32_t address) {
   // updated.
   // 
 
-  static struct ifaddrs* interfaces = 0;
-
-  if (interfaces == 0) {
-    getifaddrs(&interfaces);
-  }
+  pthread_once(&spindump_address_interfaces_once,spindump_address_getinterfaces);
+  struct ifaddrs* interfaces = spindump_address_interfaces;
   
   if (interfaces == 0) {
     
@@ -702,14 +724,14 @@ spindump_address_tobytes(const spindump_address* address,
 // Convert an address to a string. Returned string need not be freed,
 // but will not survive the next call to this same function.
 //
-// Note: This function is not thread safe.
+// Note: the returned buffer is per thread.
 //
 
 const char*
 spindump_address_tostring(const spindump_address* address) {
   spindump_assert(address != 0);
   spindump_assert(address->ss_family != 0);
-  static char buf[100];
+  static _Thread_local char buf[100];
   memset(buf,0,sizeof(buf));
   switch (address->ss_family) {
   case AF_INET:
@@ -731,6 +753,18 @@ spindump_address_tostring(const spindump_address* address) {
   return(buf);
 }
 
+//
+// Pick the random seed for anonymization. This is done only once,
+// even with several analysis threads, so that each address gets the
+// same pseudonym in all of them.
+//
+
+static void
+spindump_anon_setseed(void) {
+  spindump_anon_seed = (unsigned long)rand();
+  if (spindump_anon_seed == 0) spindump_anon_seed = 1;
+}
+
 //
 // Map a set of bytes to an anonymized set of bytes
 //
@@ -780,8 +814,8 @@ spindump_address_tostring_anon(int anonymize,
   // mapping from real addresses to sha1 of the real address.
   //
 
-  static unsigned long seed = 0;
-  if (seed == 0) seed = (unsigned long)rand();
+  pthread_once(&spindump_anon_seed_once,spindump_anon_setseed);
+  unsigned long seed = spindump_anon_seed;
   
   //
   // Map the input address to another address
@@ -853,12 +887,12 @@ spindump_network_fromstring(spindump_network* network,
 // need not be freed, but will not survive the next call to this same
 // function.
 //
-// Note: This function is not thread safe.
+// Note: the returned buffer is per thread.
 //
 
 const char*
 spindump_network_tostring(const  spindump_network* network) {
-  static char buf[100];
+  static _Thread_local char buf[100];
   memset(buf,0,sizeof(buf));
   snprintf(buf, sizeof(buf)-1, "%s/%u",
            spindump_address_tostring(&network->address),
@@ -936,12 +970,12 @@ spindump_network_fromempty(sa_family_t af,
 // Convert a large number to a string, e.g., 1000000 would become
 // "1M".
 //
-// Note: This function is not thread safe.
+// Note: the returned buffer is per thread.
 //
 
 const char*
 spindump_meganumber_tostring(unsigned long x) {
-  static char buf[50];
+  static _Thread_local char buf[50];
   const char* u;
   const unsigned long thou = 1000;
   unsigned long f;
@@ -972,12 +1006,12 @@ spindump_meganumber_tostring(unsigned long x) {
 // Convert a large number to a string, e.g., 1000000 would become
 // "1M". The input is a "long long".
 //
-// Note: This function is not thread safe.
+// Note: the returned buffer is per thread.
 //
 
 const char*
 spindump_meganumberll_tostring(unsigned long long x) {
-  static char buf[100];
+  static _Thread_local char buf[100];
   const char* u;
   const unsigned long long thou = 1000;
   unsigned long long f;
@@ -46,7 +46,7 @@
 #define spindump_max(a,b)       ((a) > (b) ? (a) : (b))
 #define spindump_min(a,b)       ((a) < (b) ? (a) : (b))
 #define spindump_isbool(x)      ((x) == 0 || (x) == 1)
-#define spindump_iszerotime(x)  ((x)->tv_sec == 0)
+#define spindump_iszerotime(x)  (*(x) == 0)
 
 #ifdef SPINDUMP_MEMDEBUG
 #define spindump_malloc(x) spindump_memdebug_malloc(x)
@@ -64,6 +64,7 @@
 
 typedef uint32_t spindump_counter_32bit;
 typedef unsigned long long spindump_counter_64bit;
+typedef unsigned long long spindump_time;           // nanoseconds since 1970 Jan 1
 typedef struct sockaddr_storage spindump_address;
 typedef struct {
   spindump_address address;
@@ -71,6 +72,9 @@ typedef struct {
   unsigned int padding; // unused
 } spindump_network;
 
+#define spindump_time_nsecspersec  (1000ULL * 1000 * 1000)
+#define spindump_time_nsecsperusec 1000ULL
+
 //
 // Configuration variables --------------------------------------------------------------------
 //
@@ -84,25 +88,32 @@ extern int spindump_deepdeepdebug;
 //
 
 void
-spindump_getcurrenttime(struct timeval* result);
+spindump_getcurrenttime(spindump_time* result);
+unsigned long long
+spindump_timediffinusecs(const spindump_time* later,
+                         const spindump_time* earlier);
 unsigned long long
-spindump_timediffinusecs(const struct timeval* later,
-                         const struct timeval* earlier);
+spindump_timediffinnsecs(const spindump_time* later,
+                         const spindump_time* earlier);
 int
-spindump_isearliertime(const struct timeval* later,
-                       const struct timeval* earlier);
+spindump_isearliertime(const spindump_time* later,
+                       const spindump_time* earlier);
 void
-spindump_zerotime(struct timeval* result);
+spindump_zerotime(spindump_time* result);
 const char*
-spindump_timetostring(const struct timeval* input,
+spindump_timetostring(const spindump_time* input,
                       char* output,
                       size_t outputLength);
 void
-spindump_timeval_to_timestamp(const struct timeval* timev,
-                              unsigned long long* timestamp);
+spindump_time_to_timestamp(const spindump_time* time,
+                           unsigned long long* timestamp);
+void
+spindump_timestamp_to_time(const unsigned long long timestamp,
+                           spindump_time* time);
 void
-spindump_timestamp_to_timeval(const unsigned long long timestamp,
-                              struct timeval* timev);
+spindump_timeval_to_time(const struct timeval* timev,
+                         int nanoseconds,
+                         spindump_time* time);
 void
 spindump_address_fromempty(sa_family_t af,
                            spindump_address* address);
@@ -20,6 +20,7 @@
 // Includes -----------------------------------------------------------------------------------
 //
 
+#include <pthread.h>
 #include "spindump_util.h"
 
 //
@@ -29,14 +30,14 @@
 // Table of CRCs of all 8-bit messages. Taken from RFC 1952.
 static unsigned long crc_table[256];
 
-// Flag: has the table been computed? Initially false. Taken from RFC 1952.
-static int crc_table_computed = 0;
+// Computes the table once, also when called from several threads.
+static pthread_once_t crc_table_once = PTHREAD_ONCE_INIT;
 
 // 32 lowest bits of CRC-32c (Castagnoli93) generator polynomial.
 static const uint32_t spindump_crc32c_poly = 0x1edc6f41UL;
 
 static uint32_t spindump_crc32c_table[256];
-static int spindump_crc32c_setup_done;
+static pthread_once_t spindump_crc32c_setup_once = PTHREAD_ONCE_INIT;
 
 //
 // Function prototypes ------------------------------------------------------------------------
@@ -68,7 +69,6 @@ spindump_crc_maketable(void) {
     }
     crc_table[n] = c;
   }
-  crc_table_computed = 1;
 }
 
 //
@@ -94,9 +94,7 @@ spindump_crc_update(unsigned long crc,
   
   unsigned long c = crc ^ 0xffffffffL;
   
-  if (!crc_table_computed) {
-    spindump_crc_maketable();
-  }
+  pthread_once(&crc_table_once,spindump_crc_maketable);
   
   for (unsigned int n = 0; n < len; n++) {
     c = crc_table[(c ^ buf[n]) & 0xff] ^ (c >> 8);
@@ -163,10 +161,7 @@ spindump_crc32c_setup(void)
 uint32_t
 spindump_crc32c_init(void)
 {
-  if (!spindump_crc32c_setup_done) {
-    spindump_crc32c_setup_done = 1;
-    spindump_crc32c_setup();
-  }
+  pthread_once(&spindump_crc32c_setup_once,spindump_crc32c_setup);
   return 0xffffffff;
 }
 